@@ -6,6 +6,7 @@
 
 #include <lttng/tracepoint.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_tracef, event,
 	LTTNG_UST_TP_ARGS(const char *, msg, unsigned int, len, void *, ip),
@@ -15,3 +16,30 @@ LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_tracef, event,
 	)
 )
 LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_tracef, event, LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG)
+
+/*
+ * Deferred-format events: the format string of a call site is recorded
+ * once by the format event, or by the lttng_ust_statedump:tracef_format
+ * statedump event, and each deferred event only records the call site
+ * id along with the raw argument values.
+ */
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_tracef, deferred,
+	LTTNG_UST_TP_ARGS(const void *, site, const uint8_t *, args,
+		unsigned int, len, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(unsigned long, site, (unsigned long) site)
+		lttng_ust_field_sequence_hex(uint8_t, args, args, unsigned int, len)
+		lttng_ust_field_unused(ip)
+	)
+)
+LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_tracef, deferred, LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG)
+
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_tracef, format,
+	LTTNG_UST_TP_ARGS(const void *, site, const char *, fmt, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(unsigned long, site, (unsigned long) site)
+		lttng_ust_field_string(fmt, fmt)
+		lttng_ust_field_unused(ip)
+	)
+)
+LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_tracef, format, LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG)
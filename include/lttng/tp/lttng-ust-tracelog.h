@@ -6,6 +6,7 @@
 
 #include <lttng/tracepoint.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 LTTNG_UST_TRACEPOINT_EVENT_CLASS(lttng_ust_tracelog, tlclass,
 	LTTNG_UST_TP_ARGS(const char *, file, int, line, const char *, func,
@@ -19,13 +20,50 @@ LTTNG_UST_TRACEPOINT_EVENT_CLASS(lttng_ust_tracelog, tlclass,
 	)
 )
 
+/*
+ * Deferred-format events, see lttng-ust-tracef.h. The descriptor of a
+ * call site (log level, file, line, function and format) is recorded
+ * once by the format event, or by the lttng_ust_statedump:tracef_format
+ * statedump event.
+ */
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(lttng_ust_tracelog, tldclass,
+	LTTNG_UST_TP_ARGS(const void *, site, const uint8_t *, args,
+		unsigned int, len, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(unsigned long, site, (unsigned long) site)
+		lttng_ust_field_sequence_hex(uint8_t, args, args, unsigned int, len)
+		lttng_ust_field_unused(ip)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_tracelog, format,
+	LTTNG_UST_TP_ARGS(const void *, site,
+		const struct lttng_ust_tracef_site *, desc, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(unsigned long, site, (unsigned long) site)
+		lttng_ust_field_integer(int, loglevel, desc->loglevel)
+		lttng_ust_field_integer(int, line, desc->line)
+		lttng_ust_field_string(file, desc->file)
+		lttng_ust_field_string(func, desc->func)
+		lttng_ust_field_string(fmt, desc->fmt)
+		lttng_ust_field_unused(ip)
+	)
+)
+LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_tracelog, format, LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG)
+
 #define LTTNG_UST_TP_TRACELOG_TEMPLATE(_level_enum) \
 	LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_tracelog, tlclass, \
 		lttng_ust_tracelog, _level_enum, \
 		LTTNG_UST_TP_ARGS(const char *, file, int, line, const char *, func, \
 			const char *, msg, unsigned int, len, void *, ip) \
 	) \
-	LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_tracelog, _level_enum, _level_enum)
+	LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_tracelog, _level_enum, _level_enum) \
+	LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_tracelog, tldclass, \
+		lttng_ust_tracelog, deferred_##_level_enum, \
+		LTTNG_UST_TP_ARGS(const void *, site, const uint8_t *, args, \
+			unsigned int, len, void *, ip) \
+	) \
+	LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_tracelog, deferred_##_level_enum, _level_enum)
 
 LTTNG_UST_TP_TRACELOG_TEMPLATE(LTTNG_UST_TRACEPOINT_LOGLEVEL_EMERG)
 LTTNG_UST_TP_TRACELOG_TEMPLATE(LTTNG_UST_TRACEPOINT_LOGLEVEL_ALERT)
@@ -35,6 +35,28 @@ void lttng_ust__vtracef(const char *fmt, va_list ap)
 			lttng_ust__vtracef(fmt, ap);		\
 	} while (0)
 
+extern
+void lttng_ust__tracef_deferred(struct lttng_ust_tracef_site *site,
+		const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/*
+ * Like lttng_ust_tracef(), but the message is formatted offline: the
+ * event only records the raw argument values, and the format string,
+ * which must be a string literal, is recorded once per call site.
+ */
+#define lttng_ust_tracef_deferred(fmt, ...)					\
+	do {								\
+		static struct lttng_ust_tracef_site lttng_ust__tracef_site = { \
+			sizeof(struct lttng_ust_tracef_site), "" fmt, 0, 0, 0, 0, \
+			LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG,		\
+		};							\
+		LTTNG_UST_STAP_PROBEV(tracepoint_lttng_ust_tracef, deferred, ## __VA_ARGS__); \
+		if (caa_unlikely(lttng_ust_tracepoint_lttng_ust_tracef___deferred.state)) \
+			lttng_ust__tracef_deferred(&lttng_ust__tracef_site, \
+				fmt, ## __VA_ARGS__);			\
+	} while (0)
+
 #if LTTNG_UST_COMPAT_API(0)
 #define tracef		lttng_ust_tracef
 #endif
@@ -22,7 +22,11 @@ extern "C" {
 	extern void lttng_ust__vtracelog_##level(const char *file,	\
 		int line, const char *func, const char *fmt,		\
 		va_list ap)						\
-		__attribute__ ((format(printf, 4, 0)));
+		__attribute__ ((format(printf, 4, 0)));			\
+									\
+	extern void lttng_ust__tracelog_deferred_##level(		\
+		struct lttng_ust_tracef_site *site, const char *fmt, ...) \
+		__attribute__ ((format(printf, 2, 3)));
 
 LTTNG_UST_TP_TRACELOG_CB_TEMPLATE(LTTNG_UST_TRACEPOINT_LOGLEVEL_EMERG);
 LTTNG_UST_TP_TRACELOG_CB_TEMPLATE(LTTNG_UST_TRACEPOINT_LOGLEVEL_ALERT);
@@ -42,6 +46,12 @@ LTTNG_UST_TP_TRACELOG_CB_TEMPLATE(LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG);
 
 #undef LTTNG_UST_TP_TRACELOG_CB_TEMPLATE
 
+/*
+ * Each log level is a distinct tracepoint, registered only when an
+ * enabler whose log level selector matches that level is enabled: the
+ * tracepoint state therefore already acts as the minimum enabled log
+ * level, and the message is not formatted for rejected levels.
+ */
 #define lttng_ust_tracelog(level, fmt, ...)					\
 	do {								\
 		LTTNG_UST_STAP_PROBEV(tracepoint_lttng_ust_tracelog, level, ## __VA_ARGS__); \
@@ -57,6 +67,24 @@ LTTNG_UST_TP_TRACELOG_CB_TEMPLATE(LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG);
 				fmt, ap);				\
 	} while (0)
 
+/*
+ * Like lttng_ust_tracelog(), but the message is formatted offline, see
+ * lttng_ust_tracef_deferred(). The file, line, function, log level and
+ * format of the call site are recorded once per call site rather than
+ * in each event.
+ */
+#define lttng_ust_tracelog_deferred(level, fmt, ...)			\
+	do {								\
+		static struct lttng_ust_tracef_site lttng_ust__tracelog_site = { \
+			sizeof(struct lttng_ust_tracef_site), "" fmt, 0, \
+			__FILE__, __func__, __LINE__, level,		\
+		};							\
+		LTTNG_UST_STAP_PROBEV(tracepoint_lttng_ust_tracelog, deferred_##level, ## __VA_ARGS__); \
+		if (caa_unlikely(lttng_ust_tracepoint_lttng_ust_tracelog___deferred_##level.state)) \
+			lttng_ust__tracelog_deferred_##level(&lttng_ust__tracelog_site, \
+				fmt, ## __VA_ARGS__);			\
+	} while (0)
+
 #if LTTNG_UST_COMPAT_API(0)
 #define TP_TRACELOG_CB_TEMPLATE LTTNG_UST_TP_TRACELOG_CB_TEMPLATE
 #define tracelog	lttng_ust_tracelog
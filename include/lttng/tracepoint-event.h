@@ -106,4 +106,7 @@
 #undef LTTNG_UST_TRACEPOINT_MODEL_EMF_URI
 #define LTTNG_UST_TRACEPOINT_MODEL_EMF_URI(provider, name, uri)
 
+#undef LTTNG_UST_TRACEPOINT_HOT
+#define LTTNG_UST_TRACEPOINT_HOT(provider, name)
+
 #endif /* LTTNG_UST_TRACEPOINT_CREATE_PROBES */
@@ -46,6 +46,59 @@ struct lttng_ust_tracepoint {
 	const char *signature;
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	/*
+	 * Sampling period of the lttng_ust_tracepoint_sampled() call
+	 * sites set at runtime, 0 to use the period of each call site.
+	 */
+	uint32_t sample_period;
+};
+
+/*
+ * Tracepoint static branch call site
+ *
+ * Emitted in the lttng_ust_static_branches section by each
+ * lttng_ust_tracepoint_enabled() call site when
+ * LTTNG_UST_TRACEPOINT_STATIC_BRANCH is defined. @site is the address
+ * of the patchable jump instruction, @target the address of the
+ * tracepoint state check the jump leads to, and @tp the tracepoint.
+ *
+ * IMPORTANT: this structure is part of the ABI between instrumented
+ * applications and UST. This structure is fixed-size because it is part
+ * of a section array.
+ */
+
+struct lttng_ust_tracepoint_static_branch {
+	void *site;
+	void *target;
+	struct lttng_ust_tracepoint *tp;
+};
+
+/*
+ * Tracef deferred-format call site descriptor, one per
+ * lttng_ust_tracef_deferred() or lttng_ust_tracelog_deferred() call.
+ * @file and @func are NULL for lttng_ust_tracef_deferred().
+ *
+ * IMPORTANT: this structure is part of the ABI between instrumented
+ * applications and UST. Fields need to be only added at the end, never
+ * reordered, never removed.
+ *
+ * The field @struct_size should be used to determine the size of the
+ * structure. It should be queried before using additional fields added
+ * at the end of the structure.
+ */
+
+struct lttng_ust_tracef_site {
+	uint32_t struct_size;
+
+	const char *fmt;
+	void *priv;		/* Private to liblttng-ust. */
+	const char *file;
+	const char *func;
+	int line;
+	int loglevel;
+
+	/* End of base ABI. Fields below should be used after checking struct_size. */
 };
 
 #endif /* _LTTNG_UST_TRACEPOINT_TYPES_H */
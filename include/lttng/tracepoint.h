@@ -7,6 +7,7 @@
 #ifndef _LTTNG_UST_TRACEPOINT_H
 #define _LTTNG_UST_TRACEPOINT_H
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <lttng/tracepoint-types.h>
@@ -59,8 +60,44 @@
 extern "C" {
 #endif
 
+#if defined(LTTNG_UST_TRACEPOINT_STATIC_BRANCH) && defined(__x86_64__)
+/*
+ * Static branch: the call site starts as an 8-byte aligned 5-byte jump
+ * to the regular tracepoint state check, which is always correct.
+ * liblttng-ust-tracepoint patches the jump into a 5-byte nop while the
+ * tracepoint is disabled, and back into the jump when it is enabled,
+ * so a disabled tracepoint costs a single nop. The call sites are
+ * listed in the lttng_ust_static_branches section, registered by the
+ * module defining the tracepoints. Call sites which cannot be patched
+ * keep the jump.
+ */
+#define lttng_ust_tracepoint_enabled(provider, name)				\
+	({									\
+		__label__ lttng_ust__tp_check, lttng_ust__tp_out;		\
+		int lttng_ust__tp_enabled = 0;					\
+										\
+		__asm__ goto (							\
+			".p2align 3\n\t"					\
+			"1: .byte 0xe9\n\t"					\
+			".long %l[lttng_ust__tp_check] - 2f\n\t"		\
+			"2:\n\t"						\
+			".pushsection lttng_ust_static_branches, \"aw\"\n\t"	\
+			".balign 8\n\t"						\
+			".quad 1b, %l[lttng_ust__tp_check], "			\
+				lttng_ust_stringify(lttng_ust_tracepoint_##provider##___##name) "\n\t" \
+			".popsection\n\t"					\
+			: : : : lttng_ust__tp_check);				\
+		goto lttng_ust__tp_out;						\
+	lttng_ust__tp_check:							\
+		lttng_ust__tp_enabled =						\
+			CMM_LOAD_SHARED(lttng_ust_tracepoint_##provider##___##name.state); \
+	lttng_ust__tp_out:							\
+		caa_unlikely(lttng_ust__tp_enabled);				\
+	})
+#else
 #define lttng_ust_tracepoint_enabled(provider, name)				\
 	caa_unlikely(CMM_LOAD_SHARED(lttng_ust_tracepoint_##provider##___##name.state))
+#endif
 
 #define lttng_ust_do_tracepoint(provider, name, ...)				\
 	lttng_ust_tracepoint_cb_##provider##___##name(__VA_ARGS__)
@@ -72,6 +109,70 @@ extern "C" {
 			lttng_ust_do_tracepoint(provider, name, __VA_ARGS__);	\
 	} while (0)
 
+/*
+ * Sampled tracepoint: each thread traces one hit out of @period of each
+ * lttng_ust_tracepoint_sampled() call site, unless the session daemon
+ * sets another period for the tracepoint. The sampling decision is taken
+ * once the tracepoint is known to be enabled, before the arguments are
+ * evaluated and the probes are called.
+ */
+static inline
+int lttng_ust_tracepoint_sample(const struct lttng_ust_tracepoint *tp,
+		uint32_t period, uint32_t *countdown)
+	__attribute__((always_inline, unused)) lttng_ust_notrace;
+static inline
+int lttng_ust_tracepoint_sample(const struct lttng_ust_tracepoint *tp,
+		uint32_t period, uint32_t *countdown)
+{
+	uint32_t tp_period = 0;
+
+	if (caa_likely(*countdown)) {
+		(*countdown)--;
+		return 0;
+	}
+	if (tp->struct_size >= offsetof(struct lttng_ust_tracepoint, sample_period)
+			+ sizeof(tp->sample_period))
+		tp_period = CMM_LOAD_SHARED(tp->sample_period);
+	if (tp_period)
+		period = tp_period;
+	*countdown = period ? period - 1 : 0;
+	return 1;
+}
+
+#define lttng_ust_tracepoint_sampled(provider, name, period, ...)		\
+	do {									\
+		static __thread uint32_t lttng_ust__tp_countdown;		\
+										\
+		LTTNG_UST_STAP_PROBEV(provider, name, ## __VA_ARGS__);		\
+		if (lttng_ust_tracepoint_enabled(provider, name)		\
+				&& lttng_ust_tracepoint_sample(			\
+					&lttng_ust_tracepoint_##provider##___##name, \
+					(period), &lttng_ust__tp_countdown))	\
+			lttng_ust_do_tracepoint(provider, name, __VA_ARGS__);	\
+	} while (0)
+
+/*
+ * Whether at least one session or event notifier group may record the
+ * event, checking the session, channel and event states and the filters
+ * which do not read the payload. Meant to be tested once
+ * lttng_ust_tracepoint_enabled() is true, before computing expensive
+ * arguments. True when the tracer cannot tell.
+ */
+#define lttng_ust_tracepoint_may_record(provider, name)			\
+	lttng_ust_tracepoint__may_record(&lttng_ust_tracepoint_##provider##___##name)
+
+/*
+ * Lazy tracepoint: @cb(@priv) is only called when the tracepoint is
+ * enabled and lttng_ust_tracepoint_may_record() is true. It computes the
+ * arguments and passes them to lttng_ust_do_tracepoint().
+ */
+#define lttng_ust_tracepoint_lazy(provider, name, cb, priv)			\
+	do {									\
+		if (lttng_ust_tracepoint_enabled(provider, name)		\
+				&& lttng_ust_tracepoint_may_record(provider, name)) \
+			(cb)(priv);						\
+	} while (0)
+
 #define LTTNG_UST_TP_ARGS(...)       __VA_ARGS__
 
 /*
@@ -207,6 +308,15 @@ void lttng_ust_tracepoint_cb_##_provider##___##_name(LTTNG_UST__TP_ARGS_PROTO(__
 	__tp_probe = lttng_ust_tp_rcu_dereference(lttng_ust_tracepoint_##_provider##___##_name.probes);	\
 	if (caa_unlikely(!__tp_probe))							\
 		goto end;								\
+	if (caa_likely(!__tp_probe[1].func)) {						\
+		/* Single probe connected, the common case: no loop. */			\
+		void (*__tp_cb)(void) = __tp_probe->func;				\
+		void *__tp_data = __tp_probe->data;					\
+											\
+		URCU_FORCE_CAST(void (*)(LTTNG_UST__TP_ARGS_DATA_PROTO(__VA_ARGS__)), __tp_cb)	\
+				(LTTNG_UST__TP_ARGS_DATA_VAR(__VA_ARGS__));			\
+		goto end;								\
+	}										\
 	do {										\
 		void (*__tp_cb)(void) = __tp_probe->func;				\
 		void *__tp_data = __tp_probe->data;					\
@@ -257,6 +367,15 @@ int lttng_ust_tracepoint_module_register(struct lttng_ust_tracepoint * const *tr
                              int tracepoints_count);
 int lttng_ust_tracepoint_module_unregister(struct lttng_ust_tracepoint * const *tracepoints_start);
 
+/*
+ * Registration of the static branch call sites of a module with
+ * lttng_ust_tracepoint_static_branch_register, unregistration with
+ * lttng_ust_tracepoint_static_branch_unregister.
+ */
+int lttng_ust_tracepoint_static_branch_register(struct lttng_ust_tracepoint_static_branch *branches_start,
+		int branches_count);
+int lttng_ust_tracepoint_static_branch_unregister(struct lttng_ust_tracepoint_static_branch *branches_start);
+
 /*
  * tracepoint dynamic linkage handling (callbacks). Hidden visibility:
  * shared across objects in a module/main executable.
@@ -282,11 +401,28 @@ struct lttng_ust_tracepoint_dlopen {
 	void *(*rcu_dereference_sym)(void *p);
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	int (*lttng_ust_tracepoint_static_branch_register)(struct lttng_ust_tracepoint_static_branch *branches_start,
+		int branches_count);
+	int (*lttng_ust_tracepoint_static_branch_unregister)(struct lttng_ust_tracepoint_static_branch *branches_start);
+	int (*tracepoint_may_record_sym)(struct lttng_ust_tracepoint *tp);
 };
 
 extern struct lttng_ust_tracepoint_dlopen lttng_ust_tracepoint_dlopen;
 extern struct lttng_ust_tracepoint_dlopen *lttng_ust_tracepoint_dlopen_ptr;
 
+static inline
+int lttng_ust_tracepoint__may_record(struct lttng_ust_tracepoint *tp)
+	__attribute__((always_inline, unused)) lttng_ust_notrace;
+static inline
+int lttng_ust_tracepoint__may_record(struct lttng_ust_tracepoint *tp)
+{
+	if (caa_unlikely(!lttng_ust_tracepoint_dlopen_ptr
+			|| !lttng_ust_tracepoint_dlopen_ptr->tracepoint_may_record_sym))
+		return 1;
+	return lttng_ust_tracepoint_dlopen_ptr->tracepoint_may_record_sym(tp);
+}
+
 /*
  * These weak symbols, the constructor, and destructor take care of
  * registering only _one_ instance of the tracepoints per shared-ojbect
@@ -395,6 +531,19 @@ lttng_ust_tracepoint__init_urcu_sym(void)
 }
 #endif
 
+static inline void
+lttng_ust_tracepoint__init_may_record_sym(void)
+	lttng_ust_notrace;
+static inline void
+lttng_ust_tracepoint__init_may_record_sym(void)
+{
+	if (!lttng_ust_tracepoint_dlopen_ptr->tracepoint_may_record_sym)
+		lttng_ust_tracepoint_dlopen_ptr->tracepoint_may_record_sym =
+			URCU_FORCE_CAST(int (*)(struct lttng_ust_tracepoint *),
+				dlsym(lttng_ust_tracepoint_dlopen_ptr->liblttngust_handle,
+					"lttng_ust_tp_probe_may_record"));
+}
+
 /*
  * Use getenv() directly and bypass lttng-ust helper functions
  * because we may not have access to lttng-ust shared libraries.
@@ -454,6 +603,7 @@ lttng_ust__tracepoints__init(void)
 		if (!lttng_ust_tracepoint_dlopen_ptr->liblttngust_handle)
 			return;
 		lttng_ust_tracepoint__init_urcu_sym();
+		lttng_ust_tracepoint__init_may_record_sym();
 		return;
 	}
 
@@ -467,6 +617,7 @@ lttng_ust__tracepoints__init(void)
 		return;
 	}
 	lttng_ust_tracepoint__init_urcu_sym();
+	lttng_ust_tracepoint__init_may_record_sym();
 }
 
 static void
@@ -525,6 +676,16 @@ extern struct lttng_ust_tracepoint * const __start_lttng_ust_tracepoints_ptrs[]
 extern struct lttng_ust_tracepoint * const __stop_lttng_ust_tracepoints_ptrs[]
 	__attribute__((weak, visibility("hidden")));
 
+/*
+ * Static branch call sites of the module, emitted by the compile units
+ * defining LTTNG_UST_TRACEPOINT_STATIC_BRANCH. Those symbols are NULL
+ * when the module has none.
+ */
+extern struct lttng_ust_tracepoint_static_branch __start_lttng_ust_static_branches[]
+	__attribute__((weak, visibility("hidden")));
+extern struct lttng_ust_tracepoint_static_branch __stop_lttng_ust_static_branches[]
+	__attribute__((weak, visibility("hidden")));
+
 /*
  * When LTTNG_UST_TRACEPOINT_PROBE_DYNAMIC_LINKAGE is defined, we do not emit a
  * unresolved symbol that requires the provider to be linked in. When
@@ -574,6 +735,7 @@ extern struct lttng_ust_tracepoint * const __stop_lttng_ust_tracepoints_ptrs[]
 			NULL,							\
 			LTTNG_UST__TRACEPOINT_UNDEFINED_REF(_provider), 	\
 			LTTNG_UST__TP_EXTRACT_STRING(_args),			\
+			0,							\
 		};								\
 	static struct lttng_ust_tracepoint *					\
 		lttng_ust_tracepoint_ptr_##_provider##___##_name			\
@@ -608,6 +770,14 @@ lttng_ust__tracepoints__ptrs_init(void)
 		URCU_FORCE_CAST(int (*)(struct lttng_ust_tracepoint * const *),
 				dlsym(lttng_ust_tracepoint_dlopen_ptr->liblttngust_handle,
 					"lttng_ust_tracepoint_module_unregister"));
+	lttng_ust_tracepoint_dlopen_ptr->lttng_ust_tracepoint_static_branch_register =
+		URCU_FORCE_CAST(int (*)(struct lttng_ust_tracepoint_static_branch *, int),
+				dlsym(lttng_ust_tracepoint_dlopen_ptr->liblttngust_handle,
+					"lttng_ust_tracepoint_static_branch_register"));
+	lttng_ust_tracepoint_dlopen_ptr->lttng_ust_tracepoint_static_branch_unregister =
+		URCU_FORCE_CAST(int (*)(struct lttng_ust_tracepoint_static_branch *),
+				dlsym(lttng_ust_tracepoint_dlopen_ptr->liblttngust_handle,
+					"lttng_ust_tracepoint_static_branch_unregister"));
 	lttng_ust_tracepoint_destructors_syms_ptr->tracepoint_disable_destructors =
 		URCU_FORCE_CAST(void (*)(void),
 				dlsym(lttng_ust_tracepoint_dlopen_ptr->liblttngust_handle,
@@ -622,6 +792,16 @@ lttng_ust__tracepoints__ptrs_init(void)
 				__stop_lttng_ust_tracepoints_ptrs -
 				__start_lttng_ust_tracepoints_ptrs);
 	}
+	/*
+	 * Register the static branch call sites after the tracepoints,
+	 * so they are patched according to the tracepoint state.
+	 */
+	if (__start_lttng_ust_static_branches
+			&& lttng_ust_tracepoint_dlopen_ptr->lttng_ust_tracepoint_static_branch_register) {
+		lttng_ust_tracepoint_dlopen_ptr->lttng_ust_tracepoint_static_branch_register(__start_lttng_ust_static_branches,
+				__stop_lttng_ust_static_branches -
+				__start_lttng_ust_static_branches);
+	}
 }
 
 static void
@@ -638,6 +818,9 @@ lttng_ust__tracepoints__ptrs_destroy(void)
 		lttng_ust_tracepoint_dlopen_ptr = &lttng_ust_tracepoint_dlopen;
 	if (!lttng_ust_tracepoint_destructors_syms_ptr)
 		lttng_ust_tracepoint_destructors_syms_ptr = &lttng_ust_tracepoint_destructors_syms;
+	if (__start_lttng_ust_static_branches
+			&& lttng_ust_tracepoint_dlopen_ptr->lttng_ust_tracepoint_static_branch_unregister)
+		lttng_ust_tracepoint_dlopen_ptr->lttng_ust_tracepoint_static_branch_unregister(__start_lttng_ust_static_branches);
 	if (lttng_ust_tracepoint_dlopen_ptr->lttng_ust_tracepoint_module_unregister)
 		lttng_ust_tracepoint_dlopen_ptr->lttng_ust_tracepoint_module_unregister(__start_lttng_ust_tracepoints_ptrs);
 	if (lttng_ust_tracepoint_dlopen_ptr->liblttngust_handle
@@ -860,6 +1043,22 @@ lttng_ust__tracepoints__ptrs_destroy(void)
 
 #endif /* #ifndef LTTNG_UST_TRACEPOINT_EVENT */
 
+#ifndef LTTNG_UST_TRACEPOINT_DECLARE
+
+/*
+ * LTTNG_UST_TRACEPOINT_DECLARE: declare the tracepoint of an event
+ * without its fields, as LTTNG_UST_TRACEPOINT_EVENT() does in the
+ * compile units which do not create the probes. A call-site header made
+ * of those declarations (see lttng-gen-tp(1)) spares the compile units
+ * which only use lttng_ust_tracepoint() the parsing of the fields of
+ * each event.
+ */
+#define LTTNG_UST_TRACEPOINT_DECLARE(provider, name, args)			\
+	LTTNG_UST__DECLARE_TRACEPOINT(provider, name, LTTNG_UST__TP_PARAMS(args))	\
+	LTTNG_UST__DEFINE_TRACEPOINT(provider, name, LTTNG_UST__TP_PARAMS(args))
+
+#endif /* #ifndef LTTNG_UST_TRACEPOINT_DECLARE */
+
 #ifndef LTTNG_UST_TRACEPOINT_LOGLEVEL
 
 /*
@@ -983,3 +1182,14 @@ enum {
 #endif
 
 #endif /* #ifndef LTTNG_UST_TRACEPOINT_MODEL_EMF_URI */
+
+#ifndef LTTNG_UST_TRACEPOINT_HOT
+
+/*
+ * Declares the tracepoint @name of @provider as frequently hit: its
+ * event gets its id before the other events enabled along with it, so
+ * it is more likely to be recorded with the compact event header.
+ */
+#define LTTNG_UST_TRACEPOINT_HOT(provider, name)
+
+#endif /* #ifndef LTTNG_UST_TRACEPOINT_HOT */
@@ -21,7 +21,7 @@
 /* Version for ABI between liblttng-ust, sessiond, consumerd */
 #define LTTNG_UST_ABI_MAJOR_VERSION			9
 #define LTTNG_UST_ABI_MAJOR_VERSION_OLDEST_COMPATIBLE	8
-#define LTTNG_UST_ABI_MINOR_VERSION		0
+#define LTTNG_UST_ABI_MINOR_VERSION		1
 
 enum lttng_ust_abi_instrumentation {
 	LTTNG_UST_ABI_TRACEPOINT	= 0,
@@ -42,6 +42,7 @@ enum lttng_ust_abi_output {
 enum lttng_ust_abi_chan_type {
 	LTTNG_UST_ABI_CHAN_PER_CPU = 0,
 	LTTNG_UST_ABI_CHAN_METADATA = 1,
+	LTTNG_UST_ABI_CHAN_PER_THREAD = 2,
 };
 
 struct lttng_ust_abi_tracer_version {
@@ -86,6 +87,8 @@ enum lttng_ust_abi_counter_arithmetic {
 enum lttng_ust_abi_counter_bitness {
 	LTTNG_UST_ABI_COUNTER_BITNESS_32 = 0,
 	LTTNG_UST_ABI_COUNTER_BITNESS_64 = 1,
+	LTTNG_UST_ABI_COUNTER_BITNESS_8 = 2,
+	LTTNG_UST_ABI_COUNTER_BITNESS_16 = 3,
 };
 
 struct lttng_ust_abi_counter_dimension {
@@ -96,7 +99,13 @@ struct lttng_ust_abi_counter_dimension {
 	uint8_t has_overflow;
 } __attribute__((packed));
 
-#define LTTNG_UST_ABI_COUNTER_CONF_PADDING1 67
+/*
+ * Histogram counters are log2 maps of a captured value: bucket 0 counts
+ * values lower than 1, bucket n counts values within [2^(n-1), 2^n).
+ */
+#define LTTNG_UST_ABI_COUNTER_HISTOGRAM_NR_BUCKETS 65
+
+#define LTTNG_UST_ABI_COUNTER_CONF_PADDING1 65
 struct lttng_ust_abi_counter_conf {
 	uint32_t arithmetic;	/* enum lttng_ust_abi_counter_arithmetic */
 	uint32_t bitness;	/* enum lttng_ust_abi_counter_bitness */
@@ -104,6 +113,8 @@ struct lttng_ust_abi_counter_conf {
 	int64_t global_sum_step;
 	struct lttng_ust_abi_counter_dimension dimensions[LTTNG_UST_ABI_COUNTER_DIMENSION_MAX];
 	uint8_t coalesce_hits;
+	uint8_t histogram;	/* Log2 histogram map: [index][bucket] */
+	uint8_t hits;		/* Event notifier hit map: [error_counter_index] */
 	char padding[LTTNG_UST_ABI_COUNTER_CONF_PADDING1];
 } __attribute__((packed));
 
@@ -130,17 +141,21 @@ struct lttng_ust_abi_event {
 	} u;
 } __attribute__((packed));
 
-#define LTTNG_UST_ABI_EVENT_NOTIFIER_PADDING	32
+#define LTTNG_UST_ABI_EVENT_NOTIFIER_PADDING	22
 struct lttng_ust_abi_event_notifier {
 	struct lttng_ust_abi_event event;
 	uint64_t error_counter_index;
+	uint64_t histogram_counter_index;
+	uint8_t has_histogram;	/* Aggregate the first capture in the histogram counter */
+	uint8_t freeze_buffers;	/* Freeze the overwrite-mode streams when fired */
 	char padding[LTTNG_UST_ABI_EVENT_NOTIFIER_PADDING];
 } __attribute__((packed));
 
-#define LTTNG_UST_ABI_EVENT_NOTIFIER_NOTIFICATION_PADDING 32
+#define LTTNG_UST_ABI_EVENT_NOTIFIER_NOTIFICATION_PADDING 24
 struct lttng_ust_abi_event_notifier_notification {
 	uint64_t token;
 	uint16_t capture_buf_size;
+	uint64_t suppressed;	/* Notifications dropped by the rate limit since the previous one */
 	char padding[LTTNG_UST_ABI_EVENT_NOTIFIER_NOTIFICATION_PADDING];
 } __attribute__((packed));
 
@@ -158,6 +173,12 @@ struct lttng_ust_abi_counter_global {
 	char padding[LTTNG_UST_ABI_COUNTER_GLOBAL_PADDING1];
 } __attribute__((packed));
 
+/*
+ * cpu_nr of a shm holding the per-cpu counters of all possible cpus, at
+ * a stride of len / number of possible cpus.
+ */
+#define LTTNG_UST_ABI_COUNTER_CPU_ALL		UINT32_MAX
+
 #define LTTNG_UST_ABI_COUNTER_CPU_PADDING1	(LTTNG_UST_ABI_SYM_NAME_LEN + 32)
 struct lttng_ust_abi_counter_cpu {
 	uint64_t len;		/* shm len */
@@ -206,6 +227,10 @@ enum lttng_ust_abi_context_type {
 	LTTNG_UST_ABI_CONTEXT_VEGID			= 19,
 	LTTNG_UST_ABI_CONTEXT_VSGID			= 20,
 	LTTNG_UST_ABI_CONTEXT_TIME_NS			= 21,
+	LTTNG_UST_ABI_CONTEXT_PROCNAME_ID		= 22,
+	LTTNG_UST_ABI_CONTEXT_PERF_CPU_COUNTER		= 23,
+	LTTNG_UST_ABI_CONTEXT_IDENTITY			= 24,
+	LTTNG_UST_ABI_CONTEXT_CALLSTACK			= 25,
 };
 
 struct lttng_ust_abi_perf_counter_ctx {
@@ -214,6 +239,16 @@ struct lttng_ust_abi_perf_counter_ctx {
 	char name[LTTNG_UST_ABI_SYM_NAME_LEN];
 } __attribute__((packed));
 
+/*
+ * Maximum number of return addresses recorded by a callstack context.
+ * 0 selects LTTNG_UST_ABI_CALLSTACK_DEFAULT_DEPTH.
+ */
+#define LTTNG_UST_ABI_CALLSTACK_DEFAULT_DEPTH	16
+#define LTTNG_UST_ABI_CALLSTACK_MAX_DEPTH	128
+struct lttng_ust_abi_callstack_ctx {
+	uint32_t max_depth;
+} __attribute__((packed));
+
 #define LTTNG_UST_ABI_CONTEXT_PADDING1	16
 #define LTTNG_UST_ABI_CONTEXT_PADDING2	(LTTNG_UST_ABI_SYM_NAME_LEN + 32)
 struct lttng_ust_abi_context {
@@ -222,6 +257,7 @@ struct lttng_ust_abi_context {
 
 	union {
 		struct lttng_ust_abi_perf_counter_ctx perf_counter;
+		struct lttng_ust_abi_callstack_ctx callstack;
 		struct {
 			/* Includes trailing '\0'. */
 			uint32_t provider_name_len;
@@ -257,6 +293,17 @@ struct lttng_ust_abi_tracepoint_iter {
 	char padding[LTTNG_UST_ABI_TRACEPOINT_ITER_PADDING];
 } __attribute__((packed));
 
+/*
+ * Sampling period of the lttng_ust_tracepoint_sampled() call sites of
+ * a tracepoint, 0 to restore the period of each call site.
+ */
+#define LTTNG_UST_ABI_TRACEPOINT_SAMPLE_PADDING	16
+struct lttng_ust_abi_tracepoint_sample {
+	char name[LTTNG_UST_ABI_SYM_NAME_LEN];	/* provider:name */
+	uint32_t period;
+	char padding[LTTNG_UST_ABI_TRACEPOINT_SAMPLE_PADDING];
+} __attribute__((packed));
+
 enum lttng_ust_abi_object_type {
 	LTTNG_UST_ABI_OBJECT_TYPE_UNKNOWN = -1,
 	LTTNG_UST_ABI_OBJECT_TYPE_CHANNEL = 0,
@@ -345,6 +392,22 @@ struct lttng_ust_abi_event_exclusion {
 	char names[LTTNG_UST_ABI_SYM_NAME_LEN][0];
 } __attribute__((packed));
 
+/*
+ * Filter evaluation statistics of an event or event notifier enabler,
+ * summed over the filters it attached to each of its instances. Only
+ * counted when the application runs with LTTNG_UST_FILTER_PROFILE set,
+ * zero otherwise. One evaluation out of
+ * LTTNG_UST_ABI_FILTER_STATS_SAMPLE_PERIOD is timed: sampled_time is the
+ * sum of the durations of those, in nanoseconds.
+ */
+#define LTTNG_UST_ABI_FILTER_STATS_SAMPLE_PERIOD	64
+struct lttng_ust_abi_filter_stats {
+	uint64_t nr_eval;		/* Evaluations */
+	uint64_t nr_accept;		/* Accepted evaluations */
+	uint64_t nr_cache_hit;		/* Evaluations served by the thread cache */
+	uint64_t sampled_time;		/* ns, sampled evaluations */
+} __attribute__((packed));
+
 #define LTTNG_UST_ABI_CMD(minor)		(minor)
 #define LTTNG_UST_ABI_CMDR(minor, type)		(minor)
 #define LTTNG_UST_ABI_CMDW(minor, type)		(minor)
@@ -364,6 +427,10 @@ struct lttng_ust_abi_event_exclusion {
 #define LTTNG_UST_ABI_TRACEPOINT_FIELD_LIST	LTTNG_UST_ABI_CMD(0x45)
 #define LTTNG_UST_ABI_EVENT_NOTIFIER_GROUP_CREATE \
 	LTTNG_UST_ABI_CMD(0x46)
+/* Since ABI minor version 1. */
+#define LTTNG_UST_ABI_BATCH			LTTNG_UST_ABI_CMD(0x47)
+#define LTTNG_UST_ABI_TRACEPOINT_SAMPLE		\
+	LTTNG_UST_ABI_CMDW(0x48, struct lttng_ust_abi_tracepoint_sample)
 
 /* Session commands */
 #define LTTNG_UST_ABI_CHANNEL			\
@@ -376,6 +443,8 @@ struct lttng_ust_abi_event_exclusion {
 #define LTTNG_UST_ABI_STREAM			LTTNG_UST_ABI_CMD(0x60)
 #define LTTNG_UST_ABI_EVENT			\
 	LTTNG_UST_ABI_CMDW(0x61, struct lttng_ust_abi_event)
+/* Since ABI minor version 1. */
+#define LTTNG_UST_ABI_STREAMS			LTTNG_UST_ABI_CMD(0x62)
 
 /* Event and channel commands */
 #define LTTNG_UST_ABI_CONTEXT			\
@@ -394,6 +463,9 @@ struct lttng_ust_abi_event_exclusion {
 /* Event and event notifier commands */
 #define LTTNG_UST_ABI_FILTER			LTTNG_UST_ABI_CMD(0xA0)
 #define LTTNG_UST_ABI_EXCLUSION			LTTNG_UST_ABI_CMD(0xA1)
+/* Since ABI minor version 1. */
+#define LTTNG_UST_ABI_FILTER_STATS		\
+	LTTNG_UST_ABI_CMDR(0xA2, struct lttng_ust_abi_filter_stats)
 
 /* Event notifier group commands */
 #define LTTNG_UST_ABI_EVENT_NOTIFIER_CREATE	\
@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <lttng/ust-abi.h>
 #include <lttng/ust-utils.h>
@@ -31,6 +32,15 @@ extern "C" {
 	"lttng-ust-sock-"					\
 	lttng_ust_stringify(LTTNG_UST_ABI_MAJOR_VERSION_OLDEST_COMPATIBLE)
 
+/*
+ * Unix socket of the optional per-host notification relay, in the same
+ * directory as the session daemon socket. The relay speaks the notify
+ * socket protocol on behalf of the session daemon.
+ */
+#define LTTNG_UST_NOTIFY_RELAY_SOCK_FILENAME			\
+	"lttng-ust-notify-relay-"				\
+	lttng_ust_stringify(LTTNG_UST_ABI_MAJOR_VERSION_OLDEST_COMPATIBLE)
+
 /*
  * Shared memory files path are automatically related to shm root, e.g.
  * /dev/shm under linux.
@@ -60,6 +70,7 @@ struct lttng_ust_context_attr {
 	enum lttng_ust_abi_context_type ctx;
 	union {
 		struct lttng_ust_abi_perf_counter_ctx perf_counter;
+		struct lttng_ust_abi_callstack_ctx callstack;
 		struct {
 			char *provider_name;
 			char *ctx_name;
@@ -92,6 +103,49 @@ int lttng_ust_ctl_disable(int sock, struct lttng_ust_abi_object_data *object);
 int lttng_ust_ctl_start_session(int sock, int handle);
 int lttng_ust_ctl_stop_session(int sock, int handle);
 
+/*
+ * Get the filter evaluation counters of an event or event notifier
+ * object, supported by applications registered with an ABI minor version
+ * of at least 1. The counters read 0 unless the application runs with
+ * LTTNG_UST_FILTER_PROFILE set.
+ */
+int lttng_ust_ctl_get_filter_stats(int sock, struct lttng_ust_abi_object_data *object,
+		struct lttng_ust_abi_filter_stats *stats);
+
+/*
+ * Batch of commands sent to an application in a single round trip,
+ * supported by applications registered with an ABI minor version of at
+ * least 1. Each command gets its own result in @ret, and the creation
+ * commands their new object in @object_data. Application contexts
+ * cannot be added within a batch.
+ */
+enum lttng_ust_ctl_batch_cmd_type {
+	LTTNG_UST_CTL_BATCH_ENABLE = 0,
+	LTTNG_UST_CTL_BATCH_DISABLE = 1,
+	LTTNG_UST_CTL_BATCH_CREATE_EVENT = 2,
+	LTTNG_UST_CTL_BATCH_ADD_CONTEXT = 3,
+};
+
+struct lttng_ust_ctl_batch_cmd {
+	enum lttng_ust_ctl_batch_cmd_type type;
+	struct lttng_ust_abi_object_data *object;	/* Target object */
+	union {
+		struct lttng_ust_abi_event *event;	/* LTTNG_UST_CTL_BATCH_CREATE_EVENT */
+		struct lttng_ust_context_attr *ctx;	/* LTTNG_UST_CTL_BATCH_ADD_CONTEXT */
+	} u;
+
+	/* Output */
+	int ret;
+	struct lttng_ust_abi_object_data *object_data;	/* Created object */
+};
+
+/*
+ * Returns 0 when every command was sent and got its reply, even if some
+ * of them failed, or a negative error code on communication error.
+ */
+int lttng_ust_ctl_batch(int sock, struct lttng_ust_ctl_batch_cmd *cmds,
+		unsigned int nr_cmds);
+
 /*
  * lttng_ust_ctl_create_event notifier_group creates a event notifier group. It
  * establishes the connection with the application by providing a file
@@ -114,6 +168,68 @@ int lttng_ust_ctl_create_event_notifier(int sock,
 		struct lttng_ust_abi_object_data *event_notifier_group,
 		struct lttng_ust_abi_object_data **event_notifier_data);
 
+/*
+ * Event notifier notification reader. Reads the notifications written by
+ * the applications to the pipe given to
+ * lttng_ust_ctl_create_event_notifier_group(), many at a time, and
+ * decodes their captures in place.
+ */
+struct lttng_ust_ctl_notification_reader;
+
+struct lttng_ust_ctl_notification {
+	uint64_t token;			/* Event notifier user token */
+	const uint8_t *capture_buf;	/* msgpack captures, valid until next read */
+	size_t capture_len;
+	size_t capture_pos;		/* Decoding position in capture_buf */
+};
+
+enum lttng_ust_ctl_capture_type {
+	LTTNG_UST_CTL_CAPTURE_NIL = 0,
+	LTTNG_UST_CTL_CAPTURE_BOOL = 1,
+	LTTNG_UST_CTL_CAPTURE_UNSIGNED = 2,
+	LTTNG_UST_CTL_CAPTURE_SIGNED = 3,
+	LTTNG_UST_CTL_CAPTURE_DOUBLE = 4,
+	LTTNG_UST_CTL_CAPTURE_STRING = 5,
+	LTTNG_UST_CTL_CAPTURE_ARRAY = 6,	/* Followed by its elements */
+	LTTNG_UST_CTL_CAPTURE_MAP = 7,		/* Followed by its key/value pairs */
+};
+
+struct lttng_ust_ctl_capture_value {
+	enum lttng_ust_ctl_capture_type type;
+	union {
+		bool b;
+		uint64_t u;
+		int64_t s;
+		double d;
+		struct {
+			const char *str;	/* Not null-terminated */
+			size_t len;
+		} str;
+		uint32_t count;			/* Array elements or map pairs */
+	} u;
+};
+
+struct lttng_ust_ctl_notification_reader *
+	lttng_ust_ctl_create_notification_reader(int pipe_fd);
+void lttng_ust_ctl_destroy_notification_reader(
+		struct lttng_ust_ctl_notification_reader *reader);
+
+/*
+ * Returns 1 and fills @notification with the next notification, 0 if no
+ * notification can be read without blocking, -EPIPE if all the
+ * applications closed the pipe, or another negative error value.
+ */
+int lttng_ust_ctl_read_notification(struct lttng_ust_ctl_notification_reader *reader,
+		struct lttng_ust_ctl_notification *notification);
+
+/*
+ * Decodes the next capture value of @notification, starting with the
+ * array of all the captures. Returns 1 on success, 0 when all values
+ * have been decoded, -EINVAL if the captures are malformed.
+ */
+int lttng_ust_ctl_notification_next_capture(struct lttng_ust_ctl_notification *notification,
+		struct lttng_ust_ctl_capture_value *value);
+
 /*
  * lttng_ust_ctl_tracepoint_list returns a tracepoint list handle, or negative
  * error value.
@@ -145,6 +261,16 @@ int lttng_ust_ctl_tracepoint_field_list_get(int sock, int tp_field_list_handle,
 int lttng_ust_ctl_tracer_version(int sock, struct lttng_ust_abi_tracer_version *v);
 int lttng_ust_ctl_wait_quiescent(int sock);
 
+/*
+ * Set the sampling period of the lttng_ust_tracepoint_sampled() call
+ * sites of the tracepoint @name ("provider:name") of the application:
+ * each of its threads traces one hit out of @period of each call site.
+ * A zero @period restores the period given by each call site. Applies
+ * to the tracepoints registered later by the application as well.
+ */
+int lttng_ust_ctl_set_tracepoint_sample_period(int sock, const char *name,
+		uint32_t period);
+
 int lttng_ust_ctl_sock_flush_buffer(int sock, struct lttng_ust_abi_object_data *object);
 
 int lttng_ust_ctl_calibrate(int sock, struct lttng_ust_abi_calibrate *calibrate);
@@ -163,6 +289,15 @@ int lttng_ust_ctl_send_channel_to_ust(int sock, int session_handle,
 int lttng_ust_ctl_send_stream_to_ust(int sock,
 		struct lttng_ust_abi_object_data *channel_data,
 		struct lttng_ust_abi_object_data *stream_data);
+/*
+ * Send all the streams of a channel at once. The application must
+ * support ABI minor version 1. The shm fd of streams in a channel arena
+ * is sent only once.
+ */
+int lttng_ust_ctl_send_streams_to_ust(int sock,
+		struct lttng_ust_abi_object_data *channel_data,
+		struct lttng_ust_abi_object_data **stream_data,
+		unsigned int nr_streams);
 
 /*
  * lttng_ust_ctl_duplicate_ust_object_data allocated a new object in "dest" if
@@ -182,9 +317,37 @@ struct lttng_ust_ctl_consumer_channel_attr;
 
 int lttng_ust_ctl_get_nr_stream_per_channel(void);
 
+/*
+ * Number of cpus in the affinity mask of process @pid: the number of
+ * streams a per-cpu channel needs for an application confined to a
+ * cpuset. Returns a negative error value on error.
+ */
+int lttng_ust_ctl_get_nr_stream_per_channel_pid(pid_t pid);
+
+/*
+ * Passing a single stream fd for a channel of several streams allocates
+ * all of them within that file: a channel arena. All streams of the
+ * channel then share that shm fd, which the consumer closes once, and
+ * applications map it once.
+ */
 struct lttng_ust_ctl_consumer_channel *
 	lttng_ust_ctl_create_channel(struct lttng_ust_ctl_consumer_channel_attr *attr,
 		const int *stream_fds, int nr_stream_fds);
+
+/*
+ * Create a per-cpu or per-thread channel of @nr_streams streams, 0 for
+ * one stream per possible cpu, as lttng_ust_ctl_create_channel does.
+ * The application maps each cpu of its affinity mask to the stream of
+ * its rank within that mask, and folds the other cpus onto those
+ * streams. @nr_stream_fds is either @nr_streams or 1 for an arena.
+ * The cpu_id of the packet context of a per-cpu stream is then its
+ * index, not a cpu: the application records the cpu of each event in
+ * the cpu_id context field, which it adds to such channels.
+ */
+struct lttng_ust_ctl_consumer_channel *
+	lttng_ust_ctl_create_channel_nr_streams(struct lttng_ust_ctl_consumer_channel_attr *attr,
+		const int *stream_fds, int nr_stream_fds,
+		unsigned int nr_streams);
 /*
  * Each stream created needs to be destroyed before calling
  * lttng_ust_ctl_destroy_channel().
@@ -198,10 +361,41 @@ int lttng_ust_ctl_channel_close_wakeup_fd(struct lttng_ust_ctl_consumer_channel
 int lttng_ust_ctl_channel_get_wait_fd(struct lttng_ust_ctl_consumer_channel *consumer_chan);
 int lttng_ust_ctl_channel_get_wakeup_fd(struct lttng_ust_ctl_consumer_channel *consumer_chan);
 
+/*
+ * Set the fill level (bytes) past which writers switch to the next
+ * sub-buffer, producing packets smaller than the sub-buffer size, e.g. to
+ * lower the latency of low-throughput channels. A limit of 0 restores the
+ * sub-buffer size. Records larger than the limit are still written in a
+ * fresh sub-buffer. Can be changed while tracing.
+ */
+int lttng_ust_ctl_channel_set_subbuf_fill_limit(struct lttng_ust_ctl_consumer_channel *consumer_chan,
+		unsigned long limit);
+
+/*
+ * Scan the positions of all streams of the channel at once. Bit n of
+ * the bitmap, of nr_words 64-bit words, is set when stream n (the
+ * stream created for cpu n) has a sub-buffer ready to be read with
+ * lttng_ust_ctl_get_next_subbuf(), and cleared otherwise. This is a
+ * hint: writers are not synchronized with the scan, and a stream which
+ * became readable meanwhile is reported by the next scan. Returns the
+ * number of readable streams, or -EINVAL if the bitmap is too small for
+ * the streams of the channel.
+ */
+int lttng_ust_ctl_channel_get_readable_streams(struct lttng_ust_ctl_consumer_channel *consumer_chan,
+		uint64_t *bitmap, unsigned int nr_words);
+
 int lttng_ust_ctl_write_metadata_to_channel(
 		struct lttng_ust_ctl_consumer_channel *channel,
 		const char *metadata_str,	/* NOT null-terminated */
 		size_t len);			/* metadata length */
+/*
+ * Same as lttng_ust_ctl_write_metadata_to_channel() for the
+ * concatenation of iovcnt fragments, copied to the channel with one
+ * reservation per packet rather than per fragment.
+ */
+int lttng_ust_ctl_writev_metadata_to_channel(
+		struct lttng_ust_ctl_consumer_channel *channel,
+		const struct iovec *iov, int iovcnt);
 ssize_t lttng_ust_ctl_write_one_packet_to_channel(
 		struct lttng_ust_ctl_consumer_channel *channel,
 		const char *metadata_str,	/* NOT null-terminated */
@@ -224,6 +418,43 @@ struct lttng_ust_ctl_consumer_stream *
 			int cpu);
 void lttng_ust_ctl_destroy_stream(struct lttng_ust_ctl_consumer_stream *stream);
 
+/*
+ * Seal the shm file of the stream against shrinking (F_SEAL_SHRINK), so
+ * its mapping cannot raise SIGBUS, and read it without the SIGBUS
+ * handling of each access from then on. Requires a file created with
+ * sealing allowed, e.g. memfd_create() with MFD_ALLOW_SEALING. Returns
+ * -EPERM if it cannot be sealed, -ENOSYS where seals are unsupported.
+ */
+int lttng_ust_ctl_stream_set_trusted(struct lttng_ust_ctl_consumer_stream *stream);
+
+/*
+ * Read position checkpoint of a stream, kept in the buffer shared
+ * memory and advanced by each lttng_ust_ctl_put_next_subbuf().
+ *
+ * @checkpoint: consumed position reached by the previous reader.
+ * @consumed: current consumed position. It is beyond @checkpoint when
+ *            writers overwrote unread packets, in overwrite mode.
+ * @held: position of the packet the previous reader held when it
+ *        exited, or UINT64_MAX. That packet is released without being
+ *        consumed, so it is read again.
+ */
+struct lttng_ust_ctl_stream_checkpoint {
+	uint64_t checkpoint;
+	uint64_t consumed;
+	uint64_t held;
+};
+
+/*
+ * Take over reading a stream whose previous reader exited without
+ * destroying it, e.g. a crashed consumer daemon, instead of failing
+ * like lttng_ust_ctl_create_stream(). The previous reader must not
+ * run anymore. Fills @checkpoint so the caller can resume consumption
+ * where it stopped and detect packets lost in between.
+ */
+struct lttng_ust_ctl_consumer_stream *
+	lttng_ust_ctl_resume_stream(struct lttng_ust_ctl_consumer_channel *channel,
+			int cpu, struct lttng_ust_ctl_stream_checkpoint *checkpoint);
+
 /* For mmap mode, readable without "get" operation */
 int lttng_ust_ctl_get_mmap_len(struct lttng_ust_ctl_consumer_stream *stream,
 		unsigned long *len);
@@ -241,7 +472,129 @@ int lttng_ust_ctl_get_subbuf_size(struct lttng_ust_ctl_consumer_stream *stream,
 		unsigned long *len);
 int lttng_ust_ctl_get_padded_subbuf_size(struct lttng_ust_ctl_consumer_stream *stream,
 		unsigned long *len);
+
+/*
+ * Compressed packets start with this header, in the byte order of the
+ * consumer, followed by compressed_size bytes of the packet content
+ * compressed with the codec. Its magic number, unlike the one of CTF
+ * packets, tells readers the packet needs to be decompressed.
+ */
+enum lttng_ust_ctl_compression_codec {
+	LTTNG_UST_CTL_COMPRESSION_LZ4 = 1,
+	LTTNG_UST_CTL_COMPRESSION_ZSTD = 2,
+};
+
+#define LTTNG_UST_CTL_COMPRESSED_PACKET_MAGIC	0xC1FC1FCCU
+
+struct lttng_ust_ctl_compressed_packet_header {
+	uint32_t magic;		/* LTTNG_UST_CTL_COMPRESSED_PACKET_MAGIC */
+	uint8_t codec;		/* enum lttng_ust_ctl_compression_codec */
+	uint8_t header_size;	/* Size of this header, in bytes */
+	uint16_t reserved;
+	uint64_t content_size;	/* Uncompressed packet size, in bytes */
+	uint64_t compressed_size;	/* Compressed size, in bytes */
+} __attribute__((packed));
+
+/*
+ * Compress the current packet content with codec into dst, prefixed with
+ * a compressed packet header. level is codec specific, 0 selects the
+ * default: the acceleration factor for LZ4, the compression level for
+ * Zstandard. *len is the size of dst on entry and the size of the header
+ * and compressed content on return. Returns -ENOBUFS and the required
+ * size if dst is too small, -ENOSYS if liblttng-ust-ctl is built without
+ * support for the codec.
+ */
+int lttng_ust_ctl_compress_subbuf(struct lttng_ust_ctl_consumer_stream *stream,
+		enum lttng_ust_ctl_compression_codec codec, int level,
+		void *dst, unsigned long *len);
+
+/*
+ * Decompress a packet compressed by lttng_ust_ctl_compress_subbuf(),
+ * src_len bytes long, into dst. *len is the size of dst on entry and the
+ * packet size on return. Returns -ENOBUFS and the packet size if dst is
+ * too small, -EINVAL if src is not a compressed packet, -ENOSYS if
+ * liblttng-ust-ctl is built without support for its codec.
+ */
+int lttng_ust_ctl_decompress_packet(const void *src, unsigned long src_len,
+		void *dst, unsigned long *len);
+/*
+ * Write the first len bytes of the current packet, usually its padded
+ * size, to out_fd without copying them to user space: the pages are
+ * vmspliced into the pipe pipe_fds ({ read end, write end }, blocking,
+ * empty) and spliced onward to out_fd, a file or a socket. Returns the
+ * number of bytes written, or a negative error code, in which case the
+ * pipe may hold leftover data and should be discarded. Returns -ENOSYS
+ * where splice is not available.
+ *
+ * Files receive a copy of the data in the page cache. Sockets may still
+ * reference the packet pages after return until the data is sent, so
+ * writers reusing the sub-buffer after it is put can alter data queued
+ * for retransmission.
+ */
+ssize_t lttng_ust_ctl_splice_subbuf(struct lttng_ust_ctl_consumer_stream *stream,
+		unsigned long len, const int *pipe_fds, int out_fd);
 int lttng_ust_ctl_get_next_subbuf(struct lttng_ust_ctl_consumer_stream *stream);
+
+/*
+ * Memory-mapped output: copy the current packets of streams, obtained
+ * with lttng_ust_ctl_get_next_subbuf(), into the trace file fd, open
+ * for reading and writing, from file offset @offset onward, through a shared mapping of the file
+ * moving by windows of window_size bytes (rounded up to the page size,
+ * 0 for the default). Completed windows are written back asynchronously
+ * and unmapped. The caller puts the packets.
+ *
+ * lttng_ust_ctl_mmap_output_write_subbuf() returns the number of bytes
+ * written, usually the padded sub-buffer size, or a negative error
+ * code. lttng_ust_ctl_mmap_output_destroy() truncates the file to the
+ * end of the last packet written, and does not close fd.
+ */
+#define LTTNG_UST_CTL_MMAP_OUTPUT_DEFAULT_WINDOW	(4UL << 20)
+
+struct lttng_ust_ctl_mmap_output;
+
+struct lttng_ust_ctl_mmap_output *lttng_ust_ctl_mmap_output_create(int fd,
+		uint64_t offset, size_t window_size);
+ssize_t lttng_ust_ctl_mmap_output_write_subbuf(struct lttng_ust_ctl_mmap_output *out,
+		struct lttng_ust_ctl_consumer_stream *stream,
+		unsigned long len);
+/* File offset of the next packet written. */
+uint64_t lttng_ust_ctl_mmap_output_get_offset(struct lttng_ust_ctl_mmap_output *out);
+int lttng_ust_ctl_mmap_output_destroy(struct lttng_ust_ctl_mmap_output *out);
+
+/*
+ * Packet writeout: write the current packets of many streams, obtained
+ * with lttng_ust_ctl_get_next_subbuf(), with one io_uring submission per
+ * batch of up to nr_entries packets, falling back to one write() or
+ * pwrite() per packet where io_uring is not available. Each packet
+ * fully written is released with lttng_ust_ctl_put_next_subbuf(); the
+ * others are left for the caller to retry or put.
+ *
+ * Writes to the same fd from consecutive packets complete in order, and
+ * a failed one cancels the following ones (-ECANCELED).
+ */
+#define LTTNG_UST_CTL_WRITEOUT_MAX_ENTRIES	256
+
+struct lttng_ust_ctl_writeout;
+
+struct lttng_ust_ctl_writeout_packet {
+	struct lttng_ust_ctl_consumer_stream *stream;
+	int fd;
+	int64_t offset;		/* File offset, -1 for the current file position. */
+	unsigned long len;	/* Usually the padded sub-buffer size. */
+	ssize_t ret;		/* Output: bytes written, or negative error code. */
+};
+
+struct lttng_ust_ctl_writeout *lttng_ust_ctl_writeout_create(unsigned int nr_entries);
+void lttng_ust_ctl_writeout_destroy(struct lttng_ust_ctl_writeout *writeout);
+/*
+ * Returns the number of packets written and released, or a negative
+ * error code if the submission itself failed, in which case the
+ * writeout must be destroyed once the ret field of each packet has been
+ * checked.
+ */
+int lttng_ust_ctl_writeout_packets(struct lttng_ust_ctl_writeout *writeout,
+		struct lttng_ust_ctl_writeout_packet *packets,
+		unsigned int nr_packets);
 int lttng_ust_ctl_put_next_subbuf(struct lttng_ust_ctl_consumer_stream *stream);
 
 /* snapshot */
@@ -252,13 +605,69 @@ int lttng_ust_ctl_snapshot_get_consumed(struct lttng_ust_ctl_consumer_stream *st
 		unsigned long *pos);
 int lttng_ust_ctl_snapshot_get_produced(struct lttng_ust_ctl_consumer_stream *stream,
 		unsigned long *pos);
+
+/*
+ * Positions of a stream sampled by lttng_ust_ctl_snapshot_channel().
+ * Streams not added to the channel yet read an empty range at 0.
+ */
+struct lttng_ust_ctl_snapshot_range {
+	unsigned long consumed;
+	unsigned long produced;
+};
+
+/*
+ * Sample the consumer and producer positions of all the streams of a
+ * channel in a single pass, into @ranges, indexed by stream. Unlike
+ * lttng_ust_ctl_snapshot_sample_positions(), the positions are not saved
+ * in the streams, so sampling writes nothing to the shared buffers.
+ * @nr_ranges must be at least the number of streams of the channel.
+ * Return the number of streams sampled, or a negative error code.
+ */
+int lttng_ust_ctl_snapshot_channel(struct lttng_ust_ctl_consumer_channel *consumer_chan,
+		struct lttng_ust_ctl_snapshot_range *ranges,
+		unsigned int nr_ranges);
 int lttng_ust_ctl_get_subbuf(struct lttng_ust_ctl_consumer_stream *stream,
 		unsigned long *pos);
 int lttng_ust_ctl_put_subbuf(struct lttng_ust_ctl_consumer_stream *stream);
 
 int lttng_ust_ctl_flush_buffer(struct lttng_ust_ctl_consumer_stream *stream,
 		int producer_active);
+/*
+ * Live mode flush: flush the stream, as with producer_active set, only
+ * if data was written since its last flush and its writers did not move
+ * to another sub-buffer since the previous call, i.e. when they do not
+ * deliver packets by themselves. Otherwise only the write offset is
+ * read, leaving the writer cache lines clean. Returns 1 if flushed, 0
+ * if not, or a negative error code.
+ */
+int lttng_ust_ctl_flush_buffer_if_stale(struct lttng_ust_ctl_consumer_stream *stream);
+/*
+ * Same for an array of streams, e.g. all streams of a channel. NULL
+ * entries are skipped. Returns the number of streams flushed.
+ */
+int lttng_ust_ctl_flush_buffers_if_stale(struct lttng_ust_ctl_consumer_stream **streams,
+		unsigned int nr_streams);
 int lttng_ust_ctl_clear_buffer(struct lttng_ust_ctl_consumer_stream *stream);
+/*
+ * Clear an array of streams, e.g. all streams of a channel, in one
+ * call. Unlike lttng_ust_ctl_clear_buffer(), a current packet holding
+ * no record is left open rather than closed as an empty packet. Safe
+ * against concurrent writers: records written during the clear may be
+ * kept. NULL entries are skipped.
+ */
+int lttng_ust_ctl_clear_buffers(struct lttng_ust_ctl_consumer_stream **streams,
+		unsigned int nr_streams);
+
+/*
+ * An overwrite-mode stream is frozen by the application when an event
+ * notifier created with freeze_buffers fires: its writers stop before
+ * overwriting its oldest sub-buffer, losing their records instead, so
+ * that its snapshot holds the history before the trigger. Once the
+ * snapshot is taken, the stream is thawed to resume overwriting.
+ */
+int lttng_ust_ctl_get_frozen(struct lttng_ust_ctl_consumer_stream *stream,
+		int *frozen);
+int lttng_ust_ctl_thaw_buffer(struct lttng_ust_ctl_consumer_stream *stream);
 
 /* index */
 
@@ -280,6 +689,102 @@ int lttng_ust_ctl_get_packet_size(struct lttng_ust_ctl_consumer_stream *stream,
 int lttng_ust_ctl_get_sequence_number(struct lttng_ust_ctl_consumer_stream *stream,
 		uint64_t *seq);
 
+/*
+ * All the packet context fields above, along with the stream and
+ * instance ids, read from the packet header at once.
+ */
+struct lttng_ust_ctl_packet_info {
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t content_size;
+	uint64_t packet_size;
+	uint64_t stream_id;
+	uint64_t sequence_number;
+	uint64_t instance_id;
+};
+
+int lttng_ust_ctl_get_packet_info(struct lttng_ust_ctl_consumer_stream *stream,
+		struct lttng_ust_ctl_packet_info *info);
+
+/*
+ * Event record of the current packet, passed to the filter callback of
+ * lttng_ust_ctl_filter_subbuf(). The event header is decoded; the
+ * callback sets @len, the length of the whole record from @data
+ * (event header, contexts and payload), from the metadata of the
+ * trace, and returns 1 to keep the record, 0 to drop it, or a negative
+ * error code to stop.
+ */
+struct lttng_ust_ctl_record {
+	uint32_t event_id;
+	uint64_t timestamp;	/* Full timestamp. */
+	const char *data;	/* Start of the event header. */
+	size_t header_len;	/* Event header length. */
+	size_t len;		/* Set by the callback. */
+};
+
+/*
+ * Write to dst, of *len bytes, a copy of the current packet holding
+ * only the records kept by @filter, e.g. to drop or sample events
+ * before writing them to disk. Event headers are widened to their
+ * extended form where the timestamp delta from the previous record
+ * kept does not fit anymore, and the packet content and packet sizes
+ * are updated. Returns the number of records kept and sets *len to the
+ * length of the new packet, or returns a negative error code: -ENOSPC
+ * if dst is too small. Returns -ENOSYS on architectures where buffers
+ * use natural alignment. @header_type is the enum
+ * lttng_ust_ctl_channel_header replied at channel registration.
+ *
+ * The callback runs while the packet is being accessed under SIGBUS
+ * protection, and must not call other lttng_ust_ctl functions.
+ */
+int lttng_ust_ctl_filter_subbuf(struct lttng_ust_ctl_consumer_stream *stream,
+		int header_type,
+		int (*filter)(struct lttng_ust_ctl_record *record, void *priv),
+		void *priv, void *dst, unsigned long *len);
+
+/*
+ * CTF packet index files, as read by trace readers to seek within a
+ * stream file without scanning it: a header followed by one entry per
+ * packet, all fields big endian. Sizes are in bits, the offset of the
+ * packet within the stream file in bytes.
+ */
+#define LTTNG_UST_CTL_INDEX_MAGIC	0xC1F1DCC1
+#define LTTNG_UST_CTL_INDEX_MAJOR	1
+#define LTTNG_UST_CTL_INDEX_MINOR	1
+
+struct lttng_ust_ctl_index_file_hdr {
+	uint32_t magic;
+	uint32_t index_major;
+	uint32_t index_minor;
+	uint32_t packet_index_len;	/* Size of an entry (bytes). */
+} __attribute__((__packed__));
+
+struct lttng_ust_ctl_packet_index {
+	uint64_t offset;		/* Offset of the packet in the file (bytes). */
+	uint64_t packet_size;		/* Packet size (bits), padding included. */
+	uint64_t content_size;		/* Content size (bits). */
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t stream_id;
+	/* Since index minor version 1. */
+	uint64_t stream_instance_id;
+	uint64_t packet_seq_num;
+} __attribute__((__packed__));
+
+/* Write the index file header at the current position of fd. */
+int lttng_ust_ctl_index_write_header(int fd);
+/*
+ * Fill the index entry of the current packet (between get/put) of the
+ * stream, written at the given offset of the stream file.
+ */
+int lttng_ust_ctl_get_packet_index(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t offset, struct lttng_ust_ctl_packet_index *index);
+/* Append the index entry of the current packet to the index file fd. */
+int lttng_ust_ctl_index_write_packet(int fd,
+		struct lttng_ust_ctl_consumer_stream *stream, uint64_t offset);
+
 /*
  * Getter returning state invariant for the stream, which can be used
  * without "get" operation.
@@ -297,6 +802,41 @@ int lttng_ust_ctl_get_instance_id(struct lttng_ust_ctl_consumer_stream *stream,
 int lttng_ust_ctl_get_current_timestamp(struct lttng_ust_ctl_consumer_stream *stream,
 		uint64_t *ts);
 
+/*
+ * Getter returning the backpressure statistics of the stream, which can
+ * be used without "get" operation: number of times writers found the
+ * buffer full, number of blocking retries and total time spent blocked
+ * (ms) for channels allowing blocking, and largest unconsumed data size
+ * seen by writers at sub-buffer switch (bytes). Any pointer may be NULL.
+ */
+int lttng_ust_ctl_get_backpressure_stats(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t *full_count, uint64_t *blocked_retries,
+		uint64_t *blocked_ms, uint64_t *max_fill);
+
+/*
+ * Getter returning the reservation statistics of the stream, which can
+ * be used without "get" operation: number of reservations which went
+ * through the slow path, number of slow path reservations retried after
+ * a concurrent update, and number of sub-buffer switches. Any pointer
+ * may be NULL. They read 0 for streams created by a version of
+ * lttng-ust-ctl which does not maintain them.
+ */
+int lttng_ust_ctl_get_reserve_stats(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t *slow_path_count, uint64_t *reserve_retries,
+		uint64_t *switch_count);
+
+/*
+ * Getter returning the number of event records sampled out in the stream
+ * since its creation, at the end of the packet held by the consumer
+ * ("get" operation required), see LTTNG_UST_RB_SAMPLING_THRESHOLD. They
+ * are not counted in the discarded events: the difference with the
+ * previous packet of the stream is the number of event records the
+ * recorded ones of the packet stand for, on top of themselves. Reads 0
+ * for streams which are not sampled.
+ */
+int lttng_ust_ctl_get_records_sampled(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t *records_sampled);
+
 /* returns whether UST has perf counters support. */
 int lttng_ust_ctl_has_perf_counters(void);
 
@@ -320,6 +860,13 @@ enum lttng_ust_ctl_channel_header {
 	LTTNG_UST_CTL_CHANNEL_HEADER_UNKNOWN = 0,
 	LTTNG_UST_CTL_CHANNEL_HEADER_COMPACT = 1,
 	LTTNG_UST_CTL_CHANNEL_HEADER_LARGE = 2,
+	/*
+	 * Stream of a single event class, whose id is 0: the record
+	 * header only holds the timestamp. A 1-bit selector tells a
+	 * 31-bit timestamp (0) from a 64-bit aligned 64-bit timestamp
+	 * (1). The records of other events are discarded.
+	 */
+	LTTNG_UST_CTL_CHANNEL_HEADER_SINGLE = 3,
 };
 
 /* event type structures */
@@ -587,6 +1134,13 @@ int lttng_ust_ctl_reply_register_channel(int sock,
 enum lttng_ust_ctl_counter_bitness {
 	LTTNG_UST_CTL_COUNTER_BITNESS_32 = 0,
 	LTTNG_UST_CTL_COUNTER_BITNESS_64 = 1,
+	/*
+	 * 8-bit and 16-bit per-cpu counters carry into global counters,
+	 * they require LTTNG_UST_CTL_COUNTER_ALLOC_PER_CPU |
+	 * LTTNG_UST_CTL_COUNTER_ALLOC_GLOBAL and modular arithmetic.
+	 */
+	LTTNG_UST_CTL_COUNTER_BITNESS_8 = 2,
+	LTTNG_UST_CTL_COUNTER_BITNESS_16 = 3,
 };
 
 enum lttng_ust_ctl_counter_arithmetic {
@@ -624,6 +1178,29 @@ struct lttng_ust_ctl_daemon_counter *
 		uint32_t alloc_flags,
 		bool coalesce_hits);
 
+/*
+ * Turn a two-dimension counter into a log2 histogram map, before its
+ * counter data is created. Sent to an event notifier group, the counter
+ * aggregates the first capture of the event notifiers created with
+ * has_histogram, in row histogram_counter_index. The second dimension
+ * size must be LTTNG_UST_CTL_COUNTER_HISTOGRAM_NR_BUCKETS: bucket 0
+ * counts values lower than 1, bucket n counts values within
+ * [2^(n-1), 2^n).
+ */
+#define LTTNG_UST_CTL_COUNTER_HISTOGRAM_NR_BUCKETS \
+	LTTNG_UST_ABI_COUNTER_HISTOGRAM_NR_BUCKETS
+
+int lttng_ust_ctl_counter_set_histogram(struct lttng_ust_ctl_daemon_counter *counter);
+
+/*
+ * Turn a one-dimension counter into an event notifier hit map, before
+ * its counter data is created. Sent to an event notifier group, the
+ * counter counts the times each of its event notifiers fired, in row
+ * error_counter_index, including the firings which sent no notification
+ * (rate limited, aggregated in a histogram, or dropped).
+ */
+int lttng_ust_ctl_counter_set_hits(struct lttng_ust_ctl_daemon_counter *counter);
+
 int lttng_ust_ctl_create_counter_data(struct lttng_ust_ctl_daemon_counter *counter,
 		struct lttng_ust_abi_object_data **counter_data);
 
@@ -632,6 +1209,18 @@ int lttng_ust_ctl_create_counter_global_data(struct lttng_ust_ctl_daemon_counter
 int lttng_ust_ctl_create_counter_cpu_data(struct lttng_ust_ctl_daemon_counter *counter, int cpu,
 		struct lttng_ust_abi_object_data **counter_cpu_data);
 
+/*
+ * Place the per-cpu counters of all possible cpus in the single shm
+ * object backed by fd, for a counter created without counter_cpu_fds.
+ * The counter is then sent with one counter cpu data, created by
+ * lttng_ust_ctl_create_counter_cpu_all_data() and sent with
+ * lttng_ust_ctl_send_counter_cpu_data_to_ust(), instead of one per cpu.
+ */
+int lttng_ust_ctl_counter_set_cpu_all_shm(struct lttng_ust_ctl_daemon_counter *counter,
+		int fd);
+int lttng_ust_ctl_create_counter_cpu_all_data(struct lttng_ust_ctl_daemon_counter *counter,
+		struct lttng_ust_abi_object_data **counter_cpu_data);
+
 /*
  * Each counter data and counter cpu data created need to be destroyed
  * before calling lttng_ust_ctl_destroy_counter().
@@ -655,9 +1244,176 @@ int lttng_ust_ctl_counter_aggregate(struct lttng_ust_ctl_daemon_counter *counter
 		const size_t *dimension_indexes,
 		int64_t *value,
 		bool *overflow, bool *underflow);
+
+/*
+ * Aggregate every element of a counter across CPUs in a single pass.
+ * values receives the aggregated value of each element, ordered by
+ * flattened dimension indexes (the last dimension varies fastest).
+ * nr_values must be at least the product of the dimension sizes.
+ * overflow and underflow receive bitmaps of
+ * LTTNG_UST_CTL_COUNTER_BITMAP_NR_WORDS(nr_values) words, where bit i is
+ * set when element i overflowed or underflowed.
+ */
+#define LTTNG_UST_CTL_COUNTER_BITMAP_NR_WORDS(nr_elem)	\
+	(((nr_elem) + (CHAR_BIT * sizeof(unsigned long)) - 1) / (CHAR_BIT * sizeof(unsigned long)))
+
+int lttng_ust_ctl_counter_aggregate_all(struct lttng_ust_ctl_daemon_counter *counter,
+		int64_t *values, size_t nr_values,
+		unsigned long *overflow, unsigned long *underflow);
 int lttng_ust_ctl_counter_clear(struct lttng_ust_ctl_daemon_counter *counter,
 		const size_t *dimension_indexes);
 
+/*
+ * Read-only views of the counter arrays, for readers which aggregate
+ * many elements, e.g. metrics exporters, without a call per element.
+ * A view points into the memory mapping of the counter: it stays valid
+ * until lttng_ust_ctl_destroy_counter() and must never be written to.
+ *
+ * Element i, of dimension indexes (i_0, ..., i_n-1), is at flattened
+ * index sum(i_k * stride_k), the strides being given by
+ * lttng_ust_ctl_counter_get_dimension(). Elements are signed integers
+ * of elem_size bytes, in host byte order, each read atomically with a
+ * plain load, though writers keep updating them: the values of a view
+ * are not a snapshot. Bit i of the overflow and underflow bitmaps, of
+ * LTTNG_UST_CTL_COUNTER_BITMAP_NR_WORDS(nr_elem) words, is bit
+ * (i % (CHAR_BIT * sizeof(unsigned long))) of word
+ * (i / (CHAR_BIT * sizeof(unsigned long))).
+ *
+ * The value of an element is the sum of the element in the global view
+ * and in the view of each cpu, where the counter has them; the 8-bit
+ * and 16-bit per-cpu counters carry into the global counters.
+ */
+struct lttng_ust_ctl_counter_view {
+	const void *counters;
+	const unsigned long *overflow_bitmap;
+	const unsigned long *underflow_bitmap;
+	uint64_t nr_elem;
+	uint32_t elem_size;	/* 1, 2, 4 or 8 */
+};
+
+int lttng_ust_ctl_counter_get_nr_dimensions(struct lttng_ust_ctl_daemon_counter *counter,
+		size_t *nr_dimensions);
+int lttng_ust_ctl_counter_get_dimension(struct lttng_ust_ctl_daemon_counter *counter,
+		size_t dimension, uint64_t *size, uint64_t *stride);
+
+/*
+ * View of the global counters when cpu is -1, or of the counters of
+ * cpu, lower than lttng_ust_ctl_get_nr_cpu_per_counter(). Returns
+ * -ENODEV if the counter has no such counters, or they are not mapped.
+ */
+int lttng_ust_ctl_counter_get_view(struct lttng_ust_ctl_daemon_counter *counter,
+		int cpu, struct lttng_ust_ctl_counter_view *view);
+
+/*
+ * Tracer self-metrics of an application started with the
+ * LTTNG_UST_METRICS environment variable set. They are kept by the
+ * application in per-cpu counters of a shared memory object, and read
+ * without any tracing session or session daemon command.
+ */
+enum lttng_ust_ctl_metric {
+	LTTNG_UST_CTL_METRIC_EVENT_RESERVE = 0,		/* Records reserved */
+	LTTNG_UST_CTL_METRIC_EVENT_DISCARD = 1,		/* Records not reserved */
+	LTTNG_UST_CTL_METRIC_RESERVE_SLOW = 2,		/* Reservations through the slow path */
+	LTTNG_UST_CTL_METRIC_FILTER_EVAL = 3,		/* Events whose filters were evaluated */
+	LTTNG_UST_CTL_METRIC_FILTER_ACCEPT = 4,		/* Events accepted by their filters */
+	LTTNG_UST_CTL_METRIC_PROBE_REGISTER = 5,	/* Probe provider registrations */
+	LTTNG_UST_CTL_METRIC_STATEDUMP = 6,		/* State dumps */
+	LTTNG_UST_CTL_METRIC_STATEDUMP_NS = 7,		/* Time spent in state dumps */
+	LTTNG_UST_CTL_METRIC_COMMAND = 8,		/* Session daemon commands handled */
+	LTTNG_UST_CTL_METRIC_COMMAND_NS = 9,		/* Time spent handling commands */
+
+	LTTNG_UST_CTL_NR_METRICS,
+};
+
+struct lttng_ust_ctl_metrics;
+
+/*
+ * Map the metrics of process pid. Returns 0 on success, -ENOENT if the
+ * process does not keep metrics, or another negative error value.
+ */
+int lttng_ust_ctl_metrics_open(pid_t pid,
+		struct lttng_ust_ctl_metrics **metrics);
+
+/*
+ * Read the value of each metric, aggregated across CPUs, into values,
+ * indexed by enum lttng_ust_ctl_metric. Returns the number of values
+ * read, at most nr_values, or a negative error value.
+ */
+int lttng_ust_ctl_metrics_read(struct lttng_ust_ctl_metrics *metrics,
+		uint64_t *values, size_t nr_values);
+
+/* Short name of a metric, or NULL if it is unknown. */
+const char *lttng_ust_ctl_metric_name(enum lttng_ust_ctl_metric metric);
+
+void lttng_ust_ctl_metrics_close(struct lttng_ust_ctl_metrics *metrics);
+
+/*
+ * Probe overhead of an application started with the
+ * LTTNG_UST_PROBE_OVERHEAD environment variable set: the number of hits
+ * and the cycles spent in the probes of each event, for the providers
+ * built with LTTNG_UST_TRACEPOINT_PROBE_OVERHEAD defined. Where there is
+ * no cycle counter, cycles are nanoseconds.
+ */
+struct lttng_ust_ctl_probe_overhead;
+
+struct lttng_ust_ctl_probe_overhead_entry {
+	char name[LTTNG_UST_ABI_SYM_NAME_LEN];	/* provider:event */
+	uint64_t hits;
+	uint64_t cycles;
+};
+
+/*
+ * Map the probe overhead counters of process pid. Returns 0 on success,
+ * -ENOENT if the process does not account probe overhead, or another
+ * negative error value.
+ */
+int lttng_ust_ctl_probe_overhead_open(pid_t pid,
+		struct lttng_ust_ctl_probe_overhead **overhead);
+
+/*
+ * Read the overhead of up to nr_entries events, in the order they were
+ * first created. Returns the number of entries filled, or a negative
+ * error value.
+ */
+int lttng_ust_ctl_probe_overhead_read(struct lttng_ust_ctl_probe_overhead *overhead,
+		struct lttng_ust_ctl_probe_overhead_entry *entries,
+		size_t nr_entries);
+
+void lttng_ust_ctl_probe_overhead_close(struct lttng_ust_ctl_probe_overhead *overhead);
+
+/*
+ * Records of each event which could not be reserved, because their
+ * sub-buffer was full or for any other reason, in an application started
+ * with the LTTNG_UST_METRICS environment variable set. The events of all
+ * the channels and sessions with the same provider:event name share
+ * their count.
+ */
+struct lttng_ust_ctl_event_discards;
+
+struct lttng_ust_ctl_event_discards_entry {
+	char name[LTTNG_UST_ABI_SYM_NAME_LEN];	/* provider:event */
+	uint64_t discarded;
+};
+
+/*
+ * Map the event discard counters of process pid. Returns 0 on success,
+ * -ENOENT if the process does not keep metrics, or another negative
+ * error value.
+ */
+int lttng_ust_ctl_event_discards_open(pid_t pid,
+		struct lttng_ust_ctl_event_discards **discards);
+
+/*
+ * Read the discards of up to nr_entries events, in the order they were
+ * first created. Returns the number of entries filled, or a negative
+ * error value.
+ */
+int lttng_ust_ctl_event_discards_read(struct lttng_ust_ctl_event_discards *discards,
+		struct lttng_ust_ctl_event_discards_entry *entries,
+		size_t nr_entries);
+
+void lttng_ust_ctl_event_discards_close(struct lttng_ust_ctl_event_discards *discards);
+
 void lttng_ust_ctl_sigbus_handle(void *addr);
 
 #ifdef __cplusplus
@@ -16,6 +16,8 @@
 #include <lttng/ust-endian.h>
 #include <float.h>
 #include <errno.h>
+#include <urcu/compiler.h>
+#include <urcu/arch.h>
 #include <urcu/ref.h>
 #include <pthread.h>
 #include <limits.h>
@@ -301,6 +303,8 @@ struct lttng_ust_event_desc {
 	const char **model_emf_uri;
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	const int *hot;				/* Non-NULL if declared hot. */
 };
 
 /*
@@ -326,6 +330,18 @@ struct lttng_ust_probe_desc {
 
 /* Data structures used by the tracer. */
 
+/*
+ * Context values computed while handling a single tracepoint hit, so
+ * each context is evaluated at most once per hit by filters and
+ * recording. Allocated on the stack by the probe, which only clears
+ * @nr_entries. The content of @data is private to the tracer.
+ */
+#define LTTNG_UST_PROBE_CTX_MEMO_DATA_LEN	128
+struct lttng_ust_probe_ctx_memo {
+	uint32_t nr_entries;
+	uint64_t data[LTTNG_UST_PROBE_CTX_MEMO_DATA_LEN / sizeof(uint64_t)];
+};
+
 /*
  * IMPORTANT: this structure is part of the ABI between the probe and
  * UST. Fields need to be only added at the end, never reordered, never
@@ -344,6 +360,9 @@ struct lttng_ust_probe_ctx {
 	void *ip;				/* caller ip address */
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	void *frame;				/* probe frame address */
+	struct lttng_ust_probe_ctx_memo *memo;	/* context values memo, may be NULL */
 };
 
 /*
@@ -401,8 +420,28 @@ struct lttng_ust_event_common {
 		void *filter_ctx);
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	int filter_payload;				/* Filters read payload fields */
 };
 
+/*
+ * Whether the filters of @event need the interpreter stack data to be
+ * prepared from the event payload. Filters which only read context
+ * fields are run without preparing it. Paired with the barriers issued
+ * by the tracer when updating filter_payload and the filters.
+ */
+static inline
+int lttng_ust_event_filter_payload(const struct lttng_ust_event_common *event)
+{
+	if (event->struct_size < offsetof(struct lttng_ust_event_common, filter_payload)
+			+ sizeof(event->filter_payload))
+		return 1;
+	if (CMM_ACCESS_ONCE(event->filter_payload))
+		return 1;
+	cmm_smp_rmb();	/* Read filter_payload before the filters. */
+	return 0;
+}
+
 struct lttng_ust_event_recorder_private;
 
 /*
@@ -503,8 +542,67 @@ struct lttng_ust_channel_buffer_ops {
 			const char *src, size_t len);
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	/*
+	 * Batched reservation of records of a single event, committed
+	 * together by event_commit(). event_reserve_batch() returns the
+	 * number of records reserved, or a negative error value.
+	 * event_reserve_batch_next() writes the header of the following
+	 * record of the batch. NULL if unsupported by the channel.
+	 */
+	int (*event_reserve_batch)(struct lttng_ust_ring_buffer_ctx *ctx,
+			unsigned int nr_records);
+	void (*event_reserve_batch_next)(struct lttng_ust_ring_buffer_ctx *ctx);
+
+	/*
+	 * Reserve a record, write its payload of ctx->data_size bytes
+	 * from @src, aligned on ctx->largest_align, and commit it, with a
+	 * single call. Returns the event_reserve() result. NULL if
+	 * unsupported by the channel.
+	 */
+	int (*event_record)(struct lttng_ust_ring_buffer_ctx *ctx,
+			const void *src);
+
+	/*
+	 * Interned strings, identified by a non-zero 64-bit hash of their
+	 * content, @id, and told apart by a second hash, @check. The
+	 * reservation of a record whose ctx->intern is set decides whether
+	 * it holds its strings in full. event_intern() records that the
+	 * reserved record @ctx holds the string @id in full, and returns
+	 * the id to record with it: @id, or 0 if the string cannot be
+	 * interned in the packet of the record. NULL if unsupported by the
+	 * channel.
+	 */
+	uint64_t (*event_intern)(struct lttng_ust_ring_buffer_ctx *ctx,
+			uint64_t id, uint64_t check);
 };
 
+/*
+ * Whether the channel operations @ops provide event_record(), for probes
+ * whose payload is laid out before the reservation.
+ */
+static inline
+int lttng_ust_channel_has_event_record(const struct lttng_ust_channel_buffer_ops *ops)
+{
+	if (ops->struct_size < offsetof(struct lttng_ust_channel_buffer_ops, event_record)
+			+ sizeof(ops->event_record))
+		return 0;
+	return ops->event_record != NULL;
+}
+
+/*
+ * Whether the channel operations @ops provide event_intern(), and their
+ * reservations honour ctx->intern, for interned string fields.
+ */
+static inline
+int lttng_ust_channel_has_string_intern(const struct lttng_ust_channel_buffer_ops *ops)
+{
+	if (ops->struct_size < offsetof(struct lttng_ust_channel_buffer_ops, event_intern)
+			+ sizeof(ops->event_intern))
+		return 0;
+	return ops->event_intern != NULL;
+}
+
 enum lttng_ust_channel_type {
 	LTTNG_UST_CHANNEL_TYPE_BUFFER = 0,
 };
@@ -604,6 +702,19 @@ struct lttng_ust_registered_probe *lttng_ust_probe_register(const struct lttng_u
 
 void lttng_ust_probe_unregister(struct lttng_ust_registered_probe *reg_probe);
 
+/*
+ * Probe overhead accounting, called by the probes of providers built
+ * with LTTNG_UST_TRACEPOINT_PROBE_OVERHEAD defined.
+ * lttng_ust_probe_overhead_begin() returns 0 unless the
+ * LTTNG_UST_PROBE_OVERHEAD environment variable is set, in which case
+ * the probe passes its return value to lttng_ust_probe_overhead_end()
+ * on exit.
+ */
+uint64_t lttng_ust_probe_overhead_begin(void);
+
+void lttng_ust_probe_overhead_end(const struct lttng_ust_event_common *event,
+		uint64_t begin);
+
 /*
  * Applications that change their procname and need the new value to be
  * reflected in the procname event context have to call this function to clear
@@ -25,6 +25,35 @@ struct lttng_ust_ring_buffer_ctx;
 struct lttng_ust_ring_buffer_ctx_private;
 struct lttng_ust_probe_ctx;
 
+#define LTTNG_UST_RING_BUFFER_INTERN_MAX	8
+
+/*
+ * Interned strings of a record, laid out by the probe before the
+ * reservation.
+ *
+ * IMPORTANT: this structure is part of the ABI between the probe and
+ * UST. Fields need to be only added at the end, never reordered, never
+ * removed.
+ *
+ * The reservation decides, for the packet it ends up in, whether the
+ * record holds the strings @ids in full, with a payload of @full_size
+ * bytes, or only their ids, with a payload of @interned_size bytes, and
+ * sets @interned accordingly. @checks holds a second hash of each
+ * string, which tells colliding ids apart.
+ */
+struct lttng_ust_ring_buffer_intern {
+	uint32_t struct_size;			/* Size of this structure. */
+
+	unsigned int nr_strings;
+	uint64_t ids[LTTNG_UST_RING_BUFFER_INTERN_MAX];
+	uint64_t checks[LTTNG_UST_RING_BUFFER_INTERN_MAX];
+	size_t full_size;
+	size_t interned_size;
+	int interned;				/* Set by the reservation. */
+
+	/* End of base ABI. Fields below should be used after checking struct_size. */
+};
+
 /*
  * ring buffer context
  *
@@ -51,6 +80,9 @@ struct lttng_ust_ring_buffer_ctx {
 	struct lttng_ust_ring_buffer_ctx_private *priv;
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	/* Interned strings of the record, NULL if none. */
+	struct lttng_ust_ring_buffer_intern *intern;
 };
 
 /**
@@ -77,6 +109,7 @@ void lttng_ust_ring_buffer_ctx_init(struct lttng_ust_ring_buffer_ctx *ctx,
 	ctx->largest_align = largest_align;
 	ctx->probe_ctx = probe_ctx;
 	ctx->priv = NULL;
+	ctx->intern = NULL;
 }
 
 /*
@@ -8,6 +8,7 @@
 #define _LTTNG_UST_THREAD_H
 
 #include <signal.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,6 +23,21 @@ extern "C" {
  */
 void lttng_ust_init_thread(void);
 
+/*
+ * Record a lttng_ust_sigsafe:record event holding the signal number
+ * @signo and the @len bytes of text @msg, typically from a crash
+ * handler into a flight recorder session. This is async-signal-safe:
+ * it never allocates memory, takes locks, nor blocks waiting for the
+ * consumer, and it can still record when the signal interrupts the
+ * tracer at its maximum nesting.
+ *
+ * It only records events from threads which called
+ * lttng_ust_init_thread() beforehand, and does nothing otherwise.
+ * Contexts which lazily allocate per-thread state (perf counters)
+ * should not be added to the channels it records to.
+ */
+void lttng_ust_sigsafe_record(int signo, const char *msg, size_t len);
+
 #ifdef __cplusplus
 }
 #endif
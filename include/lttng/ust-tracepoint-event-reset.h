@@ -27,6 +27,9 @@
 #undef LTTNG_UST_TRACEPOINT_MODEL_EMF_URI
 #define LTTNG_UST_TRACEPOINT_MODEL_EMF_URI(provider, name, uri)
 
+#undef LTTNG_UST_TRACEPOINT_HOT
+#define LTTNG_UST_TRACEPOINT_HOT(provider, name)
+
 #undef lttng_ust__field_integer_ext
 #define lttng_ust__field_integer_ext(_type, _item, _src, _byte_order, _base, \
 			_nowrite)
@@ -42,9 +45,15 @@
 #define lttng_ust__field_sequence_encoded(_type, _item, _src, _byte_order, _length_type, \
 			_src_length, _encoding, _nowrite, _elem_type_base)
 
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite)
+
 #undef lttng_ust__field_string
 #define lttng_ust__field_string(_item, _src, _nowrite)
 
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)
+
 #undef lttng_ust__field_unused
 #define lttng_ust__field_unused(_src)
 
@@ -97,9 +106,15 @@
 #undef lttng_ust_field_sequence_text
 #define lttng_ust_field_sequence_text(_type, _item, _src, _length_type, _src_length)
 
+#undef lttng_ust_field_sequence_iovec
+#define lttng_ust_field_sequence_iovec(_item, _iov, _iovcnt, _length_type)
+
 #undef lttng_ust_field_string
 #define lttng_ust_field_string(_item, _src)
 
+#undef lttng_ust_field_string_interned
+#define lttng_ust_field_string_interned(_item, _src)
+
 #undef lttng_ust_field_unused
 #define lttng_ust_field_unused(_src)
 
@@ -74,10 +74,18 @@
 	lttng_ust__field_sequence_encoded(_type, _item, _src, LTTNG_UST_BYTE_ORDER,	\
 			_length_type, _src_length, UTF8, 0, 10)
 
+#undef lttng_ust_field_sequence_iovec
+#define lttng_ust_field_sequence_iovec(_item, _iov, _iovcnt, _length_type)	\
+	lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, 0)
+
 #undef lttng_ust_field_string
 #define lttng_ust_field_string(_item, _src)					\
 	lttng_ust__field_string(_item, _src, 0)
 
+#undef lttng_ust_field_string_interned
+#define lttng_ust_field_string_interned(_item, _src)				\
+	lttng_ust__field_string_interned(_item, _src, 0)
+
 #undef lttng_ust_field_unused
 #define lttng_ust_field_unused(_src)					\
 	lttng_ust__field_unused(_src)
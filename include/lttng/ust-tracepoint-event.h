@@ -17,6 +17,7 @@
 #include <lttng/ust-endian.h>
 #include <lttng/ust-api-compat.h>
 #include <string.h>
+#include <sys/uio.h>
 #include <lttng/ust-api-compat.h>
 
 #if LTTNG_UST_COMPAT_API(0)
@@ -98,6 +99,79 @@
 /* Helpers */
 #define LTTNG_UST__TP_ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
+/*
+ * Total length of the buffers of an iovec array, and copy of those
+ * buffers, up to the length reserved, into the payload of an event.
+ */
+#ifndef LTTNG_UST__TP_IOVEC_HELPERS
+#define LTTNG_UST__TP_IOVEC_HELPERS
+
+static inline
+size_t lttng_ust__tp_iovec_len(const struct iovec *iov, int iovcnt)
+	lttng_ust_notrace;
+static inline
+size_t lttng_ust__tp_iovec_len(const struct iovec *iov, int iovcnt)
+{
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	return len;
+}
+
+static inline
+void lttng_ust__tp_iovec_write(struct lttng_ust_channel_buffer *chan,
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		const struct iovec *iov, int iovcnt, size_t len)
+	lttng_ust_notrace;
+static inline
+void lttng_ust__tp_iovec_write(struct lttng_ust_channel_buffer *chan,
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		const struct iovec *iov, int iovcnt, size_t len)
+{
+	int i;
+
+	for (i = 0; i < iovcnt && len; i++) {
+		size_t iov_len = iov[i].iov_len < len ? iov[i].iov_len : len;
+
+		chan->ops->event_write(ctx, iov[i].iov_base, iov_len, 1);
+		len -= iov_len;
+	}
+}
+
+#endif /* LTTNG_UST__TP_IOVEC_HELPERS */
+
+/*
+ * Id of an interned string: 64-bit FNV-1a hash of its content, never 0,
+ * which stands for a string recorded without interning. @check receives
+ * a second, independent hash of the content, which tells apart strings
+ * whose ids collide.
+ */
+#ifndef LTTNG_UST__TP_INTERN_HELPERS
+#define LTTNG_UST__TP_INTERN_HELPERS
+
+static inline
+uint64_t lttng_ust__tp_string_hash(const char *str, size_t len, uint64_t *check)
+	lttng_ust_notrace;
+static inline
+uint64_t lttng_ust__tp_string_hash(const char *str, size_t len, uint64_t *check)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL, hash2 = len;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 0x100000001b3ULL;
+		hash2 = (hash2 + (unsigned char) str[i]) * 0xff51afd7ed558ccdULL;
+		hash2 ^= hash2 >> 29;
+	}
+	*check = hash2;
+	return hash ? hash : 1;
+}
+
+#endif /* LTTNG_UST__TP_INTERN_HELPERS */
+
 #define lttng_ust__tp_max_t(type, x, y)			\
 	({						\
 		type lttng_ust__max1 = (x);            	\
@@ -423,6 +497,32 @@ extern const struct lttng_ust_probe_desc LTTNG_UST__TP_COMBINE_TOKENS(lttng_ust_
 		.nofilter = 0,					\
 	}),
 
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite) \
+	LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_event_field, { \
+		.struct_size = sizeof(struct lttng_ust_event_field), \
+		.name = "_" #_item "_length",			\
+		.type = lttng_ust_type_integer_define(_length_type, LTTNG_UST_BYTE_ORDER, 10), \
+		.nowrite = _nowrite,				\
+		.nofilter = 1,					\
+	}),							\
+	LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_event_field, { \
+		.struct_size = sizeof(struct lttng_ust_event_field), \
+		.name = #_item,					\
+		.type = (const struct lttng_ust_type_common *) LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_type_sequence, { \
+			.parent = {				\
+				.type = lttng_ust_type_sequence, \
+			},					\
+			.struct_size = sizeof(struct lttng_ust_type_sequence), \
+			.length_name = NULL,	/* Use previous field. */ \
+			.elem_type = lttng_ust_type_integer_define(uint8_t, LTTNG_UST_BYTE_ORDER, 16), \
+			.alignment = 0,				\
+			.encoding = lttng_ust_string_encoding_none, \
+		}),						\
+		.nowrite = _nowrite,				\
+		.nofilter = 1,	/* Not contiguous in memory. */	\
+	}),
+
 #undef lttng_ust__field_string
 #define lttng_ust__field_string(_item, _src, _nowrite)			\
 	LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_event_field, { \
@@ -439,6 +539,29 @@ extern const struct lttng_ust_probe_desc LTTNG_UST__TP_COMBINE_TOKENS(lttng_ust_
 		.nofilter = 0,					\
 	}),
 
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)		\
+	LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_event_field, { \
+		.struct_size = sizeof(struct lttng_ust_event_field), \
+		.name = "_" #_item "_id",			\
+		.type = lttng_ust_type_integer_define(uint64_t, LTTNG_UST_BYTE_ORDER, 16), \
+		.nowrite = _nowrite,				\
+		.nofilter = 1,					\
+	}),							\
+	LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_event_field, { \
+		.struct_size = sizeof(struct lttng_ust_event_field), \
+		.name = #_item,					\
+		.type = (const struct lttng_ust_type_common *) LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_type_string, { \
+			.parent = {				\
+				.type = lttng_ust_type_string,	\
+			},					\
+			.struct_size = sizeof(struct lttng_ust_type_string), \
+			.encoding = lttng_ust_string_encoding_UTF8, \
+		}),						\
+		.nowrite = _nowrite,				\
+		.nofilter = 0,					\
+	}),
+
 #undef lttng_ust__field_unused
 #define lttng_ust__field_unused(_src)
 
@@ -533,11 +656,51 @@ extern const struct lttng_ust_probe_desc LTTNG_UST__TP_COMBINE_TOKENS(lttng_ust_
 	__event_len += sizeof(_type) * __dynamic_len[__dynamic_len_idx];       \
 	__dynamic_len_idx++;
 
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite) \
+	__event_len += lttng_ust_ring_buffer_align(__event_len, lttng_ust_rb_alignof(_length_type)); \
+	__event_len += sizeof(_length_type);				       \
+	__dynamic_len[__dynamic_len_idx] = lttng_ust__tp_iovec_len(_iov, _iovcnt); \
+	__event_len += __dynamic_len[__dynamic_len_idx];		       \
+	__dynamic_len_idx++;
+
 #undef lttng_ust__field_string
 #define lttng_ust__field_string(_item, _src, _nowrite)				       \
 	__event_len += __dynamic_len[__dynamic_len_idx++] =		       \
 		strlen((_src) ? (_src) : LTTNG_UST__NULL_STRING) + 1;
 
+/*
+ * Interned strings are registered in @__intern, which the reservation
+ * uses to decide whether the record holds them in full or as empty
+ * strings after their ids. The payload size is computed for both cases,
+ * @__intern_short selecting the latter. The dynamic length array holds
+ * the string length followed by its index in @__intern plus one, 0 for
+ * a string recorded without interning.
+ */
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)		       \
+	{								       \
+		const char *__ctf_tmp_string =				       \
+			((_src) ? (_src) : LTTNG_UST__NULL_STRING);	       \
+		size_t __intern_len = strlen(__ctf_tmp_string) + 1;	       \
+		size_t __intern_idx = 0;				       \
+									       \
+		if (__intern && __intern_len > 1			       \
+				&& __intern_nr < LTTNG_UST_RING_BUFFER_INTERN_MAX) { \
+			__intern_idx = ++__intern_nr;			       \
+			if (!__intern_short)				       \
+				__intern->ids[__intern_idx - 1] =	       \
+					lttng_ust__tp_string_hash(__ctf_tmp_string, \
+						__intern_len - 1,	       \
+						&__intern->checks[__intern_idx - 1]); \
+		}							       \
+		__event_len += lttng_ust_ring_buffer_align(__event_len, lttng_ust_rb_alignof(uint64_t)); \
+		__event_len += sizeof(uint64_t);			       \
+		__event_len += __intern_short && __intern_idx ? 1 : __intern_len; \
+		__dynamic_len[__dynamic_len_idx++] = __intern_len;	       \
+		__dynamic_len[__dynamic_len_idx++] = __intern_idx;	       \
+	}
+
 #undef lttng_ust__field_unused
 #define lttng_ust__field_unused(_src)							\
 	if (0)									\
@@ -556,20 +719,28 @@ extern const struct lttng_ust_probe_desc LTTNG_UST__TP_COMBINE_TOKENS(lttng_ust_
 #undef LTTNG_UST__TRACEPOINT_EVENT_CLASS
 #define LTTNG_UST__TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
 static inline								      \
-size_t lttng_ust__event_get_size__##_provider##___##_name(size_t *__dynamic_len, LTTNG_UST__TP_ARGS_DATA_PROTO(_args)) \
+size_t lttng_ust__event_get_size__##_provider##___##_name(			      \
+		size_t *__dynamic_len,					      \
+		struct lttng_ust_ring_buffer_intern *__intern,		      \
+		int __intern_short, LTTNG_UST__TP_ARGS_DATA_PROTO(_args))	      \
 	lttng_ust_notrace;						      \
 static inline								      \
 size_t lttng_ust__event_get_size__##_provider##___##_name(			      \
 		size_t *__dynamic_len __attribute__((__unused__)),	      \
+		struct lttng_ust_ring_buffer_intern *__intern,		      \
+		int __intern_short __attribute__((__unused__)),		      \
 		LTTNG_UST__TP_ARGS_DATA_PROTO(_args))				      \
 {									      \
 	size_t __event_len = 0;						      \
 	unsigned int __dynamic_len_idx __attribute__((__unused__)) = 0;	      \
+	unsigned int __intern_nr __attribute__((__unused__)) = 0;	      \
 									      \
 	if (0)								      \
 		(void) __tp_data;	/* don't warn if unused */	      \
 									      \
 	_fields								      \
+	if (__intern)							      \
+		__intern->nr_strings = __intern_nr;			      \
 	return __event_len;						      \
 }
 
@@ -698,6 +869,13 @@ size_t lttng_ust__event_get_size__##_provider##___##_name(			      \
 		__stack_data += sizeof(void *);				       \
 	}
 
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite) \
+	if (0) {							       \
+		(void) (_iov);	/* Unused */				       \
+		(void) (_iovcnt);	/* Unused */			       \
+	}
+
 #undef lttng_ust__field_string
 #define lttng_ust__field_string(_item, _src, _nowrite)				       \
 	{								       \
@@ -707,6 +885,11 @@ size_t lttng_ust__event_get_size__##_provider##___##_name(			      \
 		__stack_data += sizeof(void *);				       \
 	}
 
+/* The filters see the string itself, the id is not available to them. */
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)		       \
+	lttng_ust__field_string(_item, _src, _nowrite)
+
 #undef lttng_ust__field_unused
 #define lttng_ust__field_unused(_src)							\
 	if (0)									\
@@ -777,11 +960,25 @@ void lttng_ust__event_prepare_interpreter_stack__##_provider##___##_name(char *_
 	__event_align = lttng_ust__tp_max_t(size_t, __event_align, lttng_ust_rb_alignof(_length_type));	  \
 	__event_align = lttng_ust__tp_max_t(size_t, __event_align, lttng_ust_rb_alignof(_type));
 
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite) \
+	if (0) {							       \
+		(void) (_iov);	/* Unused */				       \
+		(void) (_iovcnt);	/* Unused */			       \
+	}								       \
+	__event_align = lttng_ust__tp_max_t(size_t, __event_align, lttng_ust_rb_alignof(_length_type));
+
 #undef lttng_ust__field_string
 #define lttng_ust__field_string(_item, _src, _nowrite)					\
 	if (0)									\
 		(void) (_src);	/* Unused */
 
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)			\
+	if (0)									\
+		(void) (_src);	/* Unused */					\
+	__event_align = lttng_ust__tp_max_t(size_t, __event_align, lttng_ust_rb_alignof(uint64_t));
+
 #undef lttng_ust__field_unused
 #define lttng_ust__field_unused(_src)							\
 	if (0)									\
@@ -812,6 +1009,221 @@ size_t lttng_ust__event_get_align__##_provider##___##_name(LTTNG_UST__TP_ARGS_PR
 
 #include LTTNG_UST_TRACEPOINT_INCLUDE
 
+/*
+ * Stage 4.1 of tracepoint event generation.
+ *
+ * Create the fixed-layout payload structure of each event, and an enum
+ * telling whether all the fields written by the event have a fixed size.
+ * The structure is packed, and each member aligned as the ring buffer
+ * aligns its field, so that it matches the payload layout of the event
+ * relative to its start, which the ring buffer aligns on the largest
+ * field alignment.
+ */
+
+/* Reset all macros within LTTNG_UST_TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+#include <lttng/ust-tracepoint-event-write.h>
+
+#undef lttng_ust__field_integer_ext
+#define lttng_ust__field_integer_ext(_type, _item, _src, _byte_order, _base, _nowrite) \
+	_type lttng_ust__field_##_item					       \
+		__attribute__((aligned(lttng_ust_rb_alignof(_type))));
+
+#undef lttng_ust__field_float
+#define lttng_ust__field_float(_type, _item, _src, _nowrite)			       \
+	_type lttng_ust__field_##_item					       \
+		__attribute__((aligned(lttng_ust_rb_alignof(_type))));
+
+#undef lttng_ust__field_array_encoded
+#define lttng_ust__field_array_encoded(_type, _item, _src, _byte_order, _length,	       \
+			_encoding, _nowrite, _elem_type_base)		       \
+	_type lttng_ust__field_##_item[_length]				       \
+		__attribute__((aligned(lttng_ust_rb_alignof(_type))));
+
+#undef lttng_ust__field_sequence_encoded
+#define lttng_ust__field_sequence_encoded(_type, _item, _src, _byte_order, _length_type,   \
+			_src_length, _encoding, _nowrite, _elem_type_base)
+
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite)
+
+#undef lttng_ust__field_string
+#define lttng_ust__field_string(_item, _src, _nowrite)
+
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)
+
+#undef lttng_ust__field_unused
+#define lttng_ust__field_unused(_src)
+
+#undef lttng_ust__field_enum
+#define lttng_ust__field_enum(_provider, _name, _type, _item, _src, _nowrite)		\
+	lttng_ust__field_integer_ext(_type, _item, _src, LTTNG_UST_BYTE_ORDER, 10, _nowrite)
+
+#undef LTTNG_UST_TP_ARGS
+#define LTTNG_UST_TP_ARGS(...) __VA_ARGS__
+
+#undef LTTNG_UST_TP_FIELDS
+#define LTTNG_UST_TP_FIELDS(...) __VA_ARGS__
+
+#undef LTTNG_UST__TRACEPOINT_EVENT_CLASS
+#define LTTNG_UST__TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
+struct lttng_ust__event_payload__##_provider##___##_name {			      \
+	_fields								      \
+	char lttng_ust__payload_end[0];					      \
+} __attribute__((packed));
+
+#include LTTNG_UST_TRACEPOINT_INCLUDE
+
+/* Reset all macros within LTTNG_UST_TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+#include <lttng/ust-tracepoint-event-write.h>
+
+#undef lttng_ust__field_integer_ext
+#define lttng_ust__field_integer_ext(_type, _item, _src, _byte_order, _base, _nowrite) \
+	&& 1
+
+#undef lttng_ust__field_float
+#define lttng_ust__field_float(_type, _item, _src, _nowrite)			       \
+	&& 1
+
+/* Text arrays are padded after their terminator. */
+#undef lttng_ust__field_array_encoded
+#define lttng_ust__field_array_encoded(_type, _item, _src, _byte_order, _length,	       \
+			_encoding, _nowrite, _elem_type_base)		       \
+	&& (lttng_ust_string_encoding_##_encoding == lttng_ust_string_encoding_none)
+
+#undef lttng_ust__field_sequence_encoded
+#define lttng_ust__field_sequence_encoded(_type, _item, _src, _byte_order, _length_type,   \
+			_src_length, _encoding, _nowrite, _elem_type_base)     \
+	&& 0
+
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite) \
+	&& 0
+
+#undef lttng_ust__field_string
+#define lttng_ust__field_string(_item, _src, _nowrite)					\
+	&& 0
+
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)			\
+	&& 0
+
+#undef lttng_ust__field_unused
+#define lttng_ust__field_unused(_src)
+
+#undef lttng_ust__field_enum
+#define lttng_ust__field_enum(_provider, _name, _type, _item, _src, _nowrite)		\
+	lttng_ust__field_integer_ext(_type, _item, _src, LTTNG_UST_BYTE_ORDER, 10, _nowrite)
+
+#undef LTTNG_UST_TP_ARGS
+#define LTTNG_UST_TP_ARGS(...) __VA_ARGS__
+
+#undef LTTNG_UST_TP_FIELDS
+#define LTTNG_UST_TP_FIELDS(...) __VA_ARGS__
+
+#undef LTTNG_UST__TRACEPOINT_EVENT_CLASS
+#define LTTNG_UST__TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
+enum {									      \
+	lttng_ust__event_fixed_layout__##_provider##___##_name = (1 _fields),	      \
+};
+
+#include LTTNG_UST_TRACEPOINT_INCLUDE
+
+/*
+ * Stage 4.2 of tracepoint event generation.
+ *
+ * Create static inline function that fills the fixed-layout payload of
+ * an event, for events whose fields all have a fixed size.
+ */
+
+/* Reset all macros within LTTNG_UST_TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+#include <lttng/ust-tracepoint-event-write.h>
+
+#undef lttng_ust__field_integer_ext
+#define lttng_ust__field_integer_ext(_type, _item, _src, _byte_order, _base, _nowrite) \
+	{								       \
+		_type __tmp = (_src);					       \
+		memcpy((void *) &__payload->lttng_ust__field_##_item, &__tmp, sizeof(__tmp)); \
+	}
+
+#undef lttng_ust__field_float
+#define lttng_ust__field_float(_type, _item, _src, _nowrite)			       \
+	{								       \
+		_type __tmp = (_src);					       \
+		memcpy((void *) &__payload->lttng_ust__field_##_item, &__tmp, sizeof(__tmp)); \
+	}
+
+#undef lttng_ust__field_array_encoded
+#define lttng_ust__field_array_encoded(_type, _item, _src, _byte_order, _length,	       \
+			_encoding, _nowrite, _elem_type_base)		       \
+	memcpy((void *) __payload->lttng_ust__field_##_item, _src, sizeof(_type) * (_length));
+
+#undef lttng_ust__field_sequence_encoded
+#define lttng_ust__field_sequence_encoded(_type, _item, _src, _byte_order, _length_type,   \
+			_src_length, _encoding, _nowrite, _elem_type_base)     \
+	if (0)								       \
+		(void) (_src);	/* Unused */				       \
+	if (0)								       \
+		(void) (_src_length);	/* Unused */
+
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite) \
+	if (0) {							       \
+		(void) (_iov);	/* Unused */				       \
+		(void) (_iovcnt);	/* Unused */			       \
+	}
+
+#undef lttng_ust__field_string
+#define lttng_ust__field_string(_item, _src, _nowrite)					\
+	if (0)									\
+		(void) (_src);	/* Unused */
+
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)			\
+	if (0)									\
+		(void) (_src);	/* Unused */
+
+#undef lttng_ust__field_unused
+#define lttng_ust__field_unused(_src)							\
+	if (0)									\
+		(void) (_src);	/* Unused */
+
+#undef lttng_ust__field_enum
+#define lttng_ust__field_enum(_provider, _name, _type, _item, _src, _nowrite)		\
+	lttng_ust__field_integer_ext(_type, _item, _src, LTTNG_UST_BYTE_ORDER, 10, _nowrite)
+
+#undef LTTNG_UST_TP_ARGS
+#define LTTNG_UST_TP_ARGS(...) __VA_ARGS__
+
+#undef LTTNG_UST_TP_FIELDS
+#define LTTNG_UST_TP_FIELDS(...) __VA_ARGS__
+
+#undef LTTNG_UST__TRACEPOINT_EVENT_CLASS
+#define LTTNG_UST__TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)	      \
+static inline __attribute__((always_inline))				      \
+void lttng_ust__event_fill_payload__##_provider##___##_name(		      \
+		struct lttng_ust__event_payload__##_provider##___##_name *__payload, \
+		LTTNG_UST__TP_ARGS_DATA_PROTO(_args))				      \
+	lttng_ust_notrace;						      \
+static inline __attribute__((always_inline))				      \
+void lttng_ust__event_fill_payload__##_provider##___##_name(		      \
+		struct lttng_ust__event_payload__##_provider##___##_name *__payload, \
+		LTTNG_UST__TP_ARGS_DATA_PROTO(_args))				      \
+{									      \
+	if (0) {							      \
+		(void) __tp_data;	/* don't warn if unused */	      \
+		(void) __payload;	/* don't warn if unused */	      \
+	}								      \
+	/* Alignment padding is not left uninitialized. */		      \
+	memset(__payload, 0, sizeof(*__payload));			      \
+	_fields								      \
+}
+
+#include LTTNG_UST_TRACEPOINT_INCLUDE
+
 
 /*
  * Stage 5 of tracepoint event generation.
@@ -859,6 +1271,15 @@ size_t lttng_ust__event_get_align__##_provider##___##_name(LTTNG_UST__TP_ARGS_PR
 	else								\
 		__chan->ops->event_pstrcpy_pad(&__ctx, (const char *) (_src), lttng_ust__get_dynamic_len(dest)); \
 
+#undef lttng_ust__field_sequence_iovec
+#define lttng_ust__field_sequence_iovec(_item, _iov, _iovcnt, _length_type, _nowrite) \
+	{								\
+		_length_type __tmpl = __stackvar.__dynamic_len[__dynamic_len_idx]; \
+		__chan->ops->event_write(&__ctx, &__tmpl, sizeof(_length_type), lttng_ust_rb_alignof(_length_type));\
+	}								\
+	lttng_ust__tp_iovec_write(__chan, &__ctx, _iov, _iovcnt,	\
+		lttng_ust__get_dynamic_len(dest));
+
 #undef lttng_ust__field_string
 #define lttng_ust__field_string(_item, _src, _nowrite)					\
 	{									\
@@ -868,6 +1289,31 @@ size_t lttng_ust__event_get_align__##_provider##___##_name(LTTNG_UST__TP_ARGS_PR
 			lttng_ust__get_dynamic_len(dest));			\
 	}
 
+#undef lttng_ust__field_string_interned
+#define lttng_ust__field_string_interned(_item, _src, _nowrite)			\
+	{									\
+		const char *__ctf_tmp_string =					\
+			((_src) ? (_src) : LTTNG_UST__NULL_STRING);		\
+		size_t __intern_len = lttng_ust__get_dynamic_len(dest);		\
+		size_t __intern_idx = lttng_ust__get_dynamic_len(dest);		\
+		uint64_t __intern_id = 0;					\
+										\
+		if (__intern_idx) {						\
+			__intern_id = __intern->ids[__intern_idx - 1];		\
+			if (!__intern->interned)				\
+				__intern_id = __chan->ops->event_intern(&__ctx,	\
+					__intern_id,				\
+					__intern->checks[__intern_idx - 1]);	\
+		}								\
+		__chan->ops->event_write(&__ctx, &__intern_id, sizeof(__intern_id), \
+			lttng_ust_rb_alignof(__intern_id));			\
+		if (__intern_idx && __intern->interned)				\
+			__chan->ops->event_strcpy(&__ctx, "", 1);		\
+		else								\
+			__chan->ops->event_strcpy(&__ctx, __ctf_tmp_string,	\
+				__intern_len);					\
+	}
+
 #undef lttng_ust__field_unused
 #define lttng_ust__field_unused(_src)
 
@@ -924,18 +1370,52 @@ size_t lttng_ust__event_get_align__##_provider##___##_name(LTTNG_UST__TP_ARGS_PR
  * 2*sizeof(unsigned long) for all supported architectures.
  * Perform UNION (||) of filter runtime list.
  */
-#undef LTTNG_UST__TRACEPOINT_EVENT_CLASS
-#define LTTNG_UST__TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)   \
+/*
+ * With LTTNG_UST_TRACEPOINT_PROBE_OVERHEAD, the probe body is inlined
+ * into a wrapper accounting the cycles spent in it, whichever return
+ * statement it exits through.
+ */
+#undef LTTNG_UST__TP_PROBE_BODY
+#undef LTTNG_UST__TP_PROBE_BODY_ATTR
+#undef LTTNG_UST__TP_PROBE_OVERHEAD_WRAPPER
+#ifdef LTTNG_UST_TRACEPOINT_PROBE_OVERHEAD
+#define LTTNG_UST__TP_PROBE_BODY(_provider, _name)			      \
+	lttng_ust__event_probe_body__##_provider##___##_name
+#define LTTNG_UST__TP_PROBE_BODY_ATTR	inline __attribute__((always_inline))
+#define LTTNG_UST__TP_PROBE_OVERHEAD_WRAPPER(_provider, _name, _args)	      \
 static									      \
 void lttng_ust__event_probe__##_provider##___##_name(LTTNG_UST__TP_ARGS_DATA_PROTO(_args)) \
 	lttng_ust_notrace;						      \
 static									      \
 void lttng_ust__event_probe__##_provider##___##_name(LTTNG_UST__TP_ARGS_DATA_PROTO(_args)) \
+{									      \
+	uint64_t __overhead_begin = lttng_ust_probe_overhead_begin();	      \
+									      \
+	lttng_ust__event_probe_body__##_provider##___##_name(LTTNG_UST__TP_ARGS_DATA_VAR(_args)); \
+	if (caa_unlikely(__overhead_begin))				      \
+		lttng_ust_probe_overhead_end((struct lttng_ust_event_common *) __tp_data, \
+			__overhead_begin);				      \
+}
+#else
+#define LTTNG_UST__TP_PROBE_BODY(_provider, _name)			      \
+	lttng_ust__event_probe__##_provider##___##_name
+#define LTTNG_UST__TP_PROBE_BODY_ATTR
+#define LTTNG_UST__TP_PROBE_OVERHEAD_WRAPPER(_provider, _name, _args)
+#endif
+
+#undef LTTNG_UST__TRACEPOINT_EVENT_CLASS
+#define LTTNG_UST__TRACEPOINT_EVENT_CLASS(_provider, _name, _args, _fields)   \
+static LTTNG_UST__TP_PROBE_BODY_ATTR					      \
+void LTTNG_UST__TP_PROBE_BODY(_provider, _name)(LTTNG_UST__TP_ARGS_DATA_PROTO(_args)) \
+	lttng_ust_notrace;						      \
+static LTTNG_UST__TP_PROBE_BODY_ATTR					      \
+void LTTNG_UST__TP_PROBE_BODY(_provider, _name)(LTTNG_UST__TP_ARGS_DATA_PROTO(_args)) \
 {									      \
 	struct lttng_ust_event_common *__event = (struct lttng_ust_event_common *) __tp_data; \
 	size_t __dynamic_len_idx = 0;					      \
 	const size_t __num_fields = LTTNG_UST__TP_ARRAY_SIZE(lttng_ust__event_fields___##_provider##___##_name) - 1; \
 	struct lttng_ust_probe_ctx __probe_ctx;				      \
+	struct lttng_ust_probe_ctx_memo __probe_ctx_memo;		      \
 	union {								      \
 		size_t __dynamic_len[__num_fields];			      \
 		char __interpreter_stack_data[2 * sizeof(unsigned long) * __num_fields]; \
@@ -969,10 +1449,15 @@ void lttng_ust__event_probe__##_provider##___##_name(LTTNG_UST__TP_ARGS_DATA_PRO
 		return;							      \
 	__probe_ctx.struct_size = sizeof(struct lttng_ust_probe_ctx);	      \
 	__probe_ctx.ip = LTTNG_UST__TP_IP_PARAM(LTTNG_UST_TP_IP_PARAM);	      \
+	__probe_ctx.frame = __builtin_frame_address(0);			      \
+	__probe_ctx_memo.nr_entries = 0;				      \
+	__probe_ctx.memo = &__probe_ctx_memo;				      \
 	if (caa_unlikely(CMM_ACCESS_ONCE(__event->eval_filter))) {	      \
-		lttng_ust__event_prepare_interpreter_stack__##_provider##___##_name(__stackvar.__interpreter_stack_data, \
-			LTTNG_UST__TP_ARGS_DATA_VAR(_args));		      \
-		__interpreter_stack_prepared = true;			      \
+		if (lttng_ust_event_filter_payload(__event)) {		      \
+			lttng_ust__event_prepare_interpreter_stack__##_provider##___##_name(__stackvar.__interpreter_stack_data, \
+				LTTNG_UST__TP_ARGS_DATA_VAR(_args));	      \
+			__interpreter_stack_prepared = true;		      \
+		}							      \
 		if (caa_likely(__event->run_filter(__event,		      \
 				__stackvar.__interpreter_stack_data, &__probe_ctx, NULL) != LTTNG_UST_EVENT_FILTER_ACCEPT)) \
 			return;						      \
@@ -984,12 +1469,46 @@ void lttng_ust__event_probe__##_provider##___##_name(LTTNG_UST__TP_ARGS_DATA_PRO
 		struct lttng_ust_event_recorder *__event_recorder = (struct lttng_ust_event_recorder *) __event->child; \
 		struct lttng_ust_channel_buffer *__chan = __event_recorder->chan; \
 		struct lttng_ust_ring_buffer_ctx __ctx;			      \
+		struct lttng_ust_ring_buffer_intern __intern_strings;	      \
+		struct lttng_ust_ring_buffer_intern *__intern = NULL;	      \
 									      \
-		__event_len = lttng_ust__event_get_size__##_provider##___##_name(__stackvar.__dynamic_len, \
-			 LTTNG_UST__TP_ARGS_DATA_VAR(_args));			      \
+		if (lttng_ust_channel_has_string_intern(__chan->ops)) {      \
+			__intern_strings.struct_size = sizeof(struct lttng_ust_ring_buffer_intern); \
+			__intern = &__intern_strings;			      \
+		}							      \
+		__event_len = lttng_ust__event_get_size__##_provider##___##_name( \
+			__stackvar.__dynamic_len, __intern, 0,		      \
+			LTTNG_UST__TP_ARGS_DATA_VAR(_args));		      \
+		if (__intern && __intern->nr_strings) {			      \
+			__intern->full_size = __event_len;		      \
+			__intern->interned_size = lttng_ust__event_get_size__##_provider##___##_name( \
+				__stackvar.__dynamic_len, __intern, 1,	      \
+				LTTNG_UST__TP_ARGS_DATA_VAR(_args));	      \
+			__intern->interned = 0;				      \
+		} else {						      \
+			__intern = NULL;				      \
+		}							      \
 		__event_align = lttng_ust__event_get_align__##_provider##___##_name(LTTNG_UST__TP_ARGS_VAR(_args)); \
 		lttng_ust_ring_buffer_ctx_init(&__ctx, __event_recorder, __event_len, __event_align, \
 				&__probe_ctx);				      \
+		__ctx.intern = __intern;				      \
+		if (lttng_ust__event_fixed_layout__##_provider##___##_name) {  \
+			struct lttng_ust__event_payload__##_provider##___##_name __payload; \
+									      \
+			lttng_ust__event_fill_payload__##_provider##___##_name(&__payload, \
+				LTTNG_UST__TP_ARGS_DATA_VAR(_args));	      \
+			if (caa_likely(lttng_ust_channel_has_event_record(__chan->ops))) { \
+				(void) __chan->ops->event_record(&__ctx, &__payload); \
+				break;					      \
+			}						      \
+			__ret = __chan->ops->event_reserve(&__ctx);	      \
+			if (__ret < 0)					      \
+				return;					      \
+			__chan->ops->event_write(&__ctx, &__payload, __event_len, \
+				__event_align);				      \
+			__chan->ops->event_commit(&__ctx);		      \
+			break;						      \
+		}							      \
 		__ret = __chan->ops->event_reserve(&__ctx);		      \
 		if (__ret < 0)						      \
 			return;						      \
@@ -1016,7 +1535,8 @@ void lttng_ust__event_probe__##_provider##___##_name(LTTNG_UST__TP_ARGS_DATA_PRO
 		break;							      \
 	}								      \
 	}								      \
-}
+}									      \
+LTTNG_UST__TP_PROBE_OVERHEAD_WRAPPER(_provider, _name, LTTNG_UST__TP_PARAMS(_args))
 
 #include LTTNG_UST_TRACEPOINT_INCLUDE
 
@@ -1036,9 +1556,8 @@ void lttng_ust__event_probe__##_provider##___##_name(LTTNG_UST__TP_ARGS_DATA_PRO
 
 /*
  * Declare _loglevel___##__provider##___##__name as non-static, with
- * hidden visibility for c++ handling of weakref. We do a weakref to the
- * symbol in a later stage, which requires that the symbol is not
- * mangled.
+ * hidden visibility for c++ handling of the weak declaration in a later
+ * stage, which requires that the symbol is not mangled.
  */
 #ifdef __cplusplus
 #define LTTNG_UST_TP_EXTERN_C extern "C"
@@ -1068,9 +1587,8 @@ LTTNG_UST_TP_EXTERN_C const int * const _loglevel___##__provider##___##__name	\
 
 /*
  * Declare _model_emf_uri___##__provider##___##__name as non-static,
- * with hidden visibility for c++ handling of weakref. We do a weakref
- * to the symbol in a later stage, which requires that the symbol is not
- * mangled.
+ * with hidden visibility for c++ handling of the weak declaration in a
+ * later stage, which requires that the symbol is not mangled.
  */
 #ifdef __cplusplus
 #define LTTNG_UST_TP_EXTERN_C extern "C"
@@ -1087,42 +1605,85 @@ LTTNG_UST_TP_EXTERN_C const char * const _model_emf_uri___##__provider##___##__n
 
 #undef LTTNG_UST_TP_EXTERN_C
 
+/*
+ * Stage 6.2 of tracepoint event generation.
+ *
+ * Hot tracepoints.
+ */
+
+/* Reset all macros within LTTNG_UST_TRACEPOINT_EVENT */
+#include <lttng/ust-tracepoint-event-reset.h>
+
+/*
+ * Declare _hot___##__provider##___##__name as non-static, with hidden
+ * visibility for c++ handling of the weak declaration in a later
+ * stage, which requires that the symbol is not mangled.
+ */
+#ifdef __cplusplus
+#define LTTNG_UST_TP_EXTERN_C extern "C"
+#else
+#define LTTNG_UST_TP_EXTERN_C
+#endif
+
+#undef LTTNG_UST_TRACEPOINT_HOT
+#define LTTNG_UST_TRACEPOINT_HOT(__provider, __name)			   \
+LTTNG_UST_TP_EXTERN_C const int _hot___##__provider##___##__name	   \
+		__attribute__((visibility("hidden"))) = 1;
+
+#include LTTNG_UST_TRACEPOINT_INCLUDE
+
+#undef LTTNG_UST_TP_EXTERN_C
+
 /*
  * Stage 7.0 of tracepoint event generation.
  *
- * Create events description structures. We use a weakref because
- * loglevels are optional. If not declared, the event will point to
- * a loglevel that contains NULL.
+ * Create events description structures. The loglevel, model EMF URI
+ * and hot symbols are declared weak because they are optional. If not
+ * declared, the event will point to a loglevel that contains NULL, and
+ * its hot pointer is NULL.
+ *
+ * The weak declarations have hidden visibility so the static linker
+ * resolves the undefined ones to NULL. A weakref does not carry the
+ * visibility of its target, which makes each event without a loglevel
+ * or model EMF URI cost two symbol lookups in the dynamic loader when
+ * the provider is loaded.
  *
- * C++ requires that const objects have a user-declared default
- * constructor. However, in both C++ and C, weakref cannot be
- * initialized because it causes the weakref attribute to be ignored.
- * Therefore, the loglevel and model_emf_uri pointers are not const
- * to ensure C++ compilers default-initialize them.
+ * Declare the symbols with C linkage, to match their definitions.
  */
+#ifdef __cplusplus
+#define LTTNG_UST_TP_EXTERN_C extern "C"
+#else
+#define LTTNG_UST_TP_EXTERN_C extern
+#endif
 
 /* Reset all macros within LTTNG_UST_TRACEPOINT_EVENT */
 #include <lttng/ust-tracepoint-event-reset.h>
 
 #undef LTTNG_UST__TRACEPOINT_EVENT_INSTANCE
 #define LTTNG_UST__TRACEPOINT_EVENT_INSTANCE(_template_provider, _template_name, _provider, _name, _args) \
-static const int *							       \
-	__ref_loglevel___##_provider##___##_name			       \
-	__attribute__((weakref ("_loglevel___" #_provider "___" #_name)));     \
-static const char *							       \
-	__ref_model_emf_uri___##_provider##___##_name			       \
-	__attribute__((weakref ("_model_emf_uri___" #_provider "___" #_name)));\
+LTTNG_UST_TP_EXTERN_C const int * const				       \
+	_loglevel___##_provider##___##_name				       \
+	__attribute__((weak, visibility("hidden")));			       \
+LTTNG_UST_TP_EXTERN_C const char * const				       \
+	_model_emf_uri___##_provider##___##_name			       \
+	__attribute__((weak, visibility("hidden")));			       \
+LTTNG_UST_TP_EXTERN_C const int					       \
+	_hot___##_provider##___##_name					       \
+	__attribute__((weak, visibility("hidden")));			       \
 static const struct lttng_ust_event_desc lttng_ust__event_desc___##_provider##_##_name = { \
 	.struct_size = sizeof(struct lttng_ust_event_desc),		       \
 	.event_name = #_name,						       \
 	.probe_desc = &lttng_ust__probe_desc___##_provider,			       \
 	.tp_class = &lttng_ust__event_class___##_template_provider##___##_template_name, \
-	.loglevel = &__ref_loglevel___##_provider##___##_name,		       \
-	.model_emf_uri = &__ref_model_emf_uri___##_provider##___##_name,       \
+	.loglevel = (const int **) &_loglevel___##_provider##___##_name,      \
+	.model_emf_uri = (const char **) &_model_emf_uri___##_provider##___##_name, \
+	.hot = &_hot___##_provider##___##_name,				       \
 };
 
 #include LTTNG_UST_TRACEPOINT_INCLUDE
 
+#undef LTTNG_UST_TP_EXTERN_C
+
 /*
  * Stage 7.1 of tracepoint event generation.
  *
@@ -27,7 +27,7 @@ static inline void lttng_bitmap_set_bit(unsigned int index, unsigned long *p)
 	unsigned long val;
 
 	lttng_bitmap_index(index, &word, &bit);
-	val = 1U << bit;
+	val = 1UL << bit;
 	uatomic_or(p + word, val);
 }
 
@@ -37,7 +37,7 @@ static inline void lttng_bitmap_clear_bit(unsigned int index, unsigned long *p)
 	unsigned long val;
 
 	lttng_bitmap_index(index, &word, &bit);
-	val = ~(1U << bit);
+	val = ~(1UL << bit);
 	uatomic_and(p + word, val);
 }
 
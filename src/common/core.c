@@ -8,12 +8,14 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include <lttng/ust-ringbuffer-context.h>
 
 #include "common/logging.h"
 #include "common/tracer.h"
 #include "common/jhash.h"
+#include "common/ust-context-provider.h"
 
 
 /*
@@ -116,6 +118,74 @@ void lttng_ust_dummy_get_value(void *priv __attribute__((unused)),
 	value->sel = LTTNG_UST_DYNAMIC_TYPE_NONE;
 }
 
+/*
+ * Size and alignment of the zero value recorded in place of the fixed
+ * type value of an app context whose provider is not registered.
+ */
+static
+size_t dummy_fixed_size(void *priv, size_t *align)
+{
+	struct lttng_ust_app_context *app_ctx = (struct lttng_ust_app_context *) priv;
+	const struct lttng_ust_type_common *type = app_ctx->event_field->type;
+
+	switch (type->type) {
+	case lttng_ust_type_integer:
+		*align = lttng_ust_get_type_integer(type)->alignment / CHAR_BIT;
+		return lttng_ust_get_type_integer(type)->size / CHAR_BIT;
+	case lttng_ust_type_float:
+	{
+		const struct lttng_ust_type_float *ftype = lttng_ust_get_type_float(type);
+
+		*align = ftype->alignment / CHAR_BIT;
+		return (ftype->exp_dig + ftype->mant_dig) / CHAR_BIT;
+	}
+	case lttng_ust_type_string:
+	default:
+		*align = 1;
+		return 1;	/* Empty string. */
+	}
+}
+
+size_t lttng_ust_dummy_fixed_get_size(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		size_t offset)
+{
+	size_t size = 0, len, align;
+
+	len = dummy_fixed_size(priv, &align);
+	size += lttng_ust_ring_buffer_align(offset, align);
+	size += len;
+	return size;
+}
+
+void lttng_ust_dummy_fixed_record(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_channel_buffer *chan)
+{
+	static const char zero[sizeof(uint64_t)];
+	size_t len, align;
+
+	len = dummy_fixed_size(priv, &align);
+	chan->ops->event_write(ctx, zero, len, align);
+}
+
+void lttng_ust_dummy_fixed_get_value(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ctx_value *value)
+{
+	struct lttng_ust_app_context *app_ctx = (struct lttng_ust_app_context *) priv;
+
+	value->sel = app_ctx->fixed_type;
+	if (value->sel == LTTNG_UST_DYNAMIC_TYPE_STRING)
+		value->u.str = "";
+	else if (value->sel == LTTNG_UST_DYNAMIC_TYPE_FLOAT
+			|| value->sel == LTTNG_UST_DYNAMIC_TYPE_DOUBLE)
+		value->u.d = 0;
+	else
+		value->u.u64 = 0;
+}
+
 int lttng_context_is_app(const char *name)
 {
 	if (strncmp(name, "$app.", strlen("$app.")) != 0) {
@@ -167,6 +237,18 @@ void lttng_ust_free_channel_common(struct lttng_ust_channel_common *chan)
 		struct lttng_ust_channel_buffer *chan_buf;
 
 		chan_buf = (struct lttng_ust_channel_buffer *)chan->child;
+		if (chan_buf->priv->intern_caches) {
+			unsigned int i;
+
+			for (i = 0; i < chan_buf->priv->nr_intern_caches; i++)
+				free(chan_buf->priv->intern_caches[i]);
+			free(chan_buf->priv->intern_caches);
+		}
+		if (chan_buf->priv->staging) {
+			free(chan_buf->priv->staging->busy);
+			free(chan_buf->priv->staging->slots);
+			free(chan_buf->priv->staging);
+		}
 		free(chan_buf->parent);
 		free(chan_buf->priv);
 		free(chan_buf);
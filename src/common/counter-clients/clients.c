@@ -10,10 +10,22 @@ void lttng_ust_counter_clients_init(void)
 {
 	lttng_counter_client_percpu_64_modular_init();
 	lttng_counter_client_percpu_32_modular_init();
+	lttng_counter_client_percpu_64_saturation_init();
+	lttng_counter_client_percpu_32_saturation_init();
+	lttng_counter_client_percpu_16_modular_init();
+	lttng_counter_client_percpu_8_modular_init();
+	lttng_counter_client_percpu_16_saturation_init();
+	lttng_counter_client_percpu_8_saturation_init();
 }
 
 void lttng_ust_counter_clients_exit(void)
 {
+	lttng_counter_client_percpu_8_saturation_exit();
+	lttng_counter_client_percpu_16_saturation_exit();
+	lttng_counter_client_percpu_8_modular_exit();
+	lttng_counter_client_percpu_16_modular_exit();
+	lttng_counter_client_percpu_32_saturation_exit();
+	lttng_counter_client_percpu_64_saturation_exit();
 	lttng_counter_client_percpu_32_modular_exit();
 	lttng_counter_client_percpu_64_modular_exit();
 }
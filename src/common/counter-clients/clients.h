@@ -27,4 +27,40 @@ void lttng_counter_client_percpu_64_modular_init(void)
 void lttng_counter_client_percpu_64_modular_exit(void)
 	__attribute__((visibility("hidden")));
 
+void lttng_counter_client_percpu_32_saturation_init(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_32_saturation_exit(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_64_saturation_init(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_64_saturation_exit(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_8_modular_init(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_8_modular_exit(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_16_modular_init(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_16_modular_exit(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_8_saturation_init(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_8_saturation_exit(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_16_saturation_init(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_counter_client_percpu_16_saturation_exit(void)
+	__attribute__((visibility("hidden")));
+
 #endif /* _UST_COMMON_COUNTER_CLIENTS_CLIENTS_H */
@@ -67,6 +67,14 @@ static int counter_aggregate(struct lib_counter *counter, const size_t *dimensio
 				       overflow, underflow);
 }
 
+static int counter_aggregate_all(struct lib_counter *counter, int64_t *values,
+				 size_t nr_values, unsigned long *overflow,
+				 unsigned long *underflow)
+{
+	return lttng_counter_aggregate_all(&client_config, counter, values, nr_values,
+					   overflow, underflow);
+}
+
 static int counter_clear(struct lib_counter *counter, const size_t *dimension_indexes)
 {
 	return lttng_counter_clear(&client_config, counter, dimension_indexes);
@@ -80,6 +88,7 @@ static struct lttng_counter_transport lttng_counter_transport = {
 		.counter_add = counter_add,
 		.counter_read = counter_read,
 		.counter_aggregate = counter_aggregate,
+		.counter_aggregate_all = counter_aggregate_all,
 		.counter_clear = counter_clear,
 	},
 	.client_config = &client_config,
@@ -30,7 +30,7 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 				      int64_t *remainder)
 {
 	size_t index;
-	bool overflow = false, underflow = false;
+	bool overflow = false, underflow = false, saturated = false;
 	struct lib_counter_layout *layout;
 	int64_t move_sum = 0;
 
@@ -51,7 +51,7 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 	if (caa_unlikely(!layout->counters))
 		return -ENODEV;
 
-	switch (config->counter_size) {
+	switch (lttng_counter_layout_size(config, alloc)) {
 	case COUNTER_SIZE_8_BIT:
 	{
 		int8_t *int_p = (int8_t *) layout->counters + index;
@@ -65,7 +65,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 			do {
 				move_sum = 0;
 				old = res;
-				n = (int8_t) ((uint8_t) old + (uint8_t) v);
+				saturated = false;
+				if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE)
+					n = (int8_t) lttng_counter_saturate_add(old, v, INT8_MIN, INT8_MAX, &saturated);
+				else
+					n = (int8_t) ((uint8_t) old + (uint8_t) v);
 				if (caa_unlikely(n > (int8_t) global_sum_step))
 					move_sum = (int8_t) global_sum_step / 2;
 				else if (caa_unlikely(n < -(int8_t) global_sum_step))
@@ -79,7 +83,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 		{
 			do {
 				old = res;
-				n = (int8_t) ((uint8_t) old + (uint8_t) v);
+				saturated = false;
+				if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE)
+					n = (int8_t) lttng_counter_saturate_add(old, v, INT8_MIN, INT8_MAX, &saturated);
+				else
+					n = (int8_t) ((uint8_t) old + (uint8_t) v);
 				res = uatomic_cmpxchg(int_p, old, n);
 			} while (old != res);
 			break;
@@ -87,6 +95,8 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 		default:
 			return -EINVAL;
 		}
+		/* Compare the sum before its carry into the global counter. */
+		n = (int8_t) (n + move_sum);
 		if (v > 0 && (v >= UINT8_MAX || n < old))
 			overflow = true;
 		else if (v < 0 && (v <= -(int64_t) UINT8_MAX || n > old))
@@ -106,7 +116,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 			do {
 				move_sum = 0;
 				old = res;
-				n = (int16_t) ((uint16_t) old + (uint16_t) v);
+				saturated = false;
+				if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE)
+					n = (int16_t) lttng_counter_saturate_add(old, v, INT16_MIN, INT16_MAX, &saturated);
+				else
+					n = (int16_t) ((uint16_t) old + (uint16_t) v);
 				if (caa_unlikely(n > (int16_t) global_sum_step))
 					move_sum = (int16_t) global_sum_step / 2;
 				else if (caa_unlikely(n < -(int16_t) global_sum_step))
@@ -120,7 +134,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 		{
 			do {
 				old = res;
-				n = (int16_t) ((uint16_t) old + (uint16_t) v);
+				saturated = false;
+				if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE)
+					n = (int16_t) lttng_counter_saturate_add(old, v, INT16_MIN, INT16_MAX, &saturated);
+				else
+					n = (int16_t) ((uint16_t) old + (uint16_t) v);
 				res = uatomic_cmpxchg(int_p, old, n);
 			} while (old != res);
 			break;
@@ -128,6 +146,8 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 		default:
 			return -EINVAL;
 		}
+		/* Compare the sum before its carry into the global counter. */
+		n = (int16_t) (n + move_sum);
 		if (v > 0 && (v >= UINT16_MAX || n < old))
 			overflow = true;
 		else if (v < 0 && (v <= -(int64_t) UINT16_MAX || n > old))
@@ -147,7 +167,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 			do {
 				move_sum = 0;
 				old = res;
-				n = (int32_t) ((uint32_t) old + (uint32_t) v);
+				saturated = false;
+				if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE)
+					n = (int32_t) lttng_counter_saturate_add(old, v, INT32_MIN, INT32_MAX, &saturated);
+				else
+					n = (int32_t) ((uint32_t) old + (uint32_t) v);
 				if (caa_unlikely(n > (int32_t) global_sum_step))
 					move_sum = (int32_t) global_sum_step / 2;
 				else if (caa_unlikely(n < -(int32_t) global_sum_step))
@@ -161,7 +185,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 		{
 			do {
 				old = res;
-				n = (int32_t) ((uint32_t) old + (uint32_t) v);
+				saturated = false;
+				if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE)
+					n = (int32_t) lttng_counter_saturate_add(old, v, INT32_MIN, INT32_MAX, &saturated);
+				else
+					n = (int32_t) ((uint32_t) old + (uint32_t) v);
 				res = uatomic_cmpxchg(int_p, old, n);
 			} while (old != res);
 			break;
@@ -169,6 +197,8 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 		default:
 			return -EINVAL;
 		}
+		/* Compare the sum before its carry into the global counter. */
+		n = (int32_t) (n + move_sum);
 		if (v > 0 && (v >= UINT32_MAX || n < old))
 			overflow = true;
 		else if (v < 0 && (v <= -(int64_t) UINT32_MAX || n > old))
@@ -189,7 +219,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 			do {
 				move_sum = 0;
 				old = res;
-				n = (int64_t) ((uint64_t) old + (uint64_t) v);
+				saturated = false;
+				if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE)
+					n = (int64_t) lttng_counter_saturate_add(old, v, INT64_MIN, INT64_MAX, &saturated);
+				else
+					n = (int64_t) ((uint64_t) old + (uint64_t) v);
 				if (caa_unlikely(n > (int64_t) global_sum_step))
 					move_sum = (int64_t) global_sum_step / 2;
 				else if (caa_unlikely(n < -(int64_t) global_sum_step))
@@ -203,7 +237,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 		{
 			do {
 				old = res;
-				n = (int64_t) ((uint64_t) old + (uint64_t) v);
+				saturated = false;
+				if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE)
+					n = (int64_t) lttng_counter_saturate_add(old, v, INT64_MIN, INT64_MAX, &saturated);
+				else
+					n = (int64_t) ((uint64_t) old + (uint64_t) v);
 				res = uatomic_cmpxchg(int_p, old, n);
 			} while (old != res);
 			break;
@@ -211,6 +249,8 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 		default:
 			return -EINVAL;
 		}
+		/* Compare the sum before its carry into the global counter. */
+		n = (int64_t) ((uint64_t) n + (uint64_t) move_sum);
 		if (v > 0 && n < old)
 			overflow = true;
 		else if (v < 0 && n > old)
@@ -221,6 +261,11 @@ static inline int __lttng_counter_add(const struct lib_counter_config *config,
 	default:
 		return -EINVAL;
 	}
+	if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE) {
+		/* Saturating counters only flag the additions which were clamped. */
+		overflow = saturated && v > 0;
+		underflow = saturated && v < 0;
+	}
 	if (caa_unlikely(overflow && !lttng_bitmap_test_bit(index, layout->overflow_bitmap)))
 		lttng_bitmap_set_bit(index, layout->overflow_bitmap);
 	else if (caa_unlikely(underflow && !lttng_bitmap_test_bit(index, layout->underflow_bitmap)))
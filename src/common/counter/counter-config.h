@@ -21,19 +21,26 @@ enum lib_counter_config_sync {
 	COUNTER_SYNC_GLOBAL,
 };
 
+enum lib_counter_config_size {
+	COUNTER_SIZE_8_BIT	= 1,
+	COUNTER_SIZE_16_BIT	= 2,
+	COUNTER_SIZE_32_BIT	= 4,
+	COUNTER_SIZE_64_BIT	= 8,
+};
+
 struct lib_counter_config {
 	uint32_t alloc;	/* enum lib_counter_config_alloc flags */
 	enum lib_counter_config_sync sync;
 	enum {
 		COUNTER_ARITHMETIC_MODULAR,
-		COUNTER_ARITHMETIC_SATURATE,	/* TODO */
+		COUNTER_ARITHMETIC_SATURATE,
 	} arithmetic;
-	enum {
-		COUNTER_SIZE_8_BIT	= 1,
-		COUNTER_SIZE_16_BIT	= 2,
-		COUNTER_SIZE_32_BIT	= 4,
-		COUNTER_SIZE_64_BIT	= 8,
-	} counter_size;
+	enum lib_counter_config_size counter_size;
+	/*
+	 * Size of the global counters, when they are wider than the
+	 * per-cpu counters carrying into them. 0 means counter_size.
+	 */
+	enum lib_counter_config_size global_counter_size;
 };
 
 #endif /* _LTTNG_COUNTER_CONFIG_H */
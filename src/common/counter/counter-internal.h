@@ -10,6 +10,7 @@
 #define _LTTNG_COUNTER_INTERNAL_H
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <errno.h>
 
 #include <lttng/ust-config.h>
@@ -48,4 +49,36 @@ static inline size_t lttng_counter_get_index(
 	return index;
 }
 
+/*
+ * Element size of the global or per-cpu layouts of a counter.
+ */
+static inline enum lib_counter_config_size lttng_counter_layout_size(
+		const struct lib_counter_config *config,
+		enum lib_counter_config_alloc alloc)
+{
+	if (alloc == COUNTER_ALLOC_GLOBAL && config->global_counter_size)
+		return config->global_counter_size;
+	return config->counter_size;
+}
+
+/*
+ * Saturating addition of v to old, clamped to [min, max]. Sets
+ * *saturated when the result had to be clamped. The bound checks are
+ * written so that none of the intermediate computations can overflow.
+ */
+static inline int64_t lttng_counter_saturate_add(int64_t old, int64_t v,
+						 int64_t min, int64_t max,
+						 bool *saturated)
+{
+	if (v > 0 && old > max - v) {
+		*saturated = true;
+		return max;
+	}
+	if (v < 0 && old < min - v) {
+		*saturated = true;
+		return min;
+	}
+	return old + v;
+}
+
 #endif /* _LTTNG_COUNTER_INTERNAL_H */
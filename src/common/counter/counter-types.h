@@ -69,6 +69,7 @@ struct lib_counter {
 	struct lib_counter_layout *percpu_counters;
 
 	bool is_daemon;
+	bool percpu_single_shm;		/* All per-cpu layouts in one shm */
 	struct lttng_counter_shm_object_table *object_table;
 };
 
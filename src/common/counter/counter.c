@@ -6,8 +6,11 @@
  */
 
 #include <errno.h>
+#include <limits.h>
+#include <string.h>
 #include "counter.h"
 #include "counter-internal.h"
+#include <urcu/arch.h>
 #include <urcu/system.h>
 #include <urcu/compiler.h>
 #include <stdbool.h>
@@ -48,55 +51,107 @@ static int lttng_counter_init_stride(
 	return 0;
 }
 
-static int lttng_counter_layout_init(struct lib_counter *counter, int cpu, int shm_fd)
+/*
+ * Compute the length of a global (cpu == -1) or per-cpu layout, and the
+ * offsets of its bitmaps.
+ *
+ * The consumer and the application may run different versions, and both
+ * compute the layout of the shared memory objects. 32-bit and 64-bit
+ * counters in shm objects of their own keep the layout every version
+ * maps: byte-sized bitmaps right after the counters. The other layouts
+ * (8-bit and 16-bit counters, all per-cpu layouts in a single shm, with
+ * @aligned set) are only set up through ABI values older versions
+ * reject. Their bitmaps are word aligned, as they are accessed one
+ * unsigned long at a time.
+ */
+static int lttng_counter_layout_offsets(struct lib_counter *counter, int cpu,
+					bool aligned,
+					size_t *overflow_offset,
+					size_t *underflow_offset,
+					size_t *len)
 {
-	struct lib_counter_layout *layout;
 	size_t counter_size;
 	size_t nr_elem = counter->allocated_elem;
-	size_t shm_length = 0, counters_offset, overflow_offset, underflow_offset;
-	struct lttng_counter_shm_object *shm_object;
+	size_t bitmap_len;
+	size_t shm_length = 0;
 
-	if (shm_fd < 0)
-		return 0;	/* Skip, will be populated later. */
-
-	if (cpu == -1)
-		layout = &counter->global_counters;
-	else
-		layout = &counter->percpu_counters[cpu];
-	switch (counter->config.counter_size) {
+	counter_size = (size_t) lttng_counter_layout_size(&counter->config,
+			cpu == -1 ? COUNTER_ALLOC_GLOBAL : COUNTER_ALLOC_PER_CPU);
+	switch (counter_size) {
 	case COUNTER_SIZE_8_BIT:
 	case COUNTER_SIZE_16_BIT:
 	case COUNTER_SIZE_32_BIT:
 	case COUNTER_SIZE_64_BIT:
-		counter_size = (size_t) counter->config.counter_size;
 		break;
 	default:
 		return -EINVAL;
 	}
-	layout->shm_fd = shm_fd;
-	counters_offset = shm_length;
+	if (counter->config.counter_size != COUNTER_SIZE_32_BIT
+			&& counter->config.counter_size != COUNTER_SIZE_64_BIT)
+		aligned = true;
 	shm_length += counter_size * nr_elem;
-	overflow_offset = shm_length;
-	shm_length += LTTNG_UST_ALIGN(nr_elem, 8) / 8;
-	underflow_offset = shm_length;
-	shm_length += LTTNG_UST_ALIGN(nr_elem, 8) / 8;
-	layout->shm_len = shm_length;
+	if (aligned) {
+		shm_length = LTTNG_UST_ALIGN(shm_length, sizeof(unsigned long));
+		bitmap_len = LTTNG_UST_ALIGN(nr_elem, CAA_BITS_PER_LONG) / CHAR_BIT;
+	} else {
+		bitmap_len = LTTNG_UST_ALIGN(nr_elem, 8) / 8;
+	}
+	*overflow_offset = shm_length;
+	shm_length += bitmap_len;
+	*underflow_offset = shm_length;
+	shm_length += bitmap_len;
+	*len = shm_length;
+	return 0;
+}
+
+static void lttng_counter_layout_map(struct lib_counter_layout *layout, char *base,
+				     size_t overflow_offset, size_t underflow_offset)
+{
+	layout->counters = base;
+	layout->overflow_bitmap = (unsigned long *)(base + overflow_offset);
+	layout->underflow_bitmap = (unsigned long *)(base + underflow_offset);
+}
+
+static struct lttng_counter_shm_object *lttng_counter_layout_shm(struct lib_counter *counter,
+								 int cpu, int shm_fd,
+								 size_t shm_length)
+{
 	if (counter->is_daemon) {
 		/* Allocate and clear shared memory. */
-		shm_object = lttng_counter_shm_object_table_alloc(counter->object_table,
+		return lttng_counter_shm_object_table_alloc(counter->object_table,
 			shm_length, LTTNG_COUNTER_SHM_OBJECT_SHM, shm_fd, cpu);
-		if (!shm_object)
-			return -ENOMEM;
 	} else {
 		/* Map pre-existing shared memory. */
-		shm_object = lttng_counter_shm_object_table_append_shm(counter->object_table,
+		return lttng_counter_shm_object_table_append_shm(counter->object_table,
 			shm_fd, shm_length);
-		if (!shm_object)
-			return -ENOMEM;
 	}
-	layout->counters = shm_object->memory_map + counters_offset;
-	layout->overflow_bitmap = (unsigned long *)(shm_object->memory_map + overflow_offset);
-	layout->underflow_bitmap = (unsigned long *)(shm_object->memory_map + underflow_offset);
+}
+
+static int lttng_counter_layout_init(struct lib_counter *counter, int cpu, int shm_fd)
+{
+	struct lib_counter_layout *layout;
+	size_t shm_length, overflow_offset, underflow_offset;
+	struct lttng_counter_shm_object *shm_object;
+	int ret;
+
+	if (shm_fd < 0)
+		return 0;	/* Skip, will be populated later. */
+
+	if (cpu == -1)
+		layout = &counter->global_counters;
+	else
+		layout = &counter->percpu_counters[cpu];
+	ret = lttng_counter_layout_offsets(counter, cpu, false, &overflow_offset,
+			&underflow_offset, &shm_length);
+	if (ret)
+		return ret;
+	layout->shm_fd = shm_fd;
+	layout->shm_len = shm_length;
+	shm_object = lttng_counter_layout_shm(counter, cpu, shm_fd, shm_length);
+	if (!shm_object)
+		return -ENOMEM;
+	lttng_counter_layout_map(layout, shm_object->memory_map,
+			overflow_offset, underflow_offset);
 	return 0;
 }
 
@@ -129,6 +184,74 @@ int lttng_counter_set_cpu_shm(struct lib_counter *counter, int cpu, int fd)
 	return lttng_counter_layout_init(counter, cpu, fd);
 }
 
+/*
+ * Map the layouts of all possible cpus in a single object, at a stride
+ * rounded to the cache line size. A negative @fd allocates the object
+ * in process-local memory.
+ */
+static
+int lttng_counter_cpu_all_init(struct lib_counter *counter, int fd)
+{
+	struct lib_counter_config *config = &counter->config;
+	size_t shm_length, overflow_offset, underflow_offset, stride;
+	struct lttng_counter_shm_object *shm_object;
+	int cpu, ret;
+
+	if (!(config->alloc & COUNTER_ALLOC_PER_CPU))
+		return -EINVAL;
+	if (counter->percpu_single_shm)
+		return -EBUSY;
+	for_each_possible_cpu(cpu) {
+		if (counter->percpu_counters[cpu].shm_fd >= 0)
+			return -EBUSY;
+	}
+	ret = lttng_counter_layout_offsets(counter, 0, true, &overflow_offset,
+			&underflow_offset, &shm_length);
+	if (ret)
+		return ret;
+	stride = LTTNG_UST_ALIGN(shm_length, CAA_CACHE_LINE_SIZE);
+	if (fd >= 0)
+		shm_object = lttng_counter_layout_shm(counter, -1, fd,
+				stride * num_possible_cpus());
+	else
+		shm_object = lttng_counter_shm_object_table_alloc(counter->object_table,
+				stride * num_possible_cpus(),
+				LTTNG_COUNTER_SHM_OBJECT_MEM, -1, -1);
+	if (!shm_object)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		struct lib_counter_layout *layout = &counter->percpu_counters[cpu];
+
+		layout->shm_fd = fd;
+		layout->shm_len = stride;
+		lttng_counter_layout_map(layout, shm_object->memory_map + cpu * stride,
+				overflow_offset, underflow_offset);
+	}
+	counter->percpu_single_shm = true;
+	return 0;
+}
+
+/*
+ * Use a single shared memory object holding the layouts of all possible
+ * cpus, at a stride rounded to the cache line size, instead of one
+ * object per cpu. Counter setup then needs a single file descriptor.
+ */
+int lttng_counter_set_cpu_all_shm(struct lib_counter *counter, int fd)
+{
+	if (fd < 0)
+		return -EINVAL;
+	return lttng_counter_cpu_all_init(counter, fd);
+}
+
+/*
+ * Allocate the per-cpu layouts in process-local memory, for counters
+ * which are not shared with other processes.
+ */
+int lttng_counter_alloc_cpu_all_mem(struct lib_counter *counter)
+{
+	return lttng_counter_cpu_all_init(counter, -1);
+}
+
 static
 int lttng_counter_set_global_sum_step(struct lib_counter *counter,
 				      int64_t global_sum_step)
@@ -173,7 +296,8 @@ int validate_args(const struct lib_counter_config *config,
 {
 	int nr_cpus = num_possible_cpus();
 
-	if (CAA_BITS_PER_LONG != 64 && config->counter_size == COUNTER_SIZE_64_BIT) {
+	if (CAA_BITS_PER_LONG != 64 && (config->counter_size == COUNTER_SIZE_64_BIT
+			|| config->global_counter_size == COUNTER_SIZE_64_BIT)) {
 		WARN_ON_ONCE(1);
 		return -1;
 	}
@@ -309,7 +433,7 @@ int lttng_counter_get_cpu_shm(struct lib_counter *counter, int cpu, int *fd, siz
 	struct lib_counter_layout *layout;
 	int shm_fd;
 
-	if (cpu >= num_possible_cpus())
+	if (cpu >= num_possible_cpus() || counter->percpu_single_shm)
 		return -1;
 	layout = &counter->percpu_counters[cpu];
 	shm_fd = layout->shm_fd;
@@ -320,6 +444,47 @@ int lttng_counter_get_cpu_shm(struct lib_counter *counter, int cpu, int *fd, siz
 	return 0;
 }
 
+int lttng_counter_get_cpu_all_shm(struct lib_counter *counter, int *fd, size_t *len)
+{
+	if (!counter->percpu_single_shm)
+		return -1;
+	*fd = counter->percpu_counters[0].shm_fd;
+	*len = counter->percpu_counters[0].shm_len * num_possible_cpus();
+	return 0;
+}
+
+int lttng_counter_get_layout(struct lib_counter *counter, int cpu,
+			     const void **counters,
+			     const unsigned long **overflow_bitmap,
+			     const unsigned long **underflow_bitmap,
+			     size_t *elem_size)
+{
+	const struct lib_counter_config *config = &counter->config;
+	const struct lib_counter_layout *layout;
+	enum lib_counter_config_alloc alloc;
+
+	if (cpu < 0) {
+		if (!(config->alloc & COUNTER_ALLOC_GLOBAL))
+			return -ENODEV;
+		alloc = COUNTER_ALLOC_GLOBAL;
+		layout = &counter->global_counters;
+	} else {
+		if (cpu >= num_possible_cpus())
+			return -EINVAL;
+		if (!(config->alloc & COUNTER_ALLOC_PER_CPU))
+			return -ENODEV;
+		alloc = COUNTER_ALLOC_PER_CPU;
+		layout = &counter->percpu_counters[cpu];
+	}
+	if (!layout->counters)
+		return -ENODEV;
+	*counters = layout->counters;
+	*overflow_bitmap = layout->overflow_bitmap;
+	*underflow_bitmap = layout->underflow_bitmap;
+	*elem_size = (size_t) lttng_counter_layout_size(config, alloc);
+	return 0;
+}
+
 int lttng_counter_read(const struct lib_counter_config *config,
 		       struct lib_counter *counter,
 		       const size_t *dimension_indexes,
@@ -359,7 +524,8 @@ int lttng_counter_read(const struct lib_counter_config *config,
 	if (caa_unlikely(!layout->counters))
 		return -ENODEV;
 
-	switch (config->counter_size) {
+	switch (lttng_counter_layout_size(config,
+			cpu < 0 ? COUNTER_ALLOC_GLOBAL : COUNTER_ALLOC_PER_CPU)) {
 	case COUNTER_SIZE_8_BIT:
 	{
 		int8_t *int_p = (int8_t *) layout->counters + index;
@@ -439,6 +605,17 @@ int lttng_counter_aggregate(const struct lib_counter_config *config,
 				return ret;
 			*overflow |= of;
 			*underflow |= uf;
+			if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE) {
+				bool saturated = false;
+
+				sum = lttng_counter_saturate_add(old, v, INT64_MIN, INT64_MAX,
+								 &saturated);
+				if (saturated && v > 0)
+					*overflow = true;
+				else if (saturated && v < 0)
+					*underflow = true;
+				continue;
+			}
 			/* Overflow is defined on unsigned types. */
 			sum = (int64_t) ((uint64_t) old + (uint64_t) v);
 			if (v > 0 && sum < old)
@@ -454,6 +631,159 @@ int lttng_counter_aggregate(const struct lib_counter_config *config,
 	return 0;
 }
 
+/*
+ * OR the first nr_elem bits of a layout bitmap into the caller bitmap.
+ * Bits past nr_elem of the last word are masked out.
+ */
+static
+void lttng_counter_bitmap_or(unsigned long *dst, const unsigned long *src,
+			     size_t nr_elem)
+{
+	size_t nr_words = nr_elem / CAA_BITS_PER_LONG, i;
+	size_t tail = nr_elem % CAA_BITS_PER_LONG;
+
+	for (i = 0; i < nr_words; i++)
+		dst[i] |= CMM_LOAD_SHARED(src[i]);
+	if (tail)
+		dst[nr_words] |= CMM_LOAD_SHARED(src[nr_words]) & ((1UL << tail) - 1);
+}
+
+static
+void lttng_counter_bitmap_set(unsigned long *bitmap, size_t index)
+{
+	bitmap[index / CAA_BITS_PER_LONG] |= 1UL << (index % CAA_BITS_PER_LONG);
+}
+
+/*
+ * Add every element of a layout to values. The element loops only read
+ * the counter array with plain loads, without calls, so the compiler can
+ * vectorize them. Sums of counters narrower than 64 bits cannot overflow
+ * an int64_t for any realistic number of CPUs.
+ */
+static
+int lttng_counter_aggregate_layout(const struct lib_counter_config *config,
+				   enum lib_counter_config_alloc alloc,
+				   const struct lib_counter_layout *layout,
+				   size_t nr_elem, int64_t *values,
+				   unsigned long *overflow, unsigned long *underflow)
+{
+	size_t i;
+
+	if (caa_unlikely(!layout->counters))
+		return -ENODEV;
+
+	switch (lttng_counter_layout_size(config, alloc)) {
+	case COUNTER_SIZE_8_BIT:
+	{
+		const int8_t *int_p = (const int8_t *) layout->counters;
+
+		for (i = 0; i < nr_elem; i++)
+			values[i] += int_p[i];
+		break;
+	}
+	case COUNTER_SIZE_16_BIT:
+	{
+		const int16_t *int_p = (const int16_t *) layout->counters;
+
+		for (i = 0; i < nr_elem; i++)
+			values[i] += int_p[i];
+		break;
+	}
+	case COUNTER_SIZE_32_BIT:
+	{
+		const int32_t *int_p = (const int32_t *) layout->counters;
+
+		for (i = 0; i < nr_elem; i++)
+			values[i] += int_p[i];
+		break;
+	}
+#if CAA_BITS_PER_LONG == 64
+	case COUNTER_SIZE_64_BIT:
+	{
+		const int64_t *int_p = (const int64_t *) layout->counters;
+
+		if (config->arithmetic == COUNTER_ARITHMETIC_SATURATE) {
+			for (i = 0; i < nr_elem; i++) {
+				bool saturated = false;
+				int64_t v = int_p[i];
+
+				values[i] = lttng_counter_saturate_add(values[i], v,
+						INT64_MIN, INT64_MAX, &saturated);
+				if (caa_unlikely(saturated))
+					lttng_counter_bitmap_set(v > 0 ? overflow : underflow, i);
+			}
+			break;
+		}
+		for (i = 0; i < nr_elem; i++) {
+			int64_t old = values[i], v = int_p[i], sum;
+
+			/* Overflow is defined on unsigned types. */
+			sum = (int64_t) ((uint64_t) old + (uint64_t) v);
+			values[i] = sum;
+			if (caa_unlikely(((old ^ sum) & (v ^ sum)) < 0))
+				lttng_counter_bitmap_set(v > 0 ? overflow : underflow, i);
+		}
+		break;
+	}
+#endif
+	default:
+		return -EINVAL;
+	}
+	lttng_counter_bitmap_or(overflow, layout->overflow_bitmap, nr_elem);
+	lttng_counter_bitmap_or(underflow, layout->underflow_bitmap, nr_elem);
+	return 0;
+}
+
+int lttng_counter_aggregate_all(const struct lib_counter_config *config,
+				struct lib_counter *counter,
+				int64_t *values, size_t nr_values,
+				unsigned long *overflow,
+				unsigned long *underflow)
+{
+	size_t nr_elem = counter->allocated_elem;
+	size_t bitmap_len = LTTNG_UST_ALIGN(nr_elem, CAA_BITS_PER_LONG) / CHAR_BIT;
+	int cpu, ret;
+
+	if (nr_values < nr_elem)
+		return -EINVAL;
+	memset(values, 0, nr_elem * sizeof(*values));
+	memset(overflow, 0, bitmap_len);
+	memset(underflow, 0, bitmap_len);
+
+	switch (config->alloc) {
+	case COUNTER_ALLOC_GLOBAL:	/* Fallthrough */
+	case COUNTER_ALLOC_PER_CPU | COUNTER_ALLOC_GLOBAL:
+		ret = lttng_counter_aggregate_layout(config, COUNTER_ALLOC_GLOBAL,
+				&counter->global_counters,
+				nr_elem, values, overflow, underflow);
+		if (ret < 0)
+			return ret;
+		break;
+	case COUNTER_ALLOC_PER_CPU:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	switch (config->alloc) {
+	case COUNTER_ALLOC_GLOBAL:
+		break;
+	case COUNTER_ALLOC_PER_CPU | COUNTER_ALLOC_GLOBAL:	/* Fallthrough */
+	case COUNTER_ALLOC_PER_CPU:
+		for_each_possible_cpu(cpu) {
+			ret = lttng_counter_aggregate_layout(config, COUNTER_ALLOC_PER_CPU,
+					&counter->percpu_counters[cpu],
+					nr_elem, values, overflow, underflow);
+			if (ret < 0)
+				return ret;
+		}
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
 static
 int lttng_counter_clear_cpu(const struct lib_counter_config *config,
 			    struct lib_counter *counter,
@@ -493,7 +823,8 @@ int lttng_counter_clear_cpu(const struct lib_counter_config *config,
 	if (caa_unlikely(!layout->counters))
 		return -ENODEV;
 
-	switch (config->counter_size) {
+	switch (lttng_counter_layout_size(config,
+			cpu < 0 ? COUNTER_ALLOC_GLOBAL : COUNTER_ALLOC_PER_CPU)) {
 	case COUNTER_SIZE_8_BIT:
 	{
 		int8_t *int_p = (int8_t *) layout->counters + index;
@@ -33,12 +33,32 @@ int lttng_counter_set_global_shm(struct lib_counter *counter, int fd)
 int lttng_counter_set_cpu_shm(struct lib_counter *counter, int cpu, int fd)
 	__attribute__((visibility("hidden")));
 
+int lttng_counter_set_cpu_all_shm(struct lib_counter *counter, int fd)
+	__attribute__((visibility("hidden")));
+
+int lttng_counter_alloc_cpu_all_mem(struct lib_counter *counter)
+	__attribute__((visibility("hidden")));
+
 int lttng_counter_get_global_shm(struct lib_counter *counter, int *fd, size_t *len)
 	__attribute__((visibility("hidden")));
 
 int lttng_counter_get_cpu_shm(struct lib_counter *counter, int cpu, int *fd, size_t *len)
 	__attribute__((visibility("hidden")));
 
+int lttng_counter_get_cpu_all_shm(struct lib_counter *counter, int *fd, size_t *len)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Element array and overflow/underflow bitmaps of the global (cpu -1)
+ * or per-cpu layout of a counter, with the size of its elements.
+ */
+int lttng_counter_get_layout(struct lib_counter *counter, int cpu,
+			     const void **counters,
+			     const unsigned long **overflow_bitmap,
+			     const unsigned long **underflow_bitmap,
+			     size_t *elem_size)
+	__attribute__((visibility("hidden")));
+
 int lttng_counter_read(const struct lib_counter_config *config,
 		       struct lib_counter *counter,
 		       const size_t *dimension_indexes,
@@ -53,6 +73,13 @@ int lttng_counter_aggregate(const struct lib_counter_config *config,
 			    bool *overflow, bool *underflow)
 	__attribute__((visibility("hidden")));
 
+int lttng_counter_aggregate_all(const struct lib_counter_config *config,
+				struct lib_counter *counter,
+				int64_t *values, size_t nr_values,
+				unsigned long *overflow,
+				unsigned long *underflow)
+	__attribute__((visibility("hidden")));
+
 int lttng_counter_clear(const struct lib_counter_config *config,
 			struct lib_counter *counter,
 			const size_t *dimension_indexes)
@@ -9,6 +9,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -19,53 +20,51 @@
 #include "common/logging.h"
 #include "common/macros.h"
 #include "common/ust-fd.h"
-#include "common/utils.h"
-
-#define BUF_LEN	4096
 
 #ifndef NT_GNU_BUILD_ID
 # define NT_GNU_BUILD_ID	3
 #endif
 
+/*
+ * Return a pointer to the `len` bytes at `offset` in the file mapping,
+ * or NULL if they are not within the file.
+ */
+static
+const void *lttng_ust_elf_ptr(struct lttng_ust_elf *elf, uint64_t offset,
+		uint64_t len)
+{
+	if (offset > elf->size || len > elf->size - offset) {
+		return NULL;
+	}
+	return elf->map + offset;
+}
+
 /*
  * Retrieve the nth (where n is the `index` argument) phdr (program
- * header) from the given elf instance.
+ * header) from the given elf instance into `phdr`.
  *
- * A pointer to the phdr is returned on success, NULL on failure.
+ * Returns 0 on success, -1 on failure.
  */
 static
-struct lttng_ust_elf_phdr *lttng_ust_elf_get_phdr(struct lttng_ust_elf *elf,
-						uint16_t index)
+int lttng_ust_elf_get_phdr(struct lttng_ust_elf *elf, uint16_t index,
+		struct lttng_ust_elf_phdr *phdr)
 {
-	struct lttng_ust_elf_phdr *phdr = NULL;
-	off_t offset;
-
-	if (!elf) {
-		goto error;
-	}
+	uint64_t offset;
+	const void *p;
 
 	if (index >= elf->ehdr->e_phnum) {
-		goto error;
-	}
-
-	phdr = zmalloc(sizeof(struct lttng_ust_elf_phdr));
-	if (!phdr) {
-		goto error;
-	}
-
-	offset = (off_t) elf->ehdr->e_phoff
-			+ (off_t) index * elf->ehdr->e_phentsize;
-	if (lseek(elf->fd, offset, SEEK_SET) < 0) {
-		goto error;
+		return -1;
 	}
 
+	offset = elf->ehdr->e_phoff + (uint64_t) index * elf->ehdr->e_phentsize;
 	if (is_elf_32_bit(elf)) {
 		Elf32_Phdr elf_phdr;
 
-		if (lttng_ust_read(elf->fd, &elf_phdr, sizeof(elf_phdr))
-				< sizeof(elf_phdr)) {
-			goto error;
+		p = lttng_ust_elf_ptr(elf, offset, sizeof(elf_phdr));
+		if (!p) {
+			return -1;
 		}
+		memcpy(&elf_phdr, p, sizeof(elf_phdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_phdr(elf_phdr);
 		}
@@ -73,62 +72,46 @@ struct lttng_ust_elf_phdr *lttng_ust_elf_get_phdr(struct lttng_ust_elf *elf,
 	} else {
 		Elf64_Phdr elf_phdr;
 
-		if (lttng_ust_read(elf->fd, &elf_phdr, sizeof(elf_phdr))
-				< sizeof(elf_phdr)) {
-			goto error;
+		p = lttng_ust_elf_ptr(elf, offset, sizeof(elf_phdr));
+		if (!p) {
+			return -1;
 		}
+		memcpy(&elf_phdr, p, sizeof(elf_phdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_phdr(elf_phdr);
 		}
 		copy_phdr(elf_phdr, *phdr);
 	}
 
-	return phdr;
-
-error:
-	free(phdr);
-	return NULL;
+	return 0;
 }
 
 /*
  * Retrieve the nth (where n is the `index` argument) shdr (section
- * header) from the given elf instance.
+ * header) from the given elf instance into `shdr`.
  *
- * A pointer to the shdr is returned on success, NULL on failure.
+ * Returns 0 on success, -1 on failure.
  */
 static
-struct lttng_ust_elf_shdr *lttng_ust_elf_get_shdr(struct lttng_ust_elf *elf,
-						uint16_t index)
+int lttng_ust_elf_get_shdr(struct lttng_ust_elf *elf, uint16_t index,
+		struct lttng_ust_elf_shdr *shdr)
 {
-	struct lttng_ust_elf_shdr *shdr = NULL;
-	off_t offset;
-
-	if (!elf) {
-		goto error;
-	}
+	uint64_t offset;
+	const void *p;
 
 	if (index >= elf->ehdr->e_shnum) {
-		goto error;
-	}
-
-	shdr = zmalloc(sizeof(struct lttng_ust_elf_shdr));
-	if (!shdr) {
-		goto error;
-	}
-
-	offset = (off_t) elf->ehdr->e_shoff
-			+ (off_t) index * elf->ehdr->e_shentsize;
-	if (lseek(elf->fd, offset, SEEK_SET) < 0) {
-		goto error;
+		return -1;
 	}
 
+	offset = elf->ehdr->e_shoff + (uint64_t) index * elf->ehdr->e_shentsize;
 	if (is_elf_32_bit(elf)) {
 		Elf32_Shdr elf_shdr;
 
-		if (lttng_ust_read(elf->fd, &elf_shdr, sizeof(elf_shdr))
-				< sizeof(elf_shdr)) {
-			goto error;
+		p = lttng_ust_elf_ptr(elf, offset, sizeof(elf_shdr));
+		if (!p) {
+			return -1;
 		}
+		memcpy(&elf_shdr, p, sizeof(elf_shdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_shdr(elf_shdr);
 		}
@@ -136,21 +119,18 @@ struct lttng_ust_elf_shdr *lttng_ust_elf_get_shdr(struct lttng_ust_elf *elf,
 	} else {
 		Elf64_Shdr elf_shdr;
 
-		if (lttng_ust_read(elf->fd, &elf_shdr, sizeof(elf_shdr))
-				< sizeof(elf_shdr)) {
-			goto error;
+		p = lttng_ust_elf_ptr(elf, offset, sizeof(elf_shdr));
+		if (!p) {
+			return -1;
 		}
+		memcpy(&elf_shdr, p, sizeof(elf_shdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_shdr(elf_shdr);
 		}
 		copy_shdr(elf_shdr, *shdr);
 	}
 
-	return shdr;
-
-error:
-	free(shdr);
-	return NULL;
+	return 0;
 }
 
 /*
@@ -158,82 +138,43 @@ error:
  * sh_name value) in bytes relative to the beginning of the section
  * names string table.
  *
- * If no name is found, NULL is returned.
+ * The name is returned in place within the file mapping. If no
+ * null-terminated name is found, NULL is returned.
  */
 static
-char *lttng_ust_elf_get_section_name(struct lttng_ust_elf *elf, off_t offset)
+const char *lttng_ust_elf_get_section_name(struct lttng_ust_elf *elf,
+		uint64_t offset)
 {
-	char *name = NULL;
-	size_t len = 0, to_read;	/* len does not include \0 */
-
-	if (!elf) {
-		goto error;
-	}
+	const char *names;
 
 	if (offset >= elf->section_names_size) {
-		goto error;
-	}
-
-	if (lseek(elf->fd, elf->section_names_offset + offset, SEEK_SET) < 0) {
-		goto error;
-	}
-
-	to_read = elf->section_names_size - offset;
-
-	/* Find first \0 after or at current location, remember len. */
-	for (;;) {
-		char buf[BUF_LEN];
-		ssize_t read_len;
-		size_t i;
-
-		if (!to_read) {
-			goto error;
-		}
-		read_len = lttng_ust_read(elf->fd, buf,
-			min_t(size_t, BUF_LEN, to_read));
-		if (read_len <= 0) {
-			goto error;
-		}
-		for (i = 0; i < read_len; i++) {
-			if (buf[i] == '\0') {
-				len += i;
-				goto end;
-			}
-		}
-		len += read_len;
-		to_read -= read_len;
-	}
-end:
-	name = zmalloc(sizeof(char) * (len + 1));	/* + 1 for \0 */
-	if (!name) {
-		goto error;
+		return NULL;
 	}
-	if (lseek(elf->fd, elf->section_names_offset + offset,
-		SEEK_SET) < 0) {
-		goto error;
+	names = lttng_ust_elf_ptr(elf, elf->section_names_offset,
+			elf->section_names_size);
+	if (!names) {
+		return NULL;
 	}
-	if (lttng_ust_read(elf->fd, name, len + 1) < len + 1) {
-		goto error;
+	if (!memchr(names + offset, '\0', elf->section_names_size - offset)) {
+		return NULL;
 	}
-
-	return name;
-
-error:
-	free(name);
-	return NULL;
+	return names + offset;
 }
 
 /*
  * Create an instance of lttng_ust_elf for the ELF file located at
- * `path`.
+ * `path`. The file is mapped once, and all the headers, notes and
+ * string tables are then accessed within the mapping.
  *
  * Return a pointer to the instance on success, NULL on failure.
  */
 struct lttng_ust_elf *lttng_ust_elf_create(const char *path)
 {
-	uint8_t e_ident[EI_NIDENT];
-	struct lttng_ust_elf_shdr *section_names_shdr;
+	const uint8_t *e_ident;
+	struct lttng_ust_elf_shdr section_names_shdr;
 	struct lttng_ust_elf *elf = NULL;
+	struct stat st;
+	void *map;
 	int ret, fd;
 
 	elf = zmalloc(sizeof(struct lttng_ust_elf));
@@ -241,43 +182,43 @@ struct lttng_ust_elf *lttng_ust_elf_create(const char *path)
 		goto error;
 	}
 
-	/* Initialize fd field to -1. 0 is a valid fd number */
-	elf->fd = -1;
-
 	elf->path = strdup(path);
 	if (!elf->path) {
 		goto error;
 	}
 
+	/*
+	 * The file descriptor is only needed to map the file, and is
+	 * closed before releasing the fd tracker lock.
+	 */
 	lttng_ust_lock_fd_tracker();
 	fd = open(elf->path, O_RDONLY | O_CLOEXEC);
 	if (fd < 0) {
 		lttng_ust_unlock_fd_tracker();
 		goto error;
 	}
-
-	ret = lttng_ust_add_fd_to_tracker(fd);
-	if (ret < 0) {
-		ret = close(fd);
-		if (ret) {
-			PERROR("close on elf->fd");
-		}
-		ret = -1;
-		lttng_ust_unlock_fd_tracker();
-		goto error;
+	map = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size > 0
+			&& (uint64_t) st.st_size <= SIZE_MAX) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	ret = close(fd);
+	if (ret) {
+		PERROR("close on elf fd");
 	}
-	elf->fd = ret;
 	lttng_ust_unlock_fd_tracker();
-
-	if (lttng_ust_read(elf->fd, e_ident, EI_NIDENT) < EI_NIDENT) {
+	if (map == MAP_FAILED) {
 		goto error;
 	}
-	elf->bitness = e_ident[EI_CLASS];
-	elf->endianness = e_ident[EI_DATA];
+	elf->map = map;
+	elf->size = st.st_size;
 
-	if (lseek(elf->fd, 0, SEEK_SET) < 0) {
+	e_ident = lttng_ust_elf_ptr(elf, 0, EI_NIDENT);
+	if (!e_ident) {
 		goto error;
 	}
+	elf->bitness = e_ident[EI_CLASS];
+	elf->endianness = e_ident[EI_DATA];
 
 	elf->ehdr = zmalloc(sizeof(struct lttng_ust_elf_ehdr));
 	if (!elf->ehdr) {
@@ -287,10 +228,10 @@ struct lttng_ust_elf *lttng_ust_elf_create(const char *path)
 	if (is_elf_32_bit(elf)) {
 		Elf32_Ehdr elf_ehdr;
 
-		if (lttng_ust_read(elf->fd, &elf_ehdr, sizeof(elf_ehdr))
-				< sizeof(elf_ehdr)) {
+		if (elf->size < sizeof(elf_ehdr)) {
 			goto error;
 		}
+		memcpy(&elf_ehdr, elf->map, sizeof(elf_ehdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_ehdr(elf_ehdr);
 		}
@@ -298,25 +239,24 @@ struct lttng_ust_elf *lttng_ust_elf_create(const char *path)
 	} else {
 		Elf64_Ehdr elf_ehdr;
 
-		if (lttng_ust_read(elf->fd, &elf_ehdr, sizeof(elf_ehdr))
-				< sizeof(elf_ehdr)) {
+		if (elf->size < sizeof(elf_ehdr)) {
 			goto error;
 		}
+		memcpy(&elf_ehdr, elf->map, sizeof(elf_ehdr));
 		if (!is_elf_native_endian(elf)) {
 			bswap_ehdr(elf_ehdr);
 		}
 		copy_ehdr(elf_ehdr, *(elf->ehdr));
 	}
 
-	section_names_shdr = lttng_ust_elf_get_shdr(elf, elf->ehdr->e_shstrndx);
-	if (!section_names_shdr) {
+	if (lttng_ust_elf_get_shdr(elf, elf->ehdr->e_shstrndx,
+			&section_names_shdr)) {
 		goto error;
 	}
 
-	elf->section_names_offset = section_names_shdr->sh_offset;
-	elf->section_names_size = section_names_shdr->sh_size;
+	elf->section_names_offset = section_names_shdr.sh_offset;
+	elf->section_names_size = section_names_shdr.sh_size;
 
-	free(section_names_shdr);
 	return elf;
 
 error:
@@ -341,22 +281,14 @@ uint8_t lttng_ust_elf_is_pic(struct lttng_ust_elf *elf)
  */
 void lttng_ust_elf_destroy(struct lttng_ust_elf *elf)
 {
-	int ret;
-
 	if (!elf) {
 		return;
 	}
 
-	if (elf->fd >= 0) {
-		lttng_ust_lock_fd_tracker();
-		ret = close(elf->fd);
-		if (!ret) {
-			lttng_ust_delete_fd_from_tracker(elf->fd);
-		} else {
-			PERROR("close");
-			abort();
+	if (elf->map) {
+		if (munmap((void *) elf->map, elf->size)) {
+			PERROR("munmap");
 		}
-		lttng_ust_unlock_fd_tracker();
 	}
 
 	free(elf->ehdr);
@@ -380,10 +312,9 @@ int lttng_ust_elf_get_memsz(struct lttng_ust_elf *elf, uint64_t *memsz)
 	}
 
 	for (i = 0; i < elf->ehdr->e_phnum; ++i) {
-		struct lttng_ust_elf_phdr *phdr;
+		struct lttng_ust_elf_phdr phdr;
 
-		phdr = lttng_ust_elf_get_phdr(elf, i);
-		if (!phdr) {
+		if (lttng_ust_elf_get_phdr(elf, i, &phdr)) {
 			goto error;
 		}
 
@@ -391,15 +322,13 @@ int lttng_ust_elf_get_memsz(struct lttng_ust_elf *elf, uint64_t *memsz)
 		 * Only PT_LOAD segments contribute to memsz. Skip
 		 * other segments.
 		 */
-		if (phdr->p_type != PT_LOAD) {
-			goto next_loop;
+		if (phdr.p_type != PT_LOAD) {
+			continue;
 		}
 
-		low_addr = min_t(uint64_t, low_addr, phdr->p_vaddr);
+		low_addr = min_t(uint64_t, low_addr, phdr.p_vaddr);
 		high_addr = max_t(uint64_t, high_addr,
-				phdr->p_vaddr + phdr->p_memsz);
-	next_loop:
-		free(phdr);
+				phdr.p_vaddr + phdr.p_memsz);
 	}
 
 	if (high_addr < low_addr) {
@@ -428,32 +357,25 @@ error:
 static
 int lttng_ust_elf_get_build_id_from_segment(
 	struct lttng_ust_elf *elf, uint8_t **build_id, size_t *length,
-	off_t offset, off_t segment_end)
+	uint64_t offset, uint64_t segment_end)
 {
 	uint8_t *_build_id = NULL;	/* Silence old gcc warning. */
 	size_t _length = 0;		/* Silence old gcc warning. */
 
 	while (offset < segment_end) {
 		struct lttng_ust_elf_nhdr nhdr;
-		size_t read_len;
+		const void *p;
 
 		/* Align start of note entry */
 		offset += lttng_ust_offset_align(offset, ELF_NOTE_ENTRY_ALIGN);
 		if (offset >= segment_end) {
 			break;
 		}
-		/*
-		 * We seek manually because if the note isn't the
-		 * build id the data following the header will not
-		 * have been read.
-		 */
-		if (lseek(elf->fd, offset, SEEK_SET) < 0) {
-			goto error;
-		}
-		if (lttng_ust_read(elf->fd, &nhdr, sizeof(nhdr))
-				< sizeof(nhdr)) {
+		p = lttng_ust_elf_ptr(elf, offset, sizeof(nhdr));
+		if (!p) {
 			goto error;
 		}
+		memcpy(&nhdr, p, sizeof(nhdr));
 
 		if (!is_elf_native_endian(elf)) {
 			nhdr.n_namesz = lttng_ust_bswap_32(nhdr.n_namesz);
@@ -475,18 +397,15 @@ int lttng_ust_elf_get_build_id_from_segment(
 		}
 
 		_length = nhdr.n_descsz;
-		_build_id = zmalloc(sizeof(uint8_t) * _length);
-		if (!_build_id) {
-			goto error;
-		}
-
-		if (lseek(elf->fd, offset, SEEK_SET) < 0) {
+		p = lttng_ust_elf_ptr(elf, offset, _length);
+		if (!p) {
 			goto error;
 		}
-		read_len = sizeof(*_build_id) * _length;
-		if (lttng_ust_read(elf->fd, _build_id, read_len) < read_len) {
+		_build_id = zmalloc(sizeof(uint8_t) * _length);
+		if (!_build_id) {
 			goto error;
 		}
+		memcpy(_build_id, p, _length);
 
 		break;
 	}
@@ -527,27 +446,20 @@ int lttng_ust_elf_get_build_id(struct lttng_ust_elf *elf, uint8_t **build_id,
 	}
 
 	for (i = 0; i < elf->ehdr->e_phnum; ++i) {
-		off_t offset, segment_end;
-		struct lttng_ust_elf_phdr *phdr;
-		int ret = 0;
+		struct lttng_ust_elf_phdr phdr;
 
-		phdr = lttng_ust_elf_get_phdr(elf, i);
-		if (!phdr) {
+		if (lttng_ust_elf_get_phdr(elf, i, &phdr)) {
 			goto error;
 		}
 
 		/* Build ID will be contained in a PT_NOTE segment. */
-		if (phdr->p_type != PT_NOTE) {
-			goto next_loop;
+		if (phdr.p_type != PT_NOTE) {
+			continue;
 		}
 
-		offset = phdr->p_offset;
-		segment_end = offset + phdr->p_filesz;
-		ret = lttng_ust_elf_get_build_id_from_segment(
-			elf, &_build_id, &_length, offset, segment_end);
-	next_loop:
-		free(phdr);
-		if (ret) {
+		if (lttng_ust_elf_get_build_id_from_segment(elf,
+				&_build_id, &_length, phdr.p_offset,
+				phdr.p_offset + phdr.p_filesz)) {
 			goto error;
 		}
 		if (_build_id) {
@@ -586,7 +498,8 @@ int lttng_ust_elf_get_debug_link_from_section(struct lttng_ust_elf *elf,
 {
 	char *_filename = NULL;		/* Silence old gcc warning. */
 	size_t filename_len;
-	char *section_name = NULL;
+	const char *section_name;
+	const uint8_t *section;
 	uint32_t _crc = 0;		/* Silence old gcc warning. */
 
 	if (!elf || !filename || !crc || !shdr) {
@@ -614,26 +527,25 @@ int lttng_ust_elf_get_debug_link_from_section(struct lttng_ust_elf *elf,
 	 * The length of the filename is the sh_size excluding the CRC
 	 * which comes after it in the section.
 	 */
-	_filename = zmalloc(sizeof(char) * (shdr->sh_size - ELF_CRC_SIZE));
-	if (!_filename) {
+	if (shdr->sh_size < ELF_CRC_SIZE) {
 		goto error;
 	}
-	if (lseek(elf->fd, shdr->sh_offset, SEEK_SET) < 0) {
+	section = lttng_ust_elf_ptr(elf, shdr->sh_offset, shdr->sh_size);
+	if (!section) {
 		goto error;
 	}
 	filename_len = sizeof(*_filename) * (shdr->sh_size - ELF_CRC_SIZE);
-	if (lttng_ust_read(elf->fd, _filename, filename_len) < filename_len) {
-		goto error;
-	}
-	if (lttng_ust_read(elf->fd, &_crc, sizeof(_crc)) < sizeof(_crc)) {
+	_filename = zmalloc(filename_len);
+	if (!_filename) {
 		goto error;
 	}
+	memcpy(_filename, section, filename_len);
+	memcpy(&_crc, section + filename_len, sizeof(_crc));
 	if (!is_elf_native_endian(elf)) {
 		_crc = lttng_ust_bswap_32(_crc);
 	}
 
 end:
-	free(section_name);
 	if (_filename) {
 		*filename = _filename;
 		*crc = _crc;
@@ -643,7 +555,6 @@ end:
 
 error:
 	free(_filename);
-	free(section_name);
 	return -1;
 }
 
@@ -670,16 +581,14 @@ int lttng_ust_elf_get_debug_link(struct lttng_ust_elf *elf, char **filename,
 	}
 
 	for (i = 0; i < elf->ehdr->e_shnum; ++i) {
-		struct lttng_ust_elf_shdr *shdr = NULL;
+		struct lttng_ust_elf_shdr shdr;
 
-		shdr = lttng_ust_elf_get_shdr(elf, i);
-		if (!shdr) {
+		if (lttng_ust_elf_get_shdr(elf, i, &shdr)) {
 			goto error;
 		}
 
 		ret = lttng_ust_elf_get_debug_link_from_section(
-			elf, &_filename, &_crc, shdr);
-		free(shdr);
+			elf, &_filename, &_crc, &shdr);
 
 		if (ret) {
 			goto error;
@@ -703,3 +612,131 @@ error:
 	free(_filename);
 	return -1;
 }
+
+/*
+ * Retrieve the first section of type `type` into `shdr`.
+ *
+ * Returns 1 if found, 0 if not, -1 if an error occurred.
+ */
+static
+int lttng_ust_elf_find_section(struct lttng_ust_elf *elf, uint32_t type,
+		struct lttng_ust_elf_shdr *shdr)
+{
+	uint16_t i;
+
+	for (i = 0; i < elf->ehdr->e_shnum; ++i) {
+		if (lttng_ust_elf_get_shdr(elf, i, shdr)) {
+			return -1;
+		}
+		if (shdr->sh_type == type) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Call `cb` for each defined function symbol of the ELF file, with its
+ * name, value and size. The symbol table is used, else the dynamic
+ * symbol table for stripped files. The iteration stops at the first
+ * non-zero value returned by `cb`.
+ *
+ * Returns 0 on success, the value returned by `cb` if not 0, -1 if an
+ * error occurred.
+ */
+int lttng_ust_elf_for_each_func_symbol(struct lttng_ust_elf *elf,
+		int (*cb)(const char *name, uint64_t value, uint64_t size,
+			void *priv),
+		void *priv)
+{
+	struct lttng_ust_elf_shdr symtab, strtab;
+	uint64_t i, entsize, nr_syms;
+	const char *strings;
+	int ret;
+
+	if (!elf || !cb) {
+		goto error;
+	}
+
+	ret = lttng_ust_elf_find_section(elf, SHT_SYMTAB, &symtab);
+	if (!ret) {
+		ret = lttng_ust_elf_find_section(elf, SHT_DYNSYM, &symtab);
+	}
+	if (ret < 0) {
+		goto error;
+	}
+	if (!ret) {
+		return 0;
+	}
+	if (symtab.sh_link >= UINT16_MAX
+			|| lttng_ust_elf_get_shdr(elf, symtab.sh_link, &strtab)) {
+		goto error;
+	}
+	strings = lttng_ust_elf_ptr(elf, strtab.sh_offset, strtab.sh_size);
+	if (!strings) {
+		goto error;
+	}
+
+	entsize = is_elf_32_bit(elf) ? sizeof(Elf32_Sym) : sizeof(Elf64_Sym);
+	nr_syms = symtab.sh_size / entsize;
+	for (i = 0; i < nr_syms; i++) {
+		uint64_t offset = symtab.sh_offset + i * entsize;
+		uint64_t value, size;
+		uint32_t name;
+		uint16_t shndx;
+		uint8_t type;
+		const void *p;
+
+		p = lttng_ust_elf_ptr(elf, offset, entsize);
+		if (!p) {
+			goto error;
+		}
+		if (is_elf_32_bit(elf)) {
+			Elf32_Sym sym;
+
+			memcpy(&sym, p, sizeof(sym));
+			if (!is_elf_native_endian(elf)) {
+				bswap(sym.st_name);
+				bswap(sym.st_value);
+				bswap(sym.st_size);
+				bswap(sym.st_shndx);
+			}
+			name = sym.st_name;
+			value = sym.st_value;
+			size = sym.st_size;
+			shndx = sym.st_shndx;
+			type = ELF32_ST_TYPE(sym.st_info);
+		} else {
+			Elf64_Sym sym;
+
+			memcpy(&sym, p, sizeof(sym));
+			if (!is_elf_native_endian(elf)) {
+				bswap(sym.st_name);
+				bswap(sym.st_value);
+				bswap(sym.st_size);
+				bswap(sym.st_shndx);
+			}
+			name = sym.st_name;
+			value = sym.st_value;
+			size = sym.st_size;
+			shndx = sym.st_shndx;
+			type = ELF64_ST_TYPE(sym.st_info);
+		}
+
+		if (type != STT_FUNC || shndx == SHN_UNDEF || !size) {
+			continue;
+		}
+		if (name >= strtab.sh_size
+				|| !memchr(strings + name, '\0', strtab.sh_size - name)) {
+			continue;
+		}
+		ret = cb(strings + name, value, size, priv);
+		if (ret) {
+			return ret;
+		}
+	}
+	return 0;
+
+error:
+	return -1;
+}
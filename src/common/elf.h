@@ -60,11 +60,13 @@ struct lttng_ust_elf_nhdr {
 
 struct lttng_ust_elf {
 	/* Offset in bytes to start of section names string table. */
-	off_t section_names_offset;
+	uint64_t section_names_offset;
 	/* Size in bytes of section names string table. */
-	size_t section_names_size;
+	uint64_t section_names_size;
 	char *path;
-	int fd;
+	/* Read-only mapping of the whole file. */
+	const uint8_t *map;
+	size_t size;
 	struct lttng_ust_elf_ehdr *ehdr;
 	uint8_t bitness;
 	uint8_t endianness;
@@ -229,4 +231,10 @@ int lttng_ust_elf_get_debug_link(struct lttng_ust_elf *elf, char **filename,
 			uint32_t *crc, int *found)
 	__attribute__((visibility("hidden")));
 
+int lttng_ust_elf_for_each_func_symbol(struct lttng_ust_elf *elf,
+		int (*cb)(const char *name, uint64_t value, uint64_t size,
+			void *priv),
+		void *priv)
+	__attribute__((visibility("hidden")));
+
 #endif	/* _UST_COMMON_ELF_H */
@@ -8,6 +8,8 @@
 #define _UST_COMMON_UST_EVENTS_H
 
 #include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <urcu/list.h>
@@ -36,6 +38,7 @@ union lttng_ust_abi_args {
 	struct {
 		int shm_fd;
 		int wakeup_fd;
+		int arena;	/* shm_fd is the channel arena */
 	} stream;
 	struct {
 		struct lttng_ust_abi_field_iter entry;
@@ -65,6 +68,22 @@ enum lttng_enabler_format_type {
 	LTTNG_ENABLER_FORMAT_EVENT,
 };
 
+#define LTTNG_UST_EXCLUSION_HT_BITS	7
+#define LTTNG_UST_EXCLUSION_HT_SIZE	(1U << LTTNG_UST_EXCLUSION_HT_BITS)
+
+/*
+ * Exclusion name of an excluder: hashed in the exclusion table of its
+ * enabler, or part of its wildcard exclusions list.
+ */
+struct lttng_ust_exclusion_entry {
+	union {
+		struct cds_hlist_node hlist;	/* Exclusion table bucket */
+		struct cds_list_head node;	/* Wildcard exclusions list */
+	} u;
+	const char *name;		/* Not null-terminated */
+	size_t len;
+};
+
 /*
  * Enabler field, within whatever object is enabling an event. Target of
  * backward reference.
@@ -76,9 +95,17 @@ struct lttng_enabler {
 	struct cds_list_head filter_bytecode_head;
 	/* head list of struct lttng_ust_excluder_node */
 	struct cds_list_head excluder_head;
+	/* Exclusion names of the excluders, without and with wildcards. */
+	struct cds_hlist_head exclusion_table[LTTNG_UST_EXCLUSION_HT_SIZE];
+	struct cds_list_head exclusion_glob_head;
 
 	struct lttng_ust_abi_event event_param;
 	unsigned int enabled:1;
+	/*
+	 * The events of the probes registered up to this probe
+	 * generation have been created for this enabler.
+	 */
+	uint64_t probe_generation;
 };
 
 struct lttng_event_enabler {
@@ -95,6 +122,9 @@ struct lttng_event_enabler {
 struct lttng_event_notifier_enabler {
 	struct lttng_enabler base;
 	uint64_t error_counter_index;
+	uint64_t histogram_counter_index;
+	int has_histogram;
+	int freeze_buffers;
 	struct cds_list_head node;	/* per-app list of event_notifier enablers */
 	struct cds_list_head capture_bytecode_head;
 	struct lttng_event_notifier_group *group; /* weak ref */
@@ -111,6 +141,8 @@ struct lttng_ust_bytecode_node {
 	enum lttng_ust_bytecode_type type;
 	struct cds_list_head node;
 	struct lttng_enabler *enabler;
+	int validated;		/* validate_ret holds the validation result */
+	int validate_ret;	/* Validation result of the unrelocated code */
 	struct  {
 		uint32_t len;
 		uint32_t reloc_offset;
@@ -142,6 +174,8 @@ struct lttng_ust_bytecode_filter_ctx {
 struct lttng_ust_excluder_node {
 	struct cds_list_head node;
 	struct lttng_enabler *enabler;
+	/* Entries of the exclusion names, allocated when attached. */
+	struct lttng_ust_exclusion_entry *entries;
 	/*
 	 * struct lttng_ust_event_exclusion had variable sized array,
 	 * must be last field.
@@ -211,6 +245,9 @@ struct lttng_counter_ops {
 	int (*counter_aggregate)(struct lib_counter *counter,
 			const size_t *dimension_indexes, int64_t *value,
 			bool *overflow, bool *underflow);
+	int (*counter_aggregate_all)(struct lib_counter *counter,
+			int64_t *values, size_t nr_values,
+			unsigned long *overflow, unsigned long *underflow);
 	int (*counter_clear)(struct lib_counter *counter, const size_t *dimension_indexes);
 };
 
@@ -254,6 +291,12 @@ struct lttng_event_notifier_group {
 
 	struct lttng_counter *error_counter;
 	size_t error_counter_len;
+
+	struct lttng_counter *histogram_counter;
+	size_t histogram_counter_len;
+
+	struct lttng_counter *hit_counter;
+	size_t hit_counter_len;
 };
 
 struct lttng_transport {
@@ -282,6 +325,8 @@ struct lttng_ust_event_common_private {
 	int has_enablers_without_filter_bytecode;
 	/* list of struct lttng_ust_bytecode_runtime, sorted by seqnum */
 	struct cds_list_head filter_bytecode_runtime_head;
+	int overhead_slot;			/* Probe overhead counter row, -1 if none */
+	int discard_slot;			/* Event discards counter row, -1 if none */
 };
 
 struct lttng_ust_event_recorder_private {
@@ -301,15 +346,29 @@ struct lttng_ust_event_notifier_private {
 	struct lttng_event_notifier_group *group; /* weak ref */
 	size_t num_captures;			/* Needed to allocate the msgpack array. */
 	uint64_t error_counter_index;
+	uint64_t histogram_counter_index;
+	int has_histogram;			/* Captures feed the histogram counter */
+	int freeze_buffers;			/* Firing freezes the overwrite streams */
 	struct cds_list_head node;		/* Event notifier list */
 	struct cds_hlist_node hlist;		/* Hash table of event notifiers */
 	struct cds_list_head capture_bytecode_runtime_head;
+	unsigned long rate_window;		/* Current rate limit window, in seconds */
+	unsigned long rate_count;		/* Notifications in the current window */
+	unsigned long rate_dropped;		/* Dropped by the rate limit, not reported yet */
 };
 
 struct lttng_ust_bytecode_runtime {
 	enum lttng_ust_bytecode_type type;
 	struct lttng_ust_bytecode_node *bc;
 	int link_failed;
+	int reads_payload;			/* Reads event payload fields */
+	int reads_volatile_context;		/* Reads contexts which may change within a thread */
+	int fused;				/* Same bytecode as an enabled filter before it */
+	int profile;				/* Count evaluations (LTTNG_UST_FILTER_PROFILE) */
+	unsigned long nr_eval;			/* Evaluations, profile only */
+	unsigned long nr_accept;		/* Accepted evaluations, profile only */
+	unsigned long nr_cache_hit;		/* Evaluations served by the thread cache */
+	unsigned long sampled_time;		/* ns, one evaluation out of LTTNG_UST_ABI_FILTER_STATS_SAMPLE_PERIOD */
 	int (*interpreter_func)(struct lttng_ust_bytecode_runtime *bytecode_runtime,
 			const char *interpreter_stack_data,
 			struct lttng_ust_probe_ctx *probe_ctx,
@@ -338,6 +397,8 @@ struct lttng_ust_session_private {
 	int tstate:1;				/* Transient enable state */
 
 	int statedump_pending:1;
+	int statedump_active:1;			/* Statedump in progress. */
+	uint64_t statedump_dl_generation;	/* Last dl table update dumped. */
 
 	struct lttng_ust_enum_ht enums_ht;	/* ht of enumerations */
 	struct cds_list_head enums_head;
@@ -345,6 +406,7 @@ struct lttng_ust_session_private {
 
 	unsigned char uuid[LTTNG_UST_UUID_LEN];	/* Trace session unique ID */
 	bool uuid_set;				/* Is uuid set ? */
+	bool sync_pending;			/* Enabler sync deferred by a batch */
 };
 
 struct lttng_enum {
@@ -353,6 +415,7 @@ struct lttng_enum {
 	struct cds_list_head node;		/* Enum list in session */
 	struct cds_hlist_node hlist;		/* Session ht of enums */
 	uint64_t id;				/* Enumeration ID in sessiond */
+	bool pending;				/* Registration reply not received yet */
 };
 
 struct lttng_ust_shm_handle;
@@ -368,6 +431,7 @@ struct lttng_ust_channel_buffer_ops_private {
 			unsigned char *uuid,
 			uint32_t chan_id,
 			const int *stream_fds, int nr_stream_fds,
+			unsigned int nr_streams,
 			int64_t blocking_timeout);
 	void (*channel_destroy)(struct lttng_ust_channel_buffer *chan);
 	/*
@@ -388,17 +452,55 @@ struct lttng_ust_channel_common_private {
 	int tstate:1;				/* Transient enable state */
 };
 
+/*
+ * Slot of the interned string cache of a stream: @key combines the id of
+ * a string and the packet holding it in full, @check is the second hash
+ * of the string.
+ */
+struct lttng_ust_intern_slot {
+	unsigned long key;
+	uint64_t check;
+};
+
+/*
+ * Staging slots of the records larger than a sub-buffer, one per possible
+ * CPU, each claimed by a single writer from the reservation to the commit
+ * of a record. Allocated when the fragment event of the channel is first
+ * enabled, so that the probes never allocate memory.
+ */
+#define LTTNG_UST_STAGING_SLOT_SIZE	(1024 * 1024)
+
+struct lttng_ust_staging_area {
+	size_t slot_size;
+	unsigned int nr_slots;
+	unsigned long *busy;			/* Claim flag of each slot */
+	char *slots;				/* nr_slots * slot_size bytes */
+};
+
 struct lttng_ust_channel_buffer_private {
 	struct lttng_ust_channel_common_private parent;
 
 	struct lttng_ust_channel_buffer *pub;	/* Public channel buffer interface */
 	struct cds_list_head node;		/* Channel list in session */
-	int header_type;			/* 0: unset, 1: compact, 2: large */
+	int header_type;			/* 0: unset, 1: compact, 2: large, 3: single event */
 	unsigned int id;			/* Channel ID */
 	enum lttng_ust_abi_chan_type type;
 	struct lttng_ust_ctx *ctx;
 	struct lttng_ust_ring_buffer_channel *rb_chan;	/* Ring buffer channel */
 	unsigned char uuid[LTTNG_UST_UUID_LEN];	/* Trace session unique ID */
+	/*
+	 * Enabled lttng_ust_fragment:record event of the channel, NULL
+	 * when the records larger than a sub-buffer are discarded.
+	 */
+	struct lttng_ust_event_recorder *fragment_recorder;
+	unsigned long fragment_id;		/* Last fragmented record ID */
+	struct lttng_ust_staging_area *staging;	/* Set before fragment_recorder */
+	/*
+	 * Interned string cache of each stream, allocated on first use.
+	 * NULL array when the channel does not support interning.
+	 */
+	struct lttng_ust_intern_slot **intern_caches;
+	unsigned int nr_intern_caches;
 };
 
 /*
@@ -430,12 +532,28 @@ struct lttng_ust_abi_channel_config {
 	int unused11:1;
 };
 
+/* Largest context recorded from a copy laid out once. */
+#define LTTNG_UST_CTX_FROZEN_MAX_SIZE	256
+
 /* Global (filter), event and channel contexts. */
 struct lttng_ust_ctx {
 	struct lttng_ust_ctx_field *fields;
 	unsigned int nr_fields;
 	unsigned int allocated_fields;
 	unsigned int largest_align;
+	int fixed_size_valid;		/* All fields have a fixed size. */
+	size_t fixed_size;		/* Size of the fields if fixed_size_valid. */
+	int frozen;			/* Fields recorded at their frozen_offset. */
+};
+
+/*
+ * Fields of an event serialized for the session daemon. They are kept
+ * across registrations when they do not depend on the session.
+ */
+struct lttng_ust_event_fields_cache {
+	struct lttng_ust_ctl_field *fields;
+	size_t nr_fields;
+	int state;	/* 0: not serialized yet, 1: cached, -1: session dependent. */
 };
 
 struct lttng_ust_registered_probe {
@@ -444,6 +562,9 @@ struct lttng_ust_registered_probe {
 	struct cds_list_head head;		/* chain registered probes */
 	struct cds_list_head lazy_init_head;
 	int lazy;				/* lazy registration */
+	uint64_t generation;			/* registration order */
+	/* Serialized fields per event, allocated on first registration. */
+	struct lttng_ust_event_fields_cache *fields_cache;
 };
 
 /*
@@ -461,6 +582,15 @@ struct lttng_ust_ctx_field {
 			struct lttng_ust_ctx_value *value);
 	void (*destroy)(void *priv);
 	void *priv;
+	uint32_t name_hash;	/* Hash of the field name, set when added to a context */
+	/*
+	 * The record callback writes the get_value value at its natural
+	 * alignment, and nothing else, so that a context can be frozen.
+	 * The string of a text array holds the whole array.
+	 */
+	int freezable;
+	size_t frozen_offset;	/* Offset of the field within a frozen context */
+	size_t frozen_size;	/* Size of the field within a frozen context */
 };
 
 static inline
@@ -565,6 +695,18 @@ const struct lttng_ust_type_struct *lttng_ust_get_type_struct(const struct lttng
 		.priv = (_priv),									\
 	})
 
+/* Context field whose record callback only writes its get_value value. */
+#define lttng_ust_static_freezable_ctx_field(_event_field, _get_size, _record, _get_value, _destroy, _priv)	\
+	LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_ctx_field, {				\
+		.event_field = (_event_field),								\
+		.get_size = (_get_size),								\
+		.record = (_record),									\
+		.get_value = (_get_value),								\
+		.destroy = (_destroy),									\
+		.priv = (_priv),									\
+		.freezable = 1,										\
+	})
+
 static inline
 struct lttng_enabler *lttng_event_enabler_as_enabler(
 		struct lttng_event_enabler *event_enabler)
@@ -579,11 +721,112 @@ struct lttng_enabler *lttng_event_notifier_enabler_as_enabler(
 	return &event_notifier_enabler->base;
 }
 
+/*
+ * Entry of the context values memo of a tracepoint hit. Values are keyed
+ * by the get_value callback and private data of the context field, which
+ * are shared by the instances of a context in the filter context of the
+ * session and in the channel context.
+ */
+struct lttng_ust_ctx_memo_entry {
+	void (*get_value)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
+			struct lttng_ust_ctx_value *value);
+	void *priv;
+	struct lttng_ust_ctx_value value;
+};
+
+#define LTTNG_UST_CTX_MEMO_NR_ENTRIES	\
+	(LTTNG_UST_PROBE_CTX_MEMO_DATA_LEN / sizeof(struct lttng_ust_ctx_memo_entry))
 
+static inline
+struct lttng_ust_ctx_memo_entry *lttng_ust_ctx_memo_entries(struct lttng_ust_probe_ctx *probe_ctx,
+		uint32_t *nr_entries)
+{
+	struct lttng_ust_probe_ctx_memo *memo;
+
+	/* Probes built against older headers have no memo. */
+	if (!probe_ctx || probe_ctx->struct_size < offsetof(struct lttng_ust_probe_ctx, memo)
+			+ sizeof(probe_ctx->memo))
+		return NULL;
+	memo = probe_ctx->memo;
+	if (!memo)
+		return NULL;
+	*nr_entries = memo->nr_entries;
+	return (struct lttng_ust_ctx_memo_entry *) memo->data;
+}
+
+/*
+ * Look up the value of a context field already computed during the
+ * current tracepoint hit. Returns false if it was not computed yet.
+ */
+static inline
+bool lttng_ust_ctx_memo_lookup(const struct lttng_ust_ctx_field *ctx_field,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_ctx_value *value)
+{
+	struct lttng_ust_ctx_memo_entry *entries;
+	uint32_t i, nr_entries;
+
+	entries = lttng_ust_ctx_memo_entries(probe_ctx, &nr_entries);
+	if (!entries)
+		return false;
+	for (i = 0; i < nr_entries; i++) {
+		if (entries[i].get_value == ctx_field->get_value
+				&& entries[i].priv == ctx_field->priv) {
+			*value = entries[i].value;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Get the value of a context field, computing it at most once per
+ * tracepoint hit as long as the memo has room left.
+ */
+static inline
+void lttng_ust_ctx_get_value(const struct lttng_ust_ctx_field *ctx_field,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_ctx_value *value)
+{
+	struct lttng_ust_ctx_memo_entry *entries;
+	uint32_t nr_entries;
+
+	if (lttng_ust_ctx_memo_lookup(ctx_field, probe_ctx, value))
+		return;
+	ctx_field->get_value(ctx_field->priv, probe_ctx, value);
+	entries = lttng_ust_ctx_memo_entries(probe_ctx, &nr_entries);
+	if (!entries || nr_entries >= LTTNG_UST_CTX_MEMO_NR_ENTRIES)
+		return;
+	entries[nr_entries].get_value = ctx_field->get_value;
+	entries[nr_entries].priv = ctx_field->priv;
+	entries[nr_entries].value = *value;
+	probe_ctx->memo->nr_entries = nr_entries + 1;
+}
+
+/*
+ * ELF information of a loaded object. @build_id and @dbg_file are
+ * allocated, and owned by the caller.
+ */
+struct lttng_ust_dl_bin_info {
+	char resolved_path[PATH_MAX];
+	uint64_t memsz;
+	uint8_t *build_id;
+	size_t build_id_len;
+	char *dbg_file;
+	uint32_t crc;
+	int has_build_id;
+	int has_debug_link;
+};
 
 /* This is ABI between liblttng-ust and liblttng-ust-dl */
 void lttng_ust_dl_update(void *ip);
 
+/*
+ * Return 0 on success, -ENOENT if no object loaded at @base_addr is
+ * known, -ENOMEM on allocation failure.
+ */
+int lttng_ust_dl_get_bin_info(void *base_addr, struct lttng_ust_dl_bin_info *info);
+
 struct lttng_enum *lttng_ust_enum_get_from_desc(struct lttng_ust_session *session,
 		const struct lttng_ust_enum_desc *enum_desc)
 	__attribute__((visibility("hidden")));
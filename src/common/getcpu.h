@@ -51,7 +51,7 @@ int lttng_ust_get_cpu_internal(void)
  * If getcpu is not implemented in the kernel, use cpu 0 as fallback.
  */
 static inline
-int lttng_ust_get_cpu_internal(void)
+int lttng_ust_sched_get_cpu_internal(void)
 {
 	int cpu, ret;
 
@@ -67,7 +67,7 @@ int lttng_ust_get_cpu_internal(void)
  * If getcpu is not implemented in the kernel, use cpu 0 as fallback.
  */
 static inline
-int lttng_ust_get_cpu_internal(void)
+int lttng_ust_sched_get_cpu_internal(void)
 {
 	int cpu;
 
@@ -85,7 +85,7 @@ int lttng_ust_get_cpu_internal(void)
  * number 0, with the associated performance degradation on SMP.
  */
 static inline
-int lttng_ust_get_cpu_internal(void)
+int lttng_ust_sched_get_cpu_internal(void)
 {
 	return 0;
 }
@@ -94,6 +94,49 @@ int lttng_ust_get_cpu_internal(void)
 #error "Please add support for your OS into liblttng-ust/compat.h."
 #endif
 
+#ifdef HAVE_GLIBC_RSEQ
+#include <sys/rseq.h>
+
+/*
+ * Read the current cpu number from the rseq area registered by glibc for
+ * the current thread. This is a plain TLS load. Returns a negative value
+ * if rseq is not registered, either because the kernel lacks rseq support
+ * or because glibc registration was disabled (glibc.pthread.rseq=0).
+ * __rseq_size is set once by glibc at program startup, so this choice is
+ * effectively made once.
+ */
+static inline
+int lttng_ust_rseq_get_cpu_internal(void)
+{
+	const struct rseq *rs;
+
+	if (caa_unlikely(!__rseq_size))
+		return -1;
+	rs = (const struct rseq *) ((char *) __builtin_thread_pointer() + __rseq_offset);
+	return (int32_t) CMM_LOAD_SHARED(rs->cpu_id);
+}
+#else
+static inline
+int lttng_ust_rseq_get_cpu_internal(void)
+{
+	return -1;
+}
+#endif
+
+/*
+ * Use the rseq cpu number when available, which avoids a vDSO call or a
+ * system call. Fallback to sched_getcpu() otherwise.
+ */
+static inline
+int lttng_ust_get_cpu_internal(void)
+{
+	int cpu = lttng_ust_rseq_get_cpu_internal();
+
+	if (caa_likely(cpu >= 0))
+		return cpu;
+	return lttng_ust_sched_get_cpu_internal();
+}
+
 #endif
 
 static inline
@@ -42,11 +42,38 @@ static struct lttng_env lttng_env[] = {
 	/* Env. var. which can be used in setuid/setgid executables. */
 	{ "LTTNG_UST_WITHOUT_BADDR_STATEDUMP", LTTNG_ENV_NOT_SECURE, NULL, },
 	{ "LTTNG_UST_REGISTER_TIMEOUT", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_WITHOUT_STATEDUMP_WAIT", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_CLOCK_TAI", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_CLOCK_TSC", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_CYG_PROFILE_DURATION_THRESHOLD", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_CYG_PROFILE_EXCLUDE", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_CYG_PROFILE_INCLUDE", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_MALLOC_AGGREGATE_PERIOD", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_MALLOC_SAMPLE_BYTES", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_PTHREAD_AGGREGATE_PERIOD", LTTNG_ENV_NOT_SECURE, NULL, },
+	{ "LTTNG_UST_PTHREAD_CONTENDED_THRESHOLD", LTTNG_ENV_NOT_SECURE, NULL, },
 
 	/* Env. var. which are not fetched in setuid/setgid executables. */
 	{ "LTTNG_UST_CLOCK_PLUGIN", LTTNG_ENV_SECURE, NULL, },
 	{ "LTTNG_UST_GETCPU_PLUGIN", LTTNG_ENV_SECURE, NULL, },
 	{ "LTTNG_UST_ALLOW_BLOCKING", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_ELF_CACHE", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_EMBEDDED_EVENTS", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_EMBEDDED_OUTPUT", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_NOTIFY_RELAY", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_EVENT_NOTIFIER_RATE_LIMIT", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_FORK_INHERIT", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_FILTER_PROFILE", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_METRICS", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_PROBE_OVERHEAD", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_RB_LAZY_ALLOC", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_RB_NUMA_POLICY", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_RB_RECLAIM_IDLE_MS", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_RB_SAMPLING_THRESHOLD", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_RB_SPILL_STREAMS", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_RB_SWITCH_TIMER_BACKOFF", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_RB_WAKEUP_EVENTFD", LTTNG_ENV_SECURE, NULL, },
+	{ "LTTNG_UST_STATEDUMP_INCREMENTAL", LTTNG_ENV_SECURE, NULL, },
 	{ "HOME", LTTNG_ENV_SECURE, NULL, },
 	{ "LTTNG_HOME", LTTNG_ENV_SECURE, NULL, },
 };
@@ -0,0 +1,44 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#define _LGPL_SOURCE
+#include <stdio.h>
+
+#include "common/metrics.h"
+
+const struct lib_counter_config lttng_ust_metrics_config = {
+	.alloc = COUNTER_ALLOC_PER_CPU,
+	.sync = COUNTER_SYNC_PER_CPU,
+	.arithmetic = COUNTER_ARITHMETIC_MODULAR,
+#if (CAA_BITS_PER_LONG == 64)
+	.counter_size = COUNTER_SIZE_64_BIT,
+#else
+	.counter_size = COUNTER_SIZE_32_BIT,
+#endif
+};
+
+struct lib_counter *lttng_ust_metrics_counter;
+
+struct lib_counter *lttng_ust_event_discards_counter;
+
+const char * const lttng_ust_metric_names[NR_LTTNG_UST_METRICS] = {
+	[LTTNG_UST_METRIC_EVENT_RESERVE] = "event_reserve",
+	[LTTNG_UST_METRIC_EVENT_DISCARD] = "event_discard",
+	[LTTNG_UST_METRIC_RESERVE_SLOW] = "reserve_slow",
+	[LTTNG_UST_METRIC_FILTER_EVAL] = "filter_eval",
+	[LTTNG_UST_METRIC_FILTER_ACCEPT] = "filter_accept",
+	[LTTNG_UST_METRIC_PROBE_REGISTER] = "probe_register",
+	[LTTNG_UST_METRIC_STATEDUMP] = "statedump",
+	[LTTNG_UST_METRIC_STATEDUMP_NS] = "statedump_ns",
+	[LTTNG_UST_METRIC_COMMAND] = "command",
+	[LTTNG_UST_METRIC_COMMAND_NS] = "command_ns",
+};
+
+void lttng_ust_metrics_shm_name(pid_t pid, const char *kind, char *name)
+{
+	snprintf(name, LTTNG_UST_METRICS_SHM_NAME_LEN, "/lttng-ust-%s-%d",
+		kind, (int) pid);
+}
@@ -0,0 +1,124 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Tracer self-metrics and probe overhead accounting, kept in per-cpu
+ * counters shared with lttng-ust-ctl readers.
+ */
+
+#ifndef _UST_COMMON_METRICS_H
+#define _UST_COMMON_METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+
+#include <lttng/ust-abi.h>
+
+#include "common/counter/counter-api.h"
+
+/* Must match enum lttng_ust_ctl_metric of ust-ctl.h. */
+enum lttng_ust_metric {
+	LTTNG_UST_METRIC_EVENT_RESERVE = 0,	/* Records reserved */
+	LTTNG_UST_METRIC_EVENT_DISCARD = 1,	/* Records not reserved */
+	LTTNG_UST_METRIC_RESERVE_SLOW = 2,	/* Reservations through the slow path */
+	LTTNG_UST_METRIC_FILTER_EVAL = 3,	/* Events whose filters were evaluated */
+	LTTNG_UST_METRIC_FILTER_ACCEPT = 4,	/* Events accepted by their filters */
+	LTTNG_UST_METRIC_PROBE_REGISTER = 5,	/* Probe provider registrations */
+	LTTNG_UST_METRIC_STATEDUMP = 6,		/* State dumps */
+	LTTNG_UST_METRIC_STATEDUMP_NS = 7,	/* Time spent in state dumps */
+	LTTNG_UST_METRIC_COMMAND = 8,		/* Session daemon commands handled */
+	LTTNG_UST_METRIC_COMMAND_NS = 9,	/* Time spent handling commands */
+
+	NR_LTTNG_UST_METRICS,
+};
+
+#define LTTNG_UST_METRICS_SHM_NAME_LEN	64
+
+/* Second dimension of the probe overhead counter. */
+enum lttng_ust_probe_overhead_value {
+	LTTNG_UST_PROBE_OVERHEAD_HITS = 0,
+	LTTNG_UST_PROBE_OVERHEAD_CYCLES = 1,
+
+	NR_LTTNG_UST_PROBE_OVERHEAD_VALUES,
+};
+
+/*
+ * Names of the events accounted by a per-event counter, indexed by the
+ * first dimension of the counter, in their own shm object.
+ */
+struct lttng_ust_metrics_event_names {
+	uint32_t nr_slots;
+	uint32_t nr_used;		/* Updated after the name of the slot */
+	char name[][LTTNG_UST_ABI_SYM_NAME_LEN];
+};
+
+extern const struct lib_counter_config lttng_ust_metrics_config
+	__attribute__((visibility("hidden")));
+
+/* NULL unless the LTTNG_UST_METRICS environment variable is set. */
+extern struct lib_counter *lttng_ust_metrics_counter
+	__attribute__((visibility("hidden")));
+
+/*
+ * Records not reserved per event, in a counter of one row per event.
+ * NULL unless the LTTNG_UST_METRICS environment variable is set.
+ */
+extern struct lib_counter *lttng_ust_event_discards_counter
+	__attribute__((visibility("hidden")));
+
+extern const char * const lttng_ust_metric_names[NR_LTTNG_UST_METRICS]
+	__attribute__((visibility("hidden")));
+
+/*
+ * POSIX shared memory object name of the @kind ("metrics",
+ * "event-discards", "probe-overhead", or either of the latter two
+ * followed by "-names") of process pid.
+ */
+void lttng_ust_metrics_shm_name(pid_t pid, const char *kind, char *name)
+	__attribute__((visibility("hidden")));
+
+static inline
+int lttng_ust_metrics_enabled(void)
+{
+	return caa_unlikely(CMM_LOAD_SHARED(lttng_ust_metrics_counter) != NULL);
+}
+
+static inline
+void lttng_ust_metrics_add(enum lttng_ust_metric metric, int64_t v)
+{
+	struct lib_counter *counter = CMM_LOAD_SHARED(lttng_ust_metrics_counter);
+	size_t index = metric;
+
+	if (caa_likely(!counter))
+		return;
+	(void) lttng_counter_add(&lttng_ust_metrics_config, counter, &index, v);
+}
+
+static inline
+void lttng_ust_metrics_inc(enum lttng_ust_metric metric)
+{
+	lttng_ust_metrics_add(metric, 1);
+}
+
+/*
+ * Account @v records of the event of discard counter row @slot which
+ * could not be reserved.
+ */
+static inline
+void lttng_ust_event_discards_add(int slot, int64_t v)
+{
+	struct lib_counter *counter = CMM_LOAD_SHARED(lttng_ust_event_discards_counter);
+	size_t index[2] = { 0, 0 };
+
+	if (caa_likely(!counter) || slot < 0)
+		return;
+	index[0] = slot;
+	(void) lttng_counter_add(&lttng_ust_metrics_config, counter, index, v);
+}
+
+#endif /* _UST_COMMON_METRICS_H */
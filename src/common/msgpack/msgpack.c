@@ -29,6 +29,11 @@
 
 #define MSGPACK_FLOAT64_ID	0xCB
 #define MSGPACK_STR16_ID	0xDA
+#define MSGPACK_STR8_ID		0xD9
+#define MSGPACK_STR32_ID	0xDB
+#define MSGPACK_ARRAY32_ID	0xDD
+#define MSGPACK_MAP32_ID	0xDF
+#define MSGPACK_FLOAT32_ID	0xCA
 
 #define MSGPACK_FIXINT_MAX		((1 << 7) - 1)
 #define MSGPACK_FIXINT_MIN		-(1 << 5)
@@ -56,6 +61,12 @@
 #define byteswap_host_to_be16(_tmp) cpu_to_be16(_tmp)
 #define byteswap_host_to_be32(_tmp) cpu_to_be32(_tmp)
 #define byteswap_host_to_be64(_tmp) cpu_to_be64(_tmp)
+#define byteswap_be_to_host16(_tmp) be16_to_cpu(_tmp)
+#define byteswap_be_to_host32(_tmp) be32_to_cpu(_tmp)
+#define byteswap_be_to_host64(_tmp) be64_to_cpu(_tmp)
+#define byteswap16(_tmp) swab16(_tmp)
+#define byteswap32(_tmp) swab32(_tmp)
+#define byteswap64(_tmp) swab64(_tmp)
 
 #define lttng_msgpack_assert(cond) WARN_ON(!(cond))
 
@@ -70,6 +81,12 @@
 #define byteswap_host_to_be16(_tmp) htobe16(_tmp)
 #define byteswap_host_to_be32(_tmp) htobe32(_tmp)
 #define byteswap_host_to_be64(_tmp) htobe64(_tmp)
+#define byteswap_be_to_host16(_tmp) be16toh(_tmp)
+#define byteswap_be_to_host32(_tmp) be32toh(_tmp)
+#define byteswap_be_to_host64(_tmp) be64toh(_tmp)
+#define byteswap16(_tmp) lttng_ust_bswap_16(_tmp)
+#define byteswap32(_tmp) lttng_ust_bswap_32(_tmp)
+#define byteswap64(_tmp) lttng_ust_bswap_64(_tmp)
 
 #define lttng_msgpack_assert(cond) ({ \
 	if (!(cond)) \
@@ -478,6 +495,165 @@ end:
 	return ret;
 }
 
+/*
+ * Unchecked counterparts of lttng_msgpack_write_unsigned_integer() and
+ * lttng_msgpack_write_signed_integer(), producing the same encoding, for
+ * callers which checked the space left for the largest encoding. They
+ * return the new write position.
+ */
+static inline uint8_t *lttng_msgpack_put_be(uint8_t *pos, uint64_t value,
+		unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		pos[i] = (uint8_t) (value >> (8 * (len - 1 - i)));
+	return pos + len;
+}
+
+static inline uint8_t *lttng_msgpack_put_unsigned(uint8_t *pos, uint64_t value)
+{
+	if (value <= MSGPACK_FIXINT_MAX) {
+		*pos++ = (uint8_t) value;
+	} else if (value <= UINT8_MAX) {
+		*pos++ = MSGPACK_UINT8_ID;
+		pos = lttng_msgpack_put_be(pos, value, 1);
+	} else if (value <= UINT16_MAX) {
+		*pos++ = MSGPACK_UINT16_ID;
+		pos = lttng_msgpack_put_be(pos, value, 2);
+	} else if (value <= UINT32_MAX) {
+		*pos++ = MSGPACK_UINT32_ID;
+		pos = lttng_msgpack_put_be(pos, value, 4);
+	} else {
+		*pos++ = MSGPACK_UINT64_ID;
+		pos = lttng_msgpack_put_be(pos, value, 8);
+	}
+	return pos;
+}
+
+static inline uint8_t *lttng_msgpack_put_signed(uint8_t *pos, int64_t value)
+{
+	if (value >= MSGPACK_FIXINT_MIN && value <= MSGPACK_FIXINT_MAX) {
+		*pos++ = (uint8_t) value;
+	} else if (value >= INT8_MIN && value <= INT8_MAX) {
+		*pos++ = MSGPACK_INT8_ID;
+		pos = lttng_msgpack_put_be(pos, (uint64_t) value, 1);
+	} else if (value >= INT16_MIN && value <= INT16_MAX) {
+		*pos++ = MSGPACK_INT16_ID;
+		pos = lttng_msgpack_put_be(pos, (uint64_t) value, 2);
+	} else if (value >= INT32_MIN && value <= INT32_MAX) {
+		*pos++ = MSGPACK_INT32_ID;
+		pos = lttng_msgpack_put_be(pos, (uint64_t) value, 4);
+	} else {
+		*pos++ = MSGPACK_INT64_ID;
+		pos = lttng_msgpack_put_be(pos, (uint64_t) value, 8);
+	}
+	return pos;
+}
+
+/*
+ * Read element @i of an array of integers of @size bits.
+ */
+static inline uint64_t lttng_msgpack_array_elem(const uint8_t *elems, size_t i,
+		unsigned int size, bool is_signed, bool reverse_byte_order)
+{
+	switch (size) {
+	case 8:
+	{
+		uint8_t v;
+
+		memcpy(&v, elems + i, sizeof(v));
+		return is_signed ? (uint64_t) (int64_t) (int8_t) v : v;
+	}
+	case 16:
+	{
+		uint16_t v;
+
+		memcpy(&v, elems + i * sizeof(v), sizeof(v));
+		if (reverse_byte_order)
+			v = byteswap16(v);
+		return is_signed ? (uint64_t) (int64_t) (int16_t) v : v;
+	}
+	case 32:
+	{
+		uint32_t v;
+
+		memcpy(&v, elems + i * sizeof(v), sizeof(v));
+		if (reverse_byte_order)
+			v = byteswap32(v);
+		return is_signed ? (uint64_t) (int64_t) (int32_t) v : v;
+	}
+	default:
+	{
+		uint64_t v;
+
+		memcpy(&v, elems + i * sizeof(v), sizeof(v));
+		if (reverse_byte_order)
+			v = byteswap64(v);
+		return v;
+	}
+	}
+}
+
+/*
+ * Write an array of @count integers of @size bits (8, 16, 32 or 64),
+ * read from @elems in native byte order unless @reverse_byte_order. An
+ * element of @size bits takes at most 1 + @size / 8 bytes once encoded:
+ * the space left is checked once for the whole array, which is then
+ * encoded in a tight loop. An array which may not fit is encoded element
+ * by element, up to the end of the buffer, as when written with
+ * lttng_msgpack_write_*_integer().
+ */
+int lttng_msgpack_write_integer_array(struct lttng_msgpack_writer *writer,
+		const void *elems, size_t count, unsigned int size,
+		bool is_signed, bool reverse_byte_order)
+{
+	size_t i, max_len = 1 + size / 8;
+	int ret;
+
+	if (size != 8 && size != 16 && size != 32 && size != 64)
+		return -1;
+	ret = lttng_msgpack_begin_array(writer, count);
+	if (ret)
+		goto end;
+
+	if (count <= (size_t) (writer->end_write_pos - writer->write_pos) / max_len) {
+		uint8_t *pos = writer->write_pos;
+
+		if (is_signed) {
+			for (i = 0; i < count; i++)
+				pos = lttng_msgpack_put_signed(pos,
+					(int64_t) lttng_msgpack_array_elem(elems,
+						i, size, true, reverse_byte_order));
+		} else {
+			for (i = 0; i < count; i++)
+				pos = lttng_msgpack_put_unsigned(pos,
+					lttng_msgpack_array_elem(elems, i, size,
+						false, reverse_byte_order));
+		}
+		writer->write_pos = pos;
+	} else {
+		for (i = 0; i < count; i++) {
+			uint64_t value = lttng_msgpack_array_elem(elems, i,
+				size, is_signed, reverse_byte_order);
+			int elem_ret;
+
+			if (is_signed)
+				elem_ret = lttng_msgpack_write_signed_integer(writer,
+					(int64_t) value);
+			else
+				elem_ret = lttng_msgpack_write_unsigned_integer(writer,
+					value);
+			if (elem_ret)
+				ret = elem_ret;
+		}
+	}
+
+	lttng_msgpack_end_array(writer);
+end:
+	return ret;
+}
+
 int lttng_msgpack_write_double(struct lttng_msgpack_writer *writer, double value)
 {
 	return lttng_msgpack_encode_f64(writer, value);
@@ -500,3 +676,207 @@ void lttng_msgpack_writer_fini(struct lttng_msgpack_writer *writer)
 {
 	memset(writer, 0, sizeof(*writer));
 }
+
+void lttng_msgpack_reader_init(struct lttng_msgpack_reader *reader,
+		const uint8_t *buffer, size_t size)
+{
+	lttng_msgpack_assert(buffer);
+
+	reader->buffer = buffer;
+	reader->read_pos = buffer;
+	reader->end_read_pos = buffer + size;
+}
+
+static inline int lttng_msgpack_consume(struct lttng_msgpack_reader *reader,
+		void *buf, size_t length)
+{
+	if (reader->end_read_pos - reader->read_pos < length)
+		return -1;
+	memcpy(buf, reader->read_pos, length);
+	reader->read_pos += length;
+	return 0;
+}
+
+static int lttng_msgpack_consume_be(struct lttng_msgpack_reader *reader,
+		size_t length, uint64_t *value)
+{
+	union {
+		uint8_t u8;
+		uint16_t u16;
+		uint32_t u32;
+		uint64_t u64;
+	} u;
+
+	if (lttng_msgpack_consume(reader, &u, length))
+		return -1;
+	switch (length) {
+	case 1:
+		*value = u.u8;
+		break;
+	case 2:
+		*value = byteswap_be_to_host16(u.u16);
+		break;
+	case 4:
+		*value = byteswap_be_to_host32(u.u32);
+		break;
+	case 8:
+		*value = byteswap_be_to_host64(u.u64);
+		break;
+	default:
+		return -1;
+	}
+	return 0;
+}
+
+static int lttng_msgpack_read_str(struct lttng_msgpack_reader *reader,
+		size_t length, struct lttng_msgpack_object *object)
+{
+	if (reader->end_read_pos - reader->read_pos < length)
+		return -1;
+	object->type = LTTNG_MSGPACK_OBJECT_STR;
+	object->u.str.str = (const char *) reader->read_pos;
+	object->u.str.len = length;
+	reader->read_pos += length;
+	return 0;
+}
+
+/*
+ * Decode the next object. Strings point into the decoded buffer and are
+ * not null-terminated. Arrays and maps only give their element count:
+ * their elements are the objects which follow.
+ *
+ * Returns 0 on success, -1 if the buffer is exhausted, truncated or
+ * holds an unsupported object type (bin, ext).
+ */
+int lttng_msgpack_read_object(struct lttng_msgpack_reader *reader,
+		struct lttng_msgpack_object *object)
+{
+	uint8_t id;
+	uint64_t v;
+
+	if (lttng_msgpack_consume(reader, &id, sizeof(id)))
+		return -1;
+
+	if (id <= MSGPACK_FIXINT_MAX) {
+		object->type = LTTNG_MSGPACK_OBJECT_UNSIGNED_INTEGER;
+		object->u.u = id;
+		return 0;
+	}
+	if ((int8_t) id >= MSGPACK_FIXINT_MIN) {
+		object->type = LTTNG_MSGPACK_OBJECT_SIGNED_INTEGER;
+		object->u.s = (int8_t) id;
+		return 0;
+	}
+	switch (id & 0xE0) {
+	case MSGPACK_FIXSTR_ID_MASK:
+		return lttng_msgpack_read_str(reader, id & 0x1F, object);
+	}
+	switch (id & 0xF0) {
+	case MSGPACK_FIXMAP_ID_MASK:
+		object->type = LTTNG_MSGPACK_OBJECT_MAP;
+		object->u.count = id & 0x0F;
+		return 0;
+	case MSGPACK_FIXARRAY_ID_MASK:
+		object->type = LTTNG_MSGPACK_OBJECT_ARRAY;
+		object->u.count = id & 0x0F;
+		return 0;
+	}
+
+	switch (id) {
+	case MSGPACK_NIL_ID:
+		object->type = LTTNG_MSGPACK_OBJECT_NIL;
+		return 0;
+	case MSGPACK_FALSE_ID:
+	case MSGPACK_TRUE_ID:
+		object->type = LTTNG_MSGPACK_OBJECT_BOOL;
+		object->u.b = id == MSGPACK_TRUE_ID;
+		return 0;
+	case MSGPACK_UINT8_ID:
+	case MSGPACK_UINT16_ID:
+	case MSGPACK_UINT32_ID:
+	case MSGPACK_UINT64_ID:
+		if (lttng_msgpack_consume_be(reader,
+				1U << (id - MSGPACK_UINT8_ID), &v))
+			return -1;
+		object->type = LTTNG_MSGPACK_OBJECT_UNSIGNED_INTEGER;
+		object->u.u = v;
+		return 0;
+	case MSGPACK_INT8_ID:
+		if (lttng_msgpack_consume_be(reader, 1, &v))
+			return -1;
+		object->type = LTTNG_MSGPACK_OBJECT_SIGNED_INTEGER;
+		object->u.s = (int8_t) v;
+		return 0;
+	case MSGPACK_INT16_ID:
+		if (lttng_msgpack_consume_be(reader, 2, &v))
+			return -1;
+		object->type = LTTNG_MSGPACK_OBJECT_SIGNED_INTEGER;
+		object->u.s = (int16_t) v;
+		return 0;
+	case MSGPACK_INT32_ID:
+		if (lttng_msgpack_consume_be(reader, 4, &v))
+			return -1;
+		object->type = LTTNG_MSGPACK_OBJECT_SIGNED_INTEGER;
+		object->u.s = (int32_t) v;
+		return 0;
+	case MSGPACK_INT64_ID:
+		if (lttng_msgpack_consume_be(reader, 8, &v))
+			return -1;
+		object->type = LTTNG_MSGPACK_OBJECT_SIGNED_INTEGER;
+		object->u.s = (int64_t) v;
+		return 0;
+	case MSGPACK_FLOAT32_ID:
+	{
+		union {
+			float f;
+			uint32_t u;
+		} u;
+
+		if (lttng_msgpack_consume_be(reader, 4, &v))
+			return -1;
+		u.u = (uint32_t) v;
+		object->type = LTTNG_MSGPACK_OBJECT_DOUBLE;
+		object->u.d = u.f;
+		return 0;
+	}
+	case MSGPACK_FLOAT64_ID:
+	{
+		union {
+			double d;
+			uint64_t u;
+		} u;
+
+		if (lttng_msgpack_consume_be(reader, 8, &v))
+			return -1;
+		u.u = v;
+		object->type = LTTNG_MSGPACK_OBJECT_DOUBLE;
+		object->u.d = u.d;
+		return 0;
+	}
+	case MSGPACK_STR8_ID:
+	case MSGPACK_STR16_ID:
+	case MSGPACK_STR32_ID:
+		if (lttng_msgpack_consume_be(reader,
+				1U << (id - MSGPACK_STR8_ID), &v))
+			return -1;
+		return lttng_msgpack_read_str(reader, v, object);
+	case MSGPACK_ARRAY16_ID:
+	case MSGPACK_ARRAY32_ID:
+		if (lttng_msgpack_consume_be(reader,
+				id == MSGPACK_ARRAY16_ID ? 2 : 4, &v))
+			return -1;
+		object->type = LTTNG_MSGPACK_OBJECT_ARRAY;
+		object->u.count = v;
+		return 0;
+	case MSGPACK_MAP16_ID:
+	case MSGPACK_MAP32_ID:
+		if (lttng_msgpack_consume_be(reader,
+				id == MSGPACK_MAP16_ID ? 2 : 4, &v))
+			return -1;
+		object->type = LTTNG_MSGPACK_OBJECT_MAP;
+		object->u.count = v;
+		return 0;
+	default:
+		return -1;
+	}
+}
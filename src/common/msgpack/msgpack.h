@@ -11,6 +11,7 @@
 #ifdef __KERNEL__
 #include <linux/types.h>
 #else /* __KERNEL__ */
+#include <stdbool.h>
 #include <stdint.h>
 #endif /* __KERNEL__ */
 
@@ -50,6 +51,11 @@ int lttng_msgpack_write_signed_integer(
 int lttng_msgpack_write_double(struct lttng_msgpack_writer *writer, double value)
 	__attribute__((visibility("hidden")));
 
+int lttng_msgpack_write_integer_array(struct lttng_msgpack_writer *writer,
+		const void *elems, size_t count, unsigned int size,
+		bool is_signed, bool reverse_byte_order)
+	__attribute__((visibility("hidden")));
+
 int lttng_msgpack_write_str(struct lttng_msgpack_writer *writer,
 		const char *value)
 	__attribute__((visibility("hidden")));
@@ -67,4 +73,45 @@ int lttng_msgpack_begin_array(
 int lttng_msgpack_end_array(struct lttng_msgpack_writer *writer)
 	__attribute__((visibility("hidden")));
 
+struct lttng_msgpack_reader {
+	const uint8_t *buffer;
+	const uint8_t *read_pos;
+	const uint8_t *end_read_pos;
+};
+
+enum lttng_msgpack_object_type {
+	LTTNG_MSGPACK_OBJECT_NIL,
+	LTTNG_MSGPACK_OBJECT_BOOL,
+	LTTNG_MSGPACK_OBJECT_UNSIGNED_INTEGER,
+	LTTNG_MSGPACK_OBJECT_SIGNED_INTEGER,
+	LTTNG_MSGPACK_OBJECT_DOUBLE,
+	LTTNG_MSGPACK_OBJECT_STR,
+	LTTNG_MSGPACK_OBJECT_ARRAY,
+	LTTNG_MSGPACK_OBJECT_MAP,
+};
+
+struct lttng_msgpack_object {
+	enum lttng_msgpack_object_type type;
+	union {
+		bool b;
+		uint64_t u;
+		int64_t s;
+		double d;
+		struct {
+			const char *str;	/* Not null-terminated */
+			size_t len;
+		} str;
+		uint32_t count;		/* Array elements or map pairs */
+	} u;
+};
+
+void lttng_msgpack_reader_init(
+		struct lttng_msgpack_reader *reader,
+		const uint8_t *buffer, size_t size)
+	__attribute__((visibility("hidden")));
+
+int lttng_msgpack_read_object(struct lttng_msgpack_reader *reader,
+		struct lttng_msgpack_object *object)
+	__attribute__((visibility("hidden")));
+
 #endif /* _LTTNG_UST_MSGPACK_H */
@@ -4,8 +4,19 @@
  * Copyright (C) 2011 Mathieu Desnoyers <mathieu.desnoyers@efficios.com>
  */
 
+#define _LGPL_SOURCE
 #include "common/ringbuffer-clients/clients.h"
 
+DEFINE_URCU_TLS(struct lttng_ust_client_tls, lttng_ust_client_tls);
+
+/*
+ * Force a read (imply TLS allocation for dlopen) of TLS variables.
+ */
+void lttng_ust_ring_buffer_clients_alloc_tls(void)
+{
+	asm volatile ("" : : "m" (URCU_TLS(lttng_ust_client_tls)));
+}
+
 void lttng_ust_ring_buffer_clients_init(void)
 {
 	lttng_ring_buffer_metadata_client_init();
@@ -13,10 +24,12 @@ void lttng_ust_ring_buffer_clients_init(void)
 	lttng_ring_buffer_client_overwrite_rt_init();
 	lttng_ring_buffer_client_discard_init();
 	lttng_ring_buffer_client_discard_rt_init();
+	lttng_ring_buffer_client_discard_per_thread_init();
 }
 
 void lttng_ust_ring_buffer_clients_exit(void)
 {
+	lttng_ring_buffer_client_discard_per_thread_exit();
 	lttng_ring_buffer_client_discard_rt_exit();
 	lttng_ring_buffer_client_discard_exit();
 	lttng_ring_buffer_client_overwrite_rt_exit();
@@ -7,10 +7,25 @@
 #ifndef _UST_COMMON_RINGBUFFER_CLIENTS_CLIENTS_H
 #define _UST_COMMON_RINGBUFFER_CLIENTS_CLIENTS_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <urcu/tls-compat.h>
 #include <lttng/ust-events.h>
 
 #include "common/ringbuffer/ringbuffer-config.h"
+#include "common/ringbuffer/frontend_types.h"
+
+/* Packet context fields, read from the packet header at once. */
+struct lttng_ust_client_packet_info {
+	uint64_t timestamp_begin;
+	uint64_t timestamp_end;
+	uint64_t events_discarded;
+	uint64_t content_size;
+	uint64_t packet_size;
+	uint64_t stream_id;
+	uint64_t sequence_number;
+	uint64_t instance_id;
+};
 
 struct lttng_ust_client_lib_ring_buffer_client_cb {
 	struct lttng_ust_ring_buffer_client_cb parent;
@@ -40,8 +55,40 @@ struct lttng_ust_client_lib_ring_buffer_client_cb {
 		struct lttng_ust_ring_buffer_channel *chan, uint64_t *seq);
 	int (*instance_id) (struct lttng_ust_ring_buffer *buf,
 			struct lttng_ust_ring_buffer_channel *chan, uint64_t *id);
+	int (*packet_info) (struct lttng_ust_ring_buffer *buf,
+			struct lttng_ust_ring_buffer_channel *chan,
+			struct lttng_ust_client_packet_info *info);
+};
+
+struct lttng_client_ctx {
+	size_t packet_context_len;
+	size_t event_context_len;
+	struct lttng_ust_ctx *chan_ctx;
+	struct lttng_ust_ctx *event_ctx;
+	int header_type;		/* 1: compact, 2: large, 3: single event */
+	char *staging;			/* Payload of a staged record */
+	/* Interned strings of a single record reservation, or NULL. */
+	struct lttng_ust_ring_buffer_intern *intern;
+};
+
+/*
+ * Per-thread state of the ring buffer clients, shared by all of them: a
+ * thread has at most one reservation in flight per nesting level,
+ * whichever the client. Indexed by the nesting level returned by
+ * lib_ring_buffer_nesting_inc().
+ *
+ * @client_ctx holds the client contexts of batched reservations, needed
+ * to write the header of each record of the batch, and of staged
+ * records, which hold their payload.
+ */
+struct lttng_ust_client_tls {
+	struct lttng_ust_ring_buffer_ctx_private private_ctx[LIB_RING_BUFFER_MAX_NESTING];
+	struct lttng_client_ctx client_ctx[LIB_RING_BUFFER_MAX_NESTING];
 };
 
+extern DECLARE_URCU_TLS(struct lttng_ust_client_tls, lttng_ust_client_tls)
+	__attribute__((visibility("hidden")));
+
 void lttng_ust_ring_buffer_clients_init(void)
 	__attribute__((visibility("hidden")));
 
@@ -60,6 +107,9 @@ void lttng_ring_buffer_client_discard_init(void)
 void lttng_ring_buffer_client_discard_rt_init(void)
 	__attribute__((visibility("hidden")));
 
+void lttng_ring_buffer_client_discard_per_thread_init(void)
+	__attribute__((visibility("hidden")));
+
 void lttng_ring_buffer_metadata_client_init(void)
 	__attribute__((visibility("hidden")));
 
@@ -76,20 +126,13 @@ void lttng_ring_buffer_client_discard_exit(void)
 void lttng_ring_buffer_client_discard_rt_exit(void)
 	__attribute__((visibility("hidden")));
 
-void lttng_ring_buffer_metadata_client_exit(void)
-	__attribute__((visibility("hidden")));
-
-
-void lttng_ust_ring_buffer_client_overwrite_alloc_tls(void)
+void lttng_ring_buffer_client_discard_per_thread_exit(void)
 	__attribute__((visibility("hidden")));
 
-void lttng_ust_ring_buffer_client_overwrite_rt_alloc_tls(void)
-	__attribute__((visibility("hidden")));
-
-void lttng_ust_ring_buffer_client_discard_alloc_tls(void)
+void lttng_ring_buffer_metadata_client_exit(void)
 	__attribute__((visibility("hidden")));
 
-void lttng_ust_ring_buffer_client_discard_rt_alloc_tls(void)
+void lttng_ust_ring_buffer_clients_alloc_tls(void)
 	__attribute__((visibility("hidden")));
 
 #endif /* _UST_COMMON_RINGBUFFER_CLIENTS_CLIENTS_H */
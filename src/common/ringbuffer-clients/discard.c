@@ -12,8 +12,6 @@
 
 #define RING_BUFFER_MODE_TEMPLATE		RING_BUFFER_DISCARD
 #define RING_BUFFER_MODE_TEMPLATE_STRING	"discard"
-#define RING_BUFFER_MODE_TEMPLATE_ALLOC_TLS	\
-	lttng_ust_ring_buffer_client_discard_alloc_tls
 #define RING_BUFFER_MODE_TEMPLATE_INIT	\
 	lttng_ring_buffer_client_discard_init
 #define RING_BUFFER_MODE_TEMPLATE_EXIT	\
@@ -38,9 +38,6 @@ struct metadata_record_header {
 
 static const struct lttng_ust_ring_buffer_config client_config;
 
-/* No nested use supported for metadata ring buffer. */
-static DEFINE_URCU_TLS(struct lttng_ust_ring_buffer_ctx_private, private_ctx);
-
 static inline uint64_t lib_ring_buffer_clock_read(
 		struct lttng_ust_ring_buffer_channel *chan __attribute__((unused)))
 {
@@ -216,6 +213,7 @@ struct lttng_ust_channel_buffer *_channel_create(const char *name,
 				unsigned char *uuid,
 				uint32_t chan_id,
 				const int *stream_fds, int nr_stream_fds,
+				unsigned int nr_streams,
 				int64_t blocking_timeout)
 {
 	struct lttng_ust_abi_channel_config chan_priv_init;
@@ -238,7 +236,8 @@ struct lttng_ust_channel_buffer *_channel_create(const char *name,
 			&chan_priv_init,
 			lttng_chan_buf, buf_addr, subbuf_size, num_subbuf,
 			switch_timer_interval, read_timer_interval,
-			stream_fds, nr_stream_fds, blocking_timeout);
+			stream_fds, nr_stream_fds, nr_streams,
+			blocking_timeout);
 	if (!handle)
 		goto error;
 	lttng_chan_buf->priv->rb_chan = shmp(handle, handle->chan);
@@ -259,25 +258,37 @@ void lttng_channel_destroy(struct lttng_ust_channel_buffer *lttng_chan_buf)
 static
 int lttng_event_reserve(struct lttng_ust_ring_buffer_ctx *ctx)
 {
-	int ret;
+	struct lttng_ust_ring_buffer_ctx_private *private_ctx;
+	int ret, nesting;
 
-	memset(&URCU_TLS(private_ctx), 0, sizeof(struct lttng_ust_ring_buffer_ctx_private));
-	URCU_TLS(private_ctx).pub = ctx;
-	URCU_TLS(private_ctx).chan = ctx->client_priv;
-	ctx->priv = &URCU_TLS(private_ctx);
+	/* Use the context stack of the event clients. */
+	nesting = lib_ring_buffer_nesting_inc(&client_config);
+	if (nesting < 0)
+		return -EPERM;
+	private_ctx = &URCU_TLS(lttng_ust_client_tls).private_ctx[nesting];
+	memset(private_ctx, 0, sizeof(*private_ctx));
+	private_ctx->pub = ctx;
+	private_ctx->chan = ctx->client_priv;
+	ctx->priv = private_ctx;
 	ret = lib_ring_buffer_reserve(&client_config, ctx, NULL);
 	if (ret)
-		return ret;
+		goto put;
 	if (lib_ring_buffer_backend_get_pages(&client_config, ctx,
-			&ctx->priv->backend_pages))
-		return -EPERM;
+			&ctx->priv->backend_pages)) {
+		ret = -EPERM;
+		goto put;
+	}
 	return 0;
+put:
+	lib_ring_buffer_nesting_dec(&client_config);
+	return ret;
 }
 
 static
 void lttng_event_commit(struct lttng_ust_ring_buffer_ctx *ctx)
 {
 	lib_ring_buffer_commit(&client_config, ctx);
+	lib_ring_buffer_nesting_dec(&client_config);
 }
 
 static
@@ -12,8 +12,6 @@
 
 #define RING_BUFFER_MODE_TEMPLATE		RING_BUFFER_OVERWRITE
 #define RING_BUFFER_MODE_TEMPLATE_STRING	"overwrite-rt"
-#define RING_BUFFER_MODE_TEMPLATE_ALLOC_TLS	\
-	lttng_ust_ring_buffer_client_overwrite_rt_alloc_tls
 #define RING_BUFFER_MODE_TEMPLATE_INIT	\
 	lttng_ring_buffer_client_overwrite_rt_init
 #define RING_BUFFER_MODE_TEMPLATE_EXIT	\
@@ -7,20 +7,45 @@
  */
 
 #include <limits.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <lttng/urcu/pointer.h>
 #include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
 
 #include "common/events.h"
 #include "common/bitfield.h"
 #include "common/align.h"
 #include "common/clock.h"
+#include "common/macros.h"
+#include "common/metrics.h"
 #include "common/ringbuffer/frontend_types.h"
 
+/*
+ * Clients use per-cpu buffers unless they select another allocation
+ * scheme.
+ */
+#ifndef RING_BUFFER_ALLOC_TEMPLATE
+#define RING_BUFFER_ALLOC_TEMPLATE	RING_BUFFER_ALLOC_PER_CPU
+#endif
+
 #define LTTNG_COMPACT_EVENT_BITS       5
 #define LTTNG_COMPACT_TSC_BITS         27
+#define LTTNG_LARGE_TSC_BITS           32
+#define LTTNG_SINGLE_TSC_BITS          31
+
+/*
+ * Upper bound of the space taken by a record header and the alignment
+ * of its payload, context fields excluded.
+ */
+#define LTTNG_EVENT_HEADER_MAX_LEN	32
+
+/* Smallest fragment payload tried before giving up on a record. */
+#define LTTNG_FRAGMENT_MIN_LEN		64
 
 /*
  * Keep the natural field alignment for _each field_ within this structure if
@@ -56,27 +81,6 @@ struct packet_header {
 	} ctx;
 };
 
-struct lttng_client_ctx {
-	size_t packet_context_len;
-	size_t event_context_len;
-	struct lttng_ust_ctx *chan_ctx;
-	struct lttng_ust_ctx *event_ctx;
-};
-
-/*
- * Indexed by lib_ring_buffer_nesting_count().
- */
-typedef struct lttng_ust_ring_buffer_ctx_private private_ctx_stack_t[LIB_RING_BUFFER_MAX_NESTING];
-static DEFINE_URCU_TLS(private_ctx_stack_t, private_ctx_stack);
-
-/*
- * Force a read (imply TLS allocation for dlopen) of TLS variables.
- */
-void RING_BUFFER_MODE_TEMPLATE_ALLOC_TLS(void)
-{
-	asm volatile ("" : : "m" (URCU_TLS(private_ctx_stack)));
-}
-
 static inline uint64_t lib_ring_buffer_clock_read(
 		struct lttng_ust_ring_buffer_channel *chan __attribute__((unused)))
 {
@@ -107,11 +111,126 @@ void ctx_get_struct_size(struct lttng_ust_ring_buffer_ctx *bufctx,
 		*ctx_len = 0;
 		return;
 	}
+	if (caa_likely(ctx->fixed_size_valid)) {
+		*ctx_len = ctx->fixed_size;
+		return;
+	}
 	for (i = 0; i < ctx->nr_fields; i++)
 		offset += ctx->fields[i].get_size(ctx->fields[i].priv, bufctx->probe_ctx, offset);
 	*ctx_len = offset;
 }
 
+/*
+ * Record an integer context field from the value already computed by a
+ * filter during this tracepoint hit, if any, rather than evaluating it
+ * again. The record callback of integer contexts writes the value
+ * returned by get_value, with the size and alignment of the field type.
+ */
+static inline
+bool ctx_record_memo(struct lttng_ust_ring_buffer_ctx *bufctx,
+		struct lttng_ust_channel_buffer *chan,
+		const struct lttng_ust_ctx_field *ctx_field)
+{
+	const struct lttng_ust_type_common *type = ctx_field->event_field->type;
+	const struct lttng_ust_type_integer *itype;
+	struct lttng_ust_ctx_value v;
+	size_t align;
+
+	if (type->type != lttng_ust_type_integer || !ctx_field->get_value)
+		return false;
+	itype = lttng_ust_get_type_integer(type);
+	if (itype->reverse_byte_order)
+		return false;
+	if (!lttng_ust_ctx_memo_lookup(ctx_field, bufctx->probe_ctx, &v))
+		return false;
+	align = itype->alignment / CHAR_BIT;
+	switch (itype->size) {
+	case 8:
+	{
+		uint8_t value = v.u.u64;
+
+		chan->ops->event_write(bufctx, &value, sizeof(value), align);
+		return true;
+	}
+	case 16:
+	{
+		uint16_t value = v.u.u64;
+
+		chan->ops->event_write(bufctx, &value, sizeof(value), align);
+		return true;
+	}
+	case 32:
+	{
+		uint32_t value = v.u.u64;
+
+		chan->ops->event_write(bufctx, &value, sizeof(value), align);
+		return true;
+	}
+	case 64:
+		chan->ops->event_write(bufctx, &v.u.u64, sizeof(v.u.u64), align);
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Record a context frozen by lttng_context_update(): store the value of
+ * each field at its precomputed offset in a copy of the context, and
+ * write the copy at once, rather than aligning and writing each field
+ * through its record callback.
+ */
+static inline
+void ctx_record_frozen(struct lttng_ust_ring_buffer_ctx *bufctx,
+		struct lttng_ust_channel_buffer *chan,
+		struct lttng_ust_ctx *ctx)
+{
+	char data[LTTNG_UST_CTX_FROZEN_MAX_SIZE] __attribute__((aligned(sizeof(uint64_t))));
+	unsigned int i;
+
+	memset(data, 0, ctx->fixed_size);
+	for (i = 0; i < ctx->nr_fields; i++) {
+		const struct lttng_ust_ctx_field *field = &ctx->fields[i];
+		char *slot = data + field->frozen_offset;
+		struct lttng_ust_ctx_value v;
+
+		lttng_ust_ctx_get_value(field, bufctx->probe_ctx, &v);
+		if (field->event_field->type->type == lttng_ust_type_array) {
+			/* Same bytes as the record callback of the field. */
+			if (v.u.str)
+				memcpy(slot, v.u.str, field->frozen_size);
+			continue;
+		}
+		switch (field->frozen_size) {
+		case 1:
+		{
+			uint8_t value = v.u.u64;
+
+			memcpy(slot, &value, sizeof(value));
+			break;
+		}
+		case 2:
+		{
+			uint16_t value = v.u.u64;
+
+			memcpy(slot, &value, sizeof(value));
+			break;
+		}
+		case 4:
+		{
+			uint32_t value = v.u.u64;
+
+			memcpy(slot, &value, sizeof(value));
+			break;
+		}
+		case 8:
+			memcpy(slot, &v.u.u64, sizeof(v.u.u64));
+			break;
+		}
+	}
+	chan->ops->event_write(bufctx, data, ctx->fixed_size, ctx->largest_align);
+}
+
 static inline
 void ctx_record(struct lttng_ust_ring_buffer_ctx *bufctx,
 		struct lttng_ust_channel_buffer *chan,
@@ -121,11 +240,38 @@ void ctx_record(struct lttng_ust_ring_buffer_ctx *bufctx,
 
 	if (caa_likely(!ctx))
 		return;
+	if (caa_likely(ctx->frozen)) {
+		ctx_record_frozen(bufctx, chan, ctx);
+		return;
+	}
 	lttng_ust_ring_buffer_align_ctx(bufctx, ctx->largest_align);
-	for (i = 0; i < ctx->nr_fields; i++)
+	for (i = 0; i < ctx->nr_fields; i++) {
+		if (ctx_record_memo(bufctx, chan, &ctx->fields[i]))
+			continue;
 		ctx->fields[i].record(ctx->fields[i].priv, bufctx->probe_ctx, bufctx, chan);
+	}
 }
 
+/*
+ * Interned strings of the record of @ctx, NULL if none or if the probe
+ * predates them.
+ */
+static inline
+struct lttng_ust_ring_buffer_intern *lttng_event_intern_strings(struct lttng_ust_ring_buffer_ctx *ctx)
+{
+	if (ctx->struct_size < offsetof(struct lttng_ust_ring_buffer_ctx, intern)
+			+ sizeof(ctx->intern) || !ctx->intern)
+		return NULL;
+	if (ctx->intern->struct_size < offsetof(struct lttng_ust_ring_buffer_intern, interned)
+			+ sizeof(ctx->intern->interned))
+		return NULL;
+	return ctx->intern;
+}
+
+static
+void lttng_intern_reserve(struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_ring_buffer_intern *intern, size_t offset);
+
 /*
  * record_header_size - Calculate the header size and padding necessary.
  * @config: ring buffer instance configuration
@@ -142,17 +288,16 @@ void ctx_record(struct lttng_ust_ring_buffer_ctx *bufctx,
 static __inline__
 size_t record_header_size(
 		const struct lttng_ust_ring_buffer_config *config __attribute__((unused)),
-		struct lttng_ust_ring_buffer_channel *chan,
+		struct lttng_ust_ring_buffer_channel *chan __attribute__((unused)),
 		size_t offset,
 		size_t *pre_header_padding,
 		struct lttng_ust_ring_buffer_ctx *ctx,
 		struct lttng_client_ctx *client_ctx)
 {
-	struct lttng_ust_channel_buffer *lttng_chan = channel_get_private(chan);
 	size_t orig_offset = offset;
 	size_t padding;
 
-	switch (lttng_chan->priv->header_type) {
+	switch (client_ctx->header_type) {
 	case 1:	/* compact */
 		padding = lttng_ust_ring_buffer_align(offset, lttng_ust_rb_alignof(uint32_t));
 		offset += padding;
@@ -183,6 +328,17 @@ size_t record_header_size(
 			offset += sizeof(uint64_t);	/* timestamp */
 		}
 		break;
+	case 3:	/* single event */
+		padding = lttng_ust_ring_buffer_align(offset, lttng_ust_rb_alignof(uint32_t));
+		offset += padding;
+		if (!(ctx->priv->rflags & (RING_BUFFER_RFLAG_FULL_TSC | LTTNG_RFLAG_EXTENDED))) {
+			offset += sizeof(uint32_t);	/* selector and timestamp */
+		} else {
+			offset += sizeof(uint8_t);	/* selector */
+			offset += lttng_ust_ring_buffer_align(offset, lttng_ust_rb_alignof(uint64_t));
+			offset += sizeof(uint64_t);	/* timestamp */
+		}
+		break;
 	default:
 		padding = 0;
 		WARN_ON_ONCE(1);
@@ -191,6 +347,8 @@ size_t record_header_size(
 			client_ctx->packet_context_len);
 	offset += ctx_get_aligned_size(offset, client_ctx->event_ctx,
 			client_ctx->event_context_len);
+	if (caa_unlikely(client_ctx->intern))
+		lttng_intern_reserve(ctx, client_ctx->intern, orig_offset);
 	*pre_header_padding = padding;
 	return offset - orig_offset;
 }
@@ -224,7 +382,7 @@ void lttng_write_event_header(const struct lttng_ust_ring_buffer_config *config,
 	if (caa_unlikely(ctx->priv->rflags))
 		goto slow_path;
 
-	switch (lttng_chan->priv->header_type) {
+	switch (client_ctx->header_type) {
 	case 1:	/* compact */
 	{
 		uint32_t id_time = 0;
@@ -250,6 +408,17 @@ void lttng_write_event_header(const struct lttng_ust_ring_buffer_config *config,
 		lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
 		break;
 	}
+	case 3:	/* single event */
+	{
+		uint32_t sel_time = 0;
+
+		bt_bitfield_write(&sel_time, uint32_t,
+				1,
+				LTTNG_SINGLE_TSC_BITS,
+				ctx->priv->tsc);
+		lib_ring_buffer_write(config, ctx, &sel_time, sizeof(sel_time));
+		break;
+	}
 	default:
 		WARN_ON_ONCE(1);
 	}
@@ -273,7 +442,7 @@ void lttng_write_event_header_slow(const struct lttng_ust_ring_buffer_config *co
 	struct lttng_ust_ring_buffer_ctx_private *ctx_private = ctx->priv;
 	struct lttng_ust_channel_buffer *lttng_chan = channel_get_private(ctx->priv->chan);
 
-	switch (lttng_chan->priv->header_type) {
+	switch (client_ctx->header_type) {
 	case 1:	/* compact */
 		if (!(ctx_private->rflags & (RING_BUFFER_RFLAG_FULL_TSC | LTTNG_RFLAG_EXTENDED))) {
 			uint32_t id_time = 0;
@@ -325,6 +494,25 @@ void lttng_write_event_header_slow(const struct lttng_ust_ring_buffer_config *co
 		}
 		break;
 	}
+	case 3:	/* single event */
+		if (!(ctx_private->rflags & (RING_BUFFER_RFLAG_FULL_TSC | LTTNG_RFLAG_EXTENDED))) {
+			uint32_t sel_time = 0;
+
+			bt_bitfield_write(&sel_time, uint32_t,
+					1,
+					LTTNG_SINGLE_TSC_BITS,
+					ctx_private->tsc);
+			lib_ring_buffer_write(config, ctx, &sel_time, sizeof(sel_time));
+		} else {
+			uint8_t sel = 1;
+			uint64_t timestamp = ctx_private->tsc;
+
+			lib_ring_buffer_write(config, ctx, &sel, sizeof(sel));
+			/* Align extended struct on largest member */
+			lttng_ust_ring_buffer_align_ctx(ctx, lttng_ust_rb_alignof(uint64_t));
+			lib_ring_buffer_write(config, ctx, &timestamp, sizeof(timestamp));
+		}
+		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
@@ -408,6 +596,7 @@ static void client_buffer_end(struct lttng_ust_ring_buffer *buf, uint64_t tsc,
 			lib_ring_buffer_offset_address(&buf->backend,
 				subbuf_idx * chan->backend.subbuf_size,
 				handle);
+	struct commit_counters_cold *cc_cold;
 	unsigned long records_lost = 0;
 
 	assert(header);
@@ -423,6 +612,14 @@ static void client_buffer_end(struct lttng_ust_ring_buffer *buf, uint64_t tsc,
 	records_lost += lib_ring_buffer_get_records_lost_wrap(&client_config, ctx);
 	records_lost += lib_ring_buffer_get_records_lost_big(&client_config, ctx);
 	header->ctx.events_discarded = records_lost;
+	/*
+	 * Records sampled out are not lost: the consumer reads their count
+	 * apart, as the packet context layout is set by the session daemon.
+	 */
+	cc_cold = shmp_index(handle, buf->commit_cold, subbuf_idx);
+	if (cc_cold)
+		CMM_STORE_SHARED(cc_cold->records_sampled,
+			lib_ring_buffer_get_records_sampled(&client_config, ctx));
 }
 
 static int client_buffer_create(
@@ -579,6 +776,28 @@ static int client_instance_id(struct lttng_ust_ring_buffer *buf,
 	return 0;
 }
 
+static int client_packet_info(struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_ring_buffer_channel *chan,
+		struct lttng_ust_client_packet_info *info)
+{
+	struct lttng_ust_channel_buffer *lttng_chan = channel_get_private(chan);
+	struct lttng_ust_shm_handle *handle = chan->handle;
+	struct packet_header *header;
+
+	header = client_packet_header(buf, handle);
+	if (!header)
+		return -1;
+	info->timestamp_begin = header->ctx.timestamp_begin;
+	info->timestamp_end = header->ctx.timestamp_end;
+	info->events_discarded = header->ctx.events_discarded;
+	info->content_size = header->ctx.content_size;
+	info->packet_size = header->ctx.packet_size;
+	info->sequence_number = header->ctx.packet_seq_num;
+	info->stream_id = lttng_chan->priv->id;
+	info->instance_id = buf->backend.cpu;
+	return 0;
+}
+
 static const
 struct lttng_ust_client_lib_ring_buffer_client_cb client_cb = {
 	.parent = {
@@ -601,6 +820,7 @@ struct lttng_ust_client_lib_ring_buffer_client_cb client_cb = {
 	.current_timestamp = client_current_timestamp,
 	.sequence_number = client_sequence_number,
 	.instance_id = client_instance_id,
+	.packet_info = client_packet_info,
 };
 
 static const struct lttng_ust_ring_buffer_config client_config = {
@@ -615,10 +835,12 @@ static const struct lttng_ust_ring_buffer_config client_config = {
 	.cb.packet_size_field = client_packet_size_field,
 
 	.tsc_bits = LTTNG_COMPACT_TSC_BITS,
-	.alloc = RING_BUFFER_ALLOC_PER_CPU,
+	.alloc = RING_BUFFER_ALLOC_TEMPLATE,
 	.sync = RING_BUFFER_SYNC_GLOBAL,
 	.mode = RING_BUFFER_MODE_TEMPLATE,
-	.backend = RING_BUFFER_PAGE,
+	/* Sub-buffers are only exchanged with the reader in overwrite mode. */
+	.backend = RING_BUFFER_MODE_TEMPLATE == RING_BUFFER_DISCARD ?
+		RING_BUFFER_VMAP : RING_BUFFER_PAGE,
 	.output = RING_BUFFER_MMAP,
 	.oops = RING_BUFFER_OOPS_CONSISTENCY,
 	.ipi = RING_BUFFER_NO_IPI_BARRIER,
@@ -637,6 +859,7 @@ struct lttng_ust_channel_buffer *_channel_create(const char *name,
 				unsigned char *uuid,
 				uint32_t chan_id,
 				const int *stream_fds, int nr_stream_fds,
+				unsigned int nr_streams,
 				int64_t blocking_timeout)
 {
 	struct lttng_ust_abi_channel_config chan_priv_init;
@@ -659,7 +882,8 @@ struct lttng_ust_channel_buffer *_channel_create(const char *name,
 			&chan_priv_init,
 			lttng_chan_buf, buf_addr, subbuf_size, num_subbuf,
 			switch_timer_interval, read_timer_interval,
-			stream_fds, nr_stream_fds, blocking_timeout);
+			stream_fds, nr_stream_fds, nr_streams,
+			blocking_timeout);
 	if (!handle)
 		goto error;
 	lttng_chan_buf->priv->rb_chan = shmp(handle, handle->chan);
@@ -677,8 +901,20 @@ void lttng_channel_destroy(struct lttng_ust_channel_buffer *lttng_chan_buf)
 	lttng_ust_free_channel_common(lttng_chan_buf->parent);
 }
 
-static
-int lttng_event_reserve(struct lttng_ust_ring_buffer_ctx *ctx)
+/*
+ * Reserve space for @nr_records records of the event recorder found in the
+ * ring buffer context. Returns the number of records reserved on success,
+ * a negative error value otherwise.
+ *
+ * Always inlined, so each call with constant @header_type and context
+ * arguments gets a copy of the reserve and header write paths specialized
+ * for that combination.
+ */
+static inline __attribute__((always_inline))
+int _lttng_event_reserve_records(struct lttng_ust_ring_buffer_ctx *ctx,
+		unsigned int nr_records, int header_type,
+		struct lttng_ust_ctx *chan_ctx, struct lttng_ust_ctx *event_ctx,
+		unsigned int rflags)
 {
 	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
 	struct lttng_ust_channel_buffer *lttng_chan = event_recorder->chan;
@@ -688,8 +924,13 @@ int lttng_event_reserve(struct lttng_ust_ring_buffer_ctx *ctx)
 	uint32_t event_id;
 
 	event_id = event_recorder->priv->id;
-	client_ctx.chan_ctx = lttng_ust_rcu_dereference(lttng_chan->priv->ctx);
-	client_ctx.event_ctx = lttng_ust_rcu_dereference(event_recorder->priv->ctx);
+	/* The stream metadata implies the id of its single event. */
+	if (header_type == 3 && event_id != 0)
+		return -EPERM;
+	client_ctx.chan_ctx = chan_ctx;
+	client_ctx.event_ctx = event_ctx;
+	client_ctx.header_type = header_type;
+	client_ctx.intern = nr_records == 1 ? lttng_event_intern_strings(ctx) : NULL;
 	/* Compute internal size of context structures. */
 	ctx_get_struct_size(ctx, client_ctx.chan_ctx, &client_ctx.packet_context_len);
 	ctx_get_struct_size(ctx, client_ctx.event_ctx, &client_ctx.event_context_len);
@@ -698,14 +939,15 @@ int lttng_event_reserve(struct lttng_ust_ring_buffer_ctx *ctx)
 	if (nesting < 0)
 		return -EPERM;
 
-	private_ctx = &URCU_TLS(private_ctx_stack)[nesting];
+	private_ctx = &URCU_TLS(lttng_ust_client_tls).private_ctx[nesting];
 	memset(private_ctx, 0, sizeof(*private_ctx));
 	private_ctx->pub = ctx;
 	private_ctx->chan = lttng_chan->priv->rb_chan;
+	private_ctx->rflags = rflags;
 
 	ctx->priv = private_ctx;
 
-	switch (lttng_chan->priv->header_type) {
+	switch (header_type) {
 	case 1:	/* compact */
 		if (event_id > 30)
 			private_ctx->rflags |= LTTNG_RFLAG_EXTENDED;
@@ -713,29 +955,408 @@ int lttng_event_reserve(struct lttng_ust_ring_buffer_ctx *ctx)
 	case 2:	/* large */
 		if (event_id > 65534)
 			private_ctx->rflags |= LTTNG_RFLAG_EXTENDED;
+		private_ctx->tsc_bits = LTTNG_LARGE_TSC_BITS;
+		break;
+	case 3:	/* single event */
+		private_ctx->tsc_bits = LTTNG_SINGLE_TSC_BITS;
 		break;
 	default:
 		WARN_ON_ONCE(1);
 	}
 
-	ret = lib_ring_buffer_reserve(&client_config, ctx, &client_ctx);
-	if (caa_unlikely(ret))
-		goto put;
-	if (lib_ring_buffer_backend_get_pages(&client_config, ctx,
-			&private_ctx->backend_pages)) {
+	if (nr_records == 1) {
+		ret = lib_ring_buffer_reserve(&client_config, ctx, &client_ctx);
+		if (caa_unlikely(ret))
+			goto put;
+		ret = 1;
+	} else {
+		ret = lib_ring_buffer_reserve_batch(&client_config, ctx,
+				&client_ctx, nr_records);
+		if (caa_unlikely(ret < 0))
+			goto put;
+		URCU_TLS(lttng_ust_client_tls).client_ctx[nesting] = client_ctx;
+	}
+	if (client_config.backend != RING_BUFFER_VMAP
+			&& lib_ring_buffer_backend_get_pages(&client_config, ctx,
+				&private_ctx->backend_pages)) {
 		ret = -EPERM;
 		goto put;
 	}
 	lttng_write_event_header(&client_config, ctx, &client_ctx, event_id);
-	return 0;
+	return ret;
 put:
 	lib_ring_buffer_nesting_dec(&client_config);
 	return ret;
 }
 
+/*
+ * Channels without context fields, the default, use code specialized for
+ * their header type and for the absence of contexts. Other channels use
+ * the generic code.
+ */
+static inline
+int lttng_event_reserve_records(struct lttng_ust_ring_buffer_ctx *ctx,
+		unsigned int nr_records)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+	struct lttng_ust_channel_buffer *lttng_chan = event_recorder->chan;
+	struct lttng_ust_ctx *chan_ctx, *event_ctx;
+
+	chan_ctx = lttng_ust_rcu_dereference(lttng_chan->priv->ctx);
+	event_ctx = lttng_ust_rcu_dereference(event_recorder->priv->ctx);
+	if (caa_likely(!chan_ctx && !event_ctx)) {
+		switch (lttng_chan->priv->header_type) {
+		case 1:	/* compact */
+			return _lttng_event_reserve_records(ctx, nr_records,
+					1, NULL, NULL, 0);
+		case 2:	/* large */
+			return _lttng_event_reserve_records(ctx, nr_records,
+					2, NULL, NULL, 0);
+		case 3:	/* single event */
+			return _lttng_event_reserve_records(ctx, nr_records,
+					3, NULL, NULL, 0);
+		default:
+			break;
+		}
+	}
+	return _lttng_event_reserve_records(ctx, nr_records,
+			lttng_chan->priv->header_type, chan_ctx, event_ctx, 0);
+}
+
+/*
+ * Records whose payload does not fit in a sub-buffer are staged in a
+ * preallocated slot of their channel when the channel has an enabled
+ * lttng_ust_fragment:record event, and written as a sequence of fragment
+ * events on commit. The payload of a staged record is laid out as if it started at an offset
+ * aligned on its largest alignment, as in the ring buffer. Its event
+ * context fields are not recorded; the channel context fields are
+ * recorded with each fragment.
+ */
+static inline
+bool lttng_event_oversized(struct lttng_ust_ring_buffer_ctx *ctx)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+	struct lttng_ust_ring_buffer_channel *rb_chan = event_recorder->chan->priv->rb_chan;
+
+	return ctx->data_size + ctx->largest_align + LTTNG_EVENT_HEADER_MAX_LEN
+		+ client_packet_header_size() > rb_chan->backend.subbuf_size;
+}
+
+static inline
+char *lttng_event_staging(struct lttng_ust_ring_buffer_ctx_private *private_ctx)
+{
+	struct lttng_ust_client_tls *tls = &URCU_TLS(lttng_ust_client_tls);
+
+	return tls->client_ctx[private_ctx - tls->private_ctx].staging;
+}
+
+/*
+ * Claim a staging slot of the channel of @ctx, starting with the slot of
+ * the current CPU. Returns NULL if all slots are in use.
+ */
+static
+char *lttng_event_staging_claim(struct lttng_ust_staging_area *staging)
+{
+	unsigned int i, first;
+	int cpu = lttng_ust_get_cpu();
+
+	first = cpu < 0 ? 0 : (unsigned int) cpu % staging->nr_slots;
+	for (i = 0; i < staging->nr_slots; i++) {
+		unsigned int slot = (first + i) % staging->nr_slots;
+
+		if (CMM_LOAD_SHARED(staging->busy[slot]))
+			continue;
+		if (uatomic_cmpxchg(&staging->busy[slot], 0, 1) == 0)
+			return staging->slots + (size_t) slot * staging->slot_size;
+	}
+	return NULL;
+}
+
+static
+void lttng_event_staging_release(struct lttng_ust_staging_area *staging,
+		char *data)
+{
+	size_t slot = (size_t) (data - staging->slots) / staging->slot_size;
+
+	/* The payload is read before the slot is handed to another writer. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(staging->busy[slot], 0);
+}
+
+/*
+ * Stage the record of @ctx in a preallocated slot of its channel.
+ * Returns 0 on success, or a negative error value if the record is to
+ * be reserved in the ring buffer.
+ */
+static
+int lttng_event_stage(struct lttng_ust_ring_buffer_ctx *ctx)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+	struct lttng_ust_channel_buffer *lttng_chan = event_recorder->chan;
+	struct lttng_ust_ring_buffer_ctx_private *private_ctx;
+	struct lttng_ust_staging_area *staging_area;
+	char *staging;
+	int nesting;
+
+	if (!CMM_LOAD_SHARED(lttng_chan->priv->fragment_recorder))
+		return -ENOSPC;
+	cmm_smp_rmb();
+	staging_area = CMM_LOAD_SHARED(lttng_chan->priv->staging);
+	if (!staging_area || ctx->data_size > staging_area->slot_size)
+		return -ENOSPC;
+	staging = lttng_event_staging_claim(staging_area);
+	if (!staging)
+		return -EBUSY;
+	nesting = lib_ring_buffer_nesting_inc(&client_config);
+	if (nesting < 0) {
+		lttng_event_staging_release(staging_area, staging);
+		return -EPERM;
+	}
+	private_ctx = &URCU_TLS(lttng_ust_client_tls).private_ctx[nesting];
+	memset(private_ctx, 0, sizeof(*private_ctx));
+	private_ctx->pub = ctx;
+	private_ctx->chan = lttng_chan->priv->rb_chan;
+	private_ctx->rflags = LTTNG_RFLAG_STAGED;
+	ctx->priv = private_ctx;
+	URCU_TLS(lttng_ust_client_tls).client_ctx[nesting].staging = staging;
+	return 0;
+}
+
+static
+void lttng_event_stage_write(struct lttng_ust_ring_buffer_ctx *ctx,
+		const void *src, size_t len, size_t alignment)
+{
+	struct lttng_ust_ring_buffer_ctx_private *private_ctx = ctx->priv;
+
+	lttng_ust_ring_buffer_align_ctx(ctx, alignment);
+	if (caa_unlikely(private_ctx->buf_offset + len > ctx->data_size)) {
+		WARN_ON_ONCE(1);
+		return;
+	}
+	memcpy(lttng_event_staging(private_ctx) + private_ctx->buf_offset,
+		src, len);
+	private_ctx->buf_offset += len;
+}
+
+/*
+ * Staged counterpart of lib_ring_buffer_strcpy() when @terminate is
+ * true, and of lib_ring_buffer_pstrcpy() otherwise.
+ */
+static
+void lttng_event_stage_strcpy(struct lttng_ust_ring_buffer_ctx *ctx,
+		const char *src, size_t len, char pad, bool terminate)
+{
+	struct lttng_ust_ring_buffer_ctx_private *private_ctx = ctx->priv;
+	size_t copy_len = terminate ? len - 1 : len, count;
+	char *dst;
+
+	if (caa_unlikely(!len || private_ctx->buf_offset + len > ctx->data_size)) {
+		WARN_ON_ONCE(len);
+		return;
+	}
+	dst = lttng_event_staging(private_ctx) + private_ctx->buf_offset;
+	count = strnlen(src, copy_len);
+	memcpy(dst, src, count);
+	memset(dst + count, pad, copy_len - count);
+	if (terminate)
+		dst[copy_len] = '\0';
+	private_ctx->buf_offset += len;
+}
+
+/*
+ * Account @nr_records records of the event of @ctx which could not be
+ * reserved, in the tracer metrics and in the discards of the event.
+ */
+static inline
+void lttng_event_discard(struct lttng_ust_ring_buffer_ctx *ctx,
+		unsigned int nr_records)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+
+	lttng_ust_metrics_add(LTTNG_UST_METRIC_EVENT_DISCARD, nr_records);
+	lttng_ust_event_discards_add(event_recorder->parent->priv->discard_slot,
+		nr_records);
+}
+
+static
+int lttng_event_reserve(struct lttng_ust_ring_buffer_ctx *ctx)
+{
+	int ret;
+
+	if (caa_unlikely(lttng_event_oversized(ctx)) && !lttng_event_stage(ctx)) {
+		lttng_ust_metrics_inc(LTTNG_UST_METRIC_EVENT_RESERVE);
+		return 0;
+	}
+	ret = lttng_event_reserve_records(ctx, 1);
+	if (caa_unlikely(ret < 0)) {
+		lttng_event_discard(ctx, 1);
+		return ret;
+	}
+	lttng_ust_metrics_inc(LTTNG_UST_METRIC_EVENT_RESERVE);
+	return 0;
+}
+
+/*
+ * Reserve space for up to @nr_records records of the same event, each with
+ * a payload of ctx->data_size bytes, with a single space reservation. Returns
+ * the number of records reserved, which may be lower than @nr_records, or a
+ * negative error value. The header of the first record is written on return.
+ * The header of each following record is written by
+ * lttng_event_reserve_batch_next(). The whole batch is committed by a single
+ * call to lttng_event_commit().
+ */
+static
+int lttng_event_reserve_batch(struct lttng_ust_ring_buffer_ctx *ctx,
+		unsigned int nr_records)
+{
+	int ret;
+
+	if (caa_unlikely(!nr_records))
+		return -EINVAL;
+	ret = lttng_event_reserve_records(ctx, nr_records);
+	if (caa_unlikely(ret < 0))
+		lttng_event_discard(ctx, nr_records);
+	else
+		lttng_ust_metrics_add(LTTNG_UST_METRIC_EVENT_RESERVE, ret);
+	return ret;
+}
+
+/*
+ * Move to the next record of a batch reserved by lttng_event_reserve_batch()
+ * once the payload of the current record has been written.
+ */
+static
+void lttng_event_reserve_batch_next(struct lttng_ust_ring_buffer_ctx *ctx)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+	struct lttng_ust_ring_buffer_ctx_private *private_ctx = ctx->priv;
+	struct lttng_ust_client_tls *tls = &URCU_TLS(lttng_ust_client_tls);
+	struct lttng_client_ctx *client_ctx;
+	size_t pre_header_padding;
+
+	client_ctx = &tls->client_ctx[private_ctx - tls->private_ctx];
+	/* The records of a batch share the time-stamp of the first record. */
+	private_ctx->rflags &= ~RING_BUFFER_RFLAG_FULL_TSC;
+	(void) record_header_size(&client_config, private_ctx->chan,
+			private_ctx->buf_offset, &pre_header_padding,
+			ctx, client_ctx);
+	private_ctx->buf_offset += pre_header_padding;
+	lttng_write_event_header(&client_config, ctx, client_ctx,
+			event_recorder->priv->id);
+}
+
+static inline
+void lttng_fragment_write_field(struct lttng_ust_ring_buffer_ctx *ctx,
+		const void *src, size_t len, size_t alignment)
+{
+	lttng_ust_ring_buffer_align_ctx(ctx, alignment);
+	lib_ring_buffer_write(&client_config, ctx, src, len);
+}
+
+/*
+ * Write the @len bytes of the payload of a staged record as
+ * lttng_ust_fragment:record events, with the field layout of
+ * lttng-ust-fragment-provider.h. The fragments are sized to fit a
+ * sub-buffer, and halved when their reservation finds them too big
+ * anyway because of the channel context fields. They are exempt from
+ * adaptive sampling: a missing fragment voids the whole record.
+ */
+static
+void lttng_event_write_fragments(struct lttng_ust_ring_buffer_ctx *ctx,
+		const char *payload, size_t len)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+	struct lttng_ust_channel_buffer *lttng_chan = event_recorder->chan;
+	struct lttng_ust_event_recorder *fragment_recorder;
+	uint32_t event_id = event_recorder->priv->id, total_len = len;
+	size_t header_len = 0, chunk_len, offset = 0;
+	uint64_t id;
+
+	fragment_recorder = CMM_LOAD_SHARED(lttng_chan->priv->fragment_recorder);
+	if (caa_unlikely(!fragment_recorder)) {
+		lttng_event_discard(ctx, 1);
+		return;
+	}
+	id = uatomic_add_return(&lttng_chan->priv->fragment_id, 1);
+
+	/* id, event_id, total_len, offset, flags and data length fields. */
+	header_len += sizeof(uint64_t);
+	header_len += lttng_ust_ring_buffer_align(header_len, lttng_ust_rb_alignof(uint32_t));
+	header_len += 3 * sizeof(uint32_t) + sizeof(uint8_t);
+	header_len += lttng_ust_ring_buffer_align(header_len, lttng_ust_rb_alignof(uint32_t));
+	header_len += sizeof(uint32_t);
+
+	chunk_len = lttng_chan->priv->rb_chan->backend.subbuf_size
+		- client_packet_header_size() - LTTNG_EVENT_HEADER_MAX_LEN
+		- header_len;
+	while (offset < len) {
+		struct lttng_ust_ring_buffer_ctx fragment_ctx;
+		size_t data_len = len - offset < chunk_len ? len - offset : chunk_len;
+		uint32_t fragment_offset = offset, fragment_len = data_len;
+		uint8_t flags = 0;
+		int ret;
+
+		lttng_ust_ring_buffer_ctx_init(&fragment_ctx, fragment_recorder,
+			header_len + data_len, lttng_ust_rb_alignof(uint64_t),
+			ctx->probe_ctx);
+		ret = _lttng_event_reserve_records(&fragment_ctx, 1,
+			lttng_chan->priv->header_type,
+			lttng_ust_rcu_dereference(lttng_chan->priv->ctx),
+			lttng_ust_rcu_dereference(fragment_recorder->priv->ctx),
+			RING_BUFFER_RFLAG_NO_SAMPLING);
+		if (ret == -ENOSPC && chunk_len > LTTNG_FRAGMENT_MIN_LEN) {
+			chunk_len >>= 1;
+			continue;
+		}
+		if (caa_unlikely(ret < 0)) {
+			/* The fragments already written lack their last one. */
+			lttng_event_discard(ctx, 1);
+			return;
+		}
+		if (offset)
+			flags |= LTTNG_UST_FRAGMENT_FLAG_CONTINUED;
+		if (offset + data_len < len)
+			flags |= LTTNG_UST_FRAGMENT_FLAG_MORE;
+		lttng_fragment_write_field(&fragment_ctx, &id, sizeof(id),
+			lttng_ust_rb_alignof(id));
+		lttng_fragment_write_field(&fragment_ctx, &event_id, sizeof(event_id),
+			lttng_ust_rb_alignof(event_id));
+		lttng_fragment_write_field(&fragment_ctx, &total_len, sizeof(total_len),
+			lttng_ust_rb_alignof(total_len));
+		lttng_fragment_write_field(&fragment_ctx, &fragment_offset,
+			sizeof(fragment_offset), lttng_ust_rb_alignof(fragment_offset));
+		lttng_fragment_write_field(&fragment_ctx, &flags, sizeof(flags),
+			lttng_ust_rb_alignof(flags));
+		lttng_fragment_write_field(&fragment_ctx, &fragment_len,
+			sizeof(fragment_len), lttng_ust_rb_alignof(fragment_len));
+		lttng_fragment_write_field(&fragment_ctx, payload + offset, data_len, 1);
+		lib_ring_buffer_commit(&client_config, &fragment_ctx);
+		lib_ring_buffer_nesting_dec(&client_config);
+		offset += data_len;
+	}
+}
+
+static
+void lttng_event_commit_staged(struct lttng_ust_ring_buffer_ctx *ctx)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+	struct lttng_ust_ring_buffer_ctx_private *private_ctx = ctx->priv;
+	char *staging = lttng_event_staging(private_ctx);
+	size_t len = private_ctx->buf_offset;
+
+	/* The fragments are reserved at the nesting level of the record. */
+	lib_ring_buffer_nesting_dec(&client_config);
+	lttng_event_write_fragments(ctx, staging, len);
+	lttng_event_staging_release(event_recorder->chan->priv->staging, staging);
+}
+
 static
 void lttng_event_commit(struct lttng_ust_ring_buffer_ctx *ctx)
 {
+	if (caa_unlikely(ctx->priv->rflags & LTTNG_RFLAG_STAGED)) {
+		lttng_event_commit_staged(ctx);
+		return;
+	}
 	lib_ring_buffer_commit(&client_config, ctx);
 	lib_ring_buffer_nesting_dec(&client_config);
 }
@@ -744,14 +1365,39 @@ static
 void lttng_event_write(struct lttng_ust_ring_buffer_ctx *ctx,
 		const void *src, size_t len, size_t alignment)
 {
+	if (caa_unlikely(ctx->priv->rflags & LTTNG_RFLAG_STAGED)) {
+		lttng_event_stage_write(ctx, src, len, alignment);
+		return;
+	}
 	lttng_ust_ring_buffer_align_ctx(ctx, alignment);
 	lib_ring_buffer_write(&client_config, ctx, src, len);
 }
 
+/*
+ * Reserve, write and commit a record whose payload is already laid out,
+ * with the client operations inlined.
+ */
+static
+int lttng_event_record(struct lttng_ust_ring_buffer_ctx *ctx, const void *src)
+{
+	int ret;
+
+	ret = lttng_event_reserve(ctx);
+	if (caa_unlikely(ret < 0))
+		return ret;
+	lttng_event_write(ctx, src, ctx->data_size, ctx->largest_align);
+	lttng_event_commit(ctx);
+	return 0;
+}
+
 static
 void lttng_event_strcpy(struct lttng_ust_ring_buffer_ctx *ctx,
 		const char *src, size_t len)
 {
+	if (caa_unlikely(ctx->priv->rflags & LTTNG_RFLAG_STAGED)) {
+		lttng_event_stage_strcpy(ctx, src, len, '#', true);
+		return;
+	}
 	lib_ring_buffer_strcpy(&client_config, ctx, src, len, '#');
 }
 
@@ -759,9 +1405,151 @@ static
 void lttng_event_pstrcpy_pad(struct lttng_ust_ring_buffer_ctx *ctx,
 		const char *src, size_t len)
 {
+	if (caa_unlikely(ctx->priv->rflags & LTTNG_RFLAG_STAGED)) {
+		lttng_event_stage_strcpy(ctx, src, len, '\0', false);
+		return;
+	}
 	lib_ring_buffer_pstrcpy(&client_config, ctx, src, len, '\0');
 }
 
+/*
+ * Interned strings: each stream has a direct-mapped cache of the ids of
+ * the strings held in full by a record of its current packet, keyed by
+ * the id and the sequence number of that packet, so that the following
+ * records of the packet only hold the id, and each packet can be read
+ * on its own. The reservation looks the cache up for the stream and
+ * packet the record ends up in: a record only holds ids if all its
+ * strings are defined there. Each slot also holds a second hash of its
+ * string, and a string whose id collides with the one of another string
+ * defined in the packet is recorded in full with id 0. Slots are
+ * claimed by a single definer at a time; a definer losing the race also
+ * records id 0.
+ */
+#define LTTNG_INTERN_CACHE_SLOTS	256
+#define LTTNG_INTERN_KEY_BUSY		1UL
+
+static inline
+unsigned long lttng_intern_key(uint64_t id, unsigned long packet)
+{
+	unsigned long key;
+
+	key = (unsigned long) (id ^ ((uint64_t) packet * 0x9E3779B97F4A7C15ULL));
+	/* 0 is a free slot, odd keys are busy. */
+	key &= ~LTTNG_INTERN_KEY_BUSY;
+	return key ? key : 2;
+}
+
+static inline
+int lttng_intern_stream(struct lttng_ust_ring_buffer *buf)
+{
+	if (client_config.alloc == RING_BUFFER_ALLOC_GLOBAL)
+		return 0;
+	return buf->backend.cpu;
+}
+
+static
+struct lttng_ust_intern_slot *lttng_intern_cache(struct lttng_ust_channel_buffer *lttng_chan,
+		int stream, bool alloc)
+{
+	struct lttng_ust_channel_buffer_private *chan_priv = lttng_chan->priv;
+	struct lttng_ust_intern_slot *cache, *new_cache;
+
+	if (caa_unlikely(!chan_priv->intern_caches || stream < 0
+			|| (unsigned int) stream >= chan_priv->nr_intern_caches))
+		return NULL;
+	cache = CMM_LOAD_SHARED(chan_priv->intern_caches[stream]);
+	if (caa_likely(cache) || !alloc)
+		return cache;
+	new_cache = zmalloc(LTTNG_INTERN_CACHE_SLOTS * sizeof(*new_cache));
+	if (!new_cache)
+		return NULL;
+	cache = uatomic_cmpxchg(&chan_priv->intern_caches[stream], NULL, new_cache);
+	if (cache) {
+		free(new_cache);
+		return cache;
+	}
+	return new_cache;
+}
+
+/*
+ * Called by record_header_size() for each reservation attempt of a
+ * record beginning at @offset in the stream of ctx->priv->buf: set the
+ * payload size of the record depending on whether that packet holds all
+ * its interned strings.
+ */
+static
+void lttng_intern_reserve(struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_ring_buffer_intern *intern, size_t offset)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+	struct lttng_ust_ring_buffer_ctx_private *private_ctx = ctx->priv;
+	struct lttng_ust_intern_slot *cache;
+	unsigned long packet;
+	unsigned int i;
+
+	intern->interned = 0;
+	ctx->data_size = intern->full_size;
+	cache = lttng_intern_cache(event_recorder->chan,
+			lttng_intern_stream(private_ctx->buf), false);
+	if (!cache)
+		return;
+	packet = offset >> private_ctx->chan->backend.subbuf_size_order;
+	for (i = 0; i < intern->nr_strings; i++) {
+		struct lttng_ust_intern_slot *slot;
+		unsigned long key;
+		uint64_t check;
+
+		slot = &cache[intern->ids[i] % LTTNG_INTERN_CACHE_SLOTS];
+		key = lttng_intern_key(intern->ids[i], packet);
+		if (CMM_LOAD_SHARED(slot->key) != key)
+			return;
+		cmm_smp_rmb();
+		check = CMM_LOAD_SHARED(slot->check);
+		cmm_smp_rmb();
+		if (CMM_LOAD_SHARED(slot->key) != key || check != intern->checks[i])
+			return;
+	}
+	intern->interned = 1;
+	ctx->data_size = intern->interned_size;
+}
+
+static
+uint64_t lttng_event_intern(struct lttng_ust_ring_buffer_ctx *ctx, uint64_t id,
+		uint64_t check)
+{
+	struct lttng_ust_event_recorder *event_recorder = ctx->client_priv;
+	struct lttng_ust_ring_buffer_ctx_private *private_ctx = ctx->priv;
+	struct lttng_ust_intern_slot *cache, *slot;
+	unsigned long packet, key, old;
+
+	/* The fragments of a staged record are not self-contained. */
+	if (caa_unlikely(private_ctx->rflags & LTTNG_RFLAG_STAGED))
+		return 0;
+	cache = lttng_intern_cache(event_recorder->chan,
+			lttng_intern_stream(private_ctx->buf), true);
+	if (caa_unlikely(!cache))
+		return 0;
+	/* The id is not written yet: the write position is within the record. */
+	packet = private_ctx->buf_offset
+		>> private_ctx->chan->backend.subbuf_size_order;
+	key = lttng_intern_key(id, packet);
+	slot = &cache[id % LTTNG_INTERN_CACHE_SLOTS];
+	old = CMM_LOAD_SHARED(slot->key);
+	if (old == key) {
+		/* Already defined in the packet, by this string or another. */
+		cmm_smp_rmb();
+		return CMM_LOAD_SHARED(slot->check) == check ? id : 0;
+	}
+	if (old & LTTNG_INTERN_KEY_BUSY)
+		return 0;
+	if (uatomic_cmpxchg(&slot->key, old, LTTNG_INTERN_KEY_BUSY) != old)
+		return 0;
+	CMM_STORE_SHARED(slot->check, check);
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(slot->key, key);
+	return id;
+}
+
 static
 int lttng_is_finalized(struct lttng_ust_channel_buffer *chan)
 {
@@ -817,6 +1605,10 @@ static struct lttng_transport lttng_relay_transport = {
 		.event_write = lttng_event_write,
 		.event_strcpy = lttng_event_strcpy,
 		.event_pstrcpy_pad = lttng_event_pstrcpy_pad,
+		.event_reserve_batch = lttng_event_reserve_batch,
+		.event_reserve_batch_next = lttng_event_reserve_batch_next,
+		.event_record = lttng_event_record,
+		.event_intern = lttng_event_intern,
 	},
 	.client_config = &client_config,
 };
@@ -13,6 +13,7 @@
 #define _LTTNG_RING_BUFFER_BACKEND_H
 
 #include <stddef.h>
+#include <string.h>
 #include <unistd.h>
 
 /* Internal helpers */
@@ -51,6 +52,35 @@ lib_ring_buffer_read_offset_address(struct lttng_ust_ring_buffer_backend *bufb,
 				    struct lttng_ust_shm_handle *handle)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Address of buffer offset @offset for the writer of context @ctx. For
+ * RING_BUFFER_VMAP buffers, it derives from the offset alone; other
+ * backends look up the pages of the sub-buffer being written.
+ */
+static inline
+void *lib_ring_buffer_write_address(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer_ctx *ctx, size_t offset)
+	__attribute__((always_inline));
+static inline
+void *lib_ring_buffer_write_address(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer_ctx *ctx, size_t offset)
+{
+	struct lttng_ust_ring_buffer_ctx_private *ctx_private = ctx->priv;
+	struct channel_backend *chanb = &ctx_private->chan->backend;
+	struct lttng_ust_shm_handle *handle = ctx_private->chan->handle;
+	struct lttng_ust_ring_buffer_backend_pages *backend_pages;
+
+	if (config->backend == RING_BUFFER_VMAP)
+		return lib_ring_buffer_vmap_address(&ctx_private->buf->backend,
+				chanb, offset, handle);
+	backend_pages = lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
+	if (caa_unlikely(!backend_pages)) {
+		if (lib_ring_buffer_backend_get_pages(config, ctx, &backend_pages))
+			return NULL;
+	}
+	return shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
+}
+
 /**
  * lib_ring_buffer_write - write data to a buffer backend
  * @config : ring buffer instance configuration
@@ -60,8 +90,8 @@ lib_ring_buffer_read_offset_address(struct lttng_ust_ring_buffer_backend *bufb,
  *
  * This function copies "len" bytes of data from a source pointer to a buffer
  * backend, at the current context offset. This is more or less a buffer
- * backend-specific memcpy() operation. Calls the slow path (_ring_buffer_write)
- * if copy is crossing a page boundary.
+ * backend-specific memcpy() operation. Copies of at least
+ * LIB_RING_BUFFER_NT_COPY_MIN bytes bypass the writer cache.
  */
 static inline
 void lib_ring_buffer_write(const struct lttng_ust_ring_buffer_config *config,
@@ -75,9 +105,7 @@ void lib_ring_buffer_write(const struct lttng_ust_ring_buffer_config *config,
 {
 	struct lttng_ust_ring_buffer_ctx_private *ctx_private = ctx->priv;
 	struct channel_backend *chanb = &ctx_private->chan->backend;
-	struct lttng_ust_shm_handle *handle = ctx_private->chan->handle;
 	size_t offset = ctx_private->buf_offset;
-	struct lttng_ust_ring_buffer_backend_pages *backend_pages;
 	void *p;
 
 	if (caa_unlikely(!len))
@@ -87,15 +115,13 @@ void lib_ring_buffer_write(const struct lttng_ust_ring_buffer_config *config,
 	 * subbuffers.
 	 */
 	CHAN_WARN_ON(chanb, (offset & (chanb->buf_size - 1)) + len > chanb->buf_size);
-	backend_pages = lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	if (caa_unlikely(!backend_pages)) {
-		if (lib_ring_buffer_backend_get_pages(config, ctx, &backend_pages))
-			return;
-	}
-	p = shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
+	p = lib_ring_buffer_write_address(config, ctx, offset);
 	if (caa_unlikely(!p))
 		return;
-	lib_ring_buffer_do_copy(config, p, src, len);
+	if (caa_unlikely(len >= LIB_RING_BUFFER_NT_COPY_MIN))
+		lib_ring_buffer_do_copy_nt(p, src, len);
+	else
+		lib_ring_buffer_do_copy(config, p, src, len);
 	ctx_private->buf_offset += len;
 }
 
@@ -144,6 +170,11 @@ size_t lib_ring_buffer_do_strcpy(
  * buffer backend-specific strncpy() operation. If a terminating '\0'
  * character is found in @src before @len - 1 characters are copied, pad
  * the buffer with @pad characters (e.g. '#').
+ *
+ * @len is the string length computed when sizing the record, so the
+ * string is copied in a single pass, then the copy is scanned for a
+ * '\0' written concurrently in @src, which would end the string before
+ * the end of the space reserved.
  */
 static inline
 void lib_ring_buffer_strcpy(const struct lttng_ust_ring_buffer_config *config,
@@ -157,11 +188,8 @@ void lib_ring_buffer_strcpy(const struct lttng_ust_ring_buffer_config *config,
 {
 	struct lttng_ust_ring_buffer_ctx_private *ctx_private = ctx->priv;
 	struct channel_backend *chanb = &ctx_private->chan->backend;
-	struct lttng_ust_shm_handle *handle = ctx_private->chan->handle;
-	size_t count;
 	size_t offset = ctx_private->buf_offset;
-	struct lttng_ust_ring_buffer_backend_pages *backend_pages;
-	void *p;
+	char *p, *end;
 
 	if (caa_unlikely(!len))
 		return;
@@ -170,32 +198,22 @@ void lib_ring_buffer_strcpy(const struct lttng_ust_ring_buffer_config *config,
 	 * subbuffers.
 	 */
 	CHAN_WARN_ON(chanb, (offset & (chanb->buf_size - 1)) + len > chanb->buf_size);
-	backend_pages = lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	if (caa_unlikely(!backend_pages)) {
-		if (lib_ring_buffer_backend_get_pages(config, ctx, &backend_pages))
-			return;
-	}
-	p = shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
+	p = lib_ring_buffer_write_address(config, ctx, offset);
 	if (caa_unlikely(!p))
 		return;
 
-	count = lib_ring_buffer_do_strcpy(config, p, src, len - 1);
-	offset += count;
+	/*
+	 * Strings are usually longer than the word-sized copies inlined by
+	 * lib_ring_buffer_do_copy(): use the architecture-specific memcpy
+	 * and memchr.
+	 */
+	memcpy(p, src, len - 1);
 	/* Padding */
-	if (caa_unlikely(count < len - 1)) {
-		size_t pad_len = len - 1 - count;
-
-		p = shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
-		if (caa_unlikely(!p))
-			return;
-		lib_ring_buffer_do_memset(p, pad, pad_len);
-		offset += pad_len;
-	}
+	end = memchr(p, '\0', len - 1);
+	if (caa_unlikely(end))
+		lib_ring_buffer_do_memset(end, pad, len - 1 - (end - p));
 	/* Final '\0' */
-	p = shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
-	if (caa_unlikely(!p))
-		return;
-	lib_ring_buffer_do_memset(p, '\0', 1);
+	p[len - 1] = '\0';
 	ctx_private->buf_offset += len;
 }
 
@@ -227,10 +245,8 @@ void lib_ring_buffer_pstrcpy(const struct lttng_ust_ring_buffer_config *config,
 {
 	struct lttng_ust_ring_buffer_ctx_private *ctx_private = ctx->priv;
 	struct channel_backend *chanb = &ctx_private->chan->backend;
-	struct lttng_ust_shm_handle *handle = ctx_private->chan->handle;
 	size_t count;
 	size_t offset = ctx_private->buf_offset;
-	struct lttng_ust_ring_buffer_backend_pages *backend_pages;
 	void *p;
 
 	if (caa_unlikely(!len))
@@ -240,12 +256,7 @@ void lib_ring_buffer_pstrcpy(const struct lttng_ust_ring_buffer_config *config,
 	 * subbuffers.
 	 */
 	CHAN_WARN_ON(chanb, (offset & (chanb->buf_size - 1)) + len > chanb->buf_size);
-	backend_pages = lib_ring_buffer_get_backend_pages_from_ctx(config, ctx);
-	if (caa_unlikely(!backend_pages)) {
-		if (lib_ring_buffer_backend_get_pages(config, ctx, &backend_pages))
-			return;
-	}
-	p = shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
+	p = lib_ring_buffer_write_address(config, ctx, offset);
 	if (caa_unlikely(!p))
 		return;
 
@@ -255,7 +266,7 @@ void lib_ring_buffer_pstrcpy(const struct lttng_ust_ring_buffer_config *config,
 	if (caa_unlikely(count < len)) {
 		size_t pad_len = len - count;
 
-		p = shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
+		p = lib_ring_buffer_write_address(config, ctx, offset);
 		if (caa_unlikely(!p))
 			return;
 		lib_ring_buffer_do_memset(p, pad, pad_len);
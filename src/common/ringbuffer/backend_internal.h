@@ -239,6 +239,38 @@ int lib_ring_buffer_backend_get_pages(const struct lttng_ust_ring_buffer_config
 	return 0;
 }
 
+/*
+ * Address of buffer offset @offset in a RING_BUFFER_VMAP buffer, where the
+ * sub-buffers sit in order in the memory map.
+ */
+static inline
+void *lib_ring_buffer_vmap_address(struct lttng_ust_ring_buffer_backend *bufb,
+		struct channel_backend *chanb, size_t offset,
+		struct lttng_ust_shm_handle *handle)
+{
+	return shmp_index(handle, bufb->memory_map,
+			offset & (chanb->buf_size - 1));
+}
+
+/*
+ * Address of offset @offset within the sub-buffer held by the reader of a
+ * RING_BUFFER_VMAP buffer. As with the other backends, the sub-buffer is
+ * the one of buf_rsb: only the offset within the sub-buffer is used.
+ */
+static inline
+void *lib_ring_buffer_vmap_read_address(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer_backend *bufb,
+		struct channel_backend *chanb, size_t offset,
+		struct lttng_ust_shm_handle *handle)
+{
+	unsigned long sb_bindex;
+
+	sb_bindex = subbuffer_id_get_index(config, bufb->buf_rsb.id);
+	return lib_ring_buffer_vmap_address(bufb, chanb,
+			(sb_bindex << chanb->subbuf_size_order)
+			+ (offset & (chanb->subbuf_size - 1)), handle);
+}
+
 /* Get backend pages from cache. */
 static inline
 struct lttng_ust_ring_buffer_backend_pages *
@@ -635,6 +667,22 @@ do {								\
 		lttng_inline_memcpy(dest, src, __len);		\
 } while (0)
 
+/*
+ * Writes of at least LIB_RING_BUFFER_NT_COPY_MIN bytes use non-temporal
+ * stores where available: the consumer reads them much later from another
+ * cpu, and bringing them in the writer cache would only evict application
+ * data.
+ */
+#define LIB_RING_BUFFER_NT_COPY_MIN	2048
+
+/*
+ * Copy @len bytes with non-temporal stores, ordered before the stores
+ * following the copy. Falls back on memcpy on architectures without
+ * non-temporal stores.
+ */
+void lib_ring_buffer_do_copy_nt(void *dest, const void *src, size_t len)
+	__attribute__((visibility("hidden")));
+
 /*
  * write len bytes to dest with c
  */
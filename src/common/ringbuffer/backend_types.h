@@ -21,7 +21,8 @@ struct lttng_ust_ring_buffer_backend_pages {
 	union v_atomic records_unread;	/* records to read */
 	unsigned long data_size;	/* Amount of data to read from subbuf */
 	DECLARE_SHMP(char, p);		/* Backing memory map */
-	char padding[RB_BACKEND_PAGES_PADDING];
+	int populated;			/* Lazy allocation: pages allocated */
+	char padding[RB_BACKEND_PAGES_PADDING - sizeof(int)];
 };
 
 struct lttng_ust_ring_buffer_backend_subbuffer {
@@ -91,7 +92,17 @@ struct channel_backend {
 	DECLARE_SHMP(void *, priv_data);/* Client-specific information */
 	struct lttng_ust_ring_buffer_config config; /* Ring buffer configuration */
 	char name[NAME_MAX];		/* Channel name */
-	char padding[RB_BACKEND_CHANNEL_PADDING];
+	unsigned long subbuf_fill_limit;/*
+					 * Switch to the next sub-buffer once
+					 * a record would fill the current one
+					 * past this size (<= subbuf_size).
+					 */
+	int lazy_alloc;			/*
+					 * Sub-buffers populated by the writers
+					 * entering them.
+					 */
+	char padding[RB_BACKEND_CHANNEL_PADDING - sizeof(unsigned long)
+		- sizeof(int)];
 	struct lttng_ust_ring_buffer_shmp buf[];
 };
 
@@ -11,6 +11,7 @@
 #ifndef _LTTNG_RING_BUFFER_FRONTEND_H
 #define _LTTNG_RING_BUFFER_FRONTEND_H
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -51,6 +52,7 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_ring_buffer_c
 				unsigned int switch_timer_interval,
 				unsigned int read_timer_interval,
 				const int *stream_fds, int nr_stream_fds,
+				unsigned int nr_streams,
 				int64_t blocking_timeout)
 	__attribute__((visibility("hidden")));
 
@@ -71,9 +73,12 @@ void channel_destroy(struct lttng_ust_ring_buffer_channel *chan,
  * barrier in cpu hotplug. It orders the cpumask read before read of per-cpu
  * buffer data. The per-cpu buffer is never removed by cpu hotplug; teardown is
  * only performed at channel destruction.
+ *
+ * Iterates on the streams of the channel, which are fewer than the possible
+ * cpus for channels restricted to the cpus of the process affinity mask.
  */
 #define for_each_channel_cpu(cpu, chan)					\
-	for_each_possible_cpu(cpu)
+	for ((cpu) = 0; (cpu) < (int) (chan)->nr_streams; (cpu)++)
 
 extern struct lttng_ust_ring_buffer *channel_get_ring_buffer(
 				const struct lttng_ust_ring_buffer_config *config,
@@ -115,10 +120,47 @@ extern int lib_ring_buffer_open_read(struct lttng_ust_ring_buffer *buf,
 				     struct lttng_ust_shm_handle *handle)
 	__attribute__((visibility("hidden")));
 
+extern void lib_ring_buffer_resume_read(struct lttng_ust_ring_buffer *buf,
+				 struct lttng_ust_shm_handle *handle,
+				 unsigned long *checkpoint,
+				 unsigned long *held)
+	__attribute__((visibility("hidden")));
+
 extern void lib_ring_buffer_release_read(struct lttng_ust_ring_buffer *buf,
 					 struct lttng_ust_shm_handle *handle)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Share a single time-stamp between the records reserved by the current
+ * thread until the matching lib_ring_buffer_tsc_share_end(), for records
+ * describing a single instant. A record reuses the time-stamp of the
+ * previous record reserved by the thread in the same buffer only if no
+ * other record was reserved in between, which keeps time-stamps monotonic
+ * within each buffer. Sections can nest.
+ *
+ * Records from a signal handler interrupting the section between two
+ * records may also get the time-stamp of the previous record.
+ */
+void lib_ring_buffer_tsc_share_begin(void)
+	__attribute__((visibility("hidden")));
+
+void lib_ring_buffer_tsc_share_end(void)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Let the records reserved by the current thread until the matching
+ * lib_ring_buffer_nesting_reserve_end() use the last ring buffer
+ * nesting level, which is otherwise kept free, and never block waiting
+ * for the consumer. Used by the async-signal-safe record path, so it
+ * can still record from a signal handler interrupting the tracer at its
+ * maximum nesting. Sections can nest.
+ */
+void lib_ring_buffer_nesting_reserve_begin(void)
+	__attribute__((visibility("hidden")));
+
+void lib_ring_buffer_nesting_reserve_end(void)
+	__attribute__((visibility("hidden")));
+
 /*
  * Initialize signals for ring buffer. Should be called early e.g. by
  * main() in the program to affect all threads.
@@ -157,11 +199,48 @@ extern void lib_ring_buffer_put_subbuf(struct lttng_ust_ring_buffer *buf,
 	__attribute__((visibility("hidden")));
 
 /*
- * lib_ring_buffer_get_next_subbuf/lib_ring_buffer_put_next_subbuf are helpers
- * to read sub-buffers sequentially.
+ * Return 1 if the sub-buffer at the consumer position is fully committed
+ * and is not the one the writer head is in, 0 otherwise. Unordered with
+ * respect to the writers: a hint only, get_subbuf has the final word.
  */
-static inline int lib_ring_buffer_get_next_subbuf(struct lttng_ust_ring_buffer *buf,
-						  struct lttng_ust_shm_handle *handle)
+extern int lib_ring_buffer_poll_deliver(const struct lttng_ust_ring_buffer_config *config,
+					struct lttng_ust_ring_buffer *buf,
+					struct lttng_ust_ring_buffer_channel *chan,
+					struct lttng_ust_shm_handle *handle)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Freeze the overwrite-mode streams of the process, keeping the history
+ * they hold for a later snapshot. Each stream is frozen by the first
+ * writer which would move to a new sub-buffer, hence overwrite its
+ * oldest records: the current sub-buffer is filled, the following
+ * records are lost. Lock-free and async-signal-safe.
+ */
+extern void lib_ring_buffer_freeze_all(void)
+	__attribute__((visibility("hidden")));
+
+/* Let the writers of a frozen stream overwrite its history again. */
+static inline
+void lib_ring_buffer_thaw(struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	if (ext)
+		CMM_STORE_SHARED(ext->frozen, 0);
+}
+
+static inline
+int lib_ring_buffer_is_frozen(struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	return ext ? CMM_LOAD_SHARED(ext->frozen) : 0;
+}
+
+static inline int _lib_ring_buffer_get_next_subbuf(struct lttng_ust_ring_buffer *buf,
+						   struct lttng_ust_shm_handle *handle)
 {
 	int ret;
 
@@ -173,6 +252,36 @@ static inline int lib_ring_buffer_get_next_subbuf(struct lttng_ust_ring_buffer *
 	return ret;
 }
 
+/*
+ * lib_ring_buffer_get_next_subbuf/lib_ring_buffer_put_next_subbuf are helpers
+ * to read sub-buffers sequentially.
+ *
+ * The reader is flagged awake while it gets sub-buffers, so the writers
+ * delivering sub-buffers skip the wakeup. Finding the buffer empty, the
+ * reader clears the flag before checking the buffer again: a sub-buffer
+ * delivered meanwhile is either seen here, or by a writer which saw the
+ * flag cleared and wakes the reader up (see
+ * lib_ring_buffer_consumer_awake()).
+ */
+static inline int lib_ring_buffer_get_next_subbuf(struct lttng_ust_ring_buffer *buf,
+						  struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+	int ret;
+
+	ret = _lib_ring_buffer_get_next_subbuf(buf, handle);
+	if (!ext)
+		return ret;
+	if (ret == -EAGAIN && CMM_LOAD_SHARED(ext->consumer_awake)) {
+		CMM_STORE_SHARED(ext->consumer_awake, 0);
+		cmm_smp_mb();
+		ret = _lib_ring_buffer_get_next_subbuf(buf, handle);
+	}
+	if (!ret && !CMM_LOAD_SHARED(ext->consumer_awake))
+		CMM_STORE_SHARED(ext->consumer_awake, 1);
+	return ret;
+}
+
 static inline
 void lib_ring_buffer_put_next_subbuf(struct lttng_ust_ring_buffer *buf,
 				     struct lttng_ust_shm_handle *handle)
@@ -187,6 +296,47 @@ void lib_ring_buffer_put_next_subbuf(struct lttng_ust_ring_buffer *buf,
 			handle);
 }
 
+/*
+ * Sub-buffer read iterator, for consumers sharing the address space of
+ * the buffers. It walks the readable sub-buffers of a stream in order
+ * and exposes each of them in place, without copy. No lock is taken:
+ * exclusion between readers only relies on lib_ring_buffer_open_read(),
+ * which must be held by the iterator user, and sub-buffer ownership is
+ * exchanged with the writers through the usual get/put operations.
+ */
+struct lttng_ust_ring_buffer_iter {
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_shm_handle *handle;
+	int held;			/* A sub-buffer is held by the iterator */
+	const char *data;		/* Start of the sub-buffer held */
+	unsigned long data_size;	/* Content size of the sub-buffer held */
+};
+
+extern void lib_ring_buffer_iter_init(struct lttng_ust_ring_buffer_iter *iter,
+				      struct lttng_ust_ring_buffer *buf,
+				      struct lttng_ust_shm_handle *handle)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Release the sub-buffer held, if any, and move to the next readable one.
+ * Returns 0 on success, -EAGAIN if no sub-buffer is ready yet, -ENODATA
+ * if the buffer is finalized and fully consumed.
+ */
+extern int lib_ring_buffer_iter_next(struct lttng_ust_ring_buffer_iter *iter)
+	__attribute__((visibility("hidden")));
+
+extern void lib_ring_buffer_iter_fini(struct lttng_ust_ring_buffer_iter *iter)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Whether the streams of the per-cpu channel @chan each hold the records
+ * written on their cpu only, which is then the cpu_id of their packet
+ * context: 0 when the channel has fewer streams than possible cpus,
+ * or when records are spilled into the streams of other cpus.
+ */
+extern int lib_ring_buffer_streams_match_cpus(const struct lttng_ust_ring_buffer_channel *chan)
+	__attribute__((visibility("hidden")));
+
 extern void channel_reset(struct lttng_ust_ring_buffer_channel *chan)
 	__attribute__((visibility("hidden")));
 
@@ -287,6 +437,34 @@ unsigned long lib_ring_buffer_get_records_lost_big(
 	return ctx->priv->records_lost_big;
 }
 
+static inline
+unsigned long lib_ring_buffer_get_records_sampled(
+				const struct lttng_ust_ring_buffer_config *config __attribute__((unused)),
+				const struct lttng_ust_ring_buffer_ctx *ctx)
+{
+	return ctx->priv->records_sampled;
+}
+
+/*
+ * Number of records sampled out in the stream at the end of the
+ * sub-buffer held by the reader. Sampling only applies to discard mode,
+ * so the writers do not reuse that sub-buffer until it is released.
+ */
+static inline
+uint64_t lib_ring_buffer_get_subbuf_records_sampled(
+				struct lttng_ust_ring_buffer *buf,
+				struct lttng_ust_ring_buffer_channel *chan,
+				struct lttng_ust_shm_handle *handle)
+{
+	struct commit_counters_cold *cc_cold;
+
+	cc_cold = shmp_index(handle, buf->commit_cold,
+			subbuf_index(buf->get_subbuf_consumed, chan));
+	if (!cc_cold)
+		return 0;
+	return CMM_LOAD_SHARED(cc_cold->records_sampled);
+}
+
 static inline
 unsigned long lib_ring_buffer_get_records_read(
 				const struct lttng_ust_ring_buffer_config *config,
@@ -295,4 +473,88 @@ unsigned long lib_ring_buffer_get_records_read(
 	return v_read(config, &buf->backend.records_read);
 }
 
+/*
+ * Backpressure statistics: how often and how long writers were held back
+ * by the consumer, the buffer fill level they observed, how often they
+ * went through the reserve slow path or retried a reservation, and the
+ * number of sub-buffer switches. They read 0 for streams without
+ * extended state.
+ */
+static inline
+unsigned long lib_ring_buffer_get_full_count(
+				const struct lttng_ust_ring_buffer_config *config,
+				struct lttng_ust_ring_buffer *buf,
+				struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	return ext ? v_read(config, &ext->full_count) : 0;
+}
+
+static inline
+unsigned long lib_ring_buffer_get_blocked_retries(
+				const struct lttng_ust_ring_buffer_config *config,
+				struct lttng_ust_ring_buffer *buf,
+				struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	return ext ? v_read(config, &ext->blocked_retries) : 0;
+}
+
+static inline
+unsigned long lib_ring_buffer_get_blocked_ms(
+				const struct lttng_ust_ring_buffer_config *config,
+				struct lttng_ust_ring_buffer *buf,
+				struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	return ext ? v_read(config, &ext->blocked_ms) : 0;
+}
+
+static inline
+unsigned long lib_ring_buffer_get_max_fill(
+				const struct lttng_ust_ring_buffer_config *config,
+				struct lttng_ust_ring_buffer *buf,
+				struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	return ext ? v_read(config, &ext->max_fill) : 0;
+}
+
+static inline
+unsigned long lib_ring_buffer_get_slow_path_count(
+				const struct lttng_ust_ring_buffer_config *config,
+				struct lttng_ust_ring_buffer *buf,
+				struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	return ext ? v_read(config, &ext->slow_path_count) : 0;
+}
+
+static inline
+unsigned long lib_ring_buffer_get_reserve_retries(
+				const struct lttng_ust_ring_buffer_config *config,
+				struct lttng_ust_ring_buffer *buf,
+				struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	return ext ? v_read(config, &ext->reserve_retries) : 0;
+}
+
+static inline
+unsigned long lib_ring_buffer_get_switch_count(
+				const struct lttng_ust_ring_buffer_config *config,
+				struct lttng_ust_ring_buffer *buf,
+				struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	return ext ? v_read(config, &ext->switch_count) : 0;
+}
+
 #endif /* _LTTNG_RING_BUFFER_FRONTEND_H */
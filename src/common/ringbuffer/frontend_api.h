@@ -11,20 +11,76 @@
 #ifndef _LTTNG_RING_BUFFER_FRONTEND_API_H
 #define _LTTNG_RING_BUFFER_FRONTEND_API_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <urcu/compiler.h>
 
 #include "common/getcpu.h"
 #include "frontend.h"
 
+/**
+ * lib_ring_buffer_get_cpu - Current cpu.
+ * @config: ring buffer instance configuration.
+ */
+static inline
+int lib_ring_buffer_get_cpu(const struct lttng_ust_ring_buffer_config *config __attribute__((unused)))
+{
+	return lttng_ust_get_cpu();
+}
+
+/**
+ * lib_ring_buffer_get_thread_cpu - Buffer index of the current thread.
+ *
+ * Used by RING_BUFFER_ALLOC_PER_THREAD channels. The first call within a
+ * thread binds it to the buffer of the cpu it is running on; later calls
+ * return the same index without querying the cpu id.
+ */
+static inline
+int lib_ring_buffer_get_thread_cpu(void)
+{
+	unsigned int cpu_plus_one;
+
+	cpu_plus_one = URCU_TLS(lib_ring_buffer_thread_cpu);
+	if (caa_unlikely(!cpu_plus_one))
+		return lib_ring_buffer_thread_cpu_bind();
+	return (int) cpu_plus_one - 1;
+}
+
+/**
+ * lib_ring_buffer_get_stream - Stream index of a cpu.
+ * @chan: channel.
+ * @cpu: cpu id, or buffer index of the current thread.
+ *
+ * Channels created with fewer streams than possible cpus hold one stream
+ * per cpu of the process affinity mask: map each cpu to its rank within
+ * that mask. The cpus outside of it, if the affinity changed since, are
+ * folded onto the existing streams. Several cpus may then share a stream,
+ * which the global synchronization of the clients allows.
+ */
+static inline
+int lib_ring_buffer_get_stream(const struct lttng_ust_ring_buffer_channel *chan,
+		int cpu)
+{
+	int rank;
+
+	if (caa_likely(chan->nr_streams == (unsigned int) num_possible_cpus()))
+		return cpu;
+	rank = affinity_cpu_rank(cpu);
+	if (rank < 0)
+		rank = cpu;
+	return (unsigned int) rank % chan->nr_streams;
+}
+
 /**
  * lib_ring_buffer_nesting_inc - Ring buffer recursive use protection.
  *
  * The rint buffer buffer nesting count is a safety net to ensure tracer
  * client code will never trigger an endless recursion.
  * Returns a nesting level >= 0 on success, -EPERM on failure (nesting
- * count too high).
+ * count too high). The last nesting level is only available within
+ * lib_ring_buffer_nesting_reserve_begin/end() sections.
  *
  * asm volatile and "memory" clobber prevent the compiler from moving
  * instructions out of the ring buffer nesting count. This is required to ensure
@@ -40,7 +96,9 @@ int lib_ring_buffer_nesting_inc(
 
 	nesting = ++URCU_TLS(lib_ring_buffer_nesting);
 	cmm_barrier();
-	if (caa_unlikely(nesting >= LIB_RING_BUFFER_MAX_NESTING)) {
+	if (caa_unlikely(nesting >= LIB_RING_BUFFER_MAX_NESTING)
+			&& (nesting > LIB_RING_BUFFER_MAX_NESTING
+				|| !URCU_TLS(lib_ring_buffer_nesting_reserve))) {
 		WARN_ON_ONCE(1);
 		URCU_TLS(lib_ring_buffer_nesting)--;
 		return -EPERM;
@@ -63,6 +121,56 @@ void lib_ring_buffer_nesting_dec(
 	URCU_TLS(lib_ring_buffer_nesting)--;		/* TLS */
 }
 
+/*
+ * Read the time-stamp of a record starting at @offset in @buf. Within a
+ * lib_ring_buffer_tsc_share_begin/end() section, reuse the time-stamp of
+ * the previous record of the thread if it ends at @offset: no record was
+ * reserved in between, so the time-stamps of the buffer stay monotonic.
+ */
+static inline
+uint64_t lib_ring_buffer_tsc_read(struct lttng_ust_ring_buffer_channel *chan,
+		const struct lttng_ust_ring_buffer *buf, unsigned long offset)
+{
+	struct lib_ring_buffer_tsc_share *share = &URCU_TLS(lib_ring_buffer_tsc_share);
+
+	if (caa_unlikely(share->depth)) {
+		unsigned int i;
+
+		for (i = 0; i < LIB_RING_BUFFER_TSC_SHARE_BUFS; i++) {
+			if (share->last[i].buf == buf
+					&& share->last[i].offset == offset)
+				return share->last[i].tsc;
+		}
+	}
+	return lib_ring_buffer_clock_read(chan);
+}
+
+/*
+ * Remember the end of the record just reserved in @buf, and its
+ * time-stamp, for the next record of the section.
+ */
+static inline
+void lib_ring_buffer_tsc_save(const struct lttng_ust_ring_buffer *buf,
+		unsigned long offset, uint64_t tsc)
+{
+	struct lib_ring_buffer_tsc_share *share = &URCU_TLS(lib_ring_buffer_tsc_share);
+	unsigned int i;
+
+	if (caa_likely(!share->depth))
+		return;
+	for (i = 0; i < LIB_RING_BUFFER_TSC_SHARE_BUFS; i++) {
+		if (share->last[i].buf == buf)
+			break;
+	}
+	if (i == LIB_RING_BUFFER_TSC_SHARE_BUFS) {
+		i = share->next;
+		share->next = (i + 1) % LIB_RING_BUFFER_TSC_SHARE_BUFS;
+		share->last[i].buf = buf;
+	}
+	share->last[i].offset = offset;
+	share->last[i].tsc = tsc;
+}
+
 /*
  * lib_ring_buffer_try_reserve is called by lib_ring_buffer_reserve(). It is not
  * part of the API per se.
@@ -82,7 +190,7 @@ int lib_ring_buffer_try_reserve(const struct lttng_ust_ring_buffer_config *confi
 	*o_begin = v_read(config, &buf->offset);
 	*o_old = *o_begin;
 
-	ctx_private->tsc = lib_ring_buffer_clock_read(chan);
+	ctx_private->tsc = lib_ring_buffer_tsc_read(chan, buf, *o_begin);
 	if ((int64_t) ctx_private->tsc == -EIO)
 		return 1;
 
@@ -93,7 +201,8 @@ int lib_ring_buffer_try_reserve(const struct lttng_ust_ring_buffer_config *confi
 	 */
 	//prefetch(&buf->commit_hot[subbuf_index(*o_begin, chan)]);
 
-	if (last_tsc_overflow(config, buf, ctx_private->tsc))
+	if (last_tsc_overflow(config, buf, ctx_private->tsc,
+			lib_ring_buffer_ctx_tsc_bits(config, ctx_private)))
 		ctx_private->rflags |= RING_BUFFER_RFLAG_FULL_TSC;
 
 	if (caa_unlikely(subbuf_offset(*o_begin, chan) == 0))
@@ -105,7 +214,7 @@ int lib_ring_buffer_try_reserve(const struct lttng_ust_ring_buffer_config *confi
 		lttng_ust_ring_buffer_align(*o_begin + ctx_private->slot_size,
 				      ctx->largest_align) + ctx->data_size;
 	if (caa_unlikely((subbuf_offset(*o_begin, chan) + ctx_private->slot_size)
-		     > chan->backend.subbuf_size))
+		     > subbuf_fill_limit(chan)))
 		return 1;
 
 	/*
@@ -124,6 +233,30 @@ int lib_ring_buffer_try_reserve(const struct lttng_ust_ring_buffer_config *confi
 	return 0;
 }
 
+/*
+ * Adaptive sampling decision for a record reserved in the buffer of
+ * extended state @ext: returns true if it is dropped. A per-thread
+ * xorshift generator picks the records kept, so that they are not
+ * correlated with periodic event patterns.
+ */
+static inline
+bool lib_ring_buffer_sample_out(struct lttng_ust_ring_buffer_ext *ext)
+{
+	int shift = CMM_LOAD_SHARED(ext->sample_shift);
+	uint32_t x;
+
+	if (caa_likely(!shift))
+		return false;
+	x = URCU_TLS(lib_ring_buffer_sample_state);
+	if (caa_unlikely(!x))
+		x = (uint32_t) (uintptr_t) &URCU_TLS(lib_ring_buffer_sample_state) | 1;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	URCU_TLS(lib_ring_buffer_sample_state) = x;
+	return (x & ((1U << shift) - 1)) != 0;
+}
+
 /**
  * lib_ring_buffer_reserve - Reserve space in a ring buffer.
  * @config: ring buffer instance configuration.
@@ -134,7 +267,7 @@ int lib_ring_buffer_try_reserve(const struct lttng_ust_ring_buffer_config *confi
  *
  * Return :
  *  0 on success.
- * -EAGAIN if channel is disabled.
+ * -EAGAIN if channel is disabled or the record is sampled out.
  * -ENOSPC if event size is too large for packet.
  * -ENOBUFS if there is currently not enough space in buffer for the event.
  * -EIO if data cannot be written into the buffer for any other reason.
@@ -156,7 +289,13 @@ int lib_ring_buffer_reserve(const struct lttng_ust_ring_buffer_config *config,
 		return -EAGAIN;
 
 	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
-		ctx_private->reserve_cpu = lttng_ust_get_cpu();
+		ctx_private->cpu = lib_ring_buffer_get_cpu(config);
+		ctx_private->reserve_cpu = lib_ring_buffer_get_stream(chan,
+				ctx_private->cpu);
+		buf = shmp(handle, chan->backend.buf[ctx_private->reserve_cpu].shmp);
+	} else if (config->alloc == RING_BUFFER_ALLOC_PER_THREAD) {
+		ctx_private->reserve_cpu = lib_ring_buffer_get_stream(chan,
+				lib_ring_buffer_get_thread_cpu());
 		buf = shmp(handle, chan->backend.buf[ctx_private->reserve_cpu].shmp);
 	} else {
 		buf = shmp(handle, chan->backend.buf[0].shmp);
@@ -165,6 +304,18 @@ int lib_ring_buffer_reserve(const struct lttng_ust_ring_buffer_config *config,
 		return -EIO;
 	if (caa_unlikely(uatomic_read(&buf->record_disabled)))
 		return -EAGAIN;
+	/* Records never sampled out do not draw. */
+	if (config->mode == RING_BUFFER_DISCARD
+			&& config->alloc != RING_BUFFER_ALLOC_GLOBAL
+			&& !(ctx_private->rflags & RING_BUFFER_RFLAG_NO_SAMPLING)) {
+		struct lttng_ust_ring_buffer_ext *ext;
+
+		ext = lib_ring_buffer_get_ext(buf, handle);
+		if (caa_unlikely(ext && lib_ring_buffer_sample_out(ext))) {
+			v_inc(config, &ext->records_sampled);
+			return -EAGAIN;
+		}
+	}
 	ctx_private->buf = buf;
 
 	/*
@@ -185,6 +336,7 @@ int lib_ring_buffer_reserve(const struct lttng_ust_ring_buffer_config *config,
 	 * when it would be needed).
 	 */
 	save_last_tsc(config, buf, ctx_private->tsc);
+	lib_ring_buffer_tsc_save(buf, o_end, ctx_private->tsc);
 
 	/*
 	 * Push the reader if necessary
@@ -204,6 +356,137 @@ slow_path:
 	return lib_ring_buffer_reserve_slow(ctx, client_ctx);
 }
 
+/**
+ * lib_ring_buffer_reserve_batch - Reserve space for many records at once.
+ * @config: ring buffer instance configuration.
+ * @ctx: ring buffer context. (input and output) Must be already initialized.
+ * @client_ctx: client context passed to record_header_size().
+ * @nr_records: number of records of "data_size" payload bytes to reserve.
+ *
+ * Reserve contiguous space for up to @nr_records records with a single
+ * update of the write offset. All records of the batch share the time-stamp
+ * of the first record, and only the first record can require a full TSC
+ * record header. The reserved space starts at the context "pre_offset" and
+ * its length is "slot_size", which covers all the records of the batch. A
+ * single lib_ring_buffer_commit() commits the whole batch once all records
+ * have been written.
+ *
+ * The batch never spans more than the current sub-buffer: only the records
+ * fitting in the current sub-buffer are reserved. If not even a single record
+ * can be reserved on the fast path, fall back on the slow path to reserve a
+ * single record.
+ *
+ * Return :
+ *  the number of records reserved (>= 1) on success.
+ *  the negative error values of lib_ring_buffer_reserve() on error.
+ */
+static inline
+int lib_ring_buffer_reserve_batch(const struct lttng_ust_ring_buffer_config *config,
+				  struct lttng_ust_ring_buffer_ctx *ctx,
+				  void *client_ctx, unsigned int nr_records)
+{
+	struct lttng_ust_ring_buffer_ctx_private *ctx_private = ctx->priv;
+	struct lttng_ust_ring_buffer_channel *chan = ctx_private->chan;
+	struct lttng_ust_shm_handle *handle = chan->handle;
+	struct lttng_ust_ring_buffer *buf;
+	unsigned long o_begin, o_end, o_old;
+	unsigned int first_rflags, nr_reserved;
+	size_t before_hdr_pad = 0;
+	int ret;
+
+	if (caa_unlikely(uatomic_read(&chan->record_disabled)))
+		return -EAGAIN;
+
+	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+		ctx_private->cpu = lib_ring_buffer_get_cpu(config);
+		ctx_private->reserve_cpu = lib_ring_buffer_get_stream(chan,
+				ctx_private->cpu);
+		buf = shmp(handle, chan->backend.buf[ctx_private->reserve_cpu].shmp);
+	} else if (config->alloc == RING_BUFFER_ALLOC_PER_THREAD) {
+		ctx_private->reserve_cpu = lib_ring_buffer_get_stream(chan,
+				lib_ring_buffer_get_thread_cpu());
+		buf = shmp(handle, chan->backend.buf[ctx_private->reserve_cpu].shmp);
+	} else {
+		buf = shmp(handle, chan->backend.buf[0].shmp);
+	}
+	if (caa_unlikely(!buf))
+		return -EIO;
+	if (caa_unlikely(uatomic_read(&buf->record_disabled)))
+		return -EAGAIN;
+	ctx_private->buf = buf;
+
+	o_begin = v_read(config, &buf->offset);
+	o_old = o_begin;
+
+	ctx_private->tsc = lib_ring_buffer_tsc_read(chan, buf, o_begin);
+	if ((int64_t) ctx_private->tsc == -EIO)
+		goto slow_path;
+
+	if (last_tsc_overflow(config, buf, ctx_private->tsc,
+			lib_ring_buffer_ctx_tsc_bits(config, ctx_private)))
+		ctx_private->rflags |= RING_BUFFER_RFLAG_FULL_TSC;
+	first_rflags = ctx_private->rflags;
+
+	if (caa_unlikely(subbuf_offset(o_begin, chan) == 0))
+		goto slow_path;
+
+	o_end = o_begin;
+	for (nr_reserved = 0; nr_reserved < nr_records; nr_reserved++) {
+		size_t pre_header_padding, slot_size;
+
+		slot_size = record_header_size(config, chan, o_end,
+					&pre_header_padding, ctx, client_ctx);
+		slot_size += lttng_ust_ring_buffer_align(o_end + slot_size,
+					ctx->largest_align) + ctx->data_size;
+		/*
+		 * Stop before a record which does not fit in the current
+		 * sub-buffer or ends on its boundary.
+		 */
+		if ((subbuf_offset(o_end, chan) + slot_size)
+				>= subbuf_fill_limit(chan))
+			break;
+		if (!nr_reserved)
+			before_hdr_pad = pre_header_padding;
+		o_end += slot_size;
+		/* Following records share the first record time-stamp. */
+		ctx_private->rflags &= ~RING_BUFFER_RFLAG_FULL_TSC;
+	}
+	ctx_private->rflags = first_rflags;
+	if (caa_unlikely(!nr_reserved))
+		goto slow_path;
+
+	if (caa_unlikely(v_cmpxchg(config, &buf->offset, o_old, o_end)
+		     != o_old))
+		goto slow_path;
+
+	/*
+	 * Atomically update last_tsc. See lib_ring_buffer_reserve().
+	 */
+	save_last_tsc(config, buf, ctx_private->tsc);
+	lib_ring_buffer_tsc_save(buf, o_end, ctx_private->tsc);
+
+	/*
+	 * Push the reader if necessary
+	 */
+	lib_ring_buffer_reserve_push_reader(buf, chan, o_end - 1);
+
+	/*
+	 * Clear noref flag for this subbuffer.
+	 */
+	lib_ring_buffer_clear_noref(config, &buf->backend,
+				subbuf_index(o_end - 1, chan), handle);
+
+	ctx_private->slot_size = o_end - o_begin;
+	ctx_private->pre_offset = o_begin;
+	ctx_private->buf_offset = o_begin + before_hdr_pad;
+	return nr_reserved;
+slow_path:
+	ret = lib_ring_buffer_reserve_slow(ctx, client_ctx);
+	if (ret)
+		return ret;
+	return 1;
+}
+
 /**
  * lib_ring_buffer_switch - Perform a sub-buffer switch for a per-cpu buffer.
  * @config: ring buffer instance configuration.
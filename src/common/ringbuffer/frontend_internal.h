@@ -84,6 +84,49 @@ unsigned long subbuf_index(unsigned long offset,
 	return buf_offset(offset, chan) >> chan->backend.subbuf_size_order;
 }
 
+/*
+ * subbuf_fill_limit returns the sub-buffer fill level past which writers
+ * switch to the next sub-buffer. It may be lowered by the consumer at any
+ * time, so it is only a hint for the reserve paths.
+ */
+static inline
+unsigned long subbuf_fill_limit(struct lttng_ust_ring_buffer_channel *chan)
+{
+	return CMM_LOAD_SHARED(chan->backend.subbuf_fill_limit);
+}
+
+/*
+ * lib_ring_buffer_get_ext returns the extended state of a stream, or NULL
+ * if the stream was created by a version which does not allocate it.
+ */
+static inline
+struct lttng_ust_ring_buffer_ext *lib_ring_buffer_get_ext(struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_shm_handle *handle)
+{
+	if (caa_unlikely(CMM_LOAD_SHARED(buf->ext_size)
+			< sizeof(struct lttng_ust_ring_buffer_ext)))
+		return NULL;
+	return shmp(handle, buf->ext);
+}
+
+/*
+ * Whether the reader of a buffer is draining it, and will find the
+ * sub-buffers delivered by the writers without being woken up. Orders
+ * the delivery of the sub-buffer before the read of the flag, see
+ * lib_ring_buffer_get_next_subbuf().
+ */
+static inline
+int lib_ring_buffer_consumer_awake(struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	if (!ext)
+		return 0;
+	cmm_smp_mb();
+	return CMM_LOAD_SHARED(ext->consumer_awake);
+}
+
 /*
  * Last TSC comparison functions. Check if the current TSC overflows tsc_bits
  * bits from the last TSC read. When overflows are detected, the full 64-bit
@@ -107,7 +150,8 @@ void save_last_tsc(const struct lttng_ust_ring_buffer_config *config,
 
 static inline
 int last_tsc_overflow(const struct lttng_ust_ring_buffer_config *config,
-		      struct lttng_ust_ring_buffer *buf, uint64_t tsc)
+		      struct lttng_ust_ring_buffer *buf, uint64_t tsc,
+		      unsigned int tsc_bits __attribute__((unused)))
 {
 	unsigned long tsc_shifted;
 
@@ -134,19 +178,39 @@ void save_last_tsc(const struct lttng_ust_ring_buffer_config *config,
 
 static inline
 int last_tsc_overflow(const struct lttng_ust_ring_buffer_config *config,
-		      struct lttng_ust_ring_buffer *buf, uint64_t tsc)
+		      struct lttng_ust_ring_buffer *buf, uint64_t tsc,
+		      unsigned int tsc_bits)
 {
 	if (config->tsc_bits == 0 || config->tsc_bits == 64)
 		return 0;
 
 	if (caa_unlikely((tsc - v_read(config, &buf->last_tsc))
-		     >> config->tsc_bits))
+		     >> tsc_bits))
 		return 1;
 	else
 		return 0;
 }
 #endif
 
+/*
+ * Number of timestamp bits the record header being reserved can hold.
+ * Clients may use a header with more bits than config->tsc_bits, e.g. one
+ * header layout per channel, in which case the full timestamp is only
+ * needed when the delta from the last timestamp overflows those bits.
+ * Where last_tsc is saved shifted by config->tsc_bits (32-bit), it has to
+ * be used for all records.
+ */
+static inline
+unsigned int lib_ring_buffer_ctx_tsc_bits(const struct lttng_ust_ring_buffer_config *config,
+		const struct lttng_ust_ring_buffer_ctx_private *ctx_private)
+{
+#if (CAA_BITS_PER_LONG == 64)
+	if (ctx_private->tsc_bits)
+		return ctx_private->tsc_bits;
+#endif
+	return config->tsc_bits;
+}
+
 extern
 int lib_ring_buffer_reserve_slow(struct lttng_ust_ring_buffer_ctx *ctx,
 		void *client_ctx)
@@ -364,4 +428,43 @@ extern void lib_ring_buffer_free(struct lttng_ust_ring_buffer *buf,
 extern DECLARE_URCU_TLS(unsigned int, lib_ring_buffer_nesting)
 	__attribute__((visibility("hidden")));
 
+/* Depth of lib_ring_buffer_nesting_reserve_begin/end() sections. */
+extern DECLARE_URCU_TLS(unsigned int, lib_ring_buffer_nesting_reserve)
+	__attribute__((visibility("hidden")));
+
+#define LIB_RING_BUFFER_TSC_SHARE_BUFS	4
+
+/*
+ * Time-stamp sharing state of the current thread, see
+ * lib_ring_buffer_tsc_share_begin(). Remembers, for the last buffers
+ * written to, where the last record reserved by the thread ends and its
+ * time-stamp.
+ */
+struct lib_ring_buffer_tsc_share {
+	unsigned int depth;
+	unsigned int next;
+	struct {
+		const struct lttng_ust_ring_buffer *buf;
+		unsigned long offset;
+		uint64_t tsc;
+	} last[LIB_RING_BUFFER_TSC_SHARE_BUFS];
+};
+
+extern DECLARE_URCU_TLS(struct lib_ring_buffer_tsc_share, lib_ring_buffer_tsc_share)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Buffer index (plus one) bound to the current thread for
+ * RING_BUFFER_ALLOC_PER_THREAD channels, 0 if not bound yet.
+ */
+extern DECLARE_URCU_TLS(unsigned int, lib_ring_buffer_thread_cpu)
+	__attribute__((visibility("hidden")));
+
+extern int lib_ring_buffer_thread_cpu_bind(void)
+	__attribute__((visibility("hidden")));
+
+/* Pseudo-random state of the adaptive sampling of the current thread. */
+extern DECLARE_URCU_TLS(uint32_t, lib_ring_buffer_sample_state)
+	__attribute__((visibility("hidden")));
+
 #endif /* _LTTNG_RING_BUFFER_FRONTEND_INTERNAL_H */
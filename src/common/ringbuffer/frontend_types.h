@@ -26,6 +26,10 @@
 #include "shm_types.h"
 #include "vatomic.h"
 
+/*
+ * Number of per-thread nesting levels, the last one being kept for
+ * lib_ring_buffer_nesting_reserve_begin/end() sections.
+ */
 #define LIB_RING_BUFFER_MAX_NESTING	5
 
 /*
@@ -34,6 +38,12 @@
  */
 enum switch_mode { SWITCH_ACTIVE, SWITCH_FLUSH };
 
+/* Channel timer: POSIX timer id, or timerfd when available. */
+union lttng_ust_ring_buffer_timer {
+	timer_t id;
+	int fd;
+};
+
 /* channel: collection of per-cpu ring buffers. */
 #define RB_CHANNEL_PADDING		32
 struct lttng_ust_ring_buffer_channel {
@@ -46,11 +56,11 @@ struct lttng_ust_ring_buffer_channel {
 						 */
 
 	unsigned long switch_timer_interval;	/* Buffer flush (us) */
-	timer_t switch_timer;
+	union lttng_ust_ring_buffer_timer switch_timer;
 	int switch_timer_enabled;
 
 	unsigned long read_timer_interval;	/* Reader wakeup (us) */
-	timer_t read_timer;
+	union lttng_ust_ring_buffer_timer read_timer;
 	int read_timer_enabled;
 
 	int finalized;				/* Has channel been finalized */
@@ -62,6 +72,7 @@ struct lttng_ust_ring_buffer_channel {
 		struct {
 			int32_t blocking_timeout_ms;
 			void *priv;		/* Private data pointer. */
+			unsigned long switch_timer_cur_interval;	/* Adaptive switch timer (us) */
 		} s;
 		char padding[RB_CHANNEL_PADDING];
 	} u;
@@ -81,9 +92,13 @@ struct commit_counters_hot {
 } __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
 /* Per-subbuffer commit counters used only on cold paths */
-#define RB_COMMIT_COUNT_COLD_PADDING	24
+#define RB_COMMIT_COUNT_COLD_PADDING	16
 struct commit_counters_cold {
 	union v_atomic cc_sb;		/* Incremented _once_ at sb switch */
+	uint64_t records_sampled;	/*
+					 * Records sampled out in the stream
+					 * at the end of the sub-buffer
+					 */
 	char padding[RB_COMMIT_COUNT_COLD_PADDING];
 } __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
@@ -165,6 +180,85 @@ struct lttng_crash_abi {
 	uint32_t mode;		/* Buffer mode: 0: overwrite, 1: discard */
 } __attribute__((packed));
 
+/*
+ * Stream state added after the layout of struct lttng_ust_ring_buffer was
+ * fixed by the shared memory ABI between lttng-ust-ctl and applications.
+ *
+ * It is allocated in the stream shm object by whichever side creates the
+ * stream, which stores its size in the ext_size field of struct
+ * lttng_ust_ring_buffer. Streams created by a version which predates it
+ * have a zero ext_size, and the features relying on these fields are then
+ * disabled (see lib_ring_buffer_get_ext()). New fields are appended.
+ *
+ * Fields written by the writers, statistics and fields written by the
+ * reader side are on separate cachelines.
+ */
+struct lttng_ust_ring_buffer_ext {
+	/* Writer cacheline */
+	int sample_shift;		/*
+					 * Adaptive sampling: keep one record
+					 * out of 2^sample_shift, see
+					 * LTTNG_UST_RB_SAMPLING_THRESHOLD
+					 */
+	int frozen;			/*
+					 * Overwrite mode: writers lose their
+					 * records rather than start a new
+					 * sub-buffer. Cleared by the consumer.
+					 */
+	unsigned long freeze_seq;	/*
+					 * Last freeze request applied by the
+					 * writers, see
+					 * lib_ring_buffer_freeze_all()
+					 */
+
+	/* Statistics cacheline: written by writers, read by the consumer. */
+	union v_atomic __attribute__((aligned(CAA_CACHE_LINE_SIZE))) records_sampled;
+					/* Sampled out under backpressure */
+	union v_atomic full_count;	/* Writer found the buffer full */
+	union v_atomic blocked_retries;	/* Writer blocking retries */
+	union v_atomic blocked_ms;	/* Writer time spent blocked (ms) */
+	union v_atomic max_fill;	/*
+					 * Largest unconsumed data size seen
+					 * at sub-buffer switch (bytes)
+					 */
+	union v_atomic slow_path_count;	/* Reservations through the slow path */
+	union v_atomic reserve_retries;	/*
+					 * Slow path reservations retried after
+					 * a concurrent update of the offset
+					 */
+	union v_atomic switch_count;	/* Sub-buffers closed by a switch */
+
+	/* Consumer cacheline: written by the reader side. */
+	int32_t __attribute__((aligned(CAA_CACHE_LINE_SIZE))) consumer_futex;
+					/*
+					 * -1 when writers wait for the
+					 * consumer, standard atomic access
+					 * (shared)
+					 */
+	int reclaim_state;		/*
+					 * Idle time (ms) or RB_RECLAIM_*
+					 * standard atomic access (shared)
+					 */
+	unsigned long checkpoint;	/*
+					 * Consumed position reached by the
+					 * reader itself, unlike writer pushes
+					 * in overwrite mode (shared)
+					 */
+	unsigned long reclaim_pos;	/*
+					 * Write offset seen idle by the
+					 * switch timer
+					 */
+	unsigned long timer_pos;	/*
+					 * Write offset after the last flush
+					 * by the switch timer
+					 */
+	int consumer_awake;		/*
+					 * Set while the reader drains the
+					 * buffer: writers skip the wakeup
+					 * (shared)
+					 */
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
 struct lttng_ust_ring_buffer {
 	/* First 32 bytes are for the buffer crash dump ABI */
 	struct lttng_crash_abi crash_abi;
@@ -222,9 +316,22 @@ struct lttng_ust_ring_buffer {
 	unsigned int get_subbuf:1;	/* Sub-buffer being held by reader */
 	/* shmp pointer to self */
 	DECLARE_SHMP(struct lttng_ust_ring_buffer, self);
-	char padding[RB_RING_BUFFER_PADDING];
+	/* Fields below are carved out of the padding: keep sizeof stable. */
+	DECLARE_SHMP(struct lttng_ust_ring_buffer_ext, ext);
+					/* Extended stream state */
+	unsigned long ext_size;		/*
+					 * Size of the extended stream state,
+					 * 0 if the stream has none
+					 */
+	char padding[RB_RING_BUFFER_PADDING - sizeof(struct shm_ref)
+			- sizeof(unsigned long)];
 } __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
 
+/* Idle buffer memory reclamation states (reclaim_state). */
+#define RB_RECLAIM_BUSY		-1	/* Releasing memory */
+#define RB_RECLAIM_DONE		-2	/* Memory released */
+#define RB_RECLAIM_ABORT	-3	/* Release aborted by a writer */
+
 /*
  * ring buffer private context
  *
@@ -240,9 +347,17 @@ struct lttng_ust_ring_buffer_ctx_private {
 	/* input received by lib_ring_buffer_reserve(). */
 	struct lttng_ust_ring_buffer_ctx *pub;
 	struct lttng_ust_ring_buffer_channel *chan; /* channel */
+	unsigned int tsc_bits;			/*
+						 * Timestamp bits of the record
+						 * header, config->tsc_bits if 0.
+						 */
 
 	/* output from lib_ring_buffer_reserve() */
-	int reserve_cpu;			/* processor id updated by the reserve */
+	int reserve_cpu;			/* stream index updated by the reserve */
+	int cpu;				/*
+						 * processor id queried by the
+						 * reserve of per-cpu buffers
+						 */
 	size_t slot_size;			/* size of the reserved slot */
 	unsigned long buf_offset;		/* offset following the record header */
 	unsigned long pre_offset;		/*
@@ -266,6 +381,7 @@ struct lttng_ust_ring_buffer_ctx_private {
 	unsigned long records_lost_full;
 	unsigned long records_lost_wrap;
 	unsigned long records_lost_big;
+	unsigned long records_sampled;
 };
 
 static inline
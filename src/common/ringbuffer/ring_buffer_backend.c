@@ -7,13 +7,19 @@
 #define _LGPL_SOURCE
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 #include <urcu/arch.h>
 #include <limits.h>
 
+#include <lttng/ust-arch.h>
 #include <lttng/ust-utils.h>
 #include <lttng/ust-ringbuffer-context.h>
 
+#if defined(LTTNG_UST_ARCH_AMD64)
+#include <emmintrin.h>
+#endif
+
 #include "ringbuffer-config.h"
 #include "vatomic.h"
 #include "backend.h"
@@ -75,6 +81,21 @@ int lib_ring_buffer_backend_allocate(const struct lttng_ust_ring_buffer_config *
 	if (caa_unlikely(!shmp(handle, bufb->memory_map)))
 		goto memory_map_error;
 
+	/*
+	 * The sub-buffers of lazily allocated streams are populated by the
+	 * writers as they enter them: only populate the control structures
+	 * laid out around them.
+	 */
+	if (chanb->lazy_alloc) {
+		char *data = (char *) shmp(handle, bufb->memory_map);
+		char *data_end = data + subbuf_size * num_subbuf_alloc;
+		char *map_end = shmobj->memory_map + shmobj->memory_map_size;
+
+		if (shm_populate(shmobj->memory_map, data - shmobj->memory_map)
+				|| shm_populate(data_end, map_end - data_end))
+			goto memory_map_error;
+	}
+
 	/* Allocate backend pages array elements */
 	for (i = 0; i < num_subbuf_alloc; i++) {
 		align_shm(shmobj, __alignof__(struct lttng_ust_ring_buffer_backend_pages));
@@ -302,6 +323,8 @@ int channel_backend_init(struct channel_backend *chanb,
 
 	chanb->buf_size = num_subbuf * subbuf_size;
 	chanb->subbuf_size = subbuf_size;
+	chanb->subbuf_fill_limit = subbuf_size;
+	chanb->lazy_alloc = shm_lazy_alloc_enabled();
 	chanb->buf_size_order = get_count_order(chanb->buf_size);
 	chanb->subbuf_size_order = get_count_order(subbuf_size);
 	chanb->num_subbuf_order = get_count_order(num_subbuf);
@@ -322,6 +345,9 @@ int channel_backend_init(struct channel_backend *chanb,
 	/* Sampled timestamp end */
 	shmsize += lttng_ust_offset_align(shmsize, __alignof__(uint64_t));
 	shmsize += sizeof(uint64_t) * num_subbuf;
+	/* Extended stream state */
+	shmsize += lttng_ust_offset_align(shmsize, __alignof__(struct lttng_ust_ring_buffer_ext));
+	shmsize += sizeof(struct lttng_ust_ring_buffer_ext);
 
 	/* Per-cpu buffer size: backend */
 	/* num_subbuf + 1 is the worse case */
@@ -337,12 +363,13 @@ int channel_backend_init(struct channel_backend *chanb,
 	shmsize += lttng_ust_offset_align(shmsize, __alignof__(struct lttng_ust_ring_buffer_backend_counts));
 	shmsize += sizeof(struct lttng_ust_ring_buffer_backend_counts) * num_subbuf;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
 		struct lttng_ust_ring_buffer *buf;
 		/*
-		 * We need to allocate for all possible cpus.
+		 * Allocate one buffer per stream: per possible cpu, or
+		 * per cpu of the process affinity mask.
 		 */
-		for_each_possible_cpu(i) {
+		for (i = 0; i < chan->nr_streams; i++) {
 			struct shm_object *shmobj;
 
 			shmobj = shm_object_table_alloc(handle->table, shmsize,
@@ -431,6 +458,14 @@ size_t lib_ring_buffer_read(struct lttng_ust_ring_buffer_backend *bufb, size_t o
 
 	if (caa_unlikely(!len))
 		return 0;
+	if (config->backend == RING_BUFFER_VMAP) {
+		src = lib_ring_buffer_vmap_read_address(config, bufb, chanb,
+				offset, handle);
+		if (caa_unlikely(!src))
+			return 0;
+		memcpy(dest, src, len);
+		return orig_len;
+	}
 	id = bufb->buf_rsb.id;
 	sb_bindex = subbuffer_id_get_index(config, id);
 	rpages = shmp_index(handle, bufb->array, sb_bindex);
@@ -483,6 +518,11 @@ int lib_ring_buffer_read_cstr(struct lttng_ust_ring_buffer_backend *bufb, size_t
 		return -EINVAL;
 	offset &= chanb->buf_size - 1;
 	orig_offset = offset;
+	if (config->backend == RING_BUFFER_VMAP) {
+		str = lib_ring_buffer_vmap_read_address(config, bufb, chanb,
+				offset, handle);
+		goto copy;
+	}
 	id = bufb->buf_rsb.id;
 	sb_bindex = subbuffer_id_get_index(config, id);
 	rpages = shmp_index(handle, bufb->array, sb_bindex);
@@ -499,6 +539,7 @@ int lib_ring_buffer_read_cstr(struct lttng_ust_ring_buffer_backend *bufb, size_t
 	if (!backend_pages)
 		return -EINVAL;
 	str = shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
+copy:
 	if (caa_unlikely(!str))
 		return -EINVAL;
 	string_len = strnlen(str, len);
@@ -535,6 +576,9 @@ void *lib_ring_buffer_read_offset_address(struct lttng_ust_ring_buffer_backend *
 		return NULL;
 	config = &chanb->config;
 	offset &= chanb->buf_size - 1;
+	if (config->backend == RING_BUFFER_VMAP)
+		return lib_ring_buffer_vmap_read_address(config, bufb, chanb,
+				offset, handle);
 	id = bufb->buf_rsb.id;
 	sb_bindex = subbuffer_id_get_index(config, id);
 	rpages = shmp_index(handle, bufb->array, sb_bindex);
@@ -575,6 +619,8 @@ void *lib_ring_buffer_offset_address(struct lttng_ust_ring_buffer_backend *bufb,
 		return NULL;
 	config = &chanb->config;
 	offset &= chanb->buf_size - 1;
+	if (config->backend == RING_BUFFER_VMAP)
+		return lib_ring_buffer_vmap_address(bufb, chanb, offset, handle);
 	sbidx = offset >> chanb->subbuf_size_order;
 	sb = shmp_index(handle, bufb->buf_wsb, sbidx);
 	if (!sb)
@@ -591,3 +637,78 @@ void *lib_ring_buffer_offset_address(struct lttng_ust_ring_buffer_backend *bufb,
 		return NULL;
 	return shmp_index(handle, backend_pages->p, offset & (chanb->subbuf_size - 1));
 }
+
+#if defined(LTTNG_UST_ARCH_AMD64)
+
+void lib_ring_buffer_do_copy_nt(void *dest, const void *src, size_t len)
+{
+	char *d = dest;
+	const char *s = src;
+	size_t head;
+
+	/* Streaming stores need a 16-byte aligned destination. */
+	head = -(uintptr_t) d & 15;
+	if (head > len)
+		head = len;
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+	for (; len >= 64; d += 64, s += 64, len -= 64) {
+		__m128i v0, v1, v2, v3;
+
+		v0 = _mm_loadu_si128((const __m128i *) s);
+		v1 = _mm_loadu_si128((const __m128i *) (s + 16));
+		v2 = _mm_loadu_si128((const __m128i *) (s + 32));
+		v3 = _mm_loadu_si128((const __m128i *) (s + 48));
+		_mm_stream_si128((__m128i *) d, v0);
+		_mm_stream_si128((__m128i *) (d + 16), v1);
+		_mm_stream_si128((__m128i *) (d + 32), v2);
+		_mm_stream_si128((__m128i *) (d + 48), v3);
+	}
+	memcpy(d, s, len);
+	/*
+	 * Streaming stores are weakly ordered: order them before the
+	 * commit making the record visible to the consumer.
+	 */
+	_mm_sfence();
+}
+
+#elif defined(LTTNG_UST_ARCH_AARCH64)
+
+void lib_ring_buffer_do_copy_nt(void *dest, const void *src, size_t len)
+{
+	char *d = dest;
+	const char *s = src;
+	size_t head;
+
+	head = -(uintptr_t) d & 15;
+	if (head > len)
+		head = len;
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+	for (; len >= 16; d += 16, s += 16, len -= 16) {
+		uint64_t lo, hi;
+
+		memcpy(&lo, s, sizeof(lo));
+		memcpy(&hi, s + 8, sizeof(hi));
+		__asm__ __volatile__ ("stnp %1, %2, [%0]"
+			: : "r" (d), "r" (lo), "r" (hi) : "memory");
+	}
+	memcpy(d, s, len);
+	/*
+	 * Non-temporal stores are ordered by the barrier of the commit
+	 * which follows the copy.
+	 */
+}
+
+#else
+
+void lib_ring_buffer_do_copy_nt(void *dest, const void *src, size_t len)
+{
+	memcpy(dest, src, len);
+}
+
+#endif
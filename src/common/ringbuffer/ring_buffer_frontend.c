@@ -50,11 +50,26 @@
 #include <urcu/ref.h>
 #include <urcu/tls-compat.h>
 #include <poll.h>
+#include <limits.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+#if defined(HAVE_SYS_TIMERFD_H) && defined(HAVE_SYS_EPOLL_H)
+#define LTTNG_UST_RB_TIMERFD
+#endif
+#ifdef LTTNG_UST_RB_TIMERFD
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 #include "common/macros.h"
 
 #include <lttng/ust-utils.h>
 #include <lttng/ust-ringbuffer-context.h>
 
+#include "common/getcpu.h"
+#include "common/getenv.h"
+#include "common/metrics.h"
 #include "common/smp.h"
 #include "ringbuffer-config.h"
 #include "vatomic.h"
@@ -71,7 +86,10 @@
 #define LTTNG_UST_RB_SIG_READ		SIGRTMIN + 1
 #define LTTNG_UST_RB_SIG_TEARDOWN	SIGRTMIN + 2
 #define CLOCKID		CLOCK_MONOTONIC
+#define LTTNG_UST_RB_SWITCH_TIMER_BACKOFF_LIMIT	64
+#define LTTNG_UST_RB_SPILL_STREAMS_LIMIT	16
 #define LTTNG_UST_RING_BUFFER_GET_RETRY		10
+#define LTTNG_UST_RING_BUFFER_SAMPLE_RETRY	10
 #define LTTNG_UST_RING_BUFFER_RETRY_DELAY_MS	10
 #define RETRY_DELAY_MS				100	/* 100 ms. */
 
@@ -109,6 +127,10 @@ struct switch_offsets {
 };
 
 DEFINE_URCU_TLS(unsigned int, lib_ring_buffer_nesting);
+DEFINE_URCU_TLS(unsigned int, lib_ring_buffer_nesting_reserve);
+DEFINE_URCU_TLS(unsigned int, lib_ring_buffer_thread_cpu);
+DEFINE_URCU_TLS(struct lib_ring_buffer_tsc_share, lib_ring_buffer_tsc_share);
+DEFINE_URCU_TLS(uint32_t, lib_ring_buffer_sample_state);
 
 /*
  * wakeup_fd_mutex protects wakeup fd use by timer from concurrent
@@ -123,22 +145,35 @@ void lib_ring_buffer_print_errors(struct lttng_ust_ring_buffer_channel *chan,
 
 /*
  * Handle timer teardown race wrt memory free of private data by
- * ring buffer signals are handled by a single thread, which permits
- * a synchronization point between handling of each signal.
+ * ring buffer timers are handled by a single thread, which permits
+ * a synchronization point between handling of each timer expiration.
  * Protected by the lock within the structure.
+ *
+ * With LTTNG_UST_RB_TIMERFD, each channel timer is a timerfd polled by
+ * the timer thread through epoll, and a pipe is used to wake it up for
+ * teardown synchronization. Otherwise, POSIX timers deliver real-time
+ * signals which are handled synchronously by the timer thread.
  */
-struct timer_signal_data {
-	pthread_t tid;	/* thread id managing signals */
+struct timer_thread_data {
+	pthread_t tid;	/* thread id managing timers */
 	int setup_done;
 	int qs_done;
 	pthread_mutex_t lock;
+#ifdef LTTNG_UST_RB_TIMERFD
+	int epoll_fd;
+	int teardown_pipe[2];
+#endif
 };
 
-static struct timer_signal_data timer_signal = {
+static struct timer_thread_data timer_thread = {
 	.tid = 0,
 	.setup_done = 0,
 	.qs_done = 0,
 	.lock = PTHREAD_MUTEX_INITIALIZER,
+#ifdef LTTNG_UST_RB_TIMERFD
+	.epoll_fd = -1,
+	.teardown_pipe = { -1, -1 },
+#endif
 };
 
 static bool lttng_ust_allow_blocking;
@@ -151,7 +186,8 @@ void lttng_ust_ringbuffer_set_allow_blocking(void)
 /* Get blocking timeout, in ms */
 static int lttng_ust_ringbuffer_get_timeout(struct lttng_ust_ring_buffer_channel *chan)
 {
-	if (!lttng_ust_allow_blocking)
+	if (!lttng_ust_allow_blocking
+			|| URCU_TLS(lib_ring_buffer_nesting_reserve))
 		return 0;
 	return chan->u.s.blocking_timeout_ms;
 }
@@ -170,6 +206,7 @@ void lib_ring_buffer_reset(struct lttng_ust_ring_buffer *buf,
 {
 	struct lttng_ust_ring_buffer_channel *chan;
 	const struct lttng_ust_ring_buffer_config *config;
+	struct lttng_ust_ring_buffer_ext *ext;
 	unsigned int i;
 
 	chan = shmp(handle, buf->backend.chan);
@@ -198,6 +235,7 @@ void lib_ring_buffer_reset(struct lttng_ust_ring_buffer *buf,
 		v_set(config, &cc_hot->cc, 0);
 		v_set(config, &cc_hot->seq, 0);
 		v_set(config, &cc_cold->cc_sb, 0);
+		cc_cold->records_sampled = 0;
 		*ts_end = 0;
 	}
 	uatomic_set(&buf->consumed, 0);
@@ -210,6 +248,18 @@ void lib_ring_buffer_reset(struct lttng_ust_ring_buffer *buf,
 	v_set(config, &buf->records_lost_big, 0);
 	v_set(config, &buf->records_count, 0);
 	v_set(config, &buf->records_overrun, 0);
+	ext = lib_ring_buffer_get_ext(buf, handle);
+	if (ext) {
+		CMM_STORE_SHARED(ext->sample_shift, 0);
+		v_set(config, &ext->records_sampled, 0);
+		v_set(config, &ext->full_count, 0);
+		v_set(config, &ext->blocked_retries, 0);
+		v_set(config, &ext->blocked_ms, 0);
+		v_set(config, &ext->max_fill, 0);
+		v_set(config, &ext->slow_path_count, 0);
+		v_set(config, &ext->reserve_retries, 0);
+		v_set(config, &ext->switch_count, 0);
+	}
 	buf->finalized = 0;
 }
 
@@ -324,6 +374,48 @@ void init_crash_abi(const struct lttng_ust_ring_buffer_config *config,
 	}
 }
 
+/*
+ * Populate the pages of the sub-buffer holding write offset @offset in a
+ * lazily allocated stream, before a writer enters it. Failing to
+ * allocate them, the writer drops its record rather than take a SIGBUS
+ * when first touching them.
+ *
+ * Returns 0 on success, -1 on allocation failure.
+ */
+static
+int lib_ring_buffer_populate_subbuf(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_ring_buffer_channel *chan,
+		unsigned long offset,
+		struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_backend *bufb = &buf->backend;
+	struct lttng_ust_ring_buffer_backend_subbuffer *wsb;
+	struct lttng_ust_ring_buffer_backend_pages_shmp *sbp;
+	struct lttng_ust_ring_buffer_backend_pages *pages;
+	char *p;
+
+	if (caa_likely(!chan->backend.lazy_alloc))
+		return 0;
+	wsb = shmp_index(handle, bufb->buf_wsb, subbuf_index(offset, chan));
+	if (!wsb)
+		return -1;
+	sbp = shmp_index(handle, bufb->array,
+			subbuffer_id_get_index(config, wsb->id));
+	if (!sbp)
+		return -1;
+	pages = shmp(handle, sbp->shmp);
+	if (!pages)
+		return -1;
+	if (caa_likely(CMM_LOAD_SHARED(pages->populated)))
+		return 0;
+	p = shmp_index(handle, pages->p, 0);
+	if (!p || shm_populate(p, chan->backend.subbuf_size))
+		return -1;
+	CMM_STORE_SHARED(pages->populated, 1);
+	return 0;
+}
+
 /*
  * Must be called under cpu hotplug protection.
  */
@@ -373,6 +465,14 @@ int lib_ring_buffer_create(struct lttng_ust_ring_buffer *buf,
 		goto free_commit_cold;
 	}
 
+	align_shm(shmobj, __alignof__(struct lttng_ust_ring_buffer_ext));
+	set_shmp(buf->ext,
+		 zalloc_shm(shmobj, sizeof(struct lttng_ust_ring_buffer_ext)));
+	if (!shmp(handle, buf->ext)) {
+		ret = -ENOMEM;
+		goto free_init;
+	}
+	buf->ext_size = sizeof(struct lttng_ust_ring_buffer_ext);
 
 	ret = lib_ring_buffer_backend_create(&buf->backend, &chan->backend,
 			cpu, handle, shmobj);
@@ -397,6 +497,10 @@ int lib_ring_buffer_create(struct lttng_ust_ring_buffer *buf,
 		ret = -EPERM;
 		goto free_chanbuf;
 	}
+	if (lib_ring_buffer_populate_subbuf(config, buf, shmp_chan, 0, handle)) {
+		ret = -ENOMEM;
+		goto free_chanbuf;
+	}
 	tsc = config->cb.ring_buffer_clock_read(shmp_chan);
 	config->cb.buffer_begin(buf, tsc, 0, handle);
 	cc_hot = shmp_index(handle, buf->commit_hot, 0);
@@ -429,37 +533,318 @@ free_chanbuf:
 	return ret;
 }
 
+/*
+ * Maximum factor by which the switch timer interval of an idle channel
+ * is increased, and the one of a hot channel decreased, from the
+ * LTTNG_UST_RB_SWITCH_TIMER_BACKOFF environment variable. 1 (the default)
+ * keeps a fixed interval.
+ */
+static unsigned int switch_timer_backoff_max = 1;
+static pthread_once_t switch_timer_backoff_once = PTHREAD_ONCE_INIT;
+
+static
+void switch_timer_backoff_init(void)
+{
+	const char *str;
+	char *endptr;
+	long val;
+
+	str = lttng_ust_getenv("LTTNG_UST_RB_SWITCH_TIMER_BACKOFF");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtol(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0' || val < 1
+			|| val > LTTNG_UST_RB_SWITCH_TIMER_BACKOFF_LIMIT) {
+		WARN("Invalid LTTNG_UST_RB_SWITCH_TIMER_BACKOFF value \"%s\"", str);
+		return;
+	}
+	switch_timer_backoff_max = (unsigned int) val;
+}
+
+/*
+ * Arm a periodic channel timer with an interval in microseconds.
+ */
+static
+void lib_ring_buffer_timer_set(union lttng_ust_ring_buffer_timer *timer,
+		unsigned long interval)
+{
+	struct itimerspec its;
+	int ret;
+
+	its.it_value.tv_sec = interval / 1000000;
+	its.it_value.tv_nsec = (interval % 1000000) * 1000;
+	its.it_interval.tv_sec = its.it_value.tv_sec;
+	its.it_interval.tv_nsec = its.it_value.tv_nsec;
+
+#ifdef LTTNG_UST_RB_TIMERFD
+	ret = timerfd_settime(timer->fd, 0, &its, NULL);
+	if (ret == -1) {
+		PERROR("timerfd_settime");
+	}
+#else
+	ret = timer_settime(timer->id, 0, &its, NULL);
+	if (ret == -1) {
+		PERROR("timer_settime");
+	}
+#endif
+}
+
+/*
+ * Adapt the switch timer interval to the write rate of the busiest stream
+ * of the channel, "written" being the data written to it since the
+ * previous timer expiration. When no data was written to any stream, the
+ * interval is doubled, up to switch_timer_backoff_max times the
+ * configured interval. When a stream filled half a sub-buffer or more,
+ * the interval is halved, down to the configured interval divided by
+ * switch_timer_backoff_max, bounding the latency of its records. The
+ * configured interval is restored in between.
+ */
+static
+void lib_ring_buffer_channel_switch_timer_adapt(struct lttng_ust_ring_buffer_channel *chan,
+		unsigned long written)
+{
+	unsigned long interval = chan->u.s.switch_timer_cur_interval;
+	unsigned long max_interval, min_interval;
+
+	if (switch_timer_backoff_max <= 1)
+		return;
+	max_interval = chan->switch_timer_interval * switch_timer_backoff_max;
+	min_interval = max_t(unsigned long, 1,
+			chan->switch_timer_interval / switch_timer_backoff_max);
+	if (!written)
+		interval = min_t(unsigned long, interval << 1, max_interval);
+	else if (written >= chan->backend.subbuf_size / 2)
+		interval = max_t(unsigned long, interval >> 1, min_interval);
+	else
+		interval = chan->switch_timer_interval;
+	if (interval == chan->u.s.switch_timer_cur_interval)
+		return;
+	chan->u.s.switch_timer_cur_interval = interval;
+	lib_ring_buffer_timer_set(&chan->switch_timer, interval);
+}
+
+/*
+ * Flush the current sub-buffer of a stream at switch timer expiration,
+ * if it has a reader, and return the data written to it since the
+ * previous flush. The write offset after the flush is kept in the
+ * extended stream state: streams not written to since then are skipped
+ * without touching their cachelines other than reading the write
+ * offset. Streams without extended state are flushed at each
+ * expiration, and accounted as written to.
+ */
+static
+unsigned long lib_ring_buffer_switch_timer_stream(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+	unsigned long written = 1;
+
+	/* Without reader, the data is flushed once one is active. */
+	if (!uatomic_read(&buf->active_readers))
+		return 0;
+	if (ext) {
+		written = v_read(config, &buf->offset) - ext->timer_pos;
+		if (!written)
+			return 0;
+	}
+	lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE, handle);
+	if (ext)
+		ext->timer_pos = v_read(config, &buf->offset);
+	return written;
+}
+
+/*
+ * Idle period, in milliseconds, after which the switch timer releases the
+ * memory of a fully consumed discard-mode stream, from the
+ * LTTNG_UST_RB_RECLAIM_IDLE_MS environment variable. 0 (the default)
+ * disables reclamation.
+ */
+static unsigned int reclaim_idle_ms;
+static pthread_once_t reclaim_idle_once = PTHREAD_ONCE_INIT;
+
+static
+void reclaim_idle_init(void)
+{
+	const char *str;
+	char *endptr;
+	long val;
+
+	str = lttng_ust_getenv("LTTNG_UST_RB_RECLAIM_IDLE_MS");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtol(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0' || val < 0
+			|| val > INT_MAX) {
+		WARN("Invalid LTTNG_UST_RB_RECLAIM_IDLE_MS value \"%s\"", str);
+		return;
+	}
+	reclaim_idle_ms = (unsigned int) val;
+}
+
+/*
+ * Release the memory of the sub-buffers of a buffer, except the one
+ * holding write offset @offset and the next one, which writers may enter
+ * at any time. Their pages are faulted back in, zeroed, when writers
+ * reach them again.
+ *
+ * Sub-buffers are released from the farthest one from the writers,
+ * stopping as soon as a writer aborts the reclamation.
+ */
+static
+void lib_ring_buffer_reclaim_subbufs(struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_ring_buffer_ext *ext,
+		struct lttng_ust_ring_buffer_channel *chan,
+		unsigned long offset,
+		struct lttng_ust_shm_handle *handle)
+{
+#ifdef MADV_REMOVE
+	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_ust_ring_buffer_backend *bufb = &buf->backend;
+	unsigned long i, k, cur_idx;
+
+	cur_idx = subbuf_index(offset, chan);
+	for (k = 1; k + 1 < chan->backend.num_subbuf; k++) {
+		struct lttng_ust_ring_buffer_backend_subbuffer *wsb;
+		struct lttng_ust_ring_buffer_backend_pages_shmp *sbp;
+		struct lttng_ust_ring_buffer_backend_pages *pages;
+		char *p;
+
+		if (uatomic_read(&ext->reclaim_state) != RB_RECLAIM_BUSY)
+			return;
+		i = (cur_idx - k) & (chan->backend.num_subbuf - 1);
+		wsb = shmp_index(handle, bufb->buf_wsb, i);
+		if (!wsb)
+			return;
+		sbp = shmp_index(handle, bufb->array,
+				subbuffer_id_get_index(config, wsb->id));
+		if (!sbp)
+			return;
+		pages = shmp(handle, sbp->shmp);
+		if (!pages)
+			return;
+		p = shmp_index(handle, pages->p, 0);
+		if (!p)
+			return;
+		/* Populated again by the next writer entering it. */
+		CMM_STORE_SHARED(pages->populated, 0);
+		if (madvise(p, chan->backend.subbuf_size, MADV_REMOVE)) {
+			PERROR("madvise");
+			return;
+		}
+	}
+#else
+	(void) buf;
+	(void) ext;
+	(void) chan;
+	(void) offset;
+	(void) handle;
+#endif
+}
+
+/*
+ * Track the idleness of a discard-mode buffer at each switch timer
+ * expiration, @interval microseconds apart, and release the memory of its
+ * sub-buffers once it stayed fully consumed for reclaim_idle_ms.
+ *
+ * Writers never wait for the timer (see lib_ring_buffer_reclaim_abort()).
+ * The timer sets RB_RECLAIM_BUSY before reading the write offset again,
+ * and aborts if it moved. Otherwise the writers can only enter the next
+ * sub-buffer, which is kept, before reading the state again: a writer
+ * entering a new sub-buffer moves the state to RB_RECLAIM_ABORT, which
+ * stops the timer before its next release, and drops its record rather
+ * than enter a sub-buffer the timer may still be releasing.
+ */
+static
+void lib_ring_buffer_reclaim_idle(struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_ring_buffer_channel *chan,
+		unsigned long interval,
+		struct lttng_ust_shm_handle *handle)
+{
+	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_ust_ring_buffer_ext *ext;
+	unsigned long offset, idle_ms;
+	int state;
+
+	ext = lib_ring_buffer_get_ext(buf, handle);
+	if (!ext)
+		return;
+	offset = v_read(config, &buf->offset);
+	state = uatomic_read(&ext->reclaim_state);
+	if (caa_unlikely(state == RB_RECLAIM_BUSY || state == RB_RECLAIM_ABORT)) {
+		/* Left over by the timer of a consumer which died. */
+		uatomic_set(&ext->reclaim_state, 0);
+		state = 0;
+	}
+	if (offset != ext->reclaim_pos
+			|| (unsigned long) uatomic_read(&buf->consumed) != offset) {
+		/* Written to, or not consumed yet: restart the idle period. */
+		ext->reclaim_pos = offset;
+		if (state)
+			uatomic_set(&ext->reclaim_state, 0);
+		return;
+	}
+	if (state == RB_RECLAIM_DONE)
+		return;
+	idle_ms = (unsigned long) state + (interval + 999) / 1000;
+	if (idle_ms < reclaim_idle_ms) {
+		uatomic_set(&ext->reclaim_state, (int) idle_ms);
+		return;
+	}
+	uatomic_set(&ext->reclaim_state, RB_RECLAIM_BUSY);
+	cmm_smp_mb();
+	if (v_read(config, &buf->offset) != offset) {
+		uatomic_set(&ext->reclaim_state, 0);
+		return;
+	}
+	lib_ring_buffer_reclaim_subbufs(buf, ext, chan, offset, handle);
+	cmm_smp_mb();
+	if (uatomic_cmpxchg(&ext->reclaim_state, RB_RECLAIM_BUSY,
+			RB_RECLAIM_DONE) != RB_RECLAIM_BUSY) {
+		/* Aborted by a writer: writers may enter any sub-buffer. */
+		uatomic_set(&ext->reclaim_state, 0);
+	}
+}
+
 static
-void lib_ring_buffer_channel_switch_timer(int sig __attribute__((unused)),
-		siginfo_t *si, void *uc __attribute__((unused)))
+void lib_ring_buffer_channel_switch_timer(struct lttng_ust_ring_buffer_channel *chan)
 {
 	const struct lttng_ust_ring_buffer_config *config;
 	struct lttng_ust_shm_handle *handle;
-	struct lttng_ust_ring_buffer_channel *chan;
+	unsigned long written, max_written = 0;
+	bool reclaim;
 	int cpu;
 
-	assert(CMM_LOAD_SHARED(timer_signal.tid) == pthread_self());
+	assert(CMM_LOAD_SHARED(timer_thread.tid) == pthread_self());
 
-	chan = si->si_value.sival_ptr;
 	handle = chan->handle;
 	config = &chan->backend.config;
 
 	DBG("Switch timer for channel %p\n", chan);
 
+	pthread_once(&reclaim_idle_once, reclaim_idle_init);
+	reclaim = reclaim_idle_ms && config->mode == RING_BUFFER_DISCARD;
+
 	/*
 	 * Only flush buffers periodically if readers are active.
 	 */
 	pthread_mutex_lock(&wakeup_fd_mutex);
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
-		for_each_possible_cpu(cpu) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+		for_each_channel_cpu(cpu, chan) {
 			struct lttng_ust_ring_buffer *buf =
 				shmp(handle, chan->backend.buf[cpu].shmp);
 
 			if (!buf)
 				goto end;
-			if (uatomic_read(&buf->active_readers))
-				lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE,
-					chan->handle);
+			written = lib_ring_buffer_switch_timer_stream(config,
+					buf, handle);
+			max_written = max_t(unsigned long, max_written, written);
+			if (reclaim)
+				lib_ring_buffer_reclaim_idle(buf, chan,
+					chan->u.s.switch_timer_cur_interval,
+					handle);
 		}
 	} else {
 		struct lttng_ust_ring_buffer *buf =
@@ -467,16 +852,15 @@ void lib_ring_buffer_channel_switch_timer(int sig __attribute__((unused)),
 
 		if (!buf)
 			goto end;
-		if (uatomic_read(&buf->active_readers))
-			lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE,
-				chan->handle);
+		max_written = lib_ring_buffer_switch_timer_stream(config,
+				buf, handle);
 	}
+	lib_ring_buffer_channel_switch_timer_adapt(chan, max_written);
 end:
 	pthread_mutex_unlock(&wakeup_fd_mutex);
 	return;
 }
 
-static
 int lib_ring_buffer_poll_deliver(const struct lttng_ust_ring_buffer_config *config,
 				 struct lttng_ust_ring_buffer *buf,
 			         struct lttng_ust_ring_buffer_channel *chan,
@@ -533,6 +917,20 @@ void lib_ring_buffer_wakeup(struct lttng_ust_ring_buffer *buf,
 	if (wakeup_fd < 0)
 		return;
 
+	/*
+	 * An eventfd wakeup increments its counter, which cannot raise
+	 * SIGPIPE. Failure with EAGAIN means the counter is saturated,
+	 * which already wakes up the other end.
+	 */
+	if (shm_get_wakeup_eventfd(handle, &buf->self._ref)) {
+		const uint64_t one = 1;
+
+		do {
+			ret = write(wakeup_fd, &one, sizeof(one));
+		} while (ret == -1L && errno == EINTR);
+		return;
+	}
+
 	/*
 	 * Wake-up the other end by writing a null byte in the pipe
 	 * (non-blocking).  Important note: Because writing into the
@@ -601,8 +999,8 @@ void lib_ring_buffer_channel_do_read(struct lttng_ust_ring_buffer_channel *chan)
 	 * Only flush buffers periodically if readers are active.
 	 */
 	pthread_mutex_lock(&wakeup_fd_mutex);
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
-		for_each_possible_cpu(cpu) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+		for_each_channel_cpu(cpu, chan) {
 			struct lttng_ust_ring_buffer *buf =
 				shmp(handle, chan->backend.buf[cpu].shmp);
 
@@ -631,18 +1029,134 @@ end:
 }
 
 static
-void lib_ring_buffer_channel_read_timer(int sig __attribute__((unused)),
-		siginfo_t *si, void *uc __attribute__((unused)))
+void lib_ring_buffer_channel_read_timer(struct lttng_ust_ring_buffer_channel *chan)
 {
-	struct lttng_ust_ring_buffer_channel *chan;
-
-	assert(CMM_LOAD_SHARED(timer_signal.tid) == pthread_self());
-	chan = si->si_value.sival_ptr;
+	assert(CMM_LOAD_SHARED(timer_thread.tid) == pthread_self());
 	DBG("Read timer for channel %p\n", chan);
 	lib_ring_buffer_channel_do_read(chan);
 	return;
 }
 
+#ifdef LTTNG_UST_RB_TIMERFD
+
+/*
+ * The epoll data of each timerfd holds the channel pointer, tagged with
+ * the timer type in its low bit. Channels are cache-line aligned, which
+ * leaves the low bits free. A NULL channel identifies the teardown pipe.
+ */
+#define LTTNG_UST_RB_TIMER_SWITCH	0x0UL
+#define LTTNG_UST_RB_TIMER_READ		0x1UL
+#define LTTNG_UST_RB_TIMER_TYPE_MASK	0x1UL
+
+static
+void *timer_thread_func(void *arg __attribute__((unused)))
+{
+	struct epoll_event events[16];
+
+	CMM_STORE_SHARED(timer_thread.tid, pthread_self());
+
+	for (;;) {
+		bool teardown = false;
+		int nr_events, i;
+
+		nr_events = epoll_wait(timer_thread.epoll_fd, events,
+				LTTNG_ARRAY_SIZE(events), -1);
+		if (nr_events == -1) {
+			if (errno != EINTR)
+				PERROR("epoll_wait");
+			continue;
+		}
+		for (i = 0; i < nr_events; i++) {
+			uintptr_t data = (uintptr_t) events[i].data.u64;
+			struct lttng_ust_ring_buffer_channel *chan;
+			uint64_t expirations;
+			ssize_t len;
+
+			chan = (struct lttng_ust_ring_buffer_channel *)
+				(data & ~LTTNG_UST_RB_TIMER_TYPE_MASK);
+			if (!chan) {
+				char buf[64];
+
+				/* Drain teardown wakeups. */
+				do {
+					len = read(timer_thread.teardown_pipe[0],
+						buf, sizeof(buf));
+				} while (len > 0 || (len < 0 && errno == EINTR));
+				teardown = true;
+				continue;
+			}
+			if ((data & LTTNG_UST_RB_TIMER_TYPE_MASK) == LTTNG_UST_RB_TIMER_READ) {
+				do {
+					len = read(chan->read_timer.fd, &expirations,
+						sizeof(expirations));
+				} while (len < 0 && errno == EINTR);
+				if (len != sizeof(expirations))
+					continue;	/* Re-armed since wakeup. */
+				lib_ring_buffer_channel_read_timer(chan);
+			} else {
+				do {
+					len = read(chan->switch_timer.fd, &expirations,
+						sizeof(expirations));
+				} while (len < 0 && errno == EINTR);
+				if (len != sizeof(expirations))
+					continue;	/* Re-armed since wakeup. */
+				lib_ring_buffer_channel_switch_timer(chan);
+			}
+		}
+		/*
+		 * The whole batch of events returned along with the
+		 * teardown wakeup has been handled: no channel removed
+		 * from the epoll set before the wakeup can be accessed
+		 * anymore.
+		 */
+		if (teardown) {
+			cmm_smp_mb();
+			CMM_STORE_SHARED(timer_thread.qs_done, 1);
+			cmm_smp_mb();
+		}
+	}
+	return NULL;
+}
+
+static
+int timer_thread_init_fds(void)
+{
+	struct epoll_event event;
+	int ret;
+
+	timer_thread.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (timer_thread.epoll_fd < 0) {
+		PERROR("epoll_create1");
+		return -1;
+	}
+	ret = pipe2(timer_thread.teardown_pipe, O_CLOEXEC | O_NONBLOCK);
+	if (ret) {
+		PERROR("pipe2");
+		goto error_pipe;
+	}
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u64 = 0;
+	ret = epoll_ctl(timer_thread.epoll_fd, EPOLL_CTL_ADD,
+			timer_thread.teardown_pipe[0], &event);
+	if (ret) {
+		PERROR("epoll_ctl");
+		goto error_ctl;
+	}
+	return 0;
+
+error_ctl:
+	close(timer_thread.teardown_pipe[0]);
+	close(timer_thread.teardown_pipe[1]);
+	timer_thread.teardown_pipe[0] = timer_thread.teardown_pipe[1] = -1;
+error_pipe:
+	close(timer_thread.epoll_fd);
+	timer_thread.epoll_fd = -1;
+	return -1;
+}
+
+#else /* LTTNG_UST_RB_TIMERFD */
+
 static
 void rb_setmask(sigset_t *mask)
 {
@@ -667,7 +1181,7 @@ void rb_setmask(sigset_t *mask)
 }
 
 static
-void *sig_thread(void *arg __attribute__((unused)))
+void *timer_thread_func(void *arg __attribute__((unused)))
 {
 	sigset_t mask;
 	siginfo_t info;
@@ -675,7 +1189,7 @@ void *sig_thread(void *arg __attribute__((unused)))
 
 	/* Only self thread will receive signal mask. */
 	rb_setmask(&mask);
-	CMM_STORE_SHARED(timer_signal.tid, pthread_self());
+	CMM_STORE_SHARED(timer_thread.tid, pthread_self());
 
 	for (;;) {
 		signr = sigwaitinfo(&mask, &info);
@@ -685,14 +1199,12 @@ void *sig_thread(void *arg __attribute__((unused)))
 			continue;
 		}
 		if (signr == LTTNG_UST_RB_SIG_FLUSH) {
-			lib_ring_buffer_channel_switch_timer(info.si_signo,
-					&info, NULL);
+			lib_ring_buffer_channel_switch_timer(info.si_value.sival_ptr);
 		} else if (signr == LTTNG_UST_RB_SIG_READ) {
-			lib_ring_buffer_channel_read_timer(info.si_signo,
-					&info, NULL);
+			lib_ring_buffer_channel_read_timer(info.si_value.sival_ptr);
 		} else if (signr == LTTNG_UST_RB_SIG_TEARDOWN) {
 			cmm_smp_mb();
-			CMM_STORE_SHARED(timer_signal.qs_done, 1);
+			CMM_STORE_SHARED(timer_thread.qs_done, 1);
 			cmm_smp_mb();
 		} else {
 			ERR("Unexptected signal %d\n", info.si_signo);
@@ -701,8 +1213,10 @@ void *sig_thread(void *arg __attribute__((unused)))
 	return NULL;
 }
 
+#endif /* LTTNG_UST_RB_TIMERFD */
+
 /*
- * Ensure only a single thread listens on the timer signal.
+ * Ensure only a single thread handles the channel timers.
  */
 static
 void lib_ring_buffer_setup_timer_thread(void)
@@ -710,11 +1224,15 @@ void lib_ring_buffer_setup_timer_thread(void)
 	pthread_t thread;
 	int ret;
 
-	pthread_mutex_lock(&timer_signal.lock);
-	if (timer_signal.setup_done)
+	pthread_mutex_lock(&timer_thread.lock);
+	if (timer_thread.setup_done)
 		goto end;
 
-	ret = pthread_create(&thread, NULL, &sig_thread, NULL);
+#ifdef LTTNG_UST_RB_TIMERFD
+	if (timer_thread_init_fds())
+		goto end;
+#endif
+	ret = pthread_create(&thread, NULL, &timer_thread_func, NULL);
 	if (ret) {
 		errno = ret;
 		PERROR("pthread_create");
@@ -724,11 +1242,99 @@ void lib_ring_buffer_setup_timer_thread(void)
 		errno = ret;
 		PERROR("pthread_detach");
 	}
-	timer_signal.setup_done = 1;
+	timer_thread.setup_done = 1;
 end:
-	pthread_mutex_unlock(&timer_signal.lock);
+	pthread_mutex_unlock(&timer_thread.lock);
+}
+
+#ifdef LTTNG_UST_RB_TIMERFD
+
+/*
+ * Wait for timer thread quiescent state after the timer fd has been
+ * removed from the epoll set.
+ */
+static
+void lib_ring_buffer_wait_timer_thread_qs(void)
+{
+	const char c = 0;
+	ssize_t len;
+
+	/*
+	 * We need to be the only thread interacting with the timer
+	 * thread for teardown synchronization.
+	 */
+	pthread_mutex_lock(&timer_thread.lock);
+
+	cmm_smp_mb();
+	CMM_STORE_SHARED(timer_thread.qs_done, 0);
+	cmm_smp_mb();
+
+	do {
+		len = write(timer_thread.teardown_pipe[1], &c, 1);
+	} while (len < 0 && errno == EINTR);
+	if (len < 0 && errno != EAGAIN) {
+		/* A full pipe already guarantees a pending wakeup. */
+		PERROR("write");
+	}
+
+	while (!CMM_LOAD_SHARED(timer_thread.qs_done))
+		caa_cpu_relax();
+	cmm_smp_mb();
+
+	pthread_mutex_unlock(&timer_thread.lock);
+}
+
+/*
+ * Create a timerfd and add it to the timer thread epoll set. Return the
+ * timerfd, or -1 on error.
+ */
+static
+int lib_ring_buffer_timer_create(struct lttng_ust_ring_buffer_channel *chan,
+		unsigned long type)
+{
+	struct epoll_event event;
+	int fd, ret;
+
+	if (timer_thread.epoll_fd < 0)
+		return -1;
+	fd = timerfd_create(CLOCKID, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		PERROR("timerfd_create");
+		return -1;
+	}
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u64 = (uint64_t) ((uintptr_t) chan | type);
+	ret = epoll_ctl(timer_thread.epoll_fd, EPOLL_CTL_ADD, fd, &event);
+	if (ret) {
+		PERROR("epoll_ctl");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static
+void lib_ring_buffer_timer_delete(union lttng_ust_ring_buffer_timer *timer)
+{
+	int ret;
+
+	if (timer->fd < 0)
+		return;
+	ret = epoll_ctl(timer_thread.epoll_fd, EPOLL_CTL_DEL, timer->fd, NULL);
+	if (ret) {
+		PERROR("epoll_ctl");
+	}
+	lib_ring_buffer_wait_timer_thread_qs();
+	ret = close(timer->fd);
+	if (ret) {
+		PERROR("close");
+	}
+	timer->fd = -1;
 }
 
+#else /* LTTNG_UST_RB_TIMERFD */
+
 /*
  * Wait for signal-handling thread quiescent state.
  */
@@ -742,7 +1348,7 @@ void lib_ring_buffer_wait_signal_thread_qs(unsigned int signr)
 	 * We need to be the only thread interacting with the thread
 	 * that manages signals for teardown synchronization.
 	 */
-	pthread_mutex_lock(&timer_signal.lock);
+	pthread_mutex_lock(&timer_thread.lock);
 
 	/*
 	 * Ensure we don't have any signal queued for this channel.
@@ -767,7 +1373,7 @@ void lib_ring_buffer_wait_signal_thread_qs(unsigned int signr)
 	 * for any currently executing handler to complete.
 	 */
 	cmm_smp_mb();
-	CMM_STORE_SHARED(timer_signal.qs_done, 0);
+	CMM_STORE_SHARED(timer_thread.qs_done, 0);
 	cmm_smp_mb();
 
 	/*
@@ -776,63 +1382,84 @@ void lib_ring_buffer_wait_signal_thread_qs(unsigned int signr)
 	 */
 	kill(getpid(), LTTNG_UST_RB_SIG_TEARDOWN);
 
-	while (!CMM_LOAD_SHARED(timer_signal.qs_done))
+	while (!CMM_LOAD_SHARED(timer_thread.qs_done))
 		caa_cpu_relax();
 	cmm_smp_mb();
 
-	pthread_mutex_unlock(&timer_signal.lock);
+	pthread_mutex_unlock(&timer_thread.lock);
 }
 
 static
-void lib_ring_buffer_channel_switch_timer_start(struct lttng_ust_ring_buffer_channel *chan)
+void lib_ring_buffer_timer_create_signal(struct lttng_ust_ring_buffer_channel *chan,
+		union lttng_ust_ring_buffer_timer *timer, int signo)
 {
 	struct sigevent sev;
-	struct itimerspec its;
 	int ret;
 
-	if (!chan->switch_timer_interval || chan->switch_timer_enabled)
-		return;
-
-	chan->switch_timer_enabled = 1;
-
-	lib_ring_buffer_setup_timer_thread();
-
 	memset(&sev, 0, sizeof(sev));
 	sev.sigev_notify = SIGEV_SIGNAL;
-	sev.sigev_signo = LTTNG_UST_RB_SIG_FLUSH;
+	sev.sigev_signo = signo;
 	sev.sigev_value.sival_ptr = chan;
-	ret = timer_create(CLOCKID, &sev, &chan->switch_timer);
+	ret = timer_create(CLOCKID, &sev, &timer->id);
 	if (ret == -1) {
 		PERROR("timer_create");
 	}
+}
 
-	its.it_value.tv_sec = chan->switch_timer_interval / 1000000;
-	its.it_value.tv_nsec = (chan->switch_timer_interval % 1000000) * 1000;
-	its.it_interval.tv_sec = its.it_value.tv_sec;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec;
+static
+void lib_ring_buffer_timer_delete_signal(union lttng_ust_ring_buffer_timer *timer,
+		int signo)
+{
+	int ret;
 
-	ret = timer_settime(chan->switch_timer, 0, &its, NULL);
+	ret = timer_delete(timer->id);
 	if (ret == -1) {
-		PERROR("timer_settime");
+		PERROR("timer_delete");
 	}
+
+	lib_ring_buffer_wait_signal_thread_qs(signo);
+
+	timer->id = 0;
 }
 
+#endif /* LTTNG_UST_RB_TIMERFD */
+
 static
-void lib_ring_buffer_channel_switch_timer_stop(struct lttng_ust_ring_buffer_channel *chan)
+void lib_ring_buffer_channel_switch_timer_start(struct lttng_ust_ring_buffer_channel *chan)
 {
-	int ret;
-
-	if (!chan->switch_timer_interval || !chan->switch_timer_enabled)
+	if (!chan->switch_timer_interval || chan->switch_timer_enabled)
 		return;
 
-	ret = timer_delete(chan->switch_timer);
-	if (ret == -1) {
-		PERROR("timer_delete");
-	}
+	chan->switch_timer_enabled = 1;
+
+	lib_ring_buffer_setup_timer_thread();
+	pthread_once(&switch_timer_backoff_once, switch_timer_backoff_init);
+	chan->u.s.switch_timer_cur_interval = chan->switch_timer_interval;
 
-	lib_ring_buffer_wait_signal_thread_qs(LTTNG_UST_RB_SIG_FLUSH);
+#ifdef LTTNG_UST_RB_TIMERFD
+	chan->switch_timer.fd = lib_ring_buffer_timer_create(chan,
+			LTTNG_UST_RB_TIMER_SWITCH);
+	if (chan->switch_timer.fd < 0)
+		return;
+#else
+	lib_ring_buffer_timer_create_signal(chan, &chan->switch_timer,
+			LTTNG_UST_RB_SIG_FLUSH);
+#endif
+	lib_ring_buffer_timer_set(&chan->switch_timer, chan->switch_timer_interval);
+}
 
-	chan->switch_timer = 0;
+static
+void lib_ring_buffer_channel_switch_timer_stop(struct lttng_ust_ring_buffer_channel *chan)
+{
+	if (!chan->switch_timer_interval || !chan->switch_timer_enabled)
+		return;
+
+#ifdef LTTNG_UST_RB_TIMERFD
+	lib_ring_buffer_timer_delete(&chan->switch_timer);
+#else
+	lib_ring_buffer_timer_delete_signal(&chan->switch_timer,
+			LTTNG_UST_RB_SIG_FLUSH);
+#endif
 	chan->switch_timer_enabled = 0;
 }
 
@@ -840,9 +1467,6 @@ static
 void lib_ring_buffer_channel_read_timer_start(struct lttng_ust_ring_buffer_channel *chan)
 {
 	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
-	struct sigevent sev;
-	struct itimerspec its;
-	int ret;
 
 	if (config->wakeup != RING_BUFFER_WAKEUP_BY_TIMER
 			|| !chan->read_timer_interval || chan->read_timer_enabled)
@@ -852,40 +1476,37 @@ void lib_ring_buffer_channel_read_timer_start(struct lttng_ust_ring_buffer_chann
 
 	lib_ring_buffer_setup_timer_thread();
 
-	sev.sigev_notify = SIGEV_SIGNAL;
-	sev.sigev_signo = LTTNG_UST_RB_SIG_READ;
-	sev.sigev_value.sival_ptr = chan;
-	ret = timer_create(CLOCKID, &sev, &chan->read_timer);
-	if (ret == -1) {
-		PERROR("timer_create");
-	}
-
-	its.it_value.tv_sec = chan->read_timer_interval / 1000000;
-	its.it_value.tv_nsec = (chan->read_timer_interval % 1000000) * 1000;
-	its.it_interval.tv_sec = its.it_value.tv_sec;
-	its.it_interval.tv_nsec = its.it_value.tv_nsec;
-
-	ret = timer_settime(chan->read_timer, 0, &its, NULL);
-	if (ret == -1) {
-		PERROR("timer_settime");
-	}
+#ifdef LTTNG_UST_RB_TIMERFD
+	chan->read_timer.fd = lib_ring_buffer_timer_create(chan,
+			LTTNG_UST_RB_TIMER_READ);
+	if (chan->read_timer.fd < 0)
+		return;
+#else
+	lib_ring_buffer_timer_create_signal(chan, &chan->read_timer,
+			LTTNG_UST_RB_SIG_READ);
+#endif
+	lib_ring_buffer_timer_set(&chan->read_timer, chan->read_timer_interval);
 }
 
 static
 void lib_ring_buffer_channel_read_timer_stop(struct lttng_ust_ring_buffer_channel *chan)
 {
 	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
-	int ret;
 
 	if (config->wakeup != RING_BUFFER_WAKEUP_BY_TIMER
 			|| !chan->read_timer_interval || !chan->read_timer_enabled)
 		return;
 
-	ret = timer_delete(chan->read_timer);
-	if (ret == -1) {
-		PERROR("timer_delete");
-	}
-
+#ifdef LTTNG_UST_RB_TIMERFD
+	/* Stop timer thread accesses before the final check. */
+	lib_ring_buffer_timer_delete(&chan->read_timer);
+	/*
+	 * do one more check to catch data that has been written in the last
+	 * timer period.
+	 */
+	lib_ring_buffer_channel_do_read(chan);
+#else
+	timer_delete(chan->read_timer.id);
 	/*
 	 * do one more check to catch data that has been written in the last
 	 * timer period.
@@ -893,8 +1514,8 @@ void lib_ring_buffer_channel_read_timer_stop(struct lttng_ust_ring_buffer_channe
 	lib_ring_buffer_channel_do_read(chan);
 
 	lib_ring_buffer_wait_signal_thread_qs(LTTNG_UST_RB_SIG_READ);
-
-	chan->read_timer = 0;
+	chan->read_timer.id = 0;
+#endif
 	chan->read_timer_enabled = 0;
 }
 
@@ -912,8 +1533,8 @@ static void channel_print_errors(struct lttng_ust_ring_buffer_channel *chan,
 			&chan->backend.config;
 	int cpu;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU) {
-		for_each_possible_cpu(cpu) {
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+		for_each_channel_cpu(cpu, chan) {
 			struct lttng_ust_ring_buffer *buf =
 				shmp(handle, chan->backend.buf[cpu].shmp);
 			if (buf)
@@ -956,7 +1577,13 @@ static void channel_free(struct lttng_ust_ring_buffer_channel *chan,
  *                         Used for live streaming.
  * @read_timer_interval: Time interval (in us) to wake up pending readers.
  * @stream_fds: array of stream file descriptors.
- * @nr_stream_fds: number of file descriptors in array.
+ * @nr_stream_fds: number of file descriptors in array. A single file
+ *                 descriptor for several streams is an arena holding all
+ *                 of them.
+ * @nr_streams: number of streams of a per-cpu or per-thread channel, at
+ *              most the number of possible cpus, or 0 for one stream per
+ *              possible cpu. Writers map their cpu to a stream with
+ *              lib_ring_buffer_get_stream().
  *
  * Holds cpu hotplug.
  * Returns NULL on failure.
@@ -971,6 +1598,7 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_ring_buffer_c
 		   size_t num_subbuf, unsigned int switch_timer_interval,
 		   unsigned int read_timer_interval,
 		   const int *stream_fds, int nr_stream_fds,
+		   unsigned int nr_streams,
 		   int64_t blocking_timeout)
 {
 	int ret;
@@ -978,15 +1606,20 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_ring_buffer_c
 	struct lttng_ust_ring_buffer_channel *chan;
 	struct lttng_ust_shm_handle *handle;
 	struct shm_object *shmobj;
-	unsigned int nr_streams;
+	unsigned int i;
 	int64_t blocking_timeout_ms;
+	int *arena_fds = NULL;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
-		nr_streams = num_possible_cpus();
-	else
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL) {
+		if (!nr_streams)
+			nr_streams = num_possible_cpus();
+		else if (nr_streams > (unsigned int) num_possible_cpus())
+			return NULL;
+	} else {
 		nr_streams = 1;
+	}
 
-	if (nr_stream_fds != nr_streams)
+	if (nr_stream_fds != nr_streams && nr_stream_fds != 1)
 		return NULL;
 
 	if (blocking_timeout < -1) {
@@ -1011,10 +1644,21 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_ring_buffer_c
 		return NULL;
 
 	/* Allocate table for channel + per-cpu buffers */
-	handle->table = shm_object_table_create(1 + num_possible_cpus());
+	handle->table = shm_object_table_create(1 + nr_streams);
 	if (!handle->table)
 		goto error_table_alloc;
 
+	if (nr_stream_fds != nr_streams) {
+		/* All streams are allocated within the arena. */
+		arena_fds = zmalloc(nr_streams * sizeof(*arena_fds));
+		if (!arena_fds)
+			goto error_append;
+		for (i = 0; i < nr_streams; i++)
+			arena_fds[i] = stream_fds[0];
+		stream_fds = arena_fds;
+		shm_object_table_set_arena(handle->table, arena_fds[0]);
+	}
+
 	/* Calculate the shm allocation layout */
 	shmsize = sizeof(struct lttng_ust_ring_buffer_channel);
 	shmsize += lttng_ust_offset_align(shmsize, __alignof__(struct lttng_ust_ring_buffer_shmp));
@@ -1062,6 +1706,8 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_ring_buffer_c
 	ret = channel_backend_init(&chan->backend, name, config,
 				   subbuf_size, num_subbuf, handle,
 				   stream_fds);
+	free(arena_fds);
+	arena_fds = NULL;
 	if (ret)
 		goto error_backend_init;
 
@@ -1077,6 +1723,7 @@ struct lttng_ust_shm_handle *channel_create(const struct lttng_ust_ring_buffer_c
 
 error_backend_init:
 error_append:
+	free(arena_fds);
 	shm_object_table_destroy(handle->table, 1);
 error_table_alloc:
 	free(handle);
@@ -1119,12 +1766,37 @@ int channel_handle_add_stream(struct lttng_ust_shm_handle *handle,
 		int shm_fd, int wakeup_fd, uint32_t stream_nr,
 		uint64_t memory_map_size)
 {
+	struct lttng_ust_ring_buffer_channel *chan;
 	struct shm_object *object;
 
+	chan = shmp(handle, handle->chan);
+	if (!chan)
+		return -EINVAL;
+
 	/* Add stream object */
 	object = shm_object_table_append_shm(handle->table,
 			shm_fd, wakeup_fd, stream_nr,
-			memory_map_size);
+			memory_map_size, !chan->backend.lazy_alloc);
+	if (!object)
+		return -EINVAL;
+	return 0;
+}
+
+int channel_handle_add_arena_stream(struct lttng_ust_shm_handle *handle,
+		int *arena_fd, int wakeup_fd, uint32_t stream_nr,
+		uint64_t memory_map_size)
+{
+	struct lttng_ust_ring_buffer_channel *chan;
+	struct shm_object *object;
+
+	chan = shmp(handle, handle->chan);
+	if (!chan)
+		return -EINVAL;
+
+	/* Add stream object, mapping the arena on first use */
+	object = shm_object_table_append_arena_shm(handle->table,
+			arena_fd, wakeup_fd, stream_nr,
+			memory_map_size, !chan->backend.lazy_alloc);
 	if (!object)
 		return -EINVAL;
 	return 0;
@@ -1190,7 +1862,7 @@ struct lttng_ust_ring_buffer *channel_get_ring_buffer(
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
 		cpu = 0;
 	} else {
-		if (cpu >= num_possible_cpus())
+		if ((unsigned int) cpu >= chan->nr_streams)
 			return NULL;
 	}
 	ref = &chan->backend.buf[cpu].shmp._ref;
@@ -1235,7 +1907,7 @@ int ring_buffer_stream_close_wait_fd(const struct lttng_ust_ring_buffer_config *
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
 		cpu = 0;
 	} else {
-		if (cpu >= num_possible_cpus())
+		if ((unsigned int) cpu >= chan->nr_streams)
 			return -EINVAL;
 	}
 	ref = &chan->backend.buf[cpu].shmp._ref;
@@ -1253,7 +1925,7 @@ int ring_buffer_stream_close_wakeup_fd(const struct lttng_ust_ring_buffer_config
 	if (config->alloc == RING_BUFFER_ALLOC_GLOBAL) {
 		cpu = 0;
 	} else {
-		if (cpu >= num_possible_cpus())
+		if ((unsigned int) cpu >= chan->nr_streams)
 			return -EINVAL;
 	}
 	ref = &chan->backend.buf[cpu].shmp._ref;
@@ -1264,14 +1936,51 @@ int ring_buffer_stream_close_wakeup_fd(const struct lttng_ust_ring_buffer_config
 }
 
 int lib_ring_buffer_open_read(struct lttng_ust_ring_buffer *buf,
-			      struct lttng_ust_shm_handle *handle __attribute__((unused)))
+			      struct lttng_ust_shm_handle *handle)
 {
+	struct lttng_ust_ring_buffer_ext *ext;
+
 	if (uatomic_cmpxchg(&buf->active_readers, 0, 1) != 0)
 		return -EBUSY;
+	ext = lib_ring_buffer_get_ext(buf, handle);
+	if (ext)
+		CMM_STORE_SHARED(ext->consumer_awake, 0);
 	cmm_smp_mb();
 	return 0;
 }
 
+/*
+ * Take over the reader state of a buffer whose reader exited without
+ * releasing it, e.g. a crashed consumer, and which must not run
+ * anymore. A sub-buffer it held is put back without moving the
+ * consumed position, so it is read again. Returns the checkpoint left
+ * by the previous reader, and the position of the sub-buffer it held,
+ * or -1UL.
+ */
+void lib_ring_buffer_resume_read(struct lttng_ust_ring_buffer *buf,
+				 struct lttng_ust_shm_handle *handle,
+				 unsigned long *checkpoint,
+				 unsigned long *held)
+{
+	struct lttng_ust_ring_buffer_ext *ext;
+
+	uatomic_set(&buf->active_readers, 1);
+	ext = lib_ring_buffer_get_ext(buf, handle);
+	/* The previous reader may have exited while flagged awake. */
+	if (ext)
+		CMM_STORE_SHARED(ext->consumer_awake, 0);
+	cmm_smp_mb();
+	*held = -1UL;
+	if (buf->get_subbuf) {
+		*held = buf->get_subbuf_consumed;
+		lib_ring_buffer_put_subbuf(buf, handle);
+	}
+	if (ext)
+		*checkpoint = CMM_LOAD_SHARED(ext->checkpoint);
+	else
+		*checkpoint = (unsigned long) uatomic_read(&buf->consumed);
+}
+
 void lib_ring_buffer_release_read(struct lttng_ust_ring_buffer *buf,
 				  struct lttng_ust_shm_handle *handle)
 {
@@ -1284,6 +1993,51 @@ void lib_ring_buffer_release_read(struct lttng_ust_ring_buffer *buf,
 	uatomic_dec(&buf->active_readers);
 }
 
+/*
+ * Sample the consumed and write positions of a buffer without writing to
+ * any of its shared cache lines, so readers sampling a buffer never
+ * contend with its writers.
+ *
+ * No need to issue a memory barrier between consumed count read and
+ * write offset read in discard mode, because consumed count can only
+ * change concurrently in overwrite mode, and we keep a sequence counter
+ * identifier derived from the write offset to check we are getting the
+ * same sub-buffer we are expecting (the sub-buffers are atomically
+ * "tagged" upon writes, tags are checked upon read).
+ *
+ * In overwrite mode, writers push the consumed position concurrently.
+ * Re-read it after the write offset until stable, so the sampled pair
+ * is consistent, and never report a consumed position older than the
+ * data the buffer can still hold.
+ */
+static
+void lib_ring_buffer_sample_positions(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_ring_buffer_channel *chan,
+		unsigned long *consumed, unsigned long *write_offset)
+{
+	unsigned long consumed_old, consumed_new, offset;
+	int nr_retry = LTTNG_UST_RING_BUFFER_SAMPLE_RETRY;
+
+	consumed_new = uatomic_read(&buf->consumed);
+	if (config->mode != RING_BUFFER_OVERWRITE) {
+		*consumed = consumed_new;
+		*write_offset = v_read(config, &buf->offset);
+		return;
+	}
+	do {
+		consumed_old = consumed_new;
+		cmm_smp_rmb();
+		offset = v_read(config, &buf->offset);
+		cmm_smp_rmb();
+		consumed_new = uatomic_read(&buf->consumed);
+	} while (consumed_new != consumed_old && --nr_retry > 0);
+	if ((long) (offset - consumed_new) > (long) chan->backend.buf_size)
+		consumed_new = subbuf_align(offset - chan->backend.buf_size, chan);
+	*consumed = consumed_new;
+	*write_offset = offset;
+}
+
 /**
  * lib_ring_buffer_snapshot - save subbuffer position snapshot (for read)
  * @buf: ring buffer
@@ -1312,16 +2066,8 @@ int lib_ring_buffer_snapshot(struct lttng_ust_ring_buffer *buf,
 	 * Read finalized before counters.
 	 */
 	cmm_smp_rmb();
-	consumed_cur = uatomic_read(&buf->consumed);
-	/*
-	 * No need to issue a memory barrier between consumed count read and
-	 * write offset read, because consumed count can only change
-	 * concurrently in overwrite mode, and we keep a sequence counter
-	 * identifier derived from the write offset to check we are getting
-	 * the same sub-buffer we are expecting (the sub-buffers are atomically
-	 * "tagged" upon writes, tags are checked upon read).
-	 */
-	write_offset = v_read(config, &buf->offset);
+	lib_ring_buffer_sample_positions(config, buf, chan, &consumed_cur,
+			&write_offset);
 
 	/*
 	 * Check that we are not about to read the same subbuffer in
@@ -1371,19 +2117,68 @@ int lib_ring_buffer_snapshot_sample_positions(
 		return -EPERM;
 	config = &chan->backend.config;
 	cmm_smp_rmb();
-	*consumed = uatomic_read(&buf->consumed);
-	/*
-	 * No need to issue a memory barrier between consumed count read and
-	 * write offset read, because consumed count can only change
-	 * concurrently in overwrite mode, and we keep a sequence counter
-	 * identifier derived from the write offset to check we are getting
-	 * the same sub-buffer we are expecting (the sub-buffers are atomically
-	 * "tagged" upon writes, tags are checked upon read).
-	 */
-	*produced = v_read(config, &buf->offset);
+	lib_ring_buffer_sample_positions(config, buf, chan, consumed, produced);
 	return 0;
 }
 
+/*
+ * Wait for the consumer to move the consumed position away from
+ * @consumed_old, for at most @delay ms.
+ *
+ * On Linux, the writer waits on a shared futex in the extended state of
+ * the buffer, which the consumer wakes up after moving the consumed position, rather than
+ * sleeping for the whole delay. The futex word is set to -1 before
+ * checking the consumed position again, and the consumer moves the
+ * consumed position before checking the word, so either the writer sees
+ * the new position or the consumer sees the waiter. The delay still
+ * bounds the wait in case the wakeup is missed.
+ */
+static
+void lib_ring_buffer_wait_consumer(struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_ring_buffer_ext *ext,
+		unsigned long consumed_old, int delay)
+{
+#if defined(__linux__) && defined(__NR_futex)
+	struct timespec timeout;
+
+	if (!ext)
+		goto sleep;
+	uatomic_set(&ext->consumer_futex, -1);
+	cmm_smp_mb();
+	if ((unsigned long) uatomic_read(&buf->consumed) != consumed_old)
+		return;
+	timeout.tv_sec = delay / 1000;
+	timeout.tv_nsec = (delay % 1000) * 1000000L;
+	if (syscall(__NR_futex, &ext->consumer_futex, FUTEX_WAIT, -1,
+			&timeout, NULL, 0) == 0 || errno != ENOSYS)
+		return;
+sleep:
+#else
+	(void) buf;
+	(void) ext;
+	(void) consumed_old;
+#endif
+	(void) poll(NULL, 0, delay);
+}
+
+/*
+ * Wake up writers waiting for the consumer in lib_ring_buffer_wait_consumer().
+ */
+static
+void lib_ring_buffer_wake_writers(struct lttng_ust_ring_buffer_ext *ext)
+{
+#if defined(__linux__) && defined(__NR_futex)
+	cmm_smp_mb();
+	if (caa_likely(uatomic_read(&ext->consumer_futex) != -1))
+		return;
+	uatomic_set(&ext->consumer_futex, 0);
+	(void) syscall(__NR_futex, &ext->consumer_futex, FUTEX_WAKE, INT_MAX,
+			NULL, NULL, 0);
+#else
+	(void) ext;
+#endif
+}
+
 /**
  * lib_ring_buffer_move_consumer - move consumed counter forward
  * @buf: ring buffer
@@ -1395,6 +2190,7 @@ void lib_ring_buffer_move_consumer(struct lttng_ust_ring_buffer *buf,
 {
 	struct lttng_ust_ring_buffer_backend *bufb = &buf->backend;
 	struct lttng_ust_ring_buffer_channel *chan;
+	struct lttng_ust_ring_buffer_ext *ext;
 	unsigned long consumed;
 
 	chan = shmp(handle, bufb->chan);
@@ -1411,6 +2207,12 @@ void lib_ring_buffer_move_consumer(struct lttng_ust_ring_buffer *buf,
 	while ((long) consumed - (long) consumed_new < 0)
 		consumed = uatomic_cmpxchg(&buf->consumed, consumed,
 					   consumed_new);
+	ext = lib_ring_buffer_get_ext(buf, handle);
+	if (!ext)
+		return;
+	if ((long) (consumed_new - ext->checkpoint) > 0)
+		CMM_STORE_SHARED(ext->checkpoint, consumed_new);
+	lib_ring_buffer_wake_writers(ext);
 }
 
 /**
@@ -1650,6 +2452,59 @@ void lib_ring_buffer_put_subbuf(struct lttng_ust_ring_buffer *buf,
 	 */
 }
 
+void lib_ring_buffer_iter_init(struct lttng_ust_ring_buffer_iter *iter,
+			       struct lttng_ust_ring_buffer *buf,
+			       struct lttng_ust_shm_handle *handle)
+{
+	iter->buf = buf;
+	iter->handle = handle;
+	iter->held = 0;
+	iter->data = NULL;
+	iter->data_size = 0;
+}
+
+int lib_ring_buffer_iter_next(struct lttng_ust_ring_buffer_iter *iter)
+{
+	struct lttng_ust_ring_buffer *buf = iter->buf;
+	struct lttng_ust_shm_handle *handle = iter->handle;
+	struct lttng_ust_ring_buffer_channel *chan;
+	const char *data;
+	int ret;
+
+	if (iter->held) {
+		lib_ring_buffer_put_next_subbuf(buf, handle);
+		iter->held = 0;
+		iter->data = NULL;
+		iter->data_size = 0;
+	}
+	chan = shmp(handle, buf->backend.chan);
+	if (!chan)
+		return -EPERM;
+	ret = lib_ring_buffer_get_next_subbuf(buf, handle);
+	if (ret)
+		return ret;
+	data = lib_ring_buffer_read_offset_address(&buf->backend, 0, handle);
+	if (!data) {
+		lib_ring_buffer_put_next_subbuf(buf, handle);
+		return -EPERM;
+	}
+	iter->held = 1;
+	iter->data = data;
+	iter->data_size = lib_ring_buffer_get_read_data_size(&chan->backend.config,
+			buf, handle);
+	return 0;
+}
+
+void lib_ring_buffer_iter_fini(struct lttng_ust_ring_buffer_iter *iter)
+{
+	if (!iter->held)
+		return;
+	lib_ring_buffer_put_next_subbuf(iter->buf, iter->handle);
+	iter->held = 0;
+	iter->data = NULL;
+	iter->data_size = 0;
+}
+
 /*
  * cons_offset is an iterator on all subbuffer offsets between the reader
  * position and the writer position. (inclusive)
@@ -1725,6 +2580,7 @@ void lib_ring_buffer_print_errors(struct lttng_ust_ring_buffer_channel *chan,
 				struct lttng_ust_shm_handle *handle)
 {
 	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
 
 	if (!strcmp(chan->backend.name, "relay-metadata-mmap")) {
 		DBG("ring buffer %s: %lu records written, "
@@ -1749,10 +2605,29 @@ void lib_ring_buffer_print_errors(struct lttng_ust_ring_buffer_channel *chan,
 				v_read(config, &buf->records_lost_full),
 				v_read(config, &buf->records_lost_wrap),
 				v_read(config, &buf->records_lost_big));
+		if (ext && v_read(config, &ext->records_sampled))
+			DBG("ring buffer %s, cpu %d: %lu records sampled out\n",
+				chan->backend.name, cpu,
+				v_read(config, &ext->records_sampled));
 	}
 	lib_ring_buffer_print_buffer_errors(buf, chan, cpu, handle);
 }
 
+/*
+ * Account a sub-buffer switch in the statistics of the buffer, when the
+ * last reservation of a sub-buffer closes it.
+ */
+static
+void lib_ring_buffer_count_switch(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_shm_handle *handle)
+{
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+
+	if (ext)
+		v_inc(config, &ext->switch_count);
+}
+
 /*
  * lib_ring_buffer_switch_old_start: Populate old subbuffer header.
  *
@@ -1817,6 +2692,7 @@ void lib_ring_buffer_switch_old_end(struct lttng_ust_ring_buffer *buf,
 	padding_size = chan->backend.subbuf_size - data_size;
 	subbuffer_set_data_size(config, &buf->backend, oldidx, data_size,
 				handle);
+	lib_ring_buffer_count_switch(config, buf, handle);
 
 	ts_end = shmp_index(handle, buf->ts_end, oldidx);
 	if (!ts_end)
@@ -1910,6 +2786,7 @@ void lib_ring_buffer_switch_new_end(struct lttng_ust_ring_buffer *buf,
 	data_size = subbuf_offset(offsets->end - 1, chan) + 1;
 	subbuffer_set_data_size(config, &buf->backend, endidx, data_size,
 				handle);
+	lib_ring_buffer_count_switch(config, buf, handle);
 	ts_end = shmp_index(handle, buf->ts_end, endidx);
 	if (!ts_end)
 		return;
@@ -1924,6 +2801,42 @@ void lib_ring_buffer_switch_new_end(struct lttng_ust_ring_buffer *buf,
 	*ts_end = ctx->priv->tsc;
 }
 
+/*
+ * Incremented by each freeze request, see lib_ring_buffer_freeze_all().
+ * Starts at 1: a buffer freeze sequence of 0 is not synchronized yet.
+ */
+static unsigned long freeze_seq = 1;
+
+void lib_ring_buffer_freeze_all(void)
+{
+	(void) uatomic_add_return(&freeze_seq, 1);
+}
+
+/*
+ * Whether the writers of an overwrite-mode buffer must keep its history
+ * rather than overwrite it. A pending freeze request is applied once per
+ * buffer, by the writer which wins the update of its freeze sequence, so
+ * that a stream thawed by the consumer is not frozen again by a writer
+ * late to see the same request. The first writer of a buffer only
+ * synchronizes it, as its creation may follow freeze requests.
+ */
+static
+bool lib_ring_buffer_check_frozen(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer_ext *ext)
+{
+	unsigned long seq, buf_seq;
+
+	if (config->mode != RING_BUFFER_OVERWRITE || !ext)
+		return false;
+	seq = CMM_LOAD_SHARED(freeze_seq);
+	buf_seq = CMM_LOAD_SHARED(ext->freeze_seq);
+	if (caa_unlikely(seq != buf_seq)
+			&& uatomic_cmpxchg(&ext->freeze_seq, buf_seq, seq) == buf_seq
+			&& buf_seq)
+		CMM_STORE_SHARED(ext->frozen, 1);
+	return CMM_LOAD_SHARED(ext->frozen);
+}
+
 /*
  * Returns :
  * 0 if ok
@@ -1938,6 +2851,7 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 				    struct lttng_ust_shm_handle *handle)
 {
 	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
 	unsigned long off, reserve_commit_diff;
 
 	offsets->begin = v_read(config, &buf->offset);
@@ -1983,6 +2897,19 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 		if (!config->cb.subbuffer_header_size())
 			return -1;
 
+		/*
+		 * Keep the history of a frozen buffer. The freeze requests
+		 * are only applied by the writers: this may run in the
+		 * consumer.
+		 */
+		if (caa_unlikely(config->mode == RING_BUFFER_OVERWRITE
+				&& ext && CMM_LOAD_SHARED(ext->frozen))
+			&& subbuf_trunc(offsets->begin, chan)
+			 - subbuf_trunc((unsigned long)
+			     uatomic_read(&buf->consumed), chan)
+			>= chan->backend.buf_size)
+			return -1;
+
 		/* Test new buffer integrity */
 		sb_index = subbuf_index(offsets->begin, chan);
 		cc_cold = shmp_index(handle, buf->commit_cold, sb_index);
@@ -2013,6 +2940,9 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 				 * subbuffer.
 				 */
 			}
+			if (lib_ring_buffer_populate_subbuf(config, buf, chan,
+					offsets->begin, handle))
+				return -1;
 		} else {
 			/*
 			 * Next subbuffer reserve offset does not match the
@@ -2039,6 +2969,7 @@ int lib_ring_buffer_try_switch_slow(enum switch_mode mode,
 	ctx->priv->records_lost_full = v_read(config, &buf->records_lost_full);
 	ctx->priv->records_lost_wrap = v_read(config, &buf->records_lost_wrap);
 	ctx->priv->records_lost_big = v_read(config, &buf->records_lost_big);
+	ctx->priv->records_sampled = ext ? v_read(config, &ext->records_sampled) : 0;
 	return 0;
 }
 
@@ -2111,9 +3042,13 @@ void lib_ring_buffer_switch_slow(struct lttng_ust_ring_buffer *buf, enum switch_
 }
 
 static
-bool handle_blocking_retry(int *timeout_left_ms)
+bool handle_blocking_retry(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer *buf,
+		struct lttng_ust_ring_buffer_ext *ext,
+		unsigned long consumed_old, int *timeout_left_ms)
 {
-	int timeout = *timeout_left_ms, delay;
+	int timeout = *timeout_left_ms, delay, elapsed;
+	struct timespec start, end;
 
 	if (caa_likely(!timeout))
 		return false;	/* Do not retry, discard event. */
@@ -2121,30 +3056,177 @@ bool handle_blocking_retry(int *timeout_left_ms)
 		delay = RETRY_DELAY_MS;
 	else
 		delay = min_t(int, timeout, RETRY_DELAY_MS);
-	(void) poll(NULL, 0, delay);
+	if (ext)
+		v_inc(config, &ext->blocked_retries);
+	if (clock_gettime(CLOCK_MONOTONIC, &start)) {
+		lib_ring_buffer_wait_consumer(buf, ext, consumed_old, delay);
+		elapsed = delay;
+	} else {
+		lib_ring_buffer_wait_consumer(buf, ext, consumed_old, delay);
+		if (clock_gettime(CLOCK_MONOTONIC, &end))
+			end = start;
+		/* Round up, so each retry accounts for at least 1 ms. */
+		elapsed = (int) ((end.tv_sec - start.tv_sec) * 1000
+			+ (end.tv_nsec - start.tv_nsec + 999999L) / 1000000L);
+		elapsed = min_t(int, max_t(int, elapsed, 1), delay);
+	}
+	if (ext)
+		v_add(config, elapsed, &ext->blocked_ms);
 	if (timeout > 0)
-		*timeout_left_ms -= delay;
+		*timeout_left_ms -= elapsed;
 	return true;	/* Retry. */
 }
 
+/*
+ * Number of other streams of a discard-mode per-CPU channel in which a
+ * writer attempts to record an event before losing it because its own
+ * stream is full, from the LTTNG_UST_RB_SPILL_STREAMS environment
+ * variable. 0 (the default) disables spilling.
+ */
+static unsigned int spill_streams;
+static pthread_once_t spill_streams_once = PTHREAD_ONCE_INIT;
+
+static
+void spill_streams_init(void)
+{
+	const char *str;
+	char *endptr;
+	long val;
+
+	str = lttng_ust_getenv("LTTNG_UST_RB_SPILL_STREAMS");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtol(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0' || val < 0
+			|| val > LTTNG_UST_RB_SPILL_STREAMS_LIMIT) {
+		WARN("Invalid LTTNG_UST_RB_SPILL_STREAMS value \"%s\"", str);
+		return;
+	}
+	spill_streams = (unsigned int) val;
+}
+
+int lib_ring_buffer_streams_match_cpus(const struct lttng_ust_ring_buffer_channel *chan)
+{
+	if (chan->backend.config.alloc != RING_BUFFER_ALLOC_PER_CPU)
+		return 0;
+	if (chan->nr_streams != (unsigned int) num_possible_cpus())
+		return 0;
+	pthread_once(&spill_streams_once, spill_streams_init);
+	return spill_streams == 0;
+}
+
+/*
+ * Called by writers about to enter the sub-buffer holding @begin while
+ * the switch timer may be releasing the memory of an idle buffer (see
+ * lib_ring_buffer_reclaim_idle()). Abort the release, and return false if
+ * the timer may still be releasing the sub-buffer: the record is then
+ * dropped rather than waiting for the timer, which runs in the consumer.
+ */
+static
+bool lib_ring_buffer_reclaim_abort(struct lttng_ust_ring_buffer_ext *ext,
+		struct lttng_ust_ring_buffer_channel *chan,
+		unsigned long begin)
+{
+	unsigned long idx, kept_idx;
+	int state;
+
+	state = uatomic_read(&ext->reclaim_state);
+	if (caa_likely(state != RB_RECLAIM_BUSY && state != RB_RECLAIM_ABORT))
+		return true;
+	if (state == RB_RECLAIM_BUSY)
+		(void) uatomic_cmpxchg(&ext->reclaim_state, RB_RECLAIM_BUSY,
+				RB_RECLAIM_ABORT);
+	/* Read reclaim_state before reclaim_pos. */
+	cmm_smp_rmb();
+	idx = subbuf_index(begin, chan);
+	kept_idx = subbuf_index(CMM_LOAD_SHARED(ext->reclaim_pos), chan);
+	return idx == kept_idx
+		|| idx == ((kept_idx + 1) & (chan->backend.num_subbuf - 1));
+}
+
+/* Largest adaptive sampling shift: one record kept out of 256. */
+#define RB_SAMPLE_SHIFT_MAX	8
+
+static unsigned int sampling_threshold;
+static pthread_once_t sampling_threshold_once = PTHREAD_ONCE_INIT;
+
+static
+void sampling_threshold_init(void)
+{
+	const char *str;
+	char *endptr;
+	long val;
+
+	str = lttng_ust_getenv("LTTNG_UST_RB_SAMPLING_THRESHOLD");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtol(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0' || val < 0
+			|| val > 99) {
+		WARN("Invalid LTTNG_UST_RB_SAMPLING_THRESHOLD value \"%s\"", str);
+		return;
+	}
+	sampling_threshold = (unsigned int) val;
+}
+
+/*
+ * Update the adaptive sampling shift of a discard-mode per-cpu or
+ * per-thread buffer from its fill level @fill, in bytes, when a writer
+ * moves to a new sub-buffer. Below the threshold, every record is kept.
+ * Above it, the shift grows linearly with the fill level, up to
+ * RB_SAMPLE_SHIFT_MAX when the buffer is full. As the shift only changes
+ * at sub-buffer boundaries, the records sampled out, accounted with the
+ * discarded records of each packet, give the weight of its records.
+ */
+static
+void lib_ring_buffer_update_sampling(const struct lttng_ust_ring_buffer_config *config,
+		struct lttng_ust_ring_buffer_ext *ext,
+		struct lttng_ust_ring_buffer_channel *chan,
+		unsigned long fill)
+{
+	unsigned long threshold;
+	int shift = 0;
+
+	if (config->mode != RING_BUFFER_DISCARD
+			|| config->alloc == RING_BUFFER_ALLOC_GLOBAL || !ext)
+		return;
+	pthread_once(&sampling_threshold_once, sampling_threshold_init);
+	if (!sampling_threshold)
+		return;
+	threshold = chan->backend.buf_size / 100 * sampling_threshold;
+	if (fill >= threshold)
+		shift = 1 + (fill - threshold) * (RB_SAMPLE_SHIFT_MAX - 1)
+			/ (chan->backend.buf_size - threshold);
+	if (shift > RB_SAMPLE_SHIFT_MAX)
+		shift = RB_SAMPLE_SHIFT_MAX;
+	if (shift != CMM_LOAD_SHARED(ext->sample_shift))
+		CMM_STORE_SHARED(ext->sample_shift, shift);
+}
+
 /*
  * Returns :
  * 0 if ok
  * -ENOSPC if event size is too large for packet.
  * -ENOBUFS if there is currently not enough space in buffer for the event.
  * -EIO if data cannot be written into the buffer for any other reason.
+ *
+ * When @spill is set, a full buffer neither blocks nor accounts the
+ * record as lost: the caller tries another buffer first.
  */
 static
 int lib_ring_buffer_try_reserve_slow(struct lttng_ust_ring_buffer *buf,
 				     struct lttng_ust_ring_buffer_channel *chan,
 				     struct switch_offsets *offsets,
 				     struct lttng_ust_ring_buffer_ctx *ctx,
-				     void *client_ctx)
+				     void *client_ctx, bool spill)
 {
 	struct lttng_ust_ring_buffer_ctx_private *ctx_private = ctx->priv;
 	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
 	struct lttng_ust_shm_handle *handle = chan->handle;
-	unsigned long reserve_commit_diff, offset_cmp;
+	struct lttng_ust_ring_buffer_ext *ext = lib_ring_buffer_get_ext(buf, handle);
+	unsigned long reserve_commit_diff, offset_cmp, fill;
 	int timeout_left_ms = lttng_ust_ringbuffer_get_timeout(chan);
 
 retry:
@@ -2159,7 +3241,8 @@ retry:
 	if ((int64_t) ctx_private->tsc == -EIO)
 		return -EIO;
 
-	if (last_tsc_overflow(config, buf, ctx_private->tsc))
+	if (last_tsc_overflow(config, buf, ctx_private->tsc,
+			lib_ring_buffer_ctx_tsc_bits(config, ctx_private)))
 		ctx_private->rflags |= RING_BUFFER_RFLAG_FULL_TSC;
 
 	if (caa_unlikely(subbuf_offset(offsets->begin, chan) == 0)) {
@@ -2173,8 +3256,16 @@ retry:
 			lttng_ust_ring_buffer_align(offsets->begin + offsets->size,
 					     ctx->largest_align)
 			+ ctx->data_size;
-		if (caa_unlikely(subbuf_offset(offsets->begin, chan) +
-			     offsets->size > chan->backend.subbuf_size)) {
+		fill = subbuf_offset(offsets->begin, chan) + offsets->size;
+		/*
+		 * Past the fill limit, only switch if the sub-buffer already
+		 * holds records, so records larger than the limit still
+		 * get written in a fresh sub-buffer.
+		 */
+		if (caa_unlikely(fill > chan->backend.subbuf_size
+				|| (fill > subbuf_fill_limit(chan)
+				    && subbuf_offset(offsets->begin, chan)
+					> config->cb.subbuffer_header_size()))) {
 			offsets->switch_old_end = 1;	/* For offsets->old */
 			offsets->switch_new_start = 1;	/* For offsets->begin */
 		}
@@ -2213,6 +3304,8 @@ retry:
 			 * commit counter we read might not match buf->offset
 			 * due to concurrent update. We therefore need to retry.
 			 */
+			if (ext)
+				v_inc(config, &ext->reserve_retries);
 			goto retry;
 		}
 		reserve_commit_diff =
@@ -2220,15 +3313,43 @@ retry:
 		   >> chan->backend.num_subbuf_order)
 		  - (commit_count & chan->commit_count_mask);
 		if (caa_likely(reserve_commit_diff == 0)) {
+			unsigned long consumed;
+
 			/* Next subbuffer not being written to. */
+			consumed = (unsigned long) uatomic_read(&buf->consumed);
+			fill = subbuf_trunc(offsets->begin, chan)
+				- subbuf_trunc(consumed, chan);
+			/* Racy update: a statistic, not a position. */
+			if (ext && caa_unlikely(fill > v_read(config, &ext->max_fill)))
+				v_set(config, &ext->max_fill, fill);
+			lib_ring_buffer_update_sampling(config, ext, chan, fill);
+			if (caa_unlikely(lib_ring_buffer_check_frozen(config, ext)
+					&& fill >= chan->backend.buf_size)) {
+				/*
+				 * Frozen: keep the history of the buffer
+				 * for its snapshot, the record is lost.
+				 */
+				v_inc(config, &buf->records_lost_full);
+				return -ENOBUFS;
+			}
+			if (caa_unlikely(config->mode == RING_BUFFER_DISCARD
+					&& ext && !lib_ring_buffer_reclaim_abort(ext,
+						chan, offsets->begin))) {
+				/* Memory being released: the record is lost. */
+				if (!spill)
+					v_inc(config, &buf->records_lost_full);
+				return -ENOBUFS;
+			}
 			if (caa_unlikely(config->mode != RING_BUFFER_OVERWRITE &&
-				subbuf_trunc(offsets->begin, chan)
-				 - subbuf_trunc((unsigned long)
-				     uatomic_read(&buf->consumed), chan)
-				>= chan->backend.buf_size)) {
+				fill >= chan->backend.buf_size)) {
 				unsigned long nr_lost;
 
-				if (handle_blocking_retry(&timeout_left_ms))
+				if (ext)
+					v_inc(config, &ext->full_count);
+				if (spill)
+					return -ENOBUFS;
+				if (handle_blocking_retry(config, buf, ext, consumed,
+						&timeout_left_ms))
 					goto retry;
 
 				/*
@@ -2251,6 +3372,13 @@ retry:
 				 * subbuffer.
 				 */
 			}
+			if (caa_unlikely(lib_ring_buffer_populate_subbuf(config,
+					buf, chan, offsets->begin, handle))) {
+				/* Out of memory: the record is lost. */
+				if (!spill)
+					v_inc(config, &buf->records_lost_full);
+				return -ENOBUFS;
+			}
 		} else {
 			unsigned long nr_lost;
 
@@ -2325,6 +3453,8 @@ retry:
 		ctx_private->records_lost_full = v_read(config, &buf->records_lost_full);
 		ctx_private->records_lost_wrap = v_read(config, &buf->records_lost_wrap);
 		ctx_private->records_lost_big = v_read(config, &buf->records_lost_big);
+		ctx_private->records_sampled =
+			ext ? v_read(config, &ext->records_sampled) : 0;
 	}
 	return 0;
 }
@@ -2344,28 +3474,74 @@ int lib_ring_buffer_reserve_slow(struct lttng_ust_ring_buffer_ctx *ctx,
 	struct lttng_ust_ring_buffer_channel *chan = ctx_private->chan;
 	struct lttng_ust_shm_handle *handle = chan->handle;
 	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_ust_ring_buffer_ext *ext;
 	struct lttng_ust_ring_buffer *buf;
 	struct switch_offsets offsets;
+	unsigned int nr_spill = 0, spill_left = 0;
 	int ret;
 
-	if (config->alloc == RING_BUFFER_ALLOC_PER_CPU)
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL)
 		buf = shmp(handle, chan->backend.buf[ctx_private->reserve_cpu].shmp);
 	else
 		buf = shmp(handle, chan->backend.buf[0].shmp);
 	if (!buf)
 		return -EIO;
 	ctx_private->buf = buf;
+	lttng_ust_metrics_inc(LTTNG_UST_METRIC_RESERVE_SLOW);
+	ext = lib_ring_buffer_get_ext(buf, handle);
+	if (ext)
+		v_inc(config, &ext->slow_path_count);
+
+	if (config->alloc != RING_BUFFER_ALLOC_GLOBAL
+			&& config->mode == RING_BUFFER_DISCARD) {
+		pthread_once(&spill_streams_once, spill_streams_init);
+		nr_spill = min_t(unsigned int, spill_streams,
+				chan->nr_streams - 1);
+		spill_left = nr_spill;
+	}
 
 	offsets.size = 0;
 
-	do {
+	for (;;) {
 		ret = lib_ring_buffer_try_reserve_slow(buf, chan, &offsets,
-						       ctx, client_ctx);
-		if (caa_unlikely(ret))
+						       ctx, client_ctx,
+						       nr_spill != 0);
+		if (caa_likely(!ret)) {
+			if (caa_likely(v_cmpxchg(config, &buf->offset,
+					offsets.old, offsets.end) == offsets.old))
+				break;
+			ext = lib_ring_buffer_get_ext(buf, handle);
+			if (ext)
+				v_inc(config, &ext->reserve_retries);
+			continue;
+		}
+		if (ret != -ENOBUFS || !nr_spill)
 			return ret;
-	} while (caa_unlikely(v_cmpxchg(config, &buf->offset, offsets.old,
-				    offsets.end)
-			  != offsets.old));
+		/*
+		 * The buffer is full: spill the record into the next
+		 * streams of the channel. Once they are all full as well,
+		 * go back to our own buffer to block or account the
+		 * record as lost there.
+		 */
+		if (spill_left) {
+			struct lttng_ust_ring_buffer *spill_buf;
+			int cpu;
+
+			cpu = (ctx_private->reserve_cpu + nr_spill - spill_left + 1)
+				% chan->nr_streams;
+			spill_left--;
+			spill_buf = shmp(handle, chan->backend.buf[cpu].shmp);
+			if (spill_buf)
+				buf = spill_buf;
+		} else {
+			buf = shmp(handle, chan->backend.buf[ctx_private->reserve_cpu].shmp);
+			if (!buf)
+				return -EIO;
+			nr_spill = 0;
+		}
+		ctx_private->buf = buf;
+		offsets.size = 0;
+	}
 
 	/*
 	 * Atomically update last_tsc. This update races against concurrent
@@ -2571,22 +3747,71 @@ void lib_ring_buffer_check_deliver_slow(const struct lttng_ust_ring_buffer_confi
 		 */
 		if (config->wakeup == RING_BUFFER_WAKEUP_BY_WRITER
 		    && uatomic_read(&buf->active_readers)
-		    && lib_ring_buffer_poll_deliver(config, buf, chan, handle)) {
+		    && lib_ring_buffer_poll_deliver(config, buf, chan, handle)
+		    && !lib_ring_buffer_consumer_awake(buf, handle)) {
 			lib_ring_buffer_wakeup(buf, handle);
 		}
 	}
 }
 
+/*
+ * Bind the current thread to the buffer of the cpu it is running on, for
+ * RING_BUFFER_ALLOC_PER_THREAD channels. The binding is a cpu id shared
+ * by every channel, each of them mapping it to one of its streams.
+ */
+int lib_ring_buffer_thread_cpu_bind(void)
+{
+	int cpu;
+
+	cpu = lttng_ust_get_cpu();
+	URCU_TLS(lib_ring_buffer_thread_cpu) = (unsigned int) cpu + 1;
+	return cpu;
+}
+
 /*
  * Force a read (imply TLS allocation for dlopen) of TLS variables.
  */
 void lttng_ringbuffer_alloc_tls(void)
 {
 	asm volatile ("" : : "m" (URCU_TLS(lib_ring_buffer_nesting)));
+	asm volatile ("" : : "m" (URCU_TLS(lib_ring_buffer_nesting_reserve)));
+	asm volatile ("" : : "m" (URCU_TLS(lib_ring_buffer_thread_cpu)));
+	asm volatile ("" : : "m" (URCU_TLS(lib_ring_buffer_tsc_share)));
+	asm volatile ("" : : "m" (URCU_TLS(lib_ring_buffer_sample_state)));
+}
+
+void lib_ring_buffer_nesting_reserve_begin(void)
+{
+	URCU_TLS(lib_ring_buffer_nesting_reserve)++;
+	cmm_barrier();
+}
+
+void lib_ring_buffer_nesting_reserve_end(void)
+{
+	cmm_barrier();
+	URCU_TLS(lib_ring_buffer_nesting_reserve)--;
+}
+
+void lib_ring_buffer_tsc_share_begin(void)
+{
+	struct lib_ring_buffer_tsc_share *share = &URCU_TLS(lib_ring_buffer_tsc_share);
+
+	/* Never reuse a time-stamp from a previous section. */
+	if (!share->depth)
+		memset(share->last, 0, sizeof(share->last));
+	cmm_barrier();
+	share->depth++;
+}
+
+void lib_ring_buffer_tsc_share_end(void)
+{
+	cmm_barrier();
+	URCU_TLS(lib_ring_buffer_tsc_share).depth--;
 }
 
 void lib_ringbuffer_signal_init(void)
 {
+#ifndef LTTNG_UST_RB_TIMERFD
 	sigset_t mask;
 	int ret;
 
@@ -2600,4 +3825,5 @@ void lib_ringbuffer_signal_init(void)
 		errno = ret;
 		PERROR("pthread_sigmask");
 	}
+#endif
 }
@@ -111,6 +111,15 @@ struct lttng_ust_ring_buffer_client_cb {
  * RING_BUFFER_ALLOC_GLOBAL and RING_BUFFER_SYNC_GLOBAL :
  *   Global shared buffer with global synchronization.
  *
+ * RING_BUFFER_ALLOC_PER_THREAD and RING_BUFFER_SYNC_GLOBAL :
+ *   One buffer per possible cpu, like RING_BUFFER_ALLOC_PER_CPU, but each
+ *   thread is bound to a single buffer the first time it writes to it (the
+ *   buffer of the cpu it runs on at that time) and keeps using it afterwards.
+ *   This removes the cpu id lookup from the reserve fast path. With threads
+ *   pinned one per cpu, each buffer is written by a single thread. Global
+ *   synchronization is still required because the switch timer and consumer
+ *   flush update the buffer positions concurrently with the writer.
+ *
  * wakeup:
  *
  * RING_BUFFER_WAKEUP_BY_TIMER uses per-cpu deferrable timers to poll the
@@ -130,6 +139,7 @@ struct lttng_ust_ring_buffer_client_cb {
 enum lttng_ust_ring_buffer_alloc_types {
 	RING_BUFFER_ALLOC_PER_CPU,
 	RING_BUFFER_ALLOC_GLOBAL,
+	RING_BUFFER_ALLOC_PER_THREAD,
 };
 
 enum lttng_ust_ring_buffer_sync_types {
@@ -150,9 +160,15 @@ enum lttng_ust_ring_buffer_output_types {
 	RING_BUFFER_NONE,
 };
 
+/*
+ * RING_BUFFER_VMAP lays out the sub-buffers of a stream in order, at a
+ * fixed stride, in its memory map: buffer offsets translate to addresses
+ * without looking up the sub-buffer pages. Sub-buffers are then never
+ * exchanged with the reader, which requires RING_BUFFER_DISCARD.
+ */
 enum lttng_ust_ring_buffer_backend_types {
 	RING_BUFFER_PAGE,
-	RING_BUFFER_VMAP,		/* TODO */
+	RING_BUFFER_VMAP,
 	RING_BUFFER_STATIC,		/* TODO */
 };
 
@@ -211,12 +227,19 @@ struct lttng_ust_ring_buffer_config {
  * needed in the record header. If this flag is not set, the record header needs
  * only to contain "tsc_bits" bit of time value.
  *
+ * RING_BUFFER_RFLAG_NO_SAMPLING
+ *
+ * This flag is passed to lib_ring_buffer_reserve() by the client. It exempts
+ * the record from the adaptive sampling of discard-mode per-cpu and
+ * per-thread buffers.
+ *
  * Reservation flags can be added by the client, starting from
  * "(RING_BUFFER_FLAGS_END << 0)". It can be used to pass information from
  * record_header_size() to lib_ring_buffer_write_record_header().
  */
 #define	RING_BUFFER_RFLAG_FULL_TSC		(1U << 0)
-#define RING_BUFFER_RFLAG_END			(1U << 1)
+#define RING_BUFFER_RFLAG_NO_SAMPLING		(1U << 1)
+#define RING_BUFFER_RFLAG_END			(1U << 2)
 
 /*
  * lib_ring_buffer_check_config() returns 0 on success.
@@ -237,6 +260,12 @@ int lib_ring_buffer_check_config(const struct lttng_ust_ring_buffer_config *conf
 	    && config->sync == RING_BUFFER_SYNC_PER_CPU
 	    && switch_timer_interval)
 		return -EINVAL;
+	if (config->alloc == RING_BUFFER_ALLOC_PER_THREAD
+	    && config->sync == RING_BUFFER_SYNC_PER_CPU)
+		return -EINVAL;
+	if (config->backend == RING_BUFFER_VMAP
+	    && config->mode != RING_BUFFER_DISCARD)
+		return -EINVAL;
 	return 0;
 }
 
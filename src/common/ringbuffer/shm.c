@@ -19,6 +19,15 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 
 #ifdef HAVE_LIBNUMA
 #include <numa.h>
@@ -28,16 +37,23 @@
 #include <lttng/ust-utils.h>
 
 #include "common/macros.h"
+#include "common/align.h"
+#include "common/getenv.h"
+#include "common/logging.h"
 #include "common/ust-fd.h"
 #include "common/compat/mmap.h"
 
+#ifndef HUGETLBFS_MAGIC
+#define HUGETLBFS_MAGIC	0x958458f6
+#endif
+
 /*
  * Ensure we have the required amount of space available by writing 0
  * into the entire buffer. Not doing so can trigger SIGBUS when going
  * beyond the available shm space.
  */
 static
-int zero_file(int fd, size_t len)
+int zero_file(int fd, off_t offset, size_t len)
 {
 	ssize_t retlen;
 	size_t written = 0;
@@ -54,8 +70,9 @@ int zero_file(int fd, size_t len)
 
 	while (len > written) {
 		do {
-			retlen = write(fd, zeropage,
-				min_t(size_t, pagelen, len - written));
+			retlen = pwrite(fd, zeropage,
+				min_t(size_t, pagelen, len - written),
+				offset + written);
 		} while (retlen == -1UL && errno == EINTR);
 		if (retlen < 0) {
 			ret = (int) retlen;
@@ -69,6 +86,200 @@ error:
 	return ret;
 }
 
+/*
+ * Allocate the backing store of a range of the file. On tmpfs, fallocate(2)
+ * reserves zeroed pages without copying a zero page through write(2) for
+ * each page, and fails with ENOSPC on shm shortage, which gives the same
+ * guarantee as zero_file(). Fallback on zero_file() if the file system
+ * does not support fallocate.
+ */
+static
+int allocate_file(int fd, off_t offset, size_t len)
+{
+#ifdef HAVE_FALLOCATE
+	int ret;
+
+	do {
+		ret = fallocate(fd, 0, offset, len);
+	} while (ret && errno == EINTR);
+	if (!ret)
+		return 0;
+	if (errno != EOPNOTSUPP && errno != ENOSYS)
+		return ret;
+#endif
+	return zero_file(fd, offset, len);
+}
+
+/*
+ * Lazy allocation of the streams, selected with the
+ * LTTNG_UST_RB_LAZY_ALLOC environment variable of the process allocating
+ * the buffers (the consumer daemon for stream buffers). Only the control
+ * structures of the streams get their backing store upfront, the
+ * sub-buffers are populated by the writers when they first enter them,
+ * so streams of idle CPUs only use the memory of the sub-buffers they
+ * were written to.
+ */
+static int shm_lazy_alloc;
+static pthread_once_t shm_lazy_alloc_once = PTHREAD_ONCE_INIT;
+
+static
+void shm_lazy_alloc_init(void)
+{
+	if (lttng_ust_getenv("LTTNG_UST_RB_LAZY_ALLOC"))
+		shm_lazy_alloc = 1;
+}
+
+bool shm_lazy_alloc_enabled(void)
+{
+	pthread_once(&shm_lazy_alloc_once, shm_lazy_alloc_init);
+	return shm_lazy_alloc;
+}
+
+/*
+ * Allocate the pages of a range of a shared mapping, returning -1 on
+ * memory shortage rather than raising SIGBUS on the first write. Kernels
+ * without MADV_POPULATE_WRITE (before Linux 5.14) allocate the pages on
+ * the first write instead.
+ */
+int shm_populate(char *p, size_t len)
+{
+#ifdef MADV_POPULATE_WRITE
+	int ret;
+
+	do {
+		ret = madvise(p, len, MADV_POPULATE_WRITE);
+	} while (ret && errno == EINTR);
+	if (ret && errno != EINVAL)
+		return -1;
+#else
+	(void) p;
+	(void) len;
+#endif
+	return 0;
+}
+
+/*
+ * Return the huge page size backing the file if it belongs to a hugetlbfs
+ * mount (including memfd_create(MFD_HUGETLB) files), 0 otherwise.
+ */
+static
+size_t shm_fd_hugepage_size(int fd)
+{
+#ifdef __linux__
+	struct statfs buf;
+
+	if (fstatfs(fd, &buf))
+		return 0;
+	if (buf.f_type != HUGETLBFS_MAGIC)
+		return 0;
+	return buf.f_bsize;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Space taken by a stream of @memory_map_size bytes within the arena
+ * backed by @fd. Streams are laid out in stream_nr order, each starting
+ * on a page boundary, or on a huge page boundary on hugetlbfs.
+ */
+static
+size_t shm_arena_stream_span(int fd, size_t memory_map_size)
+{
+	size_t align;
+
+	align = shm_fd_hugepage_size(fd);
+	if (!align)
+		align = LTTNG_UST_PAGE_SIZE;
+	return LTTNG_UST_ALIGN(memory_map_size, align);
+}
+
+static bool shm_wakeup_eventfd;
+static pthread_once_t shm_wakeup_eventfd_once = PTHREAD_ONCE_INIT;
+
+static
+void shm_wakeup_eventfd_init(void)
+{
+	const char *str;
+
+	str = lttng_ust_getenv("LTTNG_UST_RB_WAKEUP_EVENTFD");
+	if (str && atoi(str) == 1)
+		shm_wakeup_eventfd = true;
+}
+
+/*
+ * Create the wait/wakeup file descriptor pair of a shm object.
+ *
+ * By default, this is a pipe with a non-blocking write end: each wakeup
+ * writes a byte, which the reader drains. When LTTNG_UST_RB_WAKEUP_EVENTFD
+ * is set, both ends are non-blocking duplicates of a single eventfd: a
+ * wakeup only increments its counter, which never fills up, and the
+ * reader clears it with a single 8-byte read.
+ */
+static
+int shm_wait_fd_create(int waitfd[2], int *is_eventfd)
+{
+	int ret;
+
+	*is_eventfd = 0;
+#ifdef HAVE_SYS_EVENTFD_H
+	pthread_once(&shm_wakeup_eventfd_once, shm_wakeup_eventfd_init);
+	if (shm_wakeup_eventfd) {
+		waitfd[0] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (waitfd[0] < 0) {
+			PERROR("eventfd");
+			return -1;
+		}
+		waitfd[1] = fcntl(waitfd[0], F_DUPFD_CLOEXEC, 0);
+		if (waitfd[1] < 0) {
+			PERROR("fcntl");
+			goto error_close;
+		}
+		*is_eventfd = 1;
+		return 0;
+	}
+#endif
+	ret = pipe2(waitfd, O_CLOEXEC);
+	if (ret < 0) {
+		PERROR("pipe");
+		return -1;
+	}
+	/* The write end of the pipe needs to be non-blocking */
+	ret = fcntl(waitfd[1], F_SETFL, O_NONBLOCK);
+	if (ret < 0) {
+		PERROR("fcntl");
+		ret = close(waitfd[1]);
+		if (ret) {
+			PERROR("close");
+			assert(0);
+		}
+		goto error_close;
+	}
+	return 0;
+
+error_close:
+	ret = close(waitfd[0]);
+	if (ret) {
+		PERROR("close");
+		assert(0);
+	}
+	return -1;
+}
+
+/*
+ * A wakeup fd received from the other side is an eventfd if it is not a
+ * pipe.
+ */
+static
+int shm_wakeup_fd_is_eventfd(int wakeup_fd)
+{
+	struct stat statbuf;
+
+	if (fstat(wakeup_fd, &statbuf))
+		return 0;
+	return !S_ISFIFO(statbuf.st_mode);
+}
+
 struct shm_object_table *shm_object_table_create(size_t max_nb_obj)
 {
 	struct shm_object_table *table;
@@ -78,9 +289,20 @@ struct shm_object_table *shm_object_table_create(size_t max_nb_obj)
 	if (!table)
 		return NULL;
 	table->size = max_nb_obj;
+	table->arena_fd = -1;
 	return table;
 }
 
+/*
+ * Allocate the following stream objects of @table within @arena_fd
+ * rather than in a shm file of their own.
+ */
+void shm_object_table_set_arena(struct shm_object_table *table, int arena_fd)
+{
+	table->arena_fd = arena_fd;
+	table->arena_len = 0;
+}
+
 static
 struct shm_object *_shm_object_table_alloc_shm(struct shm_object_table *table,
 					   size_t memory_map_size,
@@ -88,7 +310,10 @@ struct shm_object *_shm_object_table_alloc_shm(struct shm_object_table *table,
 {
 	int shmfd, waitfd[2], ret, i;
 	struct shm_object *obj;
+	size_t hugepage_size;
 	char *memory_map;
+	off_t offset = 0;
+	bool lazy = shm_lazy_alloc_enabled();
 
 	if (stream_fd < 0)
 		return NULL;
@@ -96,18 +321,10 @@ struct shm_object *_shm_object_table_alloc_shm(struct shm_object_table *table,
 		return NULL;
 	obj = &table->objects[table->allocated_len];
 
-	/* wait_fd: create pipe */
-	ret = pipe2(waitfd, O_CLOEXEC);
-	if (ret < 0) {
-		PERROR("pipe");
+	/* wait_fd: create pipe or eventfd */
+	ret = shm_wait_fd_create(waitfd, &obj->wakeup_eventfd);
+	if (ret < 0)
 		goto error_pipe;
-	}
-	/* The write end of the pipe needs to be non-blocking */
-	ret = fcntl(waitfd[1], F_SETFL, O_NONBLOCK);
-	if (ret < 0) {
-		PERROR("fcntl");
-		goto error_fcntl;
-	}
 	memcpy(obj->wait_fd, waitfd, sizeof(waitfd));
 
 	/*
@@ -115,39 +332,71 @@ struct shm_object *_shm_object_table_alloc_shm(struct shm_object_table *table,
 	 *
 	 * First, use ftruncate() to set its size, some implementations won't
 	 * allow writes past the size set by ftruncate.
-	 * Then, use write() to fill it with zeros, this allows us to fully
-	 * allocate it and detect a shortage of shm space without dealing with
-	 * a SIGBUS.
+	 * Then, allocate its backing store with fallocate(), or use write()
+	 * to fill it with zeros where fallocate() is unsupported. This allows
+	 * us to fully allocate it and detect a shortage of shm space without
+	 * dealing with a SIGBUS. Pages of a freshly truncated file already
+	 * read as zeros, so no explicit zeroing is needed with fallocate().
+	 *
+	 * Stream files provided on hugetlbfs (e.g. memfd_create() with
+	 * MFD_HUGETLB) are sized to a multiple of the huge page size. They
+	 * don't support write(), but shared hugetlb mappings reserve their
+	 * huge pages at mmap() time, which fails on shortage instead of
+	 * raising SIGBUS later. The rounded size is what the other side
+	 * maps, so both the consumer and the application use the same huge
+	 * pages.
+	 *
+	 * Lazily allocated streams skip the allocation: their control
+	 * structures are populated once laid out, and their sub-buffers by
+	 * the writers entering them (see shm_populate()).
 	 */
 
 	shmfd = stream_fd;
-	ret = ftruncate(shmfd, memory_map_size);
+	hugepage_size = shm_fd_hugepage_size(shmfd);
+	if (hugepage_size)
+		memory_map_size = LTTNG_UST_ALIGN(memory_map_size, hugepage_size);
+	if (shmfd == table->arena_fd) {
+		/* Append the stream to the arena. */
+		offset = table->arena_len;
+		table->arena_len += shm_arena_stream_span(shmfd, memory_map_size);
+	}
+	if (!offset) {
+		/* Discard any previous content so all pages read as zeros. */
+		ret = ftruncate(shmfd, 0);
+		if (ret) {
+			PERROR("ftruncate");
+			goto error_ftruncate;
+		}
+	}
+	ret = ftruncate(shmfd, offset + memory_map_size);
 	if (ret) {
 		PERROR("ftruncate");
 		goto error_ftruncate;
 	}
-	ret = zero_file(shmfd, memory_map_size);
-	if (ret) {
-		PERROR("zero_file");
-		goto error_zero_file;
-	}
+	if (!hugepage_size && !lazy) {
+		ret = allocate_file(shmfd, offset, memory_map_size);
+		if (ret) {
+			PERROR("allocate_file");
+			goto error_zero_file;
+		}
 
-	/*
-	 * Also ensure the file metadata is synced with the storage by using
-	 * fsync(2). Some platforms don't allow fsync on POSIX shm fds, ignore
-	 * EINVAL accordingly.
-	 */
-	ret = fsync(shmfd);
-	if (ret && errno != EINVAL) {
-		PERROR("fsync");
-		goto error_fsync;
+		/*
+		 * Also ensure the file metadata is synced with the storage by
+		 * using fsync(2). Some platforms don't allow fsync on POSIX shm
+		 * fds, ignore EINVAL accordingly.
+		 */
+		ret = fsync(shmfd);
+		if (ret && errno != EINVAL) {
+			PERROR("fsync");
+			goto error_fsync;
+		}
 	}
 	obj->shm_fd_ownership = 0;
 	obj->shm_fd = shmfd;
 
 	/* memory_map: mmap */
 	memory_map = mmap(NULL, memory_map_size, PROT_READ | PROT_WRITE,
-			  MAP_SHARED | LTTNG_MAP_POPULATE, shmfd, 0);
+			  MAP_SHARED | (lazy ? 0 : LTTNG_MAP_POPULATE), shmfd, offset);
 	if (memory_map == MAP_FAILED) {
 		PERROR("mmap");
 		goto error_mmap;
@@ -164,7 +413,6 @@ error_mmap:
 error_fsync:
 error_ftruncate:
 error_zero_file:
-error_fcntl:
 	for (i = 0; i < 2; i++) {
 		ret = close(waitfd[i]);
 		if (ret) {
@@ -182,7 +430,7 @@ struct shm_object *_shm_object_table_alloc_mem(struct shm_object_table *table,
 {
 	struct shm_object *obj;
 	void *memory_map;
-	int waitfd[2], i, ret;
+	int waitfd[2], ret;
 
 	if (table->allocated_len >= table->size)
 		return NULL;
@@ -192,18 +440,10 @@ struct shm_object *_shm_object_table_alloc_mem(struct shm_object_table *table,
 	if (!memory_map)
 		goto alloc_error;
 
-	/* wait_fd: create pipe */
-	ret = pipe2(waitfd, O_CLOEXEC);
-	if (ret < 0) {
-		PERROR("pipe");
+	/* wait_fd: create pipe or eventfd */
+	ret = shm_wait_fd_create(waitfd, &obj->wakeup_eventfd);
+	if (ret < 0)
 		goto error_pipe;
-	}
-	/* The write end of the pipe needs to be non-blocking */
-	ret = fcntl(waitfd[1], F_SETFL, O_NONBLOCK);
-	if (ret < 0) {
-		PERROR("fcntl");
-		goto error_fcntl;
-	}
 	memcpy(obj->wait_fd, waitfd, sizeof(waitfd));
 
 	/* no shm_fd */
@@ -218,14 +458,6 @@ struct shm_object *_shm_object_table_alloc_mem(struct shm_object_table *table,
 
 	return obj;
 
-error_fcntl:
-	for (i = 0; i < 2; i++) {
-		ret = close(waitfd[i]);
-		if (ret) {
-			PERROR("close");
-			assert(0);
-		}
-	}
 error_pipe:
 	free(memory_map);
 alloc_error:
@@ -251,6 +483,94 @@ static bool lttng_is_numa_available(void)
 #endif
 
 #ifdef HAVE_LIBNUMA
+/*
+ * Memory placement policy of the shm objects, selected with the
+ * LTTNG_UST_RB_NUMA_POLICY environment variable of the process allocating
+ * the buffers (the consumer daemon for stream buffers):
+ *
+ *   "cpu" (default): prefer the node of the cpu owning the buffer,
+ *   "local": prefer the node of the allocating thread,
+ *   "interleave": interleave pages on all nodes,
+ *   "none": keep the memory policy of the allocating thread,
+ *   <node number>: prefer the given node.
+ */
+enum shm_numa_policy {
+	SHM_NUMA_POLICY_CPU,
+	SHM_NUMA_POLICY_LOCAL,
+	SHM_NUMA_POLICY_INTERLEAVE,
+	SHM_NUMA_POLICY_NONE,
+	SHM_NUMA_POLICY_NODE,
+};
+
+static enum shm_numa_policy shm_numa_policy;
+static int shm_numa_policy_node;
+static pthread_once_t shm_numa_policy_once = PTHREAD_ONCE_INIT;
+
+static
+void shm_numa_policy_init(void)
+{
+	const char *str;
+	char *endptr;
+	long node;
+
+	str = lttng_ust_getenv("LTTNG_UST_RB_NUMA_POLICY");
+	if (!str || !strcmp(str, "cpu")) {
+		shm_numa_policy = SHM_NUMA_POLICY_CPU;
+	} else if (!strcmp(str, "local")) {
+		shm_numa_policy = SHM_NUMA_POLICY_LOCAL;
+	} else if (!strcmp(str, "interleave")) {
+		shm_numa_policy = SHM_NUMA_POLICY_INTERLEAVE;
+	} else if (!strcmp(str, "none")) {
+		shm_numa_policy = SHM_NUMA_POLICY_NONE;
+	} else {
+		errno = 0;
+		node = strtol(str, &endptr, 10);
+		if (errno || endptr == str || *endptr != '\0'
+				|| node < 0 || node > INT_MAX) {
+			WARN("Invalid LTTNG_UST_RB_NUMA_POLICY value \"%s\", using \"cpu\"", str);
+			shm_numa_policy = SHM_NUMA_POLICY_CPU;
+		} else {
+			shm_numa_policy = SHM_NUMA_POLICY_NODE;
+			shm_numa_policy_node = (int) node;
+		}
+	}
+}
+
+/*
+ * Apply the placement policy to the calling thread before allocating
+ * the memory of an object owned by "cpu" (-1 when not owned by a cpu).
+ * Returns true if the thread policy needs to be restored afterwards.
+ */
+static
+bool shm_numa_policy_apply(int cpu)
+{
+	int node = -1;
+
+	switch (shm_numa_policy) {
+	case SHM_NUMA_POLICY_NONE:
+		return false;
+	case SHM_NUMA_POLICY_INTERLEAVE:
+		numa_set_interleave_mask(numa_all_nodes_ptr);
+		return true;
+	case SHM_NUMA_POLICY_LOCAL:
+		break;
+	case SHM_NUMA_POLICY_NODE:
+		node = shm_numa_policy_node;
+		if (node > numa_max_node())
+			node = -1;
+		break;
+	case SHM_NUMA_POLICY_CPU:
+		if (cpu >= 0)
+			node = numa_node_of_cpu(cpu);
+		break;
+	}
+	if (node >= 0)
+		numa_set_preferred(node);
+	else
+		numa_set_localalloc();
+	return true;
+}
+
 struct shm_object *shm_object_table_alloc(struct shm_object_table *table,
 			size_t memory_map_size,
 			enum shm_object_type type,
@@ -266,19 +586,13 @@ struct shm_object *shm_object_table_alloc(struct shm_object_table *table,
 {
 	struct shm_object *shm_object;
 #ifdef HAVE_LIBNUMA
-	int oldnode = 0, node;
-	bool numa_avail;
+	int oldnode = 0;
+	bool numa_restore = false;
 
-	numa_avail = lttng_is_numa_available();
-	if (numa_avail) {
+	if (lttng_is_numa_available()) {
+		pthread_once(&shm_numa_policy_once, shm_numa_policy_init);
 		oldnode = numa_preferred();
-		if (cpu >= 0) {
-			node = numa_node_of_cpu(cpu);
-			if (node >= 0)
-				numa_set_preferred(node);
-		}
-		if (cpu < 0 || node < 0)
-			numa_set_localalloc();
+		numa_restore = shm_numa_policy_apply(cpu);
 	}
 #endif /* HAVE_LIBNUMA */
 	switch (type) {
@@ -293,15 +607,18 @@ struct shm_object *shm_object_table_alloc(struct shm_object_table *table,
 		assert(0);
 	}
 #ifdef HAVE_LIBNUMA
-	if (numa_avail)
+	if (numa_restore) {
+		if (shm_numa_policy == SHM_NUMA_POLICY_INTERLEAVE)
+			numa_set_interleave_mask(numa_no_nodes_ptr);
 		numa_set_preferred(oldnode);
+	}
 #endif /* HAVE_LIBNUMA */
 	return shm_object;
 }
 
 struct shm_object *shm_object_table_append_shm(struct shm_object_table *table,
 			int shm_fd, int wakeup_fd, uint32_t stream_nr,
-			size_t memory_map_size)
+			size_t memory_map_size, bool populate)
 {
 	struct shm_object *obj;
 	char *memory_map;
@@ -318,6 +635,7 @@ struct shm_object *shm_object_table_append_shm(struct shm_object_table *table,
 	/* wait_fd: set write end of the pipe. */
 	obj->wait_fd[0] = -1;	/* read end is unset */
 	obj->wait_fd[1] = wakeup_fd;
+	obj->wakeup_eventfd = shm_wakeup_fd_is_eventfd(wakeup_fd);
 	obj->shm_fd = shm_fd;
 	obj->shm_fd_ownership = 1;
 
@@ -330,7 +648,7 @@ struct shm_object *shm_object_table_append_shm(struct shm_object_table *table,
 
 	/* memory_map: mmap */
 	memory_map = mmap(NULL, memory_map_size, PROT_READ | PROT_WRITE,
-			  MAP_SHARED | LTTNG_MAP_POPULATE, shm_fd, 0);
+			  MAP_SHARED | (populate ? LTTNG_MAP_POPULATE : 0), shm_fd, 0);
 	if (memory_map == MAP_FAILED) {
 		PERROR("mmap");
 		goto error_mmap;
@@ -348,6 +666,82 @@ error_mmap:
 	return NULL;
 }
 
+/*
+ * Add stream @stream_nr of a channel arena. The first call maps the
+ * whole arena and takes ownership of *@arena_fd, setting it to -1. The
+ * stream is a view within that mapping.
+ */
+struct shm_object *shm_object_table_append_arena_shm(struct shm_object_table *table,
+			int *arena_fd, int wakeup_fd, uint32_t stream_nr,
+			size_t memory_map_size, bool populate)
+{
+	struct shm_object *obj;
+	size_t offset, span;
+	int ret;
+
+	if (table->allocated_len >= table->size)
+		return NULL;
+	/* streams _must_ be received in sequential order, else fail. */
+	if (stream_nr + 1 != table->allocated_len)
+		return NULL;
+
+	if (!table->arena_map) {
+		struct stat statbuf;
+		char *memory_map;
+
+		if (*arena_fd < 0)
+			return NULL;
+		if (fstat(*arena_fd, &statbuf)) {
+			PERROR("fstat");
+			return NULL;
+		}
+		if (statbuf.st_size <= 0)
+			return NULL;
+		memory_map = mmap(NULL, statbuf.st_size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | (populate ? LTTNG_MAP_POPULATE : 0),
+				  *arena_fd, 0);
+		if (memory_map == MAP_FAILED) {
+			PERROR("mmap");
+			return NULL;
+		}
+		table->arena_map = memory_map;
+		table->arena_map_size = statbuf.st_size;
+		table->arena_fd = *arena_fd;
+		*arena_fd = -1;
+	}
+	span = shm_arena_stream_span(table->arena_fd, memory_map_size);
+	offset = (size_t) stream_nr * span;
+	if (offset / span != stream_nr
+			|| offset + memory_map_size < offset
+			|| offset + memory_map_size > table->arena_map_size)
+		return NULL;
+
+	obj = &table->objects[table->allocated_len];
+
+	/* wait_fd: set write end of the pipe. */
+	obj->wait_fd[0] = -1;	/* read end is unset */
+	obj->wait_fd[1] = wakeup_fd;
+	obj->wakeup_eventfd = shm_wakeup_fd_is_eventfd(wakeup_fd);
+	obj->shm_fd = table->arena_fd;
+	obj->shm_fd_ownership = 0;
+
+	/* The write end of the pipe needs to be non-blocking */
+	ret = fcntl(obj->wait_fd[1], F_SETFL, O_NONBLOCK);
+	if (ret < 0) {
+		PERROR("fcntl");
+		return NULL;
+	}
+
+	obj->type = SHM_OBJECT_SHM;
+	obj->arena_view = 1;
+	obj->memory_map = table->arena_map + offset;
+	obj->memory_map_size = memory_map_size;
+	obj->allocated_len = memory_map_size;
+	obj->index = table->allocated_len++;
+
+	return obj;
+}
+
 /*
  * Passing ownership of mem to object.
  */
@@ -363,6 +757,7 @@ struct shm_object *shm_object_table_append_mem(struct shm_object_table *table,
 
 	obj->wait_fd[0] = -1;	/* read end is unset */
 	obj->wait_fd[1] = wakeup_fd;
+	obj->wakeup_eventfd = shm_wakeup_fd_is_eventfd(wakeup_fd);
 	obj->shm_fd = -1;
 	obj->shm_fd_ownership = 0;
 
@@ -393,10 +788,13 @@ void shmp_object_destroy(struct shm_object *obj, int consumer)
 	{
 		int ret, i;
 
-		ret = munmap(obj->memory_map, obj->memory_map_size);
-		if (ret) {
-			PERROR("umnmap");
-			assert(0);
+		/* Views are unmapped along with the arena. */
+		if (!obj->arena_view) {
+			ret = munmap(obj->memory_map, obj->memory_map_size);
+			if (ret) {
+				PERROR("umnmap");
+				assert(0);
+			}
 		}
 
 		if (obj->shm_fd_ownership) {
@@ -481,6 +879,25 @@ void shm_object_table_destroy(struct shm_object_table *table, int consumer)
 
 	for (i = 0; i < table->allocated_len; i++)
 		shmp_object_destroy(&table->objects[i], consumer);
+	if (table->arena_map) {
+		int ret;
+
+		ret = munmap(table->arena_map, table->arena_map_size);
+		if (ret) {
+			PERROR("umnmap");
+			assert(0);
+		}
+		/* The application owns the arena fd it mapped. */
+		lttng_ust_lock_fd_tracker();
+		ret = close(table->arena_fd);
+		if (!ret) {
+			lttng_ust_delete_fd_from_tracker(table->arena_fd);
+		} else {
+			PERROR("close");
+			assert(0);
+		}
+		lttng_ust_unlock_fd_tracker();
+	}
 	free(table);
 }
 
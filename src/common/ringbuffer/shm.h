@@ -7,6 +7,7 @@
 #ifndef _LIBRINGBUFFER_SHM_H
 #define _LIBRINGBUFFER_SHM_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <unistd.h>
@@ -27,6 +28,13 @@ int channel_handle_add_stream(struct lttng_ust_shm_handle *handle,
 		uint64_t memory_map_size)
 	__attribute__((visibility("hidden")));
 
+/* channel_handle_add_arena_stream - for UST. */
+extern
+int channel_handle_add_arena_stream(struct lttng_ust_shm_handle *handle,
+		int *arena_fd, int wakeup_fd, uint32_t stream_nr,
+		uint64_t memory_map_size)
+	__attribute__((visibility("hidden")));
+
 unsigned int channel_handle_get_nr_streams(struct lttng_ust_shm_handle *handle)
 	__attribute__((visibility("hidden")));
 
@@ -74,6 +82,9 @@ void _set_shmp(struct shm_ref *ref, struct shm_ref src)
 struct shm_object_table *shm_object_table_create(size_t max_nb_obj)
 	__attribute__((visibility("hidden")));
 
+void shm_object_table_set_arena(struct shm_object_table *table, int arena_fd)
+	__attribute__((visibility("hidden")));
+
 struct shm_object *shm_object_table_alloc(struct shm_object_table *table,
 			size_t memory_map_size,
 			enum shm_object_type type,
@@ -81,9 +92,26 @@ struct shm_object *shm_object_table_alloc(struct shm_object_table *table,
 			int cpu)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Map a stream received from the process which allocated it. @populate
+ * is false for lazily allocated streams, whose pages must not be
+ * allocated by the mapping.
+ */
 struct shm_object *shm_object_table_append_shm(struct shm_object_table *table,
 			int shm_fd, int wakeup_fd, uint32_t stream_nr,
-			size_t memory_map_size)
+			size_t memory_map_size, bool populate)
+	__attribute__((visibility("hidden")));
+
+struct shm_object *shm_object_table_append_arena_shm(struct shm_object_table *table,
+			int *arena_fd, int wakeup_fd, uint32_t stream_nr,
+			size_t memory_map_size, bool populate)
+	__attribute__((visibility("hidden")));
+
+/* Whether this process allocates streams lazily (LTTNG_UST_RB_LAZY_ALLOC). */
+bool shm_lazy_alloc_enabled(void)
+	__attribute__((visibility("hidden")));
+
+int shm_populate(char *p, size_t len)
 	__attribute__((visibility("hidden")));
 
 /* mem ownership is passed to shm_object_table_append_mem(). */
@@ -135,6 +163,24 @@ int shm_get_wakeup_fd(struct lttng_ust_shm_handle *handle, struct shm_ref *ref)
 	return obj->wait_fd[1];
 }
 
+/*
+ * Return 1 if the wait/wakeup fds of the object are eventfds, 0 if
+ * they are the ends of a pipe.
+ */
+static inline
+int shm_get_wakeup_eventfd(struct lttng_ust_shm_handle *handle, struct shm_ref *ref)
+{
+	struct shm_object_table *table = handle->table;
+	struct shm_object *obj;
+	size_t index;
+
+	index = (size_t) ref->index;
+	if (caa_unlikely(index >= table->allocated_len))
+		return 0;
+	obj = &table->objects[index];
+	return obj->wakeup_eventfd;
+}
+
 static inline
 int shm_close_wait_fd(struct lttng_ust_shm_handle *handle,
 		struct shm_ref *ref)
@@ -24,15 +24,25 @@ struct shm_object {
 	size_t index;	/* within the object table */
 	int shm_fd;	/* shm fd */
 	int wait_fd[2];	/* fd for wait/wakeup */
+	int wakeup_eventfd;	/* wait_fd are eventfd rather than pipe */
 	char *memory_map;
 	size_t memory_map_size;
 	uint64_t allocated_len;
 	int shm_fd_ownership;
+	int arena_view;		/* memory_map is within the table arena map */
 };
 
+/*
+ * A channel arena is a single shm file holding all the streams of the
+ * channel, each at an offset aligned on shm_arena_stream_span().
+ */
 struct shm_object_table {
 	size_t size;
 	size_t allocated_len;
+	int arena_fd;		/* -1 if streams have their own shm file */
+	size_t arena_len;	/* consumer: length allocated in the arena */
+	char *arena_map;	/* application: mapping of the whole arena */
+	size_t arena_map_size;
 	struct shm_object objects[];
 };
 
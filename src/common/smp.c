@@ -6,6 +6,9 @@
  */
 
 #define _LGPL_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
 
@@ -111,3 +114,82 @@ int num_possible_cpus(void)
 
 	return num_possible_cpus_cache;
 }
+
+/*
+ * Affinity mask of process @pid, allocated for all possible CPUs. The
+ * caller frees the returned set with CPU_FREE.
+ */
+static
+cpu_set_t *get_affinity_mask(pid_t pid, size_t *setsize, int *err)
+{
+	cpu_set_t *set;
+	int nr_cpus;
+
+	nr_cpus = num_possible_cpus();
+	if (nr_cpus <= 0) {
+		*err = -EINVAL;
+		return NULL;
+	}
+	set = CPU_ALLOC(nr_cpus);
+	if (!set) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+	*setsize = CPU_ALLOC_SIZE(nr_cpus);
+	CPU_ZERO_S(*setsize, set);
+	if (sched_getaffinity(pid, *setsize, set)) {
+		*err = -errno;
+		CPU_FREE(set);
+		return NULL;
+	}
+	return set;
+}
+
+int num_affinity_cpus(pid_t pid)
+{
+	cpu_set_t *set;
+	size_t setsize;
+	int ret;
+
+	set = get_affinity_mask(pid, &setsize, &ret);
+	if (!set)
+		return ret;
+	ret = CPU_COUNT_S(setsize, set);
+	CPU_FREE(set);
+	return ret;
+}
+
+static int *affinity_rank;
+static pthread_once_t affinity_rank_once = PTHREAD_ONCE_INIT;
+
+static
+void affinity_rank_init(void)
+{
+	cpu_set_t *set;
+	size_t setsize;
+	int *rank, cpu, nr = 0, err;
+
+	set = get_affinity_mask(0, &setsize, &err);
+	if (!set)
+		return;
+	rank = calloc(num_possible_cpus(), sizeof(*rank));
+	if (!rank)
+		goto end;
+	for_each_possible_cpu(cpu) {
+		if (CPU_ISSET_S(cpu, setsize, set))
+			rank[cpu] = nr++;
+		else
+			rank[cpu] = -1;
+	}
+	affinity_rank = rank;
+end:
+	CPU_FREE(set);
+}
+
+int affinity_cpu_rank(int cpu)
+{
+	pthread_once(&affinity_rank_once, affinity_rank_init);
+	if (!affinity_rank || cpu < 0 || cpu >= num_possible_cpus())
+		return -1;
+	return affinity_rank[cpu];
+}
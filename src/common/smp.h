@@ -7,6 +7,8 @@
 #ifndef _UST_COMMON_SMP_H
 #define _UST_COMMON_SMP_H
 
+#include <sys/types.h>
+
 /*
  * Returns the total number of CPUs in the system. If the cache is not yet
  * initialized, get the value from the system through sysconf and cache it.
@@ -16,6 +18,21 @@
 int num_possible_cpus(void)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Returns the number of CPUs in the affinity mask of process @pid, 0
+ * for the calling process, or a negative errno value on error.
+ */
+int num_affinity_cpus(pid_t pid)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Returns the rank of @cpu within the affinity mask the calling process
+ * had when first queried, or -1 when @cpu is not part of that mask or
+ * the mask is unavailable.
+ */
+int affinity_cpu_rank(int cpu)
+	__attribute__((visibility("hidden")));
+
 #define for_each_possible_cpu(cpu)		\
 	for ((cpu) = 0; (cpu) < num_possible_cpus(); (cpu)++)
 
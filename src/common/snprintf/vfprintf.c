@@ -156,6 +156,53 @@ static int exponent(char *, int, int);
 #define is_digit(c)	((unsigned)to_digit(c) <= 9)
 #define	to_char(n)	((n) + '0')
 
+/*
+ * Decimal digit pairs, to convert integers two digits per division.
+ */
+static const char digit_pairs[200] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/*
+ * Convert @val to decimal, backward from @cp. Returns the first digit.
+ * Values which fit in 32 bits, the common case, are converted with
+ * 32-bit divisions.
+ */
+static char *
+__ultoa_dec(uintmax_t val, char *cp)
+{
+	unsigned int v, i;
+
+	while (val > UINT_MAX) {
+		i = (val % 100) * 2;
+		val /= 100;
+		*--cp = digit_pairs[i + 1];
+		*--cp = digit_pairs[i];
+	}
+	v = val;
+	while (v >= 100) {
+		i = (v % 100) * 2;
+		v /= 100;
+		*--cp = digit_pairs[i + 1];
+		*--cp = digit_pairs[i];
+	}
+	if (v >= 10) {
+		*--cp = digit_pairs[v * 2 + 1];
+		*--cp = digit_pairs[v * 2];
+	} else {
+		*--cp = to_char(v);
+	}
+	return cp;
+}
+
 /*
  * Flags used during conversion.
  */
@@ -789,12 +836,7 @@ number:			if ((dprec = prec) >= 0)
 					break;
 
 				case DEC:
-					/* many numbers are 1 digit */
-					while (_umax >= 10) {
-						*--cp = to_char(_umax % 10);
-						_umax /= 10;
-					}
-					*--cp = to_char(_umax);
+					cp = __ultoa_dec(_umax, cp);
 					break;
 
 				case HEX:
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "common/strutils.h"
@@ -73,6 +74,57 @@ bool strutils_is_star_at_the_end_only_glob_pattern(const char *pattern)
 		STAR_GLOB_PATTERN_TYPE_FLAG_END_ONLY;
 }
 
+/* Smallest page size: word loads within a page cannot fault. */
+#define STRUTILS_MIN_PAGE_SIZE	4096
+
+static inline
+bool word_load_in_page(const char *p)
+{
+	return ((uintptr_t) p & (STRUTILS_MIN_PAGE_SIZE - 1))
+		<= STRUTILS_MIN_PAGE_SIZE - sizeof(unsigned long);
+}
+
+static inline
+bool word_has_byte(unsigned long word, unsigned char c)
+{
+	const unsigned long ones = ~0UL / 0xff;
+	unsigned long x = word ^ (ones * c);
+
+	return (x - ones) & ~x & (ones << 7);
+}
+
+/*
+ * Returns the length of the common prefix of `a` and `b`, compared a
+ * word at a time, which only holds characters without a special meaning
+ * for string comparison or globbing (`\0`, `\`, `*`). Callers compare
+ * the rest character by character.
+ *
+ * `a_len` and `b_len` bound the prefix and can be greater than the
+ * actual string lengths if the strings are null-terminated: since a
+ * word is never loaded across a page boundary, reading past the null
+ * character cannot fault.
+ */
+size_t strutils_plain_prefix_len(const char *a, size_t a_len,
+		const char *b, size_t b_len)
+{
+	size_t i = 0;
+
+	while (a_len - i >= sizeof(unsigned long)
+			&& b_len - i >= sizeof(unsigned long)
+			&& word_load_in_page(a + i) && word_load_in_page(b + i)) {
+		unsigned long wa, wb;
+
+		memcpy(&wa, a + i, sizeof(wa));
+		memcpy(&wb, b + i, sizeof(wb));
+		if (wa != wb || word_has_byte(wa, '\0')
+				|| word_has_byte(wa, '\\')
+				|| word_has_byte(wa, '*'))
+			break;
+		i += sizeof(unsigned long);
+	}
+	return i;
+}
+
 static inline
 bool at_end_of_pattern(const char *p, const char *pattern, size_t pattern_len)
 {
@@ -242,6 +294,16 @@ retry:
 	 *     pattern:   hi*every*one
 	 *                         ^  ^ SUCCESS
 	 */
+	/* Skip the plain characters both strings start with. */
+	{
+		size_t skip;
+
+		skip = strutils_plain_prefix_len(p, pattern_len - (p - pattern),
+			c, candidate_len - (c - candidate));
+		p += skip;
+		c += skip;
+	}
+
 	while ((c - candidate) < candidate_len && *c != '\0') {
 		assert(*c);
 
@@ -16,6 +16,10 @@ bool strutils_is_star_glob_pattern(const char *pattern)
 bool strutils_is_star_at_the_end_only_glob_pattern(const char *pattern)
 	__attribute__((visibility("hidden")));
 
+size_t strutils_plain_prefix_len(const char *a, size_t a_len,
+		const char *b, size_t b_len)
+	__attribute__((visibility("hidden")));
+
 bool strutils_star_glob_match(const char *pattern, size_t pattern_len,
                 const char *candidate, size_t candidate_len)
 	__attribute__((visibility("hidden")));
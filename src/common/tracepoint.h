@@ -7,6 +7,8 @@
 #ifndef _UST_COMMON_TRACEPOINT_H
 #define _UST_COMMON_TRACEPOINT_H
 
+#include <stdint.h>
+
 #define LTTNG_UST_TRACEPOINT_LOGLEVEL_DEFAULT	LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG_LINE
 
 /*
@@ -18,6 +20,8 @@ int lttng_ust_tp_probe_register_queue_release(const char *provider_name, const c
 int lttng_ust_tp_probe_unregister_queue_release(const char *provider_name, const char *event_name,
 		void (*func)(void), void *data);
 void lttng_ust_tp_probe_prune_release_queue(void);
+int lttng_ust_tp_set_sample_period(const char *name, uint32_t period);
+void lttng_ust_tp_set_probe_accept_cb(int (*cb)(void *data, void *ip));
 
 void lttng_ust_tp_init(void);
 void lttng_ust_tp_exit(void);
@@ -24,7 +24,15 @@
 #define CTF_SPEC_MINOR			8
 
 #define LTTNG_RFLAG_EXTENDED		RING_BUFFER_RFLAG_END
-#define LTTNG_RFLAG_END			(LTTNG_RFLAG_EXTENDED << 1)
+#define LTTNG_RFLAG_STAGED		(LTTNG_RFLAG_EXTENDED << 1)
+#define LTTNG_RFLAG_END			(LTTNG_RFLAG_STAGED << 1)
+
+/*
+ * Flags of the lttng_ust_fragment:record events which carry the payload
+ * of a record larger than a sub-buffer.
+ */
+#define LTTNG_UST_FRAGMENT_FLAG_CONTINUED	(1U << 0)	/* Not the first fragment. */
+#define LTTNG_UST_FRAGMENT_FLAG_MORE		(1U << 1)	/* Not the last fragment. */
 
 /*
  * LTTng client type enumeration. Used by the consumer to map the
@@ -36,6 +44,7 @@ enum lttng_client_types {
 	LTTNG_CLIENT_OVERWRITE = 2,
 	LTTNG_CLIENT_DISCARD_RT = 3,
 	LTTNG_CLIENT_OVERWRITE_RT = 4,
+	LTTNG_CLIENT_DISCARD_PER_THREAD = 5,
 	LTTNG_NR_CLIENT_TYPES,
 };
 
@@ -72,6 +81,23 @@ void lttng_ust_dummy_get_value(void *priv, struct lttng_ust_probe_ctx *probe_ctx
 		struct lttng_ust_ctx_value *value)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Dummy callbacks of the app contexts of a fixed type, recording a zero
+ * value of that type. Their private data is the app context.
+ */
+size_t lttng_ust_dummy_fixed_get_size(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
+		size_t offset)
+	__attribute__((visibility("hidden")));
+
+void lttng_ust_dummy_fixed_record(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_channel_buffer *chan)
+	__attribute__((visibility("hidden")));
+
+void lttng_ust_dummy_fixed_get_value(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_ctx_value *value)
+	__attribute__((visibility("hidden")));
+
 int lttng_context_is_app(const char *name)
 	__attribute__((visibility("hidden")));
 
@@ -65,8 +65,35 @@ struct lttng_ust_context_provider {
 	void *priv;
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	/*
+	 * Type of all the values of the context, or
+	 * LTTNG_UST_DYNAMIC_TYPE_NONE if it varies. The contexts added
+	 * while a fixed-type provider is registered are described as a
+	 * plain field of that type rather than as a variant: its get_size
+	 * and record callbacks must then record the value alone, without
+	 * the variant tag, and the context size is computed once when all
+	 * the context fields have a fixed size. The contexts added before
+	 * the provider is registered keep the variant type and record no
+	 * value.
+	 */
+	enum lttng_ust_dynamic_type fixed_type;
 };
 
+/*
+ * Returns the fixed type of a provider, LTTNG_UST_DYNAMIC_TYPE_NONE for
+ * providers built before fixed types.
+ */
+static inline
+enum lttng_ust_dynamic_type lttng_ust_context_provider_fixed_type(
+		const struct lttng_ust_context_provider *provider)
+{
+	if (provider->struct_size < offsetof(struct lttng_ust_context_provider, fixed_type)
+			+ sizeof(provider->fixed_type))
+		return LTTNG_UST_DYNAMIC_TYPE_NONE;
+	return provider->fixed_type;
+}
+
 /*
  * Application context callback private data
  *
@@ -86,6 +113,9 @@ struct lttng_ust_app_context {
 	char *ctx_name;
 
 	/* End of base ABI. Fields below should be used after checking struct_size. */
+
+	/* Type of the context field, LTTNG_UST_DYNAMIC_TYPE_NONE for a variant. */
+	enum lttng_ust_dynamic_type fixed_type;
 };
 
 /*
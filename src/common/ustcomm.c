@@ -29,7 +29,7 @@
 #include "common/events.h"
 #include "common/compat/pthread.h"
 
-#define USTCOMM_MAX_SEND_FDS	4
+#define USTCOMM_MAX_SEND_FDS	USTCOMM_STREAMS_FDS_PER_MSG
 
 static
 ssize_t count_fields_recursive(size_t nr_fields,
@@ -294,23 +294,20 @@ ssize_t ustcomm_recv_unix_sock(int sock, void *buf, size_t len)
 }
 
 /*
- * ustcomm_send_unix_sock
+ * ustcomm_send_unix_sock_iov
  *
- * Send buf data of size len. Using sendmsg API.
+ * Send the @iovcnt buffers of iov in a single sendmsg call.
  * Return the size of sent data.
  */
-ssize_t ustcomm_send_unix_sock(int sock, const void *buf, size_t len)
+ssize_t ustcomm_send_unix_sock_iov(int sock, struct iovec *iov, size_t iovcnt)
 {
 	struct msghdr msg;
-	struct iovec iov[1];
 	ssize_t ret;
 
 	memset(&msg, 0, sizeof(msg));
 
-	iov[0].iov_base = (void *) buf;
-	iov[0].iov_len = len;
 	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
+	msg.msg_iovlen = iovcnt;
 
 	/*
 	 * Using the MSG_NOSIGNAL when sending data from sessiond to
@@ -336,6 +333,21 @@ ssize_t ustcomm_send_unix_sock(int sock, const void *buf, size_t len)
 	return ret;
 }
 
+/*
+ * ustcomm_send_unix_sock
+ *
+ * Send buf data of size len. Using sendmsg API.
+ * Return the size of sent data.
+ */
+ssize_t ustcomm_send_unix_sock(int sock, const void *buf, size_t len)
+{
+	struct iovec iov[1];
+
+	iov[0].iov_base = (void *) buf;
+	iov[0].iov_len = len;
+	return ustcomm_send_unix_sock_iov(sock, iov, 1);
+}
+
 /*
  * Send a message accompanied by fd(s) over a unix socket.
  *
@@ -471,25 +483,39 @@ end:
 	return ret;
 }
 
-int ustcomm_send_app_msg(int sock, struct ustcomm_ust_msg *lum)
+/*
+ * Send a command message immediately followed by its @len bytes of
+ * additional payload, in a single sendmsg call.
+ */
+int ustcomm_send_app_msg_payload(int sock, struct ustcomm_ust_msg *lum,
+		const void *payload, size_t len)
 {
-	ssize_t len;
+	struct iovec iov[2];
+	size_t iovcnt = 1;
+	ssize_t ret;
 
-	len = ustcomm_send_unix_sock(sock, lum, sizeof(*lum));
-	switch (len) {
-	case sizeof(*lum):
-		break;
-	default:
-		if (len < 0) {
-			return len;
-		} else {
-			ERR("incorrect message size: %zd\n", len);
-			return -EINVAL;
-		}
+	iov[0].iov_base = lum;
+	iov[0].iov_len = sizeof(*lum);
+	if (len) {
+		iov[1].iov_base = (void *) payload;
+		iov[1].iov_len = len;
+		iovcnt++;
+	}
+	ret = ustcomm_send_unix_sock_iov(sock, iov, iovcnt);
+	if (ret < 0)
+		return ret;
+	if (ret != sizeof(*lum) + len) {
+		ERR("incorrect message size: %zd\n", ret);
+		return -EINVAL;
 	}
 	return 0;
 }
 
+int ustcomm_send_app_msg(int sock, struct ustcomm_ust_msg *lum)
+{
+	return ustcomm_send_app_msg_payload(sock, lum, NULL, 0);
+}
+
 int ustcomm_recv_app_reply(int sock, struct ustcomm_ust_reply *lur,
 			  uint32_t expected_handle, uint32_t expected_cmd)
 {
@@ -706,6 +732,60 @@ error:
 	return ret;
 }
 
+/*
+ * Receive the @nb_fd shm and wakeup fds of a LTTNG_UST_ABI_STREAMS
+ * command, in chunks of USTCOMM_STREAMS_FDS_PER_MSG, and add them to the
+ * fd tracker. On error, the fds received so far are closed.
+ */
+int ustcomm_recv_streams_fds_from_sessiond(int sock,
+		int *fds, size_t nb_fd)
+{
+	size_t i, nr_recv = 0;
+	int ret;
+
+	lttng_ust_lock_fd_tracker();
+	while (nr_recv < nb_fd) {
+		size_t chunk = nb_fd - nr_recv;
+		ssize_t len;
+
+		if (chunk > USTCOMM_STREAMS_FDS_PER_MSG)
+			chunk = USTCOMM_STREAMS_FDS_PER_MSG;
+		len = ustcomm_recv_fds_unix_sock(sock, &fds[nr_recv], chunk);
+		if (len <= 0) {
+			ret = len < 0 ? len : -EIO;
+			goto error;
+		}
+		for (i = nr_recv; i < nr_recv + chunk; i++) {
+			ret = lttng_ust_add_fd_to_tracker(fds[i]);
+			if (ret < 0) {
+				size_t j;
+
+				/* Close the fds of this chunk not yet tracked. */
+				for (j = i; j < nr_recv + chunk; j++) {
+					if (close(fds[j]))
+						PERROR("close on received stream fd");
+				}
+				nr_recv = i;
+				ret = -EIO;
+				goto error;
+			}
+			fds[i] = ret;
+		}
+		nr_recv += chunk;
+	}
+	lttng_ust_unlock_fd_tracker();
+	return 0;
+
+error:
+	for (i = 0; i < nr_recv; i++) {
+		if (close(fds[i]))
+			PERROR("close on stream fd");
+		fds[i] = -1;
+	}
+	lttng_ust_unlock_fd_tracker();
+	return ret;
+}
+
 ssize_t ustcomm_recv_counter_from_sessiond(int sock,
 		void **_counter_data, uint64_t var_len)
 {
@@ -1355,33 +1435,47 @@ error_type:
 }
 
 /*
+ * Serialize the fields of an event. The serialized fields are allocated
+ * and must be freed by the caller, unless there are none.
  * Returns 0 on success, negative error value on error.
  */
-int ustcomm_register_event(int sock,
-	struct lttng_ust_session *session,
+int ustcomm_serialize_event_fields(struct lttng_ust_session *session,
+	size_t nr_fields,		/* fields */
+	const struct lttng_ust_event_field * const *lttng_fields,
+	size_t *nr_write_fields,	/* serialized fields (output) */
+	struct lttng_ust_ctl_field **fields)
+{
+	*nr_write_fields = 0;
+	*fields = NULL;
+	if (!nr_fields)
+		return 0;
+	return alloc_serialize_fields(session, nr_write_fields, fields,
+			nr_fields, lttng_fields);
+}
+
+/*
+ * Send an event registration request with already serialized fields,
+ * without waiting for its reply.
+ * Returns 0 on success, negative error value on error.
+ */
+int ustcomm_register_event_send(int sock,
 	int session_objd,		/* session descriptor */
 	int channel_objd,		/* channel descriptor */
 	const char *event_name,		/* event name (input) */
 	int loglevel,
 	const char *signature,		/* event signature (input) */
-	size_t nr_fields,		/* fields */
-	const struct lttng_ust_event_field * const *lttng_fields,
-	const char *model_emf_uri,
-	uint32_t *id)			/* event id (output) */
+	size_t nr_write_fields,		/* serialized fields */
+	const struct lttng_ust_ctl_field *fields,
+	const char *model_emf_uri)
 {
 	ssize_t len;
 	struct {
 		struct ustcomm_notify_hdr header;
 		struct ustcomm_notify_event_msg m;
 	} msg;
-	struct {
-		struct ustcomm_notify_hdr header;
-		struct ustcomm_notify_event_reply r;
-	} reply;
 	size_t signature_len, fields_len, model_emf_uri_len;
-	struct lttng_ust_ctl_field *fields = NULL;
-	size_t nr_write_fields = 0;
-	int ret;
+	struct iovec iov[4];
+	size_t iovcnt = 0;
 
 	memset(&msg, 0, sizeof(msg));
 	msg.header.notify_cmd = LTTNG_UST_CTL_NOTIFY_CMD_EVENT;
@@ -1393,14 +1487,6 @@ int ustcomm_register_event(int sock,
 	signature_len = strlen(signature) + 1;
 	msg.m.signature_len = signature_len;
 
-	/* Calculate fields len, serialize fields. */
-	if (nr_fields > 0) {
-		ret = alloc_serialize_fields(session, &nr_write_fields, &fields,
-				nr_fields, lttng_fields);
-		if (ret)
-			return ret;
-	}
-
 	fields_len = sizeof(*fields) * nr_write_fields;
 	msg.m.fields_len = fields_len;
 	if (model_emf_uri) {
@@ -1410,52 +1496,43 @@ int ustcomm_register_event(int sock,
 	}
 	msg.m.model_emf_uri_len = model_emf_uri_len;
 
-	len = ustcomm_send_unix_sock(sock, &msg, sizeof(msg));
-	if (len > 0 && len != sizeof(msg)) {
-		ret = -EIO;
-		goto error_fields;
-	}
-	if (len < 0) {
-		ret = len;
-		goto error_fields;
+	/* send message, signature, fields and model_emf_uri at once */
+	iov[iovcnt].iov_base = &msg;
+	iov[iovcnt++].iov_len = sizeof(msg);
+	iov[iovcnt].iov_base = (void *) signature;
+	iov[iovcnt++].iov_len = signature_len;
+	if (fields_len > 0) {
+		iov[iovcnt].iov_base = (void *) fields;
+		iov[iovcnt++].iov_len = fields_len;
 	}
-
-	/* send signature */
-	len = ustcomm_send_unix_sock(sock, signature, signature_len);
-	if (len > 0 && len != signature_len) {
-		ret = -EIO;
-		goto error_fields;
+	if (model_emf_uri_len) {
+		iov[iovcnt].iov_base = (void *) model_emf_uri;
+		iov[iovcnt++].iov_len = model_emf_uri_len;
 	}
+	len = ustcomm_send_unix_sock_iov(sock, iov, iovcnt);
 	if (len < 0) {
-		ret = len;
-		goto error_fields;
+		return len;
 	}
-
-	/* send fields */
-	if (fields_len > 0) {
-		len = ustcomm_send_unix_sock(sock, fields, fields_len);
-		if (len > 0 && len != fields_len) {
-			ret = -EIO;
-			goto error_fields;
-		}
-		if (len < 0) {
-			ret = len;
-			goto error_fields;
-		}
+	if (len != sizeof(msg) + signature_len + fields_len + model_emf_uri_len) {
+		return -EIO;
 	}
-	free(fields);
+	return 0;
+}
 
-	if (model_emf_uri_len) {
-		/* send model_emf_uri */
-		len = ustcomm_send_unix_sock(sock, model_emf_uri,
-				model_emf_uri_len);
-		if (len > 0 && len != model_emf_uri_len) {
-			return -EIO;
-		}
-		if (len < 0) {
-			return len;
-		}
-	}
+/*
+ * Receive the reply to the oldest event registration request sent on
+ * the socket.
+ * Returns 0 on success, negative error value on error.
+ */
+int ustcomm_register_event_recv(int sock,
+	const char *event_name,		/* event name (input) */
+	uint32_t *id)			/* event id (output) */
+{
+	ssize_t len;
+	struct {
+		struct ustcomm_notify_hdr header;
+		struct ustcomm_notify_event_reply r;
+	} reply;
 
 	/* receive reply */
 	len = ustcomm_recv_unix_sock(sock, &reply, sizeof(reply));
@@ -1463,10 +1540,10 @@ int ustcomm_register_event(int sock,
 	case 0:	/* orderly shutdown */
 		return -EPIPE;
 	case sizeof(reply):
-		if (reply.header.notify_cmd != msg.header.notify_cmd) {
+		if (reply.header.notify_cmd != LTTNG_UST_CTL_NOTIFY_CMD_EVENT) {
 			ERR("Unexpected result message command "
 				"expected: %u vs received: %u\n",
-				msg.header.notify_cmd, reply.header.notify_cmd);
+				LTTNG_UST_CTL_NOTIFY_CMD_EVENT, reply.header.notify_cmd);
 			return -EINVAL;
 		}
 		if (reply.r.ret_code > 0)
@@ -1488,36 +1565,59 @@ int ustcomm_register_event(int sock,
 			return len;
 		}
 	}
-	/* Unreached. */
+}
 
-	/* Error path only. */
-error_fields:
+/*
+ * Returns 0 on success, negative error value on error.
+ */
+int ustcomm_register_event(int sock,
+	struct lttng_ust_session *session,
+	int session_objd,		/* session descriptor */
+	int channel_objd,		/* channel descriptor */
+	const char *event_name,		/* event name (input) */
+	int loglevel,
+	const char *signature,		/* event signature (input) */
+	size_t nr_fields,		/* fields */
+	const struct lttng_ust_event_field * const *lttng_fields,
+	const char *model_emf_uri,
+	uint32_t *id)			/* event id (output) */
+{
+	struct lttng_ust_ctl_field *fields;
+	size_t nr_write_fields;
+	int ret;
+
+	ret = ustcomm_serialize_event_fields(session, nr_fields, lttng_fields,
+			&nr_write_fields, &fields);
+	if (ret)
+		return ret;
+	ret = ustcomm_register_event_send(sock, session_objd, channel_objd,
+			event_name, loglevel, signature, nr_write_fields,
+			fields, model_emf_uri);
 	free(fields);
-	return ret;
+	if (ret)
+		return ret;
+	return ustcomm_register_event_recv(sock, event_name, id);
 }
 
 /*
+ * Send an enumeration registration request, without waiting for its
+ * reply.
  * Returns 0 on success, negative error value on error.
- * Returns -EPIPE or -ECONNRESET if other end has hung up.
  */
-int ustcomm_register_enum(int sock,
+int ustcomm_register_enum_send(int sock,
 	int session_objd,		/* session descriptor */
 	const char *enum_name,		/* enum name (input) */
 	size_t nr_entries,		/* entries */
-	const struct lttng_ust_enum_entry * const *lttng_entries,
-	uint64_t *id)
+	const struct lttng_ust_enum_entry * const *lttng_entries)
 {
 	ssize_t len;
 	struct {
 		struct ustcomm_notify_hdr header;
 		struct ustcomm_notify_enum_msg m;
 	} msg;
-	struct {
-		struct ustcomm_notify_hdr header;
-		struct ustcomm_notify_enum_reply r;
-	} reply;
 	size_t entries_len;
 	struct lttng_ust_ctl_enum_entry *entries = NULL;
+	struct iovec iov[2];
 	int ret;
 
 	memset(&msg, 0, sizeof(msg));
@@ -1537,30 +1637,35 @@ int ustcomm_register_enum(int sock,
 	entries_len = sizeof(*entries) * nr_entries;
 	msg.m.entries_len = entries_len;
 
-	len = ustcomm_send_unix_sock(sock, &msg, sizeof(msg));
-	if (len > 0 && len != sizeof(msg)) {
-		ret = -EIO;
-		goto error_entries;
-	}
-	if (len < 0) {
-		ret = len;
-		goto error_entries;
-	}
-
-	/* send entries */
-	if (entries_len > 0) {
-		len = ustcomm_send_unix_sock(sock, entries, entries_len);
-		if (len > 0 && len != entries_len) {
-			ret = -EIO;
-			goto error_entries;
-		}
-		if (len < 0) {
-			ret = len;
-			goto error_entries;
-		}
-	}
+	/* send message and entries at once */
+	iov[0].iov_base = &msg;
+	iov[0].iov_len = sizeof(msg);
+	iov[1].iov_base = entries;
+	iov[1].iov_len = entries_len;
+	len = ustcomm_send_unix_sock_iov(sock, iov, entries_len > 0 ? 2 : 1);
 	free(entries);
-	entries = NULL;
+	if (len < 0)
+		return len;
+	if (len != sizeof(msg) + entries_len)
+		return -EIO;
+	return 0;
+}
+
+/*
+ * Receive the reply to the oldest pending enumeration registration
+ * request.
+ * Returns 0 on success, negative error value on error.
+ * Returns -EPIPE or -ECONNRESET if other end has hung up.
+ */
+int ustcomm_register_enum_recv(int sock,
+	const char *enum_name,		/* enum name (input) */
+	uint64_t *id)			/* enum id (output) */
+{
+	ssize_t len;
+	struct {
+		struct ustcomm_notify_hdr header;
+		struct ustcomm_notify_enum_reply r;
+	} reply;
 
 	/* receive reply */
 	len = ustcomm_recv_unix_sock(sock, &reply, sizeof(reply));
@@ -1568,10 +1673,10 @@ int ustcomm_register_enum(int sock,
 	case 0:	/* orderly shutdown */
 		return -EPIPE;
 	case sizeof(reply):
-		if (reply.header.notify_cmd != msg.header.notify_cmd) {
+		if (reply.header.notify_cmd != LTTNG_UST_CTL_NOTIFY_CMD_ENUM) {
 			ERR("Unexpected result message command "
 				"expected: %u vs received: %u\n",
-				msg.header.notify_cmd, reply.header.notify_cmd);
+				LTTNG_UST_CTL_NOTIFY_CMD_ENUM, reply.header.notify_cmd);
 			return -EINVAL;
 		}
 		if (reply.r.ret_code > 0)
@@ -1593,11 +1698,26 @@ int ustcomm_register_enum(int sock,
 			return len;
 		}
 	}
-	return ret;
+}
 
-error_entries:
-	free(entries);
-	return ret;
+/*
+ * Returns 0 on success, negative error value on error.
+ * Returns -EPIPE or -ECONNRESET if other end has hung up.
+ */
+int ustcomm_register_enum(int sock,
+	int session_objd,		/* session descriptor */
+	const char *enum_name,		/* enum name (input) */
+	size_t nr_entries,		/* entries */
+	const struct lttng_ust_enum_entry * const *lttng_entries,
+	uint64_t *id)
+{
+	int ret;
+
+	ret = ustcomm_register_enum_send(sock, session_objd, enum_name,
+			nr_entries, lttng_entries);
+	if (ret)
+		return ret;
+	return ustcomm_register_enum_recv(sock, enum_name, id);
 }
 
 /*
@@ -1624,6 +1744,7 @@ int ustcomm_register_channel(int sock,
 	} reply;
 	size_t fields_len;
 	struct lttng_ust_ctl_field *fields = NULL;
+	struct iovec iov[2];
 	int ret;
 	size_t nr_write_fields = 0;
 
@@ -1642,28 +1763,18 @@ int ustcomm_register_channel(int sock,
 
 	fields_len = sizeof(*fields) * nr_write_fields;
 	msg.m.ctx_fields_len = fields_len;
-	len = ustcomm_send_unix_sock(sock, &msg, sizeof(msg));
-	if (len > 0 && len != sizeof(msg)) {
-		free(fields);
-		return -EIO;
-	}
+	/* send message and fields at once */
+	iov[0].iov_base = &msg;
+	iov[0].iov_len = sizeof(msg);
+	iov[1].iov_base = fields;
+	iov[1].iov_len = fields_len;
+	len = ustcomm_send_unix_sock_iov(sock, iov, fields_len > 0 ? 2 : 1);
+	free(fields);
 	if (len < 0) {
-		free(fields);
 		return len;
 	}
-
-	/* send fields */
-	if (fields_len > 0) {
-		len = ustcomm_send_unix_sock(sock, fields, fields_len);
-		free(fields);
-		if (len > 0 && len != fields_len) {
-			return -EIO;
-		}
-		if (len < 0) {
-			return len;
-		}
-	} else {
-		free(fields);
+	if (len != sizeof(msg) + fields_len) {
+		return -EIO;
 	}
 
 	len = ustcomm_recv_unix_sock(sock, &reply, sizeof(reply));
@@ -1685,6 +1796,7 @@ int ustcomm_register_channel(int sock,
 		switch (reply.r.header_type) {
 		case 1:
 		case 2:
+		case 3:
 			*header_type = reply.r.header_type;
 			break;
 		default:
@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <limits.h>
 #include <unistd.h>
+#include <sys/uio.h>
 #include <lttng/ust-abi.h>
 #include <lttng/ust-error.h>
 #include <lttng/ust-compiler.h>
@@ -77,6 +78,8 @@ struct ustcomm_ust_msg {
 		struct lttng_ust_abi_context context;
 		struct lttng_ust_abi_tracer_version version;
 		struct lttng_ust_abi_tracepoint_iter tracepoint;
+		struct lttng_ust_abi_tracepoint_sample tracepoint_sample;
+		struct lttng_ust_abi_filter_stats filter_stats;
 		struct {
 			uint32_t data_size;	/* following filter data */
 			uint32_t reloc_offset;
@@ -102,10 +105,35 @@ struct ustcomm_ust_msg {
 			/* Length of struct lttng_ust_abi_event_notifier */
 			uint32_t len;
 		} event_notifier;
+		struct {
+			uint32_t count;	/* how many struct ustcomm_ust_msg follow */
+		} __attribute__((packed)) batch;
+		struct {
+			uint32_t count;	/* how many struct lttng_ust_abi_stream follow */
+			uint32_t arena;	/* streams share one shm fd */
+		} __attribute__((packed)) streams;
 		char padding[USTCOMM_MSG_PADDING2];
 	} u;
 } __attribute__((packed));
 
+/*
+ * The LTTNG_UST_ABI_BATCH message is followed by up to
+ * USTCOMM_BATCH_MAX_CMDS struct ustcomm_ust_msg. On success, its reply
+ * is followed by one struct ustcomm_ust_reply per command, in order.
+ */
+#define USTCOMM_BATCH_MAX_CMDS		256
+
+/*
+ * The LTTNG_UST_ABI_STREAMS message is followed by up to
+ * USTCOMM_STREAMS_MAX struct lttng_ust_abi_stream, and then by the shm
+ * fd and wakeup fd of each stream, in order, sent at most
+ * USTCOMM_STREAMS_FDS_PER_MSG at a time. When the streams are in a
+ * channel arena, the arena shm fd is sent once, followed by the wakeup
+ * fd of each stream.
+ */
+#define USTCOMM_STREAMS_MAX		1024
+#define USTCOMM_STREAMS_FDS_PER_MSG	64
+
 /*
  * Data structure for the response from UST to the session daemon.
  * cmd_type is sent back in the reply for validation.
@@ -127,6 +155,7 @@ struct ustcomm_ust_reply {
 		} __attribute__((packed)) stream;
 		struct lttng_ust_abi_tracer_version version;
 		struct lttng_ust_abi_tracepoint_iter tracepoint;
+		struct lttng_ust_abi_filter_stats filter_stats;
 		char padding[USTCOMM_REPLY_PADDING2];
 	} u;
 } __attribute__((packed));
@@ -218,6 +247,9 @@ ssize_t ustcomm_recv_unix_sock(int sock, void *buf, size_t len)
 ssize_t ustcomm_send_unix_sock(int sock, const void *buf, size_t len)
 	__attribute__((visibility("hidden")));
 
+ssize_t ustcomm_send_unix_sock_iov(int sock, struct iovec *iov, size_t iovcnt)
+	__attribute__((visibility("hidden")));
+
 ssize_t ustcomm_send_fds_unix_sock(int sock, int *fds, size_t nb_fd)
 	__attribute__((visibility("hidden")));
 
@@ -230,6 +262,10 @@ const char *ustcomm_get_readable_code(int code)
 int ustcomm_send_app_msg(int sock, struct ustcomm_ust_msg *lum)
 	__attribute__((visibility("hidden")));
 
+int ustcomm_send_app_msg_payload(int sock, struct ustcomm_ust_msg *lum,
+		const void *payload, size_t len)
+	__attribute__((visibility("hidden")));
+
 int ustcomm_recv_app_reply(int sock, struct ustcomm_ust_reply *lur,
 	uint32_t expected_handle, uint32_t expected_cmd)
 	__attribute__((visibility("hidden")));
@@ -251,6 +287,10 @@ int ustcomm_recv_stream_from_sessiond(int sock,
 		int *shm_fd, int *wakeup_fd)
 	__attribute__((visibility("hidden")));
 
+int ustcomm_recv_streams_fds_from_sessiond(int sock,
+		int *fds, size_t nb_fd)
+	__attribute__((visibility("hidden")));
+
 ssize_t ustcomm_recv_event_notifier_notif_fd_from_sessiond(int sock,
 		int *event_notifier_notif_fd)
 	__attribute__((visibility("hidden")));
@@ -295,6 +335,38 @@ int ustcomm_register_event(int sock,
 	uint32_t *id)			/* event id (output) */
 	__attribute__((visibility("hidden")));
 
+/*
+ * Event registration split in steps: the fields can be serialized once
+ * for several registrations, and several requests can be sent before
+ * their replies are received. Replies are received in the order the
+ * requests were sent.
+ *
+ * Returns 0 on success, negative error value on error.
+ * Returns -EPIPE or -ECONNRESET if other end has hung up.
+ */
+int ustcomm_serialize_event_fields(struct lttng_ust_session *session,
+	size_t nr_fields,		/* fields */
+	const struct lttng_ust_event_field * const *lttng_fields,
+	size_t *nr_write_fields,	/* serialized fields (output) */
+	struct lttng_ust_ctl_field **fields)
+	__attribute__((visibility("hidden")));
+
+int ustcomm_register_event_send(int sock,
+	int session_objd,		/* session descriptor */
+	int channel_objd,		/* channel descriptor */
+	const char *event_name,		/* event name (input) */
+	int loglevel,
+	const char *signature,		/* event signature (input) */
+	size_t nr_write_fields,		/* serialized fields */
+	const struct lttng_ust_ctl_field *fields,
+	const char *model_emf_uri)
+	__attribute__((visibility("hidden")));
+
+int ustcomm_register_event_recv(int sock,
+	const char *event_name,		/* event name (input) */
+	uint32_t *id)			/* event id (output) */
+	__attribute__((visibility("hidden")));
+
 /*
  * Returns 0 on success, negative error value on error.
  * Returns -EPIPE or -ECONNRESET if other end has hung up.
@@ -307,6 +379,26 @@ int ustcomm_register_enum(int sock,
 	uint64_t *id)			/* enum id (output) */
 	__attribute__((visibility("hidden")));
 
+/*
+ * Enumeration registration split in steps: several requests can be sent
+ * before their replies are received, in the order the requests were
+ * sent.
+ *
+ * Returns 0 on success, negative error value on error.
+ * Returns -EPIPE or -ECONNRESET if other end has hung up.
+ */
+int ustcomm_register_enum_send(int sock,
+	int session_objd,		/* session descriptor */
+	const char *enum_name,		/* enum name (input) */
+	size_t nr_entries,		/* entries */
+	const struct lttng_ust_enum_entry * const *entries)
+	__attribute__((visibility("hidden")));
+
+int ustcomm_register_enum_recv(int sock,
+	const char *enum_name,		/* enum name (input) */
+	uint64_t *id)			/* enum id (output) */
+	__attribute__((visibility("hidden")));
+
 /*
  * Returns 0 on success, negative error value on error.
  * Returns -EPIPE or -ECONNRESET if other end has hung up.
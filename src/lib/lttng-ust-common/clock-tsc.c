@@ -0,0 +1,337 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Built-in trace clock reading the CPU cycle counter (TSC on x86, the
+ * virtual counter on aarch64) instead of calling clock_gettime().
+ *
+ * It provides the same nanoseconds as the default CLOCK_MONOTONIC trace
+ * clock, so it keeps the same clock description, which the session
+ * daemon generates on its own. The counter is converted with a
+ * multiplier calibrated against CLOCK_MONOTONIC and resynchronized once
+ * per RESYNC_NS: the multiplier of the next period is slewed so the
+ * clock converges back to CLOCK_MONOTONIC without going backward.
+ *
+ * The conversion parameters are double-buffered, each buffer protected
+ * by a sequence counter. The resynchronization writes the unused buffer
+ * before publishing it, so readers, including signal handlers which
+ * interrupt it, never wait for it.
+ *
+ * The clock never goes backward, across all the threads of the process:
+ * the values of a period are lower than its end, the base of the next
+ * period is at least the end of the previous one, and a reader finding
+ * the period over while another thread resynchronizes returns the end
+ * of the period rather than a CLOCK_MONOTONIC value. Until the first
+ * calibration, the values are CLOCK_MONOTONIC ones read by the thread
+ * holding the calibration lock, the others returning the last of them.
+ */
+
+#define _LGPL_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lttng/ust-arch.h>
+#include <urcu/arch.h>
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+
+#include "common/logging.h"
+#include "common/macros.h"
+#include "common/ust-fd.h"
+
+#include "lib/lttng-ust-common/clock.h"
+
+#if defined(LTTNG_UST_ARCH_X86) || defined(LTTNG_UST_ARCH_AARCH64)
+
+#ifdef LTTNG_UST_ARCH_X86
+#include <sys/prctl.h>
+#endif
+
+/* Fixed point shift of the nanoseconds per cycle multiplier. */
+#define TSC_SHIFT		24
+
+/* Resynchronization period with CLOCK_MONOTONIC. */
+#define RESYNC_NS		1000000000ULL
+
+/* Initial calibration period, during which CLOCK_MONOTONIC is used. */
+#define CALIBRATION_NS		10000000ULL
+
+#define CLOCKSOURCE_PATH	"/sys/devices/system/clocksource/clocksource0/current_clocksource"
+
+#ifdef LTTNG_UST_ARCH_X86
+#define RELIABLE_CLOCKSOURCE	"tsc"
+#else
+#define RELIABLE_CLOCKSOURCE	"arch_sys_counter"
+#endif
+
+struct tsc_params {
+	uint64_t base_tsc;
+	uint64_t base_ns;
+	uint64_t mult;		/* Nanoseconds per cycle << TSC_SHIFT. */
+	uint64_t max_delta;	/* Cycles until resynchronization. */
+};
+
+struct tsc_clock {
+	struct tsc_params params[2];
+	unsigned int seq[2];
+	unsigned int current;
+
+	/* Calibration state, protected by lock. */
+	pthread_mutex_t lock;
+	bool calibrated;
+	uint64_t last_tsc;
+	uint64_t last_ns;
+	/* Last value returned before the first calibration. */
+	uint64_t raw_max;
+};
+
+static struct tsc_clock tsc_clock = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static
+uint64_t tsc_read(void)
+{
+#ifdef LTTNG_UST_ARCH_X86
+	uint32_t low, high;
+
+	/* Do not let rdtsc execute ahead of the preceding instructions. */
+	asm volatile ("lfence; rdtsc" : "=a" (low), "=d" (high) : : "memory");
+	return ((uint64_t) high << 32) | low;
+#else
+	uint64_t cnt;
+
+	asm volatile ("isb; mrs %0, cntvct_el0" : "=r" (cnt) : : "memory");
+	return cnt;
+#endif
+}
+
+/*
+ * Sample the counter and CLOCK_MONOTONIC together, the counter value
+ * being the middle of the clock_gettime() call.
+ */
+static
+void tsc_sample(uint64_t *tsc, uint64_t *ns)
+{
+	uint64_t before;
+
+	before = tsc_read();
+	*ns = trace_clock_read64_monotonic();
+	*tsc = before + ((tsc_read() - before) >> 1);
+}
+
+/* Called with lock held. */
+static
+void tsc_publish(const struct tsc_params *params)
+{
+	unsigned int next = !tsc_clock.current;
+
+	CMM_STORE_SHARED(tsc_clock.seq[next], tsc_clock.seq[next] + 1);
+	cmm_smp_wmb();
+	tsc_clock.params[next] = *params;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(tsc_clock.seq[next], tsc_clock.seq[next] + 1);
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(tsc_clock.current, next);
+}
+
+/* End of the period of @params, above all its values. */
+static
+uint64_t tsc_period_end(const struct tsc_params *params)
+{
+	return params->base_ns
+		+ ((params->max_delta * params->mult) >> TSC_SHIFT);
+}
+
+/*
+ * Lowest value the clock can return from now on: the end of the current
+ * period, or the last value returned before the first calibration.
+ * Called with lock held.
+ */
+static
+uint64_t tsc_floor(void)
+{
+	if (!tsc_clock.calibrated)
+		return tsc_clock.raw_max;
+	return tsc_period_end(&tsc_clock.params[tsc_clock.current]);
+}
+
+/*
+ * Slow path, taken once per resynchronization period, and at each read
+ * until the initial calibration is done. Returns false, without a
+ * value, when another thread holds the lock.
+ */
+static
+bool tsc_resync(uint64_t *value)
+{
+	struct tsc_params params, *old;
+	uint64_t tsc, ns, mult, error;
+
+	if (pthread_mutex_trylock(&tsc_clock.lock))
+		return false;
+	old = &tsc_clock.params[tsc_clock.current];
+	tsc_sample(&tsc, &ns);
+	if (tsc_clock.calibrated && tsc - old->base_tsc < old->max_delta) {
+		/* Resynchronized by another thread meanwhile. */
+		ns = old->base_ns + (((tsc - old->base_tsc) * old->mult) >> TSC_SHIFT);
+		goto unlock;
+	}
+	if (!tsc_clock.last_tsc) {
+		tsc_clock.last_tsc = tsc;
+		tsc_clock.last_ns = ns;
+		goto raw;
+	}
+	if (ns - tsc_clock.last_ns < CALIBRATION_NS || tsc <= tsc_clock.last_tsc)
+		goto raw;
+
+	mult = ((ns - tsc_clock.last_ns) << TSC_SHIFT)
+		/ (tsc - tsc_clock.last_tsc);
+	if (!mult)
+		goto raw;
+	/* Never go backward from the values already returned. */
+	params.base_tsc = tsc;
+	params.base_ns = max_t(uint64_t, ns, tsc_floor());
+	/* Slew the next period to absorb the advance over the clock. */
+	error = min_t(uint64_t, params.base_ns - ns, RESYNC_NS / 2);
+	params.mult = mult * (RESYNC_NS - error) / RESYNC_NS;
+	params.max_delta = (RESYNC_NS << TSC_SHIFT) / mult;
+	tsc_publish(&params);
+	tsc_clock.calibrated = true;
+	tsc_clock.last_tsc = tsc;
+	tsc_clock.last_ns = ns;
+	ns = params.base_ns;
+	goto unlock;
+
+raw:
+	/*
+	 * Not calibrated yet: return the monotonic clock. Once calibrated,
+	 * failing to resynchronize saturates at the end of the period,
+	 * like the readers which do not get the lock.
+	 */
+	if (tsc_clock.calibrated) {
+		ns = tsc_floor();
+		goto unlock;
+	}
+	ns = max_t(uint64_t, ns, tsc_clock.raw_max);
+	CMM_STORE_SHARED(tsc_clock.raw_max, ns);
+unlock:
+	pthread_mutex_unlock(&tsc_clock.lock);
+	*value = ns;
+	return true;
+}
+
+uint64_t lttng_ust_tsc_clock_read64(void)
+{
+	for (;;) {
+		unsigned int current, seq;
+		struct tsc_params params;
+		uint64_t delta, ns;
+
+		current = CMM_LOAD_SHARED(tsc_clock.current);
+		seq = CMM_LOAD_SHARED(tsc_clock.seq[current]);
+		cmm_smp_rmb();
+		params = tsc_clock.params[current];
+		cmm_smp_rmb();
+		if (caa_unlikely((seq & 1)
+				|| CMM_LOAD_SHARED(tsc_clock.seq[current]) != seq))
+			continue;
+		delta = tsc_read() - params.base_tsc;
+		if (caa_likely(delta < params.max_delta))
+			return params.base_ns + ((delta * params.mult) >> TSC_SHIFT);
+		if (tsc_resync(&ns))
+			return ns;
+		/*
+		 * Another thread resynchronizes. Use its new period if it
+		 * is published already, else saturate at the end of the
+		 * current one, which the new period starts from.
+		 */
+		cmm_smp_rmb();
+		if (CMM_LOAD_SHARED(tsc_clock.current) != current
+				|| CMM_LOAD_SHARED(tsc_clock.seq[current]) != seq)
+			continue;
+		if (!params.max_delta)
+			return CMM_LOAD_SHARED(tsc_clock.raw_max);
+		return tsc_period_end(&params);
+	}
+}
+
+static
+void tsc_after_fork_child(void)
+{
+	pthread_mutex_init(&tsc_clock.lock, NULL);
+}
+
+/*
+ * Only use the counter when the kernel itself uses it as its clock
+ * source, which means it found it to be constant rate and synchronized
+ * across CPUs.
+ */
+static
+bool tsc_reliable(void)
+{
+	char buf[sizeof(RELIABLE_CLOCKSOURCE) + 1];
+	ssize_t len;
+	int fd;
+
+#ifdef LTTNG_UST_ARCH_X86
+	{
+		int tsc_mode;
+
+		/* The TSC may be disabled in this process. */
+		if (prctl(PR_GET_TSC, &tsc_mode, 0, 0, 0) == 0
+				&& tsc_mode != PR_TSC_ENABLE)
+			return false;
+	}
+#endif
+	lttng_ust_lock_fd_tracker();
+	fd = open(CLOCKSOURCE_PATH, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		lttng_ust_unlock_fd_tracker();
+		return false;
+	}
+	len = read(fd, buf, sizeof(buf));
+	if (close(fd))
+		PERROR("close");
+	lttng_ust_unlock_fd_tracker();
+	return len == sizeof(RELIABLE_CLOCKSOURCE)
+		&& !memcmp(buf, RELIABLE_CLOCKSOURCE "\n", len);
+}
+
+int lttng_ust_tsc_clock_init(void)
+{
+	static int state;
+	int ret;
+
+	if (state)
+		return state > 0 ? 0 : -1;
+	state = -1;
+	if (!tsc_reliable())
+		return -1;
+	ret = pthread_atfork(NULL, NULL, tsc_after_fork_child);
+	if (ret) {
+		ERR("pthread_atfork: %s", strerror(ret));
+		return -1;
+	}
+	state = 1;
+	return 0;
+}
+
+#else
+
+uint64_t lttng_ust_tsc_clock_read64(void)
+{
+	return trace_clock_read64_monotonic();
+}
+
+int lttng_ust_tsc_clock_init(void)
+{
+	return -1;
+}
+
+#endif
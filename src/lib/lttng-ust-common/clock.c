@@ -6,9 +6,15 @@
 
 #define _LGPL_SOURCE
 #include <dlfcn.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/timex.h>
+#endif
 
 #include <lttng/ust-clock.h>
 #include <lttng/ust-events.h>
@@ -28,6 +34,20 @@ struct lttng_ust_trace_clock user_tc;
 static
 void *clock_handle;
 
+/*
+ * The built-in cycle counter clock, installed when no clock override is
+ * enabled. It can still be replaced by a clock override.
+ */
+static
+struct lttng_ust_trace_clock tsc_tc;
+
+/*
+ * The built-in TAI clock, installed instead of the cycle counter clock
+ * when LTTNG_UST_CLOCK_TAI is set.
+ */
+static
+struct lttng_ust_trace_clock tai_tc;
+
 static
 uint64_t trace_clock_freq_monotonic(void)
 {
@@ -73,9 +93,60 @@ const char *trace_clock_description_monotonic(void)
 	return "Monotonic Clock";
 }
 
+#ifdef CLOCK_TAI
+
+/*
+ * CLOCK_TAI is read through the vDSO like CLOCK_MONOTONIC. On hosts
+ * whose system clock is synchronized with PTP (e.g. with phc2sys), it
+ * is common to all hosts, so traces recorded on different hosts can be
+ * merged without estimating their relative offset.
+ */
+static
+uint64_t trace_clock_read64_tai(void)
+{
+	struct timespec ts;
+
+	if (caa_unlikely(clock_gettime(CLOCK_TAI, &ts))) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+	}
+	return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/*
+ * The same UUID on all hosts, for trace viewers to consider the clocks
+ * of their traces as a single clock.
+ */
+static
+int trace_clock_uuid_tai(char *uuid)
+{
+	strcpy(uuid, "2d7c5f1e-8b4a-4c3e-9f61-7a0d3b5e9c12");
+	return 0;
+}
+
+static
+const char *trace_clock_name_tai(void)
+{
+	return "tai";
+}
+
+static
+const char *trace_clock_description_tai(void)
+{
+	return "International Atomic Time Clock";
+}
+
+#endif /* CLOCK_TAI */
+
+static
+bool trace_clock_is_overridden(void)
+{
+	return CMM_LOAD_SHARED(lttng_ust_trace_clock) == &user_tc;
+}
+
 int lttng_ust_trace_clock_set_read64_cb(lttng_ust_clock_read64_function read64_cb)
 {
-	if (CMM_LOAD_SHARED(lttng_ust_trace_clock))
+	if (trace_clock_is_overridden())
 		return -EBUSY;
 	user_tc.read64 = read64_cb;
 	return 0;
@@ -96,7 +167,7 @@ int lttng_ust_trace_clock_get_read64_cb(lttng_ust_clock_read64_function *read64_
 
 int lttng_ust_trace_clock_set_freq_cb(lttng_ust_clock_freq_function freq_cb)
 {
-	if (CMM_LOAD_SHARED(lttng_ust_trace_clock))
+	if (trace_clock_is_overridden())
 		return -EBUSY;
 	user_tc.freq = freq_cb;
 	return 0;
@@ -117,7 +188,7 @@ int lttng_ust_trace_clock_get_freq_cb(lttng_ust_clock_freq_function *freq_cb)
 
 int lttng_ust_trace_clock_set_uuid_cb(lttng_ust_clock_uuid_function uuid_cb)
 {
-	if (CMM_LOAD_SHARED(lttng_ust_trace_clock))
+	if (trace_clock_is_overridden())
 		return -EBUSY;
 	user_tc.uuid = uuid_cb;
 	return 0;
@@ -138,7 +209,7 @@ int lttng_ust_trace_clock_get_uuid_cb(lttng_ust_clock_uuid_function *uuid_cb)
 
 int lttng_ust_trace_clock_set_name_cb(lttng_ust_clock_name_function name_cb)
 {
-	if (CMM_LOAD_SHARED(lttng_ust_trace_clock))
+	if (trace_clock_is_overridden())
 		return -EBUSY;
 	user_tc.name = name_cb;
 	return 0;
@@ -159,7 +230,7 @@ int lttng_ust_trace_clock_get_name_cb(lttng_ust_clock_name_function *name_cb)
 
 int lttng_ust_trace_clock_set_description_cb(lttng_ust_clock_description_function description_cb)
 {
-	if (CMM_LOAD_SHARED(lttng_ust_trace_clock))
+	if (trace_clock_is_overridden())
 		return -EBUSY;
 	user_tc.description = description_cb;
 	return 0;
@@ -180,7 +251,7 @@ int lttng_ust_trace_clock_get_description_cb(lttng_ust_clock_description_functio
 
 int lttng_ust_enable_trace_clock_override(void)
 {
-	if (CMM_LOAD_SHARED(lttng_ust_trace_clock))
+	if (trace_clock_is_overridden())
 		return -EBUSY;
 	if (!user_tc.read64)
 		return -EINVAL;
@@ -196,6 +267,70 @@ int lttng_ust_enable_trace_clock_override(void)
 	return 0;
 }
 
+/*
+ * Use the cycle counter clock when LTTNG_UST_CLOCK_TSC is set and no
+ * clock override is enabled.
+ */
+static
+void lttng_ust_tsc_clock_enable(void)
+{
+	if (CMM_LOAD_SHARED(lttng_ust_trace_clock))
+		return;
+	if (!lttng_ust_getenv("LTTNG_UST_CLOCK_TSC"))
+		return;
+	if (lttng_ust_tsc_clock_init())
+		return;
+	tsc_tc.read64 = lttng_ust_tsc_clock_read64;
+	tsc_tc.freq = trace_clock_freq_monotonic;
+	tsc_tc.uuid = trace_clock_uuid_monotonic;
+	tsc_tc.name = trace_clock_name_monotonic;
+	tsc_tc.description = trace_clock_description_monotonic;
+	cmm_smp_mb();	/* Store callbacks before trace clock */
+	CMM_STORE_SHARED(lttng_ust_trace_clock, &tsc_tc);
+}
+
+/*
+ * Use the TAI clock when LTTNG_UST_CLOCK_TAI is set. Return 0 if it is
+ * enabled, -1 otherwise.
+ */
+static
+int lttng_ust_tai_clock_enable(void)
+{
+#ifdef CLOCK_TAI
+	struct timespec ts;
+
+	if (!lttng_ust_getenv("LTTNG_UST_CLOCK_TAI"))
+		return -1;
+	if (CMM_LOAD_SHARED(lttng_ust_trace_clock))
+		return 0;
+	if (clock_gettime(CLOCK_TAI, &ts)) {
+		PERROR("clock_gettime CLOCK_TAI");
+		return -1;
+	}
+#ifdef __linux__
+	{
+		struct timex tx = { .modes = 0 };
+
+		/* Without a TAI offset set by the time daemon, TAI is UTC. */
+		if (adjtimex(&tx) >= 0 && !tx.tai)
+			WARN("The kernel TAI offset is not set, CLOCK_TAI is equal to CLOCK_REALTIME");
+	}
+#endif
+	tai_tc.read64 = trace_clock_read64_tai;
+	tai_tc.freq = trace_clock_freq_monotonic;
+	tai_tc.uuid = trace_clock_uuid_tai;
+	tai_tc.name = trace_clock_name_tai;
+	tai_tc.description = trace_clock_description_tai;
+	cmm_smp_mb();	/* Store callbacks before trace clock */
+	CMM_STORE_SHARED(lttng_ust_trace_clock, &tai_tc);
+	return 0;
+#else
+	if (lttng_ust_getenv("LTTNG_UST_CLOCK_TAI"))
+		ERR("CLOCK_TAI is not supported on this platform");
+	return -1;
+#endif
+}
+
 void lttng_ust_clock_init(void)
 {
 	const char *libname;
@@ -204,8 +339,11 @@ void lttng_ust_clock_init(void)
 	if (clock_handle)
 		return;
 	libname = lttng_ust_getenv("LTTNG_UST_CLOCK_PLUGIN");
-	if (!libname)
+	if (!libname) {
+		if (lttng_ust_tai_clock_enable())
+			lttng_ust_tsc_clock_enable();
 		return;
+	}
 	clock_handle = dlopen(libname, RTLD_NOW);
 	if (!clock_handle) {
 		PERROR("Cannot load LTTng UST clock override library %s",
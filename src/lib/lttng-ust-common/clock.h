@@ -13,4 +13,14 @@
 void lttng_ust_clock_init(void)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Return 0 if the built-in cycle counter clock can be used, -1
+ * otherwise.
+ */
+int lttng_ust_tsc_clock_init(void)
+	__attribute__((visibility("hidden")));
+
+uint64_t lttng_ust_tsc_clock_read64(void)
+	__attribute__((visibility("hidden")));
+
 #endif /* _LTTNG_UST_COMMON_CLOCK_H */
@@ -6,6 +6,7 @@
  */
 
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,8 +15,8 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <sys/select.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <fcntl.h>
 #include <pthread.h>
@@ -24,7 +25,9 @@
 #include <urcu/compiler.h>
 #include <urcu/tls-compat.h>
 #include <urcu/system.h>
+#include <urcu/uatomic.h>
 
+#include "common/bitmap.h"
 #include "common/ust-fd.h"
 #include "common/macros.h"
 #include <lttng/ust-error.h>
@@ -35,17 +38,15 @@
 
 /* Operations on the fd set. */
 #define IS_FD_VALID(fd)			((fd) >= 0 && (fd) < lttng_ust_max_fd)
-#define GET_FD_SET_FOR_FD(fd, fd_sets)	(&((fd_sets)[(fd) / FD_SETSIZE]))
-#define CALC_INDEX_TO_SET(fd)		((fd) % FD_SETSIZE)
 #define IS_FD_STD(fd)			(IS_FD_VALID(fd) && (fd) <= STDERR_FILENO)
 
 /* Check fd validity before calling these. */
-#define ADD_FD_TO_SET(fd, fd_sets)	\
-		FD_SET(CALC_INDEX_TO_SET(fd), GET_FD_SET_FOR_FD(fd, fd_sets))
-#define IS_FD_SET(fd, fd_sets)		\
-		FD_ISSET(CALC_INDEX_TO_SET(fd), GET_FD_SET_FOR_FD(fd, fd_sets))
-#define DEL_FD_FROM_SET(fd, fd_sets)	\
-		FD_CLR(CALC_INDEX_TO_SET(fd), GET_FD_SET_FOR_FD(fd, fd_sets))
+#define ADD_FD_TO_SET(fd, set)		lttng_bitmap_set_bit(fd, set)
+#define IS_FD_SET(fd, set)		lttng_bitmap_test_bit(fd, set)
+#define DEL_FD_FROM_SET(fd, set)	lttng_bitmap_clear_bit(fd, set)
+
+/* Busy-wait iterations before sleeping for the unlocked closes. */
+#define FAST_CLOSE_SPIN		1000
 
 /*
  * Protect the lttng_fd_set. Nests within the ust_lock, and therefore
@@ -65,18 +66,32 @@ static pthread_mutex_t ust_safe_guard_fd_mutex = PTHREAD_MUTEX_INITIALIZER;
  */
 static DEFINE_URCU_TLS(int, ust_fd_mutex_nest);
 
-/* fd_set used to book keep fd being used by lttng-ust. */
-static fd_set *lttng_fd_set;
+/* Bitmap used to book keep fd being used by lttng-ust. */
+static unsigned long *lttng_fd_set;
 static int lttng_ust_max_fd;
-static int num_fd_sets;
+static int num_fd_set_longs;
 static int init_done;
 
+/*
+ * The application close() calls check whether the fd belongs to
+ * lttng-ust without taking ust_safe_guard_fd_mutex, unless it is held.
+ * A thread taking the mutex sets fd_tracker_locked, then waits for the
+ * unlocked closes already counted in fast_closers to complete, so it
+ * never opens an fd concurrently with them. The closes of the thread
+ * itself, interrupted by a signal handler taking the mutex, are not
+ * waited for.
+ */
+static int fd_tracker_locked;
+static long fast_closers;
+static DEFINE_URCU_TLS(long, ust_fd_fast_close_nest);
+
 /*
  * Force a read (imply TLS allocation for dlopen) of TLS variables.
  */
 void lttng_ust_fd_tracker_alloc_tls(void)
 {
 	asm volatile ("" : : "m" (URCU_TLS(ust_fd_mutex_nest)));
+	asm volatile ("" : : "m" (URCU_TLS(ust_fd_fast_close_nest)));
 }
 
 /*
@@ -103,21 +118,66 @@ void lttng_ust_fd_tracker_init(void)
 	 * hard limit.
 	 */
 	lttng_ust_max_fd = rlim.rlim_max;
-	num_fd_sets = lttng_ust_max_fd / FD_SETSIZE;
-	if (lttng_ust_max_fd % FD_SETSIZE)
-		++num_fd_sets;
+	num_fd_set_longs = lttng_ust_max_fd / CAA_BITS_PER_LONG;
+	if (lttng_ust_max_fd % CAA_BITS_PER_LONG)
+		++num_fd_set_longs;
 	if (lttng_fd_set != NULL) {
 		free(lttng_fd_set);
 		lttng_fd_set = NULL;
 	}
-	lttng_fd_set = malloc(num_fd_sets * (sizeof(fd_set)));
+	lttng_fd_set = malloc(num_fd_set_longs * sizeof(*lttng_fd_set));
 	if (!lttng_fd_set)
 		abort();
-	for (i = 0; i < num_fd_sets; i++)
-		FD_ZERO((&lttng_fd_set[i]));
+	for (i = 0; i < num_fd_set_longs; i++)
+		lttng_fd_set[i] = 0;
 	CMM_STORE_SHARED(init_done, 1);
 }
 
+/*
+ * Called with ust_safe_guard_fd_mutex held, before any change to the
+ * tracked fds.
+ */
+static
+void fast_close_wait(void)
+{
+	unsigned int spin = 0;
+
+	CMM_STORE_SHARED(fd_tracker_locked, 1);
+	cmm_smp_mb();
+	while (uatomic_read(&fast_closers) > URCU_TLS(ust_fd_fast_close_nest)) {
+		if (spin++ < FAST_CLOSE_SPIN)
+			caa_cpu_relax();
+		else
+			(void) poll(NULL, 0, 1);
+	}
+	cmm_smp_mb();
+}
+
+/*
+ * Enter an unlocked close, which only proceeds while the fd tracker is
+ * not locked. Returns false if it is.
+ */
+static
+bool fast_close_begin(void)
+{
+	URCU_TLS(ust_fd_fast_close_nest)++;
+	uatomic_inc(&fast_closers);
+	cmm_smp_mb();
+	if (caa_likely(!CMM_LOAD_SHARED(fd_tracker_locked)))
+		return true;
+	uatomic_dec(&fast_closers);
+	URCU_TLS(ust_fd_fast_close_nest)--;
+	return false;
+}
+
+static
+void fast_close_end(void)
+{
+	cmm_smp_mb();
+	uatomic_dec(&fast_closers);
+	URCU_TLS(ust_fd_fast_close_nest)--;
+}
+
 void lttng_ust_lock_fd_tracker(void)
 {
 	sigset_t sig_all_blocked, orig_mask;
@@ -138,6 +198,7 @@ void lttng_ust_lock_fd_tracker(void)
 		 */
 		cmm_barrier();
 		pthread_mutex_lock(&ust_safe_guard_fd_mutex);
+		fast_close_wait();
 	}
 	ret = pthread_sigmask(SIG_SETMASK, &orig_mask, NULL);
 	if (ret) {
@@ -161,6 +222,9 @@ void lttng_ust_unlock_fd_tracker(void)
 	 */
 	cmm_barrier();
 	if (!--URCU_TLS(ust_fd_mutex_nest)) {
+		/* Publish the fd set updates before the unlocked closes. */
+		cmm_smp_mb();
+		CMM_STORE_SHARED(fd_tracker_locked, 0);
 		pthread_mutex_unlock(&ust_safe_guard_fd_mutex);
 	}
 	ret = pthread_sigmask(SIG_SETMASK, &orig_mask, NULL);
@@ -325,6 +389,15 @@ int lttng_ust_safe_close_fd(int fd, int (*close_cb)(int fd))
 	if (URCU_TLS(ust_fd_mutex_nest))
 		return close_cb(fd);
 
+	if (fast_close_begin()) {
+		if (!IS_FD_VALID(fd) || !IS_FD_SET(fd, lttng_fd_set)) {
+			ret = close_cb(fd);
+			fast_close_end();
+			return ret;
+		}
+		fast_close_end();
+	}
+
 	lttng_ust_lock_fd_tracker();
 	if (IS_FD_VALID(fd) && IS_FD_SET(fd, lttng_fd_set)) {
 		ret = -1;
@@ -363,6 +436,15 @@ int lttng_ust_safe_fclose_stream(FILE *stream, int (*fclose_cb)(FILE *stream))
 
 	fd = fileno(stream);
 
+	if (fast_close_begin()) {
+		if (!IS_FD_VALID(fd) || !IS_FD_SET(fd, lttng_fd_set)) {
+			ret = fclose_cb(stream);
+			fast_close_end();
+			return ret;
+		}
+		fast_close_end();
+	}
+
 	lttng_ust_lock_fd_tracker();
 	if (IS_FD_VALID(fd) && IS_FD_SET(fd, lttng_fd_set)) {
 		ret = -1;
@@ -394,6 +476,59 @@ static int test_close_success(const int *p __attribute__((unused)))
 }
 #endif
 
+/*
+ * Return the first fd tracked by lttng-ust from `fd`, or
+ * lttng_ust_max_fd if there is none.
+ */
+static
+int next_tracked_fd(int fd)
+{
+	while (fd < lttng_ust_max_fd) {
+		unsigned long word;
+
+		word = CMM_LOAD_SHARED(lttng_fd_set[fd / CAA_BITS_PER_LONG]);
+		word >>= fd % CAA_BITS_PER_LONG;
+		if (word)
+			return min_t(int, fd + __builtin_ctzl(word), lttng_ust_max_fd);
+		fd = (fd / CAA_BITS_PER_LONG + 1) * CAA_BITS_PER_LONG;
+	}
+	return lttng_ust_max_fd;
+}
+
+/*
+ * Close the fds from `first` to `last` included, with a single
+ * close_range() system call where available, else one by one up to the
+ * last valid fd.
+ */
+static
+int close_fd_range(int first, unsigned int last, int (*close_cb)(int fd),
+		int *close_success)
+{
+	int i;
+
+#ifdef __NR_close_range
+	if (!syscall(__NR_close_range, (unsigned int) first, last, 0)) {
+		set_close_success(close_success);
+		return 0;
+	}
+	if (errno != ENOSYS && errno != EINVAL)
+		return -1;
+#endif
+	for (i = first; i < lttng_ust_max_fd && (unsigned int) i <= last; i++) {
+		if (close_cb(i) < 0) {
+			switch (errno) {
+			case EBADF:
+				continue;
+			case EINTR:
+			default:
+				return -1;
+			}
+		}
+		set_close_success(close_success);
+	}
+	return 0;
+}
+
 /*
  * Implement helper for closefrom() override.
  */
@@ -422,36 +557,30 @@ int lttng_ust_safe_closefrom_fd(int lowfd, int (*close_cb)(int fd))
 	 * validating whether the FD is part of the tracked set.
 	 */
 	if (URCU_TLS(ust_fd_mutex_nest)) {
-		for (i = lowfd; i < lttng_ust_max_fd; i++) {
-			if (close_cb(i) < 0) {
-				switch (errno) {
-				case EBADF:
-					continue;
-				case EINTR:
-				default:
-					ret = -1;
-					goto end;
-				}
-			}
-			set_close_success(&close_success);
-		}
+		ret = close_fd_range(lowfd, UINT_MAX, close_cb, &close_success);
+		if (ret)
+			goto end;
 	} else {
+		/*
+		 * Close the gaps between the tracked fds, the last one
+		 * extending past the highest possible fd.
+		 */
 		lttng_ust_lock_fd_tracker();
 		for (i = lowfd; i < lttng_ust_max_fd; i++) {
-			if (IS_FD_VALID(i) && IS_FD_SET(i, lttng_fd_set))
-				continue;
-			if (close_cb(i) < 0) {
-				switch (errno) {
-				case EBADF:
-					continue;
-				case EINTR:
-				default:
-					ret = -1;
+			int next = next_tracked_fd(i);
+
+			if (next > i) {
+				unsigned int last = next < lttng_ust_max_fd ?
+					(unsigned int) next - 1 : UINT_MAX;
+
+				ret = close_fd_range(i, last, close_cb,
+						&close_success);
+				if (ret) {
 					lttng_ust_unlock_fd_tracker();
 					goto end;
 				}
 			}
-			set_close_success(&close_success);
+			i = next;
 		}
 		lttng_ust_unlock_fd_tracker();
 	}
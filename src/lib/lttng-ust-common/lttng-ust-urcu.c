@@ -21,11 +21,14 @@
 #include <sys/mman.h>
 
 #include <urcu/arch.h>
+#include <urcu/uatomic.h>
 #include <urcu/wfcqueue.h>
 #include <lttng/urcu/static/urcu-ust.h>
 #include <lttng/urcu/pointer.h>
 #include <urcu/tls-compat.h>
 
+#include "common/getcpu.h"
+
 /* Do not #define _LGPL_SOURCE to ensure we can emit the wrapper symbols */
 #undef _LGPL_SOURCE
 #include <lttng/urcu/urcu-ust.h>
@@ -75,6 +78,9 @@ void *mremap_wrapper(void *old_address __attribute__((unused)),
  */
 #define RCU_QS_ACTIVE_ATTEMPTS 100
 
+/* Number of per-CPU registry allocation hints. */
+#define NR_ALLOC_HINTS		64
+
 static
 int lttng_ust_urcu_refcount;
 
@@ -112,11 +118,10 @@ int lttng_ust_urcu_has_sys_membarrier;
 static pthread_mutex_t rcu_gp_lock = PTHREAD_MUTEX_INITIALIZER;
 /*
  * rcu_registry_lock ensures mutual exclusion between threads
- * registering and unregistering themselves to/from the registry, and
- * with threads reading that registry from synchronize_rcu(). However,
- * this lock is not held all the way through the completion of awaiting
- * for the grace period. It is sporadically released between iterations
- * on the registry.
+ * expanding the registry arena, and with fork. Threads register and
+ * unregister themselves without it, by claiming and releasing arena
+ * slots with atomic operations, and synchronize_rcu() scans the
+ * allocated slots without it either.
  * rcu_registry_lock may nest inside rcu_gp_lock.
  */
 static pthread_mutex_t rcu_registry_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -134,8 +139,12 @@ struct lttng_ust_urcu_gp lttng_ust_urcu_gp = { .ctr = LTTNG_UST_URCU_GP_COUNT };
  */
 DEFINE_URCU_TLS(struct lttng_ust_urcu_reader *, lttng_ust_urcu_reader);
 
-static CDS_LIST_HEAD(registry);
-
+/*
+ * The chunks are only ever appended to the arena, and only grow, under
+ * rcu_registry_lock. Registering threads and synchronize_rcu() walk
+ * them without the lock, so their list links and data_len are
+ * published after the memory they cover is initialized.
+ */
 struct registry_chunk {
 	size_t data_len;		/* data length */
 	size_t used;			/* amount of data used */
@@ -151,6 +160,26 @@ static struct registry_arena registry_arena = {
 	.chunk_list = CDS_LIST_HEAD_INIT(registry_arena.chunk_list),
 };
 
+/*
+ * Per-CPU slot where threads registering on each CPU start looking for
+ * a free one, so they neither contend on the same slots nor scan the
+ * whole arena.
+ */
+static struct lttng_ust_urcu_reader *alloc_hint[NR_ALLOC_HINTS];
+
+#define for_each_chunk(chunk, arena)					\
+	for (chunk = cds_list_entry(CMM_LOAD_SHARED((arena)->chunk_list.next), \
+			struct registry_chunk, node);			\
+		&chunk->node != &(arena)->chunk_list;			\
+		chunk = cds_list_entry(CMM_LOAD_SHARED(chunk->node.next), \
+			struct registry_chunk, node))
+
+#define chunk_first(chunk)						\
+	((struct lttng_ust_urcu_reader *) &(chunk)->data[0])
+#define chunk_end(chunk)						\
+	((struct lttng_ust_urcu_reader *)				\
+		&(chunk)->data[CMM_LOAD_SHARED((chunk)->data_len)])
+
 /* Saved fork signal mask, protected by rcu_gp_lock */
 static sigset_t saved_fork_signal_mask;
 
@@ -191,24 +220,24 @@ static void smp_mb_master(void)
 }
 
 /*
- * Always called with rcu_registry lock held. Releases this lock between
- * iterations and grabs it again. Holds the lock when it returns.
+ * Wait for each thread URCU_TLS(lttng_ust_urcu_reader).ctr of
+ * @input_readers to either indicate quiescence (not nested), or observe
+ * the current rcu_gp.ctr value, moving the latter to @cur_snap_readers
+ * if not NULL.
  */
 static void wait_for_readers(struct cds_list_head *input_readers,
-			struct cds_list_head *cur_snap_readers,
-			struct cds_list_head *qsreaders)
+			struct cds_list_head *cur_snap_readers)
 {
 	unsigned int wait_loops = 0;
 	struct lttng_ust_urcu_reader *index, *tmp;
 
-	/*
-	 * Wait for each thread URCU_TLS(lttng_ust_urcu_reader).ctr to either
-	 * indicate quiescence (not nested), or observe the current
-	 * rcu_gp.ctr value.
-	 */
-	for (;;) {
+	while (!cds_list_empty(input_readers)) {
 		if (wait_loops < RCU_QS_ACTIVE_ATTEMPTS)
 			wait_loops++;
+		if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS)
+			(void) poll(NULL, 0, RCU_SLEEP_DELAY_MS);
+		else
+			caa_cpu_relax();
 
 		cds_list_for_each_entry_safe(index, tmp, input_readers, node) {
 			switch (lttng_ust_urcu_reader_state(&index->ctr)) {
@@ -220,7 +249,7 @@ static void wait_for_readers(struct cds_list_head *input_readers,
 				}
 				/* Fall-through */
 			case LTTNG_UST_URCU_READER_INACTIVE:
-				cds_list_move(&index->node, qsreaders);
+				cds_list_del(&index->node);
 				break;
 			case LTTNG_UST_URCU_READER_ACTIVE_OLD:
 				/*
@@ -232,26 +261,51 @@ static void wait_for_readers(struct cds_list_head *input_readers,
 				break;
 			}
 		}
+	}
+}
 
-		if (cds_list_empty(input_readers)) {
-			break;
-		} else {
-			/* Temporarily unlock the registry lock. */
-			mutex_unlock(&rcu_registry_lock);
-			if (wait_loops >= RCU_QS_ACTIVE_ATTEMPTS)
-				(void) poll(NULL, 0, RCU_SLEEP_DELAY_MS);
-			else
-				caa_cpu_relax();
-			/* Re-lock the registry lock before the next loop. */
-			mutex_lock(&rcu_registry_lock);
+/*
+ * Scan the registered readers, linking through their node, which only
+ * synchronize_rcu() uses, with rcu_gp_lock held, those within an old
+ * read-side critical section to @old_readers, and those within a
+ * current one to @cur_snap_readers. The quiescent readers, usually the
+ * vast majority, are only read, so that the cost of a grace period
+ * depends on the number of readers actually within read-side critical
+ * sections rather than on the number of threads.
+ *
+ * A slot released and claimed again by another thread meanwhile is
+ * merely waited for needlessly.
+ */
+static void gather_readers(struct cds_list_head *old_readers,
+			struct cds_list_head *cur_snap_readers)
+{
+	struct registry_chunk *chunk;
+	struct lttng_ust_urcu_reader *index;
+
+	for_each_chunk(chunk, &registry_arena) {
+		if (!uatomic_read(&chunk->used))
+			continue;
+		for (index = chunk_first(chunk); index < chunk_end(chunk); index++) {
+			if (!CMM_LOAD_SHARED(index->alloc))
+				continue;
+			switch (lttng_ust_urcu_reader_state(&index->ctr)) {
+			case LTTNG_UST_URCU_READER_ACTIVE_CURRENT:
+				cds_list_add(&index->node, cur_snap_readers);
+				break;
+			case LTTNG_UST_URCU_READER_ACTIVE_OLD:
+				cds_list_add(&index->node, old_readers);
+				break;
+			case LTTNG_UST_URCU_READER_INACTIVE:
+				break;
+			}
 		}
 	}
 }
 
 void lttng_ust_urcu_synchronize_rcu(void)
 {
+	CDS_LIST_HEAD(old_readers);
 	CDS_LIST_HEAD(cur_snap_readers);
-	CDS_LIST_HEAD(qsreaders);
 	sigset_t newmask, oldmask;
 	int ret;
 
@@ -262,22 +316,24 @@ void lttng_ust_urcu_synchronize_rcu(void)
 
 	mutex_lock(&rcu_gp_lock);
 
-	mutex_lock(&rcu_registry_lock);
-
-	if (cds_list_empty(&registry))
-		goto out;
-
 	/* All threads should read qparity before accessing data structure
 	 * where new ptr points to. */
 	/* Write new ptr before changing the qparity */
 	smp_mb_master();
 
+	/*
+	 * Threads which register from now on can only see the new ptr,
+	 * they do not need to be waited for. Neither do the quiescent
+	 * ones.
+	 */
+	gather_readers(&old_readers, &cur_snap_readers);
+	if (cds_list_empty(&old_readers) && cds_list_empty(&cur_snap_readers))
+		goto out;
+
 	/*
 	 * Wait for readers to observe original parity or be quiescent.
-	 * wait_for_readers() can release and grab again rcu_registry_lock
-	 * internally.
 	 */
-	wait_for_readers(&registry, &cur_snap_readers, &qsreaders);
+	wait_for_readers(&old_readers, &cur_snap_readers);
 
 	/*
 	 * Adding a cmm_smp_mb() which is _not_ formally required, but makes the
@@ -305,15 +361,8 @@ void lttng_ust_urcu_synchronize_rcu(void)
 
 	/*
 	 * Wait for readers to observe new parity or be quiescent.
-	 * wait_for_readers() can release and grab again rcu_registry_lock
-	 * internally.
 	 */
-	wait_for_readers(&cur_snap_readers, NULL, &qsreaders);
-
-	/*
-	 * Put quiescent reader list back into registry.
-	 */
-	cds_list_splice(&qsreaders, &registry);
+	wait_for_readers(&cur_snap_readers, NULL);
 
 	/*
 	 * Finish waiting for reader threads before letting the old ptr being
@@ -321,7 +370,6 @@ void lttng_ust_urcu_synchronize_rcu(void)
 	 */
 	smp_mb_master();
 out:
-	mutex_unlock(&rcu_registry_lock);
 	mutex_unlock(&rcu_gp_lock);
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	assert(!ret);
@@ -346,6 +394,20 @@ int lttng_ust_urcu_read_ongoing(void)
 	return _lttng_ust_urcu_read_ongoing();
 }
 
+/* Append a fully initialized chunk. Called with rcu_registry_lock held. */
+static
+void chunk_list_add_tail(struct registry_arena *arena,
+		struct registry_chunk *chunk)
+{
+	struct cds_list_head *head = &arena->chunk_list;
+
+	chunk->node.next = head;
+	chunk->node.prev = head->prev;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(head->prev->next, &chunk->node);
+	head->prev = &chunk->node;
+}
+
 /*
  * Only grow for now. If empty, allocate a ARENA_INIT_ALLOC sized chunk.
  * Else, try expanding the last chunk. If this fails, allocate a new
@@ -353,6 +415,7 @@ int lttng_ust_urcu_read_ongoing(void)
  * Memory used by chunks _never_ moves. A chunk could theoretically be
  * freed when all "used" slots are released, but we don't do it at this
  * point.
+ * Called with signals off and rcu_registry_lock held.
  */
 static
 void expand_arena(struct registry_arena *arena)
@@ -376,7 +439,7 @@ void expand_arena(struct registry_arena *arena)
 		memset(new_chunk, 0, new_chunk_len);
 		new_chunk->data_len =
 			new_chunk_len - sizeof(struct registry_chunk);
-		cds_list_add_tail(&new_chunk->node, &arena->chunk_list);
+		chunk_list_add_tail(arena, new_chunk);
 		return;		/* We're done. */
 	}
 
@@ -395,8 +458,9 @@ void expand_arena(struct registry_arena *arena)
 		assert(new_chunk == last_chunk);
 		memset((char *) last_chunk + old_chunk_len, 0,
 			new_chunk_len - old_chunk_len);
-		last_chunk->data_len =
-			new_chunk_len - sizeof(struct registry_chunk);
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(last_chunk->data_len,
+			new_chunk_len - sizeof(struct registry_chunk));
 		return;		/* We're done. */
 	}
 
@@ -411,132 +475,205 @@ void expand_arena(struct registry_arena *arena)
 	memset(new_chunk, 0, new_chunk_len);
 	new_chunk->data_len =
 		new_chunk_len - sizeof(struct registry_chunk);
-	cds_list_add_tail(&new_chunk->node, &arena->chunk_list);
+	chunk_list_add_tail(arena, new_chunk);
 }
 
+static
+bool arena_claim(struct registry_chunk *chunk,
+		struct lttng_ust_urcu_reader *rcu_reader_reg)
+{
+	if (CMM_LOAD_SHARED(rcu_reader_reg->alloc)
+			|| uatomic_cmpxchg(&rcu_reader_reg->alloc, 0, 1) != 0)
+		return false;
+	uatomic_add(&chunk->used, sizeof(struct lttng_ust_urcu_reader));
+	/* Account the slot before its reader can become active. */
+	cmm_smp_mb();
+	return true;
+}
+
+/*
+ * Claim a free slot without locks, starting from the hint of the
+ * current CPU. Returns NULL if the arena is full.
+ */
 static
 struct lttng_ust_urcu_reader *arena_alloc(struct registry_arena *arena)
 {
+	struct lttng_ust_urcu_reader *rcu_reader_reg, *hint, **hintp;
 	struct registry_chunk *chunk;
-	struct lttng_ust_urcu_reader *rcu_reader_reg;
-	int expand_done = 0;	/* Only allow to expand once per alloc */
 	size_t len = sizeof(struct lttng_ust_urcu_reader);
+	int cpu;
+
+	cpu = lttng_ust_get_cpu();
+	hintp = &alloc_hint[(cpu < 0 ? 0 : cpu) % NR_ALLOC_HINTS];
+	hint = CMM_LOAD_SHARED(*hintp);
 
-retry:
-	cds_list_for_each_entry(chunk, &arena->chunk_list, node) {
-		if (chunk->data_len - chunk->used < len)
+	/* Try from the hint to the end of its chunk first. */
+	for_each_chunk(chunk, arena) {
+		if (!hint || hint < chunk_first(chunk) || hint >= chunk_end(chunk))
 			continue;
-		/* Find spot */
-		for (rcu_reader_reg = (struct lttng_ust_urcu_reader *) &chunk->data[0];
-				rcu_reader_reg < (struct lttng_ust_urcu_reader *) &chunk->data[chunk->data_len];
+		for (rcu_reader_reg = hint; rcu_reader_reg < chunk_end(chunk);
 				rcu_reader_reg++) {
-			if (!rcu_reader_reg->alloc) {
-				rcu_reader_reg->alloc = 1;
-				chunk->used += len;
-				return rcu_reader_reg;
-			}
+			if (arena_claim(chunk, rcu_reader_reg))
+				goto found;
 		}
+		break;
 	}
-
-	if (!expand_done) {
-		expand_arena(arena);
-		expand_done = 1;
-		goto retry;
+	for_each_chunk(chunk, arena) {
+		if (CMM_LOAD_SHARED(chunk->data_len) - uatomic_read(&chunk->used) < len)
+			continue;
+		for (rcu_reader_reg = chunk_first(chunk);
+				rcu_reader_reg < chunk_end(chunk);
+				rcu_reader_reg++) {
+			if (arena_claim(chunk, rcu_reader_reg))
+				goto found;
+		}
 	}
-
 	return NULL;
+
+found:
+	CMM_STORE_SHARED(*hintp, rcu_reader_reg + 1);
+	return rcu_reader_reg;
 }
 
-/* Called with signals off and mutex locked */
 static
-void add_thread(void)
+struct registry_chunk *find_chunk(struct lttng_ust_urcu_reader *rcu_reader_reg)
 {
-	struct lttng_ust_urcu_reader *rcu_reader_reg;
-	int ret;
-
-	rcu_reader_reg = arena_alloc(&registry_arena);
-	if (!rcu_reader_reg)
-		abort();
-	ret = pthread_setspecific(lttng_ust_urcu_key, rcu_reader_reg);
-	if (ret)
-		abort();
+	struct registry_chunk *chunk;
 
-	/* Add to registry */
-	rcu_reader_reg->tid = pthread_self();
-	assert(rcu_reader_reg->ctr == 0);
-	cds_list_add(&rcu_reader_reg->node, &registry);
-	/*
-	 * Reader threads are pointing to the reader registry. This is
-	 * why its memory should never be relocated.
-	 */
-	URCU_TLS(lttng_ust_urcu_reader) = rcu_reader_reg;
+	for_each_chunk(chunk, &registry_arena) {
+		if (rcu_reader_reg < chunk_first(chunk))
+			continue;
+		if (rcu_reader_reg >= chunk_end(chunk))
+			continue;
+		return chunk;
+	}
+	return NULL;
 }
 
-/* Called with mutex locked */
+/*
+ * The node of the slot may be on the reader lists of a concurrent
+ * synchronize_rcu(), which owns it: leave it alone.
+ */
 static
 void cleanup_thread(struct registry_chunk *chunk,
 		struct lttng_ust_urcu_reader *rcu_reader_reg)
 {
-	rcu_reader_reg->ctr = 0;
-	cds_list_del(&rcu_reader_reg->node);
+	CMM_STORE_SHARED(rcu_reader_reg->ctr, 0);
 	rcu_reader_reg->tid = 0;
-	rcu_reader_reg->alloc = 0;
-	chunk->used -= sizeof(struct lttng_ust_urcu_reader);
+	uatomic_add(&chunk->used, -(long) sizeof(struct lttng_ust_urcu_reader));
+	cmm_smp_mb();
+	CMM_STORE_SHARED(rcu_reader_reg->alloc, 0);
 }
 
+/*
+ * Claim an arena slot for the current thread, expanding the arena if
+ * it is full, which is the only step blocking signals and taking
+ * rcu_registry_lock.
+ */
 static
-struct registry_chunk *find_chunk(struct lttng_ust_urcu_reader *rcu_reader_reg)
+struct lttng_ust_urcu_reader *claim_slot(void)
 {
-	struct registry_chunk *chunk;
+	struct lttng_ust_urcu_reader *rcu_reader_reg;
 
-	cds_list_for_each_entry(chunk, &registry_arena.chunk_list, node) {
-		if (rcu_reader_reg < (struct lttng_ust_urcu_reader *) &chunk->data[0])
-			continue;
-		if (rcu_reader_reg >= (struct lttng_ust_urcu_reader *) &chunk->data[chunk->data_len])
-			continue;
-		return chunk;
+	for (;;) {
+		sigset_t newmask, oldmask;
+		int ret;
+
+		rcu_reader_reg = arena_alloc(&registry_arena);
+		if (rcu_reader_reg)
+			return rcu_reader_reg;
+
+		ret = sigfillset(&newmask);
+		if (ret)
+			abort();
+		ret = pthread_sigmask(SIG_BLOCK, &newmask, &oldmask);
+		if (ret)
+			abort();
+		mutex_lock(&rcu_registry_lock);
+		/* Another thread may have expanded it meanwhile. */
+		rcu_reader_reg = arena_alloc(&registry_arena);
+		if (!rcu_reader_reg) {
+			expand_arena(&registry_arena);
+			rcu_reader_reg = arena_alloc(&registry_arena);
+		}
+		mutex_unlock(&rcu_registry_lock);
+		ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+		if (ret)
+			abort();
+		if (rcu_reader_reg)
+			return rcu_reader_reg;
 	}
-	return NULL;
 }
 
-/* Called with signals off and mutex locked */
+/*
+ * Take a reference on the library state without init_lock, which is
+ * only possible once it is initialized.
+ */
 static
-void remove_thread(struct lttng_ust_urcu_reader *rcu_reader_reg)
+bool lttng_ust_urcu_get_ref(void)
 {
-	cleanup_thread(find_chunk(rcu_reader_reg), rcu_reader_reg);
-	URCU_TLS(lttng_ust_urcu_reader) = NULL;
+	int old = uatomic_read(&lttng_ust_urcu_refcount);
+
+	while (old > 0) {
+		int prev = uatomic_cmpxchg(&lttng_ust_urcu_refcount, old, old + 1);
+
+		if (prev == old)
+			return true;
+		old = prev;
+	}
+	return false;
 }
 
-/* Disable signals, take mutex, add to registry */
+/* Drop a reference, taking init_lock only to drop the last one. */
+static
+void lttng_ust_urcu_put_ref(void)
+{
+	int old = uatomic_read(&lttng_ust_urcu_refcount);
+
+	while (old > 1) {
+		int prev = uatomic_cmpxchg(&lttng_ust_urcu_refcount, old, old - 1);
+
+		if (prev == old)
+			return;
+		old = prev;
+	}
+	lttng_ust_urcu_exit();
+}
+
+/*
+ * Add the current thread to the registry. Only the arena expansion
+ * blocks signals: a signal handler registering the thread concurrently
+ * wins or loses the final exchange of the TLS reader pointer, the loser
+ * releasing its slot.
+ */
 void lttng_ust_urcu_register(void)
 {
-	sigset_t newmask, oldmask;
+	struct lttng_ust_urcu_reader *rcu_reader_reg;
+	struct registry_chunk *chunk;
 	int ret;
 
-	ret = sigfillset(&newmask);
-	if (ret)
-		abort();
-	ret = pthread_sigmask(SIG_BLOCK, &newmask, &oldmask);
-	if (ret)
-		abort();
-
 	/*
-	 * Check if a signal concurrently registered our thread since
-	 * the check in rcu_read_lock().
+	 * Take care of early registration before lttng_ust_urcu constructor.
 	 */
-	if (URCU_TLS(lttng_ust_urcu_reader))
-		goto end;
+	if (caa_unlikely(!lttng_ust_urcu_get_ref()))
+		_lttng_ust_urcu_init();
 
+	rcu_reader_reg = claim_slot();
+	assert(rcu_reader_reg->ctr == 0);
+	rcu_reader_reg->tid = pthread_self();
+	if (uatomic_cmpxchg(&URCU_TLS(lttng_ust_urcu_reader), NULL,
+			rcu_reader_reg) != NULL) {
+		/* A signal handler registered our thread meanwhile. */
+		chunk = find_chunk(rcu_reader_reg);
+		cleanup_thread(chunk, rcu_reader_reg);
+		lttng_ust_urcu_put_ref();
+		return;
+	}
 	/*
-	 * Take care of early registration before lttng_ust_urcu constructor.
+	 * Reader threads are pointing to the reader registry. This is
+	 * why its memory should never be relocated.
 	 */
-	_lttng_ust_urcu_init();
-
-	mutex_lock(&rcu_registry_lock);
-	add_thread();
-	mutex_unlock(&rcu_registry_lock);
-end:
-	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	ret = pthread_setspecific(lttng_ust_urcu_key, rcu_reader_reg);
 	if (ret)
 		abort();
 }
@@ -547,7 +684,7 @@ void lttng_ust_urcu_register_thread(void)
 		lttng_ust_urcu_register(); /* If not yet registered. */
 }
 
-/* Disable signals, take mutex, remove from registry */
+/* Disable signals, release the slot of the thread */
 static
 void lttng_ust_urcu_unregister(struct lttng_ust_urcu_reader *rcu_reader_reg)
 {
@@ -561,13 +698,12 @@ void lttng_ust_urcu_unregister(struct lttng_ust_urcu_reader *rcu_reader_reg)
 	if (ret)
 		abort();
 
-	mutex_lock(&rcu_registry_lock);
-	remove_thread(rcu_reader_reg);
-	mutex_unlock(&rcu_registry_lock);
+	cleanup_thread(find_chunk(rcu_reader_reg), rcu_reader_reg);
+	URCU_TLS(lttng_ust_urcu_reader) = NULL;
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	if (ret)
 		abort();
-	lttng_ust_urcu_exit();
+	lttng_ust_urcu_put_ref();
 }
 
 /*
@@ -618,7 +754,7 @@ static
 void _lttng_ust_urcu_init(void)
 {
 	mutex_lock(&init_lock);
-	if (!lttng_ust_urcu_refcount++) {
+	if (!uatomic_read(&lttng_ust_urcu_refcount)) {
 		int ret;
 
 		ret = pthread_key_create(&lttng_ust_urcu_key,
@@ -628,6 +764,9 @@ void _lttng_ust_urcu_init(void)
 		lttng_ust_urcu_sys_membarrier_init();
 		initialized = 1;
 	}
+	/* Publish the key before the lock-free lttng_ust_urcu_get_ref(). */
+	cmm_smp_mb();
+	uatomic_inc(&lttng_ust_urcu_refcount);
 	mutex_unlock(&init_lock);
 }
 
@@ -635,7 +774,7 @@ static
 void lttng_ust_urcu_exit(void)
 {
 	mutex_lock(&init_lock);
-	if (!--lttng_ust_urcu_refcount) {
+	if (!uatomic_add_return(&lttng_ust_urcu_refcount, -1)) {
 		struct registry_chunk *chunk, *tmp;
 		int ret;
 
@@ -694,9 +833,9 @@ void lttng_ust_urcu_prune_registry(void)
 	struct registry_chunk *chunk;
 	struct lttng_ust_urcu_reader *rcu_reader_reg;
 
-	cds_list_for_each_entry(chunk, &registry_arena.chunk_list, node) {
-		for (rcu_reader_reg = (struct lttng_ust_urcu_reader *) &chunk->data[0];
-				rcu_reader_reg < (struct lttng_ust_urcu_reader *) &chunk->data[chunk->data_len];
+	for_each_chunk(chunk, &registry_arena) {
+		for (rcu_reader_reg = chunk_first(chunk);
+				rcu_reader_reg < chunk_end(chunk);
 				rcu_reader_reg++) {
 			if (!rcu_reader_reg->alloc)
 				continue;
@@ -7,10 +7,14 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include <lttng/ust-config.h>
 #include <lttng/ust-ctl.h>
@@ -19,11 +23,22 @@
 #include <lttng/ust-common.h>
 #include <lttng/ust-sigbus.h>
 #include <urcu/rculist.h>
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#endif
 
 #include "common/logging.h"
 #include "common/ustcomm.h"
 #include "common/macros.h"
 #include "common/align.h"
+#include "common/bitfield.h"
+#include "common/patient.h"
 
 #include "common/ringbuffer/backend.h"
 #include "common/ringbuffer/frontend.h"
@@ -36,6 +51,9 @@
 
 #include "common/smp.h"
 #include "common/counter/counter.h"
+#include "common/metrics.h"
+#include "common/ust-fd.h"
+#include "common/msgpack/msgpack.h"
 
 /*
  * Number of milliseconds to retry before failing metadata writes on
@@ -65,6 +83,10 @@ struct lttng_ust_ctl_consumer_stream {
 	int cpu;
 	uint64_t memory_map_size;
 	void *memory_map_addr;
+	/* Write offsets seen by the last stale check, and after the last flush. */
+	unsigned long stale_check_offset, stale_flush_offset;
+	/* Mapping sealed against shrinking, accessed without SIGBUS handling. */
+	bool trusted;
 };
 
 #define LTTNG_UST_CTL_COUNTER_ATTR_DIMENSION_MAX 8
@@ -75,6 +97,8 @@ struct lttng_ust_ctl_counter_attr {
 	int64_t global_sum_step;
 	struct lttng_ust_ctl_counter_dimension dimensions[LTTNG_UST_CTL_COUNTER_ATTR_DIMENSION_MAX];
 	bool coalesce_hits;
+	bool histogram;
+	bool hits;
 };
 
 /*
@@ -134,6 +158,37 @@ void lttng_ust_sigbus_del_range(struct lttng_ust_sigbus_range *range)
 	cds_list_del_rcu(&range->node);
 }
 
+/*
+ * SIGBUS handling of the stream mapping, skipped for trusted streams:
+ * their shm file cannot shrink, so the mapping cannot fault.
+ */
+#define stream_sigbus_begin(stream) \
+	((stream)->trusted ? false : sigbus_begin())
+
+static
+void stream_sigbus_end(struct lttng_ust_ctl_consumer_stream *stream)
+{
+	if (!stream->trusted)
+		sigbus_end();
+}
+
+static
+void stream_sigbus_add_range(struct lttng_ust_ctl_consumer_stream *stream,
+		struct lttng_ust_sigbus_range *range)
+{
+	if (!stream->trusted)
+		lttng_ust_sigbus_add_range(range, stream->memory_map_addr,
+				stream->memory_map_size);
+}
+
+static
+void stream_sigbus_del_range(struct lttng_ust_ctl_consumer_stream *stream,
+		struct lttng_ust_sigbus_range *range)
+{
+	if (!stream->trusted)
+		lttng_ust_sigbus_del_range(range);
+}
+
 void lttng_ust_ctl_sigbus_handle(void *addr)
 {
 	struct lttng_ust_sigbus_range *range;
@@ -352,8 +407,12 @@ int lttng_ust_ctl_add_context(int sock, struct lttng_ust_context_attr *ctx,
 	lum.u.context.ctx = ctx->ctx;
 	switch (ctx->ctx) {
 	case LTTNG_UST_ABI_CONTEXT_PERF_THREAD_COUNTER:
+	case LTTNG_UST_ABI_CONTEXT_PERF_CPU_COUNTER:
 		lum.u.context.u.perf_counter = ctx->u.perf_counter;
 		break;
+	case LTTNG_UST_ABI_CONTEXT_CALLSTACK:
+		lum.u.context.u.callstack = ctx->u.callstack;
+		break;
 	case LTTNG_UST_ABI_CONTEXT_APP_CONTEXT:
 	{
 		size_t provider_name_len = strlen(
@@ -378,20 +437,10 @@ int lttng_ust_ctl_add_context(int sock, struct lttng_ust_context_attr *ctx,
 	default:
 		break;
 	}
-	ret = ustcomm_send_app_msg(sock, &lum);
+	/* send message and var len ctx_name at once */
+	ret = ustcomm_send_app_msg_payload(sock, &lum, buf, buf ? len : 0);
 	if (ret)
 		goto end;
-	if (buf) {
-		/* send var len ctx_name */
-		ret = ustcomm_send_unix_sock(sock, buf, len);
-		if (ret < 0) {
-			goto end;
-		}
-		if (ret != len) {
-			ret = -EINVAL;
-			goto end;
-		}
-	}
 	ret = ustcomm_recv_app_reply(sock, &lur, lum.handle, lum.cmd);
 	if (ret < 0) {
 		if (ret == -EINVAL) {
@@ -441,17 +490,11 @@ int lttng_ust_ctl_set_filter(int sock, struct lttng_ust_abi_filter_bytecode *byt
 	lum.u.filter.reloc_offset = bytecode->reloc_offset;
 	lum.u.filter.seqnum = bytecode->seqnum;
 
-	ret = ustcomm_send_app_msg(sock, &lum);
+	/* send message and var len bytecode at once */
+	ret = ustcomm_send_app_msg_payload(sock, &lum, bytecode->data,
+			bytecode->len);
 	if (ret)
 		return ret;
-	/* send var len bytecode */
-	ret = ustcomm_send_unix_sock(sock, bytecode->data,
-				bytecode->len);
-	if (ret < 0) {
-		return ret;
-	}
-	if (ret != bytecode->len)
-		return -EINVAL;
 	ret = ustcomm_recv_app_reply(sock, &lur, lum.handle, lum.cmd);
 	if (ret == -EINVAL) {
 		/*
@@ -529,21 +572,12 @@ int lttng_ust_ctl_set_exclusion(int sock, struct lttng_ust_abi_event_exclusion *
 	lum.cmd = LTTNG_UST_ABI_EXCLUSION;
 	lum.u.exclusion.count = exclusion->count;
 
-	ret = ustcomm_send_app_msg(sock, &lum);
-	if (ret) {
-		return ret;
-	}
-
-	/* send var len exclusion names */
-	ret = ustcomm_send_unix_sock(sock,
-			exclusion->names,
+	/* send message and var len exclusion names at once */
+	ret = ustcomm_send_app_msg_payload(sock, &lum, exclusion->names,
 			exclusion->count * LTTNG_UST_ABI_SYM_NAME_LEN);
-	if (ret < 0) {
+	if (ret) {
 		return ret;
 	}
-	if (ret != exclusion->count * LTTNG_UST_ABI_SYM_NAME_LEN) {
-		return -EINVAL;
-	}
 	ret = ustcomm_recv_app_reply(sock, &lur, lum.handle, lum.cmd);
 	if (ret == -EINVAL) {
 		/*
@@ -595,6 +629,28 @@ int lttng_ust_ctl_disable(int sock, struct lttng_ust_abi_object_data *object)
 	return 0;
 }
 
+/* Filter statistics of event and event notifier ioctl */
+int lttng_ust_ctl_get_filter_stats(int sock, struct lttng_ust_abi_object_data *object,
+		struct lttng_ust_abi_filter_stats *stats)
+{
+	struct ustcomm_ust_msg lum;
+	struct ustcomm_ust_reply lur;
+	int ret;
+
+	if (!object || !stats)
+		return -EINVAL;
+
+	memset(&lum, 0, sizeof(lum));
+	lum.handle = object->handle;
+	lum.cmd = LTTNG_UST_ABI_FILTER_STATS;
+	ret = ustcomm_send_app_cmd(sock, &lum, &lur);
+	if (ret)
+		return ret;
+	memcpy(stats, &lur.u.filter_stats, sizeof(*stats));
+	DBG("filter stats of handle %u", object->handle);
+	return 0;
+}
+
 int lttng_ust_ctl_start_session(int sock, int handle)
 {
 	struct lttng_ust_abi_object_data obj;
@@ -611,6 +667,217 @@ int lttng_ust_ctl_stop_session(int sock, int handle)
 	return lttng_ust_ctl_disable(sock, &obj);
 }
 
+static
+int batch_prepare_msg(struct lttng_ust_ctl_batch_cmd *cmd,
+		struct ustcomm_ust_msg *lum)
+{
+	if (!cmd->object)
+		return -EINVAL;
+	memset(lum, 0, sizeof(*lum));
+	lum->handle = cmd->object->handle;
+	switch (cmd->type) {
+	case LTTNG_UST_CTL_BATCH_ENABLE:
+		lum->cmd = LTTNG_UST_ABI_ENABLE;
+		break;
+	case LTTNG_UST_CTL_BATCH_DISABLE:
+		lum->cmd = LTTNG_UST_ABI_DISABLE;
+		break;
+	case LTTNG_UST_CTL_BATCH_CREATE_EVENT:
+	{
+		struct lttng_ust_abi_event *ev = cmd->u.event;
+
+		if (!ev)
+			return -EINVAL;
+		lum->cmd = LTTNG_UST_ABI_EVENT;
+		strncpy(lum->u.event.name, ev->name,
+			LTTNG_UST_ABI_SYM_NAME_LEN);
+		lum->u.event.instrumentation = ev->instrumentation;
+		lum->u.event.loglevel_type = ev->loglevel_type;
+		lum->u.event.loglevel = ev->loglevel;
+		break;
+	}
+	case LTTNG_UST_CTL_BATCH_ADD_CONTEXT:
+	{
+		struct lttng_ust_context_attr *ctx = cmd->u.ctx;
+
+		if (!ctx)
+			return -EINVAL;
+		lum->cmd = LTTNG_UST_ABI_CONTEXT;
+		lum->u.context.ctx = ctx->ctx;
+		switch (ctx->ctx) {
+		case LTTNG_UST_ABI_CONTEXT_PERF_THREAD_COUNTER:
+		case LTTNG_UST_ABI_CONTEXT_PERF_CPU_COUNTER:
+			lum->u.context.u.perf_counter = ctx->u.perf_counter;
+			break;
+		case LTTNG_UST_ABI_CONTEXT_CALLSTACK:
+			lum->u.context.u.callstack = ctx->u.callstack;
+			break;
+		case LTTNG_UST_ABI_CONTEXT_APP_CONTEXT:
+			/* Carries additional payload. */
+			return -EINVAL;
+		default:
+			break;
+		}
+		break;
+	}
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static
+int batch_complete_cmd(struct lttng_ust_ctl_batch_cmd *cmd,
+		struct ustcomm_ust_reply *lur)
+{
+	struct lttng_ust_abi_object_data *object_data;
+
+	switch (cmd->type) {
+	case LTTNG_UST_CTL_BATCH_CREATE_EVENT:
+		object_data = zmalloc(sizeof(*object_data));
+		if (!object_data)
+			return -ENOMEM;
+		object_data->type = LTTNG_UST_ABI_OBJECT_TYPE_EVENT;
+		object_data->handle = lur->ret_val;
+		DBG("received event handle %u", object_data->handle);
+		cmd->object_data = object_data;
+		break;
+	case LTTNG_UST_CTL_BATCH_ADD_CONTEXT:
+		object_data = zmalloc(sizeof(*object_data));
+		if (!object_data)
+			return -ENOMEM;
+		object_data->type = LTTNG_UST_ABI_OBJECT_TYPE_CONTEXT;
+		object_data->handle = -1;
+		cmd->object_data = object_data;
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+/*
+ * Protocol for LTTNG_UST_ABI_BATCH command:
+ *
+ * - send:     struct ustcomm_ust_msg, followed by @count struct
+ *             ustcomm_ust_msg
+ * - receive:  struct ustcomm_ust_reply, followed by @count struct
+ *             ustcomm_ust_reply on success
+ *
+ * @msgs and @replies have room for the batch message and its reply
+ * followed by those of the @count commands, whose index within @cmds
+ * is in @index.
+ */
+static
+int batch_send_chunk(int sock, struct lttng_ust_ctl_batch_cmd *cmds,
+		const unsigned int *index, unsigned int count,
+		struct ustcomm_ust_msg *msgs, struct ustcomm_ust_reply *replies)
+{
+	unsigned int i;
+	ssize_t len;
+	int ret;
+
+	memset(&msgs[0], 0, sizeof(msgs[0]));
+	msgs[0].handle = LTTNG_UST_ABI_ROOT_HANDLE;
+	msgs[0].cmd = LTTNG_UST_ABI_BATCH;
+	msgs[0].u.batch.count = count;
+	len = ustcomm_send_unix_sock(sock, msgs, (count + 1) * sizeof(*msgs));
+	if (len < 0)
+		return len;
+	if (len != (count + 1) * sizeof(*msgs))
+		return -EINVAL;
+
+	ret = ustcomm_recv_app_reply(sock, &replies[0], msgs[0].handle,
+			msgs[0].cmd);
+	if (ret < 0) {
+		if (ret == -EINVAL || ret == -LTTNG_UST_ERR_INVAL) {
+			/*
+			 * Command unknown from remote end. The communication socket is
+			 * now out-of-sync and needs to be shutdown.
+			 */
+			(void) ustcomm_shutdown_unix_sock(sock);
+		}
+		return ret;
+	}
+	if (ret > 0)
+		return -EIO;
+
+	len = ustcomm_recv_unix_sock(sock, &replies[1], count * sizeof(*replies));
+	if (len == 0)
+		return -EPIPE;
+	if (len < 0)
+		return len;
+	if (len != count * sizeof(*replies))
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		struct lttng_ust_ctl_batch_cmd *cmd = &cmds[index[i]];
+		struct ustcomm_ust_reply *lur = &replies[i + 1];
+
+		if (lur->handle != msgs[i + 1].handle
+				|| lur->cmd != msgs[i + 1].cmd) {
+			ERR("Unexpected batch result message: "
+				"expected handle %u, command %u vs received: %u, %u\n",
+				msgs[i + 1].handle, msgs[i + 1].cmd,
+				lur->handle, lur->cmd);
+			(void) ustcomm_shutdown_unix_sock(sock);
+			return -EINVAL;
+		}
+		cmd->ret = lur->ret_code;
+		if (cmd->ret == LTTNG_UST_OK)
+			cmd->ret = batch_complete_cmd(cmd, lur);
+	}
+	return 0;
+}
+
+int lttng_ust_ctl_batch(int sock, struct lttng_ust_ctl_batch_cmd *cmds,
+		unsigned int nr_cmds)
+{
+	struct ustcomm_ust_msg *msgs = NULL;
+	struct ustcomm_ust_reply *replies = NULL;
+	unsigned int *index = NULL;
+	unsigned int i = 0;
+	int ret = 0;
+
+	if (!nr_cmds)
+		return 0;
+	if (!cmds)
+		return -EINVAL;
+	msgs = zmalloc((USTCOMM_BATCH_MAX_CMDS + 1) * sizeof(*msgs));
+	replies = zmalloc((USTCOMM_BATCH_MAX_CMDS + 1) * sizeof(*replies));
+	index = zmalloc(USTCOMM_BATCH_MAX_CMDS * sizeof(*index));
+	if (!msgs || !replies || !index) {
+		ret = -ENOMEM;
+		goto end;
+	}
+
+	/* Send the commands in chunks of at most USTCOMM_BATCH_MAX_CMDS. */
+	while (i < nr_cmds) {
+		unsigned int count = 0;
+
+		for (; i < nr_cmds && count < USTCOMM_BATCH_MAX_CMDS; i++) {
+			struct lttng_ust_ctl_batch_cmd *cmd = &cmds[i];
+
+			cmd->object_data = NULL;
+			cmd->ret = batch_prepare_msg(cmd, &msgs[count + 1]);
+			if (cmd->ret)
+				continue;
+			index[count++] = i;
+		}
+		if (!count)
+			continue;
+		ret = batch_send_chunk(sock, cmds, index, count, msgs, replies);
+		if (ret)
+			goto end;
+	}
+	DBG("batch of %u commands completed", nr_cmds);
+end:
+	free(index);
+	free(replies);
+	free(msgs);
+	return ret;
+}
+
 /*
  * Protocol for LTTNG_UST_ABI_EVENT_NOTIFIER_GROUP_CREATE command:
  *
@@ -728,6 +995,141 @@ int lttng_ust_ctl_create_event_notifier(int sock, struct lttng_ust_abi_event_not
 	return ret;
 }
 
+/*
+ * Each notification is written atomically to the pipe, so it is at most
+ * PIPE_BUF long. Reading many PIPE_BUF at a time drains bursts of
+ * notifications with few read() calls.
+ */
+#define NOTIFICATION_READER_BUF_LEN	(16 * PIPE_BUF)
+
+struct lttng_ust_ctl_notification_reader {
+	int fd;
+	size_t pos;		/* Start of the next notification in buf */
+	size_t len;		/* Bytes read in buf */
+	uint8_t buf[NOTIFICATION_READER_BUF_LEN];
+};
+
+struct lttng_ust_ctl_notification_reader *
+	lttng_ust_ctl_create_notification_reader(int pipe_fd)
+{
+	struct lttng_ust_ctl_notification_reader *reader;
+
+	if (pipe_fd < 0)
+		return NULL;
+	reader = zmalloc(sizeof(*reader));
+	if (!reader)
+		return NULL;
+	reader->fd = pipe_fd;
+	return reader;
+}
+
+void lttng_ust_ctl_destroy_notification_reader(
+		struct lttng_ust_ctl_notification_reader *reader)
+{
+	free(reader);
+}
+
+int lttng_ust_ctl_read_notification(struct lttng_ust_ctl_notification_reader *reader,
+		struct lttng_ust_ctl_notification *notification)
+{
+	struct lttng_ust_abi_event_notifier_notification header;
+
+	if (!reader || !notification)
+		return -EINVAL;
+	for (;;) {
+		size_t avail = reader->len - reader->pos;
+		ssize_t len;
+
+		if (avail >= sizeof(header)) {
+			memcpy(&header, &reader->buf[reader->pos], sizeof(header));
+			if (sizeof(header) + header.capture_buf_size > NOTIFICATION_READER_BUF_LEN)
+				return -EINVAL;
+			if (avail >= sizeof(header) + header.capture_buf_size) {
+				notification->token = header.token;
+				notification->capture_buf =
+					&reader->buf[reader->pos + sizeof(header)];
+				notification->capture_len = header.capture_buf_size;
+				notification->capture_pos = 0;
+				reader->pos += sizeof(header) + header.capture_buf_size;
+				return 1;
+			}
+		}
+
+		/* Keep the partial notification and read more. */
+		memmove(reader->buf, &reader->buf[reader->pos], avail);
+		reader->pos = 0;
+		reader->len = avail;
+		do {
+			len = read(reader->fd, &reader->buf[reader->len],
+				NOTIFICATION_READER_BUF_LEN - reader->len);
+		} while (len < 0 && errno == EINTR);
+		if (len < 0) {
+			if (errno == EAGAIN)
+				return 0;
+			return -errno;
+		}
+		if (len == 0)
+			return -EPIPE;
+		reader->len += len;
+	}
+}
+
+int lttng_ust_ctl_notification_next_capture(struct lttng_ust_ctl_notification *notification,
+		struct lttng_ust_ctl_capture_value *value)
+{
+	struct lttng_msgpack_reader reader;
+	struct lttng_msgpack_object object;
+
+	if (!notification || !value)
+		return -EINVAL;
+	if (notification->capture_pos >= notification->capture_len)
+		return 0;
+	lttng_msgpack_reader_init(&reader,
+		notification->capture_buf + notification->capture_pos,
+		notification->capture_len - notification->capture_pos);
+	if (lttng_msgpack_read_object(&reader, &object))
+		return -EINVAL;
+	notification->capture_pos += reader.read_pos - reader.buffer;
+
+	switch (object.type) {
+	case LTTNG_MSGPACK_OBJECT_NIL:
+		value->type = LTTNG_UST_CTL_CAPTURE_NIL;
+		break;
+	case LTTNG_MSGPACK_OBJECT_BOOL:
+		value->type = LTTNG_UST_CTL_CAPTURE_BOOL;
+		value->u.b = object.u.b;
+		break;
+	case LTTNG_MSGPACK_OBJECT_UNSIGNED_INTEGER:
+		value->type = LTTNG_UST_CTL_CAPTURE_UNSIGNED;
+		value->u.u = object.u.u;
+		break;
+	case LTTNG_MSGPACK_OBJECT_SIGNED_INTEGER:
+		value->type = LTTNG_UST_CTL_CAPTURE_SIGNED;
+		value->u.s = object.u.s;
+		break;
+	case LTTNG_MSGPACK_OBJECT_DOUBLE:
+		value->type = LTTNG_UST_CTL_CAPTURE_DOUBLE;
+		value->u.d = object.u.d;
+		break;
+	case LTTNG_MSGPACK_OBJECT_STR:
+		value->type = LTTNG_UST_CTL_CAPTURE_STRING;
+		value->u.str.str = object.u.str.str;
+		value->u.str.len = object.u.str.len;
+		break;
+	case LTTNG_MSGPACK_OBJECT_ARRAY:
+		value->type = LTTNG_UST_CTL_CAPTURE_ARRAY;
+		value->u.count = object.u.count;
+		break;
+	case LTTNG_MSGPACK_OBJECT_MAP:
+		value->type = LTTNG_UST_CTL_CAPTURE_MAP;
+		value->u.count = object.u.count;
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 1;
+}
+
 int lttng_ust_ctl_tracepoint_list(int sock)
 {
 	struct ustcomm_ust_msg lum;
@@ -850,6 +1252,28 @@ int lttng_ust_ctl_wait_quiescent(int sock)
 	return 0;
 }
 
+int lttng_ust_ctl_set_tracepoint_sample_period(int sock, const char *name,
+		uint32_t period)
+{
+	struct ustcomm_ust_msg lum;
+	struct ustcomm_ust_reply lur;
+	int ret;
+
+	if (!name || strlen(name) >= LTTNG_UST_ABI_SYM_NAME_LEN)
+		return -EINVAL;
+
+	memset(&lum, 0, sizeof(lum));
+	lum.handle = LTTNG_UST_ABI_ROOT_HANDLE;
+	lum.cmd = LTTNG_UST_ABI_TRACEPOINT_SAMPLE;
+	strcpy(lum.u.tracepoint_sample.name, name);
+	lum.u.tracepoint_sample.period = period;
+	ret = ustcomm_send_app_cmd(sock, &lum, &lur);
+	if (ret)
+		return ret;
+	DBG("set sampling period of tracepoint %s to %u", name, period);
+	return 0;
+}
+
 int lttng_ust_ctl_calibrate(int sock __attribute__((unused)),
 		struct lttng_ust_abi_calibrate *calibrate)
 {
@@ -878,39 +1302,44 @@ int lttng_ust_ctl_sock_flush_buffer(int sock, struct lttng_ust_abi_object_data *
 	return 0;
 }
 
+/*
+ * Send the channel data, preceded either by the command message @lum
+ * when sending to the application, or else by the mmap size and channel
+ * type unless @send_fd_only, in a single sendmsg call. The wakeup fd
+ * follows in its own message, as the receiver gets it separately.
+ */
 static
 int lttng_ust_ctl_send_channel(int sock,
+		struct ustcomm_ust_msg *lum,
 		enum lttng_ust_abi_chan_type type,
 		void *data,
 		uint64_t size,
 		int wakeup_fd,
 		int send_fd_only)
 {
+	struct iovec iov[3];
+	size_t i, iovcnt = 0, expected = 0;
 	ssize_t len;
 
-	if (!send_fd_only) {
-		/* Send mmap size */
-		len = ustcomm_send_unix_sock(sock, &size, sizeof(size));
-		if (len != sizeof(size)) {
-			if (len < 0)
-				return len;
-			else
-				return -EIO;
-		}
-
-		/* Send channel type */
-		len = ustcomm_send_unix_sock(sock, &type, sizeof(type));
-		if (len != sizeof(type)) {
-			if (len < 0)
-				return len;
-			else
-				return -EIO;
-		}
+	if (lum) {
+		iov[iovcnt].iov_base = lum;
+		iov[iovcnt++].iov_len = sizeof(*lum);
+	} else if (!send_fd_only) {
+		/* Send mmap size and channel type */
+		iov[iovcnt].iov_base = &size;
+		iov[iovcnt++].iov_len = sizeof(size);
+		iov[iovcnt].iov_base = &type;
+		iov[iovcnt++].iov_len = sizeof(type);
 	}
 
 	/* Send channel data */
-	len = ustcomm_send_unix_sock(sock, data, size);
-	if (len != size) {
+	iov[iovcnt].iov_base = data;
+	iov[iovcnt++].iov_len = size;
+
+	for (i = 0; i < iovcnt; i++)
+		expected += iov[i].iov_len;
+	len = ustcomm_send_unix_sock_iov(sock, iov, iovcnt);
+	if (len != expected) {
 		if (len < 0)
 			return len;
 		else
@@ -935,6 +1364,7 @@ int lttng_ust_ctl_send_stream(int sock,
 		int shm_fd, int wakeup_fd,
 		int send_fd_only)
 {
+	struct iovec iov[2];
 	ssize_t len;
 	int fds[2];
 
@@ -953,20 +1383,13 @@ int lttng_ust_ctl_send_stream(int sock,
 			return 0;
 		}
 
-		/* Send mmap size */
-		len = ustcomm_send_unix_sock(sock, &memory_map_size,
-			sizeof(memory_map_size));
-		if (len != sizeof(memory_map_size)) {
-			if (len < 0)
-				return len;
-			else
-				return -EIO;
-		}
-
-		/* Send stream nr */
-		len = ustcomm_send_unix_sock(sock, &stream_nr,
-			sizeof(stream_nr));
-		if (len != sizeof(stream_nr)) {
+		/* Send mmap size and stream nr */
+		iov[0].iov_base = &memory_map_size;
+		iov[0].iov_len = sizeof(memory_map_size);
+		iov[1].iov_base = &stream_nr;
+		iov[1].iov_len = sizeof(stream_nr);
+		len = ustcomm_send_unix_sock_iov(sock, iov, 2);
+		if (len != sizeof(memory_map_size) + sizeof(stream_nr)) {
 			if (len < 0)
 				return len;
 			else
@@ -1154,11 +1577,8 @@ int lttng_ust_ctl_send_channel_to_ust(int sock, int session_handle,
 	lum.cmd = LTTNG_UST_ABI_CHANNEL;
 	lum.u.channel.len = channel_data->size;
 	lum.u.channel.type = channel_data->u.channel.type;
-	ret = ustcomm_send_app_msg(sock, &lum);
-	if (ret)
-		return ret;
 
-	ret = lttng_ust_ctl_send_channel(sock,
+	ret = lttng_ust_ctl_send_channel(sock, &lum,
 			channel_data->u.channel.type,
 			channel_data->u.channel.data,
 			channel_data->size,
@@ -1228,25 +1648,162 @@ int lttng_ust_ctl_send_stream_to_ust(int sock,
 	return ret;
 }
 
-int lttng_ust_ctl_duplicate_ust_object_data(struct lttng_ust_abi_object_data **dest,
-                struct lttng_ust_abi_object_data *src)
+/*
+ * Streams of a channel created with a single stream fd share their shm
+ * file: their shm fds, received separately, refer to the same file.
+ */
+static
+bool lttng_ust_ctl_streams_in_arena(struct lttng_ust_abi_object_data **stream_data,
+		unsigned int nr_streams)
 {
-	struct lttng_ust_abi_object_data *obj;
-	int ret;
-
-	if (src->handle != -1) {
-		ret = -EINVAL;
-		goto error;
-	}
-
-	obj = zmalloc(sizeof(*obj));
-	if (!obj) {
-		ret = -ENOMEM;
-		goto error;
+	struct stat first, statbuf;
+	unsigned int i;
+
+	if (nr_streams < 2)
+		return false;
+	if (fstat(stream_data[0]->u.stream.shm_fd, &first))
+		return false;
+	for (i = 1; i < nr_streams; i++) {
+		if (fstat(stream_data[i]->u.stream.shm_fd, &statbuf))
+			return false;
+		if (statbuf.st_dev != first.st_dev || statbuf.st_ino != first.st_ino)
+			return false;
 	}
+	return true;
+}
 
-	obj->type = src->type;
-	obj->handle = src->handle;
+/*
+ * Protocol for LTTNG_UST_ABI_STREAMS command:
+ *
+ * - send:     struct ustcomm_ust_msg followed by struct lttng_ust_abi_stream[]
+ * - send:     shm fd and wakeup fd of each stream, in chunks, or the
+ *             arena shm fd followed by the wakeup fd of each stream
+ * - receive:  struct ustcomm_ust_reply
+ */
+static
+int lttng_ust_ctl_send_streams_chunk(int sock,
+		struct lttng_ust_abi_object_data *channel_data,
+		struct lttng_ust_abi_object_data **stream_data,
+		unsigned int nr_streams, bool arena)
+{
+	struct lttng_ust_abi_stream *streams;
+	struct ustcomm_ust_msg lum;
+	struct ustcomm_ust_reply lur;
+	unsigned int i, nr_fds = 0;
+	int *fds;
+	ssize_t len;
+	int ret;
+
+	streams = zmalloc(nr_streams * sizeof(*streams));
+	if (!streams)
+		return -ENOMEM;
+	for (i = 0; i < nr_streams; i++) {
+		assert(stream_data[i]);
+		assert(stream_data[i]->type == LTTNG_UST_ABI_OBJECT_TYPE_STREAM);
+		streams[i].len = stream_data[i]->size;
+		streams[i].stream_nr = stream_data[i]->u.stream.stream_nr;
+	}
+
+	memset(&lum, 0, sizeof(lum));
+	lum.handle = channel_data->handle;
+	lum.cmd = LTTNG_UST_ABI_STREAMS;
+	lum.u.streams.count = nr_streams;
+	lum.u.streams.arena = arena;
+	ret = ustcomm_send_app_msg_payload(sock, &lum, streams,
+			nr_streams * sizeof(*streams));
+	free(streams);
+	if (ret)
+		return ret;
+
+	/*
+	 * Send the shm fd and wakeup fd of each stream, in chunks of
+	 * exactly USTCOMM_STREAMS_FDS_PER_MSG fds but for the last one.
+	 */
+	fds = zmalloc(2 * nr_streams * sizeof(*fds));
+	if (!fds)
+		return -ENOMEM;
+	if (arena)
+		fds[nr_fds++] = stream_data[0]->u.stream.shm_fd;
+	for (i = 0; i < nr_streams; i++) {
+		if (!arena)
+			fds[nr_fds++] = stream_data[i]->u.stream.shm_fd;
+		fds[nr_fds++] = stream_data[i]->u.stream.wakeup_fd;
+	}
+	for (i = 0; i < nr_fds; i += USTCOMM_STREAMS_FDS_PER_MSG) {
+		unsigned int chunk = nr_fds - i;
+
+		if (chunk > USTCOMM_STREAMS_FDS_PER_MSG)
+			chunk = USTCOMM_STREAMS_FDS_PER_MSG;
+		len = ustcomm_send_fds_unix_sock(sock, &fds[i], chunk);
+		if (len <= 0) {
+			free(fds);
+			if (len < 0)
+				return len;
+			else
+				return -EIO;
+		}
+	}
+	free(fds);
+
+	ret = ustcomm_recv_app_reply(sock, &lur, lum.handle, lum.cmd);
+	if (ret == -EINVAL) {
+		/*
+		 * Command unknown from remote end. The communication socket is
+		 * now out-of-sync and needs to be shutdown.
+		 */
+		(void) ustcomm_shutdown_unix_sock(sock);
+	}
+	return ret;
+}
+
+/*
+ * Send the @nr_streams streams of a channel with LTTNG_UST_ABI_STREAMS
+ * commands of up to USTCOMM_STREAMS_MAX streams each, rather than with
+ * one LTTNG_UST_ABI_STREAM command per stream. Requires ABI minor
+ * version 1 on the application side.
+ */
+int lttng_ust_ctl_send_streams_to_ust(int sock,
+		struct lttng_ust_abi_object_data *channel_data,
+		struct lttng_ust_abi_object_data **stream_data,
+		unsigned int nr_streams)
+{
+	unsigned int i;
+	bool arena;
+	int ret;
+
+	arena = lttng_ust_ctl_streams_in_arena(stream_data, nr_streams);
+	for (i = 0; i < nr_streams; i += USTCOMM_STREAMS_MAX) {
+		unsigned int chunk = nr_streams - i;
+
+		if (chunk > USTCOMM_STREAMS_MAX)
+			chunk = USTCOMM_STREAMS_MAX;
+		ret = lttng_ust_ctl_send_streams_chunk(sock, channel_data,
+				&stream_data[i], chunk, arena);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+int lttng_ust_ctl_duplicate_ust_object_data(struct lttng_ust_abi_object_data **dest,
+                struct lttng_ust_abi_object_data *src)
+{
+	struct lttng_ust_abi_object_data *obj;
+	int ret;
+
+	if (src->handle != -1) {
+		ret = -EINVAL;
+		goto error;
+	}
+
+	obj = zmalloc(sizeof(*obj));
+	if (!obj) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	obj->type = src->type;
+	obj->handle = src->handle;
 	obj->size = src->size;
 
 	switch (obj->type) {
@@ -1387,9 +1944,23 @@ int lttng_ust_ctl_get_nr_stream_per_channel(void)
 	return num_possible_cpus();
 }
 
+int lttng_ust_ctl_get_nr_stream_per_channel_pid(pid_t pid)
+{
+	return num_affinity_cpus(pid);
+}
+
 struct lttng_ust_ctl_consumer_channel *
 	lttng_ust_ctl_create_channel(struct lttng_ust_ctl_consumer_channel_attr *attr,
 		const int *stream_fds, int nr_stream_fds)
+{
+	return lttng_ust_ctl_create_channel_nr_streams(attr, stream_fds,
+			nr_stream_fds, 0);
+}
+
+struct lttng_ust_ctl_consumer_channel *
+	lttng_ust_ctl_create_channel_nr_streams(struct lttng_ust_ctl_consumer_channel_attr *attr,
+		const int *stream_fds, int nr_stream_fds,
+		unsigned int nr_streams)
 {
 	struct lttng_ust_ctl_consumer_channel *chan;
 	const char *transport_name;
@@ -1415,6 +1986,15 @@ struct lttng_ust_ctl_consumer_channel *
 			return NULL;
 		}
 		break;
+	case LTTNG_UST_ABI_CHAN_PER_THREAD:
+		/* Only discard mode with writer wakeup is available. */
+		if (attr->output == LTTNG_UST_ABI_MMAP && !attr->overwrite
+				&& attr->read_timer_interval == 0) {
+			transport_name = "relay-discard-per-thread-mmap";
+		} else {
+			return NULL;
+		}
+		break;
 	case LTTNG_UST_ABI_CHAN_METADATA:
 		if (attr->output == LTTNG_UST_ABI_MMAP)
 			transport_name = "relay-metadata-mmap";
@@ -1442,7 +2022,7 @@ struct lttng_ust_ctl_consumer_channel *
 			attr->switch_timer_interval,
 			attr->read_timer_interval,
 			attr->uuid, attr->chan_id,
-			stream_fds, nr_stream_fds,
+			stream_fds, nr_stream_fds, nr_streams,
 			attr->blocking_timeout);
 	if (!chan->chan) {
 		goto chan_error;
@@ -1474,7 +2054,7 @@ int lttng_ust_ctl_send_channel_to_sessiond(int sock,
 	table = channel->chan->priv->rb_chan->handle->table;
 	if (table->size <= 0)
 		return -EINVAL;
-	return lttng_ust_ctl_send_channel(sock,
+	return lttng_ust_ctl_send_channel(sock, NULL,
 			channel->attr.type,
 			table->objects[0].memory_map,
 			table->objects[0].memory_map_size,
@@ -1499,15 +2079,32 @@ int lttng_ust_ctl_write_metadata_to_channel(
 		struct lttng_ust_ctl_consumer_channel *channel,
 		const char *metadata_str,	/* NOT null-terminated */
 		size_t len)			/* metadata length */
+{
+	struct iovec iov = {
+		.iov_base = (void *) metadata_str,
+		.iov_len = len,
+	};
+
+	return lttng_ust_ctl_writev_metadata_to_channel(channel, &iov, 1);
+}
+
+int lttng_ust_ctl_writev_metadata_to_channel(
+		struct lttng_ust_ctl_consumer_channel *channel,
+		const struct iovec *iov, int iovcnt)
 {
 	struct lttng_ust_ring_buffer_ctx ctx;
 	struct lttng_ust_channel_buffer *lttng_chan_buf = channel->chan;
 	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan_buf->priv->rb_chan;
-	const char *str = metadata_str;
-	int ret = 0, waitret;
-	size_t reserve_len, pos;
+	int ret = 0, waitret, i, iov_idx = 0;
+	size_t reserve_len, pos, len = 0, iov_off = 0;
 
+	if (iovcnt < 0 || (!iov && iovcnt))
+		return -EINVAL;
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
 	for (pos = 0; pos < len; pos += reserve_len) {
+		size_t written;
+
 		reserve_len = min_t(size_t,
 				lttng_chan_buf->ops->priv->packet_avail_size(lttng_chan_buf),
 				len - pos);
@@ -1532,7 +2129,22 @@ int lttng_ust_ctl_write_metadata_to_channel(
 				ret = waitret;
 			goto end;
 		}
-		lttng_chan_buf->ops->event_write(&ctx, &str[pos], reserve_len, 1);
+		/* Fill the reservation with as many fragments as fit. */
+		for (written = 0; written < reserve_len;) {
+			size_t frag_len = min_t(size_t, iov[iov_idx].iov_len - iov_off,
+					reserve_len - written);
+
+			if (frag_len)
+				lttng_chan_buf->ops->event_write(&ctx,
+					(const char *) iov[iov_idx].iov_base + iov_off,
+					frag_len, 1);
+			written += frag_len;
+			iov_off += frag_len;
+			if (iov_off == iov[iov_idx].iov_len) {
+				iov_idx++;
+				iov_off = 0;
+			}
+		}
 		lttng_chan_buf->ops->event_commit(&ctx);
 	}
 end:
@@ -1617,9 +2229,9 @@ int lttng_ust_ctl_stream_close_wakeup_fd(struct lttng_ust_ctl_consumer_stream *s
 			chan, chan->handle, stream->cpu);
 }
 
-struct lttng_ust_ctl_consumer_stream *
-	lttng_ust_ctl_create_stream(struct lttng_ust_ctl_consumer_channel *channel,
-			int cpu)
+static struct lttng_ust_ctl_consumer_stream *
+	lttng_ust_ctl_open_stream(struct lttng_ust_ctl_consumer_channel *channel,
+			int cpu, struct lttng_ust_ctl_stream_checkpoint *checkpoint)
 {
 	struct lttng_ust_ctl_consumer_stream *stream;
 	struct lttng_ust_shm_handle *handle;
@@ -1642,9 +2254,18 @@ struct lttng_ust_ctl_consumer_stream *
 		&wakeup_fd, &memory_map_size, &memory_map_addr);
 	if (!buf)
 		return NULL;
-	ret = lib_ring_buffer_open_read(buf, handle);
-	if (ret)
-		return NULL;
+	if (checkpoint) {
+		unsigned long reached, held;
+
+		lib_ring_buffer_resume_read(buf, handle, &reached, &held);
+		checkpoint->checkpoint = reached;
+		checkpoint->held = held == -1UL ? UINT64_MAX : held;
+		checkpoint->consumed = uatomic_read(&buf->consumed);
+	} else {
+		ret = lib_ring_buffer_open_read(buf, handle);
+		if (ret)
+			return NULL;
+	}
 
 	stream = zmalloc(sizeof(*stream));
 	if (!stream)
@@ -1660,9 +2281,49 @@ struct lttng_ust_ctl_consumer_stream *
 	return stream;
 
 alloc_error:
+	if (checkpoint)
+		lib_ring_buffer_release_read(buf, handle);
 	return NULL;
 }
 
+struct lttng_ust_ctl_consumer_stream *
+	lttng_ust_ctl_create_stream(struct lttng_ust_ctl_consumer_channel *channel,
+			int cpu)
+{
+	return lttng_ust_ctl_open_stream(channel, cpu, NULL);
+}
+
+struct lttng_ust_ctl_consumer_stream *
+	lttng_ust_ctl_resume_stream(struct lttng_ust_ctl_consumer_channel *channel,
+			int cpu, struct lttng_ust_ctl_stream_checkpoint *checkpoint)
+{
+	if (!checkpoint)
+		return NULL;
+	return lttng_ust_ctl_open_stream(channel, cpu, checkpoint);
+}
+
+int lttng_ust_ctl_stream_set_trusted(struct lttng_ust_ctl_consumer_stream *stream)
+{
+#ifdef F_SEAL_SHRINK
+	int seals;
+
+	if (!stream)
+		return -EINVAL;
+	/* Fails if the file is already sealed, check the seals anyway. */
+	(void) fcntl(stream->shm_fd, F_ADD_SEALS, F_SEAL_SHRINK);
+	seals = fcntl(stream->shm_fd, F_GET_SEALS);
+	if (seals < 0)
+		return -errno;
+	if (!(seals & F_SEAL_SHRINK))
+		return -EPERM;
+	stream->trusted = true;
+	return 0;
+#else
+	(void) stream;
+	return -ENOSYS;
+#endif
+}
+
 void lttng_ust_ctl_destroy_stream(struct lttng_ust_ctl_consumer_stream *stream)
 {
 	struct lttng_ust_ring_buffer *buf;
@@ -1693,6 +2354,78 @@ int lttng_ust_ctl_channel_get_wakeup_fd(struct lttng_ust_ctl_consumer_channel *c
 		&chan->chan->priv->rb_chan->handle->chan._ref);
 }
 
+int lttng_ust_ctl_channel_set_subbuf_fill_limit(struct lttng_ust_ctl_consumer_channel *chan,
+		unsigned long limit)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan;
+
+	if (!chan)
+		return -EINVAL;
+	rb_chan = chan->chan->priv->rb_chan;
+	if (!limit)
+		limit = rb_chan->backend.subbuf_size;
+	if (limit > rb_chan->backend.subbuf_size)
+		return -EINVAL;
+	CMM_STORE_SHARED(rb_chan->backend.subbuf_fill_limit, limit);
+	return 0;
+}
+
+/* Set the bit of each readable stream in the zeroed bitmap. */
+static
+int lttng_ust_ctl_channel_scan_streams(struct lttng_ust_ring_buffer_channel *rb_chan,
+		uint64_t *bitmap)
+{
+	struct lttng_ust_shm_handle *handle = rb_chan->handle;
+	unsigned int i;
+
+	if (sigbus_begin())
+		return -EIO;
+	for (i = 0; i < rb_chan->nr_streams; i++) {
+		struct lttng_ust_ring_buffer *buf;
+		struct lttng_ust_sigbus_range range;
+		int shm_fd, wait_fd, wakeup_fd;
+		uint64_t memory_map_size;
+		void *memory_map_addr;
+		int readable;
+
+		buf = channel_get_ring_buffer(&rb_chan->backend.config,
+			rb_chan, i, handle, &shm_fd, &wait_fd, &wakeup_fd,
+			&memory_map_size, &memory_map_addr);
+		if (!buf)
+			continue;
+		lttng_ust_sigbus_add_range(&range, memory_map_addr,
+					memory_map_size);
+		readable = lib_ring_buffer_poll_deliver(&rb_chan->backend.config,
+				buf, rb_chan, handle);
+		lttng_ust_sigbus_del_range(&range);
+		if (readable)
+			bitmap[i / 64] |= UINT64_C(1) << (i % 64);
+	}
+	sigbus_end();
+	return 0;
+}
+
+int lttng_ust_ctl_channel_get_readable_streams(struct lttng_ust_ctl_consumer_channel *consumer_chan,
+		uint64_t *bitmap, unsigned int nr_words)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan;
+	unsigned int i;
+	int ret, nr_readable = 0;
+
+	if (!consumer_chan || !bitmap)
+		return -EINVAL;
+	rb_chan = consumer_chan->chan->priv->rb_chan;
+	if ((uint64_t) nr_words * 64 < rb_chan->nr_streams)
+		return -EINVAL;
+	memset(bitmap, 0, nr_words * sizeof(*bitmap));
+	ret = lttng_ust_ctl_channel_scan_streams(rb_chan, bitmap);
+	if (ret)
+		return ret;
+	for (i = 0; i < nr_words; i++)
+		nr_readable += __builtin_popcountll(bitmap[i]);
+	return nr_readable;
+}
+
 int lttng_ust_ctl_stream_get_wait_fd(struct lttng_ust_ctl_consumer_stream *stream)
 {
 	struct lttng_ust_ring_buffer *buf;
@@ -1730,13 +2463,12 @@ void *lttng_ust_ctl_get_mmap_base(struct lttng_ust_ctl_consumer_stream *stream)
 		return NULL;
 	buf = stream->buf;
 	consumer_chan = stream->chan;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return NULL;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	p = shmp(consumer_chan->chan->priv->rb_chan->handle, buf->backend.memory_map);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return p;	/* Users of this pointer should check for sigbus. */
 }
 
@@ -1804,11 +2536,10 @@ int lttng_ust_ctl_get_mmap_read_offset(struct lttng_ust_ctl_consumer_stream *str
 	if (rb_chan->backend.config.output != RING_BUFFER_MMAP)
 		return -EINVAL;
 
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
 	ret = 0;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 
 	sb_bindex = subbuffer_id_get_index(&rb_chan->backend.config,
 					buf->backend.buf_rsb.id);
@@ -1825,8 +2556,8 @@ int lttng_ust_ctl_get_mmap_read_offset(struct lttng_ust_ctl_consumer_stream *str
 	}
 	*off = pages->mmap_offset;
 end:
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -1845,14 +2576,13 @@ int lttng_ust_ctl_get_subbuf_size(struct lttng_ust_ctl_consumer_stream *stream,
 	buf = stream->buf;
 	consumer_chan = stream->chan;
 	rb_chan = consumer_chan->chan->priv->rb_chan;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	*len = lib_ring_buffer_get_read_data_size(&rb_chan->backend.config, buf,
 		rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return 0;
 }
 
@@ -1870,84 +2600,776 @@ int lttng_ust_ctl_get_padded_subbuf_size(struct lttng_ust_ctl_consumer_stream *s
 	buf = stream->buf;
 	consumer_chan = stream->chan;
 	rb_chan = consumer_chan->chan->priv->rb_chan;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	*len = lib_ring_buffer_get_read_data_size(&rb_chan->backend.config, buf,
 		rb_chan->handle);
 	*len = LTTNG_UST_PAGE_ALIGN(*len);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return 0;
 }
 
-/* Get exclusive read access to the next sub-buffer that can be read. */
-int lttng_ust_ctl_get_next_subbuf(struct lttng_ust_ctl_consumer_stream *stream)
+/*
+ * Worst-case compressed size of len bytes with codec, or 0 if the codec is
+ * not supported by this build.
+ */
+static
+unsigned long compress_bound(enum lttng_ust_ctl_compression_codec codec,
+		unsigned long len)
 {
-	struct lttng_ust_ring_buffer *buf;
+	switch (codec) {
+#ifdef HAVE_LZ4
+	case LTTNG_UST_CTL_COMPRESSION_LZ4:
+		if (len > LZ4_MAX_INPUT_SIZE)
+			return 0;
+		return LZ4_compressBound(len);
+#endif
+#ifdef HAVE_ZSTD
+	case LTTNG_UST_CTL_COMPRESSION_ZSTD:
+		return ZSTD_compressBound(len);
+#endif
+	default:
+		(void) len;
+		return 0;
+	}
+}
+
+/*
+ * Compress the content of the current sub-buffer into dst, after its
+ * compressed packet header. On entry, *len is the size of dst. On
+ * success, *len is the size of the header and compressed content.
+ * Returns -ENOBUFS, with *len set to the worst-case size, if dst is too
+ * small, and -ENOSYS if the codec is not supported by this build.
+ */
+int lttng_ust_ctl_compress_subbuf(struct lttng_ust_ctl_consumer_stream *stream,
+		enum lttng_ust_ctl_compression_codec codec, int level,
+		void *dst, unsigned long *len)
+{
+	struct lttng_ust_ctl_compressed_packet_header header;
 	struct lttng_ust_ctl_consumer_channel *consumer_chan;
+	struct lttng_ust_ring_buffer_channel *rb_chan;
+	struct lttng_ust_ring_buffer *buf;
 	struct lttng_ust_sigbus_range range;
+	unsigned long data_size, bound, cap;
+	char *payload;
+	const char *src;
 	int ret;
 
-	if (!stream)
+	if (!stream || !dst || !len)
 		return -EINVAL;
+	if (!compress_bound(codec, 1))
+		return -ENOSYS;
 	buf = stream->buf;
 	consumer_chan = stream->chan;
-	if (sigbus_begin())
+	rb_chan = consumer_chan->chan->priv->rb_chan;
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
-	ret = lib_ring_buffer_get_next_subbuf(buf,
-			consumer_chan->chan->priv->rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_add_range(stream, &range);
+	data_size = lib_ring_buffer_get_read_data_size(&rb_chan->backend.config,
+			buf, rb_chan->handle);
+	bound = compress_bound(codec, data_size);
+	if (!bound) {
+		ret = -EINVAL;
+		goto end;
+	}
+	if (*len < sizeof(header) + bound) {
+		*len = sizeof(header) + bound;
+		ret = -ENOBUFS;
+		goto end;
+	}
+	src = lib_ring_buffer_read_offset_address(&buf->backend, 0,
+			rb_chan->handle);
+	if (!src) {
+		ret = -EINVAL;
+		goto end;
+	}
+	payload = (char *) dst + sizeof(header);
+	cap = *len - sizeof(header);
+	switch (codec) {
+#ifdef HAVE_LZ4
+	case LTTNG_UST_CTL_COMPRESSION_LZ4:
+	{
+		int size;
+
+		size = LZ4_compress_fast(src, payload, data_size,
+				cap > INT_MAX ? INT_MAX : cap, level > 0 ? level : 1);
+		if (size <= 0) {
+			ret = -EIO;
+			goto end;
+		}
+		header.compressed_size = size;
+		break;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case LTTNG_UST_CTL_COMPRESSION_ZSTD:
+	{
+		size_t size;
+
+		size = ZSTD_compress(payload, cap, src, data_size, level);
+		if (ZSTD_isError(size)) {
+			ret = -EIO;
+			goto end;
+		}
+		header.compressed_size = size;
+		break;
+	}
+#endif
+	default:
+		(void) payload;
+		(void) cap;
+		(void) level;
+		ret = -ENOSYS;
+		goto end;
+	}
+	header.magic = LTTNG_UST_CTL_COMPRESSED_PACKET_MAGIC;
+	header.codec = codec;
+	header.header_size = sizeof(header);
+	header.reserved = 0;
+	header.content_size = data_size;
+	memcpy(dst, &header, sizeof(header));
+	*len = sizeof(header) + header.compressed_size;
+	ret = 0;
+end:
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
-/* Release exclusive sub-buffer access, move consumer forward. */
-int lttng_ust_ctl_put_next_subbuf(struct lttng_ust_ctl_consumer_stream *stream)
+int lttng_ust_ctl_decompress_packet(const void *src, unsigned long src_len,
+		void *dst, unsigned long *len)
 {
-	struct lttng_ust_ring_buffer *buf;
-	struct lttng_ust_ctl_consumer_channel *consumer_chan;
-	struct lttng_ust_sigbus_range range;
+	struct lttng_ust_ctl_compressed_packet_header header;
+	const char *payload;
 
-	if (!stream)
+	if (!src || !dst || !len || src_len < sizeof(header))
 		return -EINVAL;
-	buf = stream->buf;
-	consumer_chan = stream->chan;
-	if (sigbus_begin())
-		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
-	lib_ring_buffer_put_next_subbuf(buf, consumer_chan->chan->priv->rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	memcpy(&header, src, sizeof(header));
+	if (header.magic != LTTNG_UST_CTL_COMPRESSED_PACKET_MAGIC
+			|| header.header_size < sizeof(header)
+			|| header.header_size > src_len
+			|| header.compressed_size > src_len - header.header_size)
+		return -EINVAL;
+	if (!compress_bound(header.codec, 1))
+		return -ENOSYS;
+	if (*len < header.content_size) {
+		*len = header.content_size;
+		return -ENOBUFS;
+	}
+	payload = (const char *) src + header.header_size;
+	switch (header.codec) {
+#ifdef HAVE_LZ4
+	case LTTNG_UST_CTL_COMPRESSION_LZ4:
+		if (header.compressed_size > INT_MAX
+				|| header.content_size > INT_MAX
+				|| LZ4_decompress_safe(payload, dst,
+					header.compressed_size,
+					header.content_size) != (int) header.content_size)
+			return -EINVAL;
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case LTTNG_UST_CTL_COMPRESSION_ZSTD:
+	{
+		size_t size;
+
+		size = ZSTD_decompress(dst, header.content_size, payload,
+				header.compressed_size);
+		if (ZSTD_isError(size) || size != header.content_size)
+			return -EINVAL;
+		break;
+	}
+#endif
+	default:
+		(void) payload;
+		return -ENOSYS;
+	}
+	*len = header.content_size;
 	return 0;
 }
 
-/* snapshot */
-
-/* Get a snapshot of the current ring buffer producer and consumer positions */
-int lttng_ust_ctl_snapshot(struct lttng_ust_ctl_consumer_stream *stream)
+/* Address of the current packet, or NULL. */
+static
+const char *lttng_ust_ctl_read_subbuf_address(struct lttng_ust_ctl_consumer_stream *stream)
 {
-	struct lttng_ust_ring_buffer *buf;
-	struct lttng_ust_ctl_consumer_channel *consumer_chan;
+	struct lttng_ust_ring_buffer_channel *rb_chan;
 	struct lttng_ust_sigbus_range range;
-	int ret;
+	const char *src;
+
+	rb_chan = stream->chan->chan->priv->rb_chan;
+	if (stream_sigbus_begin(stream))
+		return NULL;
+	stream_sigbus_add_range(stream, &range);
+	src = lib_ring_buffer_read_offset_address(&stream->buf->backend, 0,
+			rb_chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return src;
+}
+
+ssize_t lttng_ust_ctl_splice_subbuf(struct lttng_ust_ctl_consumer_stream *stream,
+		unsigned long len, const int *pipe_fds, int out_fd)
+{
+#if defined(__linux__) && defined(F_GETPIPE_SZ)
+	struct lttng_ust_ring_buffer_channel *rb_chan;
+	unsigned long done = 0;
+	const char *src;
+	int pipe_size;
+
+	if (!stream || !pipe_fds)
+		return -EINVAL;
+	rb_chan = stream->chan->chan->priv->rb_chan;
+	if (rb_chan->backend.config.output != RING_BUFFER_MMAP)
+		return -EINVAL;
+	if (len > rb_chan->backend.subbuf_size)
+		return -EINVAL;
+	pipe_size = fcntl(pipe_fds[1], F_GETPIPE_SZ);
+	if (pipe_size <= 0)
+		return pipe_size < 0 ? -errno : -EINVAL;
+	src = lttng_ust_ctl_read_subbuf_address(stream);
+	if (!src)
+		return -EIO;
+
+	/*
+	 * The pages are only referenced by the pipe, never copied: a
+	 * truncated shm file makes vmsplice fail with EFAULT rather than
+	 * raise SIGBUS.
+	 */
+	while (done < len) {
+		struct iovec iov = {
+			.iov_base = (void *) (src + done),
+			.iov_len = min_t(unsigned long, len - done, pipe_size),
+		};
+		ssize_t in_pipe;
+
+		in_pipe = vmsplice(pipe_fds[1], &iov, 1, 0);
+		if (in_pipe < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		while (in_pipe > 0) {
+			ssize_t spliced;
+
+			spliced = splice(pipe_fds[0], NULL, out_fd, NULL, in_pipe,
+				SPLICE_F_MOVE
+				| (done + in_pipe < len ? SPLICE_F_MORE : 0));
+			if (spliced < 0) {
+				if (errno == EINTR)
+					continue;
+				return -errno;
+			}
+			if (!spliced)
+				return -EPIPE;
+			in_pipe -= spliced;
+			done += spliced;
+		}
+	}
+	return done;
+#else
+	(void) stream;
+	(void) len;
+	(void) pipe_fds;
+	(void) out_fd;
+	return -ENOSYS;
+#endif
+}
+
+/*
+ * Memory-mapped output. Packets are copied from the stream mapping into
+ * a window of the trace file mapped in shared mode, which moves forward
+ * as the file grows. Blocks of each window are reserved before it is
+ * mapped where fallocate is available, so a full file system fails the
+ * write instead of raising SIGBUS on the window.
+ */
+struct lttng_ust_ctl_mmap_output {
+	int fd;
+	size_t window_size;
+	char *window;			/* NULL: no window mapped. */
+	uint64_t window_offset;		/* File offset of the window. */
+	uint64_t pos;			/* File offset of the next write. */
+};
+
+static
+void mmap_output_retire_window(struct lttng_ust_ctl_mmap_output *out)
+{
+	if (!out->window)
+		return;
+	/* Start the writeback, and drop the pages from the address space. */
+	if (msync(out->window, out->window_size, MS_ASYNC))
+		PERROR("msync");
+	(void) madvise(out->window, out->window_size, MADV_DONTNEED);
+	if (munmap(out->window, out->window_size))
+		PERROR("munmap");
+	out->window = NULL;
+}
+
+static
+int mmap_output_map_window(struct lttng_ust_ctl_mmap_output *out)
+{
+	uint64_t offset = out->pos - (out->pos % out->window_size);
+	void *window;
+	int ret;
+
+	mmap_output_retire_window(out);
+#ifdef HAVE_FALLOCATE
+	do {
+		ret = fallocate(out->fd, 0, offset, out->window_size);
+	} while (ret && errno == EINTR);
+	if (ret && errno != EOPNOTSUPP && errno != ENOSYS)
+		return -errno;
+	if (ret)
+#endif
+	{
+		struct stat statbuf;
+
+		if (fstat(out->fd, &statbuf))
+			return -errno;
+		if ((uint64_t) statbuf.st_size < offset + out->window_size
+				&& ftruncate(out->fd, offset + out->window_size))
+			return -errno;
+	}
+	window = mmap(NULL, out->window_size, PROT_WRITE, MAP_SHARED,
+			out->fd, offset);
+	if (window == MAP_FAILED)
+		return -errno;
+	out->window = window;
+	out->window_offset = offset;
+	return 0;
+}
+
+static
+int mmap_output_copy(struct lttng_ust_ctl_mmap_output *out,
+		struct lttng_ust_ctl_consumer_stream *stream,
+		char *dst, const char *src, size_t len)
+{
+	struct lttng_ust_sigbus_range src_range, dst_range;
+
+	if (sigbus_begin())
+		return -EIO;
+	lttng_ust_sigbus_add_range(&src_range, stream->memory_map_addr,
+				stream->memory_map_size);
+	lttng_ust_sigbus_add_range(&dst_range, out->window, out->window_size);
+	memcpy(dst, src, len);
+	lttng_ust_sigbus_del_range(&dst_range);
+	lttng_ust_sigbus_del_range(&src_range);
+	sigbus_end();
+	return 0;
+}
+
+struct lttng_ust_ctl_mmap_output *lttng_ust_ctl_mmap_output_create(int fd,
+		uint64_t offset, size_t window_size)
+{
+	struct lttng_ust_ctl_mmap_output *out;
+
+	if (fd < 0)
+		return NULL;
+	if (!window_size)
+		window_size = LTTNG_UST_CTL_MMAP_OUTPUT_DEFAULT_WINDOW;
+	window_size = LTTNG_UST_PAGE_ALIGN(window_size);
+	out = zmalloc(sizeof(*out));
+	if (!out)
+		return NULL;
+	out->fd = fd;
+	out->window_size = window_size;
+	out->pos = offset;
+	return out;
+}
+
+ssize_t lttng_ust_ctl_mmap_output_write_subbuf(struct lttng_ust_ctl_mmap_output *out,
+		struct lttng_ust_ctl_consumer_stream *stream,
+		unsigned long len)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan;
+	unsigned long done = 0;
+	const char *src;
+	int ret;
+
+	if (!out || !stream)
+		return -EINVAL;
+	rb_chan = stream->chan->chan->priv->rb_chan;
+	if (rb_chan->backend.config.output != RING_BUFFER_MMAP)
+		return -EINVAL;
+	if (len > rb_chan->backend.subbuf_size)
+		return -EINVAL;
+	src = lttng_ust_ctl_read_subbuf_address(stream);
+	if (!src)
+		return -EIO;
+	while (done < len) {
+		uint64_t window_pos;
+		size_t chunk;
+
+		if (!out->window || out->pos < out->window_offset
+				|| out->pos >= out->window_offset + out->window_size) {
+			ret = mmap_output_map_window(out);
+			if (ret)
+				return ret;
+		}
+		window_pos = out->pos - out->window_offset;
+		chunk = min_t(size_t, len - done, out->window_size - window_pos);
+		ret = mmap_output_copy(out, stream, out->window + window_pos,
+				src + done, chunk);
+		if (ret)
+			return ret;
+		done += chunk;
+		out->pos += chunk;
+	}
+	return done;
+}
+
+uint64_t lttng_ust_ctl_mmap_output_get_offset(struct lttng_ust_ctl_mmap_output *out)
+{
+	return out->pos;
+}
+
+int lttng_ust_ctl_mmap_output_destroy(struct lttng_ust_ctl_mmap_output *out)
+{
+	int ret = 0;
+
+	if (!out)
+		return -EINVAL;
+	mmap_output_retire_window(out);
+	/* Remove the unused tail of the last window. */
+	if (ftruncate(out->fd, out->pos))
+		ret = -errno;
+	free(out);
+	return ret;
+}
+
+/*
+ * Packet writeout. Writes are submitted through an io_uring where
+ * available, and issued one by one with write()/pwrite() otherwise.
+ */
+struct lttng_ust_ctl_writeout {
+	int ring_fd;			/* -1: sequential writes. */
+	unsigned int nr_entries;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	void *sqes;
+	size_t sqes_size;
+	void *cqes;
+};
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) \
+	&& defined(IORING_FEAT_RW_CUR_POS)
+
+static
+void writeout_ring_unmap(struct lttng_ust_ctl_writeout *w)
+{
+	if (w->sqes)
+		(void) munmap(w->sqes, w->sqes_size);
+	if (w->cq_ring && w->cq_ring != w->sq_ring)
+		(void) munmap(w->cq_ring, w->cq_ring_size);
+	if (w->sq_ring)
+		(void) munmap(w->sq_ring, w->sq_ring_size);
+	if (w->ring_fd >= 0)
+		(void) close(w->ring_fd);
+	w->ring_fd = -1;
+}
+
+static
+int writeout_ring_setup(struct lttng_ust_ctl_writeout *w, unsigned int nr_entries)
+{
+	struct io_uring_params params;
+	int fd;
+
+	memset(&params, 0, sizeof(params));
+	fd = syscall(__NR_io_uring_setup, nr_entries, &params);
+	if (fd < 0)
+		return -errno;
+	w->ring_fd = fd;
+	/* Writes at the current file position require Linux 5.6. */
+	if (!(params.features & IORING_FEAT_RW_CUR_POS))
+		goto error;
+	w->nr_entries = min_t(unsigned int, params.sq_entries, nr_entries);
+	w->sq_ring_size = params.sq_off.array
+		+ params.sq_entries * sizeof(unsigned int);
+	w->cq_ring_size = params.cq_off.cqes
+		+ params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		w->sq_ring_size = max_t(size_t, w->sq_ring_size, w->cq_ring_size);
+		w->cq_ring_size = w->sq_ring_size;
+	}
+	w->sq_ring = mmap(NULL, w->sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (w->sq_ring == MAP_FAILED) {
+		w->sq_ring = NULL;
+		goto error;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		w->cq_ring = w->sq_ring;
+	} else {
+		w->cq_ring = mmap(NULL, w->cq_ring_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (w->cq_ring == MAP_FAILED) {
+			w->cq_ring = NULL;
+			goto error;
+		}
+	}
+	w->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	w->sqes = mmap(NULL, w->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (w->sqes == MAP_FAILED) {
+		w->sqes = NULL;
+		goto error;
+	}
+	w->sq_tail = (unsigned int *) ((char *) w->sq_ring + params.sq_off.tail);
+	w->sq_mask = (unsigned int *) ((char *) w->sq_ring + params.sq_off.ring_mask);
+	w->sq_array = (unsigned int *) ((char *) w->sq_ring + params.sq_off.array);
+	w->cq_head = (unsigned int *) ((char *) w->cq_ring + params.cq_off.head);
+	w->cq_tail = (unsigned int *) ((char *) w->cq_ring + params.cq_off.tail);
+	w->cq_mask = (unsigned int *) ((char *) w->cq_ring + params.cq_off.ring_mask);
+	w->cqes = (char *) w->cq_ring + params.cq_off.cqes;
+	return 0;
+
+error:
+	writeout_ring_unmap(w);
+	return -ENOSYS;
+}
+
+/*
+ * Submit the writes of nr packets, which fit in the submission queue,
+ * with a single io_uring_enter() in the common case, and wait for all
+ * of them. Consecutive writes to the same fd are linked, so they
+ * complete in order and a failed write cancels the following ones.
+ */
+static
+int writeout_ring_submit(struct lttng_ust_ctl_writeout *w,
+		struct lttng_ust_ctl_writeout_packet *packets,
+		const char **srcs, unsigned int nr)
+{
+	struct io_uring_sqe *sqes = w->sqes;
+	struct io_uring_cqe *cqes = w->cqes;
+	unsigned int i, tail, head, to_submit = nr, completed = 0;
+
+	tail = *w->sq_tail;
+	for (i = 0; i < nr; i++) {
+		unsigned int index = (tail + i) & *w->sq_mask;
+		struct io_uring_sqe *sqe = &sqes[index];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_WRITE;
+		sqe->fd = packets[i].fd;
+		sqe->addr = (uint64_t) (uintptr_t) srcs[i];
+		sqe->len = packets[i].len;
+		sqe->off = packets[i].offset < 0 ? (uint64_t) -1 : (uint64_t) packets[i].offset;
+		sqe->user_data = i;
+		if (i + 1 < nr && packets[i + 1].fd == packets[i].fd)
+			sqe->flags |= IOSQE_IO_LINK;
+		w->sq_array[index] = index;
+	}
+	/* Publish the entries before the tail. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(*w->sq_tail, tail + nr);
+
+	while (completed < nr) {
+		int ret;
+
+		ret = syscall(__NR_io_uring_enter, w->ring_fd, to_submit, 1,
+				IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		to_submit -= min_t(unsigned int, ret, to_submit);
+		head = *w->cq_head;
+		while (head != CMM_LOAD_SHARED(*w->cq_tail)) {
+			struct io_uring_cqe *cqe;
+
+			/* Read the entry after the tail. */
+			cmm_smp_rmb();
+			cqe = &cqes[head & *w->cq_mask];
+			if (cqe->user_data < nr) {
+				packets[cqe->user_data].ret = cqe->res;
+				completed++;
+			}
+			head++;
+		}
+		/* Consume the entries before releasing them. */
+		cmm_smp_mb();
+		CMM_STORE_SHARED(*w->cq_head, head);
+	}
+	return 0;
+}
+
+#else
+
+static
+void writeout_ring_unmap(struct lttng_ust_ctl_writeout *w __attribute__((unused)))
+{
+}
+
+static
+int writeout_ring_setup(struct lttng_ust_ctl_writeout *w __attribute__((unused)),
+		unsigned int nr_entries __attribute__((unused)))
+{
+	return -ENOSYS;
+}
+
+static
+int writeout_ring_submit(struct lttng_ust_ctl_writeout *w __attribute__((unused)),
+		struct lttng_ust_ctl_writeout_packet *packets __attribute__((unused)),
+		const char **srcs __attribute__((unused)),
+		unsigned int nr __attribute__((unused)))
+{
+	return -ENOSYS;
+}
+
+#endif
+
+struct lttng_ust_ctl_writeout *lttng_ust_ctl_writeout_create(unsigned int nr_entries)
+{
+	struct lttng_ust_ctl_writeout *w;
+
+	if (!nr_entries || nr_entries > LTTNG_UST_CTL_WRITEOUT_MAX_ENTRIES)
+		return NULL;
+	w = zmalloc(sizeof(*w));
+	if (!w)
+		return NULL;
+	w->ring_fd = -1;
+	w->nr_entries = nr_entries;
+	if (writeout_ring_setup(w, nr_entries))
+		DBG("io_uring unavailable, packet writeout falls back to write()");
+	return w;
+}
+
+void lttng_ust_ctl_writeout_destroy(struct lttng_ust_ctl_writeout *w)
+{
+	if (!w)
+		return;
+	writeout_ring_unmap(w);
+	free(w);
+}
+
+int lttng_ust_ctl_writeout_packets(struct lttng_ust_ctl_writeout *w,
+		struct lttng_ust_ctl_writeout_packet *packets,
+		unsigned int nr_packets)
+{
+	const char *srcs[LTTNG_UST_CTL_WRITEOUT_MAX_ENTRIES];
+	unsigned int i, batch, nr_written = 0;
+	int ret;
+
+	if (!w || (!packets && nr_packets))
+		return -EINVAL;
+	for (batch = 0; batch < nr_packets; batch += w->nr_entries) {
+		unsigned int nr = min_t(unsigned int, nr_packets - batch, w->nr_entries);
+		struct lttng_ust_ctl_writeout_packet *pkts = &packets[batch];
+
+		for (i = 0; i < nr; i++) {
+			struct lttng_ust_ctl_consumer_stream *stream = pkts[i].stream;
+
+			pkts[i].ret = -EINVAL;
+			if (!stream || pkts[i].len >
+					stream->chan->chan->priv->rb_chan->backend.subbuf_size)
+				return -EINVAL;
+			srcs[i] = lttng_ust_ctl_read_subbuf_address(stream);
+			if (!srcs[i])
+				return -EIO;
+		}
+		if (w->ring_fd >= 0) {
+			ret = writeout_ring_submit(w, pkts, srcs, nr);
+			if (ret)
+				return ret;
+		} else {
+			for (i = 0; i < nr; i++) {
+				ssize_t len;
+
+				/* Same as a cancelled io_uring link. */
+				if (i && pkts[i - 1].fd == pkts[i].fd
+						&& pkts[i - 1].ret != (ssize_t) pkts[i - 1].len) {
+					pkts[i].ret = -ECANCELED;
+					continue;
+				}
+				if (pkts[i].offset < 0)
+					len = write(pkts[i].fd, srcs[i], pkts[i].len);
+				else
+					len = pwrite(pkts[i].fd, srcs[i], pkts[i].len,
+						pkts[i].offset);
+				pkts[i].ret = len < 0 ? -errno : len;
+			}
+		}
+		for (i = 0; i < nr; i++) {
+			if (pkts[i].ret != (ssize_t) pkts[i].len)
+				continue;
+			ret = lttng_ust_ctl_put_next_subbuf(pkts[i].stream);
+			if (ret)
+				pkts[i].ret = ret;
+			else
+				nr_written++;
+		}
+	}
+	return nr_written;
+}
+
+/* Get exclusive read access to the next sub-buffer that can be read. */
+int lttng_ust_ctl_get_next_subbuf(struct lttng_ust_ctl_consumer_stream *stream)
+{
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_ctl_consumer_channel *consumer_chan;
+	struct lttng_ust_sigbus_range range;
+	int ret;
 
 	if (!stream)
 		return -EINVAL;
 	buf = stream->buf;
 	consumer_chan = stream->chan;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
+	ret = lib_ring_buffer_get_next_subbuf(buf,
+			consumer_chan->chan->priv->rb_chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return ret;
+}
+
+/* Release exclusive sub-buffer access, move consumer forward. */
+int lttng_ust_ctl_put_next_subbuf(struct lttng_ust_ctl_consumer_stream *stream)
+{
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_ctl_consumer_channel *consumer_chan;
+	struct lttng_ust_sigbus_range range;
+
+	if (!stream)
+		return -EINVAL;
+	buf = stream->buf;
+	consumer_chan = stream->chan;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	lib_ring_buffer_put_next_subbuf(buf, consumer_chan->chan->priv->rb_chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return 0;
+}
+
+/* snapshot */
+
+/* Get a snapshot of the current ring buffer producer and consumer positions */
+int lttng_ust_ctl_snapshot(struct lttng_ust_ctl_consumer_stream *stream)
+{
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_ctl_consumer_channel *consumer_chan;
+	struct lttng_ust_sigbus_range range;
+	int ret;
+
+	if (!stream)
+		return -EINVAL;
+	buf = stream->buf;
+	consumer_chan = stream->chan;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
 	ret = lib_ring_buffer_snapshot(buf, &buf->cons_snapshot,
 			&buf->prod_snapshot, consumer_chan->chan->priv->rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -1967,18 +3389,56 @@ int lttng_ust_ctl_snapshot_sample_positions(struct lttng_ust_ctl_consumer_stream
 		return -EINVAL;
 	buf = stream->buf;
 	consumer_chan = stream->chan;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	ret = lib_ring_buffer_snapshot_sample_positions(buf,
 			&buf->cons_snapshot, &buf->prod_snapshot,
 			consumer_chan->chan->priv->rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
+int lttng_ust_ctl_snapshot_channel(struct lttng_ust_ctl_consumer_channel *consumer_chan,
+		struct lttng_ust_ctl_snapshot_range *ranges,
+		unsigned int nr_ranges)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan;
+	struct lttng_ust_shm_handle *handle;
+	unsigned int i;
+
+	if (!consumer_chan || !ranges)
+		return -EINVAL;
+	rb_chan = consumer_chan->chan->priv->rb_chan;
+	handle = rb_chan->handle;
+	if (nr_ranges < rb_chan->nr_streams)
+		return -EINVAL;
+	memset(ranges, 0, rb_chan->nr_streams * sizeof(*ranges));
+	if (sigbus_begin())
+		return -EIO;
+	for (i = 0; i < rb_chan->nr_streams; i++) {
+		struct lttng_ust_ring_buffer *buf;
+		struct lttng_ust_sigbus_range range;
+		int shm_fd, wait_fd, wakeup_fd;
+		uint64_t memory_map_size;
+		void *memory_map_addr;
+
+		buf = channel_get_ring_buffer(&rb_chan->backend.config,
+			rb_chan, i, handle, &shm_fd, &wait_fd, &wakeup_fd,
+			&memory_map_size, &memory_map_addr);
+		if (!buf)
+			continue;
+		lttng_ust_sigbus_add_range(&range, memory_map_addr,
+					memory_map_size);
+		(void) lib_ring_buffer_snapshot_sample_positions(buf,
+				&ranges[i].consumed, &ranges[i].produced, handle);
+		lttng_ust_sigbus_del_range(&range);
+	}
+	sigbus_end();
+	return rb_chan->nr_streams;
+}
+
 /* Get the consumer position (iteration start) */
 int lttng_ust_ctl_snapshot_get_consumed(struct lttng_ust_ctl_consumer_stream *stream,
 		unsigned long *pos)
@@ -2018,14 +3478,13 @@ int lttng_ust_ctl_get_subbuf(struct lttng_ust_ctl_consumer_stream *stream,
 		return -EINVAL;
 	buf = stream->buf;
 	consumer_chan = stream->chan;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	ret = lib_ring_buffer_get_subbuf(buf, *pos,
 			consumer_chan->chan->priv->rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -2040,18 +3499,104 @@ int lttng_ust_ctl_put_subbuf(struct lttng_ust_ctl_consumer_stream *stream)
 		return -EINVAL;
 	buf = stream->buf;
 	consumer_chan = stream->chan;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	lib_ring_buffer_put_subbuf(buf, consumer_chan->chan->priv->rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return 0;
+}
+
+int lttng_ust_ctl_flush_buffer(struct lttng_ust_ctl_consumer_stream *stream,
+		int producer_active)
+{
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_ctl_consumer_channel *consumer_chan;
+	struct lttng_ust_sigbus_range range;
+
+	assert(stream);
+	buf = stream->buf;
+	consumer_chan = stream->chan;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	lib_ring_buffer_switch_slow(buf,
+		producer_active ? SWITCH_ACTIVE : SWITCH_FLUSH,
+		consumer_chan->chan->priv->rb_chan->handle);
+	stream->stale_flush_offset = v_read(&consumer_chan->chan->priv->rb_chan->backend.config,
+		&buf->offset);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return 0;
 }
 
-int lttng_ust_ctl_flush_buffer(struct lttng_ust_ctl_consumer_stream *stream,
-		int producer_active)
+/*
+ * Flush the stream if data was written since its last flush and the
+ * writers did not move to another sub-buffer since the previous check:
+ * a stream whose writers are filling sub-buffers delivers its packets
+ * by itself. Only reads the write offset otherwise.
+ */
+static
+int flush_buffer_if_stale(struct lttng_ust_ctl_consumer_stream *stream)
+{
+	struct lttng_ust_ring_buffer_channel *chan = stream->chan->chan->priv->rb_chan;
+	const struct lttng_ust_ring_buffer_config *config = &chan->backend.config;
+	struct lttng_ust_ring_buffer *buf = stream->buf;
+	unsigned long offset, prev_offset;
+
+	offset = v_read(config, &buf->offset);
+	prev_offset = stream->stale_check_offset;
+	stream->stale_check_offset = offset;
+	/* Nothing written since the last flush, or only a packet header. */
+	if (offset == stream->stale_flush_offset
+			|| subbuf_offset(offset, chan) <= config->cb.subbuffer_header_size())
+		return 0;
+	if (subbuf_trunc(offset, chan) != subbuf_trunc(prev_offset, chan))
+		return 0;
+	lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE, chan->handle);
+	offset = v_read(config, &buf->offset);
+	stream->stale_check_offset = offset;
+	stream->stale_flush_offset = offset;
+	return 1;
+}
+
+int lttng_ust_ctl_flush_buffer_if_stale(struct lttng_ust_ctl_consumer_stream *stream)
+{
+	struct lttng_ust_sigbus_range range;
+	int ret;
+
+	if (!stream)
+		return -EINVAL;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	ret = flush_buffer_if_stale(stream);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return ret;
+}
+
+int lttng_ust_ctl_flush_buffers_if_stale(struct lttng_ust_ctl_consumer_stream **streams,
+		unsigned int nr_streams)
+{
+	unsigned int i;
+	int ret, nr_flushed = 0;
+
+	if (!streams && nr_streams)
+		return -EINVAL;
+	for (i = 0; i < nr_streams; i++) {
+		if (!streams[i])
+			continue;
+		ret = lttng_ust_ctl_flush_buffer_if_stale(streams[i]);
+		if (ret < 0)
+			return ret;
+		nr_flushed += ret;
+	}
+	return nr_flushed;
+}
+
+int lttng_ust_ctl_clear_buffer(struct lttng_ust_ctl_consumer_stream *stream)
 {
 	struct lttng_ust_ring_buffer *buf;
 	struct lttng_ust_ctl_consumer_channel *consumer_chan;
@@ -2060,36 +3605,85 @@ int lttng_ust_ctl_flush_buffer(struct lttng_ust_ctl_consumer_stream *stream,
 	assert(stream);
 	buf = stream->buf;
 	consumer_chan = stream->chan;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
-	lib_ring_buffer_switch_slow(buf,
-		producer_active ? SWITCH_ACTIVE : SWITCH_FLUSH,
+	stream_sigbus_add_range(stream, &range);
+	lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE,
 		consumer_chan->chan->priv->rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	lib_ring_buffer_clear_reader(buf, consumer_chan->chan->priv->rb_chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return 0;
 }
 
-int lttng_ust_ctl_clear_buffer(struct lttng_ust_ctl_consumer_stream *stream)
+int lttng_ust_ctl_clear_buffers(struct lttng_ust_ctl_consumer_stream **streams,
+		unsigned int nr_streams)
+{
+	unsigned int i;
+
+	if (!streams && nr_streams)
+		return -EINVAL;
+	for (i = 0; i < nr_streams; i++) {
+		struct lttng_ust_ctl_consumer_stream *stream = streams[i];
+		struct lttng_ust_ring_buffer_channel *chan;
+		struct lttng_ust_ring_buffer *buf;
+		struct lttng_ust_sigbus_range range;
+		unsigned long offset;
+
+		if (!stream)
+			continue;
+		buf = stream->buf;
+		chan = stream->chan->chan->priv->rb_chan;
+		if (sigbus_begin())
+			return -EIO;
+		lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
+					stream->memory_map_size);
+		/*
+		 * Only close the current packet if it holds records: an
+		 * empty packet stays open, and the reader position moves
+		 * up to it.
+		 */
+		offset = v_read(&chan->backend.config, &buf->offset);
+		if (subbuf_offset(offset, chan)
+				> chan->backend.config.cb.subbuffer_header_size())
+			lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE, chan->handle);
+		lib_ring_buffer_clear_reader(buf, chan->handle);
+		lttng_ust_sigbus_del_range(&range);
+		sigbus_end();
+	}
+	return 0;
+}
+
+int lttng_ust_ctl_get_frozen(struct lttng_ust_ctl_consumer_stream *stream,
+		int *frozen)
 {
-	struct lttng_ust_ring_buffer *buf;
-	struct lttng_ust_ctl_consumer_channel *consumer_chan;
 	struct lttng_ust_sigbus_range range;
 
-	assert(stream);
-	buf = stream->buf;
-	consumer_chan = stream->chan;
-	if (sigbus_begin())
+	if (!stream || !frozen)
+		return -EINVAL;
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
-	lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE,
-		consumer_chan->chan->priv->rb_chan->handle);
-	lib_ring_buffer_clear_reader(buf, consumer_chan->chan->priv->rb_chan->handle);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_add_range(stream, &range);
+	*frozen = lib_ring_buffer_is_frozen(stream->buf,
+		stream->chan->chan->priv->rb_chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return 0;
+}
+
+int lttng_ust_ctl_thaw_buffer(struct lttng_ust_ctl_consumer_stream *stream)
+{
+	struct lttng_ust_sigbus_range range;
+
+	if (!stream)
+		return -EINVAL;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	lib_ring_buffer_thaw(stream->buf,
+		stream->chan->chan->priv->rb_chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return 0;
 }
 
@@ -2126,13 +3720,12 @@ int lttng_ust_ctl_get_timestamp_begin(struct lttng_ust_ctl_consumer_stream *stre
 	client_cb = get_client_cb(buf, chan);
 	if (!client_cb)
 		return -ENOSYS;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	ret = client_cb->timestamp_begin(buf, chan, timestamp_begin);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -2152,13 +3745,12 @@ int lttng_ust_ctl_get_timestamp_end(struct lttng_ust_ctl_consumer_stream *stream
 	client_cb = get_client_cb(buf, chan);
 	if (!client_cb)
 		return -ENOSYS;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	ret = client_cb->timestamp_end(buf, chan, timestamp_end);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -2178,13 +3770,12 @@ int lttng_ust_ctl_get_events_discarded(struct lttng_ust_ctl_consumer_stream *str
 	client_cb = get_client_cb(buf, chan);
 	if (!client_cb)
 		return -ENOSYS;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	ret = client_cb->events_discarded(buf, chan, events_discarded);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -2204,13 +3795,12 @@ int lttng_ust_ctl_get_content_size(struct lttng_ust_ctl_consumer_stream *stream,
 	client_cb = get_client_cb(buf, chan);
 	if (!client_cb)
 		return -ENOSYS;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	ret = client_cb->content_size(buf, chan, content_size);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -2230,13 +3820,12 @@ int lttng_ust_ctl_get_packet_size(struct lttng_ust_ctl_consumer_stream *stream,
 	client_cb = get_client_cb(buf, chan);
 	if (!client_cb)
 		return -ENOSYS;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	ret = client_cb->packet_size(buf, chan, packet_size);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -2256,13 +3845,12 @@ int lttng_ust_ctl_get_stream_id(struct lttng_ust_ctl_consumer_stream *stream,
 	client_cb = get_client_cb(buf, chan);
 	if (!client_cb)
 		return -ENOSYS;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
+	stream_sigbus_add_range(stream, &range);
 	ret = client_cb->stream_id(buf, chan, stream_id);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
 	return ret;
 }
 
@@ -2273,75 +3861,580 @@ int lttng_ust_ctl_get_current_timestamp(struct lttng_ust_ctl_consumer_stream *st
 	struct lttng_ust_ring_buffer_channel *chan;
 	struct lttng_ust_ring_buffer *buf;
 	struct lttng_ust_sigbus_range range;
-	int ret;
+	int ret;
+
+	if (!stream || !ts)
+		return -EINVAL;
+	buf = stream->buf;
+	chan = stream->chan->chan->priv->rb_chan;
+	client_cb = get_client_cb(buf, chan);
+	if (!client_cb || !client_cb->current_timestamp)
+		return -ENOSYS;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	ret = client_cb->current_timestamp(buf, chan, ts);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return ret;
+}
+
+int lttng_ust_ctl_get_sequence_number(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t *seq)
+{
+	struct lttng_ust_client_lib_ring_buffer_client_cb *client_cb;
+	struct lttng_ust_ring_buffer_channel *chan;
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_sigbus_range range;
+	int ret;
+
+	if (!stream || !seq)
+		return -EINVAL;
+	buf = stream->buf;
+	chan = stream->chan->chan->priv->rb_chan;
+	client_cb = get_client_cb(buf, chan);
+	if (!client_cb || !client_cb->sequence_number)
+		return -ENOSYS;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	ret = client_cb->sequence_number(buf, chan, seq);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return ret;
+}
+
+int lttng_ust_ctl_get_packet_info(struct lttng_ust_ctl_consumer_stream *stream,
+		struct lttng_ust_ctl_packet_info *info)
+{
+	struct lttng_ust_client_lib_ring_buffer_client_cb *client_cb;
+	struct lttng_ust_client_packet_info client_info;
+	struct lttng_ust_ring_buffer_channel *chan;
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_sigbus_range range;
+	int ret;
+
+	if (!stream || !info)
+		return -EINVAL;
+	buf = stream->buf;
+	chan = stream->chan->chan->priv->rb_chan;
+	client_cb = get_client_cb(buf, chan);
+	if (!client_cb || !client_cb->packet_info)
+		return -ENOSYS;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	ret = client_cb->packet_info(buf, chan, &client_info);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	if (ret)
+		return ret;
+	info->timestamp_begin = client_info.timestamp_begin;
+	info->timestamp_end = client_info.timestamp_end;
+	info->events_discarded = client_info.events_discarded;
+	info->content_size = client_info.content_size;
+	info->packet_size = client_info.packet_size;
+	info->stream_id = client_info.stream_id;
+	info->sequence_number = client_info.sequence_number;
+	info->instance_id = client_info.instance_id;
+	return 0;
+}
+
+/*
+ * Record filtering. Event headers are decoded and written as the
+ * lttng_write_event_header() functions of the ring buffer clients lay
+ * them out, which is only implemented for packed buffers: with natural
+ * alignment, moving a record within the packet would change the
+ * padding of its fields.
+ */
+#define FILTER_COMPACT_EVENT_BITS	5
+#define FILTER_COMPACT_TSC_BITS		27
+#define FILTER_COMPACT_EXTENDED_ID	31
+#define FILTER_LARGE_TSC_BITS		32
+#define FILTER_LARGE_EXTENDED_ID	65535
+#define FILTER_SINGLE_TSC_BITS		31
+
+#ifndef LTTNG_UST_RING_BUFFER_NATURAL_ALIGN
+
+static
+int filter_decode_header(const char *p, size_t avail,
+		enum lttng_ust_ctl_channel_header header_type,
+		uint32_t *id, uint64_t *timestamp, unsigned int *timestamp_bits,
+		size_t *header_len)
+{
+	switch (header_type) {
+	case LTTNG_UST_CTL_CHANNEL_HEADER_COMPACT:
+	{
+		uint32_t id_time, ts;
+		uint8_t id_byte;
+
+		if (avail < sizeof(id_time))
+			return -EINVAL;
+		memcpy(&id_byte, p, sizeof(id_byte));
+		bt_bitfield_read(&id_byte, uint8_t, 0, FILTER_COMPACT_EVENT_BITS, id);
+		if (*id != FILTER_COMPACT_EXTENDED_ID) {
+			memcpy(&id_time, p, sizeof(id_time));
+			bt_bitfield_read(&id_time, uint32_t, FILTER_COMPACT_EVENT_BITS,
+					FILTER_COMPACT_TSC_BITS, &ts);
+			*timestamp = ts;
+			*timestamp_bits = FILTER_COMPACT_TSC_BITS;
+			*header_len = sizeof(id_time);
+			return 0;
+		}
+		*header_len = sizeof(id_byte) + sizeof(uint32_t) + sizeof(uint64_t);
+		if (avail < *header_len)
+			return -EINVAL;
+		memcpy(id, p + sizeof(id_byte), sizeof(uint32_t));
+		memcpy(timestamp, p + sizeof(id_byte) + sizeof(uint32_t), sizeof(uint64_t));
+		*timestamp_bits = 64;
+		return 0;
+	}
+	case LTTNG_UST_CTL_CHANNEL_HEADER_LARGE:
+	{
+		uint16_t id16;
+		uint32_t ts;
+
+		if (avail < sizeof(id16) + sizeof(ts))
+			return -EINVAL;
+		memcpy(&id16, p, sizeof(id16));
+		if (id16 != FILTER_LARGE_EXTENDED_ID) {
+			memcpy(&ts, p + sizeof(id16), sizeof(ts));
+			*id = id16;
+			*timestamp = ts;
+			*timestamp_bits = FILTER_LARGE_TSC_BITS;
+			*header_len = sizeof(id16) + sizeof(ts);
+			return 0;
+		}
+		*header_len = sizeof(id16) + sizeof(uint32_t) + sizeof(uint64_t);
+		if (avail < *header_len)
+			return -EINVAL;
+		memcpy(id, p + sizeof(id16), sizeof(uint32_t));
+		memcpy(timestamp, p + sizeof(id16) + sizeof(uint32_t), sizeof(uint64_t));
+		*timestamp_bits = 64;
+		return 0;
+	}
+	case LTTNG_UST_CTL_CHANNEL_HEADER_SINGLE:
+	{
+		uint32_t sel_time, ts;
+		uint8_t sel;
+
+		if (avail < sizeof(sel_time))
+			return -EINVAL;
+		*id = 0;
+		memcpy(&sel, p, sizeof(sel));
+		if (!(sel & 1)) {
+			memcpy(&sel_time, p, sizeof(sel_time));
+			bt_bitfield_read(&sel_time, uint32_t, 1,
+					FILTER_SINGLE_TSC_BITS, &ts);
+			*timestamp = ts;
+			*timestamp_bits = FILTER_SINGLE_TSC_BITS;
+			*header_len = sizeof(sel_time);
+			return 0;
+		}
+		*header_len = sizeof(sel) + sizeof(uint64_t);
+		if (avail < *header_len)
+			return -EINVAL;
+		memcpy(timestamp, p + sizeof(sel), sizeof(uint64_t));
+		*timestamp_bits = 64;
+		return 0;
+	}
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Returns the header length, or 0 if it does not fit in avail bytes. */
+static
+size_t filter_write_header(char *p, size_t avail,
+		enum lttng_ust_ctl_channel_header header_type,
+		uint32_t id, uint64_t timestamp, bool extended)
+{
+	if (header_type == LTTNG_UST_CTL_CHANNEL_HEADER_COMPACT) {
+		uint32_t id_time = 0;
+		uint8_t id_byte = 0;
+
+		if (!extended) {
+			if (avail < sizeof(id_time))
+				return 0;
+			bt_bitfield_write(&id_time, uint32_t, 0,
+					FILTER_COMPACT_EVENT_BITS, id);
+			bt_bitfield_write(&id_time, uint32_t, FILTER_COMPACT_EVENT_BITS,
+					FILTER_COMPACT_TSC_BITS, timestamp);
+			memcpy(p, &id_time, sizeof(id_time));
+			return sizeof(id_time);
+		}
+		if (avail < sizeof(id_byte) + sizeof(id) + sizeof(timestamp))
+			return 0;
+		bt_bitfield_write(&id_byte, uint8_t, 0, FILTER_COMPACT_EVENT_BITS,
+				FILTER_COMPACT_EXTENDED_ID);
+		memcpy(p, &id_byte, sizeof(id_byte));
+		memcpy(p + sizeof(id_byte), &id, sizeof(id));
+		memcpy(p + sizeof(id_byte) + sizeof(id), &timestamp, sizeof(timestamp));
+		return sizeof(id_byte) + sizeof(id) + sizeof(timestamp);
+	} else if (header_type == LTTNG_UST_CTL_CHANNEL_HEADER_SINGLE) {
+		uint32_t sel_time = 0;
+		uint8_t sel = 1;
+
+		if (!extended) {
+			if (avail < sizeof(sel_time))
+				return 0;
+			bt_bitfield_write(&sel_time, uint32_t, 1,
+					FILTER_SINGLE_TSC_BITS, timestamp);
+			memcpy(p, &sel_time, sizeof(sel_time));
+			return sizeof(sel_time);
+		}
+		if (avail < sizeof(sel) + sizeof(timestamp))
+			return 0;
+		memcpy(p, &sel, sizeof(sel));
+		memcpy(p + sizeof(sel), &timestamp, sizeof(timestamp));
+		return sizeof(sel) + sizeof(timestamp);
+	} else {
+		uint16_t id16 = extended ? FILTER_LARGE_EXTENDED_ID : id;
+		uint32_t ts = timestamp;
+
+		if (!extended) {
+			if (avail < sizeof(id16) + sizeof(ts))
+				return 0;
+			memcpy(p, &id16, sizeof(id16));
+			memcpy(p + sizeof(id16), &ts, sizeof(ts));
+			return sizeof(id16) + sizeof(ts);
+		}
+		if (avail < sizeof(id16) + sizeof(id) + sizeof(timestamp))
+			return 0;
+		memcpy(p, &id16, sizeof(id16));
+		memcpy(p + sizeof(id16), &id, sizeof(id));
+		memcpy(p + sizeof(id16) + sizeof(id), &timestamp, sizeof(timestamp));
+		return sizeof(id16) + sizeof(id) + sizeof(timestamp);
+	}
+}
+
+/*
+ * Full timestamp of a record from its low @bits bits, as a trace reader
+ * reconstructs it from the timestamp of the previous record.
+ */
+static
+uint64_t filter_full_timestamp(uint64_t prev, uint64_t timestamp, unsigned int bits)
+{
+	uint64_t mask;
+
+	if (bits == 64)
+		return timestamp;
+	mask = (1ULL << bits) - 1;
+	if (timestamp < (prev & mask))
+		prev += 1ULL << bits;
+	return (prev & ~mask) | timestamp;
+}
+
+static
+void filter_set_size_field(char *packet, size_t offset, size_t length,
+		uint64_t size)
+{
+	if (length == sizeof(uint32_t)) {
+		uint32_t size32 = size;
+
+		memcpy(packet + offset, &size32, sizeof(size32));
+	} else {
+		memcpy(packet + offset, &size, sizeof(size));
+	}
+}
+
+/* Walk the records of the packet at src, content_len bytes long. */
+static
+int filter_records(struct lttng_ust_ring_buffer_channel *rb_chan,
+		enum lttng_ust_ctl_channel_header header_type,
+		int (*filter)(struct lttng_ust_ctl_record *record, void *priv),
+		void *priv, const char *src, size_t content_len,
+		uint64_t timestamp_begin, char *dst, unsigned long *len)
+{
+	const struct lttng_ust_ring_buffer_config *config = &rb_chan->backend.config;
+	size_t offset, dst_offset, field_offset, field_len;
+	uint64_t prev = timestamp_begin, prev_kept = timestamp_begin;
+	int nr_kept = 0, ret;
+
+	offset = config->cb.subbuffer_header_size();
+	if (offset > content_len || offset > *len)
+		return -EINVAL;
+	memcpy(dst, src, offset);
+	dst_offset = offset;
+	while (offset < content_len) {
+		struct lttng_ust_ctl_record record;
+		unsigned int timestamp_bits;
+		size_t header_len, rest_len;
+		uint64_t timestamp;
+		bool extended;
+
+		ret = filter_decode_header(src + offset, content_len - offset,
+				header_type, &record.event_id, &timestamp,
+				&timestamp_bits, &header_len);
+		if (ret)
+			return ret;
+		record.timestamp = filter_full_timestamp(prev, timestamp,
+				timestamp_bits);
+		prev = record.timestamp;
+		record.data = src + offset;
+		record.header_len = header_len;
+		record.len = 0;
+		ret = filter(&record, priv);
+		if (ret < 0)
+			return ret;
+		if (record.len < header_len || record.len > content_len - offset)
+			return -EINVAL;
+		if (ret) {
+			/* Readers must be able to rebuild the timestamp. */
+			extended = timestamp_bits == 64
+				|| (record.timestamp - prev_kept) >> timestamp_bits;
+			header_len = filter_write_header(dst + dst_offset,
+					*len - dst_offset, header_type,
+					record.event_id, record.timestamp,
+					extended);
+			rest_len = record.len - record.header_len;
+			if (!header_len || rest_len > *len - dst_offset - header_len)
+				return -ENOSPC;
+			memcpy(dst + dst_offset + header_len,
+				record.data + record.header_len, rest_len);
+			dst_offset += header_len + rest_len;
+			prev_kept = record.timestamp;
+			nr_kept++;
+		}
+		offset += record.len;
+	}
+	config->cb.content_size_field(config, &field_offset, &field_len);
+	filter_set_size_field(dst, field_offset, field_len,
+			(uint64_t) dst_offset * CHAR_BIT);
+	config->cb.packet_size_field(config, &field_offset, &field_len);
+	filter_set_size_field(dst, field_offset, field_len,
+			(uint64_t) dst_offset * CHAR_BIT);
+	*len = dst_offset;
+	return nr_kept;
+}
+
+int lttng_ust_ctl_filter_subbuf(struct lttng_ust_ctl_consumer_stream *stream,
+		int header_type,
+		int (*filter)(struct lttng_ust_ctl_record *record, void *priv),
+		void *priv, void *dst, unsigned long *len)
+{
+	struct lttng_ust_ctl_packet_info info;
+	struct lttng_ust_sigbus_range range;
+	const char *src;
+	int ret;
+
+	if (!stream || !filter || !dst || !len)
+		return -EINVAL;
+	if (header_type != LTTNG_UST_CTL_CHANNEL_HEADER_COMPACT
+			&& header_type != LTTNG_UST_CTL_CHANNEL_HEADER_LARGE
+			&& header_type != LTTNG_UST_CTL_CHANNEL_HEADER_SINGLE)
+		return -EINVAL;
+	if (stream->chan->chan->priv->rb_chan->backend.config.output != RING_BUFFER_MMAP)
+		return -EINVAL;
+	ret = lttng_ust_ctl_get_packet_info(stream, &info);
+	if (ret)
+		return ret;
+	if (info.content_size / CHAR_BIT > stream->chan->chan->priv->rb_chan->backend.subbuf_size)
+		return -EINVAL;
+	src = lttng_ust_ctl_read_subbuf_address(stream);
+	if (!src)
+		return -EIO;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	ret = filter_records(stream->chan->chan->priv->rb_chan, header_type,
+			filter, priv, src, info.content_size / CHAR_BIT,
+			info.timestamp_begin, dst, len);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return ret;
+}
+
+#else
+
+int lttng_ust_ctl_filter_subbuf(
+		struct lttng_ust_ctl_consumer_stream *stream __attribute__((unused)),
+		int header_type __attribute__((unused)),
+		int (*filter)(struct lttng_ust_ctl_record *record, void *priv) __attribute__((unused)),
+		void *priv __attribute__((unused)),
+		void *dst __attribute__((unused)),
+		unsigned long *len __attribute__((unused)))
+{
+	return -ENOSYS;
+}
+
+#endif
+
+#if (LTTNG_UST_BYTE_ORDER == LTTNG_UST_BIG_ENDIAN)
+#define index_be32(x)	(x)
+#define index_be64(x)	(x)
+#else
+#define index_be32(x)	lttng_ust_bswap_32(x)
+#define index_be64(x)	lttng_ust_bswap_64(x)
+#endif
+
+int lttng_ust_ctl_index_write_header(int fd)
+{
+	struct lttng_ust_ctl_index_file_hdr hdr;
+	ssize_t len;
+
+	hdr.magic = index_be32(LTTNG_UST_CTL_INDEX_MAGIC);
+	hdr.index_major = index_be32(LTTNG_UST_CTL_INDEX_MAJOR);
+	hdr.index_minor = index_be32(LTTNG_UST_CTL_INDEX_MINOR);
+	hdr.packet_index_len = index_be32(sizeof(struct lttng_ust_ctl_packet_index));
+	len = ust_patient_write(fd, &hdr, sizeof(hdr));
+	if (len < 0)
+		return -errno;
+	if (len != sizeof(hdr))
+		return -EIO;
+	return 0;
+}
+
+int lttng_ust_ctl_get_packet_index(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t offset, struct lttng_ust_ctl_packet_index *index)
+{
+	struct lttng_ust_ctl_packet_info info;
+	int ret;
+
+	if (!index)
+		return -EINVAL;
+	ret = lttng_ust_ctl_get_packet_info(stream, &info);
+	if (ret)
+		return ret;
+	index->offset = index_be64(offset);
+	index->packet_size = index_be64(info.packet_size);
+	index->content_size = index_be64(info.content_size);
+	index->timestamp_begin = index_be64(info.timestamp_begin);
+	index->timestamp_end = index_be64(info.timestamp_end);
+	index->events_discarded = index_be64(info.events_discarded);
+	index->stream_id = index_be64(info.stream_id);
+	index->stream_instance_id = index_be64(info.instance_id);
+	index->packet_seq_num = index_be64(info.sequence_number);
+	return 0;
+}
+
+int lttng_ust_ctl_index_write_packet(int fd,
+		struct lttng_ust_ctl_consumer_stream *stream, uint64_t offset)
+{
+	struct lttng_ust_ctl_packet_index index;
+	ssize_t len;
+	int ret;
+
+	ret = lttng_ust_ctl_get_packet_index(stream, offset, &index);
+	if (ret)
+		return ret;
+	len = ust_patient_write(fd, &index, sizeof(index));
+	if (len < 0)
+		return -errno;
+	if (len != sizeof(index))
+		return -EIO;
+	return 0;
+}
+
+int lttng_ust_ctl_get_instance_id(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t *id)
+{
+	struct lttng_ust_client_lib_ring_buffer_client_cb *client_cb;
+	struct lttng_ust_ring_buffer_channel *chan;
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_sigbus_range range;
+	int ret;
+
+	if (!stream || !id)
+		return -EINVAL;
+	buf = stream->buf;
+	chan = stream->chan->chan->priv->rb_chan;
+	client_cb = get_client_cb(buf, chan);
+	if (!client_cb)
+		return -ENOSYS;
+	if (stream_sigbus_begin(stream))
+		return -EIO;
+	stream_sigbus_add_range(stream, &range);
+	ret = client_cb->instance_id(buf, chan, id);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return ret;
+}
+
+int lttng_ust_ctl_get_backpressure_stats(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t *full_count, uint64_t *blocked_retries,
+		uint64_t *blocked_ms, uint64_t *max_fill)
+{
+	const struct lttng_ust_ring_buffer_config *config;
+	struct lttng_ust_ring_buffer_channel *chan;
+	struct lttng_ust_ring_buffer *buf;
+	struct lttng_ust_sigbus_range range;
 
-	if (!stream || !ts)
+	if (!stream)
 		return -EINVAL;
 	buf = stream->buf;
 	chan = stream->chan->chan->priv->rb_chan;
-	client_cb = get_client_cb(buf, chan);
-	if (!client_cb || !client_cb->current_timestamp)
-		return -ENOSYS;
-	if (sigbus_begin())
+	config = &chan->backend.config;
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
-	ret = client_cb->current_timestamp(buf, chan, ts);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
-	return ret;
+	stream_sigbus_add_range(stream, &range);
+	if (full_count)
+		*full_count = lib_ring_buffer_get_full_count(config, buf,
+			chan->handle);
+	if (blocked_retries)
+		*blocked_retries = lib_ring_buffer_get_blocked_retries(config, buf,
+			chan->handle);
+	if (blocked_ms)
+		*blocked_ms = lib_ring_buffer_get_blocked_ms(config, buf,
+			chan->handle);
+	if (max_fill)
+		*max_fill = lib_ring_buffer_get_max_fill(config, buf,
+			chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return 0;
 }
 
-int lttng_ust_ctl_get_sequence_number(struct lttng_ust_ctl_consumer_stream *stream,
-		uint64_t *seq)
+int lttng_ust_ctl_get_reserve_stats(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t *slow_path_count, uint64_t *reserve_retries,
+		uint64_t *switch_count)
 {
-	struct lttng_ust_client_lib_ring_buffer_client_cb *client_cb;
+	const struct lttng_ust_ring_buffer_config *config;
 	struct lttng_ust_ring_buffer_channel *chan;
 	struct lttng_ust_ring_buffer *buf;
 	struct lttng_ust_sigbus_range range;
-	int ret;
 
-	if (!stream || !seq)
+	if (!stream)
 		return -EINVAL;
 	buf = stream->buf;
 	chan = stream->chan->chan->priv->rb_chan;
-	client_cb = get_client_cb(buf, chan);
-	if (!client_cb || !client_cb->sequence_number)
-		return -ENOSYS;
-	if (sigbus_begin())
+	config = &chan->backend.config;
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
-	ret = client_cb->sequence_number(buf, chan, seq);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
-	return ret;
+	stream_sigbus_add_range(stream, &range);
+	if (slow_path_count)
+		*slow_path_count = lib_ring_buffer_get_slow_path_count(config,
+			buf, chan->handle);
+	if (reserve_retries)
+		*reserve_retries = lib_ring_buffer_get_reserve_retries(config,
+			buf, chan->handle);
+	if (switch_count)
+		*switch_count = lib_ring_buffer_get_switch_count(config, buf,
+			chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return 0;
 }
 
-int lttng_ust_ctl_get_instance_id(struct lttng_ust_ctl_consumer_stream *stream,
-		uint64_t *id)
+int lttng_ust_ctl_get_records_sampled(struct lttng_ust_ctl_consumer_stream *stream,
+		uint64_t *records_sampled)
 {
-	struct lttng_ust_client_lib_ring_buffer_client_cb *client_cb;
 	struct lttng_ust_ring_buffer_channel *chan;
 	struct lttng_ust_ring_buffer *buf;
 	struct lttng_ust_sigbus_range range;
-	int ret;
 
-	if (!stream || !id)
+	if (!stream || !records_sampled)
 		return -EINVAL;
 	buf = stream->buf;
 	chan = stream->chan->chan->priv->rb_chan;
-	client_cb = get_client_cb(buf, chan);
-	if (!client_cb)
-		return -ENOSYS;
-	if (sigbus_begin())
+	if (stream_sigbus_begin(stream))
 		return -EIO;
-	lttng_ust_sigbus_add_range(&range, stream->memory_map_addr,
-				stream->memory_map_size);
-	ret = client_cb->instance_id(buf, chan, id);
-	lttng_ust_sigbus_del_range(&range);
-	sigbus_end();
-	return ret;
+	stream_sigbus_add_range(stream, &range);
+	*records_sampled = lib_ring_buffer_get_subbuf_records_sampled(buf, chan,
+		chan->handle);
+	stream_sigbus_del_range(stream, &range);
+	stream_sigbus_end(stream);
+	return 0;
 }
 
 #ifdef HAVE_LINUX_PERF_EVENT_H
@@ -2871,6 +4964,9 @@ int lttng_ust_ctl_reply_register_channel(int sock,
 	case LTTNG_UST_CTL_CHANNEL_HEADER_LARGE:
 		reply.r.header_type = 2;
 		break;
+	case LTTNG_UST_CTL_CHANNEL_HEADER_SINGLE:
+		reply.r.header_type = 3;
+		break;
 	default:
 		reply.r.header_type = 0;
 		break;
@@ -2927,17 +5023,50 @@ struct lttng_ust_ctl_daemon_counter *
 
 	if (nr_dimensions > LTTNG_COUNTER_DIMENSION_MAX)
 		return NULL;
-	/* Currently, only per-cpu allocation is supported. */
+	/*
+	 * Currently, only per-cpu allocation is supported, with global
+	 * counters for the narrow counters carrying into them.
+	 */
 	switch (alloc_flags) {
 	case LTTNG_UST_CTL_COUNTER_ALLOC_PER_CPU:
+		if (bitness == LTTNG_UST_CTL_COUNTER_BITNESS_8
+				|| bitness == LTTNG_UST_CTL_COUNTER_BITNESS_16)
+			return NULL;
 		break;
-
 	case LTTNG_UST_CTL_COUNTER_ALLOC_PER_CPU | LTTNG_UST_CTL_COUNTER_ALLOC_GLOBAL:
+		if (bitness != LTTNG_UST_CTL_COUNTER_BITNESS_8
+				&& bitness != LTTNG_UST_CTL_COUNTER_BITNESS_16)
+			return NULL;
+		break;
 	case LTTNG_UST_CTL_COUNTER_ALLOC_GLOBAL:
 	default:
 		return NULL;
 	}
 	switch (bitness) {
+	case LTTNG_UST_CTL_COUNTER_BITNESS_8:
+		switch (arithmetic) {
+		case LTTNG_UST_CTL_COUNTER_ARITHMETIC_MODULAR:
+			transport_name = "counter-per-cpu-8-modular";
+			break;
+		case LTTNG_UST_CTL_COUNTER_ARITHMETIC_SATURATION:
+			transport_name = "counter-per-cpu-8-saturation";
+			break;
+		default:
+			return NULL;
+		}
+		break;
+	case LTTNG_UST_CTL_COUNTER_BITNESS_16:
+		switch (arithmetic) {
+		case LTTNG_UST_CTL_COUNTER_ARITHMETIC_MODULAR:
+			transport_name = "counter-per-cpu-16-modular";
+			break;
+		case LTTNG_UST_CTL_COUNTER_ARITHMETIC_SATURATION:
+			transport_name = "counter-per-cpu-16-saturation";
+			break;
+		default:
+			return NULL;
+		}
+		break;
 	case LTTNG_UST_CTL_COUNTER_BITNESS_32:
 		switch (arithmetic) {
 		case LTTNG_UST_CTL_COUNTER_ARITHMETIC_MODULAR:
@@ -3009,6 +5138,23 @@ free_counter:
 	return NULL;
 }
 
+int lttng_ust_ctl_counter_set_histogram(struct lttng_ust_ctl_daemon_counter *counter)
+{
+	if (counter->attr->nr_dimensions != 2
+			|| counter->attr->dimensions[1].size != LTTNG_UST_CTL_COUNTER_HISTOGRAM_NR_BUCKETS)
+		return -EINVAL;
+	counter->attr->histogram = true;
+	return 0;
+}
+
+int lttng_ust_ctl_counter_set_hits(struct lttng_ust_ctl_daemon_counter *counter)
+{
+	if (counter->attr->nr_dimensions != 1)
+		return -EINVAL;
+	counter->attr->hits = true;
+	return 0;
+}
+
 int lttng_ust_ctl_create_counter_data(struct lttng_ust_ctl_daemon_counter *counter,
 		struct lttng_ust_abi_object_data **_counter_data)
 {
@@ -3028,6 +5174,12 @@ int lttng_ust_ctl_create_counter_data(struct lttng_ust_ctl_daemon_counter *count
 		return -EINVAL;
 	}
 	switch (counter->attr->bitness) {
+	case LTTNG_UST_CTL_COUNTER_BITNESS_8:
+		counter_conf.bitness = LTTNG_UST_ABI_COUNTER_BITNESS_8;
+		break;
+	case LTTNG_UST_CTL_COUNTER_BITNESS_16:
+		counter_conf.bitness = LTTNG_UST_ABI_COUNTER_BITNESS_16;
+		break;
 	case LTTNG_UST_CTL_COUNTER_BITNESS_32:
 		counter_conf.bitness = LTTNG_UST_ABI_COUNTER_BITNESS_32;
 		break;
@@ -3040,6 +5192,8 @@ int lttng_ust_ctl_create_counter_data(struct lttng_ust_ctl_daemon_counter *count
 	counter_conf.number_dimensions = counter->attr->nr_dimensions;
 	counter_conf.global_sum_step = counter->attr->global_sum_step;
 	counter_conf.coalesce_hits = counter->attr->coalesce_hits;
+	counter_conf.histogram = counter->attr->histogram;
+	counter_conf.hits = counter->attr->hits;
 	for (i = 0; i < counter->attr->nr_dimensions; i++) {
 		counter_conf.dimensions[i].size = counter->attr->dimensions[i].size;
 		counter_conf.dimensions[i].underflow_index = counter->attr->dimensions[i].underflow_index;
@@ -3125,6 +5279,33 @@ error_alloc:
 	return ret;
 }
 
+int lttng_ust_ctl_counter_set_cpu_all_shm(struct lttng_ust_ctl_daemon_counter *counter,
+		int fd)
+{
+	return lttng_counter_set_cpu_all_shm(counter->counter, fd);
+}
+
+int lttng_ust_ctl_create_counter_cpu_all_data(struct lttng_ust_ctl_daemon_counter *counter,
+		struct lttng_ust_abi_object_data **_counter_cpu_data)
+{
+	struct lttng_ust_abi_object_data *counter_cpu_data;
+	int fd;
+	size_t len;
+
+	if (lttng_counter_get_cpu_all_shm(counter->counter, &fd, &len))
+		return -EINVAL;
+	counter_cpu_data = zmalloc(sizeof(*counter_cpu_data));
+	if (!counter_cpu_data)
+		return -ENOMEM;
+	counter_cpu_data->type = LTTNG_UST_ABI_OBJECT_TYPE_COUNTER_CPU;
+	counter_cpu_data->handle = -1;
+	counter_cpu_data->size = len;
+	counter_cpu_data->u.counter_cpu.shm_fd = fd;
+	counter_cpu_data->u.counter_cpu.cpu_nr = LTTNG_UST_ABI_COUNTER_CPU_ALL;
+	*_counter_cpu_data = counter_cpu_data;
+	return 0;
+}
+
 void lttng_ust_ctl_destroy_counter(struct lttng_ust_ctl_daemon_counter *counter)
 {
 	counter->ops->counter_destroy(counter->counter);
@@ -3288,12 +5469,387 @@ int lttng_ust_ctl_counter_aggregate(struct lttng_ust_ctl_daemon_counter *counter
 			value, overflow, underflow);
 }
 
+int lttng_ust_ctl_counter_aggregate_all(struct lttng_ust_ctl_daemon_counter *counter,
+		int64_t *values, size_t nr_values,
+		unsigned long *overflow, unsigned long *underflow)
+{
+	return counter->ops->counter_aggregate_all(counter->counter, values,
+			nr_values, overflow, underflow);
+}
+
 int lttng_ust_ctl_counter_clear(struct lttng_ust_ctl_daemon_counter *counter,
 		const size_t *dimension_indexes)
 {
 	return counter->ops->counter_clear(counter->counter, dimension_indexes);
 }
 
+int lttng_ust_ctl_counter_get_nr_dimensions(struct lttng_ust_ctl_daemon_counter *counter,
+		size_t *nr_dimensions)
+{
+	if (!counter || !nr_dimensions)
+		return -EINVAL;
+	*nr_dimensions = counter->counter->nr_dimensions;
+	return 0;
+}
+
+int lttng_ust_ctl_counter_get_dimension(struct lttng_ust_ctl_daemon_counter *counter,
+		size_t dimension, uint64_t *size, uint64_t *stride)
+{
+	const struct lib_counter_dimension *dim;
+
+	if (!counter || dimension >= counter->counter->nr_dimensions)
+		return -EINVAL;
+	dim = &counter->counter->dimensions[dimension];
+	if (size)
+		*size = dim->max_nr_elem;
+	if (stride)
+		*stride = dim->stride;
+	return 0;
+}
+
+int lttng_ust_ctl_counter_get_view(struct lttng_ust_ctl_daemon_counter *counter,
+		int cpu, struct lttng_ust_ctl_counter_view *view)
+{
+	size_t elem_size;
+	int ret;
+
+	if (!counter || !view)
+		return -EINVAL;
+	ret = lttng_counter_get_layout(counter->counter, cpu, &view->counters,
+		&view->overflow_bitmap, &view->underflow_bitmap, &elem_size);
+	if (ret)
+		return ret;
+	view->nr_elem = counter->counter->allocated_elem;
+	view->elem_size = elem_size;
+	return 0;
+}
+
+lttng_ust_static_assert((int) LTTNG_UST_CTL_NR_METRICS == (int) NR_LTTNG_UST_METRICS,
+	"Metrics of lttng-ust-ctl and of the tracer differ",
+	lttng_ust_ctl_metrics_match);
+
+struct lttng_ust_ctl_metrics {
+	struct lib_counter *counter;
+};
+
+struct lttng_ust_ctl_probe_overhead {
+	struct lib_counter *counter;
+	struct lttng_ust_metrics_event_names *names;
+	size_t names_len;
+};
+
+struct lttng_ust_ctl_event_discards {
+	struct lib_counter *counter;
+	struct lttng_ust_metrics_event_names *names;
+	size_t names_len;
+};
+
+static
+void metrics_shm_close(int fd)
+{
+	lttng_ust_lock_fd_tracker();
+	if (!close(fd))
+		lttng_ust_delete_fd_from_tracker(fd);
+	else
+		PERROR("close");
+	lttng_ust_unlock_fd_tracker();
+}
+
+/* Open a shm object of the application, adding its fd to the tracker. */
+static
+int metrics_shm_open(const char *name, int *_fd, size_t *len)
+{
+	struct stat statbuf;
+	int fd, ret;
+
+	lttng_ust_lock_fd_tracker();
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {
+		ret = -errno;
+		lttng_ust_unlock_fd_tracker();
+		return ret;
+	}
+	ret = lttng_ust_add_fd_to_tracker(fd);
+	if (ret < 0) {
+		if (close(fd))
+			PERROR("close");
+		lttng_ust_unlock_fd_tracker();
+		return ret;
+	}
+	fd = ret;
+	lttng_ust_unlock_fd_tracker();
+	if (fstat(fd, &statbuf)) {
+		ret = -errno;
+		metrics_shm_close(fd);
+		return ret;
+	}
+	*_fd = fd;
+	*len = statbuf.st_size;
+	return 0;
+}
+
+/* Map a counter allocated by the application in shm object name. */
+static
+int metrics_counter_map(const char *name, size_t nr_dimensions,
+		const size_t *max_nr_elem, struct lib_counter **_counter)
+{
+	struct lib_counter *counter;
+	size_t shm_len, len;
+	int fd, ret;
+
+	ret = metrics_shm_open(name, &fd, &shm_len);
+	if (ret)
+		return ret;
+	counter = lttng_counter_create(&lttng_ust_metrics_config, nr_dimensions,
+		max_nr_elem, 0, -1, -1, NULL, false);
+	if (!counter) {
+		metrics_shm_close(fd);
+		return -ENOMEM;
+	}
+	if (lttng_counter_set_cpu_all_shm(counter, fd)) {
+		lttng_counter_destroy(counter);
+		metrics_shm_close(fd);
+		return -ENOMEM;
+	}
+	/* The counter now owns the fd. */
+	if (lttng_counter_get_cpu_all_shm(counter, &fd, &len) || shm_len != len) {
+		/* Written by another version of lttng-ust. */
+		lttng_counter_destroy(counter);
+		return -EINVAL;
+	}
+	*_counter = counter;
+	return 0;
+}
+
+int lttng_ust_ctl_metrics_open(pid_t pid,
+		struct lttng_ust_ctl_metrics **_metrics)
+{
+	char name[LTTNG_UST_METRICS_SHM_NAME_LEN];
+	size_t max_nr_elem = NR_LTTNG_UST_METRICS;
+	struct lttng_ust_ctl_metrics *metrics;
+	int ret;
+
+	metrics = zmalloc(sizeof(*metrics));
+	if (!metrics)
+		return -ENOMEM;
+	lttng_ust_metrics_shm_name(pid, "metrics", name);
+	ret = metrics_counter_map(name, 1, &max_nr_elem, &metrics->counter);
+	if (ret) {
+		free(metrics);
+		return ret;
+	}
+	*_metrics = metrics;
+	return 0;
+}
+
+int lttng_ust_ctl_metrics_read(struct lttng_ust_ctl_metrics *metrics,
+		uint64_t *values, size_t nr_values)
+{
+	unsigned long overflow[LTTNG_UST_CTL_COUNTER_BITMAP_NR_WORDS(NR_LTTNG_UST_METRICS)];
+	unsigned long underflow[LTTNG_UST_CTL_COUNTER_BITMAP_NR_WORDS(NR_LTTNG_UST_METRICS)];
+	int64_t v[NR_LTTNG_UST_METRICS];
+	size_t i;
+	int ret;
+
+	ret = lttng_counter_aggregate_all(&lttng_ust_metrics_config,
+		metrics->counter, v, NR_LTTNG_UST_METRICS, overflow, underflow);
+	if (ret)
+		return ret;
+	if (nr_values > NR_LTTNG_UST_METRICS)
+		nr_values = NR_LTTNG_UST_METRICS;
+	for (i = 0; i < nr_values; i++)
+		values[i] = (uint64_t) v[i];
+	return nr_values;
+}
+
+const char *lttng_ust_ctl_metric_name(enum lttng_ust_ctl_metric metric)
+{
+	if ((unsigned int) metric >= NR_LTTNG_UST_METRICS)
+		return NULL;
+	return lttng_ust_metric_names[metric];
+}
+
+void lttng_ust_ctl_metrics_close(struct lttng_ust_ctl_metrics *metrics)
+{
+	lttng_counter_destroy(metrics->counter);
+	free(metrics);
+}
+
+/*
+ * Map the event names of the per-event counter @kind of process pid,
+ * along with the counter itself, of nr_values columns.
+ */
+static
+int metrics_event_counter_map(pid_t pid, const char *kind, size_t nr_values,
+		struct lttng_ust_metrics_event_names **_names, size_t *names_len,
+		struct lib_counter **counter)
+{
+	char name[LTTNG_UST_METRICS_SHM_NAME_LEN];
+	char names_kind[LTTNG_UST_METRICS_SHM_NAME_LEN];
+	struct lttng_ust_metrics_event_names *names;
+	size_t max_nr_elem[2], len;
+	int fd, ret;
+
+	snprintf(names_kind, sizeof(names_kind), "%s-names", kind);
+	lttng_ust_metrics_shm_name(pid, names_kind, name);
+	ret = metrics_shm_open(name, &fd, &len);
+	if (ret)
+		return ret;
+	if (len < sizeof(*names)) {
+		metrics_shm_close(fd);
+		return -EINVAL;
+	}
+	names = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+	metrics_shm_close(fd);
+	if (names == MAP_FAILED)
+		return -errno;
+	if (len != sizeof(*names) + (size_t) names->nr_slots * LTTNG_UST_ABI_SYM_NAME_LEN) {
+		ret = -EINVAL;
+		goto error_map;
+	}
+
+	max_nr_elem[0] = names->nr_slots;
+	max_nr_elem[1] = nr_values;
+	lttng_ust_metrics_shm_name(pid, kind, name);
+	ret = metrics_counter_map(name, 2, max_nr_elem, counter);
+	if (ret)
+		goto error_map;
+	*_names = names;
+	*names_len = len;
+	return 0;
+
+error_map:
+	(void) munmap(names, len);
+	return ret;
+}
+
+/*
+ * Number of rows of a per-event counter to read, at most nr_entries,
+ * reading the slot count before the names.
+ */
+static
+size_t metrics_event_counter_nr_rows(struct lttng_ust_metrics_event_names *names,
+		size_t nr_entries)
+{
+	uint32_t nr_used = CMM_LOAD_SHARED(names->nr_used);
+
+	cmm_smp_rmb();
+	return nr_entries > nr_used ? nr_used : nr_entries;
+}
+
+static
+void metrics_event_counter_name(struct lttng_ust_metrics_event_names *names,
+		size_t row, char *name)
+{
+	memcpy(name, names->name[row], LTTNG_UST_ABI_SYM_NAME_LEN);
+	name[LTTNG_UST_ABI_SYM_NAME_LEN - 1] = '\0';
+}
+
+int lttng_ust_ctl_probe_overhead_open(pid_t pid,
+		struct lttng_ust_ctl_probe_overhead **_overhead)
+{
+	struct lttng_ust_ctl_probe_overhead *overhead;
+	int ret;
+
+	overhead = zmalloc(sizeof(*overhead));
+	if (!overhead)
+		return -ENOMEM;
+	ret = metrics_event_counter_map(pid, "probe-overhead",
+		NR_LTTNG_UST_PROBE_OVERHEAD_VALUES, &overhead->names,
+		&overhead->names_len, &overhead->counter);
+	if (ret) {
+		free(overhead);
+		return ret;
+	}
+	*_overhead = overhead;
+	return 0;
+}
+
+int lttng_ust_ctl_probe_overhead_read(struct lttng_ust_ctl_probe_overhead *overhead,
+		struct lttng_ust_ctl_probe_overhead_entry *entries,
+		size_t nr_entries)
+{
+	size_t i;
+
+	nr_entries = metrics_event_counter_nr_rows(overhead->names, nr_entries);
+	for (i = 0; i < nr_entries; i++) {
+		size_t index[2] = { i, LTTNG_UST_PROBE_OVERHEAD_HITS };
+		bool overflow, underflow;
+		int64_t value;
+		int ret;
+
+		metrics_event_counter_name(overhead->names, i, entries[i].name);
+		ret = lttng_counter_aggregate(&lttng_ust_metrics_config,
+			overhead->counter, index, &value, &overflow, &underflow);
+		if (ret)
+			return ret;
+		entries[i].hits = (uint64_t) value;
+		index[1] = LTTNG_UST_PROBE_OVERHEAD_CYCLES;
+		ret = lttng_counter_aggregate(&lttng_ust_metrics_config,
+			overhead->counter, index, &value, &overflow, &underflow);
+		if (ret)
+			return ret;
+		entries[i].cycles = (uint64_t) value;
+	}
+	return nr_entries;
+}
+
+void lttng_ust_ctl_probe_overhead_close(struct lttng_ust_ctl_probe_overhead *overhead)
+{
+	lttng_counter_destroy(overhead->counter);
+	(void) munmap(overhead->names, overhead->names_len);
+	free(overhead);
+}
+
+int lttng_ust_ctl_event_discards_open(pid_t pid,
+		struct lttng_ust_ctl_event_discards **_discards)
+{
+	struct lttng_ust_ctl_event_discards *discards;
+	int ret;
+
+	discards = zmalloc(sizeof(*discards));
+	if (!discards)
+		return -ENOMEM;
+	ret = metrics_event_counter_map(pid, "event-discards", 1,
+		&discards->names, &discards->names_len, &discards->counter);
+	if (ret) {
+		free(discards);
+		return ret;
+	}
+	*_discards = discards;
+	return 0;
+}
+
+int lttng_ust_ctl_event_discards_read(struct lttng_ust_ctl_event_discards *discards,
+		struct lttng_ust_ctl_event_discards_entry *entries,
+		size_t nr_entries)
+{
+	size_t i;
+
+	nr_entries = metrics_event_counter_nr_rows(discards->names, nr_entries);
+	for (i = 0; i < nr_entries; i++) {
+		size_t index[2] = { i, 0 };
+		bool overflow, underflow;
+		int64_t value;
+		int ret;
+
+		metrics_event_counter_name(discards->names, i, entries[i].name);
+		ret = lttng_counter_aggregate(&lttng_ust_metrics_config,
+			discards->counter, index, &value, &overflow, &underflow);
+		if (ret)
+			return ret;
+		entries[i].discarded = (uint64_t) value;
+	}
+	return nr_entries;
+}
+
+void lttng_ust_ctl_event_discards_close(struct lttng_ust_ctl_event_discards *discards)
+{
+	lttng_counter_destroy(discards->counter);
+	(void) munmap(discards->names, discards->names_len);
+	free(discards);
+}
+
 static
 void lttng_ust_ctl_ctor(void)
 	__attribute__((constructor));
@@ -6,8 +6,19 @@
 
 #define _LGPL_SOURCE
 #include <dlfcn.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <stdio.h>
+#include <time.h>
+
+#include <urcu/compiler.h>
+
+#include "common/getenv.h"
+
+#include "lttng-ust-cyg-profile-filter.h"
 
 #define LTTNG_UST_TRACEPOINT_HIDDEN_DEFINITION
 #define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
@@ -17,18 +28,140 @@
 #define LTTNG_UST_TP_IP_PARAM func_addr
 #include "lttng-ust-cyg-profile-fast.h"
 
+/*
+ * Duration mode, enabled by LTTNG_UST_CYG_PROFILE_DURATION_THRESHOLD.
+ * Each thread keeps a shadow stack of the entry times of the functions
+ * it is in, and a single func_duration event is recorded at the exit of
+ * the functions which lasted at least duration_threshold_ns
+ * nanoseconds. The functions deeper than SHADOW_STACK_DEPTH are not
+ * timed.
+ */
+#define SHADOW_STACK_DEPTH	128
+
+struct shadow_frame {
+	void *func_addr;
+	uint64_t entry_ns;	/* 0 when entered with the event disabled. */
+};
+
+struct shadow_stack {
+	unsigned int depth;
+	struct shadow_frame frames[SHADOW_STACK_DEPTH];
+};
+
+static bool duration_mode;
+static uint64_t duration_threshold_ns;
+
+static __thread struct shadow_stack shadow_stack;
+
 void __cyg_profile_func_enter(void *this_fn, void *call_site)
 	__attribute__((no_instrument_function));
 
 void __cyg_profile_func_exit(void *this_fn, void *call_site)
 	__attribute__((no_instrument_function));
 
+static
+uint64_t duration_clock_read(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static
+void shadow_stack_push(void *this_fn)
+{
+	struct shadow_stack *stack = &shadow_stack;
+	struct shadow_frame *frame;
+
+	if (caa_unlikely(stack->depth >= SHADOW_STACK_DEPTH)) {
+		stack->depth++;
+		return;
+	}
+	frame = &stack->frames[stack->depth++];
+	frame->func_addr = this_fn;
+	frame->entry_ns = 0;
+	if (lttng_ust_tracepoint_enabled(lttng_ust_cyg_profile_fast, func_duration))
+		frame->entry_ns = duration_clock_read();
+}
+
+/*
+ * The exits of the functions left by longjmp() or by an exception are
+ * missed: unwind the shadow stack up to the frame of the function
+ * which returns, if it is there.
+ */
+static
+void shadow_stack_pop(void *this_fn)
+{
+	struct shadow_stack *stack = &shadow_stack;
+	struct shadow_frame *frame;
+	unsigned int depth;
+	uint64_t duration_ns;
+
+	if (caa_unlikely(!stack->depth))
+		return;
+	if (caa_unlikely(stack->depth > SHADOW_STACK_DEPTH)) {
+		stack->depth--;
+		return;
+	}
+	for (depth = stack->depth; depth > 0; depth--) {
+		if (stack->frames[depth - 1].func_addr == this_fn)
+			break;
+	}
+	if (caa_unlikely(!depth))
+		return;
+	stack->depth = depth - 1;
+	frame = &stack->frames[depth - 1];
+	if (!frame->entry_ns)
+		return;
+	duration_ns = duration_clock_read() - frame->entry_ns;
+	if (duration_ns >= duration_threshold_ns)
+		lttng_ust_tracepoint(lttng_ust_cyg_profile_fast, func_duration,
+			this_fn, duration_ns);
+}
+
 void __cyg_profile_func_enter(void *this_fn, void *call_site __attribute__((unused)))
 {
+	if (!lttng_ust_cyg_profile_filter_match(this_fn))
+		return;
+	if (duration_mode) {
+		shadow_stack_push(this_fn);
+		return;
+	}
 	lttng_ust_tracepoint(lttng_ust_cyg_profile_fast, func_entry, this_fn);
 }
 
 void __cyg_profile_func_exit(void *this_fn, void *call_site __attribute__((unused)))
 {
+	if (!lttng_ust_cyg_profile_filter_match(this_fn))
+		return;
+	if (duration_mode) {
+		shadow_stack_pop(this_fn);
+		return;
+	}
 	lttng_ust_tracepoint(lttng_ust_cyg_profile_fast, func_exit, this_fn);
 }
+
+static
+void lttng_ust_cyg_profile_fast_init(void)
+	__attribute__((constructor));
+static
+void lttng_ust_cyg_profile_fast_init(void)
+{
+	const char *str;
+	char *endptr;
+	unsigned long long val;
+
+	lttng_ust_cyg_profile_filter_init();
+	str = lttng_ust_getenv("LTTNG_UST_CYG_PROFILE_DURATION_THRESHOLD");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtoull(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0') {
+		fprintf(stderr, "cyg-profile-fast: invalid LTTNG_UST_CYG_PROFILE_DURATION_THRESHOLD value: %s\n", str);
+		return;
+	}
+	duration_threshold_ns = val;
+	duration_mode = true;
+}
@@ -37,6 +37,18 @@ LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_cyg_profile_fast, func_exit,
 LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_cyg_profile_fast, func_exit,
 	LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG_FUNCTION)
 
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_cyg_profile_fast, func_duration,
+	LTTNG_UST_TP_ARGS(void *, func_addr, uint64_t, duration_ns),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(unsigned long, addr,
+			(unsigned long) func_addr)
+		lttng_ust_field_integer(uint64_t, duration_ns, duration_ns)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_cyg_profile_fast, func_duration,
+	LTTNG_UST_TRACEPOINT_LOGLEVEL_DEBUG_FUNCTION)
+
 #endif /* _TRACEPOINT_LTTNG_UST_CYG_PROFILE_FAST_H */
 
 #undef LTTNG_UST_TRACEPOINT_INCLUDE
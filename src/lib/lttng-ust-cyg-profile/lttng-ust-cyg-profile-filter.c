@@ -0,0 +1,226 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Function tracing address filter, built at startup from the symbol
+ * glob patterns of LTTNG_UST_CYG_PROFILE_INCLUDE and
+ * LTTNG_UST_CYG_PROFILE_EXCLUDE, resolved against the function symbols
+ * of the objects loaded at that time. A function is traced if it
+ * matches an include pattern, or if there is none, and it matches no
+ * exclude pattern. Only the ranges of the functions whose tracing
+ * differs from the default of the functions which match no pattern
+ * are kept, which includes the functions of objects loaded afterwards.
+ */
+
+#define _LGPL_SOURCE
+#include <link.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/elf.h"
+#include "common/getenv.h"
+#include "common/macros.h"
+#include "common/strutils.h"
+
+#include "lttng-ust-cyg-profile-filter.h"
+
+struct cyg_profile_filter lttng_ust_cyg_profile_filter;
+
+struct filter_patterns {
+	char *str;		/* Patterns separated by '\0'. */
+	size_t nr;
+};
+
+struct filter_range {
+	uintptr_t start, end;
+};
+
+struct filter_build {
+	struct filter_patterns include, exclude;
+	uintptr_t base;
+	struct filter_range *ranges;
+	size_t nr_ranges, alloc_ranges;
+	bool exec_found;
+};
+
+/* Split the comma-separated patterns of `str` in place. */
+static
+int filter_patterns_parse(const char *str, struct filter_patterns *patterns)
+{
+	char *p;
+
+	patterns->str = NULL;
+	patterns->nr = 0;
+	if (!str || !*str)
+		return 0;
+	patterns->str = strdup(str);
+	if (!patterns->str)
+		return -1;
+	patterns->nr = 1;
+	for (p = patterns->str; *p; p++) {
+		if (*p == ',') {
+			*p = '\0';
+			patterns->nr++;
+		}
+	}
+	return 0;
+}
+
+static
+bool filter_patterns_match(const struct filter_patterns *patterns,
+		const char *name)
+{
+	const char *pattern = patterns->str;
+	size_t i, name_len = strlen(name);
+
+	for (i = 0; i < patterns->nr; i++) {
+		size_t len = strlen(pattern);
+
+		if (strutils_star_glob_match(pattern, len, name, name_len))
+			return true;
+		pattern += len + 1;
+	}
+	return false;
+}
+
+static
+int filter_add_symbol(const char *name, uint64_t value, uint64_t size,
+		void *priv)
+{
+	struct filter_build *build = priv;
+	struct cyg_profile_filter *filter = &lttng_ust_cyg_profile_filter;
+	bool traced;
+
+	traced = (!build->include.nr || filter_patterns_match(&build->include, name))
+		&& !filter_patterns_match(&build->exclude, name);
+	if (traced == filter->trace_default)
+		return 0;
+	if (build->nr_ranges == build->alloc_ranges) {
+		size_t alloc = max_t(size_t, 64, build->alloc_ranges << 1);
+		struct filter_range *ranges;
+
+		ranges = realloc(build->ranges, alloc * sizeof(*ranges));
+		if (!ranges)
+			return -1;
+		build->ranges = ranges;
+		build->alloc_ranges = alloc;
+	}
+	build->ranges[build->nr_ranges].start = build->base + value;
+	build->ranges[build->nr_ranges].end = build->base + value + size;
+	build->nr_ranges++;
+	return 0;
+}
+
+static
+int filter_add_object(struct dl_phdr_info *info,
+		size_t size __attribute__((unused)), void *priv)
+{
+	struct filter_build *build = priv;
+	char resolved_path[PATH_MAX];
+	struct lttng_ust_elf *elf;
+
+	if (!info->dlpi_name || !info->dlpi_name[0]) {
+		ssize_t path_len;
+
+		/* The first object without a name is the executable. */
+		if (build->exec_found)
+			return 0;
+		build->exec_found = true;
+		path_len = readlink("/proc/self/exe", resolved_path,
+				sizeof(resolved_path) - 1);
+		if (path_len <= 0)
+			return 0;
+		resolved_path[path_len] = '\0';
+	} else if (!realpath(info->dlpi_name, resolved_path)) {
+		/* vdso */
+		return 0;
+	}
+	elf = lttng_ust_elf_create(resolved_path);
+	if (!elf)
+		return 0;
+	build->base = info->dlpi_addr;
+	if (lttng_ust_elf_for_each_func_symbol(elf, filter_add_symbol, build))
+		fprintf(stderr, "cyg-profile: unable to read the function symbols of %s\n",
+			resolved_path);
+	lttng_ust_elf_destroy(elf);
+	return 0;
+}
+
+static
+int filter_range_compare(const void *a, const void *b)
+{
+	const struct filter_range *ra = a, *rb = b;
+
+	if (ra->start != rb->start)
+		return ra->start < rb->start ? -1 : 1;
+	return 0;
+}
+
+/* Sort and merge the ranges into the lookup arrays. */
+static
+int filter_publish(struct filter_build *build)
+{
+	struct cyg_profile_filter *filter = &lttng_ust_cyg_profile_filter;
+	uintptr_t *starts = NULL, *ends = NULL;
+	size_t i, nr = 0;
+
+	if (build->nr_ranges) {
+		qsort(build->ranges, build->nr_ranges, sizeof(*build->ranges),
+			filter_range_compare);
+		starts = malloc(build->nr_ranges * sizeof(*starts));
+		ends = malloc(build->nr_ranges * sizeof(*ends));
+		if (!starts || !ends) {
+			free(starts);
+			free(ends);
+			return -1;
+		}
+	}
+	for (i = 0; i < build->nr_ranges; i++) {
+		const struct filter_range *range = &build->ranges[i];
+
+		if (nr && range->start <= ends[nr - 1]) {
+			ends[nr - 1] = max_t(uintptr_t, ends[nr - 1], range->end);
+			continue;
+		}
+		starts[nr] = range->start;
+		ends[nr] = range->end;
+		nr++;
+	}
+	filter->starts = starts;
+	filter->ends = ends;
+	filter->nr_ranges = nr;
+	filter->enabled = true;
+	return 0;
+}
+
+void lttng_ust_cyg_profile_filter_init(void)
+{
+	struct cyg_profile_filter *filter = &lttng_ust_cyg_profile_filter;
+	struct filter_build build;
+
+	memset(&build, 0, sizeof(build));
+	if (filter_patterns_parse(lttng_ust_getenv("LTTNG_UST_CYG_PROFILE_INCLUDE"),
+				&build.include)
+			|| filter_patterns_parse(lttng_ust_getenv("LTTNG_UST_CYG_PROFILE_EXCLUDE"),
+				&build.exclude))
+		goto error;
+	if (!build.include.nr && !build.exclude.nr)
+		goto end;
+	filter->trace_default = !build.include.nr;
+	dl_iterate_phdr(filter_add_object, &build);
+	if (filter_publish(&build))
+		goto error;
+	goto end;
+
+error:
+	fprintf(stderr, "cyg-profile: unable to build the function filter\n");
+end:
+	free(build.ranges);
+	free(build.include.str);
+	free(build.exclude.str);
+}
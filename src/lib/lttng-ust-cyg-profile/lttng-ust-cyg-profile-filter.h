@@ -0,0 +1,65 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Function tracing address filter.
+ */
+
+#ifndef _LTTNG_UST_CYG_PROFILE_FILTER_H
+#define _LTTNG_UST_CYG_PROFILE_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <urcu/compiler.h>
+
+/*
+ * Sorted, non-overlapping address ranges of the functions whose
+ * tracing differs from the default. Set once by the constructor.
+ */
+struct cyg_profile_filter {
+	bool enabled;
+	bool trace_default;
+	size_t nr_ranges;
+	uintptr_t *starts;
+	uintptr_t *ends;
+};
+
+extern struct cyg_profile_filter lttng_ust_cyg_profile_filter
+	__attribute__((visibility("hidden")));
+
+void lttng_ust_cyg_profile_filter_init(void)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Whether the function at `func_addr` is traced. The range lookup is a
+ * binary search without data-dependent branches.
+ */
+static inline __attribute__((no_instrument_function))
+bool lttng_ust_cyg_profile_filter_match(void *func_addr)
+{
+	const struct cyg_profile_filter *filter = &lttng_ust_cyg_profile_filter;
+	uintptr_t addr = (uintptr_t) func_addr;
+	const uintptr_t *base;
+	size_t n;
+	bool in_range;
+
+	if (caa_likely(!filter->enabled))
+		return true;
+	n = filter->nr_ranges;
+	if (!n)
+		return filter->trace_default;
+	base = filter->starts;
+	while (n > 1) {
+		size_t half = n >> 1;
+
+		base = base[half] <= addr ? base + half : base;
+		n -= half;
+	}
+	in_range = (*base <= addr) & (addr < filter->ends[base - filter->starts]);
+	return in_range != filter->trace_default;
+}
+
+#endif /* _LTTNG_UST_CYG_PROFILE_FILTER_H */
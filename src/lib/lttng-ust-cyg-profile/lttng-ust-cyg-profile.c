@@ -9,6 +9,8 @@
 #include <sys/types.h>
 #include <stdio.h>
 
+#include "lttng-ust-cyg-profile-filter.h"
+
 #define LTTNG_UST_TRACEPOINT_HIDDEN_DEFINITION
 #define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
 
@@ -25,10 +27,23 @@ void __cyg_profile_func_exit(void *this_fn, void *call_site)
 
 void __cyg_profile_func_enter(void *this_fn, void *call_site)
 {
+	if (!lttng_ust_cyg_profile_filter_match(this_fn))
+		return;
 	lttng_ust_tracepoint(lttng_ust_cyg_profile, func_entry, this_fn, call_site);
 }
 
 void __cyg_profile_func_exit(void *this_fn, void *call_site)
 {
+	if (!lttng_ust_cyg_profile_filter_match(this_fn))
+		return;
 	lttng_ust_tracepoint(lttng_ust_cyg_profile, func_exit, this_fn, call_site);
 }
+
+static
+void lttng_ust_cyg_profile_init(void)
+	__attribute__((constructor));
+static
+void lttng_ust_cyg_profile_init(void)
+{
+	lttng_ust_cyg_profile_filter_init();
+}
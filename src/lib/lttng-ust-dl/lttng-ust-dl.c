@@ -12,8 +12,12 @@
 #include <common/compat/dlfcn.h>
 
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -79,129 +83,300 @@ int _lttng_ust_dl_libc_dlclose(void *handle)
 	return __lttng_ust_plibc_dlclose(handle);
 }
 
+/*
+ * The dlopen(), dlmopen() and dlclose() wrappers only record the base
+ * address and name of the object on the caller path. Reading its ELF
+ * information, emitting the events and updating the base address
+ * statedump table are postponed to a worker thread, so the latency of
+ * the application dynamic loader calls is not increased by file reads
+ * nor by the UST lock. Operations are processed in call order; the
+ * events are therefore timestamped when emitted by the worker, not when
+ * the call happened.
+ */
+enum dl_op_type {
+	DL_OP_UPDATE,
+	DL_OP_DLOPEN,
+	DL_OP_DLMOPEN,
+	DL_OP_DLCLOSE,
+};
+
+struct dl_op {
+	struct dl_op *next;
+	enum dl_op_type type;
+	void *ip;
+	void *so_base;
+	int flags;
+#ifdef HAVE_DLMOPEN
+	Lmid_t nsid;
+#endif
+	char so_name[];
+};
+
+/* Protects the operation queue and the worker state. */
+static pthread_mutex_t dl_worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dl_worker_cond = PTHREAD_COND_INITIALIZER;
+static struct dl_op *dl_queue_head;
+static struct dl_op **dl_queue_tail = &dl_queue_head;
+static int dl_worker_state;	/* 0: not started, 1: running, -1: failed. */
+
+/*
+ * Get the ELF information of the object from the base address statedump
+ * table, which already read it, else from the file.
+ */
 static
-void lttng_ust_dl_dlopen(void *so_base, const char *so_name,
-		int flags, void *ip)
+int dl_get_bin_info(void *so_base, const char *so_name,
+		struct lttng_ust_dl_bin_info *info)
 {
-	char resolved_path[PATH_MAX];
 	struct lttng_ust_elf *elf;
-	uint64_t memsz;
-	uint8_t *build_id = NULL;
-	size_t build_id_len;
-	char *dbg_file = NULL;
-	uint32_t crc;
-	int has_build_id = 0, has_debug_link = 0;
 	int ret;
 
-	if (!realpath(so_name, resolved_path)) {
+	if (!lttng_ust_dl_get_bin_info(so_base, info))
+		return 0;
+
+	if (!realpath(so_name, info->resolved_path)) {
 		ERR("could not resolve path '%s'", so_name);
-		return;
+		return -1;
 	}
 
-	elf = lttng_ust_elf_create(resolved_path);
+	elf = lttng_ust_elf_create(info->resolved_path);
 	if (!elf) {
-		ERR("could not access file %s", resolved_path);
-		return;
+		ERR("could not access file %s", info->resolved_path);
+		return -1;
 	}
 
-	ret = lttng_ust_elf_get_memsz(elf, &memsz);
+	ret = lttng_ust_elf_get_memsz(elf, &info->memsz);
 	if (ret) {
 		goto end;
 	}
 	ret = lttng_ust_elf_get_build_id(
-		elf, &build_id, &build_id_len, &has_build_id);
+		elf, &info->build_id, &info->build_id_len,
+		&info->has_build_id);
 	if (ret) {
 		goto end;
 	}
 	ret = lttng_ust_elf_get_debug_link(
-		elf, &dbg_file, &crc, &has_debug_link);
+		elf, &info->dbg_file, &info->crc, &info->has_debug_link);
+end:
 	if (ret) {
-		goto end;
+		free(info->dbg_file);
+		free(info->build_id);
 	}
+	lttng_ust_elf_destroy(elf);
+	return ret;
+}
+
+static
+void lttng_ust_dl_dlopen(const struct dl_op *op)
+{
+	struct lttng_ust_dl_bin_info info;
+
+	if (dl_get_bin_info(op->so_base, op->so_name, &info))
+		return;
 
-	lttng_ust_tracepoint(lttng_ust_dl, dlopen,
-		ip, so_base, resolved_path, flags, memsz,
-		has_build_id, has_debug_link);
+	switch (op->type) {
+#ifdef HAVE_DLMOPEN
+	case DL_OP_DLMOPEN:
+		lttng_ust_tracepoint(lttng_ust_dl, dlmopen,
+			op->ip, op->so_base, op->nsid, info.resolved_path,
+			op->flags, info.memsz,
+			info.has_build_id, info.has_debug_link);
+		break;
+#endif
+	default:
+		lttng_ust_tracepoint(lttng_ust_dl, dlopen,
+			op->ip, op->so_base, info.resolved_path, op->flags,
+			info.memsz, info.has_build_id, info.has_debug_link);
+		break;
+	}
 
-	if (has_build_id) {
+	if (info.has_build_id) {
 		lttng_ust_tracepoint(lttng_ust_dl, build_id,
-			ip, so_base, build_id, build_id_len);
+			op->ip, op->so_base, info.build_id,
+			info.build_id_len);
 	}
 
-	if (has_debug_link) {
+	if (info.has_debug_link) {
 		lttng_ust_tracepoint(lttng_ust_dl, debug_link,
-			ip, so_base, dbg_file, crc);
+			op->ip, op->so_base, info.dbg_file, info.crc);
 	}
 
-end:
-	free(dbg_file);
-	free(build_id);
-	lttng_ust_elf_destroy(elf);
-	return;
+	free(info.dbg_file);
+	free(info.build_id);
 }
 
-#ifdef HAVE_DLMOPEN
 static
-void lttng_ust_dl_dlmopen(void *so_base, Lmid_t nsid, const char *so_name,
-		int flags, void *ip)
+void dl_process_op(const struct dl_op *op)
 {
-	char resolved_path[PATH_MAX];
-	struct lttng_ust_elf *elf;
-	uint64_t memsz;
-	uint8_t *build_id = NULL;
-	size_t build_id_len;
-	char *dbg_file = NULL;
-	uint32_t crc;
-	int has_build_id = 0, has_debug_link = 0;
-	int ret;
-
-	if (!realpath(so_name, resolved_path)) {
-		ERR("could not resolve path '%s'", so_name);
-		return;
+	switch (op->type) {
+	case DL_OP_UPDATE:
+		lttng_ust_dl_update(op->ip);
+		break;
+	case DL_OP_DLOPEN:
+	case DL_OP_DLMOPEN:
+		/*
+		 * Update the statedump table first, so that the ELF
+		 * information it reads is reused for the events.
+		 */
+		lttng_ust_dl_update(op->ip);
+		lttng_ust_dl_dlopen(op);
+		break;
+	case DL_OP_DLCLOSE:
+		lttng_ust_tracepoint(lttng_ust_dl, dlclose,
+			op->ip, op->so_base);
+		lttng_ust_dl_update(op->ip);
+		break;
 	}
+}
 
-	elf = lttng_ust_elf_create(resolved_path);
-	if (!elf) {
-		ERR("could not access file %s", resolved_path);
-		return;
+static
+void *dl_worker_thread(void *arg __attribute__((unused)))
+{
+	for (;;) {
+		struct dl_op *op;
+
+		pthread_mutex_lock(&dl_worker_mutex);
+		while (!dl_queue_head)
+			pthread_cond_wait(&dl_worker_cond, &dl_worker_mutex);
+		op = dl_queue_head;
+		dl_queue_head = op->next;
+		if (!dl_queue_head)
+			dl_queue_tail = &dl_queue_head;
+		pthread_mutex_unlock(&dl_worker_mutex);
+
+		dl_process_op(op);
+		free(op);
 	}
+	return NULL;
+}
+
+/* Called with dl_worker_mutex held. */
+static
+int dl_worker_start(void)
+{
+	sigset_t sig_all_blocked, orig_mask;
+	pthread_attr_t attr;
+	pthread_t worker;
+	int ret;
 
-	ret = lttng_ust_elf_get_memsz(elf, &memsz);
+	if (dl_worker_state)
+		return dl_worker_state > 0 ? 0 : -1;
+	dl_worker_state = -1;
+	ret = pthread_attr_init(&attr);
 	if (ret) {
-		goto end;
+		ERR("pthread_attr_init: %s", strerror(ret));
+		return -1;
 	}
-	ret = lttng_ust_elf_get_build_id(
-		elf, &build_id, &build_id_len, &has_build_id);
+	ret = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
 	if (ret) {
+		ERR("pthread_attr_setdetachstate: %s", strerror(ret));
 		goto end;
 	}
-	ret = lttng_ust_elf_get_debug_link(
-		elf, &dbg_file, &crc, &has_debug_link);
+	/* The worker inherits the signal mask: keep signals away from it. */
+	sigfillset(&sig_all_blocked);
+	ret = pthread_sigmask(SIG_SETMASK, &sig_all_blocked, &orig_mask);
 	if (ret) {
+		ERR("pthread_sigmask: %s", strerror(ret));
 		goto end;
 	}
+	ret = pthread_create(&worker, &attr, dl_worker_thread, NULL);
+	if (ret) {
+		ERR("pthread_create: %s", strerror(ret));
+	} else {
+		dl_worker_state = 1;
+	}
+	(void) pthread_sigmask(SIG_SETMASK, &orig_mask, NULL);
+end:
+	(void) pthread_attr_destroy(&attr);
+	return dl_worker_state > 0 ? 0 : -1;
+}
 
-	lttng_ust_tracepoint(lttng_ust_dl, dlmopen,
-		ip, so_base, nsid, resolved_path, flags, memsz,
-		has_build_id, has_debug_link);
+static
+struct dl_op *dl_op_create(enum dl_op_type type, void *ip, void *so_base,
+		const char *so_name, int flags)
+{
+	size_t name_len = so_name ? strlen(so_name) + 1 : 1;
+	struct dl_op *op;
+
+	op = zmalloc(sizeof(*op) + name_len);
+	if (!op)
+		return NULL;
+	op->type = type;
+	op->ip = ip;
+	op->so_base = so_base;
+	op->flags = flags;
+	if (so_name)
+		memcpy(op->so_name, so_name, name_len);
+	return op;
+}
 
-	if (has_build_id) {
-		lttng_ust_tracepoint(lttng_ust_dl, build_id,
-			ip, so_base, build_id, build_id_len);
+/*
+ * Queue an operation to the worker thread. Operations are processed in
+ * the calling thread if the worker is unavailable.
+ */
+static
+void dl_queue_op(struct dl_op *op)
+{
+	if (!op)
+		return;
+	pthread_mutex_lock(&dl_worker_mutex);
+	if (dl_worker_start()) {
+		pthread_mutex_unlock(&dl_worker_mutex);
+		dl_process_op(op);
+		free(op);
+		return;
 	}
+	*dl_queue_tail = op;
+	dl_queue_tail = &op->next;
+	pthread_cond_signal(&dl_worker_cond);
+	pthread_mutex_unlock(&dl_worker_mutex);
+}
 
-	if (has_debug_link) {
-		lttng_ust_tracepoint(lttng_ust_dl, debug_link,
-			ip, so_base, dbg_file, crc);
+/*
+ * The worker does not survive fork: the child starts over with an
+ * empty queue, and starts its own worker on its next dynamic loader
+ * call.
+ */
+static
+void dl_worker_before_fork(void)
+{
+	pthread_mutex_lock(&dl_worker_mutex);
+}
+
+static
+void dl_worker_after_fork_parent(void)
+{
+	pthread_mutex_unlock(&dl_worker_mutex);
+}
+
+static
+void dl_worker_after_fork_child(void)
+{
+	struct dl_op *op, *next;
+
+	for (op = dl_queue_head; op; op = next) {
+		next = op->next;
+		free(op);
 	}
+	dl_queue_head = NULL;
+	dl_queue_tail = &dl_queue_head;
+	dl_worker_state = 0;
+	pthread_mutex_unlock(&dl_worker_mutex);
+}
 
-end:
-	free(dbg_file);
-	free(build_id);
-	lttng_ust_elf_destroy(elf);
-	return;
+static
+void lttng_ust_dl_ctor(void)
+	__attribute__((constructor));
+static
+void lttng_ust_dl_ctor(void)
+{
+	int ret;
+
+	ret = pthread_atfork(dl_worker_before_fork,
+			dl_worker_after_fork_parent,
+			dl_worker_after_fork_child);
+	if (ret)
+		ERR("pthread_atfork: %s", strerror(ret));
 }
-#endif
 
 void *dlopen(const char *filename, int flags)
 {
@@ -214,11 +389,14 @@ void *dlopen(const char *filename, int flags)
 
 		ret = dlinfo(handle, RTLD_DI_LINKMAP, &p);
 		if (ret != -1 && p != NULL && p->l_addr != 0) {
-			lttng_ust_dl_dlopen((void *) p->l_addr,
-				p->l_name, flags, LTTNG_UST_CALLER_IP());
+			dl_queue_op(dl_op_create(DL_OP_DLOPEN,
+				LTTNG_UST_CALLER_IP(), (void *) p->l_addr,
+				p->l_name, flags));
+			return handle;
 		}
 	}
-	lttng_ust_dl_update(LTTNG_UST_CALLER_IP());
+	dl_queue_op(dl_op_create(DL_OP_UPDATE, LTTNG_UST_CALLER_IP(),
+		NULL, NULL, 0));
 	return handle;
 }
 
@@ -234,12 +412,18 @@ void *dlmopen(Lmid_t nsid, const char *filename, int flags)
 
 		ret = dlinfo(handle, RTLD_DI_LINKMAP, &p);
 		if (ret != -1 && p != NULL && p->l_addr != 0) {
-			lttng_ust_dl_dlmopen((void *) p->l_addr,
-				nsid, p->l_name, flags,
-				LTTNG_UST_CALLER_IP());
+			struct dl_op *op;
+
+			op = dl_op_create(DL_OP_DLMOPEN, LTTNG_UST_CALLER_IP(),
+				(void *) p->l_addr, p->l_name, flags);
+			if (op)
+				op->nsid = nsid;
+			dl_queue_op(op);
+			return handle;
 		}
 	}
-	lttng_ust_dl_update(LTTNG_UST_CALLER_IP());
+	dl_queue_op(dl_op_create(DL_OP_UPDATE, LTTNG_UST_CALLER_IP(),
+		NULL, NULL, 0));
 	return handle;
 
 }
@@ -247,6 +431,8 @@ void *dlmopen(Lmid_t nsid, const char *filename, int flags)
 
 int dlclose(void *handle)
 {
+	enum dl_op_type type = DL_OP_UPDATE;
+	void *so_base = NULL;
 	int ret;
 
 	if (lttng_ust_tracepoint_ptrs_registered) {
@@ -254,12 +440,12 @@ int dlclose(void *handle)
 
 		ret = dlinfo(handle, RTLD_DI_LINKMAP, &p);
 		if (ret != -1 && p != NULL && p->l_addr != 0) {
-			lttng_ust_tracepoint(lttng_ust_dl, dlclose,
-				LTTNG_UST_CALLER_IP(),
-				(void *) p->l_addr);
+			type = DL_OP_DLCLOSE;
+			so_base = (void *) p->l_addr;
 		}
 	}
 	ret = _lttng_ust_dl_libc_dlclose(handle);
-	lttng_ust_dl_update(LTTNG_UST_CALLER_IP());
+	dl_queue_op(dl_op_create(type, LTTNG_UST_CALLER_IP(), so_base,
+		NULL, 0));
 	return ret;
 }
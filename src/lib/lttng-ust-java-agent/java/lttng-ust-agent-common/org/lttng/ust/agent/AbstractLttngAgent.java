@@ -16,7 +16,6 @@ import java.util.Set;
 import java.util.concurrent.ConcurrentHashMap;
 import java.util.concurrent.locks.Lock;
 import java.util.concurrent.locks.ReentrantLock;
-import java.util.regex.Matcher;
 
 import org.lttng.ust.agent.client.ILttngTcpClientListener;
 import org.lttng.ust.agent.client.LttngTcpSessiondClient;
@@ -53,18 +52,23 @@ public abstract class AbstractLttngAgent<T extends ILttngHandler>
 	private final Map<EventNamePattern, Integer> enabledPatterns = new HashMap<EventNamePattern, Integer>();
 
 	/**
-	 * Cache of already-checked event names. As long as enabled/disabled events
-	 * don't change in the session, we can avoid re-checking events that were
-	 * previously checked against all known enabled patterns.
-	 *
-	 * Its accesses should be protected by the {@link #enabledEventNamesLock}
-	 * below, with the exception of concurrent get operations.
+	 * Immutable copy of the keys of {@link #enabledPatterns}, replaced
+	 * whenever a pattern is added to or removed from the map, so that event
+	 * names can be matched without taking {@link #enabledEventNamesLock}.
+	 */
+	private volatile PatternSet enabledPatternSet = new PatternSet(new EventNamePattern[0]);
+
+	/**
+	 * Cache of already-checked event names. Each decision is only valid for
+	 * the {@link PatternSet} it was made against, so that enabling or
+	 * disabling events in the session invalidates all the decisions at
+	 * once, each one being re-checked the next time its event name is seen.
 	 */
-	private final Map<String, Boolean> enabledEventNamesCache = new ConcurrentHashMap<String, Boolean>();
+	private final Map<String, CachedDecision> enabledEventNamesCache = new ConcurrentHashMap<String, CachedDecision>();
 
 	/**
-	 * Lock protecting accesses to the {@link #enabledPatterns} and
-	 * {@link #enabledEventNamesCache} maps.
+	 * Lock protecting accesses to the {@link #enabledPatterns} map, and
+	 * updates of {@link #enabledPatternSet}.
 	 */
 	private final Lock enabledEventNamesLock = new ReentrantLock();
 
@@ -207,6 +211,7 @@ public abstract class AbstractLttngAgent<T extends ILttngHandler>
 				}
 			}
 			enabledPatterns.clear();
+			updatePatternSet();
 			enabledEventNamesCache.clear();
 		} finally {
 			enabledEventNamesLock.unlock();
@@ -231,8 +236,11 @@ public abstract class AbstractLttngAgent<T extends ILttngHandler>
 
 		enabledEventNamesLock.lock();
 		try {
+			int nbPatterns = enabledPatterns.size();
 			boolean ret = incrementRefCount(pattern, enabledPatterns);
-			enabledEventNamesCache.clear();
+			if (enabledPatterns.size() != nbPatterns) {
+				updatePatternSet();
+			}
 			return ret;
 		} finally {
 			enabledEventNamesLock.unlock();
@@ -248,8 +256,11 @@ public abstract class AbstractLttngAgent<T extends ILttngHandler>
 
 		enabledEventNamesLock.lock();
 		try {
+			int nbPatterns = enabledPatterns.size();
 			boolean ret = decrementRefCount(pattern, enabledPatterns);
-			enabledEventNamesCache.clear();
+			if (enabledPatterns.size() != nbPatterns) {
+				updatePatternSet();
+			}
 			return ret;
 		} finally {
 			enabledEventNamesLock.unlock();
@@ -298,39 +309,22 @@ public abstract class AbstractLttngAgent<T extends ILttngHandler>
 
 	@Override
 	public boolean isEventEnabled(String eventName) {
-		Boolean cachedEnabled = enabledEventNamesCache.get(eventName);
-		if (cachedEnabled != null) {
-			/* We have seen this event previously */
-			/*
-			 * Careful! enabled == null could also mean that the null value is
-			 * associated with the key. But we should have never inserted null
-			 * values in the map.
-			 */
-			return cachedEnabled.booleanValue();
+		PatternSet patterns = enabledPatternSet;
+		CachedDecision cached = enabledEventNamesCache.get(eventName);
+		if (cached != null && cached.patterns == patterns) {
+			/* We have seen this event since the last session command */
+			return cached.enabled;
 		}
 
 		/*
-		 * We have not previously checked this event. Run it against all known
-		 * enabled event patterns to determine if it should pass or not.
+		 * We have not checked this event against the current patterns. Run
+		 * it against all of them to determine if it should pass or not. A
+		 * concurrent session command may replace the patterns meanwhile, in
+		 * which case this decision is simply checked again next time.
 		 */
-		enabledEventNamesLock.lock();
-		try {
-			boolean enabled = false;
-			for (EventNamePattern enabledPattern : enabledPatterns.keySet()) {
-				Matcher matcher = enabledPattern.getPattern().matcher(eventName);
-				if (matcher.matches()) {
-					enabled = true;
-					break;
-				}
-			}
-
-			/* Add the result to the cache */
-			enabledEventNamesCache.put(eventName, Boolean.valueOf(enabled));
-			return enabled;
-
-		} finally {
-			enabledEventNamesLock.unlock();
-		}
+		boolean enabled = patterns.matches(eventName);
+		enabledEventNamesCache.put(eventName, new CachedDecision(patterns, enabled));
+		return enabled;
 	}
 
 	@Override
@@ -338,6 +332,45 @@ public abstract class AbstractLttngAgent<T extends ILttngHandler>
 		return enabledAppContexts.entrySet();
 	}
 
+	/* Should be called with enabledEventNamesLock held. */
+	private void updatePatternSet() {
+		enabledPatternSet = new PatternSet(enabledPatterns.keySet().toArray(new EventNamePattern[0]));
+	}
+
+	/**
+	 * Snapshot of the enabled event name patterns.
+	 */
+	private static final class PatternSet {
+		private final EventNamePattern[] patterns;
+
+		PatternSet(EventNamePattern[] patterns) {
+			this.patterns = patterns;
+		}
+
+		boolean matches(String eventName) {
+			for (EventNamePattern pattern : patterns) {
+				if (pattern.getPattern().matcher(eventName).matches()) {
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+
+	/**
+	 * Enabled/disabled decision for an event name, made against a given
+	 * {@link PatternSet}.
+	 */
+	private static final class CachedDecision {
+		final PatternSet patterns;
+		final boolean enabled;
+
+		CachedDecision(PatternSet patterns, boolean enabled) {
+			this.patterns = patterns;
+			this.enabled = enabled;
+		}
+	}
+
 	private static <T> boolean incrementRefCount(T key, Map<T, Integer> refCountMap) {
 		synchronized (refCountMap) {
 			Integer count = refCountMap.get(key);
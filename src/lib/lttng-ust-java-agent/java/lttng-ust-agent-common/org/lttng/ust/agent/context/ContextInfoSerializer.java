@@ -13,6 +13,7 @@ import java.io.IOException;
 import java.nio.ByteBuffer;
 import java.nio.ByteOrder;
 import java.nio.charset.Charset;
+import java.util.Arrays;
 import java.util.Collection;
 import java.util.Map;
 
@@ -218,6 +219,54 @@ public class ContextInfoSerializer {
 		return new SerializedContexts(entriesArray, stringsArray);
 	}
 
+	/* Contexts last pushed as the snapshot of the current thread */
+	private static final ThreadLocal<SerializedContexts> PUSHED_CONTEXTS = new ThreadLocal<SerializedContexts>();
+
+	/**
+	 * Make the given contexts the snapshot of the current thread in the
+	 * tracer, so that events can be logged without passing them through JNI
+	 * along with each log call. The snapshot is only pushed to the tracer
+	 * when it differs from the one previously pushed by this thread.
+	 *
+	 * @param contexts
+	 *            The contexts, as returned by
+	 *            {@link #queryAndSerializeRequestedContexts}
+	 * @return True if the snapshot of the current thread holds the given
+	 *         contexts, so the event can be logged without them. False if
+	 *         they must be passed along with the log call.
+	 */
+	public static boolean pushContextSnapshot(SerializedContexts contexts) {
+		SerializedContexts pushed = PUSHED_CONTEXTS.get();
+		byte[] entries = contexts.getEntriesArray();
+		byte[] strings = contexts.getStringsArray();
+
+		if (pushed == null) {
+			if (entries.length == 0) {
+				/* Nothing pushed yet, and nothing to push */
+				return true;
+			}
+		} else if (Arrays.equals(pushed.getEntriesArray(), entries)
+				&& Arrays.equals(pushed.getStringsArray(), strings)) {
+			return true;
+		}
+
+		/*
+		 * The JNI library is loaded: either this thread already pushed a
+		 * snapshot, or non-empty contexts were retrieved through the
+		 * ContextInfoManager.
+		 */
+		if (entries.length == 0) {
+			LttngContextApi.clearContextSnapshot();
+			PUSHED_CONTEXTS.remove();
+			return true;
+		}
+		if (!LttngContextApi.setContextSnapshot(entries, strings)) {
+			return false;
+		}
+		PUSHED_CONTEXTS.set(contexts);
+		return true;
+	}
+
 	private static final int CONTEXT_VALUE_LENGTH = 8;
 
 	private static void serializeContextInfo(ByteBuffer entriesBuffer, DataOutputStream stringsDos, Object contextInfo) throws IOException {
@@ -40,5 +40,25 @@ final class LttngContextApi {
 	 *            {@link #registerProvider}
 	 */
 	static native void unregisterProvider(long provider_ref);
+
+	/**
+	 * Set the context information snapshot of the current thread.
+	 *
+	 * Events logged by this thread without context information afterwards
+	 * record the values from this snapshot.
+	 *
+	 * @param contextEntries
+	 *            The entries array, see {@link ContextInfoSerializer}
+	 * @param contextStrings
+	 *            The strings array, see {@link ContextInfoSerializer}
+	 * @return True if the snapshot was set, false if the previous one was
+	 *         kept
+	 */
+	static native boolean setContextSnapshot(byte[] contextEntries, byte[] contextStrings);
+
+	/**
+	 * Clear the context information snapshot of the current thread.
+	 */
+	static native void clearContextSnapshot();
 }
 
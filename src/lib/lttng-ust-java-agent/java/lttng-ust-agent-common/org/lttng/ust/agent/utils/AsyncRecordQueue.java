@@ -0,0 +1,213 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+package org.lttng.ust.agent.utils;
+
+import java.nio.ByteBuffer;
+import java.util.concurrent.TimeUnit;
+import java.util.concurrent.atomic.AtomicInteger;
+import java.util.concurrent.atomic.AtomicLong;
+import java.util.concurrent.atomic.AtomicReference;
+import java.util.concurrent.locks.LockSupport;
+
+/**
+ * Asynchronous handoff of log records from the logging threads to a single
+ * committer thread.
+ *
+ * The logging threads only enqueue records already encoded by
+ * {@link RecordBatch} into a lock-free multiple-producer, single-consumer
+ * queue. The committer thread appends them to a batch, which it commits to
+ * the tracer with a single JNI call once full or once the queue is empty.
+ *
+ * The records are committed by another thread, so they must carry their
+ * context information inline rather than rely on the context snapshot of
+ * the logging thread. The UST event timestamps are the commit times, the
+ * time of the log record being part of the record itself.
+ *
+ * Records enqueued while the queue already holds {@link #MAX_PENDING} records
+ * are dropped.
+ */
+public class AsyncRecordQueue {
+
+	/**
+	 * Environment variable enabling the asynchronous mode of the log handlers
+	 */
+	public static final String ENV_VAR_NAME = "LTTNG_UST_AGENT_ASYNC";
+
+	/** Maximum number of records waiting to be committed */
+	public static final int MAX_PENDING = 64 * 1024;
+
+	private static final long IDLE_PARK_NS = TimeUnit.MILLISECONDS.toNanos(100);
+
+	/**
+	 * Commits a batch of encoded records, typically through the
+	 * tracepointBatch() JNI method of an agent.
+	 */
+	public interface Committer {
+		/**
+		 * @param buffer
+		 *            The direct buffer holding the encoded records
+		 * @param length
+		 *            The length of the encoded records, in bytes
+		 */
+		void commit(ByteBuffer buffer, int length);
+	}
+
+	private static final class Node {
+		final byte[] record;
+		volatile Node next;
+
+		Node(byte[] record) {
+			this.record = record;
+		}
+	}
+
+	private final Committer committer;
+	private final RecordBatch batch = new RecordBatch(RecordBatch.DEFAULT_CAPACITY);
+	private final Thread thread;
+
+	/* Producers swap themselves in at the tail, the consumer owns the head. */
+	private final AtomicReference<Node> tail;
+	private Node head;
+
+	private final AtomicInteger pending = new AtomicInteger(0);
+	private final AtomicLong enqueued = new AtomicLong(0);
+	private final AtomicLong dropped = new AtomicLong(0);
+	private volatile long committed = 0;
+	private volatile boolean sleeping = false;
+
+	/**
+	 * @return True if the asynchronous mode is enabled through the
+	 *         environment
+	 */
+	public static boolean isEnabled() {
+		return System.getenv(ENV_VAR_NAME) != null;
+	}
+
+	/**
+	 * Constructor, starting the committer thread
+	 *
+	 * @param name
+	 *            Name of the committer thread
+	 * @param committer
+	 *            Commits the batches of records
+	 */
+	public AsyncRecordQueue(String name, Committer committer) {
+		this.committer = committer;
+		head = new Node(null);
+		tail = new AtomicReference<Node>(head);
+		thread = new Thread(new Runnable() {
+			@Override
+			public void run() {
+				drain();
+			}
+		}, name);
+		thread.setDaemon(true);
+		thread.start();
+	}
+
+	/**
+	 * Enqueue an encoded record. Wait-free, unless the committer thread has
+	 * to be woken up.
+	 *
+	 * @param record
+	 *            The record, as encoded by {@link RecordBatch#toByteArray()}
+	 * @return True if the record is enqueued, false if it is dropped because
+	 *         the queue is full
+	 */
+	public boolean enqueue(byte[] record) {
+		if (pending.incrementAndGet() > MAX_PENDING) {
+			pending.decrementAndGet();
+			dropped.incrementAndGet();
+			return false;
+		}
+		Node node = new Node(record);
+		tail.getAndSet(node).next = node;
+		enqueued.incrementAndGet();
+		if (sleeping) {
+			sleeping = false;
+			LockSupport.unpark(thread);
+		}
+		return true;
+	}
+
+	/**
+	 * Wait until the records enqueued so far are committed.
+	 *
+	 * @param timeoutMs
+	 *            Maximum time to wait, in milliseconds
+	 */
+	public void flush(long timeoutMs) {
+		long target = enqueued.get();
+		long deadline = System.nanoTime() + TimeUnit.MILLISECONDS.toNanos(timeoutMs);
+
+		LockSupport.unpark(thread);
+		while (committed < target && System.nanoTime() < deadline) {
+			LockSupport.parkNanos(TimeUnit.MILLISECONDS.toNanos(1));
+		}
+	}
+
+	/**
+	 * @return The number of records dropped because the queue was full
+	 */
+	public long getDroppedCount() {
+		return dropped.get();
+	}
+
+	/* Only called by the consumer thread. */
+	private byte[] poll() {
+		Node next = head.next;
+
+		if (next == null) {
+			return null;
+		}
+		head = next;
+		pending.decrementAndGet();
+		return next.record;
+	}
+
+	private void commit(int nrRecords) {
+		if (batch.isEmpty()) {
+			return;
+		}
+		try {
+			committer.commit(batch.getBuffer(), batch.getLength());
+		} finally {
+			batch.clear();
+			committed += nrRecords;
+		}
+	}
+
+	private void drain() {
+		int nrRecords = 0;
+
+		for (;;) {
+			byte[] record = poll();
+
+			if (record == null) {
+				commit(nrRecords);
+				nrRecords = 0;
+				sleeping = true;
+				/* Recheck, an enqueue may have missed the flag. */
+				if (head.next == null) {
+					LockSupport.parkNanos(this, IDLE_PARK_NS);
+				}
+				sleeping = false;
+				continue;
+			}
+			if (!batch.putRecord(record)) {
+				commit(nrRecords);
+				nrRecords = 0;
+				if (!batch.putRecord(record)) {
+					/* Larger than a whole batch, should not happen. */
+					committed++;
+					continue;
+				}
+			}
+			nrRecords++;
+		}
+	}
+}
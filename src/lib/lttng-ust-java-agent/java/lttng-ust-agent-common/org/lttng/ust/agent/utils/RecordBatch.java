@@ -0,0 +1,233 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+package org.lttng.ust.agent.utils;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+
+/**
+ * Batch of log records encoded into a direct {@link ByteBuffer}, so that a
+ * whole batch can be committed to the tracer with a single JNI call, without
+ * converting each string through JNI.
+ *
+ * The values are encoded in native byte order. Each record starts with its
+ * length (4 bytes, including the length itself), followed by its fields, and
+ * is padded to a multiple of 8 bytes. The fields of a record are defined by
+ * each agent, and encoded with:
+ *
+ * <ul>
+ * <li>{@link #putInt}: a 4-byte integer</li>
+ * <li>{@link #putLong}: an 8-byte integer</li>
+ * <li>{@link #putString}: a UTF-8 C-string, ending with a "\0" byte</li>
+ * <li>{@link #putBytes}: the length of the byte array (4), then its
+ * bytes</li>
+ * </ul>
+ *
+ * This class is not thread-safe.
+ */
+public class RecordBatch {
+
+	/** Default capacity of a batch buffer, in bytes */
+	public static final int DEFAULT_CAPACITY = 64 * 1024;
+
+	private static final int RECORD_ALIGN = 8;
+	private static final Charset UTF8_CHARSET = Charset.forName("UTF-8");
+
+	private final ByteBuffer buffer;
+	private int recordStart = -1;
+	private boolean overflow = false;
+	private int count = 0;
+
+	/**
+	 * Constructor
+	 *
+	 * @param capacity
+	 *            Capacity of the batch buffer, in bytes
+	 */
+	public RecordBatch(int capacity) {
+		buffer = ByteBuffer.allocateDirect(capacity);
+		buffer.order(ByteOrder.nativeOrder());
+	}
+
+	/**
+	 * @return The direct buffer holding the encoded records, to pass through
+	 *         JNI along with {@link #getLength()}
+	 */
+	public ByteBuffer getBuffer() {
+		return buffer;
+	}
+
+	/**
+	 * @return The length of the encoded records, in bytes
+	 */
+	public int getLength() {
+		return buffer.position();
+	}
+
+	/**
+	 * @return The number of records in the batch
+	 */
+	public int getCount() {
+		return count;
+	}
+
+	/**
+	 * @return True if the batch holds no record
+	 */
+	public boolean isEmpty() {
+		return count == 0;
+	}
+
+	/**
+	 * Remove all the records from the batch, typically once committed.
+	 */
+	public void clear() {
+		buffer.clear();
+		recordStart = -1;
+		overflow = false;
+		count = 0;
+	}
+
+	/**
+	 * Start a new record. Its fields must then be encoded with the put
+	 * methods, and the record completed with {@link #endRecord()}.
+	 */
+	public void beginRecord() {
+		recordStart = buffer.position();
+		overflow = false;
+		putInt(0);
+	}
+
+	/**
+	 * Complete the current record.
+	 *
+	 * @return True if the record fits in the batch, false if it was dropped
+	 *         from the batch because it is full, in which case it must be
+	 *         encoded again once the batch is committed and cleared.
+	 */
+	public boolean endRecord() {
+		int start = recordStart;
+
+		recordStart = -1;
+		if (start < 0) {
+			return false;
+		}
+		int padded = (buffer.position() + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+		if (overflow || padded > buffer.limit()) {
+			buffer.position(start);
+			overflow = false;
+			return false;
+		}
+		buffer.putInt(start, padded - start);
+		while (buffer.position() < padded) {
+			buffer.put((byte) 0);
+		}
+		count++;
+		return true;
+	}
+
+	/**
+	 * @return A copy of the encoded records, to append to another batch with
+	 *         {@link #putRecord(byte[])}
+	 */
+	public byte[] toByteArray() {
+		byte[] bytes = new byte[buffer.position()];
+		ByteBuffer view = buffer.duplicate();
+
+		view.flip();
+		view.get(bytes);
+		return bytes;
+	}
+
+	/**
+	 * Append records already encoded by another batch.
+	 *
+	 * @param records
+	 *            The records, as returned by {@link #toByteArray()}
+	 * @return True if the records fit in the batch
+	 */
+	public boolean putRecord(byte[] records) {
+		if (recordStart >= 0 || records.length > buffer.remaining()) {
+			return false;
+		}
+		buffer.put(records);
+		count++;
+		return true;
+	}
+
+	/**
+	 * Encode a 4-byte integer field.
+	 *
+	 * @param value
+	 *            The value
+	 */
+	public void putInt(int value) {
+		if (!hasRoom(4)) {
+			return;
+		}
+		buffer.putInt(value);
+	}
+
+	/**
+	 * Encode an 8-byte integer field.
+	 *
+	 * @param value
+	 *            The value
+	 */
+	public void putLong(long value) {
+		if (!hasRoom(8)) {
+			return;
+		}
+		buffer.putLong(value);
+	}
+
+	/**
+	 * Encode a string field. A null string is encoded as an empty one.
+	 *
+	 * @param value
+	 *            The string
+	 */
+	public void putString(String value) {
+		byte[] bytes = (value == null ? new byte[0] : value.getBytes(UTF8_CHARSET));
+
+		if (!hasRoom(bytes.length + 1)) {
+			return;
+		}
+		buffer.put(bytes);
+		buffer.put((byte) 0);
+	}
+
+	/**
+	 * Encode a byte array field.
+	 *
+	 * @param value
+	 *            The byte array
+	 */
+	public void putBytes(byte[] value) {
+		if (!hasRoom(4 + value.length)) {
+			return;
+		}
+		buffer.putInt(value.length);
+		buffer.put(value);
+	}
+
+	/*
+	 * Once a field of the current record does not fit, the following ones
+	 * are skipped, and endRecord() drops the record.
+	 */
+	private boolean hasRoom(int length) {
+		if (recordStart < 0 || overflow) {
+			return false;
+		}
+		if (length > buffer.remaining()) {
+			overflow = true;
+			return false;
+		}
+		return true;
+	}
+}
@@ -7,6 +7,8 @@
 
 package org.lttng.ust.agent.jul;
 
+import java.nio.ByteBuffer;
+
 /**
  * Virtual class containing the Java side of the LTTng-JUL JNI API methods.
  *
@@ -33,4 +35,6 @@ final class LttngJulApi {
 			int thread_id,
 			byte[] contextEntries,
 			byte[] contextStrings);
+
+	static native void tracepointBatch(ByteBuffer buffer, int length);
 }
@@ -9,6 +9,7 @@
 package org.lttng.ust.agent.jul;
 
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.Collection;
 import java.util.Map;
 import java.util.Map.Entry;
@@ -20,6 +21,8 @@ import java.util.logging.LogRecord;
 import org.lttng.ust.agent.ILttngAgent;
 import org.lttng.ust.agent.ILttngHandler;
 import org.lttng.ust.agent.context.ContextInfoSerializer;
+import org.lttng.ust.agent.utils.AsyncRecordQueue;
+import org.lttng.ust.agent.utils.RecordBatch;
 
 /**
  * LTTng-UST JUL log handler.
@@ -49,6 +52,31 @@ public class LttngLogHandler extends Handler implements ILttngHandler {
 		}
 	};
 
+	/**
+	 * Per-thread batch the records are encoded into, so they can be sent
+	 * through JNI without converting each string
+	 */
+	private static final ThreadLocal<RecordBatch> BATCH = new ThreadLocal<RecordBatch>() {
+		@Override
+		protected RecordBatch initialValue() {
+			return new RecordBatch(RecordBatch.DEFAULT_CAPACITY);
+		}
+	};
+
+	/**
+	 * Queue of the records committed by another thread, when the
+	 * asynchronous mode is enabled
+	 */
+	private static final AsyncRecordQueue ASYNC = (!AsyncRecordQueue.isEnabled() ? null :
+		new AsyncRecordQueue("LTTng-UST JUL agent committer", new AsyncRecordQueue.Committer() {
+			@Override
+			public void commit(ByteBuffer buffer, int length) {
+				LttngJulApi.tracepointBatch(buffer, length);
+			}
+		}));
+
+	private static final long FLUSH_TIMEOUT_MS = 1000;
+
 	private final ILttngAgent<LttngLogHandler> agent;
 
 	/** Number of events logged (really sent through JNI) by this handler */
@@ -81,6 +109,7 @@ public class LttngLogHandler extends Handler implements ILttngHandler {
 
 	@Override
 	public synchronized void close() {
+		flush();
 		agent.unregisterHandler(this);
 	}
 
@@ -97,6 +126,9 @@ public class LttngLogHandler extends Handler implements ILttngHandler {
 
 	@Override
 	public void flush() {
+		if (ASYNC != null) {
+			ASYNC.flush(FLUSH_TIMEOUT_MS);
+		}
 	}
 
 	@Override
@@ -115,13 +147,36 @@ public class LttngLogHandler extends Handler implements ILttngHandler {
 		Collection<Entry<String, Map<String, Integer>>> enabledContexts = agent.getEnabledAppContexts();
 		ContextInfoSerializer.SerializedContexts contextInfo = ContextInfoSerializer.queryAndSerializeRequestedContexts(enabledContexts);
 
+		if (ASYNC != null && publishAsync(record, formattedMessage, contextInfo)) {
+			return;
+		}
+
 		eventCount.incrementAndGet();
 
 		/*
 		 * Specific tracepoint designed for JUL events. The source class of the
 		 * caller is used for the event name, the raw message is taken, the
-		 * loglevel of the record and the thread ID.
+		 * loglevel of the record and the thread ID. The context information
+		 * is only passed along when it could not be set as the snapshot of
+		 * the current thread.
 		 */
+		boolean snapshot = ContextInfoSerializer.pushContextSnapshot(contextInfo);
+		RecordBatch batch = BATCH.get();
+		if (encodeRecord(batch, record, formattedMessage, snapshot ? null : contextInfo)) {
+			LttngJulApi.tracepointBatch(batch.getBuffer(), batch.getLength());
+			batch.clear();
+			return;
+		}
+		if (snapshot) {
+			LttngJulApi.tracepoint(formattedMessage,
+					record.getLoggerName(),
+					record.getSourceClassName(),
+					record.getSourceMethodName(),
+					record.getMillis(),
+					record.getLevel().intValue(),
+					record.getThreadID());
+			return;
+		}
 		LttngJulApi.tracepointWithContext(formattedMessage,
 				record.getLoggerName(),
 				record.getSourceClassName(),
@@ -133,4 +188,61 @@ public class LttngLogHandler extends Handler implements ILttngHandler {
 				contextInfo.getStringsArray());
 	}
 
+	/*
+	 * Hand the record off to the committer thread, along with its context
+	 * information. Returns false if the record is too large for a batch,
+	 * to commit it synchronously instead.
+	 */
+	private boolean publishAsync(LogRecord record, String formattedMessage,
+			ContextInfoSerializer.SerializedContexts contextInfo) {
+		RecordBatch batch = BATCH.get();
+
+		if (!encodeRecord(batch, record, formattedMessage, contextInfo)) {
+			return false;
+		}
+		byte[] bytes = batch.toByteArray();
+		batch.clear();
+		if (ASYNC.enqueue(bytes)) {
+			eventCount.incrementAndGet();
+		}
+		return true;
+	}
+
+	/**
+	 * Encode a record into a batch, in the layout expected by the
+	 * tracepointBatch() JNI method.
+	 *
+	 * @param batch
+	 *            The batch
+	 * @param record
+	 *            The log record
+	 * @param formattedMessage
+	 *            The formatted message of the record
+	 * @param contextInfo
+	 *            The context information, or null to use the snapshot of the
+	 *            thread committing the batch
+	 * @return True if the record fits in the batch
+	 */
+	static boolean encodeRecord(RecordBatch batch, LogRecord record, String formattedMessage,
+			ContextInfoSerializer.SerializedContexts contextInfo) {
+		batch.beginRecord();
+		batch.putLong(record.getMillis());
+		batch.putInt(record.getLevel().intValue());
+		batch.putInt(record.getThreadID());
+		batch.putString(formattedMessage);
+		batch.putString(record.getLoggerName());
+		batch.putString(record.getSourceClassName());
+		batch.putString(record.getSourceMethodName());
+		if (contextInfo == null) {
+			batch.putBytes(NO_BYTES);
+			batch.putBytes(NO_BYTES);
+		} else {
+			batch.putBytes(contextInfo.getEntriesArray());
+			batch.putBytes(contextInfo.getStringsArray());
+		}
+		return batch.endRecord();
+	}
+
+	private static final byte[] NO_BYTES = new byte[0];
+
 }
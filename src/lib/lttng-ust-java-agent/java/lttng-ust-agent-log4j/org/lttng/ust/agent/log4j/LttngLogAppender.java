@@ -116,6 +116,22 @@ public class LttngLogAppender extends AppenderSkeleton implements ILttngHandler
 
 		eventCount.incrementAndGet();
 
+		/*
+		 * The context information is only passed along when it could not be
+		 * set as the snapshot of the current thread.
+		 */
+		if (ContextInfoSerializer.pushContextSnapshot(contextInfo)) {
+			LttngLog4jApi.tracepoint(event.getRenderedMessage(),
+					event.getLoggerName(),
+					event.getLocationInformation().getClassName(),
+					event.getLocationInformation().getMethodName(),
+					event.getLocationInformation().getFileName(),
+					line,
+					event.getTimeStamp(),
+					event.getLevel().toInt(),
+					event.getThreadName());
+			return;
+		}
 		LttngLog4jApi.tracepointWithContext(event.getRenderedMessage(),
 				event.getLoggerName(),
 				event.getLocationInformation().getClassName(),
@@ -7,6 +7,8 @@
 
 package org.lttng.ust.agent.log4j2;
 
+import java.nio.ByteBuffer;
+
 /**
  * Virtual class containing the Java side of the LTTng-log4j JNI API methods.
  */
@@ -15,7 +17,13 @@ final class LttngLog4j2Api {
 	private LttngLog4j2Api() {
 	}
 
+	static native void tracepoint(String message, String loggerName, String className, String methodName,
+			String fileName, int lineNumber, long timeStamp, int logLevel, String threadName,
+			boolean log4j1Compat);
+
 	static native void tracepointWithContext(String message, String loggerName, String className, String methodName,
 			String fileName, int lineNumber, long timeStamp, int logLevel, String threadName, byte[] contextEntries,
 			byte[] contextStrings, boolean log4j1Compat);
+
+	static native void tracepointBatch(ByteBuffer buffer, int length);
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 package org.lttng.ust.agent.log4j2;
 
 import java.io.IOException;
+import java.nio.ByteBuffer;
 import java.util.Collection;
 import java.util.Map;
 import java.util.Map.Entry;
@@ -29,6 +30,8 @@ import org.apache.logging.log4j.message.Message;
 import org.lttng.ust.agent.ILttngAgent.Domain;
 import org.lttng.ust.agent.ILttngHandler;
 import org.lttng.ust.agent.context.ContextInfoSerializer;
+import org.lttng.ust.agent.utils.AsyncRecordQueue;
+import org.lttng.ust.agent.utils.RecordBatch;
 
 /**
  * LTTng-UST Log4j 2.x log handler.
@@ -58,6 +61,33 @@ public final class LttngLogAppender extends AbstractAppender implements ILttngHa
 
 	private final LttngLog4j2Agent agent;
 
+	/**
+	 * Per-thread batch the events are encoded into, so they can be sent
+	 * through JNI without converting each string
+	 */
+	private static final ThreadLocal<RecordBatch> BATCH = new ThreadLocal<RecordBatch>() {
+		@Override
+		protected RecordBatch initialValue() {
+			return new RecordBatch(RecordBatch.DEFAULT_CAPACITY);
+		}
+	};
+
+	private static final byte[] NO_BYTES = new byte[0];
+
+	/**
+	 * Queue of the events committed by another thread, when the
+	 * asynchronous mode is enabled
+	 */
+	private static final AsyncRecordQueue ASYNC = (!AsyncRecordQueue.isEnabled() ? null :
+		new AsyncRecordQueue("LTTng-UST log4j2 agent committer", new AsyncRecordQueue.Committer() {
+			@Override
+			public void commit(ByteBuffer buffer, int length) {
+				LttngLog4j2Api.tracepointBatch(buffer, length);
+			}
+		}));
+
+	private static final long FLUSH_TIMEOUT_MS = 1000;
+
 	/**
 	 * Constructor
 	 *
@@ -163,6 +193,9 @@ public final class LttngLogAppender extends AbstractAppender implements ILttngHa
 
 	@Override
 	public synchronized void close() {
+		if (ASYNC != null) {
+			ASYNC.flush(FLUSH_TIMEOUT_MS);
+		}
 		agent.unregisterHandler(this);
 	}
 
@@ -237,10 +270,76 @@ public final class LttngLogAppender extends AbstractAppender implements ILttngHa
 		ContextInfoSerializer.SerializedContexts contextInfo = ContextInfoSerializer
 				.queryAndSerializeRequestedContexts(enabledContexts);
 
+		boolean log4j1Compat = agent.getDomain() == Domain.LOG4J;
+		RecordBatch batch = BATCH.get();
+
+		/*
+		 * In asynchronous mode, hand the event off to the committer thread
+		 * along with its context information, unless it is too large for a
+		 * batch.
+		 */
+		if (ASYNC != null && encodeEvent(batch, event, message, classname, methodname,
+				filename, line, log4j1Compat, contextInfo)) {
+			byte[] bytes = batch.toByteArray();
+			batch.clear();
+			if (ASYNC.enqueue(bytes)) {
+				eventCount.incrementAndGet();
+			}
+			return;
+		}
+
 		eventCount.incrementAndGet();
 
+		/*
+		 * The context information is only passed along when it could not be
+		 * set as the snapshot of the current thread.
+		 */
+		boolean snapshot = ContextInfoSerializer.pushContextSnapshot(contextInfo);
+
+		if (encodeEvent(batch, event, message, classname, methodname, filename, line,
+				log4j1Compat, snapshot ? null : contextInfo)) {
+			LttngLog4j2Api.tracepointBatch(batch.getBuffer(), batch.getLength());
+			batch.clear();
+			return;
+		}
+		if (snapshot) {
+			LttngLog4j2Api.tracepoint(message, loggername, classname, methodname, filename, line,
+					event.getTimeMillis(), event.getLevel().intLevel(), event.getThreadName(),
+					log4j1Compat);
+			return;
+		}
 		LttngLog4j2Api.tracepointWithContext(message, loggername, classname, methodname, filename, line,
 				event.getTimeMillis(), event.getLevel().intLevel(), event.getThreadName(),
-				contextInfo.getEntriesArray(), contextInfo.getStringsArray(), agent.getDomain() == Domain.LOG4J);
+				contextInfo.getEntriesArray(), contextInfo.getStringsArray(), log4j1Compat);
+	}
+
+	/**
+	 * Encode an event into a batch, in the layout expected by the
+	 * tracepointBatch() JNI method.
+	 *
+	 * @return True if the event fits in the batch
+	 */
+	static boolean encodeEvent(RecordBatch batch, LogEvent event, String message, String classname,
+			String methodname, String filename, int line, boolean log4j1Compat,
+			ContextInfoSerializer.SerializedContexts contextInfo) {
+		batch.beginRecord();
+		batch.putLong(event.getTimeMillis());
+		batch.putInt(event.getLevel().intLevel());
+		batch.putInt(line);
+		batch.putInt(log4j1Compat ? 1 : 0);
+		batch.putString(message);
+		batch.putString(event.getLoggerName());
+		batch.putString(classname);
+		batch.putString(methodname);
+		batch.putString(filename);
+		batch.putString(event.getThreadName());
+		if (contextInfo == null) {
+			batch.putBytes(NO_BYTES);
+			batch.putBytes(NO_BYTES);
+		} else {
+			batch.putBytes(contextInfo.getEntriesArray());
+			batch.putBytes(contextInfo.getStringsArray());
+		}
+		return batch.endRecord();
 	}
 }
@@ -8,6 +8,8 @@
 
 #include "org_lttng_ust_agent_context_LttngContextApi.h"
 
+#include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
 #include <lttng/ust-events.h>
@@ -53,24 +55,67 @@ struct lttng_ust_jni_provider {
 /* TLS passing context info from JNI to callbacks. */
 __thread struct lttng_ust_jni_tls lttng_ust_context_info_tls;
 
-static const char *get_ctx_string_at_offset(int32_t offset)
+/*
+ * Per-thread snapshot of the context info, pushed by the agent when the
+ * values change rather than passed along with each log call. The
+ * buffers are owned by the snapshot, and freed on thread exit by the
+ * destructor of snapshot_key.
+ */
+static __thread struct lttng_ust_jni_tls lttng_ust_context_snapshot_tls;
+
+static pthread_key_t snapshot_key;
+static pthread_once_t snapshot_key_once = PTHREAD_ONCE_INIT;
+static int snapshot_key_error;
+
+static void snapshot_free(struct lttng_ust_jni_tls *snapshot)
+{
+	free(snapshot->ctx_entries);
+	free(snapshot->ctx_strings);
+	memset(snapshot, 0, sizeof(*snapshot));
+}
+
+static void snapshot_key_destroy(void *arg)
+{
+	snapshot_free((struct lttng_ust_jni_tls *) arg);
+}
+
+static void snapshot_key_create(void)
 {
-	signed char *ctx_strings_array = lttng_ust_context_info_tls.ctx_strings;
+	if (pthread_key_create(&snapshot_key, snapshot_key_destroy))
+		snapshot_key_error = 1;
+}
 
-	if (offset < 0 || offset >= lttng_ust_context_info_tls.ctx_strings_len) {
+/*
+ * Context info passed along with the current log call, if any, otherwise
+ * the snapshot of the current thread.
+ */
+static const struct lttng_ust_jni_tls *get_ctx_info(void)
+{
+	if (lttng_ust_context_info_tls.ctx_entries)
+		return &lttng_ust_context_info_tls;
+	return &lttng_ust_context_snapshot_tls;
+}
+
+static const char *get_ctx_string_at_offset(const struct lttng_ust_jni_tls *info,
+		int32_t offset)
+{
+	signed char *ctx_strings_array = info->ctx_strings;
+
+	if (offset < 0 || offset >= info->ctx_strings_len) {
 		return NULL;
 	}
 	return (const char *) (ctx_strings_array + offset);
 }
 
-static struct lttng_ust_jni_ctx_entry *lookup_ctx_by_name(const char *ctx_name)
+static struct lttng_ust_jni_ctx_entry *lookup_ctx_by_name(const struct lttng_ust_jni_tls *info,
+		const char *ctx_name)
 {
-	struct lttng_ust_jni_ctx_entry *ctx_entries_array = lttng_ust_context_info_tls.ctx_entries;
-	int i, len = lttng_ust_context_info_tls.ctx_entries_len / sizeof(struct lttng_ust_jni_ctx_entry);
+	struct lttng_ust_jni_ctx_entry *ctx_entries_array = info->ctx_entries;
+	int i, len = info->ctx_entries_len / sizeof(struct lttng_ust_jni_ctx_entry);
 
 	for (i = 0; i < len; i++) {
 		int32_t offset = ctx_entries_array[i].context_name_offset;
-		const char *string = get_ctx_string_at_offset(offset);
+		const char *string = get_ctx_string_at_offset(info, offset);
 
 		if (string && strcmp(string, ctx_name) == 0) {
 			return &ctx_entries_array[i];
@@ -84,13 +129,14 @@ static size_t get_size_cb(void *priv, struct lttng_ust_probe_ctx *probe_ctx __at
 {
 	const struct lttng_ust_app_context *app_ctx = (const struct lttng_ust_app_context *) priv;
 	const char *ctx_name = app_ctx->ctx_name;
+	const struct lttng_ust_jni_tls *info = get_ctx_info();
 	struct lttng_ust_jni_ctx_entry *jctx;
 	size_t size = 0;
 	enum lttng_ust_jni_type jni_type;
 
 	size += lttng_ust_ring_buffer_align(offset, lttng_ust_rb_alignof(char));
 	size += sizeof(char);		/* tag */
-	jctx = lookup_ctx_by_name(ctx_name);
+	jctx = lookup_ctx_by_name(info, ctx_name);
 	if (!jctx) {
 		jni_type = JNI_TYPE_NULL;
 	} else {
@@ -128,7 +174,7 @@ static size_t get_size_cb(void *priv, struct lttng_ust_probe_ctx *probe_ctx __at
 	{
 		/* The value is an offset, the string is in the "strings" array */
 		int32_t string_offset = jctx->value._string_offset;
-		const char *string = get_ctx_string_at_offset(string_offset);
+		const char *string = get_ctx_string_at_offset(info, string_offset);
 
 		if (string) {
 			size += strlen(string) + 1;
@@ -149,11 +195,12 @@ static void record_cb(void *priv,
 {
 	const struct lttng_ust_app_context *app_ctx = (const struct lttng_ust_app_context *) priv;
 	const char *ctx_name = app_ctx->ctx_name;
+	const struct lttng_ust_jni_tls *info = get_ctx_info();
 	struct lttng_ust_jni_ctx_entry *jctx;
 	enum lttng_ust_jni_type jni_type;
 	char sel_char;
 
-	jctx = lookup_ctx_by_name(ctx_name);
+	jctx = lookup_ctx_by_name(info, ctx_name);
 	if (!jctx) {
 		jni_type = JNI_TYPE_NULL;
 	} else {
@@ -231,7 +278,7 @@ static void record_cb(void *priv,
 	case JNI_TYPE_STRING:
 	{
 			int32_t offset = jctx->value._string_offset;
-			const char *str = get_ctx_string_at_offset(offset);
+			const char *str = get_ctx_string_at_offset(info, offset);
 
 			if (str) {
 				sel_char = LTTNG_UST_DYNAMIC_TYPE_STRING;
@@ -254,10 +301,11 @@ static void get_value_cb(void *priv, struct lttng_ust_probe_ctx *probe_ctx __att
 {
 	const struct lttng_ust_app_context *app_ctx = (const struct lttng_ust_app_context *) priv;
 	const char *ctx_name = app_ctx->ctx_name;
+	const struct lttng_ust_jni_tls *info = get_ctx_info();
 	struct lttng_ust_jni_ctx_entry *jctx;
 	enum lttng_ust_jni_type jni_type;
 
-	jctx = lookup_ctx_by_name(ctx_name);
+	jctx = lookup_ctx_by_name(info, ctx_name);
 	if (!jctx) {
 		jni_type = JNI_TYPE_NULL;
 	} else {
@@ -299,7 +347,7 @@ static void get_value_cb(void *priv, struct lttng_ust_probe_ctx *probe_ctx __att
 	case JNI_TYPE_STRING:
 	{
 		int32_t offset = jctx->value._string_offset;
-		const char *str = get_ctx_string_at_offset(offset);
+		const char *str = get_ctx_string_at_offset(info, offset);
 
 		if (str) {
 			value->sel = LTTNG_UST_DYNAMIC_TYPE_STRING;
@@ -314,6 +362,83 @@ static void get_value_cb(void *priv, struct lttng_ust_probe_ctx *probe_ctx __att
 	}
 }
 
+/*
+ * Copy a Java byte array into a newly allocated buffer. An empty array
+ * yields a NULL buffer.
+ */
+static int copy_byte_array(JNIEnv *env, jbyteArray array, signed char **buf, int32_t *len)
+{
+	jsize array_len = (*env)->GetArrayLength(env, array);
+
+	*buf = NULL;
+	*len = 0;
+	if (!array_len) {
+		return 0;
+	}
+	*buf = malloc(array_len);
+	if (!*buf) {
+		return -1;
+	}
+	(*env)->GetByteArrayRegion(env, array, 0, array_len, (jbyte *) *buf);
+	*len = array_len;
+	return 0;
+}
+
+/*
+ * Set the context info snapshot of the current thread.
+ *
+ * Called from the Java side when the context values of the current thread
+ * change. Log calls made without context info afterwards record the
+ * values from this snapshot, without passing them through JNI each time.
+ * Returns JNI_FALSE if the snapshot could not be set, in which case the
+ * previous one is kept.
+ */
+JNIEXPORT jboolean JNICALL Java_org_lttng_ust_agent_context_LttngContextApi_setContextSnapshot(JNIEnv *env,
+						jobject jobj __attribute__((unused)),
+						jbyteArray context_info_entries,
+						jbyteArray context_info_strings)
+{
+	struct lttng_ust_jni_tls *snapshot = &lttng_ust_context_snapshot_tls;
+	struct lttng_ust_jni_tls new_snapshot;
+
+	if (pthread_once(&snapshot_key_once, snapshot_key_create) || snapshot_key_error) {
+		goto error_key;
+	}
+	/* Free the snapshot on thread exit. */
+	if (pthread_setspecific(snapshot_key, snapshot)) {
+		goto error_key;
+	}
+	if (copy_byte_array(env, context_info_entries,
+			(signed char **) &new_snapshot.ctx_entries,
+			&new_snapshot.ctx_entries_len)) {
+		goto error_entries;
+	}
+	if (copy_byte_array(env, context_info_strings,
+			&new_snapshot.ctx_strings,
+			&new_snapshot.ctx_strings_len)) {
+		goto error_strings;
+	}
+	snapshot_free(snapshot);
+	*snapshot = new_snapshot;
+	return JNI_TRUE;
+
+	/* Error handling. */
+error_strings:
+	free(new_snapshot.ctx_entries);
+error_entries:
+error_key:
+	return JNI_FALSE;
+}
+
+/*
+ * Clear the context info snapshot of the current thread.
+ */
+JNIEXPORT void JNICALL Java_org_lttng_ust_agent_context_LttngContextApi_clearContextSnapshot(JNIEnv *env __attribute__((unused)),
+						jobject jobj __attribute__((unused)))
+{
+	snapshot_free(&lttng_ust_context_snapshot_tls);
+}
+
 /*
  * Register a context provider to UST.
  *
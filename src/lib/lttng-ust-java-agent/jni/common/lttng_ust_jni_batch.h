@@ -0,0 +1,148 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef LIBLTTNG_UST_JAVA_AGENT_JNI_COMMON_LTTNG_UST_JNI_BATCH_H_
+#define LIBLTTNG_UST_JAVA_AGENT_JNI_COMMON_LTTNG_UST_JNI_BATCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lttng_ust_context.h"
+
+/*
+ * Reader of the log record batches encoded by the Java class
+ * org.lttng.ust.agent.utils.RecordBatch, in native byte order. Each
+ * record starts with its padded length, including the length itself.
+ *
+ * A read past the end of the record sets the error flag and returns a
+ * default value, so the fields can be read in a row and the record
+ * skipped once they are all read.
+ */
+struct lttng_ust_jni_batch_reader {
+	const char *pos;
+	const char *end;
+	bool error;
+};
+
+static inline
+void lttng_ust_jni_batch_init(struct lttng_ust_jni_batch_reader *batch,
+		const void *buf, size_t len)
+{
+	batch->pos = (const char *) buf;
+	batch->end = batch->pos + len;
+	batch->error = false;
+}
+
+/* Returns false once all the records are read. */
+static inline
+bool lttng_ust_jni_batch_next(struct lttng_ust_jni_batch_reader *batch,
+		struct lttng_ust_jni_batch_reader *record)
+{
+	int32_t len;
+
+	if ((size_t) (batch->end - batch->pos) < sizeof(len))
+		return false;
+	memcpy(&len, batch->pos, sizeof(len));
+	if (len < (int32_t) sizeof(len) || len > batch->end - batch->pos)
+		return false;
+	record->pos = batch->pos + sizeof(len);
+	record->end = batch->pos + len;
+	record->error = false;
+	batch->pos += len;
+	return true;
+}
+
+static inline
+int32_t lttng_ust_jni_batch_read_int(struct lttng_ust_jni_batch_reader *record)
+{
+	int32_t v = 0;
+
+	if ((size_t) (record->end - record->pos) < sizeof(v)) {
+		record->error = true;
+		return 0;
+	}
+	memcpy(&v, record->pos, sizeof(v));
+	record->pos += sizeof(v);
+	return v;
+}
+
+static inline
+int64_t lttng_ust_jni_batch_read_long(struct lttng_ust_jni_batch_reader *record)
+{
+	int64_t v = 0;
+
+	if ((size_t) (record->end - record->pos) < sizeof(v)) {
+		record->error = true;
+		return 0;
+	}
+	memcpy(&v, record->pos, sizeof(v));
+	record->pos += sizeof(v);
+	return v;
+}
+
+static inline
+const char *lttng_ust_jni_batch_read_string(struct lttng_ust_jni_batch_reader *record)
+{
+	const char *str = record->pos, *nul;
+
+	nul = (const char *) memchr(str, '\0', record->end - record->pos);
+	if (!nul) {
+		record->error = true;
+		return "";
+	}
+	record->pos = nul + 1;
+	return str;
+}
+
+static inline
+const char *lttng_ust_jni_batch_read_bytes(struct lttng_ust_jni_batch_reader *record,
+		int32_t *len)
+{
+	const char *bytes;
+
+	*len = lttng_ust_jni_batch_read_int(record);
+	if (record->error || *len < 0 || *len > record->end - record->pos) {
+		record->error = true;
+		*len = 0;
+		return NULL;
+	}
+	bytes = record->pos;
+	record->pos += *len;
+	return bytes;
+}
+
+/*
+ * Read the context info of a record into the TLS variables used by the
+ * UST callbacks in lttng_ust_context.c. Empty context info leaves the
+ * snapshot of the current thread in use.
+ */
+static inline
+void lttng_ust_jni_batch_read_context(struct lttng_ust_jni_batch_reader *record)
+{
+	const char *entries, *strings;
+	int32_t entries_len, strings_len;
+
+	entries = lttng_ust_jni_batch_read_bytes(record, &entries_len);
+	strings = lttng_ust_jni_batch_read_bytes(record, &strings_len);
+	if (record->error || !entries_len)
+		return;
+	lttng_ust_context_info_tls.ctx_entries = (struct lttng_ust_jni_ctx_entry *) entries;
+	lttng_ust_context_info_tls.ctx_entries_len = entries_len;
+	lttng_ust_context_info_tls.ctx_strings = (signed char *) strings;
+	lttng_ust_context_info_tls.ctx_strings_len = strings_len;
+}
+
+static inline
+void lttng_ust_jni_batch_clear_context(void)
+{
+	lttng_ust_context_info_tls.ctx_entries = NULL;
+	lttng_ust_context_info_tls.ctx_entries_len = 0;
+	lttng_ust_context_info_tls.ctx_strings = NULL;
+	lttng_ust_context_info_tls.ctx_strings_len = 0;
+}
+
+#endif /* LIBLTTNG_UST_JAVA_AGENT_JNI_COMMON_LTTNG_UST_JNI_BATCH_H_ */
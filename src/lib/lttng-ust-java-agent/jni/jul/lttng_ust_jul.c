@@ -16,6 +16,7 @@
 #define LTTNG_UST_TRACEPOINT_CREATE_PROBES
 #include "lttng_ust_jul.h"
 #include "../common/lttng_ust_context.h"
+#include "../common/lttng_ust_jni_batch.h"
 
 /*
  * Deprecated function from before the context information was passed.
@@ -93,3 +94,39 @@ JNIEXPORT void JNICALL Java_org_lttng_ust_agent_jul_LttngJulApi_tracepointWithCo
 	(*env)->ReleaseByteArrayElements(env, context_info_entries, context_info_entries_array, 0);
 	(*env)->ReleaseByteArrayElements(env, context_info_strings, context_info_strings_array, 0);
 }
+
+/*
+ * Commit a batch of log records encoded by the JUL handler into a
+ * direct buffer, see org.lttng.ust.agent.utils.RecordBatch. Each record
+ * holds the millis, log level and thread ID, the message, logger name,
+ * class name and method name strings, then the context info entries and
+ * strings arrays.
+ */
+JNIEXPORT void JNICALL Java_org_lttng_ust_agent_jul_LttngJulApi_tracepointBatch(JNIEnv *env,
+						jobject jobj __attribute__((unused)),
+						jobject buffer,
+						jint length)
+{
+	struct lttng_ust_jni_batch_reader batch, record;
+	void *buf = (*env)->GetDirectBufferAddress(env, buffer);
+	jlong capacity = (*env)->GetDirectBufferCapacity(env, buffer);
+
+	if (!buf || length < 0 || length > capacity)
+		return;
+	lttng_ust_jni_batch_init(&batch, buf, length);
+	while (lttng_ust_jni_batch_next(&batch, &record)) {
+		jlong millis = lttng_ust_jni_batch_read_long(&record);
+		jint log_level = lttng_ust_jni_batch_read_int(&record);
+		jint thread_id = lttng_ust_jni_batch_read_int(&record);
+		const char *msg_cstr = lttng_ust_jni_batch_read_string(&record);
+		const char *logger_name_cstr = lttng_ust_jni_batch_read_string(&record);
+		const char *class_name_cstr = lttng_ust_jni_batch_read_string(&record);
+		const char *method_name_cstr = lttng_ust_jni_batch_read_string(&record);
+
+		lttng_ust_jni_batch_read_context(&record);
+		if (!record.error)
+			lttng_ust_tracepoint(lttng_jul, event, msg_cstr, logger_name_cstr,
+					class_name_cstr, method_name_cstr, millis, log_level, thread_id);
+		lttng_ust_jni_batch_clear_context();
+	}
+}
@@ -11,6 +11,7 @@
 #include "lttng_ust_log4j_tp.h"
 #include "lttng_ust_log4j2_tp.h"
 #include "../common/lttng_ust_context.h"
+#include "../common/lttng_ust_jni_batch.h"
 
 /*
  * Those are an exact map from the class org.apache.log4j.Level.
@@ -95,6 +96,55 @@ static jint loglevel_2x_to_1x(jint loglevel)
 	}
 }
 
+/*
+ * Tracepoint used by Java applications using the log4j 2.x handler, when
+ * the context info is the snapshot of the current thread.
+ */
+JNIEXPORT void JNICALL Java_org_lttng_ust_agent_log4j2_LttngLog4j2Api_tracepoint(JNIEnv *env,
+						jobject jobj __attribute__((unused)),
+						jstring message,
+						jstring loggerName,
+						jstring className,
+						jstring methodName,
+						jstring fileName,
+						jint lineNumber,
+						jlong timeStamp,
+						jint logLevel,
+						jstring threadName,
+						jboolean log4j1Compat)
+{
+	jboolean iscopy;
+	const char *msg_cstr = (*env)->GetStringUTFChars(env, message, &iscopy);
+	const char *logger_name_cstr = (*env)->GetStringUTFChars(env, loggerName, &iscopy);
+	const char *class_name_cstr = (*env)->GetStringUTFChars(env, className, &iscopy);
+	const char *method_name_cstr = (*env)->GetStringUTFChars(env, methodName, &iscopy);
+	const char *file_name_cstr = (*env)->GetStringUTFChars(env, fileName, &iscopy);
+	const char *thread_name_cstr = (*env)->GetStringUTFChars(env, threadName, &iscopy);
+
+	if (log4j1Compat) {
+		/*
+		 * Log4j 1.x compatible tracepoint with loglevel conversion.
+		 */
+		lttng_ust_tracepoint(lttng_log4j, event, msg_cstr, logger_name_cstr,
+			   class_name_cstr, method_name_cstr, file_name_cstr,
+			   lineNumber, timeStamp, loglevel_2x_to_1x(logLevel), thread_name_cstr);
+	} else {
+		/*
+		 * Log4j 2.x tracepoint with native loglevel.
+		 */
+		lttng_ust_tracepoint(lttng_log4j2, event, msg_cstr, logger_name_cstr,
+			   class_name_cstr, method_name_cstr, file_name_cstr,
+			   lineNumber, timeStamp, logLevel, thread_name_cstr);
+	}
+
+	(*env)->ReleaseStringUTFChars(env, message, msg_cstr);
+	(*env)->ReleaseStringUTFChars(env, loggerName, logger_name_cstr);
+	(*env)->ReleaseStringUTFChars(env, className, class_name_cstr);
+	(*env)->ReleaseStringUTFChars(env, methodName, method_name_cstr);
+	(*env)->ReleaseStringUTFChars(env, fileName, file_name_cstr);
+	(*env)->ReleaseStringUTFChars(env, threadName, thread_name_cstr);
+}
+
 /*
  * Tracepoint used by Java applications using the log4j 2.x handler.
  */
@@ -163,3 +213,51 @@ JNIEXPORT void JNICALL Java_org_lttng_ust_agent_log4j2_LttngLog4j2Api_tracepoint
 	(*env)->ReleaseByteArrayElements(env, context_info_entries, context_info_entries_array, 0);
 	(*env)->ReleaseByteArrayElements(env, context_info_strings, context_info_strings_array, 0);
 }
+
+/*
+ * Commit a batch of log events encoded by the log4j 2.x appender into a
+ * direct buffer, see org.lttng.ust.agent.utils.RecordBatch. Each record
+ * holds the timestamp, log level, line number and log4j 1.x
+ * compatibility flag, the message, logger name, class name, method
+ * name, file name and thread name strings, then the context info
+ * entries and strings arrays.
+ */
+JNIEXPORT void JNICALL Java_org_lttng_ust_agent_log4j2_LttngLog4j2Api_tracepointBatch(JNIEnv *env,
+						jobject jobj __attribute__((unused)),
+						jobject buffer,
+						jint length)
+{
+	struct lttng_ust_jni_batch_reader batch, record;
+	void *buf = (*env)->GetDirectBufferAddress(env, buffer);
+	jlong capacity = (*env)->GetDirectBufferCapacity(env, buffer);
+
+	if (!buf || length < 0 || length > capacity)
+		return;
+	lttng_ust_jni_batch_init(&batch, buf, length);
+	while (lttng_ust_jni_batch_next(&batch, &record)) {
+		jlong timestamp = lttng_ust_jni_batch_read_long(&record);
+		jint log_level = lttng_ust_jni_batch_read_int(&record);
+		jint line_number = lttng_ust_jni_batch_read_int(&record);
+		jint log4j1_compat = lttng_ust_jni_batch_read_int(&record);
+		const char *msg_cstr = lttng_ust_jni_batch_read_string(&record);
+		const char *logger_name_cstr = lttng_ust_jni_batch_read_string(&record);
+		const char *class_name_cstr = lttng_ust_jni_batch_read_string(&record);
+		const char *method_name_cstr = lttng_ust_jni_batch_read_string(&record);
+		const char *file_name_cstr = lttng_ust_jni_batch_read_string(&record);
+		const char *thread_name_cstr = lttng_ust_jni_batch_read_string(&record);
+
+		lttng_ust_jni_batch_read_context(&record);
+		if (record.error) {
+			/* Malformed record, skip it. */
+		} else if (log4j1_compat) {
+			lttng_ust_tracepoint(lttng_log4j, event, msg_cstr, logger_name_cstr,
+				   class_name_cstr, method_name_cstr, file_name_cstr,
+				   line_number, timestamp, loglevel_2x_to_1x(log_level), thread_name_cstr);
+		} else {
+			lttng_ust_tracepoint(lttng_log4j2, event, msg_cstr, logger_name_cstr,
+				   class_name_cstr, method_name_cstr, file_name_cstr,
+				   line_number, timestamp, log_level, thread_name_cstr);
+		}
+		lttng_ust_jni_batch_clear_context();
+	}
+}
@@ -15,9 +15,17 @@
 #include <common/compat/dlfcn.h>
 
 #include <sys/types.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <malloc.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
 
 #include <urcu/system.h>
 #include <urcu/uatomic.h>
@@ -29,6 +37,9 @@
 
 #include "common/macros.h"
 #include "common/align.h"
+#include "common/getenv.h"
+#include "common/counter/counter.h"
+#include "common/counter/counter-api.h"
 
 #define LTTNG_UST_TRACEPOINT_HIDDEN_DEFINITION
 #define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
@@ -54,6 +65,80 @@ struct alloc_functions {
 static
 struct alloc_functions cur_alloc;
 
+/*
+ * Allocation sampling, enabled by LTTNG_UST_MALLOC_SAMPLE_BYTES. Each
+ * thread samples one allocation every sample_bytes allocated bytes on
+ * average, with exponentially distributed intervals, so that each byte
+ * has the same probability of being sampled (Poisson sampling). Only
+ * sampled allocations are traced, and only the frees, and reallocs, of
+ * sampled pointers.
+ */
+static
+unsigned long sample_bytes;
+
+struct malloc_sample_state {
+	unsigned long bytes_left;	/* Until the next sampled allocation. */
+	uint64_t rand;			/* 0 until the first allocation. */
+};
+
+/*
+ * Sampled pointers which were not freed yet, shared by all threads since
+ * memory can be freed by another thread than the one which allocated it.
+ * A pointer hashes to a window of one cache line of slots, which is
+ * entirely scanned by lookups, so slots can simply be cleared on
+ * removal. A sampled allocation whose window is full is not traced.
+ */
+#define SAMPLED_SET_ORDER	12
+#define SAMPLED_SET_SIZE	(1UL << SAMPLED_SET_ORDER)
+#define SAMPLED_SET_WINDOW	(CAA_CACHE_LINE_SIZE / sizeof(void *))
+
+static
+void *sampled_set[SAMPLED_SET_SIZE]
+	__attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static
+unsigned long sampled_set_count;
+
+/*
+ * Allocation aggregation, enabled by LTTNG_UST_MALLOC_AGGREGATE_PERIOD.
+ * Instead of tracing each call, the number of calls and of bytes are
+ * accumulated per call site into per-cpu counters, and the totals of
+ * all call sites are traced periodically by a dump thread. Call sites
+ * are inserted in an open addressing table and never removed. The
+ * calls from sites which do not fit are accumulated in an additional
+ * element.
+ */
+#define ALLOC_SITES_ORDER	10
+#define NR_ALLOC_SITES		(1UL << ALLOC_SITES_ORDER)
+#define ALLOC_SITES_PROBES	16
+
+enum alloc_site_counter {
+	ALLOC_SITE_CALLS,
+	ALLOC_SITE_BYTES,
+	NR_ALLOC_SITE_COUNTERS,
+};
+
+static const struct lib_counter_config alloc_site_counter_config = {
+	.alloc = COUNTER_ALLOC_PER_CPU,
+	.sync = COUNTER_SYNC_PER_CPU,
+	.arithmetic = COUNTER_ARITHMETIC_MODULAR,
+#if CAA_BITS_PER_LONG == 64
+	.counter_size = COUNTER_SIZE_64_BIT,
+#else
+	.counter_size = COUNTER_SIZE_32_BIT,
+#endif
+};
+
+static
+void *alloc_site_ips[NR_ALLOC_SITES];
+
+static
+struct lib_counter *alloc_sites;
+
+/* Dump period, in milliseconds. */
+static
+unsigned long alloc_site_period;
+
 /*
  * Make sure our own use of the LTS compat layer will not cause infinite
  * recursion by calling calloc.
@@ -100,6 +185,7 @@ void ust_malloc_spin_unlock(pthread_mutex_t *lock __attribute__((unused)))
 #define pthread_mutex_lock ust_malloc_spin_lock
 #define pthread_mutex_unlock ust_malloc_spin_unlock
 static DEFINE_URCU_TLS(int, malloc_nesting);
+static DEFINE_URCU_TLS(struct malloc_sample_state, malloc_sample_state);
 #undef pthread_mutex_unlock
 #undef pthread_mutex_lock
 #undef calloc
@@ -257,6 +343,166 @@ void lookup_all_symbols(void)
 	memcpy(&cur_alloc, &af, sizeof(cur_alloc));
 }
 
+static
+void **sampled_set_window(const void *ptr)
+{
+	uint64_t hash = (uint64_t) (uintptr_t) ptr * 0x9E3779B97F4A7C15ULL;
+
+	return &sampled_set[(hash >> (64 - SAMPLED_SET_ORDER)) & ~(SAMPLED_SET_WINDOW - 1)];
+}
+
+static
+bool sampled_set_add(void *ptr)
+{
+	void **window = sampled_set_window(ptr);
+	unsigned int i;
+
+	for (i = 0; i < SAMPLED_SET_WINDOW; i++) {
+		if (!CMM_LOAD_SHARED(window[i])
+				&& uatomic_cmpxchg(&window[i], NULL, ptr) == NULL) {
+			uatomic_inc(&sampled_set_count);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Must be called before the memory is released to the allocator,
+ * which may return the same address to another thread.
+ */
+static
+bool sampled_set_remove(void *ptr)
+{
+	void **window;
+	unsigned int i;
+
+	if (caa_likely(!uatomic_read(&sampled_set_count)))
+		return false;
+	window = sampled_set_window(ptr);
+	for (i = 0; i < SAMPLED_SET_WINDOW; i++) {
+		if (CMM_LOAD_SHARED(window[i]) == ptr
+				&& uatomic_cmpxchg(&window[i], ptr, NULL) == ptr) {
+			uatomic_dec(&sampled_set_count);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Draw the number of bytes until the next sampled allocation from an
+ * exponential distribution of mean sample_bytes. log2() of the uniform
+ * variable is approximated with a quadratic between powers of two,
+ * which is accurate enough for sampling and avoids depending on libm.
+ */
+static
+unsigned long sample_next_interval(struct malloc_sample_state *state)
+{
+	uint64_t x = state->rand;
+	uint32_t r;
+	unsigned int e;
+	double f, log2_r;
+
+	/* xorshift64* */
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	state->rand = x;
+	r = (uint32_t) ((x * 0x2545F4914F6CDD1DULL) >> 32);
+	if (!r)
+		r = 1;
+	e = 31 - __builtin_clz(r);
+	f = (double) (r - (1U << e)) / (double) (1U << e);
+	log2_r = e + f * (1.3466 - 0.3466 * f);
+	return (unsigned long) ((32.0 - log2_r) * 0.6931471805599453
+			* (double) sample_bytes) + 1;
+}
+
+/*
+ * Return whether the allocation of @size bytes by the current thread is
+ * sampled.
+ */
+static
+bool sample_alloc(size_t size)
+{
+	struct malloc_sample_state *state = &URCU_TLS(malloc_sample_state);
+
+	if (caa_likely(size < state->bytes_left)) {
+		state->bytes_left -= size;
+		return false;
+	}
+	if (caa_unlikely(!state->rand)) {
+		state->rand = ((uint64_t) (uintptr_t) state * 0x9E3779B97F4A7C15ULL)
+			^ (uint64_t) time(NULL);
+		if (!state->rand)
+			state->rand = 1;
+		state->bytes_left = sample_next_interval(state);
+		return sample_alloc(size);
+	}
+	state->bytes_left = sample_next_interval(state);
+	return true;
+}
+
+/*
+ * Return whether an allocation returning @ptr is traced, and track @ptr
+ * if it is sampled. Only called when the allocation event is enabled,
+ * so that no pointer is tracked while tracing is inactive.
+ */
+static
+bool trace_alloc(void *ptr, size_t size)
+{
+	if (caa_likely(!sample_bytes))
+		return true;
+	if (caa_likely(!sample_alloc(size)))
+		return false;
+	return !ptr || sampled_set_add(ptr);
+}
+
+/*
+ * Return whether the free of @ptr is traced, which stops tracking it.
+ */
+static
+bool trace_free(void *ptr)
+{
+	if (caa_likely(!sample_bytes))
+		return true;
+	return ptr && sampled_set_remove(ptr);
+}
+
+static
+size_t alloc_site_index(void *ip)
+{
+	uint64_t hash = (uint64_t) (uintptr_t) ip * 0x9E3779B97F4A7C15ULL;
+	unsigned int i;
+
+	for (i = 0; i < ALLOC_SITES_PROBES; i++) {
+		size_t index = ((hash >> (64 - ALLOC_SITES_ORDER)) + i) & (NR_ALLOC_SITES - 1);
+		void *site = CMM_LOAD_SHARED(alloc_site_ips[index]);
+
+		if (site == ip)
+			return index;
+		if (!site) {
+			site = uatomic_cmpxchg(&alloc_site_ips[index], NULL, ip);
+			if (!site || site == ip)
+				return index;
+		}
+	}
+	return NR_ALLOC_SITES;
+}
+
+static
+void alloc_site_add(void *ip, size_t size)
+{
+	size_t indexes[2];
+
+	indexes[0] = ip ? alloc_site_index(ip) : NR_ALLOC_SITES;
+	indexes[1] = ALLOC_SITE_CALLS;
+	(void) lttng_counter_inc(&alloc_site_counter_config, alloc_sites, indexes);
+	indexes[1] = ALLOC_SITE_BYTES;
+	(void) lttng_counter_add(&alloc_site_counter_config, alloc_sites, indexes, size);
+}
+
 void *malloc(size_t size)
 {
 	void *retval;
@@ -271,8 +517,12 @@ void *malloc(size_t size)
 	}
 	retval = cur_alloc.malloc(size);
 	if (URCU_TLS(malloc_nesting) == 1) {
-		lttng_ust_tracepoint(lttng_ust_libc, malloc,
-			size, retval, LTTNG_UST_CALLER_IP());
+		if (caa_unlikely(alloc_sites))
+			alloc_site_add(LTTNG_UST_CALLER_IP(), size);
+		else if (lttng_ust_tracepoint_enabled(lttng_ust_libc, malloc)
+				&& trace_alloc(retval, size))
+			lttng_ust_tracepoint(lttng_ust_libc, malloc,
+				size, retval, LTTNG_UST_CALLER_IP());
 	}
 	URCU_TLS(malloc_nesting)--;
 	return retval;
@@ -291,8 +541,15 @@ void free(void *ptr)
 	}
 
 	if (URCU_TLS(malloc_nesting) == 1) {
-		lttng_ust_tracepoint(lttng_ust_libc, free,
-			ptr, LTTNG_UST_CALLER_IP());
+		if (caa_unlikely(alloc_sites)) {
+			/* The freed bytes include the allocator slack. */
+			if (ptr)
+				alloc_site_add(LTTNG_UST_CALLER_IP(),
+					malloc_usable_size(ptr));
+		} else if (trace_free(ptr)) {
+			lttng_ust_tracepoint(lttng_ust_libc, free,
+				ptr, LTTNG_UST_CALLER_IP());
+		}
 	}
 
 	if (cur_alloc.free == NULL) {
@@ -321,8 +578,12 @@ void *calloc(size_t nmemb, size_t size)
 	}
 	retval = cur_alloc.calloc(nmemb, size);
 	if (URCU_TLS(malloc_nesting) == 1) {
-		lttng_ust_tracepoint(lttng_ust_libc, calloc,
-			nmemb, size, retval, LTTNG_UST_CALLER_IP());
+		if (caa_unlikely(alloc_sites))
+			alloc_site_add(LTTNG_UST_CALLER_IP(), nmemb * size);
+		else if (lttng_ust_tracepoint_enabled(lttng_ust_libc, calloc)
+				&& trace_alloc(retval, nmemb * size))
+			lttng_ust_tracepoint(lttng_ust_libc, calloc,
+				nmemb, size, retval, LTTNG_UST_CALLER_IP());
 	}
 	URCU_TLS(malloc_nesting)--;
 	return retval;
@@ -330,6 +591,7 @@ void *calloc(size_t nmemb, size_t size)
 
 void *realloc(void *ptr, size_t size)
 {
+	bool traced = true;
 	void *retval;
 
 	URCU_TLS(malloc_nesting)++;
@@ -361,6 +623,9 @@ void *realloc(void *ptr, size_t size)
 		 * allocator.
 		 */
 		ptr = NULL;
+		if (URCU_TLS(malloc_nesting) == 1)
+			traced = lttng_ust_tracepoint_enabled(lttng_ust_libc, realloc)
+				&& trace_alloc(retval, size);
 		goto end;
 	}
 
@@ -371,11 +636,30 @@ void *realloc(void *ptr, size_t size)
 			abort();
 		}
 	}
+	if (caa_unlikely(sample_bytes) && URCU_TLS(malloc_nesting) == 1) {
+		/*
+		 * The realloc of a sampled pointer is traced, and keeps
+		 * tracking the reallocated memory.
+		 */
+		if (ptr && sampled_set_remove(ptr)) {
+			retval = cur_alloc.realloc(ptr, size);
+			if (retval || size)
+				(void) sampled_set_add(retval ? retval : ptr);
+			goto end;
+		}
+		retval = cur_alloc.realloc(ptr, size);
+		traced = lttng_ust_tracepoint_enabled(lttng_ust_libc, realloc)
+			&& trace_alloc(retval, size);
+		goto end;
+	}
 	retval = cur_alloc.realloc(ptr, size);
 end:
 	if (URCU_TLS(malloc_nesting) == 1) {
-		lttng_ust_tracepoint(lttng_ust_libc, realloc,
-			ptr, size, retval, LTTNG_UST_CALLER_IP());
+		if (caa_unlikely(alloc_sites))
+			alloc_site_add(LTTNG_UST_CALLER_IP(), size);
+		else if (traced)
+			lttng_ust_tracepoint(lttng_ust_libc, realloc,
+				ptr, size, retval, LTTNG_UST_CALLER_IP());
 	}
 	URCU_TLS(malloc_nesting)--;
 	return retval;
@@ -395,9 +679,13 @@ void *memalign(size_t alignment, size_t size)
 	}
 	retval = cur_alloc.memalign(alignment, size);
 	if (URCU_TLS(malloc_nesting) == 1) {
-		lttng_ust_tracepoint(lttng_ust_libc, memalign,
-			alignment, size, retval,
-			LTTNG_UST_CALLER_IP());
+		if (caa_unlikely(alloc_sites))
+			alloc_site_add(LTTNG_UST_CALLER_IP(), size);
+		else if (lttng_ust_tracepoint_enabled(lttng_ust_libc, memalign)
+				&& trace_alloc(retval, size))
+			lttng_ust_tracepoint(lttng_ust_libc, memalign,
+				alignment, size, retval,
+				LTTNG_UST_CALLER_IP());
 	}
 	URCU_TLS(malloc_nesting)--;
 	return retval;
@@ -417,9 +705,13 @@ int posix_memalign(void **memptr, size_t alignment, size_t size)
 	}
 	retval = cur_alloc.posix_memalign(memptr, alignment, size);
 	if (URCU_TLS(malloc_nesting) == 1) {
-		lttng_ust_tracepoint(lttng_ust_libc, posix_memalign,
-			*memptr, alignment, size,
-			retval, LTTNG_UST_CALLER_IP());
+		if (caa_unlikely(alloc_sites))
+			alloc_site_add(LTTNG_UST_CALLER_IP(), size);
+		else if (lttng_ust_tracepoint_enabled(lttng_ust_libc, posix_memalign)
+				&& trace_alloc(retval ? NULL : *memptr, size))
+			lttng_ust_tracepoint(lttng_ust_libc, posix_memalign,
+				*memptr, alignment, size,
+				retval, LTTNG_UST_CALLER_IP());
 	}
 	URCU_TLS(malloc_nesting)--;
 	return retval;
@@ -429,18 +721,185 @@ static
 void lttng_ust_malloc_nesting_alloc_tls(void)
 {
 	asm volatile ("" : : "m" (URCU_TLS(malloc_nesting)));
+	asm volatile ("" : : "m" (URCU_TLS(malloc_sample_state)));
+}
+
+static
+void lttng_ust_malloc_sample_init(void)
+{
+	const char *str;
+	char *endptr;
+	unsigned long val;
+
+	str = lttng_ust_getenv("LTTNG_UST_MALLOC_SAMPLE_BYTES");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtoul(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0') {
+		fprintf(stderr, "mallocwrap: invalid LTTNG_UST_MALLOC_SAMPLE_BYTES value: %s\n", str);
+		return;
+	}
+	/* Keep the drawn intervals within range. */
+	sample_bytes = min_t(unsigned long, val, ULONG_MAX / 32);
+}
+
+/*
+ * Trace the totals of all call sites. The allocations of the tracer
+ * itself are not accounted.
+ */
+static
+void alloc_site_dump(void)
+{
+	size_t index;
+
+	URCU_TLS(malloc_nesting)++;
+	for (index = 0; index <= NR_ALLOC_SITES; index++) {
+		size_t indexes[2] = { index, ALLOC_SITE_CALLS };
+		void *ip = NULL;
+		int64_t calls, bytes;
+		bool overflow, underflow;
+
+		if (index < NR_ALLOC_SITES) {
+			ip = CMM_LOAD_SHARED(alloc_site_ips[index]);
+			if (!ip)
+				continue;
+		}
+		if (lttng_counter_aggregate(&alloc_site_counter_config, alloc_sites,
+				indexes, &calls, &overflow, &underflow) || !calls)
+			continue;
+		indexes[1] = ALLOC_SITE_BYTES;
+		if (lttng_counter_aggregate(&alloc_site_counter_config, alloc_sites,
+				indexes, &bytes, &overflow, &underflow))
+			continue;
+		lttng_ust_tracepoint(lttng_ust_libc, alloc_site,
+			(uint64_t) calls, (uint64_t) bytes, ip);
+	}
+	URCU_TLS(malloc_nesting)--;
+}
+
+static
+void *alloc_site_dump_thread(void *arg __attribute__((unused)))
+{
+	struct timespec period = {
+		.tv_sec = alloc_site_period / 1000,
+		.tv_nsec = (alloc_site_period % 1000) * 1000000,
+	};
+
+	for (;;) {
+		while (nanosleep(&period, NULL) && errno == EINTR)
+			;
+		alloc_site_dump();
+	}
+	return NULL;
+}
+
+static
+void alloc_site_dump_thread_start(void)
+{
+	sigset_t sig_all_blocked, orig_mask;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int ret;
+
+	sigfillset(&sig_all_blocked);
+	ret = pthread_sigmask(SIG_SETMASK, &sig_all_blocked, &orig_mask);
+	if (ret) {
+		fprintf(stderr, "mallocwrap: pthread_sigmask: %d\n", ret);
+		return;
+	}
+	ret = pthread_attr_init(&attr);
+	if (!ret) {
+		ret = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (!ret)
+			ret = pthread_create(&thread, &attr, alloc_site_dump_thread, NULL);
+		(void) pthread_attr_destroy(&attr);
+	}
+	if (ret)
+		fprintf(stderr, "mallocwrap: unable to create the call site dump thread: %d\n", ret);
+	ret = pthread_sigmask(SIG_SETMASK, &orig_mask, NULL);
+	if (ret)
+		fprintf(stderr, "mallocwrap: pthread_sigmask: %d\n", ret);
+}
+
+/* The dump thread does not survive fork. */
+static
+void alloc_site_after_fork_child(void)
+{
+	alloc_site_dump_thread_start();
+}
+
+static
+void lttng_ust_malloc_aggregate_init(void)
+{
+	size_t max_nr_elem[2] = { NR_ALLOC_SITES + 1, NR_ALLOC_SITE_COUNTERS };
+	struct lib_counter *counter;
+	const char *str;
+	char *endptr;
+	unsigned long val;
+	int ret;
+
+	str = lttng_ust_getenv("LTTNG_UST_MALLOC_AGGREGATE_PERIOD");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtoul(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0' || !val) {
+		fprintf(stderr, "mallocwrap: invalid LTTNG_UST_MALLOC_AGGREGATE_PERIOD value: %s\n", str);
+		return;
+	}
+	counter = lttng_counter_create(&alloc_site_counter_config, 2, max_nr_elem,
+			0, -1, 0, NULL, false);
+	if (!counter) {
+		fprintf(stderr, "mallocwrap: unable to create the call site counters\n");
+		return;
+	}
+	if (lttng_counter_alloc_cpu_all_mem(counter)) {
+		fprintf(stderr, "mallocwrap: unable to allocate the call site counters\n");
+		lttng_counter_destroy(counter);
+		return;
+	}
+	ret = pthread_atfork(NULL, NULL, alloc_site_after_fork_child);
+	if (ret) {
+		fprintf(stderr, "mallocwrap: pthread_atfork: %d\n", ret);
+		lttng_counter_destroy(counter);
+		return;
+	}
+	alloc_site_period = val;
+	/* Aggregation replaces per-call events, sampled or not. */
+	sample_bytes = 0;
+	CMM_STORE_SHARED(alloc_sites, counter);
+	alloc_site_dump_thread_start();
+}
+
+/* Dump the last totals before exiting. */
+static
+void lttng_ust_malloc_aggregate_exit(void)
+	__attribute__((destructor));
+static
+void lttng_ust_malloc_aggregate_exit(void)
+{
+	if (alloc_sites)
+		alloc_site_dump();
 }
 
 void lttng_ust_libc_wrapper_malloc_ctor(void)
 {
+	static bool initialized;
+
 	/* Initialization already done */
-	if (cur_alloc.calloc) {
+	if (initialized) {
 		return;
 	}
+	initialized = true;
 	lttng_ust_malloc_nesting_alloc_tls();
 	/*
 	 * Ensure the allocator is in place before the process becomes
-	 * multithreaded.
+	 * multithreaded. It may already be if malloc() was called
+	 * before this constructor.
 	 */
-	lookup_all_symbols();
+	if (!cur_alloc.calloc)
+		lookup_all_symbols();
+	lttng_ust_malloc_sample_init();
+	lttng_ust_malloc_aggregate_init();
 }
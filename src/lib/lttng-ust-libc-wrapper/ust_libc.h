@@ -74,6 +74,20 @@ LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_libc, posix_memalign,
 	)
 )
 
+/*
+ * Periodic dump of the allocations aggregated per call site. @ip is
+ * the call site, or NULL for the calls which did not fit in the site
+ * table. The counts are totals since the process started.
+ */
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_libc, alloc_site,
+	LTTNG_UST_TP_ARGS(uint64_t, calls, uint64_t, bytes, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, site, ip)
+		lttng_ust_field_integer(uint64_t, calls, calls)
+		lttng_ust_field_integer(uint64_t, bytes, bytes)
+	)
+)
+
 #endif /* _TRACEPOINT_UST_LIBC_H */
 
 #undef LTTNG_UST_TRACEPOINT_INCLUDE
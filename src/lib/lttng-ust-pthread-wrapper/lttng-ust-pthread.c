@@ -13,8 +13,23 @@
 /* Has to be included first to override dlfcn.h */
 #include <common/compat/dlfcn.h>
 
-#include "common/macros.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <pthread.h>
+#include <time.h>
+
+#include <urcu/compiler.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+
+#include "common/macros.h"
+#include "common/getenv.h"
+#include "common/counter/counter.h"
+#include "common/counter/counter-api.h"
 
 #define LTTNG_UST_TRACEPOINT_HIDDEN_DEFINITION
 #define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
@@ -26,6 +41,234 @@
 
 static __thread int thread_in_trace;
 
+/*
+ * In contended mode, only the lock operations which had to wait are
+ * traced, with their wait duration, and only when it is at least
+ * contended_threshold_ns nanoseconds.
+ */
+static bool contended_only;
+static uint64_t contended_threshold_ns;
+
+/*
+ * Lock aggregation, enabled by LTTNG_UST_PTHREAD_AGGREGATE_PERIOD.
+ * Instead of tracing each operation, the acquisitions, contended
+ * acquisitions and wait durations are accumulated per lock and call
+ * site into per-cpu counters, and the totals of all sites are traced
+ * periodically by a dump thread. The locks are mutexes, rwlocks and
+ * condition variables, whose waits all count as contended. Sites are
+ * inserted in an open addressing table, keyed by a hash of the lock
+ * address and caller IP, and never removed. The operations of the sites which do not fit
+ * are accumulated in an additional element. The maximum wait duration
+ * of each site is kept next to its key.
+ */
+#define LOCK_SITES_ORDER	10
+#define NR_LOCK_SITES		(1UL << LOCK_SITES_ORDER)
+#define LOCK_SITES_PROBES	16
+
+enum lock_site_counter {
+	LOCK_SITE_ACQUISITIONS,
+	LOCK_SITE_CONTENDED,
+	LOCK_SITE_WAIT,
+	NR_LOCK_SITE_COUNTERS,
+};
+
+static const struct lib_counter_config lock_site_counter_config = {
+	.alloc = COUNTER_ALLOC_PER_CPU,
+	.sync = COUNTER_SYNC_PER_CPU,
+	.arithmetic = COUNTER_ARITHMETIC_MODULAR,
+#if CAA_BITS_PER_LONG == 64
+	.counter_size = COUNTER_SIZE_64_BIT,
+#else
+	.counter_size = COUNTER_SIZE_32_BIT,
+#endif
+};
+
+struct lock_site {
+	unsigned long key;		/* Never 0 once inserted. */
+	void *lock;
+	void *ip;
+	unsigned long max_wait_ns;
+};
+
+static
+struct lock_site lock_site_table[NR_LOCK_SITES + 1];
+
+static
+struct lib_counter *lock_sites;
+
+/* Dump period, in milliseconds. */
+static
+unsigned long lock_site_period;
+
+static int (*mutex_trylock)(pthread_mutex_t *);
+static int (*rwlock_tryrdlock)(pthread_rwlock_t *);
+static int (*rwlock_trywrlock)(pthread_rwlock_t *);
+
+static
+uint64_t wait_clock_read(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static
+size_t lock_site_index(void *lock, void *ip)
+{
+	uint64_t hash = ((uint64_t) (uintptr_t) lock * 0x9E3779B97F4A7C15ULL)
+		^ ((uint64_t) (uintptr_t) ip * 0xC2B2AE3D27D4EB4FULL);
+	unsigned long key = (unsigned long) (hash * 0x9E3779B97F4A7C15ULL) | 1;
+	unsigned int i;
+
+	for (i = 0; i < LOCK_SITES_PROBES; i++) {
+		size_t index = ((hash >> (64 - LOCK_SITES_ORDER)) + i) & (NR_LOCK_SITES - 1);
+		struct lock_site *site = &lock_site_table[index];
+		unsigned long site_key = CMM_LOAD_SHARED(site->key);
+
+		if (site_key == key)
+			return index;
+		if (!site_key) {
+			site_key = uatomic_cmpxchg(&site->key, 0, key);
+			if (!site_key) {
+				CMM_STORE_SHARED(site->lock, lock);
+				CMM_STORE_SHARED(site->ip, ip);
+				return index;
+			}
+			if (site_key == key)
+				return index;
+		}
+	}
+	return NR_LOCK_SITES;
+}
+
+static
+void lock_site_add(void *lock, void *ip, bool acquired,
+		bool contended, uint64_t wait_ns)
+{
+	size_t indexes[2];
+	struct lock_site *site;
+	unsigned long max_wait_ns;
+
+	indexes[0] = lock_site_index(lock, ip);
+	if (acquired) {
+		indexes[1] = LOCK_SITE_ACQUISITIONS;
+		(void) lttng_counter_inc(&lock_site_counter_config, lock_sites, indexes);
+	}
+	if (!contended)
+		return;
+	indexes[1] = LOCK_SITE_CONTENDED;
+	(void) lttng_counter_inc(&lock_site_counter_config, lock_sites, indexes);
+	indexes[1] = LOCK_SITE_WAIT;
+	(void) lttng_counter_add(&lock_site_counter_config, lock_sites, indexes, wait_ns);
+	site = &lock_site_table[indexes[0]];
+	max_wait_ns = CMM_LOAD_SHARED(site->max_wait_ns);
+	while (wait_ns > max_wait_ns) {
+		unsigned long old;
+
+		old = uatomic_cmpxchg(&site->max_wait_ns, max_wait_ns,
+			(unsigned long) wait_ns);
+		if (old == max_wait_ns)
+			break;
+		max_wait_ns = old;
+	}
+}
+
+/*
+ * Try to take the lock before waiting for it, so the wait can be timed
+ * and accounted. Called with thread_in_trace set.
+ */
+static
+int mutex_lock_aggregate(int (*mutex_lock)(pthread_mutex_t *),
+		pthread_mutex_t *mutex, void *ip)
+{
+	uint64_t start, wait_ns;
+	int retval;
+
+	retval = mutex_trylock(mutex);
+	if (caa_likely(retval != EBUSY)) {
+		lock_site_add(mutex, ip, !retval, false, 0);
+		return retval;
+	}
+	start = wait_clock_read();
+	retval = mutex_lock(mutex);
+	wait_ns = wait_clock_read() - start;
+	lock_site_add(mutex, ip, !retval, true, wait_ns);
+	return retval;
+}
+
+/*
+ * Try to take the lock before waiting for it, so the wait can be timed
+ * and traced after the fact. Called with thread_in_trace set.
+ */
+static
+int mutex_lock_contended(int (*mutex_lock)(pthread_mutex_t *),
+		pthread_mutex_t *mutex, void *ip)
+{
+	uint64_t start, wait_ns;
+	int retval;
+
+	retval = mutex_trylock(mutex);
+	if (caa_likely(retval != EBUSY))
+		return retval;
+	start = wait_clock_read();
+	retval = mutex_lock(mutex);
+	wait_ns = wait_clock_read() - start;
+	if (wait_ns >= contended_threshold_ns)
+		lttng_ust_tracepoint(lttng_ust_pthread, pthread_mutex_lock_contended,
+			mutex, retval, wait_ns, ip);
+	return retval;
+}
+
+/*
+ * Contended and aggregated rwlock operations, which try to take the
+ * lock before waiting for it. Called with thread_in_trace set.
+ */
+static
+int rwlock_lock_contended(int (*rwlock_trylock)(pthread_rwlock_t *),
+		int (*rwlock_lock)(pthread_rwlock_t *),
+		pthread_rwlock_t *rwlock, bool write, void *ip)
+{
+	uint64_t start, wait_ns;
+	int retval;
+
+	retval = rwlock_trylock(rwlock);
+	if (caa_likely(retval != EBUSY)) {
+		if (lock_sites)
+			lock_site_add(rwlock, ip, !retval, false, 0);
+		return retval;
+	}
+	start = wait_clock_read();
+	retval = rwlock_lock(rwlock);
+	wait_ns = wait_clock_read() - start;
+	if (lock_sites)
+		lock_site_add(rwlock, ip, !retval, true, wait_ns);
+	else if (wait_ns >= contended_threshold_ns) {
+		if (write)
+			lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_wrlock_contended,
+				rwlock, retval, wait_ns, ip);
+		else
+			lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_rdlock_contended,
+				rwlock, retval, wait_ns, ip);
+	}
+	return retval;
+}
+
+/*
+ * Account a condition variable wait in contended and aggregated modes.
+ * Called with thread_in_trace set.
+ */
+static
+void cond_wait_contended(pthread_cond_t *cond, pthread_mutex_t *mutex,
+		int status, uint64_t wait_ns, void *ip)
+{
+	if (lock_sites)
+		lock_site_add(cond, ip, !status, true, wait_ns);
+	else if (wait_ns >= contended_threshold_ns)
+		lttng_ust_tracepoint(lttng_ust_pthread, pthread_cond_wait_blocked,
+			cond, mutex, status, wait_ns, ip);
+}
+
 int pthread_mutex_lock(pthread_mutex_t *mutex)
 {
 	static int (*mutex_lock)(pthread_mutex_t *);
@@ -45,6 +288,24 @@ int pthread_mutex_lock(pthread_mutex_t *mutex)
 		return mutex_lock(mutex);
 	}
 
+	if (caa_unlikely(lock_sites)) {
+		thread_in_trace = 1;
+		retval = mutex_lock_aggregate(mutex_lock, mutex,
+			LTTNG_UST_CALLER_IP());
+		thread_in_trace = 0;
+		return retval;
+	}
+	if (contended_only) {
+		if (!lttng_ust_tracepoint_enabled(lttng_ust_pthread,
+				pthread_mutex_lock_contended))
+			return mutex_lock(mutex);
+		thread_in_trace = 1;
+		retval = mutex_lock_contended(mutex_lock, mutex,
+			LTTNG_UST_CALLER_IP());
+		thread_in_trace = 0;
+		return retval;
+	}
+
 	thread_in_trace = 1;
 	lttng_ust_tracepoint(lttng_ust_pthread, pthread_mutex_lock_req, mutex,
 		LTTNG_UST_CALLER_IP());
@@ -57,7 +318,6 @@ int pthread_mutex_lock(pthread_mutex_t *mutex)
 
 int pthread_mutex_trylock(pthread_mutex_t *mutex)
 {
-	static int (*mutex_trylock)(pthread_mutex_t *);
 	int retval;
 
 	if (!mutex_trylock) {
@@ -76,8 +336,16 @@ int pthread_mutex_trylock(pthread_mutex_t *mutex)
 
 	thread_in_trace = 1;
 	retval = mutex_trylock(mutex);
-	lttng_ust_tracepoint(lttng_ust_pthread, pthread_mutex_trylock, mutex,
-		retval, LTTNG_UST_CALLER_IP());
+	if (caa_unlikely(lock_sites)) {
+		if (!retval)
+			lock_site_add(mutex, LTTNG_UST_CALLER_IP(), true, false, 0);
+		thread_in_trace = 0;
+		return retval;
+	}
+	/* In contended mode, only the failed attempts are traced. */
+	if (!contended_only || retval)
+		lttng_ust_tracepoint(lttng_ust_pthread, pthread_mutex_trylock,
+			mutex, retval, LTTNG_UST_CALLER_IP());
 	thread_in_trace = 0;
 	return retval;
 }
@@ -97,7 +365,7 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex)
 			return EINVAL;
 		}
 	}
-	if (thread_in_trace) {
+	if (thread_in_trace || contended_only || lock_sites) {
 		return mutex_unlock(mutex);
 	}
 
@@ -108,3 +376,470 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex)
 	thread_in_trace = 0;
 	return retval;
 }
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock)
+{
+	static int (*rwlock_rdlock)(pthread_rwlock_t *);
+	int retval;
+
+	if (!rwlock_rdlock) {
+		rwlock_rdlock = dlsym(RTLD_NEXT, "pthread_rwlock_rdlock");
+		if (!rwlock_rdlock) {
+			if (thread_in_trace) {
+				abort();
+			}
+			fprintf(stderr, "unable to initialize pthread wrapper library.\n");
+			return EINVAL;
+		}
+	}
+	if (thread_in_trace) {
+		return rwlock_rdlock(rwlock);
+	}
+
+	if (caa_unlikely(lock_sites) || contended_only) {
+		if (!lock_sites && !lttng_ust_tracepoint_enabled(lttng_ust_pthread,
+				pthread_rwlock_rdlock_contended))
+			return rwlock_rdlock(rwlock);
+		thread_in_trace = 1;
+		retval = rwlock_lock_contended(rwlock_tryrdlock, rwlock_rdlock,
+			rwlock, false, LTTNG_UST_CALLER_IP());
+		thread_in_trace = 0;
+		return retval;
+	}
+
+	thread_in_trace = 1;
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_rdlock_req, rwlock,
+		LTTNG_UST_CALLER_IP());
+	retval = rwlock_rdlock(rwlock);
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_rdlock_acq, rwlock,
+		retval, LTTNG_UST_CALLER_IP());
+	thread_in_trace = 0;
+	return retval;
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock)
+{
+	static int (*rwlock_wrlock)(pthread_rwlock_t *);
+	int retval;
+
+	if (!rwlock_wrlock) {
+		rwlock_wrlock = dlsym(RTLD_NEXT, "pthread_rwlock_wrlock");
+		if (!rwlock_wrlock) {
+			if (thread_in_trace) {
+				abort();
+			}
+			fprintf(stderr, "unable to initialize pthread wrapper library.\n");
+			return EINVAL;
+		}
+	}
+	if (thread_in_trace) {
+		return rwlock_wrlock(rwlock);
+	}
+
+	if (caa_unlikely(lock_sites) || contended_only) {
+		if (!lock_sites && !lttng_ust_tracepoint_enabled(lttng_ust_pthread,
+				pthread_rwlock_wrlock_contended))
+			return rwlock_wrlock(rwlock);
+		thread_in_trace = 1;
+		retval = rwlock_lock_contended(rwlock_trywrlock, rwlock_wrlock,
+			rwlock, true, LTTNG_UST_CALLER_IP());
+		thread_in_trace = 0;
+		return retval;
+	}
+
+	thread_in_trace = 1;
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_wrlock_req, rwlock,
+		LTTNG_UST_CALLER_IP());
+	retval = rwlock_wrlock(rwlock);
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_wrlock_acq, rwlock,
+		retval, LTTNG_UST_CALLER_IP());
+	thread_in_trace = 0;
+	return retval;
+}
+
+int pthread_rwlock_tryrdlock(pthread_rwlock_t *rwlock)
+{
+	int retval;
+
+	if (!rwlock_tryrdlock) {
+		rwlock_tryrdlock = dlsym(RTLD_NEXT, "pthread_rwlock_tryrdlock");
+		if (!rwlock_tryrdlock) {
+			if (thread_in_trace) {
+				abort();
+			}
+			fprintf(stderr, "unable to initialize pthread wrapper library.\n");
+			return EINVAL;
+		}
+	}
+	if (thread_in_trace) {
+		return rwlock_tryrdlock(rwlock);
+	}
+
+	thread_in_trace = 1;
+	retval = rwlock_tryrdlock(rwlock);
+	if (caa_unlikely(lock_sites)) {
+		if (!retval)
+			lock_site_add(rwlock, LTTNG_UST_CALLER_IP(), true, false, 0);
+		thread_in_trace = 0;
+		return retval;
+	}
+	/* In contended mode, only the failed attempts are traced. */
+	if (!contended_only || retval)
+		lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_tryrdlock,
+			rwlock, retval, LTTNG_UST_CALLER_IP());
+	thread_in_trace = 0;
+	return retval;
+}
+
+int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock)
+{
+	int retval;
+
+	if (!rwlock_trywrlock) {
+		rwlock_trywrlock = dlsym(RTLD_NEXT, "pthread_rwlock_trywrlock");
+		if (!rwlock_trywrlock) {
+			if (thread_in_trace) {
+				abort();
+			}
+			fprintf(stderr, "unable to initialize pthread wrapper library.\n");
+			return EINVAL;
+		}
+	}
+	if (thread_in_trace) {
+		return rwlock_trywrlock(rwlock);
+	}
+
+	thread_in_trace = 1;
+	retval = rwlock_trywrlock(rwlock);
+	if (caa_unlikely(lock_sites)) {
+		if (!retval)
+			lock_site_add(rwlock, LTTNG_UST_CALLER_IP(), true, false, 0);
+		thread_in_trace = 0;
+		return retval;
+	}
+	/* In contended mode, only the failed attempts are traced. */
+	if (!contended_only || retval)
+		lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_trywrlock,
+			rwlock, retval, LTTNG_UST_CALLER_IP());
+	thread_in_trace = 0;
+	return retval;
+}
+
+int pthread_rwlock_unlock(pthread_rwlock_t *rwlock)
+{
+	static int (*rwlock_unlock)(pthread_rwlock_t *);
+	int retval;
+
+	if (!rwlock_unlock) {
+		rwlock_unlock = dlsym(RTLD_NEXT, "pthread_rwlock_unlock");
+		if (!rwlock_unlock) {
+			if (thread_in_trace) {
+				abort();
+			}
+			fprintf(stderr, "unable to initialize pthread wrapper library.\n");
+			return EINVAL;
+		}
+	}
+	if (thread_in_trace || contended_only || lock_sites) {
+		return rwlock_unlock(rwlock);
+	}
+
+	thread_in_trace = 1;
+	retval = rwlock_unlock(rwlock);
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_rwlock_unlock, rwlock,
+		retval, LTTNG_UST_CALLER_IP());
+	thread_in_trace = 0;
+	return retval;
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+	static int (*cond_wait)(pthread_cond_t *, pthread_mutex_t *);
+	uint64_t start;
+	int retval;
+
+	if (!cond_wait) {
+		cond_wait = dlsym(RTLD_NEXT, "pthread_cond_wait");
+		if (!cond_wait) {
+			if (thread_in_trace) {
+				abort();
+			}
+			fprintf(stderr, "unable to initialize pthread wrapper library.\n");
+			return EINVAL;
+		}
+	}
+	if (thread_in_trace) {
+		return cond_wait(cond, mutex);
+	}
+
+	if (caa_unlikely(lock_sites) || contended_only) {
+		if (!lock_sites && !lttng_ust_tracepoint_enabled(lttng_ust_pthread,
+				pthread_cond_wait_blocked))
+			return cond_wait(cond, mutex);
+		thread_in_trace = 1;
+		start = wait_clock_read();
+		retval = cond_wait(cond, mutex);
+		cond_wait_contended(cond, mutex, retval,
+			wait_clock_read() - start, LTTNG_UST_CALLER_IP());
+		thread_in_trace = 0;
+		return retval;
+	}
+
+	thread_in_trace = 1;
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_cond_wait_begin, cond,
+		mutex, LTTNG_UST_CALLER_IP());
+	retval = cond_wait(cond, mutex);
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_cond_wait_end, cond,
+		mutex, retval, LTTNG_UST_CALLER_IP());
+	thread_in_trace = 0;
+	return retval;
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+		const struct timespec *abstime)
+{
+	static int (*cond_timedwait)(pthread_cond_t *, pthread_mutex_t *,
+		const struct timespec *);
+	uint64_t start;
+	int retval;
+
+	if (!cond_timedwait) {
+		cond_timedwait = dlsym(RTLD_NEXT, "pthread_cond_timedwait");
+		if (!cond_timedwait) {
+			if (thread_in_trace) {
+				abort();
+			}
+			fprintf(stderr, "unable to initialize pthread wrapper library.\n");
+			return EINVAL;
+		}
+	}
+	if (thread_in_trace) {
+		return cond_timedwait(cond, mutex, abstime);
+	}
+
+	if (caa_unlikely(lock_sites) || contended_only) {
+		if (!lock_sites && !lttng_ust_tracepoint_enabled(lttng_ust_pthread,
+				pthread_cond_wait_blocked))
+			return cond_timedwait(cond, mutex, abstime);
+		thread_in_trace = 1;
+		start = wait_clock_read();
+		retval = cond_timedwait(cond, mutex, abstime);
+		cond_wait_contended(cond, mutex, retval,
+			wait_clock_read() - start, LTTNG_UST_CALLER_IP());
+		thread_in_trace = 0;
+		return retval;
+	}
+
+	thread_in_trace = 1;
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_cond_timedwait_begin, cond,
+		mutex, LTTNG_UST_CALLER_IP());
+	retval = cond_timedwait(cond, mutex, abstime);
+	lttng_ust_tracepoint(lttng_ust_pthread, pthread_cond_timedwait_end, cond,
+		mutex, retval, LTTNG_UST_CALLER_IP());
+	thread_in_trace = 0;
+	return retval;
+}
+
+/*
+ * The contended and aggregated modes try the locks before waiting for
+ * them.
+ */
+static
+bool lookup_trylock_symbols(void)
+{
+	if (!mutex_trylock)
+		mutex_trylock = dlsym(RTLD_NEXT, "pthread_mutex_trylock");
+	if (!rwlock_tryrdlock)
+		rwlock_tryrdlock = dlsym(RTLD_NEXT, "pthread_rwlock_tryrdlock");
+	if (!rwlock_trywrlock)
+		rwlock_trywrlock = dlsym(RTLD_NEXT, "pthread_rwlock_trywrlock");
+	if (!mutex_trylock || !rwlock_tryrdlock || !rwlock_trywrlock) {
+		fprintf(stderr, "unable to initialize pthread wrapper library.\n");
+		return false;
+	}
+	return true;
+}
+
+static
+void lttng_ust_pthread_contended_init(void)
+{
+	const char *str;
+	char *endptr;
+	unsigned long long val;
+
+	str = lttng_ust_getenv("LTTNG_UST_PTHREAD_CONTENDED_THRESHOLD");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtoull(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0') {
+		fprintf(stderr, "pthreadwrap: invalid LTTNG_UST_PTHREAD_CONTENDED_THRESHOLD value: %s\n", str);
+		return;
+	}
+	if (!lookup_trylock_symbols())
+		return;
+	contended_threshold_ns = val;
+	contended_only = true;
+}
+
+/*
+ * Trace the totals of all sites. The lock operations of the tracer
+ * itself are not accounted.
+ */
+static
+void lock_site_dump(void)
+{
+	size_t index;
+
+	thread_in_trace = 1;
+	for (index = 0; index <= NR_LOCK_SITES; index++) {
+		struct lock_site *site = &lock_site_table[index];
+		size_t indexes[2] = { index, LOCK_SITE_ACQUISITIONS };
+		void *lock = NULL, *ip = NULL;
+		int64_t acquisitions, contended, wait_ns;
+		bool overflow, underflow;
+
+		if (index < NR_LOCK_SITES) {
+			if (!CMM_LOAD_SHARED(site->key))
+				continue;
+			lock = CMM_LOAD_SHARED(site->lock);
+			ip = CMM_LOAD_SHARED(site->ip);
+		}
+		if (lttng_counter_aggregate(&lock_site_counter_config, lock_sites,
+				indexes, &acquisitions, &overflow, &underflow))
+			continue;
+		indexes[1] = LOCK_SITE_CONTENDED;
+		if (lttng_counter_aggregate(&lock_site_counter_config, lock_sites,
+				indexes, &contended, &overflow, &underflow))
+			continue;
+		if (!acquisitions && !contended)
+			continue;
+		indexes[1] = LOCK_SITE_WAIT;
+		if (lttng_counter_aggregate(&lock_site_counter_config, lock_sites,
+				indexes, &wait_ns, &overflow, &underflow))
+			continue;
+		lttng_ust_tracepoint(lttng_ust_pthread, lock_site, lock,
+			(uint64_t) acquisitions, (uint64_t) contended,
+			(uint64_t) wait_ns,
+			(uint64_t) CMM_LOAD_SHARED(site->max_wait_ns), ip);
+	}
+	thread_in_trace = 0;
+}
+
+static
+void *lock_site_dump_thread(void *arg __attribute__((unused)))
+{
+	struct timespec period = {
+		.tv_sec = lock_site_period / 1000,
+		.tv_nsec = (lock_site_period % 1000) * 1000000,
+	};
+
+	for (;;) {
+		while (nanosleep(&period, NULL) && errno == EINTR)
+			;
+		lock_site_dump();
+	}
+	return NULL;
+}
+
+static
+void lock_site_dump_thread_start(void)
+{
+	sigset_t sig_all_blocked, orig_mask;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int ret;
+
+	sigfillset(&sig_all_blocked);
+	ret = pthread_sigmask(SIG_SETMASK, &sig_all_blocked, &orig_mask);
+	if (ret) {
+		fprintf(stderr, "pthreadwrap: pthread_sigmask: %d\n", ret);
+		return;
+	}
+	ret = pthread_attr_init(&attr);
+	if (!ret) {
+		ret = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (!ret)
+			ret = pthread_create(&thread, &attr, lock_site_dump_thread, NULL);
+		(void) pthread_attr_destroy(&attr);
+	}
+	if (ret)
+		fprintf(stderr, "pthreadwrap: unable to create the lock site dump thread: %d\n", ret);
+	ret = pthread_sigmask(SIG_SETMASK, &orig_mask, NULL);
+	if (ret)
+		fprintf(stderr, "pthreadwrap: pthread_sigmask: %d\n", ret);
+}
+
+/* The dump thread does not survive fork. */
+static
+void lock_site_after_fork_child(void)
+{
+	lock_site_dump_thread_start();
+}
+
+static
+void lttng_ust_pthread_aggregate_init(void)
+{
+	size_t max_nr_elem[2] = { NR_LOCK_SITES + 1, NR_LOCK_SITE_COUNTERS };
+	struct lib_counter *counter;
+	const char *str;
+	char *endptr;
+	unsigned long val;
+	int ret;
+
+	str = lttng_ust_getenv("LTTNG_UST_PTHREAD_AGGREGATE_PERIOD");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtoul(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0' || !val) {
+		fprintf(stderr, "pthreadwrap: invalid LTTNG_UST_PTHREAD_AGGREGATE_PERIOD value: %s\n", str);
+		return;
+	}
+	if (!lookup_trylock_symbols())
+		return;
+	counter = lttng_counter_create(&lock_site_counter_config, 2, max_nr_elem,
+			0, -1, 0, NULL, false);
+	if (!counter) {
+		fprintf(stderr, "pthreadwrap: unable to create the lock site counters\n");
+		return;
+	}
+	if (lttng_counter_alloc_cpu_all_mem(counter)) {
+		fprintf(stderr, "pthreadwrap: unable to allocate the lock site counters\n");
+		lttng_counter_destroy(counter);
+		return;
+	}
+	ret = pthread_atfork(NULL, NULL, lock_site_after_fork_child);
+	if (ret) {
+		fprintf(stderr, "pthreadwrap: pthread_atfork: %d\n", ret);
+		lttng_counter_destroy(counter);
+		return;
+	}
+	lock_site_period = val;
+	CMM_STORE_SHARED(lock_sites, counter);
+	lock_site_dump_thread_start();
+}
+
+static
+void lttng_ust_pthread_wrapper_init(void)
+	__attribute__((constructor));
+static
+void lttng_ust_pthread_wrapper_init(void)
+{
+	/* The environment is read under a pthread mutex. */
+	thread_in_trace = 1;
+	lttng_ust_pthread_contended_init();
+	lttng_ust_pthread_aggregate_init();
+	thread_in_trace = 0;
+}
+
+/* Dump the last totals before exiting. */
+static
+void lttng_ust_pthread_wrapper_exit(void)
+	__attribute__((destructor));
+static
+void lttng_ust_pthread_wrapper_exit(void)
+{
+	if (lock_sites)
+		lock_site_dump();
+}
@@ -33,6 +33,17 @@ LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_pthread, pthread_mutex_lock_acq,
 	)
 )
 
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_pthread, pthread_mutex_lock_contended,
+	LTTNG_UST_TP_ARGS(pthread_mutex_t *, mutex, int, status,
+		uint64_t, wait_ns, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, mutex, mutex)
+		lttng_ust_field_integer(int, status, status)
+		lttng_ust_field_integer(uint64_t, wait_ns, wait_ns)
+		lttng_ust_field_unused(ip)
+	)
+)
+
 LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_pthread, pthread_mutex_trylock,
 	LTTNG_UST_TP_ARGS(pthread_mutex_t *, mutex, int, status, void *, ip),
 	LTTNG_UST_TP_FIELDS(
@@ -51,6 +62,162 @@ LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_pthread, pthread_mutex_unlock,
 	)
 )
 
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(lttng_ust_pthread, rwlock_req,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, rwlock, rwlock)
+		lttng_ust_field_unused(ip)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(lttng_ust_pthread, rwlock_status,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, rwlock, rwlock)
+		lttng_ust_field_integer(int, status, status)
+		lttng_ust_field_unused(ip)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(lttng_ust_pthread, rwlock_contended,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status,
+		uint64_t, wait_ns, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, rwlock, rwlock)
+		lttng_ust_field_integer(int, status, status)
+		lttng_ust_field_integer(uint64_t, wait_ns, wait_ns)
+		lttng_ust_field_unused(ip)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_req,
+	lttng_ust_pthread, pthread_rwlock_rdlock_req,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_status,
+	lttng_ust_pthread, pthread_rwlock_rdlock_acq,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_contended,
+	lttng_ust_pthread, pthread_rwlock_rdlock_contended,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status,
+		uint64_t, wait_ns, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_req,
+	lttng_ust_pthread, pthread_rwlock_wrlock_req,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_status,
+	lttng_ust_pthread, pthread_rwlock_wrlock_acq,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_contended,
+	lttng_ust_pthread, pthread_rwlock_wrlock_contended,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status,
+		uint64_t, wait_ns, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_status,
+	lttng_ust_pthread, pthread_rwlock_tryrdlock,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_status,
+	lttng_ust_pthread, pthread_rwlock_trywrlock,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, rwlock_status,
+	lttng_ust_pthread, pthread_rwlock_unlock,
+	LTTNG_UST_TP_ARGS(pthread_rwlock_t *, rwlock, int, status, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(lttng_ust_pthread, cond_wait_begin,
+	LTTNG_UST_TP_ARGS(pthread_cond_t *, cond, pthread_mutex_t *, mutex,
+		void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, cond, cond)
+		lttng_ust_field_integer_hex(void *, mutex, mutex)
+		lttng_ust_field_unused(ip)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_CLASS(lttng_ust_pthread, cond_wait_end,
+	LTTNG_UST_TP_ARGS(pthread_cond_t *, cond, pthread_mutex_t *, mutex,
+		int, status, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, cond, cond)
+		lttng_ust_field_integer_hex(void *, mutex, mutex)
+		lttng_ust_field_integer(int, status, status)
+		lttng_ust_field_unused(ip)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, cond_wait_begin,
+	lttng_ust_pthread, pthread_cond_wait_begin,
+	LTTNG_UST_TP_ARGS(pthread_cond_t *, cond, pthread_mutex_t *, mutex,
+		void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, cond_wait_end,
+	lttng_ust_pthread, pthread_cond_wait_end,
+	LTTNG_UST_TP_ARGS(pthread_cond_t *, cond, pthread_mutex_t *, mutex,
+		int, status, void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, cond_wait_begin,
+	lttng_ust_pthread, pthread_cond_timedwait_begin,
+	LTTNG_UST_TP_ARGS(pthread_cond_t *, cond, pthread_mutex_t *, mutex,
+		void *, ip)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT_INSTANCE(lttng_ust_pthread, cond_wait_end,
+	lttng_ust_pthread, pthread_cond_timedwait_end,
+	LTTNG_UST_TP_ARGS(pthread_cond_t *, cond, pthread_mutex_t *, mutex,
+		int, status, void *, ip)
+)
+
+/*
+ * Condition variable wait, timed or not, of the contended mode. The
+ * wait duration is in nanoseconds.
+ */
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_pthread, pthread_cond_wait_blocked,
+	LTTNG_UST_TP_ARGS(pthread_cond_t *, cond, pthread_mutex_t *, mutex,
+		int, status, uint64_t, wait_ns, void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, cond, cond)
+		lttng_ust_field_integer_hex(void *, mutex, mutex)
+		lttng_ust_field_integer(int, status, status)
+		lttng_ust_field_integer(uint64_t, wait_ns, wait_ns)
+		lttng_ust_field_unused(ip)
+	)
+)
+
+/*
+ * Totals of a lock and call site of the lock aggregation, traced
+ * periodically for each site of the table. The lock is a mutex, rwlock
+ * or condition variable. The counts are totals since the process
+ * started, and the wait durations are in nanoseconds.
+ */
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_pthread, lock_site,
+	LTTNG_UST_TP_ARGS(void *, lock, uint64_t, acquisitions,
+		uint64_t, contended, uint64_t, wait_ns, uint64_t, max_wait_ns,
+		void *, ip),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer_hex(void *, lock, lock)
+		lttng_ust_field_integer_hex(void *, site, ip)
+		lttng_ust_field_integer(uint64_t, acquisitions, acquisitions)
+		lttng_ust_field_integer(uint64_t, contended, contended)
+		lttng_ust_field_integer(uint64_t, wait_ns, wait_ns)
+		lttng_ust_field_integer(uint64_t, max_wait_ns, max_wait_ns)
+	)
+)
+
 #endif /* _TRACEPOINT_UST_PTHREAD_H */
 
 #undef LTTNG_UST_TRACEPOINT_INCLUDE
@@ -9,10 +9,15 @@
 
 #define _LGPL_SOURCE
 #include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <dlfcn.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/syscall.h>
 
 #include <urcu/arch.h>
 #include <lttng/urcu/urcu-ust.h>
@@ -51,6 +56,7 @@ static int initialized;
 static int tracepoint_destructors_state = 1;
 
 static void (*new_tracepoint_cb)(struct lttng_ust_tracepoint *);
+static int (*probe_accept_cb)(void *data, void *ip);
 
 /*
  * tracepoint_mutex nests inside UST mutex.
@@ -79,13 +85,40 @@ static CDS_LIST_HEAD(libs);
  * lttng_ust_tracepoint_module_unregister, which take the tracepoint mutex themselves.
  */
 
+/*
+ * Hash tables of the tracepoint and callsite registries. They start
+ * with a static array of (1 << TP_HASH_INIT_BITS) buckets, and double
+ * their number of buckets each time the number of entries exceeds
+ * TP_HASH_MAX_LOAD entries per bucket, up to (1 << TP_HASH_MAX_BITS)
+ * buckets. The entry hash is kept within each node so resizing does
+ * not hash the names again. Protected by tracepoint mutex.
+ */
+#define TP_HASH_INIT_BITS	12
+#define TP_HASH_MAX_BITS	20
+#define TP_HASH_MAX_LOAD	2
+
+struct tp_hash_node {
+	struct cds_hlist_node hlist;
+	uint32_t hash;
+};
+
+struct tp_hash_table {
+	struct cds_hlist_head *buckets;
+	unsigned int bits;
+	unsigned long nr_entries;
+	const char *name;
+};
+
 /*
  * Tracepoint hash table, containing the active tracepoints.
  * Protected by tracepoint mutex.
  */
-#define TRACEPOINT_HASH_BITS 12
-#define TRACEPOINT_TABLE_SIZE (1 << TRACEPOINT_HASH_BITS)
-static struct cds_hlist_head tracepoint_table[TRACEPOINT_TABLE_SIZE];
+static struct cds_hlist_head tracepoint_table_init[1 << TP_HASH_INIT_BITS];
+static struct tp_hash_table tracepoint_table = {
+	.buckets = tracepoint_table_init,
+	.bits = TP_HASH_INIT_BITS,
+	.name = "tracepoint",
+};
 
 static CDS_LIST_HEAD(old_probes);
 static int need_update;
@@ -100,7 +133,7 @@ static int release_queue_need_update;
  * Tracepoint entries modifications are protected by the tracepoint mutex.
  */
 struct tracepoint_entry {
-	struct cds_hlist_node hlist;
+	struct tp_hash_node hnode;
 	struct lttng_ust_tracepoint_probe *probes;
 	int refcount;	/* Number of times armed. 0 if disarmed. */
 	int callsite_refcount;	/* how many libs use this tracepoint */
@@ -122,17 +155,95 @@ struct tp_probes {
  * Callsite hash table, containing the tracepoint call sites.
  * Protected by tracepoint mutex.
  */
-#define CALLSITE_HASH_BITS 12
-#define CALLSITE_TABLE_SIZE (1 << CALLSITE_HASH_BITS)
-static struct cds_hlist_head callsite_table[CALLSITE_TABLE_SIZE];
+static struct cds_hlist_head callsite_table_init[1 << TP_HASH_INIT_BITS];
+static struct tp_hash_table callsite_table = {
+	.buckets = callsite_table_init,
+	.bits = TP_HASH_INIT_BITS,
+	.name = "callsite",
+};
 
 struct callsite_entry {
-	struct cds_hlist_node hlist;	/* hash table node */
+	struct tp_hash_node hnode;	/* hash table node */
 	struct cds_list_head node;	/* lib list of callsites node */
 	struct lttng_ust_tracepoint *tp;
 	bool tp_entry_callsite_ref; /* Has a tp_entry took a ref on this callsite */
 };
 
+/*
+ * Sampling periods set by tracepoint name, applied to the tracepoints
+ * registered afterwards. Protected by tracepoint mutex.
+ */
+static CDS_LIST_HEAD(sample_periods);
+
+struct sample_period_entry {
+	struct cds_list_head node;
+	uint32_t period;
+	char name[LTTNG_UST_ABI_SYM_NAME_LEN];	/* provider:name */
+};
+
+static uint32_t tp_hash(const char *provider_name, const char *event_name)
+{
+	return jhash(provider_name, strlen(provider_name), 0) ^
+		jhash(event_name, strlen(event_name), 0);
+}
+
+static struct cds_hlist_head *tp_hash_bucket(struct tp_hash_table *table, uint32_t hash)
+{
+	return &table->buckets[hash & ((1UL << table->bits) - 1)];
+}
+
+/*
+ * Double the number of buckets of the table. The table keeps its
+ * current buckets if the allocation fails: lookups remain correct, only
+ * with longer chains.
+ */
+static void tp_hash_grow(struct tp_hash_table *table)
+{
+	unsigned long i, old_size = 1UL << table->bits;
+	struct cds_hlist_head *buckets;
+
+	buckets = zmalloc(2 * old_size * sizeof(*buckets));
+	if (!buckets) {
+		DBG("Unable to grow %s hash table beyond %lu buckets", table->name, old_size);
+		return;
+	}
+	for (i = 0; i < old_size; i++) {
+		struct cds_hlist_node *pos, *p;
+
+		for (pos = table->buckets[i].next; pos; pos = p) {
+			struct tp_hash_node *hnode =
+				caa_container_of(pos, struct tp_hash_node, hlist);
+
+			p = pos->next;
+			cds_hlist_add_head(&hnode->hlist,
+				&buckets[hnode->hash & (2 * old_size - 1)]);
+		}
+	}
+	if (table->bits > TP_HASH_INIT_BITS)
+		free(table->buckets);
+	table->buckets = buckets;
+	table->bits++;
+	DBG("Grew %s hash table to %lu buckets for %lu entries",
+		table->name, 2 * old_size, table->nr_entries);
+}
+
+static void tp_hash_add(struct tp_hash_table *table, struct tp_hash_node *hnode,
+		uint32_t hash)
+{
+	hnode->hash = hash;
+	cds_hlist_add_head(&hnode->hlist, tp_hash_bucket(table, hash));
+	table->nr_entries++;
+	if (table->bits < TP_HASH_MAX_BITS
+			&& table->nr_entries > ((unsigned long) TP_HASH_MAX_LOAD << table->bits))
+		tp_hash_grow(table);
+}
+
+static void tp_hash_del(struct tp_hash_table *table, struct tp_hash_node *hnode)
+{
+	cds_hlist_del(&hnode->hlist);
+	table->nr_entries--;
+}
+
 lttng_ust_static_assert(LTTNG_UST_TRACEPOINT_NAME_LEN_MAX == LTTNG_UST_ABI_SYM_NAME_LEN,
 		"Tracepoint name max length mismatch between UST ABI and tracepoint API",
 		Tracepoint_name_max_length_mismatch);
@@ -264,23 +375,29 @@ tracepoint_entry_remove_probe(struct tracepoint_entry *entry,
  * Must be called with tracepoint mutex held.
  * Returns NULL if not present.
  */
-static struct tracepoint_entry *get_tracepoint(const char *provider_name, const char *event_name)
+static struct tracepoint_entry *get_tracepoint_hash(const char *provider_name,
+		const char *event_name, uint32_t hash)
 {
 	struct cds_hlist_head *head;
 	struct cds_hlist_node *node;
 	struct tracepoint_entry *e;
-	uint32_t hash;
 
-	hash = jhash(provider_name, strlen(provider_name), 0) ^
-		jhash(event_name, strlen(event_name), 0);
-	head = &tracepoint_table[hash & (TRACEPOINT_TABLE_SIZE - 1)];
-	cds_hlist_for_each_entry(e, node, head, hlist) {
+	head = tp_hash_bucket(&tracepoint_table, hash);
+	cds_hlist_for_each_entry(e, node, head, hnode.hlist) {
+		if (e->hnode.hash != hash)
+			continue;
 		if (!strcmp(event_name, e->event_name) && !strcmp(provider_name, e->provider_name))
 			return e;
 	}
 	return NULL;
 }
 
+static struct tracepoint_entry *get_tracepoint(const char *provider_name, const char *event_name)
+{
+	return get_tracepoint_hash(provider_name, event_name,
+		tp_hash(provider_name, event_name));
+}
+
 /*
  * Add the tracepoint to the tracepoint hash table. Must be called with
  * tracepoint mutex held.
@@ -288,8 +405,6 @@ static struct tracepoint_entry *get_tracepoint(const char *provider_name, const
 static struct tracepoint_entry *add_tracepoint(const char *provider_name, const char *event_name,
 		const char *signature)
 {
-	struct cds_hlist_head *head;
-	struct cds_hlist_node *node;
 	struct tracepoint_entry *e;
 	size_t sig_len = strlen(signature);
 	size_t sig_off, provider_name_off, event_name_off;
@@ -299,12 +414,9 @@ static struct tracepoint_entry *add_tracepoint(const char *provider_name, const
 
 	hash = jhash(provider_name, provider_name_len, 0) ^
 		jhash(event_name, event_name_len, 0);
-	head = &tracepoint_table[hash & (TRACEPOINT_TABLE_SIZE - 1)];
-	cds_hlist_for_each_entry(e, node, head, hlist) {
-		if (!strcmp(event_name, e->event_name) && !strcmp(provider_name, e->provider_name)) {
-			DBG("tracepoint \"%s:%s\" busy", provider_name, event_name);
-			return ERR_PTR(-EEXIST);	/* Already there */
-		}
+	if (get_tracepoint_hash(provider_name, event_name, hash)) {
+		DBG("tracepoint \"%s:%s\" busy", provider_name, event_name);
+		return ERR_PTR(-EEXIST);	/* Already there */
 	}
 
 	/*
@@ -335,7 +447,7 @@ static struct tracepoint_entry *add_tracepoint(const char *provider_name, const
 	e->refcount = 0;
 	e->callsite_refcount = 0;
 
-	cds_hlist_add_head(&e->hlist, head);
+	tp_hash_add(&tracepoint_table, &e->hnode, hash);
 	return e;
 }
 
@@ -345,10 +457,23 @@ static struct tracepoint_entry *add_tracepoint(const char *provider_name, const
  */
 static void remove_tracepoint(struct tracepoint_entry *e)
 {
-	cds_hlist_del(&e->hlist);
+	tp_hash_del(&tracepoint_table, &e->hnode);
 	free(e);
 }
 
+/*
+ * Static branch call site ranges (struct static_branch_range), one per
+ * module. Protected by tracepoint mutex.
+ */
+static CDS_LIST_HEAD(static_branch_ranges);
+
+struct static_branch_range {
+	struct cds_list_head node;
+	struct lttng_ust_tracepoint_static_branch *start;
+	int count;
+	bool failed;	/* Patching is not permitted for this module. */
+};
+
 /*
  * Sets the probe callback corresponding to one tracepoint.
  */
@@ -398,13 +523,45 @@ static void disable_tracepoint(struct lttng_ust_tracepoint *elem)
 	lttng_ust_rcu_assign_pointer(elem->probes, NULL);
 }
 
+/*
+ * Set the sampling period of a tracepoint, if it is recent enough to
+ * have one. Must be called with tracepoint mutex held.
+ */
+static void set_tracepoint_sample_period(struct lttng_ust_tracepoint *tp,
+		uint32_t period)
+{
+	if (tp->struct_size < offsetof(struct lttng_ust_tracepoint, sample_period)
+			+ sizeof(tp->sample_period))
+		return;
+	CMM_STORE_SHARED(tp->sample_period, period);
+}
+
+/*
+ * Apply the sampling period set by name, if any, to a tracepoint with a
+ * valid name. Must be called with tracepoint mutex held.
+ */
+static void sync_tracepoint_sample_period(struct lttng_ust_tracepoint *tp)
+{
+	struct sample_period_entry *e;
+	char name[LTTNG_UST_ABI_SYM_NAME_LEN];
+
+	if (cds_list_empty(&sample_periods))
+		return;
+	snprintf(name, sizeof(name), "%s:%s", tp->provider_name, tp->event_name);
+	cds_list_for_each_entry(e, &sample_periods, node) {
+		if (!strcmp(e->name, name)) {
+			set_tracepoint_sample_period(tp, e->period);
+			return;
+		}
+	}
+}
+
 /*
  * Add the callsite to the callsite hash table. Must be called with
  * tracepoint mutex held.
  */
 static void add_callsite(struct tracepoint_lib * lib, struct lttng_ust_tracepoint *tp)
 {
-	struct cds_hlist_head *head;
 	struct callsite_entry *e;
 	uint32_t hash;
 	struct tracepoint_entry *tp_entry;
@@ -414,19 +571,18 @@ static void add_callsite(struct tracepoint_lib * lib, struct lttng_ust_tracepoin
 			tp->provider_name, tp->event_name, LTTNG_UST_TRACEPOINT_NAME_LEN_MAX - 1);
 		return;
 	}
-	hash = jhash(tp->provider_name, strlen(tp->provider_name), 0) ^
-		jhash(tp->event_name, strlen(tp->event_name), 0);
-	head = &callsite_table[hash & (CALLSITE_TABLE_SIZE - 1)];
+	hash = tp_hash(tp->provider_name, tp->event_name);
 	e = zmalloc(sizeof(struct callsite_entry));
 	if (!e) {
 		PERROR("Unable to add callsite for tracepoint \"%s:%s\"", tp->provider_name, tp->event_name);
 		return;
 	}
-	cds_hlist_add_head(&e->hlist, head);
+	tp_hash_add(&callsite_table, &e->hnode, hash);
 	e->tp = tp;
 	cds_list_add(&e->node, &lib->callsites);
+	sync_tracepoint_sample_period(tp);
 
-	tp_entry = get_tracepoint(tp->provider_name, tp->event_name);
+	tp_entry = get_tracepoint_hash(tp->provider_name, tp->event_name, hash);
 	if (!tp_entry)
 		return;
 	tp_entry->callsite_refcount++;
@@ -441,14 +597,15 @@ static void remove_callsite(struct callsite_entry *e)
 {
 	struct tracepoint_entry *tp_entry;
 
-	tp_entry = get_tracepoint(e->tp->provider_name, e->tp->event_name);
+	tp_entry = get_tracepoint_hash(e->tp->provider_name, e->tp->event_name,
+			e->hnode.hash);
 	if (tp_entry) {
 		if (e->tp_entry_callsite_ref)
 			tp_entry->callsite_refcount--;
 		if (tp_entry->callsite_refcount == 0)
 			disable_tracepoint(e->tp);
 	}
-	cds_hlist_del(&e->hlist);
+	tp_hash_del(&callsite_table, &e->hnode);
 	cds_list_del(&e->node);
 	free(e);
 }
@@ -466,13 +623,14 @@ static void tracepoint_sync_callsites(const char *provider_name, const char *eve
 	struct callsite_entry *e;
 	uint32_t hash;
 
-	tp_entry = get_tracepoint(provider_name, event_name);
-	hash = jhash(provider_name, strlen(provider_name), 0) ^
-		jhash(event_name, strlen(event_name), 0);
-	head = &callsite_table[hash & (CALLSITE_TABLE_SIZE - 1)];
-	cds_hlist_for_each_entry(e, node, head, hlist) {
+	hash = tp_hash(provider_name, event_name);
+	tp_entry = get_tracepoint_hash(provider_name, event_name, hash);
+	head = tp_hash_bucket(&callsite_table, hash);
+	cds_hlist_for_each_entry(e, node, head, hnode.hlist) {
 		struct lttng_ust_tracepoint *tp = e->tp;
 
+		if (e->hnode.hash != hash)
+			continue;
 		if (strcmp(event_name, tp->event_name))
 			continue;
 		if (strcmp(provider_name, tp->provider_name))
@@ -573,6 +731,319 @@ static void tracepoint_update_probes(void)
 		lib_update_tracepoints(lib);
 }
 
+#if defined(__x86_64__)
+
+#define STATIC_BRANCH_INSN_LEN	5
+#define STATIC_BRANCH_JMP	0xe9
+#define STATIC_BRANCH_INT3	0xcc
+
+#ifndef __NR_membarrier
+# define __NR_membarrier	324
+#endif
+
+enum static_branch_membarrier_cmd {
+	STATIC_BRANCH_MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE		= (1 << 5),
+	STATIC_BRANCH_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE	= (1 << 6),
+};
+
+static const uint8_t static_branch_nop[STATIC_BRANCH_INSN_LEN] = {
+	0x0f, 0x1f, 0x44, 0x00, 0x00,	/* nopl 0x0(%rax,%rax,1) */
+};
+
+static int static_branch_sync_core_registered;
+
+static void static_branch_make_insn(const struct lttng_ust_tracepoint_static_branch *branch,
+		bool enabled, uint8_t *insn)
+{
+	int32_t rel;
+
+	if (!enabled) {
+		memcpy(insn, static_branch_nop, STATIC_BRANCH_INSN_LEN);
+		return;
+	}
+	rel = (int32_t) ((uintptr_t) branch->target -
+		((uintptr_t) branch->site + STATIC_BRANCH_INSN_LEN));
+	insn[0] = STATIC_BRANCH_JMP;
+	memcpy(&insn[1], &rel, sizeof(rel));
+}
+
+/*
+ * Make sure no thread keeps executing a prefetched stale instruction.
+ * The int3 patching protocol below depends on it, so call sites are
+ * only patched once the process is registered for core serialization.
+ */
+static bool static_branch_sync_core_init(void)
+{
+	if (!static_branch_sync_core_registered) {
+		if (syscall(__NR_membarrier,
+				STATIC_BRANCH_MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE, 0))
+			static_branch_sync_core_registered = -1;
+		else
+			static_branch_sync_core_registered = 1;
+	}
+	return static_branch_sync_core_registered > 0;
+}
+
+static int static_branch_sync_core(void)
+{
+	if (syscall(__NR_membarrier,
+			STATIC_BRANCH_MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE, 0))
+		return -errno;
+	return 0;
+}
+
+/*
+ * Range being patched, read by the SIGTRAP handler. Set while the range
+ * has call sites starting with an int3, which stays the case if patching
+ * fails midway.
+ */
+static struct static_branch_range *static_branch_patching;
+static struct sigaction static_branch_old_trap;
+static bool static_branch_trap_installed;
+
+/*
+ * A thread executing a call site being patched hits its int3: resume at
+ * the tracepoint state check, which is correct whether the call site is
+ * becoming a jump or a nop. Other traps go to the previous handler.
+ */
+static void static_branch_trap(int sig, siginfo_t *info, void *context)
+{
+	ucontext_t *uc = context;
+	struct static_branch_range *range = CMM_LOAD_SHARED(static_branch_patching);
+	uintptr_t site = (uintptr_t) uc->uc_mcontext.gregs[REG_RIP] - 1;
+	int i;
+
+	if (range) {
+		for (i = 0; i < range->count; i++) {
+			if ((uintptr_t) range->start[i].site != site)
+				continue;
+			uc->uc_mcontext.gregs[REG_RIP] = (greg_t) range->start[i].target;
+			return;
+		}
+	}
+	if (static_branch_old_trap.sa_flags & SA_SIGINFO) {
+		static_branch_old_trap.sa_sigaction(sig, info, context);
+	} else if (static_branch_old_trap.sa_handler == SIG_DFL) {
+		(void) sigaction(SIGTRAP, &static_branch_old_trap, NULL);
+		(void) raise(SIGTRAP);
+	} else if (static_branch_old_trap.sa_handler != SIG_IGN) {
+		static_branch_old_trap.sa_handler(sig);
+	}
+}
+
+static int static_branch_trap_install(void)
+{
+	struct sigaction act;
+
+	if (static_branch_trap_installed)
+		return 0;
+	memset(&act, 0, sizeof(act));
+	act.sa_sigaction = static_branch_trap;
+	act.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&act.sa_mask);
+	if (sigaction(SIGTRAP, &act, &static_branch_old_trap))
+		return -errno;
+	static_branch_trap_installed = true;
+	return 0;
+}
+
+static void static_branch_trap_uninstall(void)
+{
+	/* Call sites still start with an int3: keep handling their traps. */
+	if (!static_branch_trap_installed || CMM_LOAD_SHARED(static_branch_patching))
+		return;
+	if (!sigaction(SIGTRAP, &static_branch_old_trap, NULL))
+		static_branch_trap_installed = false;
+}
+
+/*
+ * Write code through /proc/self/mem, which does not require the code
+ * pages to be made writable.
+ */
+static int static_branch_poke(int mem_fd, void *addr, const uint8_t *bytes, size_t len)
+{
+	ssize_t ret;
+
+	ret = pwrite(mem_fd, bytes, len, (off_t) (uintptr_t) addr);
+	if (ret < 0)
+		return -errno;
+	if ((size_t) ret != len)
+		return -EIO;
+	return 0;
+}
+
+static bool static_branch_stale(const struct lttng_ust_tracepoint_static_branch *branch,
+		uint8_t *insn)
+{
+	if (!branch->site || !branch->tp
+			|| ((uintptr_t) branch->site & (sizeof(uint64_t) - 1)))
+		return false;
+	static_branch_make_insn(branch, !!CMM_LOAD_SHARED(branch->tp->state), insn);
+	return memcmp(branch->site, insn, STATIC_BRANCH_INSN_LEN) != 0;
+}
+
+/*
+ * Patch the call sites of a range which do not match the state of their
+ * tracepoint, following the cross-modifying code protocol: write an int3
+ * over the first byte of each call site, serialize all cores, write the
+ * last bytes of the new instructions, serialize, write their first
+ * bytes, and serialize again. A thread executing a call site meanwhile
+ * either runs the old instruction, the new one, or traps into
+ * static_branch_trap(). Returns the number of call sites modified, or a
+ * negative error value.
+ */
+static int static_branch_range_update(struct static_branch_range *range, int mem_fd)
+{
+	const uint8_t int3 = STATIC_BRANCH_INT3;
+	uint8_t insn[STATIC_BRANCH_INSN_LEN];
+	int i, ret = 0, nr_patched = 0;
+
+	CMM_STORE_SHARED(static_branch_patching, range);
+	cmm_smp_mb();
+	for (i = 0; i < range->count; i++) {
+		struct lttng_ust_tracepoint_static_branch *branch = &range->start[i];
+
+		if (!static_branch_stale(branch, insn))
+			continue;
+		ret = static_branch_poke(mem_fd, branch->site, &int3, 1);
+		if (ret) {
+			/*
+			 * The protection policy is per process, so this
+			 * fails on the first write, while all the call
+			 * sites of the range still jump to the state check.
+			 */
+			if (!nr_patched)
+				goto end;
+			goto error;
+		}
+		nr_patched++;
+	}
+	if (!nr_patched)
+		goto end;
+	ret = static_branch_sync_core();
+	if (ret)
+		goto error;
+	for (i = 0; i < range->count; i++) {
+		struct lttng_ust_tracepoint_static_branch *branch = &range->start[i];
+
+		if (!branch->site || *(uint8_t *) branch->site != STATIC_BRANCH_INT3)
+			continue;
+		static_branch_make_insn(branch, !!CMM_LOAD_SHARED(branch->tp->state), insn);
+		ret = static_branch_poke(mem_fd, (uint8_t *) branch->site + 1,
+			&insn[1], STATIC_BRANCH_INSN_LEN - 1);
+		if (ret)
+			goto error;
+	}
+	ret = static_branch_sync_core();
+	if (ret)
+		goto error;
+	for (i = 0; i < range->count; i++) {
+		struct lttng_ust_tracepoint_static_branch *branch = &range->start[i];
+
+		if (!branch->site || *(uint8_t *) branch->site != STATIC_BRANCH_INT3)
+			continue;
+		static_branch_make_insn(branch, !!CMM_LOAD_SHARED(branch->tp->state), insn);
+		ret = static_branch_poke(mem_fd, branch->site, insn, 1);
+		if (ret)
+			goto error;
+	}
+	ret = static_branch_sync_core();
+	if (ret)
+		goto error;
+end:
+	if (ret) {
+		DBG("Unable to patch static branches at %p (%d), keeping the tracepoint state checks",
+			range->start, ret);
+		range->failed = true;
+	}
+	cmm_smp_mb();
+	CMM_STORE_SHARED(static_branch_patching, NULL);
+	return ret ? ret : nr_patched;
+
+error:
+	/*
+	 * Some call sites start with an int3: leave the trap handler in
+	 * place to send the threads executing them to the state check.
+	 */
+	ERR("Static branch patching failed midway at %p (%d)", range->start, ret);
+	range->failed = true;
+	return ret;
+}
+
+/*
+ * Patch the static branch call sites of all modules according to the
+ * state of their tracepoints. Called after the tracepoint states are
+ * updated: enabling a tracepoint sets its state before the call sites
+ * jump to the state check, and disabling it clears its state before the
+ * call sites are turned into nops. The code pages are never made
+ * writable; if the process cannot serialize cores, write its code
+ * through /proc/self/mem or handle SIGTRAP, the call sites keep jumping
+ * to the state check.
+ * Must be called with tracepoint mutex held.
+ */
+static void static_branch_update(void)
+{
+	struct static_branch_range *range;
+	int mem_fd = -1;
+
+	cds_list_for_each_entry(range, &static_branch_ranges, node) {
+		uint8_t insn[STATIC_BRANCH_INSN_LEN];
+		int i;
+
+		if (range->failed || CMM_LOAD_SHARED(static_branch_patching))
+			continue;
+		for (i = 0; i < range->count; i++) {
+			if (static_branch_stale(&range->start[i], insn))
+				break;
+		}
+		if (i == range->count)
+			continue;
+		if (mem_fd < 0) {
+			if (!static_branch_sync_core_init())
+				return;
+			mem_fd = open("/proc/self/mem", O_RDWR | O_CLOEXEC);
+			if (mem_fd < 0) {
+				DBG("Unable to open /proc/self/mem (%d), keeping the tracepoint state checks",
+					-errno);
+				return;
+			}
+			if (static_branch_trap_install())
+				goto end;
+		}
+		(void) static_branch_range_update(range, mem_fd);
+	}
+end:
+	if (mem_fd >= 0) {
+		static_branch_trap_uninstall();
+		if (close(mem_fd))
+			PERROR("close");
+	}
+}
+
+/*
+ * The module is being unloaded: its call sites are not executed anymore.
+ * Must be called with tracepoint mutex held.
+ */
+static void static_branch_range_free(struct static_branch_range *range)
+{
+	if (CMM_LOAD_SHARED(static_branch_patching) == range)
+		CMM_STORE_SHARED(static_branch_patching, NULL);
+	free(range);
+}
+
+#else	/* #if defined(__x86_64__) */
+
+static void static_branch_update(void)
+{
+}
+
+static void static_branch_range_free(struct static_branch_range *range)
+{
+	free(range);
+}
+
+#endif	/* #else #if defined(__x86_64__) */
+
 static struct lttng_ust_tracepoint_probe *
 tracepoint_add_probe(const char *provider_name, const char *event_name,
 		void (*probe)(void), void *data, const char *signature)
@@ -675,6 +1146,7 @@ int lttng_ust_tracepoint_provider_register(const char *provider_name, const char
 	}
 
 	tracepoint_sync_callsites(provider_name, event_name);
+	static_branch_update();
 	release_probes(old);
 end:
 	pthread_mutex_unlock(&tracepoint_mutex);
@@ -702,6 +1174,7 @@ int lttng_ust_tp_probe_register_queue_release(const char *provider_name, const c
 	}
 
 	tracepoint_sync_callsites(provider_name, event_name);
+	static_branch_update();
 	tracepoint_release_queue_add_old_probes(old);
 end:
 	pthread_mutex_unlock(&tracepoint_mutex);
@@ -747,6 +1220,7 @@ int lttng_ust_tracepoint_provider_unregister(const char *provider_name, const ch
 		goto end;
 	}
 	tracepoint_sync_callsites(provider_name, event_name);
+	static_branch_update();
 	release_probes(old);
 end:
 	pthread_mutex_unlock(&tracepoint_mutex);
@@ -773,6 +1247,7 @@ int lttng_ust_tp_probe_unregister_queue_release(const char *provider_name, const
 		goto end;
 	}
 	tracepoint_sync_callsites(provider_name, event_name);
+	static_branch_update();
 	tracepoint_release_queue_add_old_probes(old);
 end:
 	pthread_mutex_unlock(&tracepoint_mutex);
@@ -804,6 +1279,107 @@ end:
 	pthread_mutex_unlock(&tracepoint_mutex);
 }
 
+/*
+ * Set the sampling period of the lttng_ust_tracepoint_sampled() call
+ * sites of the tracepoint @name ("provider:name"), registered or not.
+ * A zero period restores the period of each call site.
+ */
+int lttng_ust_tp_set_sample_period(const char *name, uint32_t period)
+{
+	char provider_name[LTTNG_UST_ABI_SYM_NAME_LEN];
+	struct sample_period_entry *e, *found = NULL;
+	struct cds_hlist_head *head;
+	struct cds_hlist_node *node;
+	struct callsite_entry *ce;
+	const char *event_name;
+	size_t provider_len;
+	uint32_t hash;
+	int ret = 0;
+
+	if (strlen(name) >= LTTNG_UST_ABI_SYM_NAME_LEN)
+		return -EINVAL;
+	event_name = strchr(name, ':');
+	if (!event_name || event_name == name || !event_name[1])
+		return -EINVAL;
+	provider_len = event_name - name;
+	memcpy(provider_name, name, provider_len);
+	provider_name[provider_len] = '\0';
+	event_name++;
+
+	lttng_ust_tp_init();
+	pthread_mutex_lock(&tracepoint_mutex);
+	cds_list_for_each_entry(e, &sample_periods, node) {
+		if (!strcmp(e->name, name)) {
+			found = e;
+			break;
+		}
+	}
+	if (!period && found) {
+		cds_list_del(&found->node);
+		free(found);
+	} else if (period && found) {
+		found->period = period;
+	} else if (period) {
+		found = zmalloc(sizeof(*found));
+		if (!found) {
+			ret = -ENOMEM;
+			goto end;
+		}
+		strcpy(found->name, name);
+		found->period = period;
+		cds_list_add(&found->node, &sample_periods);
+	}
+
+	hash = tp_hash(provider_name, event_name);
+	head = tp_hash_bucket(&callsite_table, hash);
+	cds_hlist_for_each_entry(ce, node, head, hnode.hlist) {
+		if (ce->hnode.hash != hash)
+			continue;
+		if (strcmp(event_name, ce->tp->event_name))
+			continue;
+		if (strcmp(provider_name, ce->tp->provider_name))
+			continue;
+		set_tracepoint_sample_period(ce->tp, period);
+	}
+end:
+	pthread_mutex_unlock(&tracepoint_mutex);
+	return ret;
+}
+
+/*
+ * Set by liblttng-ust: tells whether the event @data passed to a probe
+ * may be recorded by a call from @ip, without its payload.
+ */
+void lttng_ust_tp_set_probe_accept_cb(int (*cb)(void *data, void *ip))
+{
+	CMM_STORE_SHARED(probe_accept_cb, cb);
+}
+
+/*
+ * Called by the lttng_ust_tracepoint_may_record() call sites: returns 1
+ * when at least one probe connected to @tp may record the event, 0 when
+ * they would all discard it whatever its payload.
+ */
+int lttng_ust_tp_probe_may_record(struct lttng_ust_tracepoint *tp);
+int lttng_ust_tp_probe_may_record(struct lttng_ust_tracepoint *tp)
+{
+	int (*accept)(void *data, void *ip) = CMM_LOAD_SHARED(probe_accept_cb);
+	void *ip = __builtin_return_address(0);
+	struct lttng_ust_tracepoint_probe *probe;
+	int ret = 0;
+
+	lttng_ust_urcu_read_lock();
+	probe = lttng_ust_rcu_dereference(tp->probes);
+	for (; probe && probe->func; probe++) {
+		if (!accept || accept(probe->data, ip)) {
+			ret = 1;
+			break;
+		}
+	}
+	lttng_ust_urcu_read_unlock();
+	return ret;
+}
+
 static void tracepoint_add_old_probes(void *old)
 {
 	need_update = 1;
@@ -884,6 +1460,7 @@ void tracepoint_probe_update_all(void)
 	need_update = 0;
 
 	tracepoint_update_probes();
+	static_branch_update();
 	/* Wait for grace period between update_probes and free. */
 	lttng_ust_urcu_synchronize_rcu();
 	cds_list_for_each_entry_safe(pos, next, &release_probes, u.list) {
@@ -955,6 +1532,7 @@ lib_added:
 	new_tracepoints(tracepoints_start, tracepoints_start + tracepoints_count);
 	lib_register_callsites(pl);
 	lib_update_tracepoints(pl);
+	static_branch_update();
 	pthread_mutex_unlock(&tracepoint_mutex);
 
 	DBG("just registered a tracepoints section from %p and having %d tracepoints",
@@ -997,6 +1575,57 @@ int lttng_ust_tracepoint_module_unregister(struct lttng_ust_tracepoint * const *
 		free(lib);
 		break;
 	}
+	static_branch_update();
+	pthread_mutex_unlock(&tracepoint_mutex);
+	return 0;
+}
+
+/*
+ * lttng_ust_tracepoint_static_branch_{un,}register are looked up by
+ * instrumented applications through dlsym(), after registering their
+ * tracepoints. Call sites of modules which cannot find those symbols
+ * keep jumping to the tracepoint state check.
+ */
+int lttng_ust_tracepoint_static_branch_register(struct lttng_ust_tracepoint_static_branch *branches_start,
+		int branches_count)
+{
+	struct static_branch_range *range;
+
+	if (branches_count <= 0)
+		return 0;
+	range = zmalloc(sizeof(struct static_branch_range));
+	if (!range) {
+		PERROR("Unable to register static branches");
+		return -1;
+	}
+	range->start = branches_start;
+	range->count = branches_count;
+
+	pthread_mutex_lock(&tracepoint_mutex);
+	cds_list_add(&range->node, &static_branch_ranges);
+	static_branch_update();
+	pthread_mutex_unlock(&tracepoint_mutex);
+
+	DBG("just registered a static branches section from %p and having %d call sites",
+		branches_start, branches_count);
+	return 0;
+}
+
+int lttng_ust_tracepoint_static_branch_unregister(struct lttng_ust_tracepoint_static_branch *branches_start)
+{
+	struct static_branch_range *range;
+
+	pthread_mutex_lock(&tracepoint_mutex);
+	cds_list_for_each_entry(range, &static_branch_ranges, node) {
+		if (range->start != branches_start)
+			continue;
+
+		cds_list_del(&range->node);
+		DBG("just unregistered a static branches section from %p",
+			range->start);
+		static_branch_range_free(range);
+		break;
+	}
 	pthread_mutex_unlock(&tracepoint_mutex);
 	return 0;
 }
@@ -7,9 +7,85 @@
 #ifndef _LTTNG_UST_CONTEXT_INTERNAL_H
 #define _LTTNG_UST_CONTEXT_INTERNAL_H
 
+#include <sys/types.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
 #include <lttng/ust-events.h>
 #include "lib/lttng-ust/events.h"
 #include "common/ust-context-provider.h"
+#include "common/ns.h"
+
+/*
+ * Number of distinct thread names the procname_id context can intern.
+ * Threads whose name does not fit in the table record the overflow id.
+ */
+#define LTTNG_UST_PROCNAME_ID_MAX	1024
+#define LTTNG_UST_PROCNAME_ID_OVERFLOW	UINT16_MAX
+
+/*
+ * Process-wide cache of a namespace inode number, so a new thread does
+ * not have to stat(2) the proc filesystem to populate its per-thread
+ * cache when all threads of the process are known to share the same
+ * namespaces.
+ *
+ * lttng_ns_cache_generation is bumped after fork in the child, which
+ * invalidates all entries. Its lowest bit is set once a thread of the
+ * process changed its namespaces through setns(2) or unshare(2): threads
+ * may then be in different namespaces, so the process-wide cache is not
+ * used anymore until the next fork.
+ */
+#define LTTNG_NS_CACHE_DIVERGED		1UL
+#define LTTNG_NS_CACHE_GENERATION_INIT	2UL
+
+struct lttng_ns_cache {
+	ino_t ino;
+	unsigned long generation;
+};
+
+extern unsigned long lttng_ns_cache_generation
+	__attribute__((visibility("hidden")));
+
+/*
+ * Return the cached inode number, or NS_INO_UNINITIALIZED. The
+ * generation must be passed to lttng_ns_cache_set() after populating
+ * the cache.
+ */
+static inline
+ino_t lttng_ns_cache_get(const struct lttng_ns_cache *cache,
+		unsigned long *generation)
+{
+	unsigned long gen = CMM_LOAD_SHARED(lttng_ns_cache_generation);
+
+	*generation = gen;
+	if (gen & LTTNG_NS_CACHE_DIVERGED)
+		return NS_INO_UNINITIALIZED;
+	cmm_smp_rmb();
+	if (CMM_LOAD_SHARED(cache->generation) != gen)
+		return NS_INO_UNINITIALIZED;
+	cmm_smp_rmb();
+	return CMM_LOAD_SHARED(cache->ino);
+}
+
+/*
+ * All threads populating the cache within a generation store the same
+ * inode number, so the entry is never torn.
+ */
+static inline
+void lttng_ns_cache_set(struct lttng_ns_cache *cache, ino_t ino,
+		unsigned long generation)
+{
+	if (generation & LTTNG_NS_CACHE_DIVERGED)
+		return;
+	CMM_STORE_SHARED(cache->ino, ino);
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(cache->generation, generation);
+}
+
+void lttng_ns_cache_diverge(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_ns_cache_reset(void)
+	__attribute__((visibility("hidden")));
 
 int lttng_context_init_all(struct lttng_ust_ctx **ctx)
 	__attribute__((visibility("hidden")));
@@ -36,6 +112,9 @@ int lttng_ust_context_append(struct lttng_ust_ctx **ctx_p,
 		const struct lttng_ust_ctx_field *f)
 	__attribute__((visibility("hidden")));
 
+void lttng_ust_context_remove_last(struct lttng_ust_ctx *ctx)
+	__attribute__((visibility("hidden")));
+
 void lttng_context_vtid_reset(void)
 	__attribute__((visibility("hidden")));
 
@@ -84,6 +163,21 @@ void lttng_context_vegid_reset(void)
 void lttng_context_vsgid_reset(void)
 	__attribute__((visibility("hidden")));
 
+pid_t lttng_context_vpid_get(void)
+	__attribute__((visibility("hidden")));
+
+pid_t lttng_context_vtid_get(void)
+	__attribute__((visibility("hidden")));
+
+uid_t lttng_context_vuid_get(void)
+	__attribute__((visibility("hidden")));
+
+gid_t lttng_context_vgid_get(void)
+	__attribute__((visibility("hidden")));
+
+const char *lttng_context_procname_get(void)
+	__attribute__((visibility("hidden")));
+
 int lttng_add_vtid_to_ctx(struct lttng_ust_ctx **ctx)
 	__attribute__((visibility("hidden")));
 
@@ -96,6 +190,25 @@ int lttng_add_pthread_id_to_ctx(struct lttng_ust_ctx **ctx)
 int lttng_add_procname_to_ctx(struct lttng_ust_ctx **ctx)
 	__attribute__((visibility("hidden")));
 
+int lttng_add_procname_id_to_ctx(struct lttng_ust_ctx **ctx)
+	__attribute__((visibility("hidden")));
+
+int lttng_add_identity_to_ctx(struct lttng_ust_ctx **ctx)
+	__attribute__((visibility("hidden")));
+
+int lttng_context_time_ns_get_offsets(ino_t *time_ns, int64_t *monotonic,
+		int64_t *boottime)
+	__attribute__((visibility("hidden")));
+
+int lttng_add_callstack_to_ctx(uint32_t max_depth, struct lttng_ust_ctx **ctx)
+	__attribute__((visibility("hidden")));
+
+unsigned int lttng_ust_procname_id_count(void)
+	__attribute__((visibility("hidden")));
+
+const char *lttng_ust_procname_id_name(unsigned int id)
+	__attribute__((visibility("hidden")));
+
 int lttng_add_ip_to_ctx(struct lttng_ust_ctx **ctx)
 	__attribute__((visibility("hidden")));
 
@@ -10,7 +10,10 @@
 #include <stddef.h>
 #include <lttng/ust-events.h>
 
+#include "common/dynamic-type.h"
+
 void lttng_ust_context_set_event_notifier_group_provider(const char *name,
+		enum lttng_ust_dynamic_type fixed_type,
 		size_t (*get_size)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
 			size_t offset),
 		void (*record)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
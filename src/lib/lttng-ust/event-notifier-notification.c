@@ -9,15 +9,24 @@
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include <lttng/ust-endian.h>
 #include "common/logging.h"
 #include <urcu/rculist.h>
+#include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
 
 #include "lttng-tracer-core.h"
 #include "lib/lttng-ust/events.h"
 #include "common/msgpack/msgpack.h"
+#include "common/ringbuffer/frontend.h"
 #include "lttng-bytecode.h"
+#include "common/getenv.h"
 #include "common/patient.h"
 
 /*
@@ -30,10 +39,17 @@
 #define CAPTURE_BUFFER_SIZE \
 	(PIPE_BUF - sizeof(struct lttng_ust_abi_event_notifier_notification) - 1)
 
+/*
+ * The capture buffer directly follows the notification structure, so the
+ * notification is sent with a single contiguous write.
+ */
 struct lttng_event_notifier_notification {
 	int notification_fd;
 	uint64_t event_notifier_token;
-	uint8_t capture_buf[CAPTURE_BUFFER_SIZE];
+	struct {
+		struct lttng_ust_abi_event_notifier_notification header;
+		uint8_t capture_buf[CAPTURE_BUFFER_SIZE];
+	} __attribute__((packed)) msg;
 	struct lttng_msgpack_writer writer;
 	bool has_captures;
 };
@@ -62,104 +78,6 @@ void capture_enum(struct lttng_msgpack_writer *writer,
 	lttng_msgpack_end_map(writer);
 }
 
-static
-int64_t capture_sequence_element_signed(uint8_t *ptr,
-		const struct lttng_ust_type_integer *integer_type)
-{
-	int64_t value;
-	unsigned int size = integer_type->size;
-	bool byte_order_reversed = integer_type->reverse_byte_order;
-
-	switch (size) {
-	case 8:
-		value = *ptr;
-		break;
-	case 16:
-	{
-		int16_t tmp;
-		tmp = *(int16_t *) ptr;
-		if (byte_order_reversed)
-			tmp = lttng_ust_bswap_16(tmp);
-
-		value = tmp;
-		break;
-	}
-	case 32:
-	{
-		int32_t tmp;
-		tmp = *(int32_t *) ptr;
-		if (byte_order_reversed)
-			tmp = lttng_ust_bswap_32(tmp);
-
-		value = tmp;
-		break;
-	}
-	case 64:
-	{
-		int64_t tmp;
-		tmp = *(int64_t *) ptr;
-		if (byte_order_reversed)
-			tmp = lttng_ust_bswap_64(tmp);
-
-		value = tmp;
-		break;
-	}
-	default:
-		abort();
-	}
-
-	return value;
-}
-
-static
-uint64_t capture_sequence_element_unsigned(uint8_t *ptr,
-		const struct lttng_ust_type_integer *integer_type)
-{
-	uint64_t value;
-	unsigned int size = integer_type->size;
-	bool byte_order_reversed = integer_type->reverse_byte_order;
-
-	switch (size) {
-	case 8:
-		value = *ptr;
-		break;
-	case 16:
-	{
-		uint16_t tmp;
-		tmp = *(uint16_t *) ptr;
-		if (byte_order_reversed)
-			tmp = lttng_ust_bswap_16(tmp);
-
-		value = tmp;
-		break;
-	}
-	case 32:
-	{
-		uint32_t tmp;
-		tmp = *(uint32_t *) ptr;
-		if (byte_order_reversed)
-			tmp = lttng_ust_bswap_32(tmp);
-
-		value = tmp;
-		break;
-	}
-	case 64:
-	{
-		uint64_t tmp;
-		tmp = *(uint64_t *) ptr;
-		if (byte_order_reversed)
-			tmp = lttng_ust_bswap_64(tmp);
-
-		value = tmp;
-		break;
-	}
-	default:
-		abort();
-	}
-
-	return value;
-}
-
 static
 void capture_sequence(struct lttng_msgpack_writer *writer,
 		struct lttng_interpreter_output *output)
@@ -167,10 +85,6 @@ void capture_sequence(struct lttng_msgpack_writer *writer,
 	const struct lttng_ust_type_integer *integer_type;
 	const struct lttng_ust_type_common *nested_type;
 	uint8_t *ptr;
-	bool signedness;
-	int i;
-
-	lttng_msgpack_begin_array(writer, output->u.sequence.nr_elem);
 
 	ptr = (uint8_t *) output->u.sequence.ptr;
 	nested_type = output->u.sequence.nested_type;
@@ -186,30 +100,18 @@ void capture_sequence(struct lttng_msgpack_writer *writer,
 		/* Capture of array of non-integer are not supported. */
 		abort();
 	}
-	signedness = integer_type->signedness;
-	for (i = 0; i < output->u.sequence.nr_elem; i++) {
-		if (signedness) {
-			lttng_msgpack_write_signed_integer(writer,
-				capture_sequence_element_signed(ptr, integer_type));
-		} else {
-			lttng_msgpack_write_unsigned_integer(writer,
-				capture_sequence_element_unsigned(ptr, integer_type));
-		}
-
-		/*
-		 * We assume that alignment is smaller or equal to the size.
-		 * This currently holds true but if it changes in the future,
-		 * we will want to change the pointer arithmetic below to
-		 * take into account that the next element might be further
-		 * away.
-		 */
-		assert(integer_type->alignment <= integer_type->size);
-
-		/* Size is in number of bits. */
-		ptr += (integer_type->size / CHAR_BIT) ;
-	}
+	/*
+	 * We assume that alignment is smaller or equal to the size, so that
+	 * the elements are contiguous. This currently holds true but if it
+	 * changes in the future, we will want to encode the elements one by
+	 * one, taking into account that the next element might be further
+	 * away.
+	 */
+	assert(integer_type->alignment <= integer_type->size);
 
-	lttng_msgpack_end_array(writer);
+	lttng_msgpack_write_integer_array(writer, ptr,
+		output->u.sequence.nr_elem, integer_type->size,
+		integer_type->signedness, integer_type->reverse_byte_order);
 }
 
 static
@@ -223,7 +125,7 @@ void notification_init(struct lttng_event_notifier_notification *notif,
 	notif->has_captures = false;
 
 	if (event_notifier->priv->num_captures > 0) {
-		lttng_msgpack_writer_init(writer, notif->capture_buf,
+		lttng_msgpack_writer_init(writer, notif->msg.capture_buf,
 				CAPTURE_BUFFER_SIZE);
 
 		lttng_msgpack_begin_array(writer, event_notifier->priv->num_captures);
@@ -280,60 +182,148 @@ static void record_error(const struct lttng_ust_event_notifier *event_notifier)
 
 	error_counter = CMM_LOAD_SHARED(event_notifier_group->error_counter);
 	/*
-	 * load-acquire paired with store-release orders creation of the
-	 * error counter and setting error_counter_len before the
-	 * error_counter is used.
-	 * Currently a full memory barrier is used, which could be
-	 * turned into acquire-release barriers.
+	 * Paired with the full memory barrier before the error counter is
+	 * published. Everything used here is reached through the
+	 * error_counter pointer, so a dependency barrier orders creation
+	 * of the counter before its use, without a full memory barrier on
+	 * each error.
 	 */
-	cmm_smp_mb();
+	cmm_smp_read_barrier_depends();
 	/* This group may not have an error counter attached to it. */
 	if (!error_counter)
 		return;
 
 	dimension_index[0] = event_notifier->priv->error_counter_index;
-	ret = event_notifier_group->error_counter->ops->counter_add(
-			error_counter->counter, dimension_index, 1);
+	ret = error_counter->ops->counter_add(error_counter->counter,
+			dimension_index, 1);
 	if (ret)
 		WARN_ON_ONCE(1);
 }
 
+/*
+ * Count the event notifier hits in per-CPU counter memory, aggregated by
+ * the session daemon with lttng_ust_ctl_counter_aggregate() when it reads
+ * the fire rates.
+ */
+static void record_hit(const struct lttng_ust_event_notifier *event_notifier)
+{
+	struct lttng_event_notifier_group *event_notifier_group =
+			event_notifier->priv->group;
+	struct lttng_counter *hit_counter;
+	size_t dimension_index[1];
+
+	hit_counter = CMM_LOAD_SHARED(event_notifier_group->hit_counter);
+	/* Paired with the full memory barrier before the counter is published. */
+	cmm_smp_read_barrier_depends();
+	if (!hit_counter)
+		return;
+
+	dimension_index[0] = event_notifier->priv->error_counter_index;
+	if (hit_counter->ops->counter_add(hit_counter->counter,
+			dimension_index, 1))
+		WARN_ON_ONCE(1);
+}
+
+/*
+ * Log2 bucket of a captured value, see
+ * LTTNG_UST_ABI_COUNTER_HISTOGRAM_NR_BUCKETS. Negative values and values
+ * which cannot be expressed as integers are accounted in bucket 0.
+ */
+static
+bool histogram_bucket(const struct lttng_interpreter_output *output, size_t *bucket)
+{
+	uint64_t v;
+
+	switch (output->type) {
+	case LTTNG_INTERPRETER_TYPE_S64:
+	case LTTNG_INTERPRETER_TYPE_SIGNED_ENUM:
+		v = output->u.s < 0 ? 0 : (uint64_t) output->u.s;
+		break;
+	case LTTNG_INTERPRETER_TYPE_U64:
+	case LTTNG_INTERPRETER_TYPE_UNSIGNED_ENUM:
+		v = output->u.u;
+		break;
+	case LTTNG_INTERPRETER_TYPE_DOUBLE:
+		if (!(output->u.d >= 1.0))
+			v = 0;
+		else if (output->u.d >= 18446744073709551616.0)
+			v = UINT64_MAX;
+		else
+			v = (uint64_t) output->u.d;
+		break;
+	default:
+		return false;
+	}
+	*bucket = v ? 64 - __builtin_clzll(v) : 0;
+	return true;
+}
+
+/*
+ * Aggregate the first capture of the event notifier into its histogram
+ * counter row instead of sending a notification. The update lands in
+ * per-CPU counter memory, read by the session daemon with
+ * lttng_ust_ctl_counter_aggregate().
+ */
+static
+void histogram_record(const struct lttng_ust_event_notifier *event_notifier,
+		const char *stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_notification_ctx *notif_ctx)
+{
+	struct lttng_event_notifier_group *event_notifier_group =
+			event_notifier->priv->group;
+	struct lttng_ust_bytecode_runtime *capture_bc_runtime;
+	struct lttng_interpreter_output output;
+	struct lttng_counter *histogram_counter;
+	size_t dimension_indexes[2];
+
+	histogram_counter = CMM_LOAD_SHARED(event_notifier_group->histogram_counter);
+	/* Paired with the full memory barrier before the counter is published. */
+	cmm_smp_read_barrier_depends();
+	if (!histogram_counter || !notif_ctx->eval_capture)
+		return;
+
+	/* Only the first capture is aggregated. */
+	cds_list_for_each_entry_rcu(capture_bc_runtime,
+			&event_notifier->priv->capture_bytecode_runtime_head, node) {
+		if (capture_bc_runtime->interpreter_func(capture_bc_runtime,
+				stack_data, probe_ctx, &output) != LTTNG_UST_BYTECODE_INTERPRETER_OK
+				|| !histogram_bucket(&output, &dimension_indexes[1])) {
+			record_error(event_notifier);
+			return;
+		}
+		dimension_indexes[0] = event_notifier->priv->histogram_counter_index;
+		if (histogram_counter->ops->counter_add(histogram_counter->counter,
+				dimension_indexes, 1))
+			record_error(event_notifier);
+		return;
+	}
+}
+
 static
 void notification_send(struct lttng_event_notifier_notification *notif,
 		const struct lttng_ust_event_notifier *event_notifier)
 {
+	struct lttng_ust_abi_event_notifier_notification *ust_notif = &notif->msg.header;
 	ssize_t ret;
 	size_t content_len;
-	int iovec_count = 1;
-	struct lttng_ust_abi_event_notifier_notification ust_notif = {0};
-	struct iovec iov[2];
 
 	assert(notif);
 
-	ust_notif.token = event_notifier->priv->parent.user_token;
-
-	/*
-	 * Prepare sending the notification from multiple buffers using an
-	 * array of `struct iovec`. The first buffer of the vector is
-	 * notification structure itself and is always present.
-	 */
-	iov[0].iov_base = &ust_notif;
-	iov[0].iov_len = sizeof(ust_notif);
+	memset(ust_notif, 0, sizeof(*ust_notif));
+	ust_notif->token = event_notifier->priv->parent.user_token;
+	if (caa_unlikely(CMM_LOAD_SHARED(event_notifier->priv->rate_dropped)))
+		ust_notif->suppressed = uatomic_xchg(&event_notifier->priv->rate_dropped, 0);
 
 	if (notif->has_captures) {
 		/*
-		 * If captures were requested, the second buffer of the array
-		 * is the capture buffer.
+		 * If captures were requested, the capture buffer follows the
+		 * notification structure.
 		 */
 		assert(notif->writer.buffer);
 		content_len = notif->writer.write_pos - notif->writer.buffer;
 
 		assert(content_len > 0 && content_len <= CAPTURE_BUFFER_SIZE);
-
-		iov[1].iov_base = notif->capture_buf;
-		iov[1].iov_len = content_len;
-
-		iovec_count++;
 	} else {
 		content_len = 0;
 	}
@@ -342,13 +332,18 @@ void notification_send(struct lttng_event_notifier_notification *notif,
 	 * Update the capture buffer size so that receiver of the buffer will
 	 * know how much to expect.
 	 */
-	ust_notif.capture_buf_size = content_len;
+	ust_notif->capture_buf_size = content_len;
 
-	/* Send all the buffers. */
-	ret = ust_patient_writev(notif->notification_fd, iov, iovec_count);
+	/* Send the notification and its capture buffer. */
+	ret = ust_patient_write(notif->notification_fd, &notif->msg,
+			sizeof(*ust_notif) + content_len);
 	if (ret == -1) {
 		if (errno == EAGAIN) {
 			record_error(event_notifier);
+			/* Report them with the next notification. */
+			if (ust_notif->suppressed)
+				uatomic_add(&event_notifier->priv->rate_dropped,
+					ust_notif->suppressed);
 			DBG("Cannot send event_notifier notification without blocking: %s",
 				strerror(errno));
 		} else {
@@ -359,19 +354,135 @@ void notification_send(struct lttng_event_notifier_notification *notif,
 	}
 }
 
-void lttng_event_notifier_notification_send(
+/*
+ * Maximum number of notifications sent per second by each event
+ * notifier, from the LTTNG_UST_EVENT_NOTIFIER_RATE_LIMIT environment
+ * variable. 0 (the default) means no limit.
+ */
+static unsigned long notification_rate_limit;
+static pthread_once_t notification_rate_limit_once = PTHREAD_ONCE_INIT;
+
+static
+void notification_rate_limit_init(void)
+{
+	const char *str;
+	char *endptr;
+	long val;
+
+	str = lttng_ust_getenv("LTTNG_UST_EVENT_NOTIFIER_RATE_LIMIT");
+	if (!str)
+		return;
+	errno = 0;
+	val = strtol(str, &endptr, 10);
+	if (errno || endptr == str || *endptr != '\0' || val < 0) {
+		WARN("Invalid LTTNG_UST_EVENT_NOTIFIER_RATE_LIMIT value \"%s\"", str);
+		return;
+	}
+	notification_rate_limit = (unsigned long) val;
+}
+
+/*
+ * Return true if the event notifier already sent its quota of
+ * notifications for the current one-second window. Notifications over the
+ * quota are dropped and counted apart from the errors, their number being
+ * reported in the suppressed field of the next notification sent, so a
+ * burst of matching events costs the session daemon nothing until the
+ * next window.
+ *
+ * Concurrent window changes may let a few extra notifications through.
+ */
+static
+bool notification_rate_limited(struct lttng_ust_event_notifier_private *priv)
+{
+	unsigned long window, cur;
+	struct timespec ts;
+
+	pthread_once(&notification_rate_limit_once, notification_rate_limit_init);
+	if (caa_likely(!notification_rate_limit))
+		return false;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return false;
+	window = (unsigned long) ts.tv_sec;
+	cur = CMM_LOAD_SHARED(priv->rate_window);
+	if (caa_unlikely(cur != window)
+			&& uatomic_cmpxchg(&priv->rate_window, cur, window) == cur)
+		uatomic_set(&priv->rate_count, 0);
+	return uatomic_add_return(&priv->rate_count, 1) > notification_rate_limit;
+}
+
+/*
+ * The notification, with its PIPE_BUF-sized capture buffer, is built in
+ * a per-thread buffer reused across notifications rather than on the
+ * probe stack. It is allocated by the first notification of the thread,
+ * so that threads which send none do not pay for it, and freed when the
+ * thread exits. A notification sent from a signal handler nested over
+ * another one of the same thread, or whose buffer cannot be allocated,
+ * falls back to the stack.
+ */
+static pthread_key_t notification_key;
+static DEFINE_URCU_TLS(int, notification_nest);
+
+void lttng_event_notifier_notification_alloc_tls(void)
+{
+	asm volatile ("" : : "m" (URCU_TLS(notification_nest)));
+}
+
+static
+void notification_key_destroy(void *arg)
+{
+	free(arg);
+}
+
+int lttng_event_notifier_notification_init(void)
+{
+	return -pthread_key_create(&notification_key, notification_key_destroy);
+}
+
+void lttng_event_notifier_notification_exit(void)
+{
+	int ret;
+
+	ret = pthread_key_delete(notification_key);
+	if (ret) {
+		errno = ret;
+		PERROR("Error in pthread_key_delete");
+	}
+}
+
+static
+struct lttng_event_notifier_notification *notification_get_buffer(void)
+{
+	struct lttng_event_notifier_notification *notif;
+	sigset_t newmask, oldmask;
+
+	notif = pthread_getspecific(notification_key);
+	if (caa_likely(notif))
+		return notif;
+	if (sigfillset(&newmask) || pthread_sigmask(SIG_BLOCK, &newmask, &oldmask))
+		return NULL;
+	/* Check again with signals disabled */
+	notif = pthread_getspecific(notification_key);
+	if (notif)
+		goto end;
+	notif = zmalloc(sizeof(*notif));
+	if (notif && pthread_setspecific(notification_key, notif)) {
+		free(notif);
+		notif = NULL;
+	}
+end:
+	if (pthread_sigmask(SIG_SETMASK, &oldmask, NULL))
+		abort();
+	return notif;
+}
+
+static
+void notification_build_send(struct lttng_event_notifier_notification *notif,
 		const struct lttng_ust_event_notifier *event_notifier,
 		const char *stack_data,
 		struct lttng_ust_probe_ctx *probe_ctx,
 		struct lttng_ust_notification_ctx *notif_ctx)
 {
-	/*
-	 * This function is called from the probe, we must do dynamic
-	 * allocation in this context.
-	 */
-	struct lttng_event_notifier_notification notif = {0};
-
-	notification_init(&notif, event_notifier);
+	notification_init(notif, event_notifier);
 
 	if (caa_unlikely(notif_ctx->eval_capture)) {
 		struct lttng_ust_bytecode_runtime *capture_bc_runtime;
@@ -388,9 +499,9 @@ void lttng_event_notifier_notification_send(
 
 			if (capture_bc_runtime->interpreter_func(capture_bc_runtime,
 					stack_data, probe_ctx, &output) == LTTNG_UST_BYTECODE_INTERPRETER_OK)
-				notification_append_capture(&notif, &output);
+				notification_append_capture(notif, &output);
 			else
-				notification_append_empty_capture(&notif);
+				notification_append_empty_capture(notif);
 		}
 	}
 
@@ -398,5 +509,58 @@ void lttng_event_notifier_notification_send(
 	 * Send the notification (including the capture buffer) to the
 	 * sessiond.
 	 */
-	notification_send(&notif, event_notifier);
+	notification_send(notif, event_notifier);
+}
+
+static __attribute__((noinline))
+void notification_build_send_nested(const struct lttng_ust_event_notifier *event_notifier,
+		const char *stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_notification_ctx *notif_ctx)
+{
+	struct lttng_event_notifier_notification notif;
+
+	notification_build_send(&notif, event_notifier, stack_data,
+			probe_ctx, notif_ctx);
+}
+
+void lttng_event_notifier_notification_send(
+		const struct lttng_ust_event_notifier *event_notifier,
+		const char *stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_notification_ctx *notif_ctx)
+{
+	struct lttng_event_notifier_notification *notif;
+
+	/*
+	 * Freeze before anything else: the history is kept from this
+	 * point on, while the notification lets the session daemon
+	 * collect it.
+	 */
+	if (event_notifier->priv->freeze_buffers)
+		lib_ring_buffer_freeze_all();
+
+	record_hit(event_notifier);
+
+	if (event_notifier->priv->has_histogram) {
+		histogram_record(event_notifier, stack_data, probe_ctx, notif_ctx);
+		return;
+	}
+
+	if (caa_unlikely(notification_rate_limited(event_notifier->priv))) {
+		uatomic_inc(&event_notifier->priv->rate_dropped);
+		return;
+	}
+
+	if (caa_likely(!URCU_TLS(notification_nest)++)
+			&& (notif = notification_get_buffer()) != NULL) {
+		cmm_barrier();
+		notification_build_send(notif, event_notifier, stack_data,
+				probe_ctx, notif_ctx);
+		cmm_barrier();
+	} else {
+		notification_build_send_nested(event_notifier, stack_data,
+				probe_ctx, notif_ctx);
+	}
+	URCU_TLS(notification_nest)--;
 }
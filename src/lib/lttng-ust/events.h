@@ -50,6 +50,14 @@ int lttng_event_enabler_attach_filter_bytecode(
 		struct lttng_ust_bytecode_node **bytecode)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Sum the filter evaluation counters of `struct lttng_event_enabler`
+ * over all events related to this enabler.
+ */
+int lttng_event_enabler_filter_stats(struct lttng_event_enabler *enabler,
+		struct lttng_ust_abi_filter_stats *stats)
+	__attribute__((visibility("hidden")));
+
 /*
  * Attach an application context to an event enabler.
  *
@@ -131,6 +139,16 @@ int lttng_event_notifier_enabler_disable(
 		struct lttng_event_notifier_enabler *event_notifier_enabler)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Sum the filter evaluation counters of `struct
+ * lttng_event_notifier_enabler` over all event notifiers related to this
+ * enabler.
+ */
+int lttng_event_notifier_enabler_filter_stats(
+		struct lttng_event_notifier_enabler *event_notifier_enabler,
+		struct lttng_ust_abi_filter_stats *stats)
+	__attribute__((visibility("hidden")));
+
 /*
  * Attach filter bytecode program to `struct lttng_event_notifier_enabler` and
  * all event notifiers related to this enabler.
@@ -161,6 +179,15 @@ int lttng_event_notifier_enabler_attach_exclusion(
 void lttng_free_event_filter_runtime(struct lttng_ust_event_common *event)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Add the evaluation counters of the filters of @enabler linked in
+ * @bytecode_runtime_head to @stats.
+ */
+void lttng_bytecode_filter_stats_add(struct cds_list_head *bytecode_runtime_head,
+		const struct lttng_enabler *enabler,
+		struct lttng_ust_abi_filter_stats *stats)
+	__attribute__((visibility("hidden")));
+
 /*
  * Connect the probe on all enablers matching this event description.
  * Called on library load.
@@ -181,6 +208,12 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 				  struct lttng_ust_ctx **ctx)
 	__attribute__((visibility("hidden")));
 
+int lttng_add_perf_cpu_counter_to_ctx(uint32_t type,
+				  uint64_t config,
+				  const char *name,
+				  struct lttng_ust_ctx **ctx)
+	__attribute__((visibility("hidden")));
+
 int lttng_perf_counter_init(void)
 	__attribute__((visibility("hidden")));
 
@@ -198,6 +231,14 @@ int lttng_add_perf_counter_to_ctx(uint32_t type __attribute__((unused)),
 	return -ENOSYS;
 }
 static inline
+int lttng_add_perf_cpu_counter_to_ctx(uint32_t type __attribute__((unused)),
+				  uint64_t config __attribute__((unused)),
+				  const char *name __attribute__((unused)),
+				  struct lttng_ust_ctx **ctx __attribute__((unused)))
+{
+	return -ENOSYS;
+}
+static inline
 int lttng_perf_counter_init(void)
 {
 	return 0;
@@ -252,6 +293,12 @@ int lttng_session_active(void)
 struct cds_list_head *lttng_get_sessions(void)
 	__attribute__((visibility("hidden")));
 
+void lttng_session_enabler_sync_batch_begin(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_session_enabler_sync_batch_end(void)
+	__attribute__((visibility("hidden")));
+
 void lttng_handle_pending_statedump(void *owner)
 	__attribute__((visibility("hidden")));
 
@@ -270,6 +317,9 @@ int lttng_fix_pending_events(void)
 struct cds_list_head *lttng_get_probe_list_head(void)
 	__attribute__((visibility("hidden")));
 
+uint64_t lttng_probes_generation(void)
+	__attribute__((visibility("hidden")));
+
 int lttng_abi_create_root_handle(void)
 	__attribute__((visibility("hidden")));
 
@@ -294,6 +344,9 @@ int lttng_ust_interpret_event_filter(const struct lttng_ust_event_common *event,
 		void *filter_ctx)
 	__attribute__((visibility("hidden")));
 
+void lttng_bytecode_filter_cache_invalidate(void)
+	__attribute__((visibility("hidden")));
+
 int lttng_ust_session_uuid_validate(struct lttng_ust_session *session,
 		unsigned char *uuid)
 	__attribute__((visibility("hidden")));
@@ -310,6 +363,7 @@ int lttng_ust_add_app_context_to_ctx_rcu(const char *name, struct lttng_ust_ctx
 
 int lttng_ust_context_set_provider_rcu(struct lttng_ust_ctx **_ctx,
 		const char *name,
+		enum lttng_ust_dynamic_type fixed_type,
 		size_t (*get_size)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
 			size_t offset),
 		void (*record)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
@@ -320,6 +374,7 @@ int lttng_ust_context_set_provider_rcu(struct lttng_ust_ctx **_ctx,
 	__attribute__((visibility("hidden")));
 
 void lttng_ust_context_set_session_provider(const char *name,
+		enum lttng_ust_dynamic_type fixed_type,
 		size_t (*get_size)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
 			size_t offset),
 		void (*record)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
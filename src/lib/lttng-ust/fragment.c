@@ -0,0 +1,27 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Event carrying the fragments of the records larger than a sub-buffer.
+ * It is never hit as a tracepoint: the ring buffer clients write it in
+ * the channel of the fragmented record.
+ */
+
+#define _LGPL_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include "common/macros.h"
+#include "lib/lttng-ust/lttng-tracer-core.h"
+
+#define LTTNG_UST_TRACEPOINT_HIDDEN_DEFINITION
+#define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
+
+#define LTTNG_UST_TRACEPOINT_CREATE_PROBES
+#define LTTNG_UST_TRACEPOINT_DEFINE
+#include "lttng-ust-fragment-provider.h"
+
+bool lttng_ust_is_fragment_event(const struct lttng_ust_event_desc *desc)
+{
+	return desc == &lttng_ust__event_desc___lttng_ust_fragment_record;
+}
@@ -173,6 +173,56 @@ static inline int lttng_ust_futex_async(int32_t *uaddr, int op, int32_t val,
 
 #endif
 
+/*
+ * Wait on several shared 32-bit futexes at once, until any of them is
+ * woken up or does not hold its expected value anymore. The optional
+ * timeout is absolute, on CLOCK_MONOTONIC. Returns the index of the
+ * woken up futex, or -1 with errno set. Fails with ENOSYS where the
+ * kernel does not support it (before Linux 5.16).
+ */
+struct lttng_ust_futex_waitv {
+	uint64_t val;
+	uint64_t uaddr;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+#define LTTNG_UST_FUTEX_32	2
+
+/* The kernel __kernel_timespec, 64-bit even where time_t is 32-bit. */
+struct lttng_ust_futex_timespec {
+	int64_t tv_sec;
+	int64_t tv_nsec;
+};
+
+#if (defined(__linux__) && defined(__NR_futex_waitv))
+
+static inline int lttng_ust_futex_waitv(struct lttng_ust_futex_waitv *waiters,
+		unsigned int nr_futexes, const struct timespec *timeout)
+{
+	struct lttng_ust_futex_timespec ts;
+
+	if (timeout) {
+		ts.tv_sec = timeout->tv_sec;
+		ts.tv_nsec = timeout->tv_nsec;
+	}
+	return syscall(__NR_futex_waitv, waiters, nr_futexes, 0,
+			timeout ? &ts : NULL, CLOCK_MONOTONIC);
+}
+
+#else
+
+static inline int lttng_ust_futex_waitv(
+		struct lttng_ust_futex_waitv *waiters __attribute__((unused)),
+		unsigned int nr_futexes __attribute__((unused)),
+		const struct timespec *timeout __attribute__((unused)))
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,391 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * LTTng UST bytecode compiler.
+ *
+ * Translates specialized filter bytecode made of comparisons between integer
+ * payload fields and literals, combined with logical and/or (e.g.
+ * "intfield > 42 && intfield2 == 3"), to a register form evaluated
+ * natively, which skips the interpreter stack and instruction dispatch.
+ * Captures of a single payload field are also reduced to a direct read of
+ * that field. Any other bytecode keeps being interpreted.
+ */
+
+#define _LGPL_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lttng-bytecode.h"
+
+static
+int compile_operand(struct bytecode_runtime *bytecode, char **pc,
+		struct bytecode_compiled_operand *operand)
+{
+	char *end_pc = &bytecode->code[0] + bytecode->len;
+
+	if (*pc + sizeof(struct load_op) > end_pc)
+		return -EINVAL;
+	switch (*(bytecode_opcode_t *) *pc) {
+	case BYTECODE_OP_LOAD_S64:
+	{
+		struct load_op *insn = (struct load_op *) *pc;
+
+		if (*pc + sizeof(struct load_op)
+				+ sizeof(struct literal_numeric) > end_pc)
+			return -EINVAL;
+		operand->literal = true;
+		operand->v = ((struct literal_numeric *) insn->data)->v;
+		*pc += sizeof(struct load_op) + sizeof(struct literal_numeric);
+		return 0;
+	}
+	case BYTECODE_OP_LOAD_FIELD_REF_S64:
+	{
+		struct load_op *insn = (struct load_op *) *pc;
+		struct field_ref *ref = (struct field_ref *) insn->data;
+
+		if (*pc + sizeof(struct load_op)
+				+ sizeof(struct field_ref) > end_pc)
+			return -EINVAL;
+		operand->literal = false;
+		operand->type = OBJECT_TYPE_S64;
+		operand->offset = ref->offset;
+		*pc += sizeof(struct load_op) + sizeof(struct field_ref);
+		return 0;
+	}
+	case BYTECODE_OP_GET_PAYLOAD_ROOT:
+	{
+		struct load_op *insn;
+		struct get_index_u16 *index;
+		struct bytecode_get_index_data *gid;
+
+		*pc += sizeof(struct load_op);
+		if (*pc + sizeof(struct load_op) + sizeof(struct get_index_u16)
+				+ sizeof(struct load_op) > end_pc)
+			return -EINVAL;
+		insn = (struct load_op *) *pc;
+		if (insn->op != BYTECODE_OP_GET_INDEX_U16)
+			return -EINVAL;
+		index = (struct get_index_u16 *) insn->data;
+		gid = (struct bytecode_get_index_data *) &bytecode->data[index->index];
+		operand->literal = false;
+		operand->offset = gid->offset;
+		*pc += sizeof(struct load_op) + sizeof(struct get_index_u16);
+
+		/*
+		 * Integer payload fields are specialized to 64-bit loads:
+		 * narrower integers only appear as array elements, whose
+		 * lookup is left to the interpreter.
+		 */
+		switch (*(bytecode_opcode_t *) *pc) {
+		case BYTECODE_OP_LOAD_FIELD_S64:
+			operand->type = OBJECT_TYPE_S64;
+			break;
+		case BYTECODE_OP_LOAD_FIELD_U64:
+			operand->type = OBJECT_TYPE_U64;
+			break;
+		default:
+			return -EINVAL;
+		}
+		*pc += sizeof(struct load_op);
+		return 0;
+	}
+	default:
+		return -EINVAL;
+	}
+}
+
+static
+int compile_comparison(struct bytecode_runtime *bytecode, char **pc,
+		struct bytecode_compiled_insn *insn)
+{
+	char *end_pc = &bytecode->code[0] + bytecode->len;
+	int ret;
+
+	insn->kind = BYTECODE_COMPILED_CMP;
+	ret = compile_operand(bytecode, pc, &insn->bx);
+	if (ret)
+		return ret;
+	ret = compile_operand(bytecode, pc, &insn->ax);
+	if (ret)
+		return ret;
+	if (*pc + sizeof(struct binary_op) > end_pc)
+		return -EINVAL;
+	insn->op = *(bytecode_opcode_t *) *pc;
+	switch (insn->op) {
+	case BYTECODE_OP_EQ_S64:
+	case BYTECODE_OP_NE_S64:
+	case BYTECODE_OP_GT_S64:
+	case BYTECODE_OP_LT_S64:
+	case BYTECODE_OP_GE_S64:
+	case BYTECODE_OP_LE_S64:
+		break;
+	default:
+		return -EINVAL;
+	}
+	*pc += sizeof(struct binary_op);
+	return 0;
+}
+
+/*
+ * Bytecode offsets of a compiled instruction. A jump may land either on
+ * the instruction itself or on the cast no-ops preceding it.
+ */
+struct insn_offsets {
+	uint16_t start;
+	uint16_t insn;
+};
+
+/*
+ * Turn the logical operator skip offsets into instruction indexes. Jumps
+ * only go forward, onto a logical operator or onto the return, both of
+ * which expect the value being skipped in r0.
+ */
+static
+int resolve_targets(struct bytecode_compiled_filter *compiled,
+		const struct insn_offsets *offsets)
+{
+	uint16_t i, j;
+
+	for (i = 0; i < compiled->nr_insn; i++) {
+		struct bytecode_compiled_insn *insn = &compiled->insn[i];
+
+		if (insn->kind == BYTECODE_COMPILED_CMP)
+			continue;
+		for (j = i + 1; j <= compiled->nr_insn; j++) {
+			if (offsets[j].start == insn->target
+					|| offsets[j].insn == insn->target)
+				break;
+		}
+		if (j > compiled->nr_insn)
+			return -EINVAL;
+		if (j < compiled->nr_insn
+				&& compiled->insn[j].kind == BYTECODE_COMPILED_CMP)
+			return -EINVAL;
+		insn->target = j;
+	}
+	return 0;
+}
+
+/*
+ * Capture of a payload field: GET_PAYLOAD_ROOT, GET_INDEX_U16 and RETURN.
+ * The field is loaded once, while formatting the capture output, instead
+ * of being looked up by the interpreter and loaded again for the output.
+ */
+static
+int compile_capture(struct bytecode_runtime *bytecode)
+{
+	struct bytecode_compiled_capture *compiled = &bytecode->compiled_capture;
+	char *pc = &bytecode->code[0];
+	char *end_pc = pc + bytecode->len;
+	struct load_op *insn;
+	struct get_index_u16 *index;
+	struct bytecode_get_index_data *gid;
+
+	if (pc + 2 * sizeof(struct load_op) + sizeof(struct get_index_u16)
+			+ sizeof(struct return_op) > end_pc)
+		return -EINVAL;
+	if (*(bytecode_opcode_t *) pc != BYTECODE_OP_GET_PAYLOAD_ROOT)
+		return -EINVAL;
+	pc += sizeof(struct load_op);
+	insn = (struct load_op *) pc;
+	if (insn->op != BYTECODE_OP_GET_INDEX_U16)
+		return -EINVAL;
+	index = (struct get_index_u16 *) insn->data;
+	pc += sizeof(struct load_op) + sizeof(struct get_index_u16);
+	if (*(bytecode_opcode_t *) pc != BYTECODE_OP_RETURN)
+		return -EINVAL;
+	gid = (struct bytecode_get_index_data *) &bytecode->data[index->index];
+	switch (gid->elem.type) {
+	case OBJECT_TYPE_STRUCT:
+	case OBJECT_TYPE_VARIANT:
+	case OBJECT_TYPE_DYNAMIC:
+		return -EINVAL;
+	default:
+		break;
+	}
+	dbg_printf("Capture bytecode compiled to a payload field read.\n");
+	compiled->index = index->index;
+	compiled->valid = true;
+	return 0;
+}
+
+/*
+ * Return 0 if the bytecode has been compiled, a negative error value if it
+ * needs to be interpreted.
+ */
+int lttng_bytecode_compile(struct bytecode_runtime *bytecode)
+{
+	struct bytecode_compiled_filter *compiled = &bytecode->compiled;
+	struct insn_offsets offsets[BYTECODE_COMPILED_MAX_INSN + 1];
+	char *start_pc = &bytecode->code[0];
+	char *end_pc = start_pc + bytecode->len;
+	char *pc = start_pc, *cast_pc = NULL;
+	bool r0_live = false;
+	int ret;
+
+	compiled->valid = false;
+	compiled->nr_insn = 0;
+	bytecode->compiled_capture.valid = false;
+	if (bytecode->p.type == LTTNG_UST_BYTECODE_TYPE_CAPTURE)
+		return compile_capture(bytecode);
+	if (bytecode->p.type != LTTNG_UST_BYTECODE_TYPE_FILTER)
+		return -EINVAL;
+	for (;;) {
+		struct bytecode_compiled_insn *insn;
+		uint16_t i = compiled->nr_insn;
+
+		if (pc + sizeof(bytecode_opcode_t) > end_pc)
+			return -EINVAL;
+		if (*(bytecode_opcode_t *) pc == BYTECODE_OP_CAST_NOP) {
+			if (!cast_pc)
+				cast_pc = pc;
+			pc += sizeof(struct cast_op);
+			continue;
+		}
+		offsets[i].insn = pc - start_pc;
+		offsets[i].start = (cast_pc ? cast_pc : pc) - start_pc;
+		cast_pc = NULL;
+
+		switch (*(bytecode_opcode_t *) pc) {
+		case BYTECODE_OP_RETURN:
+		case BYTECODE_OP_RETURN_S64:
+			if (!r0_live)
+				return -EINVAL;
+			goto end;
+		}
+		if (i == BYTECODE_COMPILED_MAX_INSN)
+			return -EINVAL;
+		insn = &compiled->insn[i];
+
+		switch (*(bytecode_opcode_t *) pc) {
+		case BYTECODE_OP_AND:
+		case BYTECODE_OP_OR:
+		{
+			struct logical_op *lop = (struct logical_op *) pc;
+
+			if (!r0_live || pc + sizeof(struct logical_op) > end_pc)
+				return -EINVAL;
+			if (lop->op == BYTECODE_OP_AND)
+				insn->kind = BYTECODE_COMPILED_AND;
+			else
+				insn->kind = BYTECODE_COMPILED_OR;
+			insn->target = lop->skip_offset;
+			pc += sizeof(struct logical_op);
+			/* The operand is popped when the jump is not taken. */
+			r0_live = false;
+			break;
+		}
+		default:
+			if (r0_live)
+				return -EINVAL;
+			ret = compile_comparison(bytecode, &pc, insn);
+			if (ret)
+				return ret;
+			r0_live = true;
+			break;
+		}
+		compiled->nr_insn++;
+	}
+end:
+	ret = resolve_targets(compiled, offsets);
+	if (ret)
+		return ret;
+	dbg_printf("Bytecode compiled to %u register instructions.\n",
+		(unsigned int) compiled->nr_insn);
+	compiled->valid = true;
+	return 0;
+}
+
+/*
+ * Loads match the interpreter LOAD_FIELD_* instructions, so both
+ * evaluations give identical results.
+ */
+static inline
+int64_t compiled_operand_value(const struct bytecode_compiled_operand *operand,
+		const char *stack_data)
+{
+	const char *ptr;
+
+	if (operand->literal)
+		return operand->v;
+	ptr = stack_data + operand->offset;
+	switch (operand->type) {
+	case OBJECT_TYPE_U64:
+		return (int64_t) *(uint64_t *) ptr;
+	case OBJECT_TYPE_S64:
+	default:
+		return ((struct literal_numeric *) ptr)->v;
+	}
+}
+
+static inline
+int64_t compiled_comparison(const struct bytecode_compiled_insn *insn,
+		const char *stack_data)
+{
+	int64_t bx, ax;
+
+	bx = compiled_operand_value(&insn->bx, stack_data);
+	ax = compiled_operand_value(&insn->ax, stack_data);
+	switch (insn->op) {
+	case BYTECODE_OP_EQ_S64:
+		return bx == ax;
+	case BYTECODE_OP_NE_S64:
+		return bx != ax;
+	case BYTECODE_OP_GT_S64:
+		return bx > ax;
+	case BYTECODE_OP_LT_S64:
+		return bx < ax;
+	case BYTECODE_OP_GE_S64:
+		return bx >= ax;
+	case BYTECODE_OP_LE_S64:
+	default:
+		return bx <= ax;
+	}
+}
+
+int lttng_bytecode_interpret_compiled(struct lttng_ust_bytecode_runtime *ust_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		void *caller_ctx)
+{
+	struct bytecode_runtime *bytecode = caa_container_of(ust_bytecode, struct bytecode_runtime, p);
+	const struct bytecode_compiled_filter *compiled = &bytecode->compiled;
+	struct lttng_ust_bytecode_filter_ctx *filter_ctx =
+		(struct lttng_ust_bytecode_filter_ctx *) caller_ctx;
+	uint16_t i = 0;
+	int64_t r0 = 0;
+
+	while (i < compiled->nr_insn) {
+		const struct bytecode_compiled_insn *insn = &compiled->insn[i];
+
+		switch (insn->kind) {
+		case BYTECODE_COMPILED_CMP:
+			r0 = compiled_comparison(insn, interpreter_stack_data);
+			i++;
+			break;
+		case BYTECODE_COMPILED_AND:
+			if (!r0)
+				i = insn->target;
+			else
+				i++;
+			break;
+		case BYTECODE_COMPILED_OR:
+			if (r0) {
+				r0 = 1;
+				i = insn->target;
+			} else {
+				i++;
+			}
+			break;
+		default:
+			return LTTNG_UST_BYTECODE_INTERPRETER_ERROR;
+		}
+	}
+	if (r0)
+		filter_ctx->result = LTTNG_UST_BYTECODE_FILTER_ACCEPT;
+	else
+		filter_ctx->result = LTTNG_UST_BYTECODE_FILTER_REJECT;
+	return LTTNG_UST_BYTECODE_INTERPRETER_OK;
+}
@@ -12,11 +12,15 @@
 
 #include <lttng/urcu/pointer.h>
 #include <urcu/rculist.h>
+#include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
 #include <lttng/ust-endian.h>
 #include <lttng/ust-events.h>
 #include "lib/lttng-ust/events.h"
 
 #include "lttng-bytecode.h"
+#include "common/clock.h"
+#include "common/metrics.h"
 #include "common/strutils.h"
 
 
@@ -87,9 +91,16 @@ static
 int stack_strcmp(struct estack *stack, int top, const char *cmp_type __attribute__((unused)))
 {
 	const char *p = estack_bx(stack, top)->u.s.str, *q = estack_ax(stack, top)->u.s.str;
+	size_t skip;
 	int ret;
 	int diff;
 
+	/* Skip the plain characters both strings start with. */
+	skip = strutils_plain_prefix_len(p, estack_bx(stack, top)->u.s.seq_len,
+			q, estack_ax(stack, top)->u.s.seq_len);
+	p += skip;
+	q += skip;
+
 	for (;;) {
 		int escaped_r0 = 0;
 
@@ -232,7 +243,7 @@ static int context_get_index(struct lttng_ust_ctx *ctx,
 
 	switch (field->type->type) {
 	case lttng_ust_type_integer:
-		ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+		lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 		if (lttng_ust_get_type_integer(field->type)->signedness) {
 			ptr->object_type = OBJECT_TYPE_S64;
 			ptr->u.s64 = v.u.s64;
@@ -249,7 +260,7 @@ static int context_get_index(struct lttng_ust_ctx *ctx,
 		const struct lttng_ust_type_integer *itype;
 
 		itype = lttng_ust_get_type_integer(lttng_ust_get_type_enum(field->type)->container_type);
-		ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+		lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 		if (itype->signedness) {
 			ptr->object_type = OBJECT_TYPE_SIGNED_ENUM;
 			ptr->u.s64 = v.u.s64;
@@ -272,7 +283,7 @@ static int context_get_index(struct lttng_ust_ctx *ctx,
 			return -EINVAL;
 		}
 		ptr->object_type = OBJECT_TYPE_STRING;
-		ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+		lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 		ptr->ptr = v.u.str;
 		break;
 	case lttng_ust_type_sequence:
@@ -285,23 +296,23 @@ static int context_get_index(struct lttng_ust_ctx *ctx,
 			return -EINVAL;
 		}
 		ptr->object_type = OBJECT_TYPE_STRING;
-		ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+		lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 		ptr->ptr = v.u.str;
 		break;
 	case lttng_ust_type_string:
 		ptr->object_type = OBJECT_TYPE_STRING;
-		ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+		lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 		ptr->ptr = v.u.str;
 		break;
 	case lttng_ust_type_float:
 		ptr->object_type = OBJECT_TYPE_DOUBLE;
-		ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+		lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 		ptr->u.d = v.u.d;
 		ptr->ptr = &ptr->u.d;
 		ptr->rev_bo = lttng_ust_get_type_float(field->type)->reverse_byte_order;
 		break;
 	case lttng_ust_type_dynamic:
-		ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+		lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 		switch (v.sel) {
 		case LTTNG_UST_DYNAMIC_TYPE_NONE:
 			return -EINVAL;
@@ -2161,7 +2172,7 @@ int lttng_bytecode_interpret(struct lttng_ust_bytecode_runtime *ust_bytecode,
 			dbg_printf("get context ref offset %u type dynamic\n",
 				ref->offset);
 			ctx_field = &ctx->fields[ref->offset];
-			ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+			lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 			estack_push(stack, top, ax, bx, ax_t, bx_t);
 			switch (v.sel) {
 			case LTTNG_UST_DYNAMIC_TYPE_NONE:
@@ -2209,7 +2220,7 @@ int lttng_bytecode_interpret(struct lttng_ust_bytecode_runtime *ust_bytecode,
 			dbg_printf("get context ref offset %u type string\n",
 				ref->offset);
 			ctx_field = &ctx->fields[ref->offset];
-			ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+			lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 			estack_push(stack, top, ax, bx, ax_t, bx_t);
 			estack_ax(stack, top)->u.s.str = v.u.str;
 			if (unlikely(!estack_ax(stack, top)->u.s.str)) {
@@ -2236,7 +2247,7 @@ int lttng_bytecode_interpret(struct lttng_ust_bytecode_runtime *ust_bytecode,
 			dbg_printf("get context ref offset %u type s64\n",
 				ref->offset);
 			ctx_field = &ctx->fields[ref->offset];
-			ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+			lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 			estack_push(stack, top, ax, bx, ax_t, bx_t);
 			estack_ax_v = v.u.s64;
 			estack_ax_t = REG_S64;
@@ -2255,7 +2266,7 @@ int lttng_bytecode_interpret(struct lttng_ust_bytecode_runtime *ust_bytecode,
 			dbg_printf("get context ref offset %u type double\n",
 				ref->offset);
 			ctx_field = &ctx->fields[ref->offset];
-			ctx_field->get_value(ctx_field->priv, probe_ctx, &v);
+			lttng_ust_ctx_get_value(ctx_field, probe_ctx, &v);
 			estack_push(stack, top, ax, bx, ax_t, bx_t);
 			memcpy(&estack_ax(stack, top)->u.d, &v.u.d, sizeof(struct literal_double));
 			estack_ax_t = REG_DOUBLE;
@@ -2531,9 +2542,153 @@ end:
 		return LTTNG_UST_BYTECODE_INTERPRETER_OK;
 }
 
+/*
+ * Evaluate a capture compiled to a payload field read. The stack entry
+ * is set up as GET_INDEX_U16 does on the payload root.
+ */
+int lttng_bytecode_interpret_compiled_capture(struct lttng_ust_bytecode_runtime *ust_bytecode,
+		const char *interpreter_stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		void *caller_ctx)
+{
+	struct bytecode_runtime *bytecode = caa_container_of(ust_bytecode, struct bytecode_runtime, p);
+	const struct bytecode_get_index_data *gid;
+	struct estack_entry entry;
+
+	gid = (const struct bytecode_get_index_data *)
+		&bytecode->data[bytecode->compiled_capture.index];
+	entry.type = REG_PTR;
+	entry.u.ptr.type = LOAD_OBJECT;
+	entry.u.ptr.ptr = interpreter_stack_data + gid->offset;
+	if (gid->elem.type == OBJECT_TYPE_STRING)
+		entry.u.ptr.ptr = *(const char * const *) entry.u.ptr.ptr;
+	entry.u.ptr.object_type = gid->elem.type;
+	entry.u.ptr.field = gid->field;
+	entry.u.ptr.rev_bo = gid->elem.rev_bo;
+	if (lttng_bytecode_interpret_format_output(&entry,
+			(struct lttng_interpreter_output *) caller_ctx))
+		return LTTNG_UST_BYTECODE_INTERPRETER_ERROR;
+	return LTTNG_UST_BYTECODE_INTERPRETER_OK;
+}
+
+/*
+ * Per-thread cache of the results of filters which read neither the
+ * payload nor contexts that may change within a thread, e.g.
+ * "$ctx.vtid == 42". Entries are keyed by filter runtime and tagged with
+ * a global generation, bumped whenever filters are linked or change
+ * state, and after fork.
+ */
+#define FILTER_CACHE_SIZE	8	/* Power of 2 */
+
+struct filter_cache_entry {
+	const struct lttng_ust_bytecode_runtime *runtime;
+	unsigned long generation;
+	bool accept;
+};
+
+struct filter_cache {
+	struct filter_cache_entry entries[FILTER_CACHE_SIZE];
+};
+
+static DEFINE_URCU_TLS(struct filter_cache, filter_cache);
+static unsigned long filter_cache_generation = 1;
+
+void lttng_bytecode_filter_cache_invalidate(void)
+{
+	uatomic_inc(&filter_cache_generation);
+}
+
+static inline
+bool filter_is_cacheable(const struct lttng_ust_bytecode_runtime *runtime)
+{
+	return runtime->type == LTTNG_UST_BYTECODE_TYPE_FILTER
+		&& !runtime->reads_payload
+		&& !runtime->reads_volatile_context;
+}
+
+static
+bool run_filter(struct lttng_ust_bytecode_runtime *runtime,
+		const char *interpreter_stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx)
+{
+	struct lttng_ust_bytecode_filter_ctx bytecode_filter_ctx;
+
+	return runtime->interpreter_func(runtime, interpreter_stack_data,
+			probe_ctx, &bytecode_filter_ctx) == LTTNG_UST_BYTECODE_INTERPRETER_OK
+		&& bytecode_filter_ctx.result == LTTNG_UST_BYTECODE_FILTER_ACCEPT;
+}
+
+static
+bool run_filter_cached(struct lttng_ust_bytecode_runtime *runtime,
+		const char *interpreter_stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx)
+{
+	struct filter_cache_entry *entry;
+	unsigned long generation;
+
+	generation = CMM_LOAD_SHARED(filter_cache_generation);
+	/*
+	 * Read the generation before the interpreter function. Matches the
+	 * write barrier before lttng_bytecode_filter_cache_invalidate().
+	 */
+	cmm_smp_rmb();
+	entry = &URCU_TLS(filter_cache).entries[((uintptr_t) runtime >> 4)
+			& (FILTER_CACHE_SIZE - 1)];
+	if (caa_likely(entry->runtime == runtime
+			&& entry->generation == generation)) {
+		if (caa_unlikely(runtime->profile))
+			uatomic_inc(&runtime->nr_cache_hit);
+		return entry->accept;
+	}
+	entry->accept = run_filter(runtime, interpreter_stack_data, probe_ctx);
+	entry->runtime = runtime;
+	entry->generation = generation;
+	return entry->accept;
+}
+
 /*
  * Return LTTNG_UST_EVENT_FILTER_ACCEPT or LTTNG_UST_EVENT_FILTER_REJECT.
  */
+static inline
+bool run_filter_select(struct lttng_ust_bytecode_runtime *runtime,
+		const char *interpreter_stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx)
+{
+	if (filter_is_cacheable(runtime))
+		return run_filter_cached(runtime, interpreter_stack_data, probe_ctx);
+	return run_filter(runtime, interpreter_stack_data, probe_ctx);
+}
+
+/*
+ * Count the evaluation, and time one evaluation out of
+ * LTTNG_UST_ABI_FILTER_STATS_SAMPLE_PERIOD, to keep the cost of reading
+ * the clock off most evaluations.
+ */
+static
+bool run_filter_profile(struct lttng_ust_bytecode_runtime *runtime,
+		const char *interpreter_stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx)
+{
+	unsigned long nr_eval;
+	uint64_t start;
+	bool accept;
+
+	nr_eval = uatomic_add_return(&runtime->nr_eval, 1);
+	if (caa_likely(nr_eval % LTTNG_UST_ABI_FILTER_STATS_SAMPLE_PERIOD)) {
+		accept = run_filter_select(runtime, interpreter_stack_data,
+				probe_ctx);
+	} else {
+		start = trace_clock_read64_monotonic();
+		accept = run_filter_select(runtime, interpreter_stack_data,
+				probe_ctx);
+		uatomic_add(&runtime->sampled_time, (unsigned long)
+				(trace_clock_read64_monotonic() - start));
+	}
+	if (accept)
+		uatomic_inc(&runtime->nr_accept);
+	return accept;
+}
+
 int lttng_ust_interpret_event_filter(const struct lttng_ust_event_common *event,
 		const char *interpreter_stack_data,
 		struct lttng_ust_probe_ctx *probe_ctx,
@@ -2541,22 +2696,29 @@ int lttng_ust_interpret_event_filter(const struct lttng_ust_event_common *event,
 {
 	struct lttng_ust_bytecode_runtime *filter_bc_runtime;
 	struct cds_list_head *filter_bytecode_runtime_head = &event->priv->filter_bytecode_runtime_head;
-	struct lttng_ust_bytecode_filter_ctx bytecode_filter_ctx;
 	bool filter_record = false;
 
 	cds_list_for_each_entry_rcu(filter_bc_runtime, filter_bytecode_runtime_head, node) {
-		if (caa_likely(filter_bc_runtime->interpreter_func(filter_bc_runtime,
-				interpreter_stack_data, probe_ctx, &bytecode_filter_ctx) == LTTNG_UST_BYTECODE_INTERPRETER_OK)) {
-			if (caa_unlikely(bytecode_filter_ctx.result == LTTNG_UST_BYTECODE_FILTER_ACCEPT)) {
-				filter_record = true;
-				break;
-			}
+		bool accept;
+
+		if (CMM_LOAD_SHARED(filter_bc_runtime->fused))
+			continue;
+		if (caa_unlikely(filter_bc_runtime->profile))
+			accept = run_filter_profile(filter_bc_runtime,
+					interpreter_stack_data, probe_ctx);
+		else
+			accept = run_filter_select(filter_bc_runtime,
+					interpreter_stack_data, probe_ctx);
+		if (caa_unlikely(accept)) {
+			filter_record = true;
+			break;
 		}
 	}
-	if (filter_record)
-		return LTTNG_UST_EVENT_FILTER_ACCEPT;
-	else
+	lttng_ust_metrics_inc(LTTNG_UST_METRIC_FILTER_EVAL);
+	if (!filter_record)
 		return LTTNG_UST_EVENT_FILTER_REJECT;
+	lttng_ust_metrics_inc(LTTNG_UST_METRIC_FILTER_ACCEPT);
+	return LTTNG_UST_EVENT_FILTER_ACCEPT;
 }
 
 #undef START_OP
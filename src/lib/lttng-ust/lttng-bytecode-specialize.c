@@ -471,6 +471,8 @@ static int specialize_context_lookup(struct lttng_ust_ctx *ctx,
 	}
 	ctx_field = &ctx->fields[idx];
 	field = ctx_field->event_field;
+	if (!lttng_bytecode_context_is_thread_stable(field->name))
+		runtime->p.reads_volatile_context = 1;
 	ret = specialize_load_object(field, load, true);
 	if (ret)
 		return ret;
@@ -1322,6 +1324,7 @@ int lttng_bytecode_specialize(const struct lttng_ust_event_desc *event_desc,
 			}
 			vstack_ax(stack)->type = REG_PTR;
 			vstack_ax(stack)->load.type = LOAD_ROOT_APP_CONTEXT;
+			bytecode->p.reads_volatile_context = 1;
 			next_pc += sizeof(struct load_op);
 			break;
 		}
@@ -1331,6 +1334,7 @@ int lttng_bytecode_specialize(const struct lttng_ust_event_desc *event_desc,
 				ret = -EINVAL;
 				goto end;
 			}
+			bytecode->p.reads_payload = 1;
 			vstack_ax(stack)->type = REG_PTR;
 			vstack_ax(stack)->load.type = LOAD_ROOT_PAYLOAD;
 			next_pc += sizeof(struct load_op);
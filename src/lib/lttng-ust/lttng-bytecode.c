@@ -7,14 +7,17 @@
  */
 
 #define _LGPL_SOURCE
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 
 #include <urcu/rculist.h>
+#include <urcu/uatomic.h>
 
 #include "context-internal.h"
 #include "lttng-bytecode.h"
 #include "lib/lttng-ust/events.h"
+#include "common/getenv.h"
 #include "common/macros.h"
 #include "common/tracer.h"
 
@@ -281,6 +284,16 @@ int apply_field_reloc(const struct lttng_ust_event_desc *event_desc,
 	return 0;
 }
 
+/*
+ * Context fields whose value only changes across fork(), so that the
+ * result of filters reading only them can be cached per thread.
+ */
+bool lttng_bytecode_context_is_thread_stable(const char *name)
+{
+	return !strcmp(name, "vpid") || !strcmp(name, "vtid")
+		|| !strcmp(name, "pthread_id");
+}
+
 static
 int apply_context_reloc(struct bytecode_runtime *runtime,
 		uint32_t runtime_len __attribute__((unused)),
@@ -295,6 +308,9 @@ int apply_context_reloc(struct bytecode_runtime *runtime,
 
 	dbg_printf("Apply context reloc: %u %s\n", reloc_offset, context_name);
 
+	if (!lttng_bytecode_context_is_thread_stable(context_name))
+		runtime->p.reads_volatile_context = 1;
+
 	/* Get context index */
 	idx = lttng_get_context_index(*pctx, context_name);
 	if (idx < 0) {
@@ -390,6 +406,7 @@ int apply_reloc(const struct lttng_ust_event_desc *event_desc,
 	op = (struct load_op *) &runtime->code[reloc_offset];
 	switch (op->op) {
 	case BYTECODE_OP_LOAD_FIELD_REF:
+		runtime->p.reads_payload = 1;
 		return apply_field_reloc(event_desc, runtime, runtime_len,
 			reloc_offset, name, op->op);
 	case BYTECODE_OP_GET_CONTEXT_REF:
@@ -422,6 +439,21 @@ int bytecode_is_linked(struct lttng_ust_bytecode_node *bytecode,
 	return 0;
 }
 
+/*
+ * Filter evaluation counters, read with the LTTNG_UST_ABI_FILTER_STATS
+ * command and reported in the debug output when the event is destroyed.
+ * Enabled by the LTTNG_UST_FILTER_PROFILE environment variable.
+ */
+static int filter_profile;
+static pthread_once_t filter_profile_once = PTHREAD_ONCE_INIT;
+
+static
+void filter_profile_init(void)
+{
+	if (lttng_ust_getenv("LTTNG_UST_FILTER_PROFILE"))
+		filter_profile = 1;
+}
+
 /*
  * Take a bytecode with reloc table and link it to an event to create a
  * bytecode runtime.
@@ -476,8 +508,21 @@ int link_bytecode(const struct lttng_ust_event_desc *event_desc,
 		}
 		next_offset = offset + sizeof(uint16_t) + strlen(name) + 1;
 	}
-	/* Validate bytecode */
-	ret = lttng_bytecode_validate(runtime);
+	/*
+	 * Validate bytecode. Relocations only rewrite legacy field and
+	 * context references: when there are none, the code is the same
+	 * for every event the bytecode is linked to, and so is the
+	 * validation result.
+	 */
+	if (!memcmp(runtime->code, bytecode->bc.data, runtime->len)) {
+		if (!bytecode->validated) {
+			bytecode->validate_ret = lttng_bytecode_validate(runtime);
+			bytecode->validated = 1;
+		}
+		ret = bytecode->validate_ret;
+	} else {
+		ret = lttng_bytecode_validate(runtime);
+	}
 	if (ret) {
 		goto link_error;
 	}
@@ -487,8 +532,19 @@ int link_bytecode(const struct lttng_ust_event_desc *event_desc,
 		goto link_error;
 	}
 
-	runtime->p.interpreter_func = lttng_bytecode_interpret;
+	/* Evaluate natively integer comparisons and payload field captures */
+	(void) lttng_bytecode_compile(runtime);
+
+	/*
+	 * Enabled by lttng_bytecode_sync_state(), once the event knows
+	 * whether its filters read the payload.
+	 */
+	runtime->p.interpreter_func = lttng_bytecode_interpret_error;
 	runtime->p.link_failed = 0;
+	pthread_once(&filter_profile_once, filter_profile_init);
+	runtime->p.profile = filter_profile;
+	cmm_smp_wmb();
+	lttng_bytecode_filter_cache_invalidate();
 	cds_list_add_rcu(&runtime->p.node, insert_loc);
 	dbg_printf("Linking successful.\n");
 	return 0;
@@ -496,6 +552,8 @@ int link_bytecode(const struct lttng_ust_event_desc *event_desc,
 link_error:
 	runtime->p.interpreter_func = lttng_bytecode_interpret_error;
 	runtime->p.link_failed = 1;
+	cmm_smp_wmb();
+	lttng_bytecode_filter_cache_invalidate();
 	cds_list_add_rcu(&runtime->p.node, insert_loc);
 alloc_error:
 	dbg_printf("Linking failed.\n");
@@ -508,8 +566,19 @@ void lttng_bytecode_sync_state(struct lttng_ust_bytecode_runtime *runtime)
 
 	if (!bc->enabler->enabled || runtime->link_failed)
 		runtime->interpreter_func = lttng_bytecode_interpret_error;
+	else if (caa_container_of(runtime, struct bytecode_runtime, p)->compiled.valid)
+		runtime->interpreter_func = lttng_bytecode_interpret_compiled;
+	else if (caa_container_of(runtime, struct bytecode_runtime, p)->compiled_capture.valid)
+		runtime->interpreter_func = lttng_bytecode_interpret_compiled_capture;
 	else
 		runtime->interpreter_func = lttng_bytecode_interpret;
+	/*
+	 * Invalidate the filter results cached by the probes once they can
+	 * only see the new interpreter function: a result computed with
+	 * the previous one is tagged with the previous generation.
+	 */
+	cmm_smp_wmb();
+	lttng_bytecode_filter_cache_invalidate();
 }
 
 /*
@@ -590,7 +659,44 @@ void free_filter_runtime(struct cds_list_head *bytecode_runtime_head)
 	}
 }
 
+static
+void print_filter_profile(const struct lttng_ust_event_common *event)
+{
+	struct lttng_ust_bytecode_runtime *runtime;
+	char name[LTTNG_UST_ABI_SYM_NAME_LEN];
+	unsigned int i = 0;
+
+	lttng_ust_format_event_name(event->priv->desc, name);
+	cds_list_for_each_entry(runtime, &event->priv->filter_bytecode_runtime_head, node) {
+		if (!runtime->profile)
+			continue;
+		DBG("Filter profile: event \"%s\" filter %u: %lu evaluations, %lu accepted, %lu cache hits, %lu ns sampled%s",
+			name, i++, uatomic_read(&runtime->nr_eval),
+			uatomic_read(&runtime->nr_accept),
+			uatomic_read(&runtime->nr_cache_hit),
+			uatomic_read(&runtime->sampled_time),
+			runtime->fused ? " (fused)" : "");
+	}
+}
+
+void lttng_bytecode_filter_stats_add(struct cds_list_head *bytecode_runtime_head,
+		const struct lttng_enabler *enabler,
+		struct lttng_ust_abi_filter_stats *stats)
+{
+	struct lttng_ust_bytecode_runtime *runtime;
+
+	cds_list_for_each_entry(runtime, bytecode_runtime_head, node) {
+		if (runtime->bc->enabler != enabler)
+			continue;
+		stats->nr_eval += uatomic_read(&runtime->nr_eval);
+		stats->nr_accept += uatomic_read(&runtime->nr_accept);
+		stats->nr_cache_hit += uatomic_read(&runtime->nr_cache_hit);
+		stats->sampled_time += uatomic_read(&runtime->sampled_time);
+	}
+}
+
 void lttng_free_event_filter_runtime(struct lttng_ust_event_common *event)
 {
+	print_filter_profile(event);
 	free_filter_runtime(&event->priv->filter_bytecode_runtime_head);
 }
@@ -58,16 +58,6 @@ do {								\
 } while (0)
 #endif
 
-/* Linked bytecode. Child of struct lttng_ust_bytecode_runtime. */
-struct bytecode_runtime {
-	struct lttng_ust_bytecode_runtime p;
-	size_t data_len;
-	size_t data_alloc_len;
-	char *data;
-	uint16_t len;
-	char code[0];
-};
-
 enum entry_type {
 	REG_S64,
 	REG_U64,
@@ -110,6 +100,65 @@ enum object_type {
 	OBJECT_TYPE_DYNAMIC,
 };
 
+/*
+ * Operand of a compiled filter: either a literal, or an integer payload
+ * field read at a fixed offset of the interpreter stack data.
+ */
+struct bytecode_compiled_operand {
+	bool literal;
+	enum object_type type;	/* Payload field integer type */
+	uint64_t offset;	/* Payload field offset, in bytes */
+	int64_t v;		/* Literal value */
+};
+
+#define BYTECODE_COMPILED_MAX_INSN	16
+
+enum bytecode_compiled_insn_kind {
+	BYTECODE_COMPILED_CMP,	/* r0 = bx <op> ax */
+	BYTECODE_COMPILED_AND,	/* if r0 == 0, jump to target */
+	BYTECODE_COMPILED_OR,	/* if r0 != 0, r0 = 1 and jump to target */
+};
+
+struct bytecode_compiled_insn {
+	enum bytecode_compiled_insn_kind kind;
+	bytecode_opcode_t op;	/* BYTECODE_OP_{EQ,NE,GT,LT,GE,LE}_S64 */
+	uint16_t target;	/* Index of the jump target instruction */
+	struct bytecode_compiled_operand bx, ax;
+};
+
+/*
+ * Register form of a filter made of integer comparisons combined with
+ * logical and/or, evaluated natively instead of going through the
+ * interpreter. The result of the last comparison or logical operator is
+ * kept in a single register (r0), the filter result.
+ */
+struct bytecode_compiled_filter {
+	bool valid;
+	uint16_t nr_insn;
+	struct bytecode_compiled_insn insn[BYTECODE_COMPILED_MAX_INSN];
+};
+
+/*
+ * Capture of a payload field, read straight from the interpreter stack
+ * data into the capture output.
+ */
+struct bytecode_compiled_capture {
+	bool valid;
+	uint16_t index;		/* Offset of the field get index data in data */
+};
+
+/* Linked bytecode. Child of struct lttng_ust_bytecode_runtime. */
+struct bytecode_runtime {
+	struct lttng_ust_bytecode_runtime p;
+	size_t data_len;
+	size_t data_alloc_len;
+	char *data;
+	struct bytecode_compiled_filter compiled;
+	struct bytecode_compiled_capture compiled_capture;
+	uint16_t len;
+	char code[0];
+};
+
 struct bytecode_get_index_data {
 	uint64_t offset;	/* in bytes */
 	size_t ctx_index;
@@ -328,6 +377,18 @@ int lttng_bytecode_specialize(const struct lttng_ust_event_desc *event_desc,
 		struct bytecode_runtime *bytecode)
 	__attribute__((visibility("hidden")));
 
+bool lttng_bytecode_context_is_thread_stable(const char *name)
+	__attribute__((visibility("hidden")));
+
+int lttng_bytecode_compile(struct bytecode_runtime *bytecode)
+	__attribute__((visibility("hidden")));
+
+int lttng_bytecode_interpret_compiled(struct lttng_ust_bytecode_runtime *bytecode_runtime,
+		const char *stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		void *ctx)
+	__attribute__((visibility("hidden")));
+
 int lttng_bytecode_interpret_error(struct lttng_ust_bytecode_runtime *bytecode_runtime,
 		const char *stack_data,
 		struct lttng_ust_probe_ctx *probe_ctx,
@@ -340,4 +401,10 @@ int lttng_bytecode_interpret(struct lttng_ust_bytecode_runtime *bytecode_runtime
 		void *ctx)
 	__attribute__((visibility("hidden")));
 
+int lttng_bytecode_interpret_compiled_capture(struct lttng_ust_bytecode_runtime *bytecode_runtime,
+		const char *stack_data,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		void *ctx)
+	__attribute__((visibility("hidden")));
+
 #endif /* _LTTNG_BYTECODE_H */
@@ -0,0 +1,355 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * LTTng UST callstack context.
+ *
+ * Records the return addresses of the callers of the tracepoint by
+ * walking the frame pointer chain starting at the probe frame. This
+ * does not rely on unwind tables, and only gives a complete callstack
+ * for code built with frame pointers (-fno-omit-frame-pointer). The walk
+ * stops at the first frame which does not look valid. The callstack is
+ * walked once per tracepoint hit, and shared by the callbacks of both
+ * context fields of all the channels recording the event.
+ */
+
+#define _LGPL_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <lttng/ust-arch.h>
+#include <lttng/ust-events.h>
+#include <lttng/ust-tracer.h>
+#include <lttng/ust-ringbuffer-context.h>
+#include <urcu/tls-compat.h>
+
+#include "common/macros.h"
+#include "common/events.h"
+#include "common/ringbuffer/frontend_internal.h"
+#include "context-internal.h"
+#include "lttng-tracer-core.h"
+
+#if defined(LTTNG_UST_ARCH_X86) || defined(LTTNG_UST_ARCH_AARCH64)
+
+/*
+ * Frame record pointed to by the frame pointer register, on both x86
+ * and aarch64: the caller frame pointer followed by the return address.
+ */
+struct callstack_frame {
+	struct callstack_frame *next;
+	uintptr_t ret;
+};
+
+/*
+ * Upper bound on the number of frames visited by a walk, including the
+ * ones skipped because they repeat the previous return address.
+ */
+#define CALLSTACK_MAX_FRAMES	(4 * LTTNG_UST_ABI_CALLSTACK_MAX_DEPTH)
+
+#define CALLSTACK_PROBE_CTX_SIZE	(offsetof(struct lttng_ust_probe_ctx, frame) \
+						+ sizeof(void *))
+
+struct callstack_bounds {
+	uintptr_t low, high;
+	int state;		/* 0: unknown, 1: valid, -1: unavailable. */
+};
+
+/*
+ * Stack bounds of the current thread. Frame pointers outside of those
+ * bounds end the walk, which prevents dereferencing garbage when the
+ * chain goes through code built without frame pointers.
+ */
+static DEFINE_URCU_TLS(struct callstack_bounds, callstack_bounds);
+
+static
+bool callstack_get_bounds(uintptr_t *low, uintptr_t *high)
+{
+	struct callstack_bounds *bounds = &URCU_TLS(callstack_bounds);
+
+	if (caa_unlikely(!bounds->state)) {
+		pthread_attr_t attr;
+		void *addr;
+		size_t size;
+
+		bounds->state = -1;
+		if (!pthread_getattr_np(pthread_self(), &attr)) {
+			if (!pthread_attr_getstack(&attr, &addr, &size)) {
+				bounds->low = (uintptr_t) addr;
+				bounds->high = (uintptr_t) addr + size;
+				bounds->state = 1;
+			}
+			(void) pthread_attr_destroy(&attr);
+		}
+	}
+	if (bounds->state < 0)
+		return false;
+	*low = bounds->low;
+	*high = bounds->high;
+	return true;
+}
+
+/*
+ * Only the frames of the callers of the probe are visited. They do not
+ * change while the probe runs, so successive walks for the same event
+ * yield the same callstack.
+ *
+ * Consecutive identical return addresses, as found in recursions, are
+ * recorded once.
+ */
+static
+unsigned int callstack_walk(struct lttng_ust_probe_ctx *probe_ctx,
+		unsigned int max_depth, uintptr_t *entries)
+{
+	struct callstack_frame *frame;
+	uintptr_t low, high;
+	unsigned int depth = 0, nr_frames;
+
+	if (!probe_ctx || probe_ctx->struct_size < CALLSTACK_PROBE_CTX_SIZE
+			|| !probe_ctx->frame)
+		return 0;
+	if (!callstack_get_bounds(&low, &high))
+		return 0;
+	frame = probe_ctx->frame;
+	for (nr_frames = 0; depth < max_depth && nr_frames < CALLSTACK_MAX_FRAMES;
+			nr_frames++) {
+		struct callstack_frame *next;
+
+		if ((uintptr_t) frame < low
+				|| (uintptr_t) frame > high - sizeof(*frame)
+				|| ((uintptr_t) frame & (sizeof(void *) - 1)))
+			break;
+		if (!frame->ret)
+			break;
+		if (!depth || entries[depth - 1] != frame->ret)
+			entries[depth++] = frame->ret;
+		next = frame->next;
+		/* The stack grows down: caller frames are at higher addresses. */
+		if (next <= frame)
+			break;
+		frame = next;
+	}
+	return depth;
+}
+
+#else
+
+static
+unsigned int callstack_walk(struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		unsigned int max_depth __attribute__((unused)),
+		uintptr_t *entries __attribute__((unused)))
+{
+	return 0;
+}
+
+#endif
+
+static
+unsigned int callstack_max_depth(void *priv)
+{
+	return (unsigned int) (uintptr_t) priv;
+}
+
+struct callstack_cache {
+	unsigned long gen;
+	unsigned int depth;
+	uintptr_t entries[LTTNG_UST_ABI_CALLSTACK_MAX_DEPTH];
+};
+
+/*
+ * Callstacks walked by the current thread, one per ring buffer nesting
+ * level: the callbacks of a record all run at the nesting level of its
+ * reservation, and the records of tracepoints hit from a signal handler
+ * use the following levels, so they do not overwrite the callstack of
+ * the record they interrupt.
+ */
+struct callstack_tls {
+	unsigned long gen;
+	struct callstack_cache cache[LIB_RING_BUFFER_MAX_NESTING];
+};
+
+static DEFINE_URCU_TLS(struct callstack_tls, callstack_tls);
+
+static
+struct callstack_cache *callstack_get_cache(void)
+{
+	unsigned int nesting = URCU_TLS(lib_ring_buffer_nesting);
+
+	if (caa_unlikely(!nesting || nesting > LIB_RING_BUFFER_MAX_NESTING))
+		nesting = 1;
+	return &URCU_TLS(callstack_tls).cache[nesting - 1];
+}
+
+/*
+ * Walk the callstack into the cache of the current nesting level, and
+ * return its generation, which is kept in the memo of the tracepoint
+ * hit.
+ */
+static
+void callstack_walk_cached(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_ctx_value *value)
+{
+	struct callstack_cache *cache = callstack_get_cache();
+
+	cache->gen = ++URCU_TLS(callstack_tls).gen;
+	cache->depth = callstack_walk(probe_ctx, callstack_max_depth(priv),
+			cache->entries);
+	value->sel = LTTNG_UST_DYNAMIC_TYPE_U64;
+	value->u.u64 = cache->gen;
+}
+
+/*
+ * Get the callstack of the tracepoint hit, walking it only if the memo
+ * of the hit does not tell it is already cached. Without memo, or if
+ * the cache was reused since, the callstack is walked again.
+ */
+static
+const struct callstack_cache *callstack_get(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx)
+{
+	struct lttng_ust_ctx_field memo_key = {
+		.get_value = callstack_walk_cached,
+		.priv = priv,
+	};
+	struct callstack_cache *cache;
+	struct lttng_ust_ctx_value value;
+
+	lttng_ust_ctx_get_value(&memo_key, probe_ctx, &value);
+	cache = callstack_get_cache();
+	if (caa_unlikely(value.u.u64 != cache->gen))
+		callstack_walk_cached(priv, probe_ctx, &value);
+	return cache;
+}
+
+static
+size_t callstack_length_get_size(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		size_t offset)
+{
+	size_t size = 0;
+
+	size += lttng_ust_ring_buffer_align(offset, lttng_ust_rb_alignof(uint32_t));
+	size += sizeof(uint32_t);
+	return size;
+}
+
+static
+void callstack_length_record(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_channel_buffer *chan)
+{
+	uint32_t depth = callstack_get(priv, probe_ctx)->depth;
+
+	chan->ops->event_write(ctx, &depth, sizeof(depth),
+		lttng_ust_rb_alignof(depth));
+}
+
+static
+size_t callstack_get_size(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		size_t offset)
+{
+	size_t size = 0;
+
+	size += lttng_ust_ring_buffer_align(offset, lttng_ust_rb_alignof(uintptr_t));
+	size += sizeof(uintptr_t) * callstack_get(priv, probe_ctx)->depth;
+	return size;
+}
+
+static
+void callstack_record(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx,
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_channel_buffer *chan)
+{
+	const struct callstack_cache *cache = callstack_get(priv, probe_ctx);
+
+	chan->ops->event_write(ctx, cache->entries,
+		sizeof(uintptr_t) * cache->depth,
+		lttng_ust_rb_alignof(uintptr_t));
+}
+
+static const struct lttng_ust_event_field *callstack_length_field =
+	lttng_ust_static_event_field("_callstack_length",
+		lttng_ust_static_type_integer(sizeof(uint32_t) * CHAR_BIT,
+				lttng_ust_rb_alignof(uint32_t) * CHAR_BIT,
+				lttng_ust_is_signed_type(uint32_t),
+				LTTNG_UST_BYTE_ORDER, 10),
+		false, true);
+
+static const struct lttng_ust_event_field *callstack_field =
+	lttng_ust_static_event_field("callstack",
+		(const struct lttng_ust_type_common *) LTTNG_UST_COMPOUND_LITERAL(const struct lttng_ust_type_sequence, {
+			.parent = {
+				.type = lttng_ust_type_sequence,
+			},
+			.struct_size = sizeof(struct lttng_ust_type_sequence),
+			.length_name = "_callstack_length",
+			.elem_type = lttng_ust_static_type_integer(sizeof(uintptr_t) * CHAR_BIT,
+					lttng_ust_rb_alignof(uintptr_t) * CHAR_BIT,
+					lttng_ust_is_signed_type(uintptr_t),
+					LTTNG_UST_BYTE_ORDER, 16),
+			.alignment = 0,
+			.encoding = lttng_ust_string_encoding_none,
+		}),
+		false, true);
+
+/*
+ * The callstack is recorded as two context fields: its length, and the
+ * sequence of return addresses. The maximum depth is kept in the field
+ * private data, so each context can use its own limit.
+ */
+int lttng_add_callstack_to_ctx(uint32_t max_depth, struct lttng_ust_ctx **ctx)
+{
+	struct lttng_ust_ctx_field ctx_field;
+	int ret;
+
+#if !defined(LTTNG_UST_ARCH_X86) && !defined(LTTNG_UST_ARCH_AARCH64)
+	return -ENOSYS;
+#endif
+	if (!max_depth)
+		max_depth = LTTNG_UST_ABI_CALLSTACK_DEFAULT_DEPTH;
+	if (max_depth > LTTNG_UST_ABI_CALLSTACK_MAX_DEPTH)
+		return -EINVAL;
+	if (lttng_find_context(*ctx, callstack_field->name)) {
+		ret = -EEXIST;
+		goto error_find_context;
+	}
+
+	memset(&ctx_field, 0, sizeof(ctx_field));
+	ctx_field.event_field = callstack_length_field;
+	ctx_field.get_size = callstack_length_get_size;
+	ctx_field.record = callstack_length_record;
+	ctx_field.priv = (void *) (uintptr_t) max_depth;
+	ret = lttng_ust_context_append(ctx, &ctx_field);
+	if (ret)
+		return ret;
+
+	ctx_field.event_field = callstack_field;
+	ctx_field.get_size = callstack_get_size;
+	ctx_field.record = callstack_record;
+	ret = lttng_ust_context_append(ctx, &ctx_field);
+	if (ret) {
+		lttng_ust_context_remove_last(*ctx);
+		return ret;
+	}
+	return 0;
+
+error_find_context:
+	return ret;
+}
+
+/*
+ * Force a read (imply TLS allocation for dlopen) of TLS variables.
+ */
+void lttng_callstack_alloc_tls(void)
+{
+#if defined(LTTNG_UST_ARCH_X86) || defined(LTTNG_UST_ARCH_AARCH64)
+	asm volatile ("" : : "m" (URCU_TLS(callstack_bounds)));
+#endif
+	asm volatile ("" : : "m" (URCU_TLS(callstack_tls).gen));
+}
@@ -30,11 +30,14 @@
  */
 static DEFINE_URCU_TLS_INIT(ino_t, cached_cgroup_ns, NS_INO_UNINITIALIZED);
 
+static struct lttng_ns_cache process_cgroup_ns;
+
 static
 ino_t get_cgroup_ns(void)
 {
 	struct stat sb;
 	ino_t cgroup_ns;
+	unsigned long generation;
 
 	cgroup_ns = CMM_LOAD_SHARED(URCU_TLS(cached_cgroup_ns));
 
@@ -45,6 +48,14 @@ ino_t get_cgroup_ns(void)
 	if (caa_likely(cgroup_ns != NS_INO_UNINITIALIZED))
 		return cgroup_ns;
 
+	/*
+	 * Inherit the value populated by another thread if all threads
+	 * share the same namespaces.
+	 */
+	cgroup_ns = lttng_ns_cache_get(&process_cgroup_ns, &generation);
+	if (caa_likely(cgroup_ns != NS_INO_UNINITIALIZED))
+		goto end;
+
 	/*
 	 * At this point we have to populate the cache, set the initial
 	 * value to NS_INO_UNAVAILABLE (0), if we fail to get the inode
@@ -71,6 +82,8 @@ ino_t get_cgroup_ns(void)
 		}
 	}
 
+	lttng_ns_cache_set(&process_cgroup_ns, cgroup_ns, generation);
+end:
 	/*
 	 * And finally, store the inode number in the cache.
 	 */
@@ -123,7 +136,7 @@ void cgroup_ns_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = get_cgroup_ns();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("cgroup_ns",
 		lttng_ust_static_type_integer(sizeof(ino_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(ino_t) * CHAR_BIT,
@@ -22,6 +22,7 @@
 #include <lttng/ust-ringbuffer-context.h>
 
 #include "common/getcpu.h"
+#include "common/ringbuffer/frontend_types.h"
 
 #include "context-internal.h"
 
@@ -43,9 +44,18 @@ void cpu_id_record(void *priv __attribute__((unused)),
 		struct lttng_ust_ring_buffer_ctx *ctx,
 		struct lttng_ust_channel_buffer *chan)
 {
+	struct lttng_ust_ring_buffer_ctx_private *ctx_private = ctx->priv;
 	int cpu;
 
-	cpu = lttng_ust_get_cpu();
+	/*
+	 * The reserve already queried the cpu of per-cpu buffers. It may
+	 * differ from the stream of the record, which holds several cpus
+	 * or records spilled from other streams.
+	 */
+	if (ctx_private->chan->backend.config.alloc == RING_BUFFER_ALLOC_PER_CPU)
+		cpu = ctx_private->cpu;
+	else
+		cpu = lttng_ust_get_cpu();
 	chan->ops->event_write(ctx, &cpu, sizeof(cpu), lttng_ust_rb_alignof(cpu));
 }
 
@@ -57,6 +67,7 @@ void cpu_id_get_value(void *priv __attribute__((unused)),
 	value->u.s64 = lttng_ust_get_cpu();
 }
 
+/* Not freezable: records use the cpu of the reserve, not get_value. */
 static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
 	lttng_ust_static_event_field("cpu_id",
 		lttng_ust_static_type_integer(sizeof(int) * CHAR_BIT,
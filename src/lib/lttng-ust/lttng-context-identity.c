@@ -0,0 +1,130 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * LTTng UST identity context.
+ *
+ * Records the vpid, vtid, vuid, vgid and procname of the current thread
+ * as a single structure field, with one record callback and one write
+ * into the ring buffer instead of one per field.
+ */
+
+#define _LGPL_SOURCE
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+#include <lttng/ust-events.h>
+#include <lttng/ust-tracer.h>
+#include <lttng/ust-ringbuffer-context.h>
+
+#include "common/macros.h"
+#include "context-internal.h"
+
+/*
+ * In-memory layout of the record. All integers are 32-bit, so there is
+ * no padding before the procname, both with natural alignment and
+ * without, and the layout matches the structure type described below.
+ */
+struct identity_record {
+	pid_t vpid;
+	pid_t vtid;
+	uid_t vuid;
+	gid_t vgid;
+	char procname[LTTNG_UST_CONTEXT_PROCNAME_LEN];
+};
+
+#define IDENTITY_RECORD_SIZE	(offsetof(struct identity_record, procname) \
+					+ LTTNG_UST_CONTEXT_PROCNAME_LEN)
+
+lttng_ust_static_assert(sizeof(pid_t) == sizeof(uint32_t)
+		&& sizeof(uid_t) == sizeof(uint32_t)
+		&& sizeof(gid_t) == sizeof(uint32_t),
+		"Identity context integers are expected to be 32-bit",
+		identity_context_integers_are_32_bit);
+
+static
+size_t identity_get_size(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		size_t offset)
+{
+	size_t size = 0;
+
+	size += lttng_ust_ring_buffer_align(offset, lttng_ust_rb_alignof(uint32_t));
+	size += IDENTITY_RECORD_SIZE;
+	return size;
+}
+
+static
+void identity_record(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_channel_buffer *chan)
+{
+	struct identity_record record;
+
+	record.vpid = lttng_context_vpid_get();
+	record.vtid = lttng_context_vtid_get();
+	record.vuid = lttng_context_vuid_get();
+	record.vgid = lttng_context_vgid_get();
+	memcpy(record.procname, lttng_context_procname_get(),
+		LTTNG_UST_CONTEXT_PROCNAME_LEN);
+	chan->ops->event_write(ctx, &record, IDENTITY_RECORD_SIZE,
+		lttng_ust_rb_alignof(uint32_t));
+}
+
+#define identity_integer_field(_name, _type)					\
+	lttng_ust_static_event_field(_name,					\
+		lttng_ust_static_type_integer(sizeof(_type) * CHAR_BIT,		\
+				lttng_ust_rb_alignof(_type) * CHAR_BIT,		\
+				lttng_ust_is_signed_type(_type),		\
+				LTTNG_UST_BYTE_ORDER, 10),			\
+		false, false)
+
+static const struct lttng_ust_event_field * const identity_fields[] = {
+	identity_integer_field("vpid", pid_t),
+	identity_integer_field("vtid", pid_t),
+	identity_integer_field("vuid", uid_t),
+	identity_integer_field("vgid", gid_t),
+	lttng_ust_static_event_field("procname",
+		lttng_ust_static_type_array_text(LTTNG_UST_CONTEXT_PROCNAME_LEN),
+		false, false),
+};
+
+static const struct lttng_ust_type_struct identity_type = {
+	.parent = {
+		.type = lttng_ust_type_struct,
+	},
+	.struct_size = sizeof(struct lttng_ust_type_struct),
+	.nr_fields = LTTNG_ARRAY_SIZE(identity_fields),
+	.fields = identity_fields,
+	.alignment = lttng_ust_rb_alignof(uint32_t) * CHAR_BIT,
+};
+
+/* A structure cannot be used by filters, hence no get_value callback. */
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+	lttng_ust_static_event_field("identity",
+		&identity_type.parent,
+		false, true),
+	identity_get_size,
+	identity_record,
+	NULL,
+	NULL, NULL);
+
+int lttng_add_identity_to_ctx(struct lttng_ust_ctx **ctx)
+{
+	int ret;
+
+	if (lttng_find_context(*ctx, ctx_field->event_field->name)) {
+		ret = -EEXIST;
+		goto error_find_context;
+	}
+	ret = lttng_ust_context_append(ctx, ctx_field);
+	if (ret)
+		return ret;
+	return 0;
+
+error_find_context:
+	return ret;
+}
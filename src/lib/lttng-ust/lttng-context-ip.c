@@ -49,7 +49,7 @@ void ip_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = (unsigned long) probe_ctx->ip;
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("ip",
 		lttng_ust_static_type_integer(sizeof(void *) * CHAR_BIT,
 				lttng_ust_rb_alignof(void *) * CHAR_BIT,
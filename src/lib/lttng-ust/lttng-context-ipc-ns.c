@@ -29,11 +29,14 @@
  */
 static DEFINE_URCU_TLS_INIT(ino_t, cached_ipc_ns, NS_INO_UNINITIALIZED);
 
+static struct lttng_ns_cache process_ipc_ns;
+
 static
 ino_t get_ipc_ns(void)
 {
 	struct stat sb;
 	ino_t ipc_ns;
+	unsigned long generation;
 
 	ipc_ns = CMM_LOAD_SHARED(URCU_TLS(cached_ipc_ns));
 
@@ -44,6 +47,14 @@ ino_t get_ipc_ns(void)
 	if (caa_likely(ipc_ns != NS_INO_UNINITIALIZED))
 		return ipc_ns;
 
+	/*
+	 * Inherit the value populated by another thread if all threads
+	 * share the same namespaces.
+	 */
+	ipc_ns = lttng_ns_cache_get(&process_ipc_ns, &generation);
+	if (caa_likely(ipc_ns != NS_INO_UNINITIALIZED))
+		goto end;
+
 	/*
 	 * At this point we have to populate the cache, set the initial
 	 * value to NS_INO_UNAVAILABLE (0), if we fail to get the inode
@@ -70,6 +81,8 @@ ino_t get_ipc_ns(void)
 		}
 	}
 
+	lttng_ns_cache_set(&process_ipc_ns, ipc_ns, generation);
+end:
 	/*
 	 * And finally, store the inode number in the cache.
 	 */
@@ -121,7 +134,7 @@ void ipc_ns_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = get_ipc_ns();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("ipc_ns",
 		lttng_ust_static_type_integer(sizeof(ino_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(ino_t) * CHAR_BIT,
@@ -32,6 +32,9 @@
 #include <signal.h>
 #include <urcu/tls-compat.h>
 #include "perf_event.h"
+#include "common/getcpu.h"
+#include "common/smp.h"
+#include "common/compat/tid.h"
 
 #include "context-internal.h"
 #include "lttng-tracer-core.h"
@@ -45,6 +48,25 @@
  *
  * Updates and traversals of thread_list are protected by UST lock.
  * Updates to rcu_field_list are protected by UST lock.
+ *
+ * The perf counters attached to a given context form a perf event
+ * group, led by the first one attached. For each thread, the group
+ * leader thread field is opened first, and the member thread fields
+ * are opened together with it, within the leader group. Since the
+ * kernel schedules the counters of a group together, recording the
+ * leader reads all group counters in a single seqlock-protected pass,
+ * and the members, which are recorded after the leader within the same
+ * context, use the value read by the leader. Updates to the group lists
+ * are protected by the perf lock.
+ *
+ * Thread fields are created when a perf counter is added to a context,
+ * for all the threads registered at that point, and when a thread
+ * registers, for all the perf counters of existing contexts, so that
+ * recording events does not open and map counters. Threads register
+ * from lttng_ust_init_thread(), and otherwise when they first record a
+ * perf counter. The registered threads and the perf counters are listed
+ * under the perf lock. Group leader thread fields keep their fd open,
+ * so that counters added later can join their group.
  */
 
 struct lttng_perf_counter_thread_field {
@@ -52,22 +74,44 @@ struct lttng_perf_counter_thread_field {
 	struct perf_event_mmap_page *pc;
 	struct cds_list_head thread_field_node;	/* Per-field list of thread fields (node) */
 	struct cds_list_head rcu_field_node;	/* RCU per-thread list of fields (node) */
+	struct cds_list_head group_list;	/* Group members (head), for a leader */
+	struct cds_list_head group_node;	/* Group members (node), for a member */
+	struct lttng_perf_counter_thread_field *leader;	/* Group leader, NULL if not a member */
+	uint64_t value;				/* Value of the last group read */
+	uint32_t seq;				/* Seqlock value of the last group read */
 	int fd;					/* Perf FD */
 };
 
 struct lttng_perf_counter_thread {
 	struct cds_list_head rcu_field_list;	/* RCU per-thread list of fields */
+	struct cds_list_head thread_node;	/* Registered threads (node) */
+	pid_t pid, tid;
+};
+
+struct lttng_perf_counter_cpu {
+	struct perf_event_mmap_page *pc;
+	int fd;					/* Perf FD */
 };
 
 struct lttng_perf_counter_field {
 	struct perf_event_attr attr;
+	struct lttng_perf_counter_cpu *cpus;	/* Per-CPU counters, NULL for per-thread */
+	int nr_cpus;
 	struct cds_list_head thread_field_list;	/* Per-field list of thread fields */
+	struct cds_list_head group_list;	/* Group members (head), for a leader */
+	struct cds_list_head group_node;	/* Group members (node), for a member */
+	struct lttng_perf_counter_field *leader;	/* Group leader, NULL if leader */
+	struct cds_list_head field_node;	/* Per-thread perf counters (node) */
 	char *name;
 	struct lttng_ust_event_field *event_field;
 };
 
 static pthread_key_t perf_counter_key;
 
+/* Registered threads and per-thread perf counters, under the perf lock. */
+static CDS_LIST_HEAD(perf_thread_list);
+static CDS_LIST_HEAD(perf_field_list);
+
 /*
  * lttng_perf_lock - Protect lttng-ust perf counter data structures
  *
@@ -159,15 +203,14 @@ size_t perf_counter_get_size(void *priv __attribute__((unused)),
 }
 
 static
-uint64_t read_perf_counter_syscall(
-		struct lttng_perf_counter_thread_field *thread_field)
+uint64_t read_perf_counter_syscall(int fd)
 {
 	uint64_t count;
 
-	if (caa_unlikely(thread_field->fd < 0))
+	if (caa_unlikely(fd < 0))
 		return 0;
 
-	if (caa_unlikely(read(thread_field->fd, &count, sizeof(count))
+	if (caa_unlikely(read(fd, &count, sizeof(count))
 				< sizeof(count)))
 		return 0;
 
@@ -221,7 +264,7 @@ uint64_t arch_read_perf_counter(
 			count = pc->offset + pmcval;
 		} else {
 			/* Fall-back on system call if rdpmc cannot be used. */
-			return read_perf_counter_syscall(thread_field);
+			return read_perf_counter_syscall(thread_field->fd);
 		}
 		cmm_barrier();
 	} while (CMM_LOAD_SHARED(pc->lock) != seq);
@@ -229,6 +272,102 @@ uint64_t arch_read_perf_counter(
 	return count;
 }
 
+/*
+ * Read a CPU-wide counter with rdpmc, which reads the counter of the
+ * CPU it runs on. Return false if rdpmc cannot be used.
+ */
+static
+bool arch_read_perf_cpu_counter(struct perf_event_mmap_page *pc,
+		uint64_t *count)
+{
+	uint32_t seq, idx;
+
+	do {
+		int64_t pmcval;
+
+		seq = CMM_LOAD_SHARED(pc->lock);
+		cmm_barrier();
+
+		idx = pc->index;
+		if (caa_unlikely(!has_rdpmc(pc) || !idx))
+			return false;
+		pmcval = rdpmc(idx - 1);
+		/* Sign-extend the pmc register result. */
+		pmcval <<= 64 - pc->pmc_width;
+		pmcval >>= 64 - pc->pmc_width;
+		*count = pc->offset + pmcval;
+		cmm_barrier();
+	} while (CMM_LOAD_SHARED(pc->lock) != seq);
+
+	return true;
+}
+
+/*
+ * Read the counter without retrying. Return false if rdpmc cannot be
+ * used.
+ */
+static
+bool arch_read_perf_counter_once(
+		struct lttng_perf_counter_thread_field *thread_field)
+{
+	struct perf_event_mmap_page *pc = thread_field->pc;
+	uint32_t idx;
+	int64_t pmcval;
+
+	if (caa_unlikely(!pc))
+		return false;
+	thread_field->seq = CMM_LOAD_SHARED(pc->lock);
+	cmm_barrier();
+
+	idx = pc->index;
+	if (caa_unlikely(!has_rdpmc(pc) || !idx))
+		return false;
+	pmcval = rdpmc(idx - 1);
+	/* Sign-extend the pmc register result. */
+	pmcval <<= 64 - pc->pmc_width;
+	pmcval >>= 64 - pc->pmc_width;
+	thread_field->value = pc->offset + pmcval;
+	return true;
+}
+
+static
+bool arch_read_perf_counter_retry(
+		struct lttng_perf_counter_thread_field *thread_field)
+{
+	return CMM_LOAD_SHARED(thread_field->pc->lock) != thread_field->seq;
+}
+
+/*
+ * Read all counters of the group in one pass, retrying the whole pass
+ * if any of their mmap pages was updated concurrently.
+ */
+static
+void arch_read_perf_counter_group(
+		struct lttng_perf_counter_thread_field *leader)
+{
+	struct lttng_perf_counter_thread_field *member;
+	bool retry;
+
+	do {
+		if (!arch_read_perf_counter_once(leader))
+			goto fallback;
+		cds_list_for_each_entry_rcu(member, &leader->group_list, group_node) {
+			if (!arch_read_perf_counter_once(member))
+				goto fallback;
+		}
+		cmm_barrier();
+		retry = arch_read_perf_counter_retry(leader);
+		cds_list_for_each_entry_rcu(member, &leader->group_list, group_node)
+			retry |= arch_read_perf_counter_retry(member);
+	} while (retry);
+	return;
+
+fallback:
+	leader->value = arch_read_perf_counter(leader);
+	cds_list_for_each_entry_rcu(member, &leader->group_list, group_node)
+		member->value = arch_read_perf_counter(member);
+}
+
 static
 int arch_perf_keep_fd(struct lttng_perf_counter_thread_field *thread_field)
 {
@@ -246,7 +385,26 @@ static
 uint64_t arch_read_perf_counter(
 		struct lttng_perf_counter_thread_field *thread_field)
 {
-	return read_perf_counter_syscall(thread_field);
+	return read_perf_counter_syscall(thread_field->fd);
+}
+
+static
+bool arch_read_perf_cpu_counter(
+		struct perf_event_mmap_page *pc __attribute__((unused)),
+		uint64_t *count __attribute__((unused)))
+{
+	return false;
+}
+
+static
+void arch_read_perf_counter_group(
+		struct lttng_perf_counter_thread_field *leader)
+{
+	struct lttng_perf_counter_thread_field *member;
+
+	leader->value = arch_read_perf_counter(leader);
+	cds_list_for_each_entry_rcu(member, &leader->group_list, group_node)
+		member->value = arch_read_perf_counter(member);
 }
 
 static
@@ -267,11 +425,11 @@ int sys_perf_event_open(struct perf_event_attr *attr,
 }
 
 static
-int open_perf_fd(struct perf_event_attr *attr)
+int open_perf_fd(struct perf_event_attr *attr, pid_t tid, int group_fd)
 {
 	int fd;
 
-	fd = sys_perf_event_open(attr, 0, -1, -1, 0);
+	fd = sys_perf_event_open(attr, tid, -1, group_fd, 0);
 	if (fd < 0)
 		return -1;
 
@@ -302,7 +460,8 @@ static void setup_perf(struct lttng_perf_counter_thread_field *thread_field)
 		perf_addr = NULL;
 	thread_field->pc = perf_addr;
 
-	if (!arch_perf_keep_fd(thread_field)) {
+	/* Counters of a context may join the group of its first one later. */
+	if (!arch_perf_keep_fd(thread_field) && thread_field->field->leader) {
 		close_perf_fd(thread_field->fd);
 		thread_field->fd = -1;
 	}
@@ -322,10 +481,93 @@ void unmap_perf_page(struct perf_event_mmap_page *pc)
 	}
 }
 
+static
+struct lttng_perf_counter_thread_field *
+	find_thread_field(struct lttng_perf_counter_field *perf_field,
+		struct lttng_perf_counter_thread *perf_thread)
+{
+	struct lttng_perf_counter_thread_field *thread_field;
+
+	cds_list_for_each_entry_rcu(thread_field, &perf_thread->rcu_field_list,
+			rcu_field_node) {
+		if (thread_field->field == perf_field)
+			return thread_field;
+	}
+	return NULL;
+}
+
+/*
+ * Create the thread field of @perf_field for @perf_thread, whose thread
+ * is @tid, or the current thread if 0, unless it already exists. The
+ * counter is opened within the group of the leader thread field if
+ * possible, falling back on a counter of its own otherwise, e.g. if the
+ * group would not fit in the PMU. The thread field is set up before
+ * being published, since its thread may be recording concurrently.
+ *
+ * For the current thread, the thread field is created even if the
+ * counter cannot be opened, so that it reads 0 without retrying. For
+ * another thread, nothing is created, and the thread retries on its own.
+ *
+ * Called with perf lock held and signals blocked.
+ */
+static
+struct lttng_perf_counter_thread_field *
+	create_thread_field(struct lttng_perf_counter_field *perf_field,
+		struct lttng_perf_counter_thread *perf_thread, pid_t tid)
+{
+	struct lttng_perf_counter_thread_field *thread_field, *leader = NULL;
+	int fd = -1;
+
+	thread_field = find_thread_field(perf_field, perf_thread);
+	if (thread_field)
+		return thread_field;
+	if (perf_field->leader)
+		leader = create_thread_field(perf_field->leader, perf_thread, tid);
+	if (leader && leader->fd >= 0) {
+		fd = open_perf_fd(&perf_field->attr, tid, leader->fd);
+		if (fd < 0)
+			leader = NULL;
+	} else {
+		leader = NULL;
+	}
+	if (fd < 0)
+		fd = open_perf_fd(&perf_field->attr, tid, -1);
+	if (fd < 0 && tid)
+		return NULL;
+
+	thread_field = zmalloc(sizeof(*thread_field));
+	if (!thread_field)
+		abort();
+	thread_field->field = perf_field;
+	CDS_INIT_LIST_HEAD(&thread_field->group_list);
+	CDS_INIT_LIST_HEAD(&thread_field->group_node);
+	thread_field->leader = leader;
+	thread_field->fd = fd;
+	/*
+	 * Note: thread_field->pc can be NULL if setup_perf() fails.
+	 * Also, thread_field->fd can be -1 if open_perf_fd() fails.
+	 */
+	if (fd >= 0)
+		setup_perf(thread_field);
+	cds_list_add(&thread_field->thread_field_node,
+			&perf_field->thread_field_list);
+	if (leader)
+		cds_list_add_tail_rcu(&thread_field->group_node,
+				&leader->group_list);
+	cds_list_add_rcu(&thread_field->rcu_field_node,
+			&perf_thread->rcu_field_list);
+	return thread_field;
+}
+
+/*
+ * Register the current thread, and create its thread fields for the
+ * perf counters of the existing contexts.
+ */
 static
 struct lttng_perf_counter_thread *alloc_perf_counter_thread(void)
 {
 	struct lttng_perf_counter_thread *perf_thread;
+	struct lttng_perf_counter_field *perf_field;
 	sigset_t newmask, oldmask;
 	int ret;
 
@@ -343,9 +585,16 @@ struct lttng_perf_counter_thread *alloc_perf_counter_thread(void)
 	if (!perf_thread)
 		abort();
 	CDS_INIT_LIST_HEAD(&perf_thread->rcu_field_list);
+	perf_thread->pid = getpid();
+	perf_thread->tid = lttng_gettid();
 	ret = pthread_setspecific(perf_counter_key, perf_thread);
 	if (ret)
 		abort();
+	lttng_perf_lock();
+	cds_list_add(&perf_thread->thread_node, &perf_thread_list);
+	cds_list_for_each_entry(perf_field, &perf_field_list, field_node)
+		(void) create_thread_field(perf_field, perf_thread, 0);
+	lttng_perf_unlock();
 skip:
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	if (ret)
@@ -353,6 +602,48 @@ skip:
 	return perf_thread;
 }
 
+/*
+ * List a perf counter added to a context, within the group of @leader if
+ * not NULL, and create its thread fields for all registered threads.
+ * Threads inherited from the parent process across fork are not counted.
+ */
+static
+void add_thread_fields(struct lttng_perf_counter_field *perf_field,
+		struct lttng_perf_counter_field *leader)
+{
+	struct lttng_perf_counter_thread *perf_thread;
+	sigset_t newmask, oldmask;
+	pid_t pid = getpid();
+	int ret;
+
+	ret = sigfillset(&newmask);
+	if (ret)
+		abort();
+	ret = pthread_sigmask(SIG_BLOCK, &newmask, &oldmask);
+	if (ret)
+		abort();
+	lttng_perf_lock();
+	if (leader) {
+		perf_field->leader = leader;
+		cds_list_add_tail(&perf_field->group_node, &leader->group_list);
+	}
+	cds_list_add_tail(&perf_field->field_node, &perf_field_list);
+	cds_list_for_each_entry(perf_thread, &perf_thread_list, thread_node) {
+		if (perf_thread->pid != pid)
+			continue;
+		(void) create_thread_field(perf_field, perf_thread,
+				perf_thread->tid);
+	}
+	lttng_perf_unlock();
+	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+	if (ret)
+		abort();
+}
+
+/*
+ * Only used when the thread field could not be created beforehand, e.g.
+ * for the first events recorded by a thread which did not register.
+ */
 static
 struct lttng_perf_counter_thread_field *
 	add_thread_field(struct lttng_perf_counter_field *perf_field,
@@ -368,30 +659,9 @@ struct lttng_perf_counter_thread_field *
 	ret = pthread_sigmask(SIG_BLOCK, &newmask, &oldmask);
 	if (ret)
 		abort();
-	/* Check again with signals disabled */
-	cds_list_for_each_entry_rcu(thread_field, &perf_thread->rcu_field_list,
-			rcu_field_node) {
-		if (thread_field->field == perf_field)
-			goto skip;
-	}
-	thread_field = zmalloc(sizeof(*thread_field));
-	if (!thread_field)
-		abort();
-	thread_field->field = perf_field;
-	thread_field->fd = open_perf_fd(&perf_field->attr);
-	if (thread_field->fd >= 0)
-		setup_perf(thread_field);
-	/*
-	 * Note: thread_field->pc can be NULL if setup_perf() fails.
-	 * Also, thread_field->fd can be -1 if open_perf_fd() fails.
-	 */
 	lttng_perf_lock();
-	cds_list_add_rcu(&thread_field->rcu_field_node,
-			&perf_thread->rcu_field_list);
-	cds_list_add(&thread_field->thread_field_node,
-			&perf_field->thread_field_list);
+	thread_field = create_thread_field(perf_field, perf_thread, 0);
 	lttng_perf_unlock();
-skip:
 	ret = pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
 	if (ret)
 		abort();
@@ -406,17 +676,25 @@ struct lttng_perf_counter_thread_field *
 	struct lttng_perf_counter_thread_field *thread_field;
 
 	perf_thread = pthread_getspecific(perf_counter_key);
-	if (!perf_thread)
+	if (caa_unlikely(!perf_thread))
 		perf_thread = alloc_perf_counter_thread();
-	cds_list_for_each_entry_rcu(thread_field, &perf_thread->rcu_field_list,
-			rcu_field_node) {
-		if (thread_field->field == field)
-			return thread_field;
-	}
+	thread_field = find_thread_field(field, perf_thread);
+	if (caa_likely(thread_field))
+		return thread_field;
 	/* perf_counter_thread_field not found, need to add one */
 	return add_thread_field(field, perf_thread);
 }
 
+/*
+ * Register the current thread, so that its thread fields are created
+ * ahead of its first events.
+ */
+void lttng_perf_counter_init_thread(void)
+{
+	if (!pthread_getspecific(perf_counter_key))
+		(void) alloc_perf_counter_thread();
+}
+
 static
 uint64_t wrapper_perf_counter_read(void *priv)
 {
@@ -428,6 +706,28 @@ uint64_t wrapper_perf_counter_read(void *priv)
 	return arch_read_perf_counter(perf_thread_field);
 }
 
+/*
+ * The group leader is recorded before its members within a context, so
+ * the leader reads the whole group and the members use the values it
+ * read. An event nested between the two, from a signal handler, can
+ * only make the member values slightly more recent.
+ */
+static
+uint64_t wrapper_perf_counter_group_read(void *priv)
+{
+	struct lttng_perf_counter_field *perf_field;
+	struct lttng_perf_counter_thread_field *perf_thread_field;
+
+	perf_field = (struct lttng_perf_counter_field *) priv;
+	perf_thread_field = get_thread_field(perf_field);
+	if (perf_thread_field->leader)
+		return CMM_LOAD_SHARED(perf_thread_field->value);
+	if (cds_list_empty(&perf_thread_field->group_list))
+		return arch_read_perf_counter(perf_thread_field);
+	arch_read_perf_counter_group(perf_thread_field);
+	return perf_thread_field->value;
+}
+
 static
 void perf_counter_record(void *priv,
 		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
@@ -436,7 +736,7 @@ void perf_counter_record(void *priv,
 {
 	uint64_t value;
 
-	value = wrapper_perf_counter_read(priv);
+	value = wrapper_perf_counter_group_read(priv);
 	chan->ops->event_write(ctx, &value, sizeof(value), lttng_ust_rb_alignof(value));
 }
 
@@ -448,11 +748,134 @@ void perf_counter_get_value(void *priv,
 	value->u.u64 = wrapper_perf_counter_read(priv);
 }
 
+static
+int perf_get_cpu(void)
+{
+	/*
+	 * rdpmc reads the counter of the CPU it runs on, so the actual
+	 * CPU is needed here, regardless of any getcpu override.
+	 */
+	return lttng_ust_get_cpu_internal();
+}
+
+/*
+ * Read the counter of the current CPU, retrying if the thread migrated
+ * to another CPU meanwhile.
+ */
+static
+uint64_t wrapper_perf_cpu_counter_read(void *priv)
+{
+	struct lttng_perf_counter_field *perf_field;
+	struct lttng_perf_counter_cpu *cpu_counter;
+	uint64_t count;
+	int cpu;
+
+	perf_field = (struct lttng_perf_counter_field *) priv;
+	do {
+		cpu = perf_get_cpu();
+		if (caa_unlikely(cpu < 0 || cpu >= perf_field->nr_cpus))
+			return 0;
+		cpu_counter = &perf_field->cpus[cpu];
+		if (caa_unlikely(!cpu_counter->pc))
+			return read_perf_counter_syscall(cpu_counter->fd);
+		if (caa_unlikely(!arch_read_perf_cpu_counter(cpu_counter->pc, &count)))
+			return read_perf_counter_syscall(cpu_counter->fd);
+	} while (caa_unlikely(perf_get_cpu() != cpu));
+	return count;
+}
+
+static
+void perf_cpu_counter_record(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_channel_buffer *chan)
+{
+	uint64_t value;
+
+	value = wrapper_perf_cpu_counter_read(priv);
+	chan->ops->event_write(ctx, &value, sizeof(value), lttng_ust_rb_alignof(value));
+}
+
+static
+void perf_cpu_counter_get_value(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ctx_value *value)
+{
+	value->u.u64 = wrapper_perf_cpu_counter_read(priv);
+}
+
+/*
+ * Open one CPU-wide counter per possible CPU, shared by all threads of
+ * the process. The fds are kept open for the read system call fallback.
+ * Fails if the counter cannot be opened on any CPU, typically because
+ * CPU-wide counters need CAP_PERFMON or a perf_event_paranoid setting
+ * of 0 or less.
+ */
+static
+int setup_perf_cpus(struct lttng_perf_counter_field *perf_field)
+{
+	int cpu, nr_cpus, nr_opened = 0;
+
+	nr_cpus = num_possible_cpus();
+	if (nr_cpus <= 0)
+		return -EINVAL;
+	perf_field->cpus = zmalloc(nr_cpus * sizeof(*perf_field->cpus));
+	if (!perf_field->cpus)
+		return -ENOMEM;
+	perf_field->nr_cpus = nr_cpus;
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		struct lttng_perf_counter_cpu *cpu_counter = &perf_field->cpus[cpu];
+		void *perf_addr;
+
+		cpu_counter->fd = sys_perf_event_open(&perf_field->attr,
+				-1, cpu, -1, 0);
+		if (cpu_counter->fd < 0) {
+			/* Offline CPU, or not permitted. */
+			cpu_counter->fd = -1;
+			continue;
+		}
+		nr_opened++;
+		perf_addr = mmap(NULL, sizeof(struct perf_event_mmap_page),
+				PROT_READ, MAP_SHARED, cpu_counter->fd, 0);
+		if (perf_addr == MAP_FAILED)
+			perf_addr = NULL;
+		cpu_counter->pc = perf_addr;
+	}
+	if (!nr_opened) {
+		free(perf_field->cpus);
+		perf_field->cpus = NULL;
+		perf_field->nr_cpus = 0;
+		return -ENODEV;
+	}
+	return 0;
+}
+
+static
+void destroy_perf_cpus(struct lttng_perf_counter_field *perf_field)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < perf_field->nr_cpus; cpu++) {
+		close_perf_fd(perf_field->cpus[cpu].fd);
+		unmap_perf_page(perf_field->cpus[cpu].pc);
+	}
+	free(perf_field->cpus);
+}
+
 /* Called with perf lock held */
 static
 void lttng_destroy_perf_thread_field(
 		struct lttng_perf_counter_thread_field *thread_field)
 {
+	struct lttng_perf_counter_thread_field *pos, *p;
+
+	/* Members left without a leader read their own counter. */
+	cds_list_for_each_entry_safe(pos, p, &thread_field->group_list,
+			group_node) {
+		cds_list_del_init(&pos->group_node);
+		pos->leader = NULL;
+	}
+	cds_list_del(&thread_field->group_node);
 	close_perf_fd(thread_field->fd);
 	unmap_perf_page(thread_field->pc);
 	cds_list_del_rcu(&thread_field->rcu_field_node);
@@ -467,6 +890,7 @@ void lttng_destroy_perf_thread_key(void *_key)
 	struct lttng_perf_counter_thread_field *pos, *p;
 
 	lttng_perf_lock();
+	cds_list_del(&perf_thread->thread_node);
 	cds_list_for_each_entry_safe(pos, p, &perf_thread->rcu_field_list,
 			rcu_field_node)
 		lttng_destroy_perf_thread_field(pos);
@@ -488,9 +912,22 @@ void lttng_destroy_perf_counter_ctx_field(void *priv)
 	 * perform a "get" concurrently, thanks to urcu-bp grace
 	 * period. Holding the lttng perf lock protects against
 	 * concurrent modification of the per-thread thread field
-	 * list.
+	 * list, and of the perf counter list and groups by threads
+	 * registering.
 	 */
 	lttng_perf_lock();
+	cds_list_del(&perf_field->field_node);
+	if (perf_field->leader) {
+		cds_list_del(&perf_field->group_node);
+	} else {
+		struct lttng_perf_counter_field *member, *tmp;
+
+		cds_list_for_each_entry_safe(member, tmp,
+				&perf_field->group_list, group_node) {
+			cds_list_del_init(&member->group_node);
+			member->leader = NULL;
+		}
+	}
 	cds_list_for_each_entry_safe(pos, p, &perf_field->thread_field_list,
 			thread_field_node)
 		lttng_destroy_perf_thread_field(pos);
@@ -499,6 +936,19 @@ void lttng_destroy_perf_counter_ctx_field(void *priv)
 	free(perf_field);
 }
 
+/* Called with UST lock held */
+static
+void lttng_destroy_perf_cpu_counter_ctx_field(void *priv)
+{
+	struct lttng_perf_counter_field *perf_field;
+
+	perf_field = (struct lttng_perf_counter_field *) priv;
+	free(perf_field->name);
+	destroy_perf_cpus(perf_field);
+	free(perf_field->event_field);
+	free(perf_field);
+}
+
 #ifdef LTTNG_UST_ARCH_ARMV7
 
 static
@@ -517,6 +967,29 @@ int perf_get_exclude_kernel(void)
 
 #endif /* LTTNG_UST_ARCH_ARMV7 */
 
+/*
+ * Return the first perf counter attached to the context, which leads
+ * the group of the perf counters of this context.
+ */
+static
+struct lttng_perf_counter_field *find_group_leader(struct lttng_ust_ctx *ctx)
+{
+	unsigned int i;
+
+	if (!ctx)
+		return NULL;
+	for (i = 0; i < ctx->nr_fields; i++) {
+		struct lttng_perf_counter_field *perf_field;
+
+		if (ctx->fields[i].destroy != lttng_destroy_perf_counter_ctx_field)
+			continue;
+		perf_field = (struct lttng_perf_counter_field *) ctx->fields[i].priv;
+		if (!perf_field->leader)
+			return perf_field;
+	}
+	return NULL;
+}
+
 static const struct lttng_ust_type_common *ust_type =
 	lttng_ust_static_type_integer(sizeof(uint64_t) * CHAR_BIT,
 			lttng_ust_rb_alignof(uint64_t) * CHAR_BIT,
@@ -524,14 +997,16 @@ static const struct lttng_ust_type_common *ust_type =
 			LTTNG_UST_BYTE_ORDER, 10);
 
 /* Called with UST lock held */
-int lttng_add_perf_counter_to_ctx(uint32_t type,
+static
+int add_perf_counter_to_ctx(uint32_t type,
 				uint64_t config,
 				const char *name,
-				struct lttng_ust_ctx **ctx)
+				struct lttng_ust_ctx **ctx,
+				bool per_cpu)
 {
 	struct lttng_ust_ctx_field ctx_field;
 	struct lttng_ust_event_field *event_field;
-	struct lttng_perf_counter_field *perf_field;
+	struct lttng_perf_counter_field *perf_field, *leader;
 	char *name_alloc;
 	int ret;
 
@@ -561,32 +1036,51 @@ int lttng_add_perf_counter_to_ctx(uint32_t type,
 	perf_field->attr.config = config;
 	perf_field->attr.exclude_kernel = perf_get_exclude_kernel();
 	CDS_INIT_LIST_HEAD(&perf_field->thread_field_list);
+	CDS_INIT_LIST_HEAD(&perf_field->group_list);
+	CDS_INIT_LIST_HEAD(&perf_field->group_node);
+	CDS_INIT_LIST_HEAD(&perf_field->field_node);
 	perf_field->name = name_alloc;
 	perf_field->event_field = event_field;
 
-	/* Ensure that this perf counter can be used in this process. */
-	ret = open_perf_fd(&perf_field->attr);
-	if (ret < 0) {
-		ret = -ENODEV;
-		goto setup_error;
-	}
-	close_perf_fd(ret);
-
+	/* Not freezable: records read the group of counters at once. */
+	memset(&ctx_field, 0, sizeof(ctx_field));
 	ctx_field.event_field = event_field;
 	ctx_field.get_size = perf_counter_get_size;
-	ctx_field.record = perf_counter_record;
-	ctx_field.get_value = perf_counter_get_value;
-	ctx_field.destroy = lttng_destroy_perf_counter_ctx_field;
 	ctx_field.priv = perf_field;
+	if (per_cpu) {
+		ret = setup_perf_cpus(perf_field);
+		if (ret)
+			goto setup_error;
+		ctx_field.record = perf_cpu_counter_record;
+		ctx_field.get_value = perf_cpu_counter_get_value;
+		ctx_field.destroy = lttng_destroy_perf_cpu_counter_ctx_field;
+		leader = NULL;
+	} else {
+		/* Ensure that this perf counter can be used in this process. */
+		ret = open_perf_fd(&perf_field->attr, 0, -1);
+		if (ret < 0) {
+			ret = -ENODEV;
+			goto setup_error;
+		}
+		close_perf_fd(ret);
+		ctx_field.record = perf_counter_record;
+		ctx_field.get_value = perf_counter_get_value;
+		ctx_field.destroy = lttng_destroy_perf_counter_ctx_field;
+		leader = find_group_leader(*ctx);
+	}
 
 	ret = lttng_ust_context_append(ctx, &ctx_field);
 	if (ret) {
 		ret = -ENOMEM;
 		goto append_context_error;
 	}
+	if (!per_cpu)
+		add_thread_fields(perf_field, leader);
 	return 0;
 
 append_context_error:
+	if (per_cpu)
+		destroy_perf_cpus(perf_field);
 setup_error:
 	free(perf_field);
 perf_field_alloc_error:
@@ -598,6 +1092,24 @@ find_error:
 	return ret;
 }
 
+/* Called with UST lock held */
+int lttng_add_perf_counter_to_ctx(uint32_t type,
+				uint64_t config,
+				const char *name,
+				struct lttng_ust_ctx **ctx)
+{
+	return add_perf_counter_to_ctx(type, config, name, ctx, false);
+}
+
+/* Called with UST lock held */
+int lttng_add_perf_cpu_counter_to_ctx(uint32_t type,
+				uint64_t config,
+				const char *name,
+				struct lttng_ust_ctx **ctx)
+{
+	return add_perf_counter_to_ctx(type, config, name, ctx, true);
+}
+
 int lttng_perf_counter_init(void)
 {
 	int ret;
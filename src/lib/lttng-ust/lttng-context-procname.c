@@ -7,17 +7,27 @@
  */
 
 #define _LGPL_SOURCE
+#include <limits.h>
 #include <stddef.h>
+#include <string.h>
 #include <lttng/ust-events.h>
 #include <lttng/ust-tracer.h>
 #include <lttng/ust-ringbuffer-context.h>
 #include <urcu/tls-compat.h>
+#include <urcu/uatomic.h>
 #include <assert.h>
 #include "common/compat/pthread.h"
 #include "lttng-tracer-core.h"
 
 #include "context-internal.h"
 
+#define LTTNG_UST_TRACEPOINT_HIDDEN_DEFINITION
+#define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
+
+#define LTTNG_UST_TRACEPOINT_CREATE_PROBES
+#define LTTNG_UST_TRACEPOINT_DEFINE
+#include "lttng-ust-procname-provider.h"
+
 /* Maximum number of nesting levels for the procname cache. */
 #define PROCNAME_NESTING_MAX	2
 
@@ -36,6 +46,26 @@ static DEFINE_URCU_TLS(procname_array, cached_procname);
 
 static DEFINE_URCU_TLS(int, procname_nesting);
 
+/*
+ * Process-wide table of interned thread names for the procname_id
+ * context. Entries are only ever appended: an id stays valid for the
+ * lifetime of the process, including across fork. Writers reserve a
+ * slot, fill it, then publish it with the ready flag, so interning can
+ * be done from the tracing fast path without taking a lock. Concurrent
+ * interning of the same name can yield two ids mapping to the same
+ * name, which is harmless.
+ */
+struct procname_id_entry {
+	char name[LTTNG_UST_CONTEXT_PROCNAME_LEN];
+	int ready;
+};
+
+static struct procname_id_entry procname_ids[LTTNG_UST_PROCNAME_ID_MAX];
+static unsigned int nr_procname_ids;
+
+/* Interned id of the thread name, plus one. Zero if not interned yet. */
+static DEFINE_URCU_TLS(unsigned int, cached_procname_id);
+
 static inline
 const char *wrapper_getprocname(void)
 {
@@ -56,9 +86,79 @@ const char *wrapper_getprocname(void)
 	return URCU_TLS(cached_procname)[nesting];
 }
 
+const char *lttng_context_procname_get(void)
+{
+	return wrapper_getprocname();
+}
+
+static
+uint16_t procname_intern(const char *name)
+{
+	unsigned int i, nr, old;
+
+	nr = CMM_LOAD_SHARED(nr_procname_ids);
+	for (i = 0; i < nr; i++) {
+		if (!CMM_LOAD_SHARED(procname_ids[i].ready))
+			continue;
+		cmm_smp_rmb();
+		if (!strncmp(procname_ids[i].name, name, LTTNG_UST_CONTEXT_PROCNAME_LEN))
+			return i;
+	}
+	/* Reserve a slot, bounded by the table size. */
+	do {
+		if (nr >= LTTNG_UST_PROCNAME_ID_MAX)
+			return LTTNG_UST_PROCNAME_ID_OVERFLOW;
+		old = nr;
+		nr = uatomic_cmpxchg(&nr_procname_ids, old, old + 1);
+	} while (nr != old);
+	strncpy(procname_ids[nr].name, name, LTTNG_UST_CONTEXT_PROCNAME_LEN - 1);
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(procname_ids[nr].ready, 1);
+	return nr;
+}
+
+static inline
+uint16_t wrapper_getprocname_id(void)
+{
+	unsigned int cached = CMM_LOAD_SHARED(URCU_TLS(cached_procname_id));
+	const char *name;
+	uint16_t id;
+
+	if (caa_likely(cached))
+		return cached - 1;
+	name = wrapper_getprocname();
+	id = procname_intern(name);
+	/*
+	 * Cache the id before emitting the mapping, so the nested event
+	 * does not intern the name again if it records this context.
+	 */
+	CMM_STORE_SHARED(URCU_TLS(cached_procname_id), id + 1);
+	if (id != LTTNG_UST_PROCNAME_ID_OVERFLOW)
+		lttng_ust_tracepoint(lttng_ust_procname, intern, id, name);
+	return id;
+}
+
+unsigned int lttng_ust_procname_id_count(void)
+{
+	unsigned int nr = CMM_LOAD_SHARED(nr_procname_ids);
+
+	return nr < LTTNG_UST_PROCNAME_ID_MAX ? nr : LTTNG_UST_PROCNAME_ID_MAX;
+}
+
+const char *lttng_ust_procname_id_name(unsigned int id)
+{
+	if (id >= lttng_ust_procname_id_count())
+		return NULL;
+	if (!CMM_LOAD_SHARED(procname_ids[id].ready))
+		return NULL;
+	cmm_smp_rmb();
+	return procname_ids[id].name;
+}
+
 /* Reset should not be called from a signal handler. */
 void lttng_ust_context_procname_reset(void)
 {
+	CMM_STORE_SHARED(URCU_TLS(cached_procname_id), 0);
 	CMM_STORE_SHARED(URCU_TLS(cached_procname)[1][0], '\0');
 	CMM_STORE_SHARED(URCU_TLS(procname_nesting), 1);
 	CMM_STORE_SHARED(URCU_TLS(cached_procname)[0][0], '\0');
@@ -93,7 +193,7 @@ void procname_get_value(void *priv __attribute__((unused)),
 	value->u.str = wrapper_getprocname();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("procname",
 		lttng_ust_static_type_array_text(LTTNG_UST_CONTEXT_PROCNAME_LEN),
 		false, false),
@@ -119,10 +219,72 @@ error_find_context:
 	return ret;
 }
 
+static
+size_t procname_id_get_size(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		size_t offset)
+{
+	size_t size = 0;
+
+	size += lttng_ust_ring_buffer_align(offset, lttng_ust_rb_alignof(uint16_t));
+	size += sizeof(uint16_t);
+	return size;
+}
+
+static
+void procname_id_record(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_channel_buffer *chan)
+{
+	uint16_t id;
+
+	id = wrapper_getprocname_id();
+	chan->ops->event_write(ctx, &id, sizeof(id), lttng_ust_rb_alignof(id));
+}
+
+static
+void procname_id_get_value(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ctx_value *value)
+{
+	value->u.u64 = wrapper_getprocname_id();
+}
+
+static const struct lttng_ust_ctx_field *id_ctx_field = lttng_ust_static_freezable_ctx_field(
+	lttng_ust_static_event_field("procname_id",
+		lttng_ust_static_type_integer(sizeof(uint16_t) * CHAR_BIT,
+				lttng_ust_rb_alignof(uint16_t) * CHAR_BIT,
+				lttng_ust_is_signed_type(uint16_t),
+				LTTNG_UST_BYTE_ORDER, 10),
+		false, false),
+	procname_id_get_size,
+	procname_id_record,
+	procname_id_get_value,
+	NULL, NULL);
+
+int lttng_add_procname_id_to_ctx(struct lttng_ust_ctx **ctx)
+{
+	int ret;
+
+	if (lttng_find_context(*ctx, id_ctx_field->event_field->name)) {
+		ret = -EEXIST;
+		goto error_find_context;
+	}
+	ret = lttng_ust_context_append(ctx, id_ctx_field);
+	if (ret)
+		return ret;
+	return 0;
+
+error_find_context:
+	return ret;
+}
+
 /*
  * Force a read (imply TLS allocation for dlopen) of TLS variables.
  */
 void lttng_procname_alloc_tls(void)
 {
 	asm volatile ("" : : "m" (URCU_TLS(cached_procname)[0]));
+	asm volatile ("" : : "m" (URCU_TLS(cached_procname_id)));
 }
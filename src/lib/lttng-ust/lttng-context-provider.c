@@ -65,6 +65,7 @@ struct lttng_ust_registered_context_provider *lttng_ust_context_provider_registe
 	struct lttng_ust_registered_context_provider *reg_provider = NULL;
 	struct cds_hlist_head *head;
 	size_t name_len = strlen(provider->name);
+	enum lttng_ust_dynamic_type fixed_type;
 	uint32_t hash;
 
 	lttng_ust_alloc_tls();
@@ -75,6 +76,9 @@ struct lttng_ust_registered_context_provider *lttng_ust_context_provider_registe
 	/* Provider name cannot contain a colon character. */
 	if (strchr(provider->name, ':'))
 		return NULL;
+	fixed_type = lttng_ust_context_provider_fixed_type(provider);
+	if ((unsigned int) fixed_type >= _NR_LTTNG_UST_DYNAMIC_TYPES)
+		return NULL;
 	if (ust_lock())
 		goto end;
 	if (lookup_provider_by_name(provider->name))
@@ -87,12 +91,12 @@ struct lttng_ust_registered_context_provider *lttng_ust_context_provider_registe
 	head = &context_provider_ht.table[hash & (CONTEXT_PROVIDER_HT_SIZE - 1)];
 	cds_hlist_add_head(&reg_provider->node, head);
 
-	lttng_ust_context_set_session_provider(provider->name,
+	lttng_ust_context_set_session_provider(provider->name, fixed_type,
 		provider->get_size, provider->record,
 		provider->get_value);
 
 	lttng_ust_context_set_event_notifier_group_provider(provider->name,
-		provider->get_size, provider->record,
+		fixed_type, provider->get_size, provider->record,
 		provider->get_value);
 end:
 	ust_unlock();
@@ -106,11 +110,11 @@ void lttng_ust_context_provider_unregister(struct lttng_ust_registered_context_p
 	if (ust_lock())
 		goto end;
 	lttng_ust_context_set_session_provider(reg_provider->provider->name,
-		lttng_ust_dummy_get_size, lttng_ust_dummy_record,
+		LTTNG_UST_DYNAMIC_TYPE_NONE, lttng_ust_dummy_get_size, lttng_ust_dummy_record,
 		lttng_ust_dummy_get_value);
 
 	lttng_ust_context_set_event_notifier_group_provider(reg_provider->provider->name,
-		lttng_ust_dummy_get_size, lttng_ust_dummy_record,
+		LTTNG_UST_DYNAMIC_TYPE_NONE, lttng_ust_dummy_get_size, lttng_ust_dummy_record,
 		lttng_ust_dummy_get_value);
 
 	cds_hlist_del(&reg_provider->node);
@@ -138,6 +142,8 @@ const struct lttng_ust_type_common app_ctx_type = {
  * Add application context to array of context, even if the application
  * context is not currently loaded by application. It will then use the
  * dummy callbacks in that case.
+ * The context is a variant unless its provider is loaded and declares a
+ * fixed type, in which case it is a plain field of that type.
  * Always performed before tracing is started, since it modifies
  * metadata describing the context.
  */
@@ -181,6 +187,9 @@ int lttng_ust_add_app_context_to_ctx_rcu(const char *name,
 	 */
 	provider = lookup_provider_by_name(name);
 	if (provider) {
+		app_ctx->fixed_type = lttng_ust_context_provider_fixed_type(provider);
+		if (app_ctx->fixed_type != LTTNG_UST_DYNAMIC_TYPE_NONE)
+			event_field->type = lttng_ust_dynamic_type_field(app_ctx->fixed_type)->type;
 		new_field.get_size = provider->get_size;
 		new_field.record = provider->record;
 		new_field.get_value = provider->get_value;
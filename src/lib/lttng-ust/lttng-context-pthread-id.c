@@ -48,7 +48,7 @@ void pthread_id_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = (unsigned long) pthread_self();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("pthread_id",
 		lttng_ust_static_type_integer(sizeof(unsigned long) * CHAR_BIT,
 				lttng_ust_rb_alignof(unsigned long) * CHAR_BIT,
@@ -8,8 +8,12 @@
  */
 
 #define _LGPL_SOURCE
+#include <errno.h>
 #include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -29,11 +33,14 @@
  */
 static DEFINE_URCU_TLS_INIT(ino_t, cached_time_ns, NS_INO_UNINITIALIZED);
 
+static struct lttng_ns_cache process_time_ns;
+
 static
 ino_t get_time_ns(void)
 {
 	struct stat sb;
 	ino_t time_ns;
+	unsigned long generation;
 
 	time_ns = CMM_LOAD_SHARED(URCU_TLS(cached_time_ns));
 
@@ -44,6 +51,14 @@ ino_t get_time_ns(void)
 	if (caa_likely(time_ns != NS_INO_UNINITIALIZED))
 		return time_ns;
 
+	/*
+	 * Inherit the value populated by another thread if all threads
+	 * share the same namespaces.
+	 */
+	time_ns = lttng_ns_cache_get(&process_time_ns, &generation);
+	if (caa_likely(time_ns != NS_INO_UNINITIALIZED))
+		goto end;
+
 	/*
 	 * At this point we have to populate the cache, set the initial
 	 * value to NS_INO_UNAVAILABLE (0), if we fail to get the inode
@@ -70,6 +85,8 @@ ino_t get_time_ns(void)
 		}
 	}
 
+	lttng_ns_cache_set(&process_time_ns, time_ns, generation);
+end:
 	/*
 	 * And finally, store the inode number in the cache.
 	 */
@@ -88,6 +105,40 @@ void lttng_context_time_ns_reset(void)
 	CMM_STORE_SHARED(URCU_TLS(cached_time_ns), NS_INO_UNINITIALIZED);
 }
 
+/*
+ * Offsets of the monotonic and boottime clocks of the time namespace of
+ * the process relative to the initial time namespace, in nanoseconds,
+ * along with the inode number of the namespace.
+ *
+ * Returns -ENOENT if the kernel does not support time namespaces.
+ */
+int lttng_context_time_ns_get_offsets(ino_t *time_ns, int64_t *monotonic,
+		int64_t *boottime)
+{
+	char clock_name[16];
+	long long sec;
+	long nsec;
+	FILE *fp;
+
+	fp = fopen("/proc/self/timens_offsets", "r");
+	if (!fp)
+		return -ENOENT;
+	*monotonic = 0;
+	*boottime = 0;
+	while (fscanf(fp, "%15s %lld %ld", clock_name, &sec, &nsec) == 3) {
+		int64_t offset = (int64_t) sec * 1000000000LL + nsec;
+
+		/* Older kernels list clock IDs rather than names. */
+		if (!strcmp(clock_name, "monotonic") || !strcmp(clock_name, "1"))
+			*monotonic = offset;
+		else if (!strcmp(clock_name, "boottime") || !strcmp(clock_name, "7"))
+			*boottime = offset;
+	}
+	fclose(fp);
+	*time_ns = get_time_ns();
+	return 0;
+}
+
 static
 size_t time_ns_get_size(void *priv __attribute__((unused)),
 		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
@@ -120,7 +171,7 @@ void time_ns_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = get_time_ns();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("time_ns",
 		lttng_ust_static_type_integer(sizeof(ino_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(ino_t) * CHAR_BIT,
@@ -30,11 +30,14 @@
  */
 static DEFINE_URCU_TLS_INIT(ino_t, cached_uts_ns, NS_INO_UNINITIALIZED);
 
+static struct lttng_ns_cache process_uts_ns;
+
 static
 ino_t get_uts_ns(void)
 {
 	struct stat sb;
 	ino_t uts_ns;
+	unsigned long generation;
 
 	uts_ns = CMM_LOAD_SHARED(URCU_TLS(cached_uts_ns));
 
@@ -45,6 +48,14 @@ ino_t get_uts_ns(void)
 	if (caa_likely(uts_ns != NS_INO_UNINITIALIZED))
 		return uts_ns;
 
+	/*
+	 * Inherit the value populated by another thread if all threads
+	 * share the same namespaces.
+	 */
+	uts_ns = lttng_ns_cache_get(&process_uts_ns, &generation);
+	if (caa_likely(uts_ns != NS_INO_UNINITIALIZED))
+		goto end;
+
 	/*
 	 * At this point we have to populate the cache, set the initial
 	 * value to NS_INO_UNAVAILABLE (0), if we fail to get the inode
@@ -71,6 +82,8 @@ ino_t get_uts_ns(void)
 		}
 	}
 
+	lttng_ns_cache_set(&process_uts_ns, uts_ns, generation);
+end:
 	/*
 	 * And finally, store the inode number in the cache.
 	 */
@@ -122,7 +135,7 @@ void uts_ns_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = get_uts_ns();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("uts_ns",
 		lttng_ust_static_type_integer(sizeof(ino_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(ino_t) * CHAR_BIT,
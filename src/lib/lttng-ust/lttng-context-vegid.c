@@ -93,7 +93,7 @@ void vegid_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = get_vegid();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("vegid",
 		lttng_ust_static_type_integer(sizeof(gid_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(gid_t) * CHAR_BIT,
@@ -61,6 +61,11 @@ void lttng_context_vgid_reset(void)
 	CMM_STORE_SHARED(cached_vgid, INVALID_GID);
 }
 
+gid_t lttng_context_vgid_get(void)
+{
+	return get_vgid();
+}
+
 static
 size_t vgid_get_size(void *priv __attribute__((unused)),
 		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
@@ -93,7 +98,7 @@ void vgid_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = get_vgid();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("vgid",
 		lttng_ust_static_type_integer(sizeof(gid_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(gid_t) * CHAR_BIT,
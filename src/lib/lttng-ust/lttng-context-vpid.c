@@ -45,6 +45,11 @@ void lttng_context_vpid_reset(void)
 	CMM_STORE_SHARED(cached_vpid, 0);
 }
 
+pid_t lttng_context_vpid_get(void)
+{
+	return wrapper_getvpid();
+}
+
 static
 size_t vpid_get_size(void *priv __attribute__((unused)),
 		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
@@ -76,7 +81,7 @@ void vpid_get_value(void *priv __attribute__((unused)),
 	value->u.s64 = wrapper_getvpid();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("vpid",
 		lttng_ust_static_type_integer(sizeof(pid_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(pid_t) * CHAR_BIT,
@@ -97,7 +97,7 @@ void vsuid_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = get_vsuid();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("vsuid",
 		lttng_ust_static_type_integer(sizeof(uid_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(uid_t) * CHAR_BIT,
@@ -61,6 +61,11 @@ pid_t wrapper_getvtid(void)
 	return vtid;
 }
 
+pid_t lttng_context_vtid_get(void)
+{
+	return wrapper_getvtid();
+}
+
 static
 void vtid_record(void *priv __attribute__((unused)),
 		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
@@ -80,7 +85,7 @@ void vtid_get_value(void *priv __attribute__((unused)),
 	value->u.s64 = wrapper_getvtid();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("vtid",
 		lttng_ust_static_type_integer(sizeof(pid_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(pid_t) * CHAR_BIT,
@@ -61,6 +61,11 @@ void lttng_context_vuid_reset(void)
 	CMM_STORE_SHARED(cached_vuid, INVALID_UID);
 }
 
+uid_t lttng_context_vuid_get(void)
+{
+	return get_vuid();
+}
+
 static
 size_t vuid_get_size(void *priv __attribute__((unused)),
 		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
@@ -93,7 +98,7 @@ void vuid_get_value(void *priv __attribute__((unused)),
 	value->u.u64 = get_vuid();
 }
 
-static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_ctx_field(
+static const struct lttng_ust_ctx_field *ctx_field = lttng_ust_static_freezable_ctx_field(
 	lttng_ust_static_event_field("vuid",
 		lttng_ust_static_type_integer(sizeof(uid_t) * CHAR_BIT,
 				lttng_ust_rb_alignof(uid_t) * CHAR_BIT,
@@ -12,13 +12,17 @@
 #include <common/ust-context-provider.h>
 #include <lttng/urcu/pointer.h>
 #include <lttng/urcu/urcu-ust.h>
+#include <urcu/uatomic.h>
+#include "common/jhash.h"
 #include "common/logging.h"
 #include "common/macros.h"
+#include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include <assert.h>
 #include <limits.h>
 #include "common/tracepoint.h"
+#include "common/tracer.h"
 
 #include "context-internal.h"
 
@@ -27,32 +31,23 @@
  * same context performed by the same thread return the same result.
  */
 
-int lttng_find_context(struct lttng_ust_ctx *ctx, const char *name)
+static
+uint32_t context_name_hash(const char *name)
 {
-	unsigned int i;
-	const char *subname;
-
-	if (!ctx)
-		return 0;
-	if (strncmp(name, "$ctx.", strlen("$ctx.")) == 0) {
-		subname = name + strlen("$ctx.");
-	} else {
-		subname = name;
-	}
-	for (i = 0; i < ctx->nr_fields; i++) {
-		/* Skip allocated (but non-initialized) contexts */
-		if (!ctx->fields[i].event_field->name)
-			continue;
-		if (!strcmp(ctx->fields[i].event_field->name, subname))
-			return 1;
-	}
-	return 0;
+	return jhash(name, strlen(name), 0);
 }
 
-int lttng_get_context_index(struct lttng_ust_ctx *ctx, const char *name)
+/*
+ * Context lookups by name happen for each bytecode reference to a
+ * context, when linking filters and captures. Compare the name hashes
+ * computed when fields are added before comparing the names.
+ */
+static
+int context_lookup_index(struct lttng_ust_ctx *ctx, const char *name)
 {
 	unsigned int i;
 	const char *subname;
+	uint32_t hash;
 
 	if (!ctx)
 		return -1;
@@ -61,16 +56,47 @@ int lttng_get_context_index(struct lttng_ust_ctx *ctx, const char *name)
 	} else {
 		subname = name;
 	}
+	hash = context_name_hash(subname);
 	for (i = 0; i < ctx->nr_fields; i++) {
 		/* Skip allocated (but non-initialized) contexts */
 		if (!ctx->fields[i].event_field->name)
 			continue;
+		if (ctx->fields[i].name_hash != hash)
+			continue;
 		if (!strcmp(ctx->fields[i].event_field->name, subname))
 			return i;
 	}
 	return -1;
 }
 
+unsigned long lttng_ns_cache_generation = LTTNG_NS_CACHE_GENERATION_INIT;
+
+/* Called after a thread changed its namespaces. */
+void lttng_ns_cache_diverge(void)
+{
+	uatomic_or(&lttng_ns_cache_generation, LTTNG_NS_CACHE_DIVERGED);
+}
+
+/*
+ * Called after fork in the child, which has a single thread: all
+ * threads it creates share its namespaces.
+ */
+void lttng_ns_cache_reset(void)
+{
+	CMM_STORE_SHARED(lttng_ns_cache_generation,
+		(lttng_ns_cache_generation | LTTNG_NS_CACHE_DIVERGED) + 1);
+}
+
+int lttng_find_context(struct lttng_ust_ctx *ctx, const char *name)
+{
+	return context_lookup_index(ctx, name) >= 0;
+}
+
+int lttng_get_context_index(struct lttng_ust_ctx *ctx, const char *name)
+{
+	return context_lookup_index(ctx, name);
+}
+
 static int lttng_find_context_provider(struct lttng_ust_ctx *ctx, const char *name)
 {
 	unsigned int i;
@@ -155,23 +181,128 @@ static size_t get_type_max_align(const struct lttng_ust_type_common *type)
 	}
 }
 
+static bool is_type_fixed_size(const struct lttng_ust_type_common *type)
+{
+	switch (type->type) {
+	case lttng_ust_type_integer:
+	case lttng_ust_type_float:
+		return true;
+	case lttng_ust_type_enum:
+		return is_type_fixed_size(lttng_ust_get_type_enum(type)->container_type);
+	case lttng_ust_type_array:
+		return is_type_fixed_size(lttng_ust_get_type_array(type)->elem_type);
+	case lttng_ust_type_struct:
+	{
+		unsigned int i;
+		const struct lttng_ust_type_struct *struct_type = lttng_ust_get_type_struct(type);
+
+		for (i = 0; i < struct_type->nr_fields; i++) {
+			if (!is_type_fixed_size(struct_type->fields[i]->type))
+				return false;
+		}
+		return true;
+	}
+	case lttng_ust_type_string:
+	case lttng_ust_type_sequence:
+	case lttng_ust_type_dynamic:
+	default:
+		return false;
+	}
+}
+
+/*
+ * Size of the field within a frozen context, or 0 if the field cannot be
+ * frozen: only native integers and text arrays of fields declared
+ * freezable can be. Other fields, such as perf counters and cpu_id,
+ * record more than their get_value value.
+ */
+static size_t ctx_field_frozen_size(const struct lttng_ust_ctx_field *field)
+{
+	const struct lttng_ust_type_common *type = field->event_field->type;
+
+	if (!field->freezable || !field->get_value)
+		return 0;
+	switch (type->type) {
+	case lttng_ust_type_integer:
+	{
+		const struct lttng_ust_type_integer *itype = lttng_ust_get_type_integer(type);
+
+		if (itype->reverse_byte_order)
+			return 0;
+		switch (itype->size) {
+		case 8:
+		case 16:
+		case 32:
+		case 64:
+			return itype->size / CHAR_BIT;
+		default:
+			return 0;
+		}
+	}
+	case lttng_ust_type_array:
+	{
+		const struct lttng_ust_type_array *atype = lttng_ust_get_type_array(type);
+
+		if (atype->encoding == lttng_ust_string_encoding_none
+				|| atype->elem_type->type != lttng_ust_type_integer
+				|| lttng_ust_get_type_integer(atype->elem_type)->size != CHAR_BIT)
+			return 0;
+		return atype->length;
+	}
+	default:
+		return 0;
+	}
+}
+
 /*
  * lttng_context_update() should be called at least once between context
  * modification and trace start.
+ *
+ * The context fields are laid out from offset 0 for each event, so when
+ * all fields have a fixed size, the size of the context is computed once
+ * here rather than by calling each get_size callback for each event.
+ * The size callbacks of fixed-size fields do not use the probe context.
+ *
+ * When, in addition, all fields can be frozen, the offset of each field
+ * is kept, and the client records the context by storing the value of
+ * each field at its offset in a copy of the context, then writing that
+ * copy at once. Contexts cannot change once the session was active, so
+ * the layout holds for the whole trace.
  */
 static
 void lttng_context_update(struct lttng_ust_ctx *ctx)
 {
 	int i;
 	size_t largest_align = 8;	/* in bits */
+	size_t offset = 0;
+	bool fixed_size = true, frozen = true;
 
 	for (i = 0; i < ctx->nr_fields; i++) {
+		struct lttng_ust_ctx_field *field = &ctx->fields[i];
 		size_t field_align = 8;
 
-		field_align = get_type_max_align(ctx->fields[i].event_field->type);
+		if (field->event_field->name)
+			field->name_hash = context_name_hash(field->event_field->name);
+		field_align = get_type_max_align(field->event_field->type);
 		largest_align = max_t(size_t, largest_align, field_align);
+		field->frozen_offset = 0;
+		field->frozen_size = 0;
+		if (fixed_size && is_type_fixed_size(field->event_field->type)) {
+			offset += field->get_size(field->priv, NULL, offset);
+			field->frozen_size = ctx_field_frozen_size(field);
+			/* The field ends the context laid out so far. */
+			field->frozen_offset = offset - field->frozen_size;
+			if (!field->frozen_size)
+				frozen = false;
+		} else {
+			fixed_size = false;
+		}
 	}
 	ctx->largest_align = largest_align >> 3;	/* bits to bytes */
+	ctx->fixed_size_valid = fixed_size;
+	ctx->fixed_size = fixed_size ? offset : 0;
+	ctx->frozen = fixed_size && frozen && ctx->nr_fields
+		&& offset <= LTTNG_UST_CTX_FROZEN_MAX_SIZE;
 }
 
 int lttng_ust_context_append_rcu(struct lttng_ust_ctx **ctx_p,
@@ -226,6 +357,19 @@ int lttng_ust_context_append(struct lttng_ust_ctx **ctx_p,
 	return 0;
 }
 
+/*
+ * Remove the last field appended, without calling its destroy callback.
+ * Used to undo a partial append of a context made of several fields.
+ */
+void lttng_ust_context_remove_last(struct lttng_ust_ctx *ctx)
+{
+	if (!ctx || !ctx->nr_fields)
+		return;
+	ctx->nr_fields--;
+	memset(&ctx->fields[ctx->nr_fields], 0, sizeof(*ctx->fields));
+	lttng_context_update(ctx);
+}
+
 void lttng_destroy_context(struct lttng_ust_ctx *ctx)
 {
 	int i;
@@ -251,9 +395,14 @@ void lttng_destroy_context(struct lttng_ust_ctx *ctx)
  * a provider (by name) while tracing is using it, in a way that ensures
  * a single RCU read-side critical section see either all old, or all
  * new handlers.
+ *
+ * The handlers record values of type @fixed_type: the contexts typed
+ * otherwise, added while another provider of the same name was
+ * registered, get the dummy handlers of their type.
  */
 int lttng_ust_context_set_provider_rcu(struct lttng_ust_ctx **_ctx,
 		const char *name,
+		enum lttng_ust_dynamic_type fixed_type,
 		size_t (*get_size)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
 			size_t offset),
 		void (*record)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
@@ -265,6 +414,7 @@ int lttng_ust_context_set_provider_rcu(struct lttng_ust_ctx **_ctx,
 	int i, ret;
 	struct lttng_ust_ctx *ctx = *_ctx, *new_ctx;
 	struct lttng_ust_ctx_field *new_fields;
+	struct lttng_ust_app_context *app_ctx;
 
 	if (!ctx || !lttng_find_context_provider(ctx, name))
 		return 0;
@@ -287,11 +437,23 @@ int lttng_ust_context_set_provider_rcu(struct lttng_ust_ctx **_ctx,
 		if (strncmp(new_fields[i].event_field->name,
 				name, strlen(name)) != 0)
 			continue;
-		new_fields[i].get_size = get_size;
-		new_fields[i].record = record;
-		new_fields[i].get_value = get_value;
+		app_ctx = (struct lttng_ust_app_context *) new_fields[i].priv;
+		if (app_ctx->fixed_type == fixed_type) {
+			new_fields[i].get_size = get_size;
+			new_fields[i].record = record;
+			new_fields[i].get_value = get_value;
+		} else if (app_ctx->fixed_type == LTTNG_UST_DYNAMIC_TYPE_NONE) {
+			new_fields[i].get_size = lttng_ust_dummy_get_size;
+			new_fields[i].record = lttng_ust_dummy_record;
+			new_fields[i].get_value = lttng_ust_dummy_get_value;
+		} else {
+			new_fields[i].get_size = lttng_ust_dummy_fixed_get_size;
+			new_fields[i].record = lttng_ust_dummy_fixed_record;
+			new_fields[i].get_value = lttng_ust_dummy_fixed_get_value;
+		}
 	}
 	new_ctx->fields = new_fields;
+	lttng_context_update(new_ctx);
 	lttng_ust_rcu_assign_pointer(*_ctx, new_ctx);
 	lttng_ust_urcu_synchronize_rcu();
 	free(ctx->fields);
@@ -327,6 +489,11 @@ int lttng_context_init_all(struct lttng_ust_ctx **ctx)
 		WARN("Cannot add context lttng_add_procname_to_ctx");
 		goto error;
 	}
+	ret = lttng_add_procname_id_to_ctx(ctx);
+	if (ret) {
+		WARN("Cannot add context lttng_add_procname_id_to_ctx");
+		goto error;
+	}
 	ret = lttng_add_cpu_id_to_ctx(ctx);
 	if (ret) {
 		WARN("Cannot add context lttng_add_cpu_id_to_ctx");
@@ -53,6 +53,7 @@
 #include "common/ringbuffer/frontend.h"
 #include "common/counter/counter.h"
 #include "common/jhash.h"
+#include "common/smp.h"
 #include <lttng/ust-abi.h>
 #include "context-provider-internal.h"
 
@@ -64,6 +65,9 @@
 static CDS_LIST_HEAD(sessions);
 static CDS_LIST_HEAD(event_notifier_groups);
 
+/* Nesting of batches deferring the lazy enabler syncs. */
+static int enabler_sync_batch_nesting;
+
 struct cds_list_head *lttng_get_sessions(void)
 {
 	return &sessions;
@@ -77,6 +81,8 @@ void lttng_session_lazy_sync_event_enablers(struct lttng_ust_session *session);
 static
 void lttng_session_sync_event_enablers(struct lttng_ust_session *session);
 static
+void __lttng_session_sync_event_enablers(struct lttng_ust_session *session);
+static
 void lttng_event_notifier_group_sync_enablers(
 		struct lttng_event_notifier_group *event_notifier_group);
 static
@@ -260,6 +266,13 @@ void _lttng_channel_unmap(struct lttng_ust_channel_buffer *lttng_chan)
 	free(lttng_chan);
 }
 
+/*
+ * Only the enabled events are connected to their tracepoint, so the
+ * tracepoint state is the union of the enabled states of the event
+ * recorders of all sessions and of the event notifiers: the call sites
+ * skip the probe dispatch, and its RCU read-side critical section, when
+ * no session or event notifier group enables the event.
+ */
 static
 void register_event(struct lttng_ust_event_common *event)
 {
@@ -294,6 +307,44 @@ void unregister_event(struct lttng_ust_event_common *event)
 		event->priv->registered = 0;
 }
 
+/*
+ * Whether the event connected to a tracepoint may be recorded by a call
+ * from @ip, checking what its probe checks before reading the payload:
+ * the session, channel and event states, and the filters which only
+ * read context fields. Called within an RCU read-side critical section.
+ */
+int lttng_ust_event_may_record(void *data, void *ip)
+{
+	struct lttng_ust_event_common *event = (struct lttng_ust_event_common *) data;
+	struct lttng_ust_probe_ctx_memo probe_ctx_memo;
+	struct lttng_ust_probe_ctx probe_ctx;
+
+	if (event->type == LTTNG_UST_EVENT_TYPE_RECORDER) {
+		struct lttng_ust_event_recorder *event_recorder =
+			(struct lttng_ust_event_recorder *) event->child;
+		struct lttng_ust_channel_common *chan = event_recorder->chan->parent;
+
+		if (!CMM_ACCESS_ONCE(chan->session->active))
+			return 0;
+		if (!CMM_ACCESS_ONCE(chan->enabled))
+			return 0;
+	}
+	if (!CMM_ACCESS_ONCE(event->enabled))
+		return 0;
+	if (!CMM_ACCESS_ONCE(event->eval_filter))
+		return 1;
+	/* Filters reading the payload cannot be run without it. */
+	if (lttng_ust_event_filter_payload(event))
+		return 1;
+	probe_ctx.struct_size = sizeof(probe_ctx);
+	probe_ctx.ip = ip;
+	probe_ctx.frame = __builtin_frame_address(0);
+	probe_ctx_memo.nr_entries = 0;
+	probe_ctx.memo = &probe_ctx_memo;
+	return event->run_filter(event, NULL, &probe_ctx, NULL)
+		== LTTNG_UST_EVENT_FILTER_ACCEPT;
+}
+
 static
 void _lttng_event_unregister(struct lttng_ust_event_common *event)
 {
@@ -358,6 +409,10 @@ void lttng_event_notifier_group_destroy(
 
 	if (event_notifier_group->error_counter)
 		lttng_ust_counter_destroy(event_notifier_group->error_counter);
+	if (event_notifier_group->histogram_counter)
+		lttng_ust_counter_destroy(event_notifier_group->histogram_counter);
+	if (event_notifier_group->hit_counter)
+		lttng_ust_counter_destroy(event_notifier_group->hit_counter);
 
 	/* Close the notification fd to the listener of event_notifiers. */
 
@@ -396,6 +451,7 @@ void lttng_enabler_destroy(struct lttng_enabler *enabler)
 	/* Destroy excluders */
 	cds_list_for_each_entry_safe(excluder_node, tmp_excluder_node,
 			&enabler->excluder_head, node) {
+		free(excluder_node->entries);
 		free(excluder_node);
 	}
 }
@@ -413,12 +469,107 @@ void lttng_enabler_destroy(struct lttng_enabler *enabler)
 	free(event_notifier_enabler);
 }
 
+/*
+ * Maximum number of enumeration registration requests sent to the
+ * session daemon before receiving their replies. As for events, the
+ * replies are small enough to fit in the notify socket buffer.
+ */
+#define LTTNG_UST_ENUM_REGISTER_WINDOW	64
+
+/*
+ * Enumerations whose registration request has been sent on the notify
+ * socket, waiting for the reply carrying their id. They are already
+ * part of their session, so that a request is sent once per
+ * enumeration. @error holds the first registration error.
+ */
+struct lttng_enum_register_queue {
+	int notify_socket;
+	unsigned int nr_pending;
+	struct lttng_enum *pending[LTTNG_UST_ENUM_REGISTER_WINDOW];
+	int error;
+};
+
+/*
+ * Receive the replies to the pending registration requests, in the order
+ * they were sent. Enumerations which failed to register are removed from
+ * their session.
+ */
+static
+void lttng_enum_register_queue_flush(struct lttng_enum_register_queue *queue)
+{
+	unsigned int i;
+
+	for (i = 0; i < queue->nr_pending; i++) {
+		struct lttng_enum *_enum = queue->pending[i];
+		int ret;
+
+		ret = ustcomm_register_enum_recv(queue->notify_socket,
+				_enum->desc->name, &_enum->id);
+		if (ret < 0) {
+			DBG("Error (%d) registering enumeration to sessiond", ret);
+			_lttng_enum_destroy(_enum);
+			if (!queue->error)
+				queue->error = ret;
+			continue;
+		}
+		_enum->pending = false;
+	}
+	queue->nr_pending = 0;
+}
+
+static
+bool lttng_enum_entry_equal(const struct lttng_ust_enum_entry *a,
+		const struct lttng_ust_enum_entry *b)
+{
+	return a->start.value == b->start.value
+		&& a->start.signedness == b->start.signedness
+		&& a->end.value == b->end.value
+		&& a->end.signedness == b->end.signedness
+		&& !strcmp(a->string, b->string)
+		&& !((a->options ^ b->options) & LTTNG_UST_ENUM_ENTRY_OPTION_IS_AUTO);
+}
+
+/*
+ * Find an enumeration of the session with the same name and entries as
+ * @desc, as defined by another descriptor, e.g. in another probe
+ * provider. The session daemon gives the same id to such enumerations.
+ */
+static
+struct lttng_enum *lttng_enum_find_same(struct cds_hlist_head *head,
+		const struct lttng_ust_enum_desc *desc)
+{
+	struct lttng_enum *_enum;
+	struct cds_hlist_node *node;
+	size_t i;
+
+	cds_hlist_for_each_entry(_enum, node, head, hlist) {
+		const struct lttng_ust_enum_desc *other = _enum->desc;
+
+		if (strcmp(other->name, desc->name)
+				|| other->nr_entries != desc->nr_entries)
+			continue;
+		for (i = 0; i < desc->nr_entries; i++) {
+			if (!lttng_enum_entry_equal(other->entries[i],
+					desc->entries[i]))
+				break;
+		}
+		if (i == desc->nr_entries)
+			return _enum;
+	}
+	return NULL;
+}
+
+/*
+ * The registration request is sent right away, and its reply received
+ * when @queue is flushed.
+ */
 static
 int lttng_enum_create(const struct lttng_ust_enum_desc *desc,
-		struct lttng_ust_session *session)
+		struct lttng_ust_session *session,
+		struct lttng_enum_register_queue *queue)
 {
 	const char *enum_name = desc->name;
-	struct lttng_enum *_enum;
+	struct lttng_enum *_enum, *same;
 	struct cds_hlist_head *head;
 	int ret = 0;
 	size_t name_len = strlen(enum_name);
@@ -435,6 +586,44 @@ int lttng_enum_create(const struct lttng_ust_enum_desc *desc,
 		goto exist;
 	}
 
+	same = lttng_enum_find_same(head, desc);
+	if (same && same->pending) {
+		lttng_enum_register_queue_flush(queue);
+		same = lttng_enum_find_same(head, desc);
+	}
+	if (same) {
+		/* Reuse the id of the identical enumeration. */
+		_enum = zmalloc(sizeof(*_enum));
+		if (!_enum) {
+			ret = -ENOMEM;
+			goto cache_error;
+		}
+		_enum->session = session;
+		_enum->desc = desc;
+		_enum->id = same->id;
+		cds_list_add(&_enum->node, &session->priv->enums_head);
+		cds_hlist_add_head(&_enum->hlist, head);
+		return 0;
+	}
+
+	if (lttng_ust_sockinfo_is_embedded(session->priv->owner)) {
+		_enum = zmalloc(sizeof(*_enum));
+		if (!_enum) {
+			ret = -ENOMEM;
+			goto cache_error;
+		}
+		_enum->session = session;
+		_enum->desc = desc;
+		ret = lttng_ust_embedded_register_enum(desc, &_enum->id);
+		if (ret < 0) {
+			DBG("Error (%d) registering enumeration to embedded consumer", ret);
+			goto sessiond_register_error;
+		}
+		cds_list_add(&_enum->node, &session->priv->enums_head);
+		cds_hlist_add_head(&_enum->hlist, head);
+		return 0;
+	}
+
 	notify_socket = lttng_get_notify_socket(session->priv->owner);
 	if (notify_socket < 0) {
 		ret = notify_socket;
@@ -449,18 +638,23 @@ int lttng_enum_create(const struct lttng_ust_enum_desc *desc,
 	_enum->session = session;
 	_enum->desc = desc;
 
-	ret = ustcomm_register_enum(notify_socket,
+	/* Request enumeration ID from sessiond, the reply is received on flush. */
+	ret = ustcomm_register_enum_send(notify_socket,
 		session->priv->objd,
 		enum_name,
 		desc->nr_entries,
-		desc->entries,
-		&_enum->id);
+		desc->entries);
 	if (ret < 0) {
 		DBG("Error (%d) registering enumeration to sessiond", ret);
 		goto sessiond_register_error;
 	}
+	_enum->pending = true;
 	cds_list_add(&_enum->node, &session->priv->enums_head);
 	cds_hlist_add_head(&_enum->hlist, head);
+	queue->notify_socket = notify_socket;
+	queue->pending[queue->nr_pending++] = _enum;
+	if (queue->nr_pending == LTTNG_UST_ENUM_REGISTER_WINDOW)
+		lttng_enum_register_queue_flush(queue);
 	return 0;
 
 sessiond_register_error:
@@ -473,7 +667,8 @@ exist:
 
 static
 int lttng_create_enum_check(const struct lttng_ust_type_common *type,
-		struct lttng_ust_session *session)
+		struct lttng_ust_session *session,
+		struct lttng_enum_register_queue *queue)
 {
 	switch (type->type) {
 	case lttng_ust_type_enum:
@@ -482,7 +677,7 @@ int lttng_create_enum_check(const struct lttng_ust_type_common *type,
 		int ret;
 
 		enum_desc = lttng_ust_get_type_enum(type)->desc;
-		ret = lttng_enum_create(enum_desc, session);
+		ret = lttng_enum_create(enum_desc, session, queue);
 		if (ret && ret != -EEXIST) {
 			DBG("Unable to create enum error: (%d)", ret);
 			return ret;
@@ -497,7 +692,7 @@ int lttng_create_enum_check(const struct lttng_ust_type_common *type,
 
 		tag_field_generic = lttng_ust_dynamic_type_tag_field();
 		enum_desc = lttng_ust_get_type_enum(tag_field_generic->type)->desc;
-		ret = lttng_enum_create(enum_desc, session);
+		ret = lttng_enum_create(enum_desc, session, queue);
 		if (ret && ret != -EEXIST) {
 			DBG("Unable to create enum error: (%d)", ret);
 			return ret;
@@ -511,10 +706,15 @@ int lttng_create_enum_check(const struct lttng_ust_type_common *type,
 	return 0;
 }
 
+/*
+ * Ensure the enumerations of the fields are part of the session. The
+ * registrations are complete once @queue is flushed.
+ */
 static
-int lttng_create_all_event_enums(size_t nr_fields,
+int lttng_queue_all_event_enums(size_t nr_fields,
 		const struct lttng_ust_event_field * const *event_fields,
-		struct lttng_ust_session *session)
+		struct lttng_ust_session *session,
+		struct lttng_enum_register_queue *queue)
 {
 	size_t i;
 	int ret;
@@ -523,7 +723,7 @@ int lttng_create_all_event_enums(size_t nr_fields,
 	for (i = 0; i < nr_fields; i++) {
 		const struct lttng_ust_type_common *type = event_fields[i]->type;
 
-		ret = lttng_create_enum_check(type, session);
+		ret = lttng_create_enum_check(type, session, queue);
 		if (ret)
 			return ret;
 	}
@@ -531,9 +731,28 @@ int lttng_create_all_event_enums(size_t nr_fields,
 }
 
 static
-int lttng_create_all_ctx_enums(size_t nr_fields,
-		struct lttng_ust_ctx_field *ctx_fields,
+int lttng_create_all_event_enums(size_t nr_fields,
+		const struct lttng_ust_event_field * const *event_fields,
 		struct lttng_ust_session *session)
+{
+	struct lttng_enum_register_queue queue = {
+		.notify_socket = -1,
+	};
+	int ret;
+
+	ret = lttng_queue_all_event_enums(nr_fields, event_fields, session,
+			&queue);
+	lttng_enum_register_queue_flush(&queue);
+	if (ret)
+		return ret;
+	return queue.error;
+}
+
+static
+int lttng_queue_all_ctx_enums(size_t nr_fields,
+		struct lttng_ust_ctx_field *ctx_fields,
+		struct lttng_ust_session *session,
+		struct lttng_enum_register_queue *queue)
 {
 	size_t i;
 	int ret;
@@ -542,7 +761,7 @@ int lttng_create_all_ctx_enums(size_t nr_fields,
 	for (i = 0; i < nr_fields; i++) {
 		const struct lttng_ust_type_common *type = ctx_fields[i].event_field->type;
 
-		ret = lttng_create_enum_check(type, session);
+		ret = lttng_create_enum_check(type, session, queue);
 		if (ret)
 			return ret;
 	}
@@ -564,16 +783,23 @@ int lttng_session_enable(struct lttng_ust_session *session)
 {
 	int ret = 0;
 	struct lttng_ust_channel_buffer_private *chan;
-	int notify_socket;
+	struct lttng_enum_register_queue enum_queue = {
+		.notify_socket = -1,
+	};
+	int notify_socket = -1;
+	bool embedded;
 
 	if (session->active) {
 		ret = -EBUSY;
 		goto end;
 	}
 
-	notify_socket = lttng_get_notify_socket(session->priv->owner);
-	if (notify_socket < 0)
-		return notify_socket;
+	embedded = lttng_ust_sockinfo_is_embedded(session->priv->owner);
+	if (!embedded) {
+		notify_socket = lttng_get_notify_socket(session->priv->owner);
+		if (notify_socket < 0)
+			return notify_socket;
+	}
 
 	/* Set transient enabler state to "enabled" */
 	session->priv->tstate = 1;
@@ -581,6 +807,24 @@ int lttng_session_enable(struct lttng_ust_session *session)
 	/* We need to sync enablers with session before activation. */
 	lttng_session_sync_event_enablers(session);
 
+	/* Register the enumerations of all channel contexts at once. */
+	cds_list_for_each_entry(chan, &session->priv->chan_head, node) {
+		/* don't change it if session stop/restart */
+		if (chan->header_type || !chan->ctx)
+			continue;
+		ret = lttng_queue_all_ctx_enums(chan->ctx->nr_fields,
+			chan->ctx->fields, session, &enum_queue);
+		if (ret < 0)
+			break;
+	}
+	lttng_enum_register_queue_flush(&enum_queue);
+	if (!ret)
+		ret = enum_queue.error;
+	if (ret < 0) {
+		DBG("Error (%d) adding enum to session", ret);
+		return ret;
+	}
+
 	/*
 	 * Snapshot the number of events per channel to know the type of header
 	 * we need to use.
@@ -598,21 +842,19 @@ int lttng_session_enable(struct lttng_ust_session *session)
 		if (ctx) {
 			nr_fields = ctx->nr_fields;
 			fields = ctx->fields;
-			ret = lttng_create_all_ctx_enums(nr_fields, fields,
-				session);
-			if (ret < 0) {
-				DBG("Error (%d) adding enum to session", ret);
-				return ret;
-			}
 		}
-		ret = ustcomm_register_channel(notify_socket,
-			session,
-			session->priv->objd,
-			chan->parent.objd,
-			nr_fields,
-			fields,
-			&chan_id,
-			&chan->header_type);
+		if (embedded)
+			ret = lttng_ust_embedded_register_channel(chan->pub,
+				&chan_id, &chan->header_type);
+		else
+			ret = ustcomm_register_channel(notify_socket,
+				session,
+				session->priv->objd,
+				chan->parent.objd,
+				nr_fields,
+				fields,
+				&chan_id,
+				&chan->header_type);
 		if (ret) {
 			DBG("Error (%d) registering channel to sessiond", ret);
 			return ret;
@@ -687,48 +929,217 @@ end:
 	return ret;
 }
 
+/*
+ * Events and event notifiers are looked up by descriptor, so the
+ * descriptor address is hashed rather than the formatted event name.
+ */
 static inline
 struct cds_hlist_head *borrow_hash_table_bucket(
 		struct cds_hlist_head *hash_table,
 		unsigned int hash_table_size,
 		const struct lttng_ust_event_desc *desc)
 {
-	char name[LTTNG_UST_ABI_SYM_NAME_LEN];
-	size_t name_len;
+	uintptr_t key = (uintptr_t) desc;
 	uint32_t hash;
 
-	lttng_ust_format_event_name(desc, name);
-	name_len = strlen(name);
-
-	hash = jhash(name, name_len, 0);
+	hash = jhash(&key, sizeof(key), 0);
 	return &hash_table[hash & (hash_table_size - 1)];
 }
 
+/*
+ * Maximum number of event registration requests sent to the session
+ * daemon before receiving their replies. Replies are small, so they fit
+ * in the notify socket buffer and the session daemon never blocks on
+ * sending them while the application is still sending requests.
+ */
+#define LTTNG_UST_EVENT_REGISTER_WINDOW	64
+
+/*
+ * Event recorders whose registration request has been sent on the
+ * notify socket, waiting for the reply carrying their event id. @error
+ * holds the first registration error.
+ */
+struct lttng_event_register_queue {
+	int notify_socket;
+	unsigned int nr_pending;
+	struct lttng_ust_event_recorder *pending[LTTNG_UST_EVENT_REGISTER_WINDOW];
+	int error;
+};
+
+static
+void lttng_event_recorder_free(struct lttng_ust_event_recorder *event_recorder)
+{
+	free(event_recorder->priv);
+	free(event_recorder->parent);
+	free(event_recorder);
+}
+
+static
+void lttng_event_recorder_add(struct lttng_ust_event_recorder *event_recorder)
+{
+	const struct lttng_ust_event_desc *desc = event_recorder->parent->priv->desc;
+	struct lttng_ust_session *session = event_recorder->chan->parent->session;
+
+	cds_list_add(&event_recorder->priv->node, &session->priv->events_head);
+	cds_hlist_add_head(&event_recorder->priv->hlist,
+		borrow_hash_table_bucket(session->priv->events_ht.table,
+			LTTNG_UST_EVENT_HT_SIZE, desc));
+}
+
+/*
+ * Receive the replies to the pending registration requests, in the order
+ * they were sent, and add the registered events to their session.
+ */
+static
+void lttng_event_register_queue_flush(struct lttng_event_register_queue *queue)
+{
+	unsigned int i;
+
+	for (i = 0; i < queue->nr_pending; i++) {
+		struct lttng_ust_event_recorder *event_recorder = queue->pending[i];
+		const struct lttng_ust_event_desc *desc = event_recorder->parent->priv->desc;
+		char name[LTTNG_UST_ABI_SYM_NAME_LEN];
+		int ret;
+
+		lttng_ust_format_event_name(desc, name);
+		ret = ustcomm_register_event_recv(queue->notify_socket, name,
+				&event_recorder->priv->id);
+		if (ret < 0) {
+			DBG("Error (%d) registering event to sessiond", ret);
+			lttng_event_recorder_free(event_recorder);
+			if (!queue->error)
+				queue->error = ret;
+			continue;
+		}
+		lttng_event_recorder_add(event_recorder);
+	}
+	queue->nr_pending = 0;
+}
+
+/*
+ * Enumerations are registered with their own request and reply on the
+ * notify socket. Those must not be interleaved with pending event
+ * registration replies.
+ */
+static
+bool lttng_event_fields_missing_enum(size_t nr_fields,
+		const struct lttng_ust_event_field * const *event_fields,
+		struct lttng_ust_session *session)
+{
+	const struct lttng_ust_event_field *tag_field;
+	const struct lttng_ust_enum_desc *enum_desc;
+	size_t i;
+
+	for (i = 0; i < nr_fields; i++) {
+		switch (event_fields[i]->type->type) {
+		case lttng_ust_type_enum:
+			enum_desc = lttng_ust_get_type_enum(event_fields[i]->type)->desc;
+			break;
+		case lttng_ust_type_dynamic:
+			tag_field = lttng_ust_dynamic_type_tag_field();
+			enum_desc = lttng_ust_get_type_enum(tag_field->type)->desc;
+			break;
+		default:
+			continue;
+		}
+		if (!lttng_ust_enum_get_from_desc(session, enum_desc))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Serialized fields refer to enumerations by their id in the session.
+ * Without enumeration, they are the same in every session.
+ */
+static
+bool lttng_serialized_fields_session_dependent(const struct lttng_ust_ctl_field *fields,
+		size_t nr_fields)
+{
+	size_t i;
+
+	for (i = 0; i < nr_fields; i++) {
+		if (fields[i].type.atype == lttng_ust_ctl_atype_enum_nestable)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Get the fields of an event serialized for the session daemon. Fields
+ * which do not depend on the session are serialized on the first
+ * registration of the event and kept in @fields_cache, if not NULL.
+ * *owned tells whether the caller must free the returned fields.
+ */
+static
+int lttng_event_get_serialized_fields(const struct lttng_ust_event_desc *desc,
+		struct lttng_ust_session *session,
+		struct lttng_ust_event_fields_cache *fields_cache,
+		struct lttng_ust_ctl_field **fields, size_t *nr_fields,
+		bool *owned)
+{
+	int ret;
+
+	if (fields_cache && fields_cache->state > 0) {
+		*fields = fields_cache->fields;
+		*nr_fields = fields_cache->nr_fields;
+		*owned = false;
+		return 0;
+	}
+	ret = ustcomm_serialize_event_fields(session, desc->tp_class->nr_fields,
+			desc->tp_class->fields, nr_fields, fields);
+	if (ret)
+		return ret;
+	*owned = true;
+	if (fields_cache && !fields_cache->state) {
+		if (lttng_serialized_fields_session_dependent(*fields, *nr_fields)) {
+			fields_cache->state = -1;
+		} else {
+			fields_cache->fields = *fields;
+			fields_cache->nr_fields = *nr_fields;
+			fields_cache->state = 1;
+			*owned = false;
+		}
+	}
+	return 0;
+}
+
 /*
  * Supports event creation while tracing session is active.
+ *
+ * The event is added to its session once the session daemon replies to
+ * its registration request, when @queue is flushed.
  */
 static
 int lttng_event_recorder_create(const struct lttng_ust_event_desc *desc,
-		struct lttng_ust_channel_buffer *chan)
+		struct lttng_ust_channel_buffer *chan,
+		struct lttng_ust_event_fields_cache *fields_cache,
+		struct lttng_event_register_queue *queue)
 {
 	char name[LTTNG_UST_ABI_SYM_NAME_LEN];
 	struct lttng_ust_event_recorder *event_recorder;
 	struct lttng_ust_event_recorder_private *event_recorder_priv;
 	struct lttng_ust_session *session = chan->parent->session;
-	struct cds_hlist_head *head;
+	struct lttng_ust_ctl_field *fields;
+	size_t nr_fields;
+	bool fields_owned = false;
 	int ret = 0;
-	int notify_socket, loglevel;
+	int notify_socket = -1, loglevel;
 	const char *uri;
-
-	head = borrow_hash_table_bucket(chan->parent->session->priv->events_ht.table,
-		LTTNG_UST_EVENT_HT_SIZE, desc);
-
-	notify_socket = lttng_get_notify_socket(session->priv->owner);
-	if (notify_socket < 0) {
-		ret = notify_socket;
-		goto socket_error;
+	bool embedded;
+
+	embedded = lttng_ust_sockinfo_is_embedded(session->priv->owner);
+	if (!embedded) {
+		notify_socket = lttng_get_notify_socket(session->priv->owner);
+		if (notify_socket < 0) {
+			ret = notify_socket;
+			goto socket_error;
+		}
 	}
 
+	if (queue->nr_pending && lttng_event_fields_missing_enum(desc->tp_class->nr_fields,
+			desc->tp_class->fields, session))
+		lttng_event_register_queue_flush(queue);
 	ret = lttng_create_all_event_enums(desc->tp_class->nr_fields, desc->tp_class->fields,
 			session);
 	if (ret < 0) {
@@ -774,6 +1185,8 @@ int lttng_event_recorder_create(const struct lttng_ust_event_desc *desc,
 	CDS_INIT_LIST_HEAD(&event_recorder->parent->priv->filter_bytecode_runtime_head);
 	CDS_INIT_LIST_HEAD(&event_recorder->parent->priv->enablers_ref_head);
 	event_recorder->parent->priv->desc = desc;
+	event_recorder->parent->priv->overhead_slot = lttng_ust_probe_overhead_slot(desc);
+	event_recorder->parent->priv->discard_slot = lttng_ust_event_discards_slot(desc);
 
 	if (desc->loglevel)
 		loglevel = *(*desc->loglevel);
@@ -786,25 +1199,46 @@ int lttng_event_recorder_create(const struct lttng_ust_event_desc *desc,
 
 	lttng_ust_format_event_name(desc, name);
 
-	/* Fetch event ID from sessiond */
-	ret = ustcomm_register_event(notify_socket,
-		session,
+	if (embedded) {
+		/* The embedded consumer describes the fields itself. */
+		ret = lttng_ust_embedded_register_event(chan, desc, name,
+				loglevel, uri, &event_recorder_priv->id);
+		if (ret < 0) {
+			DBG("Error (%d) registering event to embedded consumer", ret);
+			goto sessiond_register_error;
+		}
+		lttng_event_recorder_add(event_recorder);
+		return 0;
+	}
+
+	ret = lttng_event_get_serialized_fields(desc, session, fields_cache,
+			&fields, &nr_fields, &fields_owned);
+	if (ret < 0) {
+		DBG("Error (%d) serializing event fields", ret);
+		goto sessiond_register_error;
+	}
+
+	/* Request event ID from sessiond, the reply is received on flush. */
+	ret = ustcomm_register_event_send(notify_socket,
 		session->priv->objd,
 		chan->priv->parent.objd,
 		name,
 		loglevel,
 		desc->tp_class->signature,
-		desc->tp_class->nr_fields,
-		desc->tp_class->fields,
-		uri,
-		&event_recorder->priv->id);
+		nr_fields,
+		fields,
+		uri);
+	if (fields_owned)
+		free(fields);
 	if (ret < 0) {
 		DBG("Error (%d) registering event to sessiond", ret);
 		goto sessiond_register_error;
 	}
 
-	cds_list_add(&event_recorder_priv->node, &chan->parent->session->priv->events_head);
-	cds_hlist_add_head(&event_recorder_priv->hlist, head);
+	queue->notify_socket = notify_socket;
+	queue->pending[queue->nr_pending++] = event_recorder;
+	if (queue->nr_pending == LTTNG_UST_EVENT_REGISTER_WINDOW)
+		lttng_event_register_queue_flush(queue);
 	return 0;
 
 sessiond_register_error:
@@ -822,6 +1256,8 @@ socket_error:
 static
 int lttng_event_notifier_create(const struct lttng_ust_event_desc *desc,
 		uint64_t token, uint64_t error_counter_index,
+		int has_histogram, uint64_t histogram_counter_index,
+		int freeze_buffers,
 		struct lttng_event_notifier_group *event_notifier_group)
 {
 	struct lttng_ust_event_notifier *event_notifier;
@@ -866,6 +1302,9 @@ int lttng_event_notifier_create(const struct lttng_ust_event_desc *desc,
 	event_notifier_priv->group = event_notifier_group;
 	event_notifier_priv->parent.user_token = token;
 	event_notifier_priv->error_counter_index = error_counter_index;
+	event_notifier_priv->has_histogram = has_histogram;
+	event_notifier_priv->histogram_counter_index = histogram_counter_index;
+	event_notifier_priv->freeze_buffers = freeze_buffers;
 
 	/* Event notifier will be enabled by enabler sync. */
 	event_notifier->parent->run_filter = lttng_ust_interpret_event_filter;
@@ -876,6 +1315,8 @@ int lttng_event_notifier_create(const struct lttng_ust_event_desc *desc,
 	CDS_INIT_LIST_HEAD(&event_notifier->priv->capture_bytecode_runtime_head);
 	CDS_INIT_LIST_HEAD(&event_notifier_priv->parent.enablers_ref_head);
 	event_notifier_priv->parent.desc = desc;
+	event_notifier_priv->parent.overhead_slot = lttng_ust_probe_overhead_slot(desc);
+	event_notifier_priv->parent.discard_slot = -1;
 	event_notifier->notification_send = lttng_event_notifier_notification_send;
 
 	cds_list_add(&event_notifier_priv->node,
@@ -892,6 +1333,51 @@ error:
 	return ret;
 }
 
+/*
+ * Length of the literal prefix of the enabler name, which the
+ * "provider:event" name of every matching event starts with: the whole
+ * name for an exact match, and the characters before the first special
+ * character for a star globbing pattern.
+ */
+static
+size_t lttng_enabler_name_prefix_len(struct lttng_enabler *enabler)
+{
+	const char *name = enabler->event_param.name;
+	size_t len;
+
+	for (len = 0; len < LTTNG_UST_ABI_SYM_NAME_LEN && name[len]; len++) {
+		if (enabler->format_type == LTTNG_ENABLER_FORMAT_STAR_GLOB
+				&& (name[len] == '*' || name[len] == '\\'))
+			break;
+	}
+	return len;
+}
+
+/*
+ * Check that the "provider:event" name starts with the first @len
+ * characters of @prefix, without formatting the name. A NULL
+ * @event_name only checks the "provider:" part of the name, which
+ * allows skipping all the events of a provider at once.
+ */
+static
+bool lttng_enabler_prefix_match(const char *prefix, size_t len,
+		const char *provider_name, const char *event_name)
+{
+	size_t provider_len = strlen(provider_name);
+
+	if (len <= provider_len)
+		return !strncmp(prefix, provider_name, len);
+	if (strncmp(prefix, provider_name, provider_len))
+		return false;
+	prefix += provider_len;
+	len -= provider_len;
+	if (*prefix != ':')
+		return false;
+	if (!event_name)
+		return true;
+	return !strncmp(prefix + 1, event_name, len - 1);
+}
+
 static
 int lttng_desc_match_star_glob_enabler(const struct lttng_ust_event_desc *desc,
 		struct lttng_enabler *enabler)
@@ -941,14 +1427,49 @@ int lttng_desc_match_event_enabler(const struct lttng_ust_event_desc *desc,
 	return 1;
 }
 
+/*
+ * Returns 1 if the event name @name matches an exclusion of the enabler:
+ * a hash lookup for the plain exclusion names, and a glob match for the
+ * ones with wildcards.
+ */
+static
+int lttng_enabler_excludes(struct lttng_enabler *enabler, const char *name)
+{
+	struct lttng_ust_exclusion_entry *entry;
+	struct cds_hlist_head *head;
+	struct cds_hlist_node *node;
+	size_t len;
+	uint32_t hash;
+
+	if (cds_list_empty(&enabler->excluder_head))
+		return 0;
+	len = strlen(name);
+	hash = jhash(name, len, 0);
+	head = &enabler->exclusion_table[hash & (LTTNG_UST_EXCLUSION_HT_SIZE - 1)];
+	cds_hlist_for_each_entry(entry, node, head, u.hlist) {
+		if (entry->len == len && !memcmp(entry->name, name, len))
+			return 1;
+	}
+	cds_list_for_each_entry(entry, &enabler->exclusion_glob_head, u.node) {
+		if (strutils_star_glob_match(entry->name, entry->len,
+				name, SIZE_MAX))
+			return 1;
+	}
+	return 0;
+}
+
 static
 int lttng_desc_match_enabler(const struct lttng_ust_event_desc *desc,
 		struct lttng_enabler *enabler)
 {
+	if (!lttng_enabler_prefix_match(enabler->event_param.name,
+			lttng_enabler_name_prefix_len(enabler),
+			desc->probe_desc->provider_name, desc->event_name))
+		return 0;
 	switch (enabler->format_type) {
 	case LTTNG_ENABLER_FORMAT_STAR_GLOB:
 	{
-		struct lttng_ust_excluder_node *excluder;
+		char name[LTTNG_UST_ABI_SYM_NAME_LEN];
 
 		if (!lttng_desc_match_star_glob_enabler(desc, enabler)) {
 			return 0;
@@ -958,27 +1479,10 @@ int lttng_desc_match_enabler(const struct lttng_ust_event_desc *desc,
 		 * If the matching event matches with an excluder,
 		 * return 'does not match'
 		 */
-		cds_list_for_each_entry(excluder, &enabler->excluder_head, node) {
-			int count;
-
-			for (count = 0; count < excluder->excluder.count; count++) {
-				int len;
-				char *excluder_name;
-
-				excluder_name = (char *) (excluder->excluder.names)
-						+ count * LTTNG_UST_ABI_SYM_NAME_LEN;
-				len = strnlen(excluder_name, LTTNG_UST_ABI_SYM_NAME_LEN);
-				if (len > 0) {
-					char name[LTTNG_UST_ABI_SYM_NAME_LEN];
-
-					lttng_ust_format_event_name(desc, name);
-					if (strutils_star_glob_match(excluder_name, len, name, SIZE_MAX)) {
-						return 0;
-					}
-				}
-			}
-		}
-		return 1;
+		if (cds_list_empty(&enabler->excluder_head))
+			return 1;
+		lttng_ust_format_event_name(desc, name);
+		return !lttng_enabler_excludes(enabler, name);
 	}
 	case LTTNG_ENABLER_FORMAT_EVENT:
 		return lttng_desc_match_event_enabler(desc, enabler);
@@ -991,9 +1495,9 @@ static
 int lttng_event_enabler_match_event(struct lttng_event_enabler *event_enabler,
 		struct lttng_ust_event_recorder *event_recorder)
 {
-	if (lttng_desc_match_enabler(event_recorder->parent->priv->desc,
-			lttng_event_enabler_as_enabler(event_enabler))
-			&& event_recorder->chan == event_enabler->chan)
+	if (event_recorder->chan == event_enabler->chan
+			&& lttng_desc_match_enabler(event_recorder->parent->priv->desc,
+				lttng_event_enabler_as_enabler(event_enabler)))
 		return 1;
 	else
 		return 0;
@@ -1028,6 +1532,78 @@ struct lttng_enabler_ref *lttng_enabler_ref(
 	return NULL;
 }
 
+static
+bool lttng_event_recorder_exists(struct lttng_ust_session *session,
+		const struct lttng_ust_event_desc *desc,
+		struct lttng_ust_channel_buffer *chan)
+{
+	struct lttng_ust_event_recorder_private *event_recorder_priv;
+	struct cds_hlist_head *head;
+	struct cds_hlist_node *node;
+
+	head = borrow_hash_table_bucket(session->priv->events_ht.table,
+		LTTNG_UST_EVENT_HT_SIZE, desc);
+	cds_hlist_for_each_entry(event_recorder_priv, node, head, hlist) {
+		if (event_recorder_priv->parent.desc == desc
+				&& event_recorder_priv->pub->chan == chan)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Register the enumerations of all the events about to be created for
+ * @event_enabler at once, rather than waiting for the replies before
+ * each event creation. Errors are left to the event creation.
+ */
+static
+void lttng_event_enabler_register_enums(struct lttng_event_enabler *event_enabler)
+{
+	struct lttng_ust_session *session = event_enabler->chan->parent->session;
+	struct lttng_enabler *enabler = lttng_event_enabler_as_enabler(event_enabler);
+	struct lttng_enum_register_queue queue = {
+		.notify_socket = -1,
+	};
+	struct lttng_ust_registered_probe *reg_probe;
+	struct cds_list_head *probe_list;
+	size_t prefix_len;
+	int i;
+
+	probe_list = lttng_get_probe_list_head();
+	prefix_len = lttng_enabler_name_prefix_len(enabler);
+	cds_list_for_each_entry(reg_probe, probe_list, head) {
+		const struct lttng_ust_probe_desc *probe_desc = reg_probe->desc;
+
+		if (reg_probe->generation <= enabler->probe_generation)
+			continue;
+		if (!lttng_enabler_prefix_match(enabler->event_param.name, prefix_len,
+				probe_desc->provider_name, NULL))
+			continue;
+		for (i = 0; i < probe_desc->nr_events; i++) {
+			const struct lttng_ust_event_desc *desc = probe_desc->event_desc[i];
+
+			if (!lttng_desc_match_enabler(desc, enabler))
+				continue;
+			if (lttng_event_recorder_exists(session, desc, event_enabler->chan))
+				continue;
+			if (lttng_queue_all_event_enums(desc->tp_class->nr_fields,
+					desc->tp_class->fields, session, &queue))
+				goto end;
+		}
+	}
+end:
+	lttng_enum_register_queue_flush(&queue);
+}
+
+static
+bool lttng_event_desc_is_hot(const struct lttng_ust_event_desc *desc)
+{
+	if (desc->struct_size < offsetof(struct lttng_ust_event_desc, hot)
+			+ sizeof(desc->hot))
+		return false;
+	return desc->hot != NULL;
+}
+
 /*
  * Create struct lttng_event if it is missing and present in the list of
  * tracepoint probes.
@@ -1036,59 +1612,78 @@ static
 void lttng_create_event_recorder_if_missing(struct lttng_event_enabler *event_enabler)
 {
 	struct lttng_ust_session *session = event_enabler->chan->parent->session;
+	struct lttng_enabler *enabler = lttng_event_enabler_as_enabler(event_enabler);
 	struct lttng_ust_registered_probe *reg_probe;
 	const struct lttng_ust_event_desc *desc;
-	struct lttng_ust_event_recorder_private *event_recorder_priv;
-	int i;
+	int i, pass;
 	struct cds_list_head *probe_list;
+	struct lttng_event_register_queue queue = {
+		.notify_socket = -1,
+	};
+	uint64_t generation;
+	size_t prefix_len;
+	bool complete = true;
+
+	lttng_event_enabler_register_enums(event_enabler);
 
 	probe_list = lttng_get_probe_list_head();
+	generation = lttng_probes_generation();
+	prefix_len = lttng_enabler_name_prefix_len(enabler);
 	/*
-	 * For each probe event, if we find that a probe event matches
-	 * our enabler, create an associated lttng_event if not
-	 * already present.
+	 * For each probe event registered since the last call, if we
+	 * find that a probe event matches our enabler, create an
+	 * associated lttng_event if not already present. The session
+	 * daemon assigns the event ids in registration order: the hot
+	 * events are created in a first pass, so they get the ids which
+	 * fit in the compact event header.
 	 */
-	cds_list_for_each_entry(reg_probe, probe_list, head) {
-		const struct lttng_ust_probe_desc *probe_desc = reg_probe->desc;
-
-		for (i = 0; i < probe_desc->nr_events; i++) {
-			int ret;
-			bool found = false;
-			struct cds_hlist_head *head;
-			struct cds_hlist_node *node;
+	for (pass = 0; pass < 2; pass++) {
+		cds_list_for_each_entry(reg_probe, probe_list, head) {
+			const struct lttng_ust_probe_desc *probe_desc = reg_probe->desc;
 
-			desc = probe_desc->event_desc[i];
-			if (!lttng_desc_match_enabler(desc,
-					lttng_event_enabler_as_enabler(event_enabler)))
+			if (reg_probe->generation <= enabler->probe_generation)
+				continue;
+			if (!lttng_enabler_prefix_match(enabler->event_param.name, prefix_len,
+					probe_desc->provider_name, NULL))
 				continue;
+			for (i = 0; i < probe_desc->nr_events; i++) {
+				int ret;
 
-			head = borrow_hash_table_bucket(
-				session->priv->events_ht.table,
-				LTTNG_UST_EVENT_HT_SIZE, desc);
+				desc = probe_desc->event_desc[i];
+				if (lttng_event_desc_is_hot(desc) != !pass)
+					continue;
+				if (!lttng_desc_match_enabler(desc, enabler))
+					continue;
 
-			cds_hlist_for_each_entry(event_recorder_priv, node, head, hlist) {
-				if (event_recorder_priv->parent.desc == desc
-						&& event_recorder_priv->pub->chan == event_enabler->chan) {
-					found = true;
-					break;
-				}
-			}
-			if (found)
-				continue;
+				if (lttng_event_recorder_exists(session, desc, event_enabler->chan))
+					continue;
 
-			/*
-			 * We need to create an event for this
-			 * event probe.
-			 */
-			ret = lttng_event_recorder_create(probe_desc->event_desc[i],
-					event_enabler->chan);
-			if (ret) {
-				DBG("Unable to create event \"%s:%s\", error %d\n",
-					probe_desc->provider_name,
-					probe_desc->event_desc[i]->event_name, ret);
+				/*
+				 * We need to create an event for this
+				 * event probe.
+				 */
+				if (!reg_probe->fields_cache)
+					reg_probe->fields_cache = zmalloc(probe_desc->nr_events
+						* sizeof(*reg_probe->fields_cache));
+				ret = lttng_event_recorder_create(probe_desc->event_desc[i],
+						event_enabler->chan,
+						reg_probe->fields_cache ? &reg_probe->fields_cache[i] : NULL,
+						&queue);
+				if (ret) {
+					DBG("Unable to create event \"%s:%s\", error %d\n",
+						probe_desc->provider_name,
+						probe_desc->event_desc[i]->event_name, ret);
+					complete = false;
+				}
 			}
 		}
 	}
+	lttng_event_register_queue_flush(&queue);
+	if (queue.error)
+		complete = false;
+	/* Retry the events which could not be created on the next call. */
+	if (complete)
+		enabler->probe_generation = generation;
 }
 
 static
@@ -1217,9 +1812,15 @@ void lttng_probe_provider_unregister_events(
 	 */
 	probe_provider_event_for_each(provider_desc, _lttng_event_unregister);
 
-	/* Wait for grace period. */
-	lttng_ust_urcu_synchronize_rcu();
-	/* Prune the unregistration queue. */
+	/*
+	 * Prune the unregistration queue. Its grace period also waits for
+	 * the in-flight calls to the probes of this provider, whose code
+	 * is about to be unmapped. It is skipped when no probe was
+	 * disconnected, in which case no thread can be running them: the
+	 * unregistration of providers without enabled events, such as
+	 * plugins unloaded while not being traced, does not wait for any
+	 * grace period.
+	 */
 	lttng_ust_tp_probe_prune_release_queue();
 
 	/*
@@ -1316,10 +1917,10 @@ void lttng_handle_pending_statedump(void *owner)
 {
 	struct lttng_ust_session_private *session_priv;
 
-	/* Execute state dump */
-	do_lttng_ust_statedump(owner);
-
-	/* Clear pending state dump */
+	/*
+	 * Start the state dump of the sessions pending so far. Sessions
+	 * becoming pending while it runs are dumped by the next one.
+	 */
 	if (ust_lock()) {
 		goto end;
 	}
@@ -1329,6 +1930,20 @@ void lttng_handle_pending_statedump(void *owner)
 		if (!session_priv->statedump_pending)
 			continue;
 		session_priv->statedump_pending = 0;
+		session_priv->statedump_active = 1;
+	}
+	ust_unlock();
+
+	/* Execute state dump */
+	do_lttng_ust_statedump(owner);
+
+	/* Clear active state dump */
+	if (ust_lock()) {
+		goto end;
+	}
+	cds_list_for_each_entry(session_priv, &sessions, node) {
+		if (session_priv->owner == owner)
+			session_priv->statedump_active = 0;
 	}
 end:
 	ust_unlock();
@@ -1351,6 +1966,8 @@ void _lttng_event_destroy(struct lttng_ust_event_common *event)
 	{
 		struct lttng_ust_event_recorder *event_recorder = event->child;
 
+		if (event_recorder->chan->priv->fragment_recorder == event_recorder)
+			CMM_STORE_SHARED(event_recorder->chan->priv->fragment_recorder, NULL);
 		/* Remove from event list. */
 		cds_list_del(&event_recorder->priv->node);
 		/* Remove from event hash table. */
@@ -1413,6 +2030,7 @@ struct lttng_event_enabler *lttng_event_enabler_create(
 	event_enabler->base.format_type = format_type;
 	CDS_INIT_LIST_HEAD(&event_enabler->base.filter_bytecode_head);
 	CDS_INIT_LIST_HEAD(&event_enabler->base.excluder_head);
+	CDS_INIT_LIST_HEAD(&event_enabler->base.exclusion_glob_head);
 	memcpy(&event_enabler->base.event_param, event_param,
 		sizeof(event_enabler->base.event_param));
 	event_enabler->chan = chan;
@@ -1438,9 +2056,13 @@ struct lttng_event_notifier_enabler *lttng_event_notifier_enabler_create(
 	CDS_INIT_LIST_HEAD(&event_notifier_enabler->base.filter_bytecode_head);
 	CDS_INIT_LIST_HEAD(&event_notifier_enabler->capture_bytecode_head);
 	CDS_INIT_LIST_HEAD(&event_notifier_enabler->base.excluder_head);
+	CDS_INIT_LIST_HEAD(&event_notifier_enabler->base.exclusion_glob_head);
 
 	event_notifier_enabler->user_token = event_notifier_param->event.token;
 	event_notifier_enabler->error_counter_index = event_notifier_param->error_counter_index;
+	event_notifier_enabler->has_histogram = !!event_notifier_param->has_histogram;
+	event_notifier_enabler->histogram_counter_index = event_notifier_param->histogram_counter_index;
+	event_notifier_enabler->freeze_buffers = !!event_notifier_param->freeze_buffers;
 	event_notifier_enabler->num_captures = 0;
 
 	memcpy(&event_notifier_enabler->base.event_param.name,
@@ -1480,6 +2102,20 @@ int lttng_event_enabler_disable(struct lttng_event_enabler *event_enabler)
 	return 0;
 }
 
+int lttng_event_enabler_filter_stats(struct lttng_event_enabler *event_enabler,
+		struct lttng_ust_abi_filter_stats *stats)
+{
+	struct lttng_ust_session *session = event_enabler->chan->parent->session;
+	struct lttng_ust_event_recorder_private *event_recorder_priv;
+
+	memset(stats, 0, sizeof(*stats));
+	cds_list_for_each_entry(event_recorder_priv, &session->priv->events_head, node)
+		lttng_bytecode_filter_stats_add(
+			&event_recorder_priv->parent.filter_bytecode_runtime_head,
+			lttng_event_enabler_as_enabler(event_enabler), stats);
+	return 0;
+}
+
 static
 void _lttng_enabler_attach_filter_bytecode(struct lttng_enabler *enabler,
 		struct lttng_ust_bytecode_node **bytecode)
@@ -1500,21 +2136,56 @@ int lttng_event_enabler_attach_filter_bytecode(struct lttng_event_enabler *event
 	return 0;
 }
 
+/*
+ * Add the exclusion names of the excluder to the exclusion table of the
+ * enabler, or to its wildcard exclusions list for the names which
+ * require a glob match. Empty names are ignored.
+ */
 static
-void _lttng_enabler_attach_exclusion(struct lttng_enabler *enabler,
+int _lttng_enabler_attach_exclusion(struct lttng_enabler *enabler,
 		struct lttng_ust_excluder_node **excluder)
 {
-	(*excluder)->enabler = enabler;
-	cds_list_add_tail(&(*excluder)->node, &enabler->excluder_head);
+	struct lttng_ust_excluder_node *node = *excluder;
+	uint32_t i;
+
+	node->entries = zmalloc(node->excluder.count * sizeof(*node->entries));
+	if (!node->entries)
+		return -ENOMEM;
+	for (i = 0; i < node->excluder.count; i++) {
+		struct lttng_ust_exclusion_entry *entry = &node->entries[i];
+
+		entry->name = (char *) node->excluder.names
+				+ i * LTTNG_UST_ABI_SYM_NAME_LEN;
+		entry->len = strnlen(entry->name, LTTNG_UST_ABI_SYM_NAME_LEN);
+		if (!entry->len)
+			continue;
+		if (memchr(entry->name, '*', entry->len)
+				|| memchr(entry->name, '\\', entry->len)) {
+			cds_list_add_tail(&entry->u.node,
+					&enabler->exclusion_glob_head);
+		} else {
+			uint32_t hash = jhash(entry->name, entry->len, 0);
+
+			cds_hlist_add_head(&entry->u.hlist,
+					&enabler->exclusion_table[hash & (LTTNG_UST_EXCLUSION_HT_SIZE - 1)]);
+		}
+	}
+	node->enabler = enabler;
+	cds_list_add_tail(&node->node, &enabler->excluder_head);
 	/* Take ownership of excluder */
 	*excluder = NULL;
+	return 0;
 }
 
 int lttng_event_enabler_attach_exclusion(struct lttng_event_enabler *event_enabler,
 		struct lttng_ust_excluder_node **excluder)
 {
-	_lttng_enabler_attach_exclusion(
+	int ret;
+
+	ret = _lttng_enabler_attach_exclusion(
 		lttng_event_enabler_as_enabler(event_enabler), excluder);
+	if (ret)
+		return ret;
 
 	lttng_session_lazy_sync_event_enablers(event_enabler->chan->parent->session);
 	return 0;
@@ -1538,6 +2209,22 @@ int lttng_event_notifier_enabler_disable(
 	return 0;
 }
 
+int lttng_event_notifier_enabler_filter_stats(
+		struct lttng_event_notifier_enabler *event_notifier_enabler,
+		struct lttng_ust_abi_filter_stats *stats)
+{
+	struct lttng_event_notifier_group *group = event_notifier_enabler->group;
+	struct lttng_ust_event_notifier_private *event_notifier_priv;
+
+	memset(stats, 0, sizeof(*stats));
+	cds_list_for_each_entry(event_notifier_priv, &group->event_notifiers_head, node)
+		lttng_bytecode_filter_stats_add(
+			&event_notifier_priv->parent.filter_bytecode_runtime_head,
+			lttng_event_notifier_enabler_as_enabler(event_notifier_enabler),
+			stats);
+	return 0;
+}
+
 int lttng_event_notifier_enabler_attach_filter_bytecode(
 		struct lttng_event_notifier_enabler *event_notifier_enabler,
 		struct lttng_ust_bytecode_node **bytecode)
@@ -1570,9 +2257,13 @@ int lttng_event_notifier_enabler_attach_exclusion(
 		struct lttng_event_notifier_enabler *event_notifier_enabler,
 		struct lttng_ust_excluder_node **excluder)
 {
-	_lttng_enabler_attach_exclusion(
+	int ret;
+
+	ret = _lttng_enabler_attach_exclusion(
 		lttng_event_notifier_enabler_as_enabler(event_notifier_enabler),
 		excluder);
+	if (ret)
+		return ret;
 
 	lttng_event_notifier_group_sync_enablers(event_notifier_enabler->group);
 	return 0;
@@ -1604,12 +2295,30 @@ int lttng_attach_context(struct lttng_ust_abi_context *context_param,
 			perf_ctx_param->name,
 			ctx);
 	}
+	case LTTNG_UST_ABI_CONTEXT_PERF_CPU_COUNTER:
+	{
+		struct lttng_ust_abi_perf_counter_ctx *perf_ctx_param;
+
+		perf_ctx_param = &context_param->u.perf_counter;
+		return lttng_add_perf_cpu_counter_to_ctx(
+			perf_ctx_param->type,
+			perf_ctx_param->config,
+			perf_ctx_param->name,
+			ctx);
+	}
 	case LTTNG_UST_ABI_CONTEXT_VTID:
 		return lttng_add_vtid_to_ctx(ctx);
 	case LTTNG_UST_ABI_CONTEXT_VPID:
 		return lttng_add_vpid_to_ctx(ctx);
 	case LTTNG_UST_ABI_CONTEXT_PROCNAME:
 		return lttng_add_procname_to_ctx(ctx);
+	case LTTNG_UST_ABI_CONTEXT_PROCNAME_ID:
+		return lttng_add_procname_id_to_ctx(ctx);
+	case LTTNG_UST_ABI_CONTEXT_IDENTITY:
+		return lttng_add_identity_to_ctx(ctx);
+	case LTTNG_UST_ABI_CONTEXT_CALLSTACK:
+		return lttng_add_callstack_to_ctx(
+			context_param->u.callstack.max_depth, ctx);
 	case LTTNG_UST_ABI_CONTEXT_IP:
 		return lttng_add_ip_to_ctx(ctx);
 	case LTTNG_UST_ABI_CONTEXT_CPU_ID:
@@ -1670,16 +2379,134 @@ void lttng_event_enabler_destroy(struct lttng_event_enabler *event_enabler)
 	free(event_enabler);
 }
 
+static
+bool lttng_bytecode_runtime_enabled(const struct lttng_ust_bytecode_runtime *runtime)
+{
+	return runtime->bc->enabler->enabled && !runtime->link_failed;
+}
+
+static
+bool lttng_bytecode_runtime_same_code(const struct lttng_ust_bytecode_runtime *a,
+		const struct lttng_ust_bytecode_runtime *b)
+{
+	return a->bc->bc.len == b->bc->bc.len
+		&& a->bc->bc.reloc_offset == b->bc->bc.reloc_offset
+		&& !memcmp(a->bc->bc.data, b->bc->bc.data, a->bc->bc.len);
+}
+
+/*
+ * Filters of an event are OR'd in list order, so a filter with the same
+ * bytecode as an enabled filter before it, typically attached by another
+ * enabler matching the same event, cannot change the outcome: mark it
+ * as fused to skip its evaluation.
+ */
+static
+void lttng_event_fuse_filters(struct cds_list_head *filter_bytecode_runtime_head)
+{
+	struct lttng_ust_bytecode_runtime *runtime, *iter;
+
+	cds_list_for_each_entry(runtime, filter_bytecode_runtime_head, node) {
+		int fused = 0;
+
+		cds_list_for_each_entry(iter, filter_bytecode_runtime_head, node) {
+			if (iter == runtime)
+				break;
+			if (lttng_bytecode_runtime_enabled(iter)
+					&& lttng_bytecode_runtime_same_code(iter, runtime)) {
+				fused = 1;
+				break;
+			}
+		}
+		if (fused)
+			CMM_STORE_SHARED(runtime->fused, 1);
+	}
+}
+
+/*
+ * Enable the filters of an event and publish whether they read the
+ * payload. The probe skips preparing the interpreter stack when
+ * filter_payload is unset, so it is set before any filter reading the
+ * payload is enabled, and only cleared after they are all disabled.
+ * Fused filters are only marked once the filters they duplicate are
+ * enabled. Returns the number of filters.
+ */
+static
+int lttng_event_sync_filter_state(struct lttng_ust_event_common *event,
+		struct cds_list_head *filter_bytecode_runtime_head)
+{
+	struct lttng_ust_bytecode_runtime *runtime;
+	int nr_filters = 0, filter_payload = 0;
+
+	cds_list_for_each_entry(runtime, filter_bytecode_runtime_head, node) {
+		if (runtime->reads_payload)
+			filter_payload = 1;
+		CMM_STORE_SHARED(runtime->fused, 0);
+		nr_filters++;
+	}
+	if (filter_payload) {
+		CMM_STORE_SHARED(event->filter_payload, 1);
+		cmm_smp_wmb();
+	}
+	cds_list_for_each_entry(runtime, filter_bytecode_runtime_head, node)
+		lttng_bytecode_sync_state(runtime);
+	if (!filter_payload) {
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(event->filter_payload, 0);
+	}
+	cmm_smp_wmb();
+	lttng_event_fuse_filters(filter_bytecode_runtime_head);
+	return nr_filters;
+}
+
+/*
+ * Allocate the staging area of the records of @chan larger than a
+ * sub-buffer, kept until the channel is freed.
+ */
+static
+int lttng_channel_alloc_staging(struct lttng_ust_channel_buffer *chan)
+{
+	struct lttng_ust_staging_area *staging;
+	int nr_slots = num_possible_cpus();
+
+	if (chan->priv->staging)
+		return 0;
+	if (nr_slots <= 0)
+		return -EINVAL;
+	staging = zmalloc(sizeof(*staging));
+	if (!staging)
+		goto error;
+	staging->slot_size = LTTNG_UST_STAGING_SLOT_SIZE;
+	staging->nr_slots = nr_slots;
+	staging->busy = zmalloc(nr_slots * sizeof(*staging->busy));
+	if (!staging->busy)
+		goto error;
+	staging->slots = malloc((size_t) nr_slots * staging->slot_size);
+	if (!staging->slots)
+		goto error;
+	/* Published before the fragment event which uses it. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(chan->priv->staging, staging);
+	return 0;
+
+error:
+	DBG("Unable to allocate the staging area of channel %u", chan->priv->id);
+	if (staging)
+		free(staging->busy);
+	free(staging);
+	return -ENOMEM;
+}
+
 /*
  * lttng_session_sync_event_enablers should be called just before starting a
  * session.
  */
 static
-void lttng_session_sync_event_enablers(struct lttng_ust_session *session)
+void __lttng_session_sync_event_enablers(struct lttng_ust_session *session)
 {
 	struct lttng_event_enabler *event_enabler;
 	struct lttng_ust_event_recorder_private *event_recorder_priv;
 
+	session->priv->sync_pending = false;
 	cds_list_for_each_entry(event_enabler, &session->priv->enablers_head, node)
 		lttng_event_enabler_ref_event_recorders(event_enabler);
 	/*
@@ -1689,7 +2516,6 @@ void lttng_session_sync_event_enablers(struct lttng_ust_session *session)
 	 */
 	cds_list_for_each_entry(event_recorder_priv, &session->priv->events_head, node) {
 		struct lttng_enabler_ref *enabler_ref;
-		struct lttng_ust_bytecode_runtime *runtime;
 		int enabled = 0, has_enablers_without_filter_bytecode = 0;
 		int nr_filters = 0;
 
@@ -1709,6 +2535,17 @@ void lttng_session_sync_event_enablers(struct lttng_ust_session *session)
 		enabled = enabled && session->priv->tstate && event_recorder_priv->pub->chan->priv->parent.tstate;
 
 		CMM_STORE_SHARED(event_recorder_priv->pub->parent->enabled, enabled);
+		/*
+		 * The ring buffer client records the records larger
+		 * than a sub-buffer as fragment events of the channel.
+		 */
+		if (caa_unlikely(lttng_ust_is_fragment_event(event_recorder_priv->parent.desc))) {
+			struct lttng_ust_channel_buffer *chan = event_recorder_priv->pub->chan;
+
+			CMM_STORE_SHARED(chan->priv->fragment_recorder,
+				enabled && !lttng_channel_alloc_staging(chan) ?
+					event_recorder_priv->pub : NULL);
+		}
 		/*
 		 * Sync tracepoint registration with event enabled
 		 * state.
@@ -1734,14 +2571,17 @@ void lttng_session_sync_event_enablers(struct lttng_ust_session *session)
 			has_enablers_without_filter_bytecode;
 
 		/* Enable filters */
-		cds_list_for_each_entry(runtime,
-				&event_recorder_priv->parent.filter_bytecode_runtime_head, node) {
-			lttng_bytecode_sync_state(runtime);
-			nr_filters++;
-		}
+		nr_filters = lttng_event_sync_filter_state(event_recorder_priv->parent.pub,
+				&event_recorder_priv->parent.filter_bytecode_runtime_head);
 		CMM_STORE_SHARED(event_recorder_priv->parent.pub->eval_filter,
 			!(has_enablers_without_filter_bytecode || !nr_filters));
 	}
+}
+
+static
+void lttng_session_sync_event_enablers(struct lttng_ust_session *session)
+{
+	__lttng_session_sync_event_enablers(session);
 	lttng_ust_tp_probe_prune_release_queue();
 }
 
@@ -1750,15 +2590,27 @@ void lttng_create_event_notifier_if_missing(
 		struct lttng_event_notifier_enabler *event_notifier_enabler)
 {
 	struct lttng_event_notifier_group *event_notifier_group = event_notifier_enabler->group;
+	struct lttng_enabler *enabler =
+		lttng_event_notifier_enabler_as_enabler(event_notifier_enabler);
 	struct lttng_ust_registered_probe *reg_probe;
 	struct cds_list_head *probe_list;
+	uint64_t generation;
+	size_t prefix_len;
+	bool complete = true;
 	int i;
 
 	probe_list = lttng_get_probe_list_head();
+	generation = lttng_probes_generation();
+	prefix_len = lttng_enabler_name_prefix_len(enabler);
 
 	cds_list_for_each_entry(reg_probe, probe_list, head) {
 		const struct lttng_ust_probe_desc *probe_desc = reg_probe->desc;
 
+		if (reg_probe->generation <= enabler->probe_generation)
+			continue;
+		if (!lttng_enabler_prefix_match(enabler->event_param.name, prefix_len,
+				probe_desc->provider_name, NULL))
+			continue;
 		for (i = 0; i < probe_desc->nr_events; i++) {
 			int ret;
 			bool found = false;
@@ -1769,8 +2621,7 @@ void lttng_create_event_notifier_if_missing(
 
 			desc = probe_desc->event_desc[i];
 
-			if (!lttng_desc_match_enabler(desc,
-					lttng_event_notifier_enabler_as_enabler(event_notifier_enabler)))
+			if (!lttng_desc_match_enabler(desc, enabler))
 				continue;
 
 			/*
@@ -1804,14 +2655,21 @@ void lttng_create_event_notifier_if_missing(
 			ret = lttng_event_notifier_create(desc,
 				event_notifier_enabler->user_token,
 				event_notifier_enabler->error_counter_index,
+				event_notifier_enabler->has_histogram,
+				event_notifier_enabler->histogram_counter_index,
+				event_notifier_enabler->freeze_buffers,
 				event_notifier_group);
 			if (ret) {
 				DBG("Unable to create event_notifier \"%s:%s\", error %d\n",
 					probe_desc->provider_name,
 					probe_desc->event_desc[i]->event_name, ret);
+				complete = false;
 			}
 		}
 	}
+	/* Retry the event notifiers which could not be created on the next call. */
+	if (complete)
+		enabler->probe_generation = generation;
 }
 
 /*
@@ -1934,11 +2792,8 @@ void lttng_event_notifier_group_sync_enablers(struct lttng_event_notifier_group
 			has_enablers_without_filter_bytecode;
 
 		/* Enable filters */
-		cds_list_for_each_entry(runtime,
-				&event_notifier_priv->parent.filter_bytecode_runtime_head, node) {
-			lttng_bytecode_sync_state(runtime);
-			nr_filters++;
-		}
+		nr_filters = lttng_event_sync_filter_state(event_notifier_priv->parent.pub,
+				&event_notifier_priv->parent.filter_bytecode_runtime_head);
 		CMM_STORE_SHARED(event_notifier_priv->parent.pub->eval_filter,
 			!(has_enablers_without_filter_bytecode || !nr_filters));
 
@@ -1959,6 +2814,7 @@ void lttng_event_notifier_group_sync_enablers(struct lttng_event_notifier_group
  * be. It is required after each modification applied to an active
  * session, and right before session "start".
  * "lazy" sync means we only sync if required.
+ * Within a batch, the sync is deferred to the end of the batch.
  */
 static
 void lttng_session_lazy_sync_event_enablers(struct lttng_ust_session *session)
@@ -1966,9 +2822,46 @@ void lttng_session_lazy_sync_event_enablers(struct lttng_ust_session *session)
 	/* We can skip if session is not active */
 	if (!session->active)
 		return;
+	if (enabler_sync_batch_nesting) {
+		session->priv->sync_pending = true;
+		return;
+	}
 	lttng_session_sync_event_enablers(session);
 }
 
+/*
+ * Defer the lazy enabler syncs of the sessions until the matching
+ * lttng_session_enabler_sync_batch_end(). Called with ust lock held.
+ */
+void lttng_session_enabler_sync_batch_begin(void)
+{
+	enabler_sync_batch_nesting++;
+}
+
+/*
+ * Sync the sessions modified since the outermost
+ * lttng_session_enabler_sync_batch_begin(), waiting for a single grace
+ * period to release the old tracepoint probe arrays of all of them.
+ * Called with ust lock held.
+ */
+void lttng_session_enabler_sync_batch_end(void)
+{
+	struct lttng_ust_session_private *session_priv;
+
+	assert(enabler_sync_batch_nesting > 0);
+	if (--enabler_sync_batch_nesting)
+		return;
+	cds_list_for_each_entry(session_priv, &sessions, node) {
+		if (!session_priv->sync_pending)
+			continue;
+		if (session_priv->pub->active)
+			__lttng_session_sync_event_enablers(session_priv->pub);
+		else
+			session_priv->sync_pending = false;
+	}
+	lttng_ust_tp_probe_prune_release_queue();
+}
+
 /*
  * Update all sessions with the given app context.
  * Called with ust lock held.
@@ -1977,6 +2870,7 @@ void lttng_session_lazy_sync_event_enablers(struct lttng_ust_session *session)
  * context (either app context callbacks, or dummy callbacks).
  */
 void lttng_ust_context_set_session_provider(const char *name,
+		enum lttng_ust_dynamic_type fixed_type,
 		size_t (*get_size)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
 			size_t offset),
 		void (*record)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
@@ -1993,18 +2887,18 @@ void lttng_ust_context_set_session_provider(const char *name,
 		int ret;
 
 		ret = lttng_ust_context_set_provider_rcu(&session_priv->ctx,
-				name, get_size, record, get_value);
+				name, fixed_type, get_size, record, get_value);
 		if (ret)
 			abort();
 		cds_list_for_each_entry(chan, &session_priv->chan_head, node) {
 			ret = lttng_ust_context_set_provider_rcu(&chan->ctx,
-					name, get_size, record, get_value);
+					name, fixed_type, get_size, record, get_value);
 			if (ret)
 				abort();
 		}
 		cds_list_for_each_entry(event_recorder_priv, &session_priv->events_head, node) {
 			ret = lttng_ust_context_set_provider_rcu(&event_recorder_priv->ctx,
-					name, get_size, record, get_value);
+					name, fixed_type, get_size, record, get_value);
 			if (ret)
 				abort();
 		}
@@ -2019,6 +2913,7 @@ void lttng_ust_context_set_session_provider(const char *name,
  * context (either app context callbacks, or dummy callbacks).
  */
 void lttng_ust_context_set_event_notifier_group_provider(const char *name,
+		enum lttng_ust_dynamic_type fixed_type,
 		size_t (*get_size)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
 			size_t offset),
 		void (*record)(void *priv, struct lttng_ust_probe_ctx *probe_ctx,
@@ -2034,7 +2929,7 @@ void lttng_ust_context_set_event_notifier_group_provider(const char *name,
 
 		ret = lttng_ust_context_set_provider_rcu(
 				&event_notifier_group->ctx,
-				name, get_size, record, get_value);
+				name, fixed_type, get_size, record, get_value);
 		if (ret)
 			abort();
 	}
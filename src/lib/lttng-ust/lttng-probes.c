@@ -20,6 +20,7 @@
 
 #include "lttng-tracer-core.h"
 #include "common/jhash.h"
+#include "common/metrics.h"
 #include "lib/lttng-ust/events.h"
 
 /*
@@ -39,6 +40,13 @@ static CDS_LIST_HEAD(lazy_probe_init);
  */
 static int lazy_nesting;
 
+/*
+ * Incremented each time a probe is added to the probe list. Enablers
+ * only look for new events within the probes registered after the
+ * generation they have already processed. Protected by ust lock.
+ */
+static uint64_t probe_generation;
+
 static
 int check_provider_version(const struct lttng_ust_probe_desc *desc)
 {
@@ -191,12 +199,17 @@ void lttng_lazy_probe_register(struct lttng_ust_registered_probe *reg_probe)
 	/* We should be added at the head of the list */
 	cds_list_add(&reg_probe->head, probe_list);
 probe_added:
+	reg_probe->generation = ++probe_generation;
 	DBG("just registered probe %s containing %u events",
 		reg_probe->desc->provider_name, reg_probe->desc->nr_events);
 }
 
 /*
- * Called under ust lock.
+ * Called under ust lock. The events of the probes are validated here
+ * rather than at registration, so loading provider libraries does not
+ * pay for it: this is only done when the probe list is first needed,
+ * or when a provider is registered while a session is active. Probes
+ * which fail validation are not added to the probe list.
  */
 static
 void fixup_lazy_probes(void)
@@ -207,7 +220,10 @@ void fixup_lazy_probes(void)
 	lazy_nesting++;
 	cds_list_for_each_entry_safe(iter, tmp,
 			&lazy_probe_init, lazy_init_head) {
-		lttng_lazy_probe_register(iter);
+		if (check_event_provider(iter->desc))
+			lttng_lazy_probe_register(iter);
+		else
+			CDS_INIT_LIST_HEAD(&iter->head);
 		iter->lazy = 0;
 		cds_list_del(&iter->lazy_init_head);
 	}
@@ -226,6 +242,13 @@ struct cds_list_head *lttng_get_probe_list_head(void)
 	return &_probe_list;
 }
 
+/*
+ * Called under ust lock, after lttng_get_probe_list_head().
+ */
+uint64_t lttng_probes_generation(void)
+{
+	return probe_generation;
+}
 
 struct lttng_ust_registered_probe *lttng_ust_probe_register(const struct lttng_ust_probe_desc *desc)
 {
@@ -239,8 +262,6 @@ struct lttng_ust_registered_probe *lttng_ust_probe_register(const struct lttng_u
 	 */
 	if (!check_provider_version(desc))
 		return NULL;
-	if (!check_event_provider(desc))
-		return NULL;
 
 	ust_lock_nocheck();
 
@@ -262,6 +283,7 @@ struct lttng_ust_registered_probe *lttng_ust_probe_register(const struct lttng_u
 		fixup_lazy_probes();
 
 	lttng_fix_pending_event_notifiers();
+	lttng_ust_metrics_inc(LTTNG_UST_METRIC_PROBE_REGISTER);
 end:
 	ust_unlock();
 	return reg_probe;
@@ -285,6 +307,13 @@ void lttng_ust_probe_unregister(struct lttng_ust_registered_probe *reg_probe)
 	lttng_probe_provider_unregister_events(reg_probe->desc);
 	DBG("just unregistered probes of provider %s", reg_probe->desc->provider_name);
 	ust_unlock();
+	if (reg_probe->fields_cache) {
+		unsigned int i;
+
+		for (i = 0; i < reg_probe->desc->nr_events; i++)
+			free(reg_probe->fields_cache[i].fields);
+		free(reg_probe->fields_cache);
+	}
 	free(reg_probe);
 }
 
@@ -9,7 +9,10 @@
 #ifndef _LTTNG_TRACER_CORE_H
 #define _LTTNG_TRACER_CORE_H
 
+#include <stdarg.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <urcu/arch.h>
 #include <urcu/list.h>
 #include <lttng/ust-tracer.h>
@@ -24,6 +27,9 @@ struct lttng_ust_ctx_value;
 struct lttng_ust_event_recorder;
 struct lttng_ust_event_notifier;
 struct lttng_ust_notification_ctx;
+struct lttng_ust_tracef_site;
+struct lttng_ust_event_desc;
+struct lttng_ust_enum_desc;
 
 int ust_lock(void) __attribute__ ((warn_unused_result))
 	__attribute__((visibility("hidden")));
@@ -58,6 +64,86 @@ void lttng_time_ns_alloc_tls(void)
 void lttng_uts_ns_alloc_tls(void)
 	__attribute__((visibility("hidden")));
 
+void lttng_callstack_alloc_tls(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_tracef_alloc_tls(void)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Probe accept callback of liblttng-ust-tracepoint, backing the
+ * lttng_ust_tracepoint_may_record() call sites.
+ */
+int lttng_ust_event_may_record(void *data, void *ip)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Tracer self-metrics and probe overhead accounting, enabled by
+ * LTTNG_UST_METRICS and LTTNG_UST_PROBE_OVERHEAD (see common/metrics.h).
+ */
+void lttng_ust_metrics_init(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_ust_metrics_exit(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_ust_metrics_after_fork_child(void)
+	__attribute__((visibility("hidden")));
+
+/* Probe overhead counter row of the events of @desc, or -1. */
+int lttng_ust_probe_overhead_slot(const struct lttng_ust_event_desc *desc)
+	__attribute__((visibility("hidden")));
+
+/* Event discards counter row of the event recorders of @desc, or -1. */
+int lttng_ust_event_discards_slot(const struct lttng_ust_event_desc *desc)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Prepare the current thread for lttng_ust_sigsafe_record(): registers
+ * it as URCU reader, which allocates memory and takes a lock.
+ */
+void lttng_ust_sigsafe_init_thread(void)
+	__attribute__((visibility("hidden")));
+
+/* Whether @desc is the lttng_ust_fragment:record event. */
+bool lttng_ust_is_fragment_event(const struct lttng_ust_event_desc *desc)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Format a tracef/tracelog message into the per-thread scratch buffer,
+ * or into a heap allocation when it does not fit or the buffer is in
+ * use. Returns the message length, or -1 on error. The message must be
+ * released with lttng_ust_tracef_msg_put() unless an error is returned.
+ */
+int lttng_ust_tracef_msg_get(char **msg, const char *fmt, va_list ap)
+	__attribute__((visibility("hidden"), format(printf, 2, 0)));
+
+void lttng_ust_tracef_msg_put(char *msg)
+	__attribute__((visibility("hidden")));
+
+#define LTTNG_UST_TRACEF_DEFERRED_ARGS_LEN	512
+
+/*
+ * Pack the arguments of a deferred-format call site into @buf, of
+ * LTTNG_UST_TRACEF_DEFERRED_ARGS_LEN bytes. The first call of the call
+ * site calls @format_cb to record its descriptor. Returns the packed
+ * length, -1 if the format cannot be deferred, in which case @ap is not
+ * consumed, or -ENOMEM.
+ */
+int lttng_ust_tracef_site_pack(struct lttng_ust_tracef_site *site,
+		uint8_t *buf, va_list ap,
+		void (*format_cb)(const void *site,
+			const struct lttng_ust_tracef_site *desc, void *ip),
+		void *ip)
+	__attribute__((visibility("hidden")));
+
+/* Iterate on the deferred-format call sites seen so far. */
+void lttng_ust_tracef_site_for_each(
+		void (*cb)(const void *site,
+			const struct lttng_ust_tracef_site *desc, void *priv),
+		void *priv)
+	__attribute__((visibility("hidden")));
+
 const char *lttng_ust_obj_get_name(int id)
 	__attribute__((visibility("hidden")));
 
@@ -70,6 +156,50 @@ char* lttng_ust_sockinfo_get_procname(void *owner)
 void lttng_ust_sockinfo_session_enabled(void *owner)
 	__attribute__((visibility("hidden")));
 
+/*
+ * Whether the sessions of @owner are traced to a local directory by the
+ * embedded consumer rather than by a session daemon.
+ */
+int lttng_ust_sockinfo_is_embedded(void *owner)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Embedded mode: without session daemon, the tracer creates its own
+ * session, with one per-cpu channel, and an in-process consumer thread
+ * writes its streams and their CTF metadata in the directory given by
+ * LTTNG_UST_EMBEDDED_OUTPUT.
+ */
+const char *lttng_ust_embedded_output(void)
+	__attribute__((visibility("hidden")));
+
+int lttng_ust_embedded_init(void *owner)
+	__attribute__((visibility("hidden")));
+
+void lttng_ust_embedded_exit(void)
+	__attribute__((visibility("hidden")));
+
+/* Forget the state inherited from the parent, in a forked child. */
+void lttng_ust_embedded_after_fork_child(void)
+	__attribute__((visibility("hidden")));
+
+/*
+ * Registration of the session objects to the embedded consumer, in
+ * place of the notify socket requests to the session daemon. Called
+ * with the UST lock held.
+ */
+int lttng_ust_embedded_register_enum(const struct lttng_ust_enum_desc *desc,
+		uint64_t *id)
+	__attribute__((visibility("hidden")));
+
+int lttng_ust_embedded_register_channel(struct lttng_ust_channel_buffer *chan,
+		uint32_t *chan_id, int *header_type)
+	__attribute__((visibility("hidden")));
+
+int lttng_ust_embedded_register_event(struct lttng_ust_channel_buffer *chan,
+		const struct lttng_ust_event_desc *desc, const char *name,
+		int loglevel, const char *model_emf_uri, uint32_t *id)
+	__attribute__((visibility("hidden")));
+
 void lttng_event_notifier_notification_send(
 		const struct lttng_ust_event_notifier *event_notifier,
 		const char *stack_data,
@@ -77,6 +207,15 @@ void lttng_event_notifier_notification_send(
 		struct lttng_ust_notification_ctx *notif_ctx)
 	__attribute__((visibility("hidden")));
 
+void lttng_event_notifier_notification_alloc_tls(void)
+	__attribute__((visibility("hidden")));
+
+int lttng_event_notifier_notification_init(void)
+	__attribute__((visibility("hidden")));
+
+void lttng_event_notifier_notification_exit(void)
+	__attribute__((visibility("hidden")));
+
 #ifdef HAVE_LINUX_PERF_EVENT_H
 void lttng_ust_perf_counter_alloc_tls(void)
 	__attribute__((visibility("hidden")));
@@ -86,6 +225,9 @@ void lttng_perf_lock(void)
 
 void lttng_perf_unlock(void)
 	__attribute__((visibility("hidden")));
+
+void lttng_perf_counter_init_thread(void)
+	__attribute__((visibility("hidden")));
 #else /* #ifdef HAVE_LINUX_PERF_EVENT_H */
 static inline
 void lttng_ust_perf_counter_alloc_tls(void)
@@ -99,6 +241,10 @@ static inline
 void lttng_perf_unlock(void)
 {
 }
+static inline
+void lttng_perf_counter_init_thread(void)
+{
+}
 #endif /* #else #ifdef HAVE_LINUX_PERF_EVENT_H */
 
 #endif /* _LTTNG_TRACER_CORE_H */
@@ -42,6 +42,7 @@
 #include "common/ringbuffer/frontend_types.h"
 #include "common/ringbuffer/frontend.h"
 #include "common/ringbuffer/shm.h"
+#include "common/smp.h"
 #include "common/counter/counter.h"
 #include "common/tracepoint.h"
 #include "common/tracer.h"
@@ -407,6 +408,8 @@ long lttng_abi_add_context(int objd __attribute__((unused)),
  *		Returns a file descriptor listing available tracepoint fields
  *	LTTNG_UST_ABI_WAIT_QUIESCENT
  *		Returns after all previously running probes have completed
+ *	LTTNG_UST_ABI_TRACEPOINT_SAMPLE
+ *		Sets the sampling period of a tracepoint's sampled call sites
  *
  * The returned session will be deleted when its file descriptor is closed.
  */
@@ -430,6 +433,14 @@ long lttng_cmd(int objd, unsigned int cmd, unsigned long arg,
 	case LTTNG_UST_ABI_EVENT_NOTIFIER_GROUP_CREATE:
 		return lttng_abi_event_notifier_send_fd(owner,
 			&uargs->event_notifier_handle.event_notifier_notif_fd);
+	case LTTNG_UST_ABI_TRACEPOINT_SAMPLE:
+	{
+		struct lttng_ust_abi_tracepoint_sample *sample =
+			(struct lttng_ust_abi_tracepoint_sample *) arg;
+
+		sample->name[LTTNG_UST_ABI_SYM_NAME_LEN - 1] = '\0';
+		return lttng_ust_tp_set_sample_period(sample->name, sample->period);
+	}
 	default:
 		return -EINVAL;
 	}
@@ -468,6 +479,7 @@ int lttng_abi_map_channel(int session_objd,
 
 	switch (type) {
 	case LTTNG_UST_ABI_CHAN_PER_CPU:
+	case LTTNG_UST_ABI_CHAN_PER_THREAD:
 		break;
 	default:
 		ret = -EINVAL;
@@ -533,6 +545,17 @@ int lttng_abi_map_channel(int session_objd,
 		}
 		chan_name = "channel";
 		break;
+	case LTTNG_UST_ABI_CHAN_PER_THREAD:
+		if (config->output == RING_BUFFER_MMAP
+				&& config->mode == RING_BUFFER_DISCARD
+				&& config->wakeup == RING_BUFFER_WAKEUP_BY_WRITER) {
+			transport_name = "relay-discard-per-thread-mmap";
+		} else {
+			ret = -EINVAL;
+			goto notransport;
+		}
+		chan_name = "channel";
+		break;
 	default:
 		ret = -EINVAL;
 		goto notransport;
@@ -545,6 +568,26 @@ int lttng_abi_map_channel(int session_objd,
 		goto notransport;
 	}
 
+	lttng_chan_buf->priv->intern_caches = zmalloc(chan->nr_streams *
+			sizeof(*lttng_chan_buf->priv->intern_caches));
+	if (!lttng_chan_buf->priv->intern_caches) {
+		ret = -ENOMEM;
+		goto intern_error;
+	}
+	lttng_chan_buf->priv->nr_intern_caches = chan->nr_streams;
+
+	/*
+	 * The packet context cpu_id of a per-cpu channel with fewer streams
+	 * than possible cpus is the index of the stream, which holds the
+	 * events of one or more cpus: record the cpu of each event.
+	 */
+	if (type == LTTNG_UST_ABI_CHAN_PER_CPU
+			&& chan->nr_streams != (unsigned int) num_possible_cpus()) {
+		ret = lttng_add_cpu_id_to_ctx(&lttng_chan_buf->priv->ctx);
+		if (ret)
+			goto ctx_error;
+	}
+
 	chan_objd = objd_alloc(NULL, &lttng_channel_ops, owner, chan_name);
 	if (chan_objd < 0) {
 		ret = chan_objd;
@@ -556,7 +599,6 @@ int lttng_abi_map_channel(int session_objd,
 	lttng_chan_buf->parent->session = session;
 
 	lttng_chan_buf->priv->parent.tstate = 1;
-	lttng_chan_buf->priv->ctx = NULL;
 	lttng_chan_buf->priv->rb_chan = chan;
 
 	lttng_chan_buf->ops = &transport->ops;
@@ -584,6 +626,9 @@ int lttng_abi_map_channel(int session_objd,
 
 	/* error path after channel was created */
 objd_error:
+	lttng_destroy_context(lttng_chan_buf->priv->ctx);
+ctx_error:
+intern_error:
 notransport:
 uuid_error:
 alloc_error:
@@ -736,6 +781,9 @@ long lttng_event_notifier_enabler_cmd(int objd, unsigned int cmd, unsigned long
 		return lttng_event_notifier_enabler_enable(event_notifier_enabler);
 	case LTTNG_UST_ABI_DISABLE:
 		return lttng_event_notifier_enabler_disable(event_notifier_enabler);
+	case LTTNG_UST_ABI_FILTER_STATS:
+		return lttng_event_notifier_enabler_filter_stats(event_notifier_enabler,
+			(struct lttng_ust_abi_filter_stats *) arg);
 	default:
 		return -EINVAL;
 	}
@@ -765,15 +813,26 @@ long lttng_event_notifier_group_error_counter_cmd(int objd, unsigned int cmd, un
 
 	switch (cmd) {
 	case LTTNG_UST_ABI_COUNTER_GLOBAL:
-		ret = -EINVAL;	/* Unimplemented. */
+	{
+		ret = lttng_counter_set_global_shm(counter->counter,
+			uargs->counter_shm.shm_fd);
+		if (!ret) {
+			/* Take ownership of the shm_fd. */
+			uargs->counter_shm.shm_fd = -1;
+		}
 		break;
+	}
 	case LTTNG_UST_ABI_COUNTER_CPU:
 	{
 		struct lttng_ust_abi_counter_cpu *counter_cpu =
 			(struct lttng_ust_abi_counter_cpu *)arg;
 
-		ret = lttng_counter_set_cpu_shm(counter->counter,
-			counter_cpu->cpu_nr, uargs->counter_shm.shm_fd);
+		if (counter_cpu->cpu_nr == LTTNG_UST_ABI_COUNTER_CPU_ALL)
+			ret = lttng_counter_set_cpu_all_shm(counter->counter,
+				uargs->counter_shm.shm_fd);
+		else
+			ret = lttng_counter_set_cpu_shm(counter->counter,
+				counter_cpu->cpu_nr, uargs->counter_shm.shm_fd);
 		if (!ret) {
 			/* Take ownership of the shm_fd. */
 			uargs->counter_shm.shm_fd = -1;
@@ -806,6 +865,42 @@ static const struct lttng_ust_abi_objd_ops lttng_event_notifier_group_error_coun
 	.cmd = lttng_event_notifier_group_error_counter_cmd,
 };
 
+static
+const char *event_notifier_group_counter_transport(
+		const struct lttng_ust_abi_counter_conf *counter_conf)
+{
+	switch (counter_conf->arithmetic) {
+	case LTTNG_UST_ABI_COUNTER_ARITHMETIC_MODULAR:
+		switch (counter_conf->bitness) {
+		case LTTNG_UST_ABI_COUNTER_BITNESS_64:
+			return "counter-per-cpu-64-modular";
+		case LTTNG_UST_ABI_COUNTER_BITNESS_32:
+			return "counter-per-cpu-32-modular";
+		case LTTNG_UST_ABI_COUNTER_BITNESS_16:
+			return "counter-per-cpu-16-modular";
+		case LTTNG_UST_ABI_COUNTER_BITNESS_8:
+			return "counter-per-cpu-8-modular";
+		default:
+			return NULL;
+		}
+	case LTTNG_UST_ABI_COUNTER_ARITHMETIC_SATURATION:
+		switch (counter_conf->bitness) {
+		case LTTNG_UST_ABI_COUNTER_BITNESS_64:
+			return "counter-per-cpu-64-saturation";
+		case LTTNG_UST_ABI_COUNTER_BITNESS_32:
+			return "counter-per-cpu-32-saturation";
+		case LTTNG_UST_ABI_COUNTER_BITNESS_16:
+			return "counter-per-cpu-16-saturation";
+		case LTTNG_UST_ABI_COUNTER_BITNESS_8:
+			return "counter-per-cpu-8-saturation";
+		default:
+			return NULL;
+		}
+	default:
+		return NULL;
+	}
+}
+
 static
 int lttng_ust_event_notifier_group_create_error_counter(int event_notifier_group_objd, void *owner,
 		struct lttng_ust_abi_counter_conf *error_counter_conf)
@@ -821,22 +916,12 @@ int lttng_ust_event_notifier_group_create_error_counter(int event_notifier_group
 	if (event_notifier_group->error_counter)
 		return -EBUSY;
 
-	if (error_counter_conf->arithmetic != LTTNG_UST_ABI_COUNTER_ARITHMETIC_MODULAR)
-		return -EINVAL;
-
 	if (error_counter_conf->number_dimensions != 1)
 		return -EINVAL;
 
-	switch (error_counter_conf->bitness) {
-	case LTTNG_UST_ABI_COUNTER_BITNESS_64:
-		counter_transport_name = "counter-per-cpu-64-modular";
-		break;
-	case LTTNG_UST_ABI_COUNTER_BITNESS_32:
-		counter_transport_name = "counter-per-cpu-32-modular";
-		break;
-	default:
+	counter_transport_name = event_notifier_group_counter_transport(error_counter_conf);
+	if (!counter_transport_name)
 		return -EINVAL;
-	}
 
 	counter_objd = objd_alloc(NULL, &lttng_event_notifier_group_error_counter_ops, owner,
 		"event_notifier group error counter");
@@ -860,11 +945,11 @@ int lttng_ust_event_notifier_group_create_error_counter(int event_notifier_group
 
 	event_notifier_group->error_counter_len = counter_len;
 	/*
-	 * store-release to publish error counter matches load-acquire
-	 * in record_error. Ensures the counter is created and the
-	 * error_counter_len is set before they are used.
+	 * store-release to publish error counter matches the dependency
+	 * ordered load in record_error. Ensures the counter is created and
+	 * the error_counter_len is set before they are used.
 	 * Currently a full memory barrier is used, which could be
-	 * turned into acquire-release barriers.
+	 * turned into a release barrier.
 	 */
 	cmm_smp_mb();
 	CMM_STORE_SHARED(event_notifier_group->error_counter, counter);
@@ -889,6 +974,147 @@ objd_error:
 	return ret;
 }
 
+/*
+ * The histogram counter is a two-dimension map: the first dimension is
+ * indexed by the event notifier histogram_counter_index, the second by
+ * the log2 bucket of the value captured by the event notifier.
+ */
+static
+int lttng_ust_event_notifier_group_create_histogram_counter(int event_notifier_group_objd,
+		void *owner, struct lttng_ust_abi_counter_conf *histogram_counter_conf)
+{
+	const char *counter_transport_name;
+	struct lttng_event_notifier_group *event_notifier_group =
+		objd_private(event_notifier_group_objd);
+	struct lttng_counter *counter;
+	int counter_objd, ret;
+	struct lttng_counter_dimension dimensions[2];
+	size_t counter_len;
+
+	if (event_notifier_group->histogram_counter)
+		return -EBUSY;
+
+	if (histogram_counter_conf->number_dimensions != 2)
+		return -EINVAL;
+	if (histogram_counter_conf->dimensions[1].size != LTTNG_UST_ABI_COUNTER_HISTOGRAM_NR_BUCKETS)
+		return -EINVAL;
+
+	counter_transport_name = event_notifier_group_counter_transport(histogram_counter_conf);
+	if (!counter_transport_name)
+		return -EINVAL;
+
+	counter_objd = objd_alloc(NULL, &lttng_event_notifier_group_error_counter_ops, owner,
+		"event_notifier group histogram counter");
+	if (counter_objd < 0) {
+		ret = counter_objd;
+		goto objd_error;
+	}
+
+	counter_len = histogram_counter_conf->dimensions[0].size;
+	memset(dimensions, 0, sizeof(dimensions));
+	dimensions[0].size = counter_len;
+	dimensions[1].size = LTTNG_UST_ABI_COUNTER_HISTOGRAM_NR_BUCKETS;
+
+	counter = lttng_ust_counter_create(counter_transport_name, 2, dimensions);
+	if (!counter) {
+		ret = -EINVAL;
+		goto create_error;
+	}
+
+	event_notifier_group->histogram_counter_len = counter_len;
+	/* Same publication scheme as the error counter. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(event_notifier_group->histogram_counter, counter);
+
+	counter->objd = counter_objd;
+	counter->event_notifier_group = event_notifier_group;	/* owner */
+
+	objd_set_private(counter_objd, counter);
+	/* The histogram counter holds a reference on the event_notifier group. */
+	objd_ref(event_notifier_group->objd);
+
+	return counter_objd;
+
+create_error:
+	{
+		int err;
+
+		err = lttng_ust_abi_objd_unref(counter_objd, 1);
+		assert(!err);
+	}
+objd_error:
+	return ret;
+}
+
+/*
+ * The hit counter has the layout of the error counter: it counts the
+ * times each event notifier fired, at its error_counter_index, whether
+ * or not a notification was sent.
+ */
+static
+int lttng_ust_event_notifier_group_create_hit_counter(int event_notifier_group_objd,
+		void *owner, struct lttng_ust_abi_counter_conf *hit_counter_conf)
+{
+	const char *counter_transport_name;
+	struct lttng_event_notifier_group *event_notifier_group =
+		objd_private(event_notifier_group_objd);
+	struct lttng_counter *counter;
+	int counter_objd, ret;
+	struct lttng_counter_dimension dimensions[1];
+	size_t counter_len;
+
+	if (event_notifier_group->hit_counter)
+		return -EBUSY;
+
+	if (hit_counter_conf->number_dimensions != 1)
+		return -EINVAL;
+
+	counter_transport_name = event_notifier_group_counter_transport(hit_counter_conf);
+	if (!counter_transport_name)
+		return -EINVAL;
+
+	counter_objd = objd_alloc(NULL, &lttng_event_notifier_group_error_counter_ops, owner,
+		"event_notifier group hit counter");
+	if (counter_objd < 0) {
+		ret = counter_objd;
+		goto objd_error;
+	}
+
+	counter_len = hit_counter_conf->dimensions[0].size;
+	memset(dimensions, 0, sizeof(dimensions));
+	dimensions[0].size = counter_len;
+
+	counter = lttng_ust_counter_create(counter_transport_name, 1, dimensions);
+	if (!counter) {
+		ret = -EINVAL;
+		goto create_error;
+	}
+
+	event_notifier_group->hit_counter_len = counter_len;
+	/* Same publication scheme as the error counter. */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(event_notifier_group->hit_counter, counter);
+
+	counter->objd = counter_objd;
+	counter->event_notifier_group = event_notifier_group;	/* owner */
+
+	objd_set_private(counter_objd, counter);
+	/* The hit counter holds a reference on the event_notifier group. */
+	objd_ref(event_notifier_group->objd);
+
+	return counter_objd;
+
+create_error:
+	{
+		int err;
+
+		err = lttng_ust_abi_objd_unref(counter_objd, 1);
+		assert(!err);
+	}
+objd_error:
+	return ret;
+}
+
 static
 long lttng_event_notifier_group_cmd(int objd, unsigned int cmd, unsigned long arg,
 		union lttng_ust_abi_args *uargs, void *owner)
@@ -916,6 +1142,12 @@ long lttng_event_notifier_group_cmd(int objd, unsigned int cmd, unsigned long ar
 	{
 		struct lttng_ust_abi_counter_conf *counter_conf =
 			(struct lttng_ust_abi_counter_conf *) uargs->counter.counter_data;
+		if (counter_conf->histogram)
+			return lttng_ust_event_notifier_group_create_histogram_counter(
+					objd, owner, counter_conf);
+		if (counter_conf->hits)
+			return lttng_ust_event_notifier_group_create_hit_counter(
+					objd, owner, counter_conf);
 		return lttng_ust_event_notifier_group_create_error_counter(
 				objd, owner, counter_conf);
 	}
@@ -1126,6 +1358,17 @@ int lttng_abi_map_stream(int channel_objd, struct lttng_ust_abi_stream *info,
 	struct lttng_ust_channel_buffer *lttng_chan_buf = objd_private(channel_objd);
 	int ret;
 
+	if (uargs->stream.arena) {
+		/* Takes ownership of shm_fd when it maps the arena. */
+		ret = channel_handle_add_arena_stream(lttng_chan_buf->priv->rb_chan->handle,
+			&uargs->stream.shm_fd, uargs->stream.wakeup_fd,
+			info->stream_nr, info->len);
+		if (ret)
+			goto error_add_stream;
+		/* Take ownership of wakeup_fd. */
+		uargs->stream.wakeup_fd = -1;
+		return 0;
+	}
 	ret = channel_handle_add_stream(lttng_chan_buf->priv->rb_chan->handle,
 		uargs->stream.shm_fd, uargs->stream.wakeup_fd,
 		info->stream_nr, info->len);
@@ -1248,10 +1491,29 @@ long lttng_channel_cmd(int objd, unsigned int cmd, unsigned long arg,
 		}
 	}
 	case LTTNG_UST_ABI_CONTEXT:
-		return lttng_abi_add_context(objd,
-				(struct lttng_ust_abi_context *) arg, uargs,
+	{
+		struct lttng_ust_abi_context *context_param =
+			(struct lttng_ust_abi_context *) arg;
+
+		/*
+		 * Events recorded in per-cpu buffers are on the cpu found
+		 * in the packet context of their stream, unless streams
+		 * hold several cpus or records spilled from other cpus:
+		 * the cpu_id context field would only repeat it in each
+		 * event. Channels with fewer streams than cpus already
+		 * have it.
+		 */
+		if (context_param->ctx == LTTNG_UST_ABI_CONTEXT_CPU_ID
+				&& (lib_ring_buffer_streams_match_cpus(lttng_chan_buf->priv->rb_chan)
+					|| lttng_find_context(lttng_chan_buf->priv->ctx, "cpu_id"))) {
+			if (lttng_chan_buf->parent->session->priv->been_active)
+				return -EPERM;
+			return 0;
+		}
+		return lttng_abi_add_context(objd, context_param, uargs,
 				&lttng_chan_buf->priv->ctx,
 				lttng_chan_buf->parent->session);
+	}
 	case LTTNG_UST_ABI_ENABLE:
 		return lttng_channel_enable(lttng_chan_buf->parent);
 	case LTTNG_UST_ABI_DISABLE:
@@ -1299,6 +1561,8 @@ static const struct lttng_ust_abi_objd_ops lttng_channel_ops = {
  *		Attach a filter to an enabler.
  *	LTTNG_UST_ABI_EXCLUSION
  *		Attach exclusions to an enabler.
+ *	LTTNG_UST_ABI_FILTER_STATS
+ *		Get the filter evaluation counters of an enabler.
  */
 static
 long lttng_event_enabler_cmd(int objd, unsigned int cmd, unsigned long arg,
@@ -1330,6 +1594,9 @@ long lttng_event_enabler_cmd(int objd, unsigned int cmd, unsigned long arg,
 		return lttng_event_enabler_attach_exclusion(enabler,
 				(struct lttng_ust_excluder_node **) arg);
 	}
+	case LTTNG_UST_ABI_FILTER_STATS:
+		return lttng_event_enabler_filter_stats(enabler,
+				(struct lttng_ust_abi_filter_stats *) arg);
 	default:
 		return -EINVAL;
 	}
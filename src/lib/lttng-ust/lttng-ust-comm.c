@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <signal.h>
 #include <limits.h>
+#include <poll.h>
 #include <urcu/uatomic.h>
 #include <urcu/compiler.h>
 #include <lttng/urcu/urcu-ust.h>
@@ -53,6 +54,7 @@
 #include "lttng-ust-statedump.h"
 #include "common/clock.h"
 #include "common/getenv.h"
+#include "common/metrics.h"
 #include "lib/lttng-ust/events.h"
 #include "context-internal.h"
 #include "common/align.h"
@@ -76,6 +78,9 @@ static int initialized;
  *
  * ust_fork_mutex must never nest in ust_mutex.
  *
+ * ust_statedump_mutex must never nest in ust_mutex, and no other ust
+ * lock is taken while it is held.
+ *
  * ust_mutex_nest is a per-thread nesting counter, allowing the perf
  * counter lazy initialization called by events within the statedump,
  * which traces while the ust_mutex is held.
@@ -91,7 +96,7 @@ static pthread_mutex_t ust_mutex = PTHREAD_MUTEX_INITIALIZER;
 static DEFINE_URCU_TLS(int, ust_mutex_nest);
 
 /*
- * ust_exit_mutex protects thread_active variable wrt thread exit. It
+ * ust_exit_mutex protects ust_listener_active variable wrt thread exit. It
  * cannot be done by ust_mutex because pthread_cancel(), which takes an
  * internal libc lock, cannot nest within ust_mutex.
  *
@@ -107,6 +112,15 @@ static pthread_mutex_t ust_exit_mutex = PTHREAD_MUTEX_INITIALIZER;
  */
 static pthread_mutex_t ust_fork_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+/*
+ * ust_statedump_mutex protects the queue of pending statedumps handed
+ * from the listener thread to the statedump worker thread. It is only
+ * held to queue and dequeue requests, never across a statedump, and
+ * nests within none of the other ust mutexes.
+ */
+static pthread_mutex_t ust_statedump_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ust_statedump_cond = PTHREAD_COND_INITIALIZER;
+
 /* Should the ust comm thread quit ? */
 static int lttng_ust_comm_should_quit;
 
@@ -249,18 +263,23 @@ static int sem_count = sem_count_initial_value;
 static DEFINE_URCU_TLS(int, lttng_ust_nest_count);
 
 /*
- * Info about socket and associated listener thread.
+ * Info about socket and its connection state in the listener thread.
  */
 struct sock_info {
 	const char *name;
-	pthread_t ust_listener;	/* listener thread */
 	int root_handle;
 	int registration_done;
 	int allowed;
 	int global;
-	int thread_active;
+	int embedded;		/* Traced by the embedded consumer. */
+	/* Connection state, only used by the listener thread. */
+	int connected;
+	int connect_failed;
+	int has_waited;
+	uint64_t retry_time;	/* Don't reconnect before (CLOCK_MONOTONIC ns). */
 
 	char sock_path[PATH_MAX];
+	char notify_relay_path[PATH_MAX];	/* Empty unless relay enabled. */
 	int socket;
 	int notify_socket;
 
@@ -268,6 +287,7 @@ struct sock_info {
 	char *wait_shm_mmap;
 	/* Keep track of lazy state dump not performed yet. */
 	int statedump_pending;
+	int statedump_queued;	/* Protected by ust_statedump_mutex. */
 	int initial_statedump_done;
 	/* Keep procname for statedump */
 	char procname[LTTNG_UST_CONTEXT_PROCNAME_LEN];
@@ -281,7 +301,6 @@ static struct sock_info global_apps = {
 	.root_handle = -1,
 	.registration_done = 0,
 	.allowed = 0,
-	.thread_active = 0,
 
 	.sock_path = LTTNG_DEFAULT_RUNDIR "/" LTTNG_UST_SOCK_FILENAME,
 	.socket = -1,
@@ -302,7 +321,6 @@ static struct sock_info local_apps = {
 	.root_handle = -1,
 	.registration_done = 0,
 	.allowed = 0,	/* Check setuid bit first */
-	.thread_active = 0,
 
 	.socket = -1,
 	.notify_socket = -1,
@@ -312,6 +330,56 @@ static struct sock_info local_apps = {
 	.procname[0] = '\0'
 };
 
+/*
+ * Owner of the session traced to a local directory by the embedded
+ * consumer, without session daemon. It has no socket: the session
+ * objects are registered to the embedded consumer.
+ */
+static struct sock_info embedded_apps = {
+	.name = "embedded",
+	.embedded = 1,
+	.root_handle = -1,
+	.registration_done = 0,
+	.allowed = 0,
+
+	.socket = -1,
+	.notify_socket = -1,
+
+	.statedump_pending = 0,
+	.initial_statedump_done = 0,
+	.procname[0] = '\0'
+};
+
+/* Session daemons served by the listener thread. */
+static struct sock_info * const sock_infos[] = {
+	&global_apps,
+	&local_apps,
+};
+
+#define NR_SOCK_INFOS	LTTNG_ARRAY_SIZE(sock_infos)
+
+/*
+ * Single listener thread serving both session daemons. Protected by
+ * ust_exit_mutex wrt thread exit.
+ */
+static pthread_t ust_listener;
+static int ust_listener_active;
+
+/*
+ * Statedump worker thread, running the statedumps queued by the
+ * listener thread. Created by the listener thread on the first
+ * statedump request. Protected by ust_exit_mutex wrt thread exit.
+ */
+static pthread_t ust_statedump_worker;
+static int ust_statedump_worker_active;
+
+/*
+ * Niceness increment of the statedump worker thread. The statedump is
+ * background work which should not compete with the application
+ * threads.
+ */
+#define STATEDUMP_WORKER_NICE	5
+
 static int wait_poll_fallback;
 
 static const char *cmd_name_mapping[] = {
@@ -325,6 +393,8 @@ static const char *cmd_name_mapping[] = {
 	[ LTTNG_UST_ABI_TRACEPOINT_FIELD_LIST ] = "Create Tracepoint Field List",
 
 	[ LTTNG_UST_ABI_EVENT_NOTIFIER_GROUP_CREATE ] = "Create event notifier group",
+	[ LTTNG_UST_ABI_BATCH ] = "Batch",
+	[ LTTNG_UST_ABI_TRACEPOINT_SAMPLE ] = "Set Tracepoint Sampling Period",
 
 	/* Session FD commands */
 	[ LTTNG_UST_ABI_CHANNEL ] = "Create Channel",
@@ -333,6 +403,7 @@ static const char *cmd_name_mapping[] = {
 
 	/* Channel FD commands */
 	[ LTTNG_UST_ABI_STREAM ] = "Create Stream",
+	[ LTTNG_UST_ABI_STREAMS ] = "Create Streams",
 	[ LTTNG_UST_ABI_EVENT ] = "Create Event",
 
 	/* Event and Channel FD commands */
@@ -350,6 +421,7 @@ static const char *cmd_name_mapping[] = {
 	/* Event FD commands */
 	[ LTTNG_UST_ABI_FILTER ] = "Create Filter",
 	[ LTTNG_UST_ABI_EXCLUSION ] = "Add exclusions to event",
+	[ LTTNG_UST_ABI_FILTER_STATS ] = "Get Filter Statistics",
 
 	/* Event notifier group commands */
 	[ LTTNG_UST_ABI_EVENT_NOTIFIER_CREATE ] = "Create event notifier",
@@ -365,6 +437,16 @@ static const char *cmd_name_mapping[] = {
 static const char *str_timeout;
 static int got_timeout_env;
 
+/*
+ * Whether the constructor waits for the initial statedump, in addition
+ * to the "registration done" command. Cleared by
+ * LTTNG_UST_WITHOUT_STATEDUMP_WAIT.
+ */
+static int wait_initial_statedump = 1;
+
+/* Set by LTTNG_UST_NOTIFY_RELAY. */
+static int notify_relay;
+
 static char *get_map_shm(struct sock_info *sock_info);
 
 /*
@@ -415,6 +497,7 @@ void lttng_ust_alloc_tls(void)
 	lttng_nest_count_alloc_tls();
 	lttng_procname_alloc_tls();
 	lttng_ust_mutex_nest_alloc_tls();
+	lttng_event_notifier_notification_alloc_tls();
 	lttng_ust_perf_counter_alloc_tls();
 	lttng_ust_common_alloc_tls();
 	lttng_cgroup_ns_alloc_tls();
@@ -422,10 +505,9 @@ void lttng_ust_alloc_tls(void)
 	lttng_net_ns_alloc_tls();
 	lttng_time_ns_alloc_tls();
 	lttng_uts_ns_alloc_tls();
-	lttng_ust_ring_buffer_client_discard_alloc_tls();
-	lttng_ust_ring_buffer_client_discard_rt_alloc_tls();
-	lttng_ust_ring_buffer_client_overwrite_alloc_tls();
-	lttng_ust_ring_buffer_client_overwrite_rt_alloc_tls();
+	lttng_callstack_alloc_tls();
+	lttng_tracef_alloc_tls();
+	lttng_ust_ring_buffer_clients_alloc_tls();
 }
 
 /*
@@ -438,6 +520,11 @@ void lttng_ust_alloc_tls(void)
  * trace from signal handlers need to explicitly trigger the lazy
  * allocation of those variables for each thread before using them.
  * This can be triggered by calling lttng_ust_init_thread().
+ *
+ * When configured with --enable-initial-exec-tls, the tracer libraries
+ * are built with the IE model instead: their TLS is part of the static
+ * TLS block, accessed without calling __tls_get_addr, and this lazy
+ * allocation is a no-op.
  */
 void lttng_ust_init_thread(void)
 {
@@ -447,6 +534,8 @@ void lttng_ust_init_thread(void)
 	 * this thread attempts to use them.
 	 */
 	lttng_ust_alloc_tls();
+	lttng_ust_sigsafe_init_thread();
+	lttng_perf_counter_init_thread();
 }
 
 int lttng_get_notify_socket(void *owner)
@@ -493,6 +582,10 @@ int setup_global_apps(void)
 	}
 
 	global_apps.allowed = 1;
+	if (notify_relay)
+		snprintf(global_apps.notify_relay_path, PATH_MAX, "%s/%s",
+			LTTNG_DEFAULT_RUNDIR,
+			LTTNG_UST_NOTIFY_RELAY_SOCK_FILENAME);
 	lttng_pthread_getname_np(global_apps.procname, LTTNG_UST_CONTEXT_PROCNAME_LEN);
 error:
 	return ret;
@@ -527,6 +620,11 @@ int setup_local_apps(void)
 		home_dir,
 		LTTNG_DEFAULT_HOME_RUNDIR,
 		LTTNG_UST_SOCK_FILENAME);
+	if (notify_relay)
+		snprintf(local_apps.notify_relay_path, PATH_MAX, "%s/%s/%s",
+			home_dir,
+			LTTNG_DEFAULT_HOME_RUNDIR,
+			LTTNG_UST_NOTIFY_RELAY_SOCK_FILENAME);
 	snprintf(local_apps.wait_shm_path, PATH_MAX, "/%s-%u",
 		LTTNG_UST_WAIT_FILENAME,
 		uid);
@@ -630,6 +728,31 @@ void get_allow_blocking(void)
 	}
 }
 
+static
+void get_without_statedump_wait(void)
+{
+	if (lttng_ust_getenv("LTTNG_UST_WITHOUT_STATEDUMP_WAIT")) {
+		DBG("%s environment variable is set",
+			"LTTNG_UST_WITHOUT_STATEDUMP_WAIT");
+		wait_initial_statedump = 0;
+	}
+}
+
+/*
+ * Connect the notify socket through the per-host notification relay
+ * when one is listening, so the session daemon serves one connection
+ * per host rather than one per application.
+ */
+static
+void get_notify_relay(void)
+{
+	if (lttng_ust_getenv("LTTNG_UST_NOTIFY_RELAY")) {
+		DBG("%s environment variable is set",
+			"LTTNG_UST_NOTIFY_RELAY");
+		notify_relay = 1;
+	}
+}
+
 static
 int register_to_sessiond(int socket, enum lttng_ust_ctl_socket_type type,
 		const char *procname)
@@ -693,7 +816,12 @@ int handle_register_done(struct sock_info *sock_info)
 	sock_info->registration_done = 1;
 
 	decrement_sem_count(1);
-	if (!sock_info->statedump_pending) {
+	/*
+	 * Events are enabled once registration is done: the initial
+	 * statedump can complete after the constructor returns without
+	 * losing early events.
+	 */
+	if (!sock_info->statedump_pending || !wait_initial_statedump) {
 		sock_info->initial_statedump_done = 1;
 		decrement_sem_count(1);
 	}
@@ -715,39 +843,154 @@ int handle_register_failed(struct sock_info *sock_info)
 }
 
 /*
- * Only execute pending statedump after the constructor semaphore has
- * been posted by the current listener thread. This means statedump will
- * only be performed after the "registration done" command is received
- * from this thread's session daemon.
+ * Only execute pending statedump after the "registration done" command
+ * has been received from every session daemon, or their connection
+ * failed. The statedumps are retried by the listener thread after each
+ * command.
  *
  * This ensures we don't run into deadlock issues with the dynamic
  * loader mutex, which is held while the constructor is called and
  * waiting on the constructor semaphore. All operations requiring this
  * dynamic loader lock need to be postponed using this mechanism.
  *
- * In a scenario with two session daemons connected to the application,
- * it is possible that the first listener thread which receives the
- * registration done command issues its statedump while the dynamic
- * loader lock is still held by the application constructor waiting on
- * the semaphore. It will however be allowed to proceed when the
- * second session daemon sends the registration done command to the
- * second listener thread. This situation therefore does not produce
- * a deadlock.
+ * The listener thread serves both session daemons. A statedump blocked
+ * on the dynamic loader lock would keep it from receiving the
+ * "registration done" command from the other session daemon, which the
+ * constructor waits for. Postponing the statedump until both session
+ * daemons are done with registration avoids this.
+ *
+ * The statedump itself is handed to the statedump worker thread, so the
+ * listener keeps serving commands while it runs. The worker is created
+ * on the first statedump request, and the statedump is only performed by
+ * the listener thread if the worker could not be created.
  */
 static
-void handle_pending_statedump(struct sock_info *sock_info)
+void run_pending_statedump(struct sock_info *sock_info)
+{
+	pthread_mutex_lock(&ust_fork_mutex);
+	lttng_handle_pending_statedump(sock_info);
+	pthread_mutex_unlock(&ust_fork_mutex);
+
+	if (!sock_info->initial_statedump_done) {
+		sock_info->initial_statedump_done = 1;
+		decrement_sem_count(1);
+	}
+}
+
+static
+struct sock_info *dequeue_pending_statedump(void)
 {
-	if (sock_info->registration_done && sock_info->statedump_pending) {
-		sock_info->statedump_pending = 0;
-		pthread_mutex_lock(&ust_fork_mutex);
-		lttng_handle_pending_statedump(sock_info);
-		pthread_mutex_unlock(&ust_fork_mutex);
+	unsigned int i;
 
-		if (!sock_info->initial_statedump_done) {
-			sock_info->initial_statedump_done = 1;
-			decrement_sem_count(1);
+	for (i = 0; i < NR_SOCK_INFOS; i++) {
+		if (sock_infos[i]->statedump_queued) {
+			sock_infos[i]->statedump_queued = 0;
+			return sock_infos[i];
 		}
 	}
+	return NULL;
+}
+
+static
+void statedump_worker_unlock(void *arg __attribute__((unused)))
+{
+	pthread_mutex_unlock(&ust_statedump_mutex);
+}
+
+/*
+ * The statedump worker is only cancelled while waiting for a request:
+ * a statedump holds the ust_fork_mutex and possibly the dynamic loader
+ * lock, which must not be left locked behind.
+ */
+static
+void *ust_statedump_worker_thread(void *arg __attribute__((unused)))
+{
+	int oldstate;
+
+	lttng_ust_alloc_tls();
+#ifdef __linux__
+	/* On Linux, the niceness is a per-thread attribute. */
+	errno = 0;
+	if (nice(STATEDUMP_WORKER_NICE) == -1 && errno)
+		DBG("Unable to lower the statedump worker priority: %s",
+			strerror(errno));
+#endif
+	for (;;) {
+		struct sock_info *sock_info;
+
+		pthread_mutex_lock(&ust_statedump_mutex);
+		pthread_cleanup_push(statedump_worker_unlock, NULL);
+		while (!(sock_info = dequeue_pending_statedump()))
+			pthread_cond_wait(&ust_statedump_cond, &ust_statedump_mutex);
+		pthread_cleanup_pop(1);
+
+		(void) pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldstate);
+		run_pending_statedump(sock_info);
+		(void) pthread_setcancelstate(oldstate, NULL);
+	}
+	return NULL;
+}
+
+/*
+ * Called by the listener thread with ust_exit_mutex held. The worker
+ * inherits the signal mask of the listener thread, which blocks all
+ * signals.
+ */
+static
+void start_statedump_worker(void)
+{
+	pthread_attr_t thread_attr;
+	int ret;
+
+	ret = pthread_attr_init(&thread_attr);
+	if (ret) {
+		ERR("pthread_attr_init: %s", strerror(ret));
+		return;
+	}
+	ret = pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+	if (ret) {
+		ERR("pthread_attr_setdetachstate: %s", strerror(ret));
+	}
+	ret = pthread_create(&ust_statedump_worker, &thread_attr,
+			ust_statedump_worker_thread, NULL);
+	if (ret) {
+		ERR("pthread_create: %s", strerror(ret));
+	} else {
+		ust_statedump_worker_active = 1;
+	}
+	ret = pthread_attr_destroy(&thread_attr);
+	if (ret) {
+		ERR("pthread_attr_destroy: %s", strerror(ret));
+	}
+}
+
+static
+void handle_pending_statedump(struct sock_info *sock_info)
+{
+	unsigned int i;
+	int worker_active;
+
+	if (!sock_info->registration_done || !sock_info->statedump_pending)
+		return;
+	for (i = 0; i < NR_SOCK_INFOS; i++) {
+		if (!sock_infos[i]->registration_done)
+			return;
+	}
+	sock_info->statedump_pending = 0;
+
+	pthread_mutex_lock(&ust_exit_mutex);
+	if (!ust_statedump_worker_active && !lttng_ust_comm_should_quit)
+		start_statedump_worker();
+	worker_active = ust_statedump_worker_active;
+	pthread_mutex_unlock(&ust_exit_mutex);
+	if (!worker_active) {
+		run_pending_statedump(sock_info);
+		return;
+	}
+	pthread_mutex_lock(&ust_statedump_mutex);
+	sock_info->statedump_queued = 1;
+	pthread_cond_signal(&ust_statedump_cond);
+	pthread_mutex_unlock(&ust_statedump_mutex);
 }
 
 static inline
@@ -910,6 +1153,266 @@ void prepare_cmd_reply(struct ustcomm_ust_reply *lur, uint32_t handle, uint32_t
 	}
 }
 
+/*
+ * Commands which can be part of a LTTNG_UST_ABI_BATCH command: those
+ * without additional payload, neither before nor after their reply.
+ */
+static
+bool batch_cmd_allowed(const struct ustcomm_ust_msg *lum)
+{
+	switch (lum->cmd) {
+	case LTTNG_UST_ABI_RELEASE:
+	case LTTNG_UST_ABI_SESSION:
+	case LTTNG_UST_ABI_WAIT_QUIESCENT:
+	case LTTNG_UST_ABI_SESSION_START:
+	case LTTNG_UST_ABI_SESSION_STOP:
+	case LTTNG_UST_ABI_SESSION_STATEDUMP:
+	case LTTNG_UST_ABI_EVENT:
+	case LTTNG_UST_ABI_FLUSH_BUFFER:
+	case LTTNG_UST_ABI_ENABLE:
+	case LTTNG_UST_ABI_DISABLE:
+		return true;
+	case LTTNG_UST_ABI_CONTEXT:
+		return lum->u.context.ctx != LTTNG_UST_ABI_CONTEXT_APP_CONTEXT;
+	default:
+		return false;
+	}
+}
+
+static
+int handle_batch_recv(struct sock_info *sock_info,
+		int sock, struct ustcomm_ust_msg *lum,
+		struct ustcomm_ust_msg **_msgs)
+{
+	struct ustcomm_ust_msg *msgs;
+	uint32_t count = lum->u.batch.count;
+	ssize_t len;
+
+	*_msgs = NULL;
+	if (count == 0)
+		return 0;
+	if (count > USTCOMM_BATCH_MAX_CMDS) {
+		ERR("Too many commands in batch: %u", count);
+		return -EINVAL;
+	}
+	msgs = zmalloc(count * sizeof(*msgs));
+	if (!msgs)
+		return -ENOMEM;
+	len = ustcomm_recv_unix_sock(sock, msgs, count * sizeof(*msgs));
+	switch (len) {
+	case 0:	/* orderly shutdown */
+		free(msgs);
+		return -EPIPE;
+	default:
+		if (len == count * sizeof(*msgs)) {
+			DBG("batch commands received");
+			break;
+		} else if (len < 0) {
+			DBG("Receive failed from lttng-sessiond with errno %d", (int) -len);
+			if (len == -ECONNRESET)
+				ERR("%s remote end closed connection", sock_info->name);
+			free(msgs);
+			return len;
+		} else {
+			DBG("incorrect batch message size: %zd", len);
+			free(msgs);
+			return -EINVAL;
+		}
+	}
+	*_msgs = msgs;
+	return 0;
+}
+
+/*
+ * Execute the @count commands of a batch in order, each getting its own
+ * reply: a failed command does not prevent the next ones. The enabler
+ * changes of the batch are synced once, after its last command. Called
+ * with the UST lock held.
+ */
+static
+int handle_batch(struct sock_info *sock_info,
+		struct ustcomm_ust_msg *msgs, uint32_t count,
+		struct ustcomm_ust_reply **_replies)
+{
+	struct ustcomm_ust_reply *replies;
+	uint32_t i;
+
+	*_replies = NULL;
+	if (count == 0)
+		return 0;
+	replies = zmalloc(count * sizeof(*replies));
+	if (!replies)
+		return -ENOMEM;
+	lttng_session_enabler_sync_batch_begin();
+	for (i = 0; i < count; i++) {
+		struct ustcomm_ust_msg *sub = &msgs[i];
+		const struct lttng_ust_abi_objd_ops *ops;
+		union lttng_ust_abi_args args;
+		int ret;
+
+		print_cmd(sub->cmd, sub->handle);
+		memset(&args, 0, sizeof(args));
+		if (!batch_cmd_allowed(sub)) {
+			ret = -EINVAL;
+		} else if (sub->cmd == LTTNG_UST_ABI_RELEASE) {
+			if (sub->handle == LTTNG_UST_ABI_ROOT_HANDLE)
+				ret = -EPERM;
+			else
+				ret = lttng_ust_abi_objd_unref(sub->handle, 1);
+		} else {
+			ops = lttng_ust_abi_objd_ops(sub->handle);
+			if (!ops)
+				ret = -ENOENT;
+			else if (ops->cmd)
+				ret = ops->cmd(sub->handle, sub->cmd,
+						(unsigned long) &sub->u,
+						&args, sock_info);
+			else
+				ret = -ENOSYS;
+		}
+		prepare_cmd_reply(&replies[i], sub->handle, sub->cmd, ret);
+	}
+	lttng_session_enabler_sync_batch_end();
+	*_replies = replies;
+	return 0;
+}
+
+static
+int handle_streams_recv(struct sock_info *sock_info,
+		int sock, struct ustcomm_ust_msg *lum,
+		struct lttng_ust_abi_stream **_streams, int **_fds)
+{
+	struct lttng_ust_abi_stream *streams;
+	uint32_t count = lum->u.streams.count;
+	ssize_t len;
+	int *fds;
+	int ret;
+
+	*_streams = NULL;
+	*_fds = NULL;
+	if (count == 0)
+		return 0;
+	if (count > USTCOMM_STREAMS_MAX) {
+		ERR("Too many streams: %u", count);
+		return -EINVAL;
+	}
+	streams = zmalloc(count * sizeof(*streams));
+	if (!streams)
+		return -ENOMEM;
+	fds = zmalloc(2 * count * sizeof(*fds));
+	if (!fds) {
+		ret = -ENOMEM;
+		goto error;
+	}
+	len = ustcomm_recv_unix_sock(sock, streams, count * sizeof(*streams));
+	switch (len) {
+	case 0:	/* orderly shutdown */
+		ret = -EPIPE;
+		goto error;
+	default:
+		if (len == count * sizeof(*streams)) {
+			DBG("streams received");
+			break;
+		} else if (len < 0) {
+			DBG("Receive failed from lttng-sessiond with errno %d", (int) -len);
+			if (len == -ECONNRESET)
+				ERR("%s remote end closed connection", sock_info->name);
+			ret = len;
+			goto error;
+		} else {
+			DBG("incorrect streams message size: %zd", len);
+			ret = -EINVAL;
+			goto error;
+		}
+	}
+	/*
+	 * Receive the shm_fd and wakeup_fd of each stream, or the arena
+	 * shm_fd followed by the wakeup_fd of each stream.
+	 */
+	ret = ustcomm_recv_streams_fds_from_sessiond(sock, fds,
+			lum->u.streams.arena ? 1 + count : 2 * count);
+	if (ret)
+		goto error;
+	*_streams = streams;
+	*_fds = fds;
+	return 0;
+
+error:
+	free(fds);
+	free(streams);
+	return ret;
+}
+
+/*
+ * Map the @count streams of a LTTNG_UST_ABI_STREAMS command, in order,
+ * stopping at the first failure. The fds left unused by the mapping are
+ * closed. Called with the UST lock held.
+ */
+static
+int handle_streams(struct sock_info *sock_info, int handle,
+		const struct lttng_ust_abi_objd_ops *ops,
+		struct lttng_ust_abi_stream *streams, int *fds,
+		uint32_t count, bool arena)
+{
+	int arena_fd = -1, close_ret;
+	uint32_t i;
+	int ret = 0;
+
+	if (arena && count) {
+		arena_fd = fds[0];
+		fds[0] = -1;
+		fds++;
+	}
+	for (i = 0; i < count; i++) {
+		union lttng_ust_abi_args args;
+
+		memset(&args, 0, sizeof(args));
+		if (arena) {
+			args.stream.shm_fd = arena_fd;
+			args.stream.wakeup_fd = fds[i];
+			args.stream.arena = 1;
+			fds[i] = -1;
+		} else {
+			args.stream.shm_fd = fds[2 * i];
+			args.stream.wakeup_fd = fds[2 * i + 1];
+			fds[2 * i] = fds[2 * i + 1] = -1;
+		}
+		if (ret >= 0) {
+			if (ops->cmd)
+				ret = ops->cmd(handle, LTTNG_UST_ABI_STREAM,
+						(unsigned long) &streams[i],
+						&args, sock_info);
+			else
+				ret = -ENOSYS;
+		}
+		if (arena) {
+			/* Unset once the arena is mapped by the channel. */
+			arena_fd = args.stream.shm_fd;
+		} else if (args.stream.shm_fd >= 0) {
+			lttng_ust_lock_fd_tracker();
+			close_ret = close(args.stream.shm_fd);
+			lttng_ust_unlock_fd_tracker();
+			if (close_ret)
+				PERROR("close");
+		}
+		if (args.stream.wakeup_fd >= 0) {
+			lttng_ust_lock_fd_tracker();
+			close_ret = close(args.stream.wakeup_fd);
+			lttng_ust_unlock_fd_tracker();
+			if (close_ret)
+				PERROR("close");
+		}
+	}
+	if (arena_fd >= 0) {
+		lttng_ust_lock_fd_tracker();
+		close_ret = close(arena_fd);
+		lttng_ust_unlock_fd_tracker();
+		if (close_ret)
+			PERROR("close");
+	}
+	return ret < 0 ? ret : 0;
+}
+
 static
 int handle_message(struct sock_info *sock_info,
 		int sock, struct ustcomm_ust_msg *lum)
@@ -919,6 +1422,10 @@ int handle_message(struct sock_info *sock_info,
 	struct ustcomm_ust_reply lur;
 	union lttng_ust_abi_args args;
 	char ctxstr[LTTNG_UST_ABI_SYM_NAME_LEN];	/* App context string. */
+	struct ustcomm_ust_msg *batch_msgs = NULL;
+	struct ustcomm_ust_reply *batch_replies = NULL;
+	struct lttng_ust_abi_stream *streams = NULL;
+	int *stream_fds = NULL;
 	ssize_t len;
 
 	memset(&lur, 0, sizeof(lur));
@@ -940,6 +1447,8 @@ int handle_message(struct sock_info *sock_info,
 	case LTTNG_UST_ABI_CHANNEL:
 	case LTTNG_UST_ABI_STREAM:
 	case LTTNG_UST_ABI_CONTEXT:
+	case LTTNG_UST_ABI_BATCH:
+	case LTTNG_UST_ABI_STREAMS:
 		/*
 		 * Those commands send additional payload after struct
 		 * ustcomm_ust_msg, which makes it pretty much impossible to
@@ -999,6 +1508,16 @@ int handle_message(struct sock_info *sock_info,
 		if (ret)
 			goto error;
 		break;
+	case LTTNG_UST_ABI_BATCH:
+		ret = handle_batch_recv(sock_info, sock, lum, &batch_msgs);
+		if (ret)
+			goto error;
+		if (lum->handle == LTTNG_UST_ABI_ROOT_HANDLE)
+			ret = handle_batch(sock_info, batch_msgs,
+					lum->u.batch.count, &batch_replies);
+		else
+			ret = -EINVAL;
+		break;
 	case LTTNG_UST_ABI_EXCLUSION:
 	{
 		/* Receive exclusion names */
@@ -1193,6 +1712,15 @@ int handle_message(struct sock_info *sock_info,
 		}
 		break;
 	}
+	case LTTNG_UST_ABI_STREAMS:
+		ret = handle_streams_recv(sock_info, sock, lum,
+				&streams, &stream_fds);
+		if (ret)
+			goto error;
+		ret = handle_streams(sock_info, lum->handle, ops,
+				streams, stream_fds, lum->u.streams.count,
+				lum->u.streams.arena);
+		break;
 	case LTTNG_UST_ABI_CONTEXT:
 		switch (lum->u.context.ctx) {
 		case LTTNG_UST_ABI_CONTEXT_APP_CONTEXT:
@@ -1404,6 +1932,9 @@ int handle_message(struct sock_info *sock_info,
 		case LTTNG_UST_ABI_TRACER_VERSION:
 			lur.u.version = lum->u.version;
 			break;
+		case LTTNG_UST_ABI_FILTER_STATS:
+			lur.u.filter_stats = lum->u.filter_stats;
+			break;
 		case LTTNG_UST_ABI_TRACEPOINT_LIST_GET:
 			memcpy(&lur.u.tracepoint, &lum->u.tracepoint, sizeof(lur.u.tracepoint));
 			break;
@@ -1449,46 +1980,56 @@ int handle_message(struct sock_info *sock_info,
 				ret = -EINVAL;
 				goto error;
 			}
+			break;
+		case LTTNG_UST_ABI_BATCH:
+			/* Send the reply of each command of the batch. */
+			if (!lum->u.batch.count)
+				break;
+			len = ustcomm_send_unix_sock(sock, batch_replies,
+				lum->u.batch.count * sizeof(*batch_replies));
+			if (len < 0) {
+				ret = len;
+				goto error;
+			}
+			if (len != lum->u.batch.count * sizeof(*batch_replies)) {
+				ret = -EINVAL;
+				goto error;
+			}
+			break;
 		}
 	}
 
 error:
 	ust_unlock();
+	free(batch_replies);
+	free(batch_msgs);
+	free(stream_fds);
+	free(streams);
 
 	return ret;
 }
 
+/*
+ * Close the session daemon connection of a forked child, where the
+ * listener thread does not exist anymore.
+ */
 static
-void cleanup_sock_info(struct sock_info *sock_info, int exiting)
+void reset_sock_info(struct sock_info *sock_info)
 {
 	int ret;
 
-	if (sock_info->root_handle != -1) {
-		ret = lttng_ust_abi_objd_unref(sock_info->root_handle, 1);
+	sock_info->registration_done = 0;
+	sock_info->statedump_queued = 0;
+	sock_info->initial_statedump_done = 0;
+	sock_info->connected = 0;
+	sock_info->connect_failed = 0;
+	sock_info->has_waited = 0;
+	sock_info->retry_time = 0;
+
+	if (sock_info->socket != -1) {
+		ret = ustcomm_close_unix_sock(sock_info->socket);
 		if (ret) {
-			ERR("Error unref root handle");
-		}
-		sock_info->root_handle = -1;
-	}
-
-
-	/*
-	 * wait_shm_mmap, socket and notify socket are used by listener
-	 * threads outside of the ust lock, so we cannot tear them down
-	 * ourselves, because we cannot join on these threads. Leave
-	 * responsibility of cleaning up these resources to the OS
-	 * process exit.
-	 */
-	if (exiting)
-		return;
-
-	sock_info->registration_done = 0;
-	sock_info->initial_statedump_done = 0;
-
-	if (sock_info->socket != -1) {
-		ret = ustcomm_close_unix_sock(sock_info->socket);
-		if (ret) {
-			ERR("Error closing ust cmd socket");
+			ERR("Error closing ust cmd socket");
 		}
 		sock_info->socket = -1;
 	}
@@ -1518,6 +2059,33 @@ void cleanup_sock_info(struct sock_info *sock_info, int exiting)
 	}
 }
 
+static
+void cleanup_sock_info(struct sock_info *sock_info, int exiting)
+{
+	int ret;
+
+	if (sock_info->root_handle != -1) {
+		ret = lttng_ust_abi_objd_unref(sock_info->root_handle, 1);
+		if (ret) {
+			ERR("Error unref root handle");
+		}
+		sock_info->root_handle = -1;
+	}
+
+
+	/*
+	 * wait_shm_mmap, socket and notify socket are used by the listener
+	 * thread outside of the ust lock, so we cannot tear them down
+	 * ourselves, because we cannot join on this thread. Leave
+	 * responsibility of cleaning up these resources to the OS
+	 * process exit.
+	 */
+	if (exiting)
+		return;
+
+	reset_sock_info(sock_info);
+}
+
 /*
  * Using fork to set umask in the child process (not multi-thread safe).
  * We deal with the shm_open vs ftruncate race (happening when the
@@ -1741,101 +2309,75 @@ error:
 	return NULL;
 }
 
-static
-void wait_for_sessiond(struct sock_info *sock_info)
-{
-	/* Use ust_lock to check if we should quit. */
-	if (ust_lock()) {
-		goto quit;
-	}
-	if (wait_poll_fallback) {
-		goto error;
-	}
-	ust_unlock();
+/*
+ * Period at which the listener thread checks whether a session daemon
+ * became available, when it cannot block waiting for its wait shm
+ * futex: while it also listens to the other session daemon, or when
+ * the kernel cannot wait on both futexes at once.
+ */
+#define LISTENER_WAIT_POLL_MS		5000
 
-	assert(sock_info->wait_shm_mmap);
+/* Delay before reconnecting after a failure / wait / failure sequence. */
+#define LISTENER_RETRY_DELAY_MS		5000
 
-	DBG("Waiting for %s apps sessiond", sock_info->name);
-	/* Wait for futex wakeup */
-	if (uatomic_read((int32_t *) sock_info->wait_shm_mmap))
-		goto end_wait;
-
-	while (lttng_ust_futex_async((int32_t *) sock_info->wait_shm_mmap,
-			FUTEX_WAIT, 0, NULL, NULL, 0)) {
-		switch (errno) {
-		case EWOULDBLOCK:
-			/* Value already changed. */
-			goto end_wait;
-		case EINTR:
-			/* Retry if interrupted by signal. */
-			break;	/* Get out of switch. */
-		case EFAULT:
-			wait_poll_fallback = 1;
-			DBG(
-"Linux kernels 2.6.33 to 3.0 (with the exception of stable versions) "
-"do not support FUTEX_WAKE on read-only memory mappings correctly. "
-"Please upgrade your kernel "
-"(fix is commit 9ea71503a8ed9184d2d0b8ccc4d269d05f7940ae in Linux kernel "
-"mainline). LTTng-UST will use polling mode fallback.");
-			if (lttng_ust_logging_debug_enabled())
-				PERROR("futex");
-			goto end_wait;
-		}
-	}
-end_wait:
-	return;
+#define LISTENER_NSEC_PER_MSEC		1000000ULL
 
-quit:
-	ust_unlock();
-	return;
+static
+uint64_t listener_now(void)
+{
+	struct timespec ts;
 
-error:
-	ust_unlock();
-	return;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
 /*
- * This thread does not allocate any resource, except within
- * handle_message, within mutex protection. This mutex protects against
- * fork and exit.
- * The other moment it allocates resources is at socket connection, which
- * is also protected by the mutex.
+ * The session daemon sets its wait shm futex when it starts. Always
+ * try to connect in polling mode fallback.
  */
 static
-void *ust_listener_thread(void *arg)
+bool sessiond_available(struct sock_info *sock_info)
 {
-	struct sock_info *sock_info = arg;
-	int sock, ret, prev_connect_failed = 0, has_waited = 0, fd;
-	long timeout;
-
-	lttng_ust_alloc_tls();
-	/*
-	 * If available, add '-ust' to the end of this thread's
-	 * process name
-	 */
-	ret = lttng_ust_setustprocname();
-	if (ret) {
-		ERR("Unable to set UST process name");
-	}
+	assert(sock_info->wait_shm_mmap);
+	return wait_poll_fallback
+		|| uatomic_read((int32_t *) sock_info->wait_shm_mmap);
+}
 
-	/* Restart trying to connect to the session daemon */
-restart:
-	if (prev_connect_failed) {
-		/* Wait for sessiond availability with pipe */
-		wait_for_sessiond(sock_info);
-		if (has_waited) {
-			has_waited = 0;
-			/*
-			 * Sleep for 5 seconds before retrying after a
-			 * sequence of failure / wait / failure. This
-			 * deals with a killed or broken session daemon.
-			 */
-			sleep(5);
+/*
+ * After a failed connection, wait for the session daemon to be
+ * available before reconnecting. Wait 5 seconds before reconnecting
+ * after a sequence of failure / wait / failure. This deals with a
+ * killed or broken session daemon.
+ */
+static
+bool listener_should_connect(struct sock_info *sock_info, uint64_t now)
+{
+	if (sock_info->connect_failed) {
+		if (!sessiond_available(sock_info))
+			return false;
+		if (sock_info->has_waited) {
+			sock_info->has_waited = 0;
+			sock_info->retry_time = now
+				+ LISTENER_RETRY_DELAY_MS * LISTENER_NSEC_PER_MSEC;
 		} else {
-			has_waited = 1;
+			sock_info->has_waited = 1;
 		}
-		prev_connect_failed = 0;
+		sock_info->connect_failed = 0;
 	}
+	return now >= sock_info->retry_time;
+}
+
+/*
+ * Connect and register the command and notify sockets to the session
+ * daemon. Returns 0 on success, 1 if the connection failed and is
+ * retried later, or -1 if the listener thread should quit.
+ */
+static
+int listener_connect(struct sock_info *sock_info)
+{
+	int ret, fd;
+	long timeout;
 
 	if (ust_lock()) {
 		goto quit;
@@ -1875,16 +2417,7 @@ restart:
 	if (ret < 0) {
 		lttng_ust_unlock_fd_tracker();
 		DBG("Info: sessiond not accepting connections to %s apps socket", sock_info->name);
-		prev_connect_failed = 1;
-
-		/*
-		 * If we cannot find the sessiond daemon, don't delay
-		 * constructor execution.
-		 */
-		ret = handle_register_failed(sock_info);
-		assert(!ret);
-		ust_unlock();
-		goto restart;
+		goto connect_failed;
 	}
 	fd = ret;
 	ret = lttng_ust_add_fd_to_tracker(fd);
@@ -1895,7 +2428,6 @@ restart:
 		}
 		ret = -1;
 		lttng_ust_unlock_fd_tracker();
-		ust_unlock();
 		goto quit;
 	}
 
@@ -1913,7 +2445,7 @@ restart:
 	}
 
 	/*
-	 * Create only one root handle per listener thread for the whole
+	 * Create only one root handle per session daemon for the whole
 	 * process lifetime, so we ensure we get ID which is statically
 	 * assigned to the root handle.
 	 */
@@ -1931,15 +2463,7 @@ restart:
 	if (ret < 0) {
 		ERR("Error registering to %s ust cmd socket",
 			sock_info->name);
-		prev_connect_failed = 1;
-		/*
-		 * If we cannot register to the sessiond daemon, don't
-		 * delay constructor execution.
-		 */
-		ret = handle_register_failed(sock_info);
-		assert(!ret);
-		ust_unlock();
-		goto restart;
+		goto connect_failed;
 	}
 
 	ust_unlock();
@@ -1952,23 +2476,22 @@ restart:
 		goto quit;
 	}
 
-	/* Connect notify socket */
+	/* Connect notify socket, through the relay if it is listening. */
 	lttng_ust_lock_fd_tracker();
-	ret = ustcomm_connect_unix_sock(sock_info->sock_path,
-		get_connect_sock_timeout());
+	ret = -1;
+	if (sock_info->notify_relay_path[0]) {
+		ret = ustcomm_connect_unix_sock(sock_info->notify_relay_path,
+			get_connect_sock_timeout());
+		if (ret < 0)
+			DBG("Info: notify relay not accepting connections to %s apps socket", sock_info->name);
+	}
+	if (ret < 0)
+		ret = ustcomm_connect_unix_sock(sock_info->sock_path,
+			get_connect_sock_timeout());
 	if (ret < 0) {
 		lttng_ust_unlock_fd_tracker();
 		DBG("Info: sessiond not accepting connections to %s apps socket", sock_info->name);
-		prev_connect_failed = 1;
-
-		/*
-		 * If we cannot find the sessiond daemon, don't delay
-		 * constructor execution.
-		 */
-		ret = handle_register_failed(sock_info);
-		assert(!ret);
-		ust_unlock();
-		goto restart;
+		goto connect_failed;
 	}
 
 	fd = ret;
@@ -1980,7 +2503,6 @@ restart:
 		}
 		ret = -1;
 		lttng_ust_unlock_fd_tracker();
-		ust_unlock();
 		goto quit;
 	}
 
@@ -2024,7 +2546,53 @@ restart:
 	if (ret < 0) {
 		ERR("Error registering to %s ust notify socket",
 			sock_info->name);
-		prev_connect_failed = 1;
+		goto connect_failed;
+	}
+	sock_info->connected = 1;
+	ust_unlock();
+	return 0;
+
+connect_failed:
+	sock_info->connect_failed = 1;
+	/*
+	 * If we cannot connect or register to the session daemon, don't
+	 * delay constructor execution.
+	 */
+	ret = handle_register_failed(sock_info);
+	assert(!ret);
+	ust_unlock();
+	return 1;
+
+quit:
+	ust_unlock();
+	return -1;
+}
+
+/*
+ * Receive and handle one command from the session daemon. Returns 0 on
+ * success, 1 if the connection is closed, or -1 if the listener thread
+ * should quit.
+ */
+static
+int listener_handle_cmd(struct sock_info *sock_info)
+{
+	struct ustcomm_ust_msg lum;
+	ssize_t len;
+	int ret;
+
+	len = ustcomm_recv_unix_sock(sock_info->socket, &lum, sizeof(lum));
+	switch (len) {
+	case 0:	/* orderly shutdown */
+		DBG("%s lttng-sessiond has performed an orderly shutdown", sock_info->name);
+		if (ust_lock()) {
+			goto quit;
+		}
+		/*
+		 * Either sessiond has shutdown or refused us by closing the socket.
+		 * In either case, we don't want to delay construction execution,
+		 * and we need to wait before retry.
+		 */
+		sock_info->connect_failed = 1;
 		/*
 		 * If we cannot register to the sessiond daemon, don't
 		 * delay constructor execution.
@@ -2032,82 +2600,257 @@ restart:
 		ret = handle_register_failed(sock_info);
 		assert(!ret);
 		ust_unlock();
-		goto restart;
-	}
-	sock = sock_info->socket;
-
-	ust_unlock();
-
-	for (;;) {
-		ssize_t len;
-		struct ustcomm_ust_msg lum;
-
-		len = ustcomm_recv_unix_sock(sock, &lum, sizeof(lum));
-		switch (len) {
-		case 0:	/* orderly shutdown */
-			DBG("%s lttng-sessiond has performed an orderly shutdown", sock_info->name);
-			if (ust_lock()) {
-				goto quit;
-			}
-			/*
-			 * Either sessiond has shutdown or refused us by closing the socket.
-			 * In either case, we don't want to delay construction execution,
-			 * and we need to wait before retry.
-			 */
-			prev_connect_failed = 1;
+		goto end;
+	case sizeof(lum):
+	{
+		uint64_t start = 0;
+
+		print_cmd(lum.cmd, lum.handle);
+		if (lttng_ust_metrics_enabled())
+			start = listener_now();
+		ret = handle_message(sock_info, sock_info->socket, &lum);
+		if (lttng_ust_metrics_enabled()) {
+			lttng_ust_metrics_inc(LTTNG_UST_METRIC_COMMAND);
+			lttng_ust_metrics_add(LTTNG_UST_METRIC_COMMAND_NS,
+				listener_now() - start);
+		}
+		if (ret) {
+			ERR("Error handling message for %s socket",
+				sock_info->name);
 			/*
-			 * If we cannot register to the sessiond daemon, don't
-			 * delay constructor execution.
+			 * Close socket if protocol error is
+			 * detected.
 			 */
-			ret = handle_register_failed(sock_info);
-			assert(!ret);
-			ust_unlock();
-			goto end;
-		case sizeof(lum):
-			print_cmd(lum.cmd, lum.handle);
-			ret = handle_message(sock_info, sock, &lum);
-			if (ret) {
-				ERR("Error handling message for %s socket",
-					sock_info->name);
-				/*
-				 * Close socket if protocol error is
-				 * detected.
-				 */
-				goto end;
-			}
-			continue;
-		default:
-			if (len < 0) {
-				DBG("Receive failed from lttng-sessiond with errno %d", (int) -len);
-			} else {
-				DBG("incorrect message size (%s socket): %zd", sock_info->name, len);
-			}
-			if (len == -ECONNRESET) {
-				DBG("%s remote end closed connection", sock_info->name);
-				goto end;
-			}
 			goto end;
 		}
-
+		return 0;
 	}
+	default:
+		if (len < 0) {
+			DBG("Receive failed from lttng-sessiond with errno %d", (int) -len);
+		} else {
+			DBG("incorrect message size (%s socket): %zd", sock_info->name, len);
+		}
+		if (len == -ECONNRESET) {
+			DBG("%s remote end closed connection", sock_info->name);
+		}
+		goto end;
+	}
+
 end:
 	if (ust_lock()) {
 		goto quit;
 	}
 	/* Cleanup socket handles before trying to reconnect */
 	lttng_ust_abi_objd_table_owner_cleanup(sock_info);
+	sock_info->connected = 0;
 	ust_unlock();
-	goto restart;	/* try to reconnect */
+	return 1;
 
 quit:
 	ust_unlock();
+	return -1;
+}
+
+/*
+ * Wait for the wait shm futex of any of the @nr_waiting session
+ * daemons, for at most @timeout_ms if not negative.
+ */
+static
+void listener_wait_for_sessiond(struct sock_info **waiting,
+		unsigned int nr_waiting, int timeout_ms)
+{
+	struct timespec timeout;
+	int ret;
+
+	if (nr_waiting > 1) {
+		struct lttng_ust_futex_waitv waiters[NR_SOCK_INFOS];
+		uint64_t deadline = 0;
+		unsigned int i;
+
+		for (i = 0; i < nr_waiting; i++) {
+			DBG("Waiting for %s apps sessiond", waiting[i]->name);
+			waiters[i].val = 0;
+			waiters[i].uaddr = (uint64_t) (uintptr_t) waiting[i]->wait_shm_mmap;
+			waiters[i].flags = LTTNG_UST_FUTEX_32;
+			waiters[i].reserved = 0;
+		}
+		if (timeout_ms >= 0) {
+			deadline = listener_now() + timeout_ms * LISTENER_NSEC_PER_MSEC;
+			timeout.tv_sec = deadline / 1000000000ULL;
+			timeout.tv_nsec = deadline % 1000000000ULL;
+		}
+		ret = lttng_ust_futex_waitv(waiters, nr_waiting,
+				timeout_ms >= 0 ? &timeout : NULL);
+		if (ret >= 0 || errno != ENOSYS)
+			return;
+		/* Wait for the first one, and check the others periodically. */
+		if (timeout_ms < 0 || timeout_ms > LISTENER_WAIT_POLL_MS)
+			timeout_ms = LISTENER_WAIT_POLL_MS;
+	} else {
+		DBG("Waiting for %s apps sessiond", waiting[0]->name);
+	}
+
+	if (timeout_ms >= 0) {
+		timeout.tv_sec = timeout_ms / 1000;
+		timeout.tv_nsec = (timeout_ms % 1000) * LISTENER_NSEC_PER_MSEC;
+	}
+	ret = lttng_ust_futex_async((int32_t *) waiting[0]->wait_shm_mmap,
+			FUTEX_WAIT, 0, timeout_ms >= 0 ? &timeout : NULL, NULL, 0);
+	if (ret < 0 && errno == EFAULT) {
+		wait_poll_fallback = 1;
+		DBG(
+"Linux kernels 2.6.33 to 3.0 (with the exception of stable versions) "
+"do not support FUTEX_WAKE on read-only memory mappings correctly. "
+"Please upgrade your kernel "
+"(fix is commit 9ea71503a8ed9184d2d0b8ccc4d269d05f7940ae in Linux kernel "
+"mainline). LTTng-UST will use polling mode fallback.");
+		if (lttng_ust_logging_debug_enabled())
+			PERROR("futex");
+	}
+	/* Otherwise woken up, value already changed, interrupted or timed out. */
+}
+
+/*
+ * Wait for a command from a connected session daemon, for a session
+ * daemon to become available, or for the next reconnection time,
+ * whichever comes first. Returns the number of session daemons stored
+ * in @ready, which sent a command.
+ */
+static
+unsigned int listener_wait(struct sock_info **ready)
+{
+	struct pollfd fds[NR_SOCK_INFOS];
+	struct sock_info *polled[NR_SOCK_INFOS], *waiting[NR_SOCK_INFOS];
+	unsigned int i, nr_fds = 0, nr_waiting = 0, nr_ready = 0;
+	uint64_t now = listener_now(), deadline = UINT64_MAX;
+	int timeout_ms = -1, ret;
+
+	for (i = 0; i < NR_SOCK_INFOS; i++) {
+		struct sock_info *sock_info = sock_infos[i];
+
+		if (!sock_info->allowed)
+			continue;
+		if (sock_info->connected) {
+			fds[nr_fds].fd = sock_info->socket;
+			fds[nr_fds].events = POLLIN;
+			fds[nr_fds].revents = 0;
+			polled[nr_fds++] = sock_info;
+		} else if (sock_info->connect_failed) {
+			waiting[nr_waiting++] = sock_info;
+		} else if (sock_info->retry_time < deadline) {
+			deadline = sock_info->retry_time;
+		}
+	}
+	if (deadline != UINT64_MAX) {
+		if (deadline <= now)
+			timeout_ms = 0;
+		else
+			timeout_ms = (deadline - now + LISTENER_NSEC_PER_MSEC - 1)
+				/ LISTENER_NSEC_PER_MSEC;
+	}
+
+	if (nr_fds) {
+		if (nr_waiting && (timeout_ms < 0 || timeout_ms > LISTENER_WAIT_POLL_MS))
+			timeout_ms = LISTENER_WAIT_POLL_MS;
+		ret = poll(fds, nr_fds, timeout_ms);
+		if (ret < 0) {
+			if (errno != EINTR)
+				PERROR("poll");
+			return 0;
+		}
+		for (i = 0; i < nr_fds; i++) {
+			if (fds[i].revents)
+				ready[nr_ready++] = polled[i];
+		}
+		return nr_ready;
+	}
+	if (nr_waiting)
+		listener_wait_for_sessiond(waiting, nr_waiting, timeout_ms);
+	else if (timeout_ms > 0)
+		(void) poll(NULL, 0, timeout_ms);
+	return 0;
+}
+
+/*
+ * This thread serves both the global and the per-user session daemons.
+ *
+ * This thread does not allocate any resource, except within
+ * handle_message, within mutex protection. This mutex protects against
+ * fork and exit.
+ * The other moment it allocates resources is at socket connection, which
+ * is also protected by the mutex.
+ */
+static
+void *ust_listener_thread(void *arg __attribute__((unused)))
+{
+	struct sock_info *ready[NR_SOCK_INFOS];
+	int ret;
+
+	lttng_ust_alloc_tls();
+	/*
+	 * If available, add '-ust' to the end of this thread's
+	 * process name
+	 */
+	ret = lttng_ust_setustprocname();
+	if (ret) {
+		ERR("Unable to set UST process name");
+	}
 
+	for (;;) {
+		unsigned int i, nr_ready;
+		uint64_t now = listener_now();
+
+		/* (Re)connect to the session daemons. */
+		for (i = 0; i < NR_SOCK_INFOS; i++) {
+			struct sock_info *sock_info = sock_infos[i];
+
+			if (!sock_info->allowed || sock_info->connected)
+				continue;
+			if (!listener_should_connect(sock_info, now))
+				continue;
+			if (listener_connect(sock_info) < 0)
+				goto quit;
+		}
+		/*
+		 * Perform the statedumps postponed until both session
+		 * daemons are done with registration.
+		 */
+		for (i = 0; i < NR_SOCK_INFOS; i++)
+			handle_pending_statedump(sock_infos[i]);
+
+		nr_ready = listener_wait(ready);
+		for (i = 0; i < nr_ready; i++) {
+			if (listener_handle_cmd(ready[i]) < 0)
+				goto quit;
+		}
+	}
+
+quit:
 	pthread_mutex_lock(&ust_exit_mutex);
-	sock_info->thread_active = 0;
+	ust_listener_active = 0;
 	pthread_mutex_unlock(&ust_exit_mutex);
 	return NULL;
 }
 
+/*
+ * The session daemon sets its wait shm futex when it starts. While it is
+ * 0, there is no session daemon to connect to: skip the connection
+ * attempt and don't delay constructor execution waiting for
+ * registration. The listener thread directly waits for the session
+ * daemon to start.
+ */
+static
+void check_sessiond_started(struct sock_info *sock_info)
+{
+	if (sessiond_available(sock_info))
+		return;
+	DBG("No %s apps sessiond started, not waiting for registration",
+		sock_info->name);
+	sock_info->connect_failed = 1;
+	(void) handle_register_failed(sock_info);
+}
+
 /*
  * Weak symbol to call when the ust malloc wrapper is not loaded.
  */
@@ -2231,10 +2974,13 @@ void lttng_ust_ctor(void)
 	lttng_ust_common_ctor();
 
 	lttng_ust_tp_init();
+	lttng_ust_tp_set_probe_accept_cb(lttng_ust_event_may_record);
 	lttng_ust_statedump_init();
 	lttng_ust_ring_buffer_clients_init();
 	lttng_ust_counter_clients_init();
+	lttng_ust_metrics_init();
 	lttng_perf_counter_init();
+	lttng_event_notifier_notification_init();
 	/*
 	 * Invoke ust malloc wrapper init before starting other threads.
 	 */
@@ -2243,12 +2989,28 @@ void lttng_ust_ctor(void)
 	timeout_mode = get_constructor_timeout(&constructor_timeout);
 
 	get_allow_blocking();
+	get_without_statedump_wait();
+	get_notify_relay();
 
 	ret = sem_init(&constructor_wait, 0, 0);
 	if (ret) {
 		PERROR("sem_init");
 	}
 
+	if (lttng_ust_embedded_output()) {
+		/*
+		 * Trace to a local directory instead of registering to
+		 * the session daemons.
+		 */
+		lttng_pthread_getname_np(embedded_apps.procname,
+			LTTNG_UST_CONTEXT_PROCNAME_LEN);
+		ret = lttng_ust_embedded_init(&embedded_apps);
+		if (!ret)
+			return;
+		ERR("Unable to trace to \"%s\" (%d), registering to the session daemons instead",
+			lttng_ust_embedded_output(), ret);
+	}
+
 	ret = setup_global_apps();
 	if (ret) {
 		assert(global_apps.allowed == 0);
@@ -2281,30 +3043,26 @@ void lttng_ust_ctor(void)
 		ERR("pthread_attr_setdetachstate: %s", strerror(ret));
 	}
 
-	if (global_apps.allowed) {
-		pthread_mutex_lock(&ust_exit_mutex);
-		ret = pthread_create(&global_apps.ust_listener, &thread_attr,
-				ust_listener_thread, &global_apps);
-		if (ret) {
-			ERR("pthread_create global: %s", strerror(ret));
-		}
-		global_apps.thread_active = 1;
-		pthread_mutex_unlock(&ust_exit_mutex);
-	} else {
+	if (!global_apps.allowed) {
 		handle_register_done(&global_apps);
+	} else {
+		check_sessiond_started(&global_apps);
+	}
+	if (!local_apps.allowed) {
+		handle_register_done(&local_apps);
+	} else {
+		check_sessiond_started(&local_apps);
 	}
 
-	if (local_apps.allowed) {
+	if (global_apps.allowed || local_apps.allowed) {
 		pthread_mutex_lock(&ust_exit_mutex);
-		ret = pthread_create(&local_apps.ust_listener, &thread_attr,
-				ust_listener_thread, &local_apps);
+		ret = pthread_create(&ust_listener, &thread_attr,
+				ust_listener_thread, NULL);
 		if (ret) {
-			ERR("pthread_create local: %s", strerror(ret));
+			ERR("pthread_create: %s", strerror(ret));
 		}
-		local_apps.thread_active = 1;
+		ust_listener_active = 1;
 		pthread_mutex_unlock(&ust_exit_mutex);
-	} else {
-		handle_register_done(&local_apps);
 	}
 	ret = pthread_attr_destroy(&thread_attr);
 	if (ret) {
@@ -2374,6 +3132,7 @@ void lttng_ust_cleanup(int exiting)
 	lttng_ust_abi_exit();
 	lttng_ust_abi_events_exit();
 	lttng_perf_counter_exit();
+	lttng_event_notifier_notification_exit();
 	lttng_ust_ring_buffer_clients_exit();
 	lttng_ust_counter_clients_exit();
 	lttng_ust_statedump_destroy();
@@ -2383,6 +3142,13 @@ void lttng_ust_cleanup(int exiting)
 		sem_count = sem_count_initial_value;
 		lttng_ust_comm_should_quit = 0;
 		initialized = 0;
+		/*
+		 * The statedump worker disappeared in the child, possibly
+		 * while holding the statedump mutex.
+		 */
+		ust_statedump_worker_active = 0;
+		pthread_mutex_init(&ust_statedump_mutex, NULL);
+		pthread_cond_init(&ust_statedump_cond, NULL);
 	}
 }
 
@@ -2400,6 +3166,12 @@ void lttng_ust_exit(void)
 	 * B) the thread is not allocating any resource.
 	 */
 
+	/*
+	 * The embedded consumer drains the buffers of its session, which
+	 * needs the UST lock, before the teardown.
+	 */
+	lttng_ust_embedded_exit();
+
 	/*
 	 * Require the communication thread to quit. Synchronize with
 	 * mutexes to ensure it is not in a mutex critical section when
@@ -2410,23 +3182,23 @@ void lttng_ust_exit(void)
 	ust_unlock();
 
 	pthread_mutex_lock(&ust_exit_mutex);
-	/* cancel threads */
-	if (global_apps.thread_active) {
-		ret = pthread_cancel(global_apps.ust_listener);
+	/* cancel thread */
+	if (ust_listener_active) {
+		ret = pthread_cancel(ust_listener);
 		if (ret) {
-			ERR("Error cancelling global ust listener thread: %s",
+			ERR("Error cancelling ust listener thread: %s",
 				strerror(ret));
 		} else {
-			global_apps.thread_active = 0;
+			ust_listener_active = 0;
 		}
 	}
-	if (local_apps.thread_active) {
-		ret = pthread_cancel(local_apps.ust_listener);
+	if (ust_statedump_worker_active) {
+		ret = pthread_cancel(ust_statedump_worker);
 		if (ret) {
-			ERR("Error cancelling local ust listener thread: %s",
+			ERR("Error cancelling ust statedump worker thread: %s",
 				strerror(ret));
 		} else {
-			local_apps.thread_active = 0;
+			ust_statedump_worker_active = 0;
 		}
 	}
 	pthread_mutex_unlock(&ust_exit_mutex);
@@ -2440,6 +3212,7 @@ void lttng_ust_exit(void)
 	 * cleanup the threads if there are stalled in a syscall.
 	 */
 	lttng_ust_cleanup(1);
+	lttng_ust_metrics_exit();
 }
 
 static
@@ -2546,6 +3319,29 @@ void lttng_ust_after_fork_parent(sigset_t *restore_sigset)
  * This is meant for forks() that have tracing in the child between the
  * fork and following exec call (if there is any).
  */
+/*
+ * With LTTNG_UST_FORK_INHERIT, the child of a registered process keeps
+ * the sessions, channels and enabled events of its parent, and records
+ * into the buffers mapped by its parent, without registering to the
+ * session daemon. Only the connection of the parent and the state of
+ * its threads, which do not exist in the child, are reset.
+ */
+static
+bool lttng_ust_fork_inherit(void)
+{
+	if (!lttng_ust_getenv("LTTNG_UST_FORK_INHERIT"))
+		return false;
+	if (!global_apps.registration_done && !local_apps.registration_done)
+		return false;
+	reset_sock_info(&global_apps);
+	reset_sock_info(&local_apps);
+	ust_listener_active = 0;
+	ust_statedump_worker_active = 0;
+	pthread_mutex_init(&ust_statedump_mutex, NULL);
+	pthread_cond_init(&ust_statedump_cond, NULL);
+	return true;
+}
+
 void lttng_ust_after_fork_child(sigset_t *restore_sigset)
 {
 	if (URCU_TLS(lttng_ust_nest_count))
@@ -2553,12 +3349,20 @@ void lttng_ust_after_fork_child(sigset_t *restore_sigset)
 	lttng_context_vpid_reset();
 	lttng_context_vtid_reset();
 	lttng_ust_context_procname_reset();
+	lttng_ns_cache_reset();
 	ust_context_ns_reset();
 	ust_context_vuids_reset();
 	ust_context_vgids_reset();
+	lttng_bytecode_filter_cache_invalidate();
+	lttng_ust_metrics_after_fork_child();
+	lttng_ust_embedded_after_fork_child();
 	DBG("process %d", getpid());
 	/* Release urcu mutexes */
 	lttng_ust_urcu_after_fork_child();
+	if (lttng_ust_fork_inherit()) {
+		ust_after_fork_common(restore_sigset);
+		return;
+	}
 	lttng_ust_cleanup(0);
 	/* Release mutexes and re-enable signals */
 	ust_after_fork_common(restore_sigset);
@@ -2567,6 +3371,7 @@ void lttng_ust_after_fork_child(sigset_t *restore_sigset)
 
 void lttng_ust_after_setns(void)
 {
+	lttng_ns_cache_diverge();
 	ust_context_ns_reset();
 	ust_context_vuids_reset();
 	ust_context_vgids_reset();
@@ -2574,6 +3379,7 @@ void lttng_ust_after_setns(void)
 
 void lttng_ust_after_unshare(void)
 {
+	lttng_ns_cache_diverge();
 	ust_context_ns_reset();
 	ust_context_vuids_reset();
 	ust_context_vgids_reset();
@@ -2624,3 +3430,10 @@ void lttng_ust_sockinfo_session_enabled(void *owner)
 	struct sock_info *sock_info = owner;
 	sock_info->statedump_pending = 1;
 }
+
+int lttng_ust_sockinfo_is_embedded(void *owner)
+{
+	struct sock_info *sock_info = owner;
+
+	return sock_info->embedded;
+}
@@ -0,0 +1,221 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Host-wide ELF information cache for the base address statedump.
+ *
+ * The cache file holds a fixed-size hash table. Each entry is protected
+ * by a sequence counter, odd while a process writes the entry, so
+ * readers of other processes detect concurrent updates and treat them
+ * as misses. Entries are overwritten when their probe sequence is full.
+ * The cache only saves work: any inconsistency is a miss, and the
+ * information is then read from the binary.
+ *
+ * Accesses are serialized within the process by the UST lock, held by
+ * the statedump.
+ */
+
+#define _LGPL_SOURCE
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <urcu/arch.h>
+#include <urcu/uatomic.h>
+
+#include "common/getenv.h"
+#include "common/jhash.h"
+#include "common/logging.h"
+#include "common/ust-fd.h"
+#include "lttng-ust-elf-cache.h"
+
+#define ELF_CACHE_FILENAME	"ust-elf-cache-1"
+#define ELF_CACHE_SIGNATURE	0x4c54454c46430001ULL	/* "LTELFC", version 1 */
+#define ELF_CACHE_NR_ENTRIES	1024
+#define ELF_CACHE_NR_PROBES	4
+
+struct elf_cache_key {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+};
+
+struct elf_cache_entry {
+	uint32_t seq;			/* 0: empty, odd: being written. */
+	uint32_t padding;
+	struct elf_cache_key key;
+	struct lttng_ust_elf_cache_info info;
+};
+
+struct elf_cache {
+	uint64_t signature;
+	uint64_t padding[7];
+	struct elf_cache_entry entries[ELF_CACHE_NR_ENTRIES];
+};
+
+static struct elf_cache *elf_cache;
+static int elf_cache_state;		/* 0: unknown, 1: mapped, -1: disabled. */
+
+static
+struct elf_cache *elf_cache_map(void)
+{
+	const char *home;
+	char path[PATH_MAX];
+	struct stat st;
+	void *map;
+	int fd, ret;
+
+	home = lttng_ust_getenv("LTTNG_HOME");
+	if (!home)
+		home = lttng_ust_getenv("HOME");
+	if (!home)
+		return NULL;
+	ret = snprintf(path, sizeof(path), "%s/.lttng/%s", home, ELF_CACHE_FILENAME);
+	if (ret < 0 || ret >= (int) sizeof(path))
+		return NULL;
+
+	lttng_ust_lock_fd_tracker();
+	fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		lttng_ust_unlock_fd_tracker();
+		return NULL;
+	}
+	map = MAP_FAILED;
+	/* Growing the file is harmless if another process does it too. */
+	if (!fstat(fd, &st) && (st.st_size == sizeof(struct elf_cache)
+			|| (!st.st_size && !ftruncate(fd, sizeof(struct elf_cache)))))
+		map = mmap(NULL, sizeof(struct elf_cache), PROT_READ | PROT_WRITE,
+				MAP_SHARED, fd, 0);
+	if (close(fd))
+		PERROR("close");
+	lttng_ust_unlock_fd_tracker();
+	if (map == MAP_FAILED)
+		return NULL;
+	if (uatomic_cmpxchg(&((struct elf_cache *) map)->signature, 0,
+			ELF_CACHE_SIGNATURE) != 0
+			&& uatomic_read(&((struct elf_cache *) map)->signature)
+				!= ELF_CACHE_SIGNATURE) {
+		(void) munmap(map, sizeof(struct elf_cache));
+		return NULL;
+	}
+	return map;
+}
+
+static
+struct elf_cache *elf_cache_get(void)
+{
+	if (caa_likely(elf_cache_state))
+		return elf_cache;
+	elf_cache_state = -1;
+	if (!lttng_ust_getenv("LTTNG_UST_ELF_CACHE"))
+		return NULL;
+	elf_cache = elf_cache_map();
+	if (!elf_cache) {
+		DBG("ELF information cache unavailable");
+		return NULL;
+	}
+	elf_cache_state = 1;
+	return elf_cache;
+}
+
+static
+void elf_cache_key_init(struct elf_cache_key *key, const struct stat *st)
+{
+	memset(key, 0, sizeof(*key));
+	key->dev = st->st_dev;
+	key->ino = st->st_ino;
+	key->size = st->st_size;
+	key->mtime_sec = st->st_mtim.tv_sec;
+	key->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+static
+struct elf_cache_entry *elf_cache_probe(struct elf_cache *cache,
+		const struct elf_cache_key *key, unsigned int probe)
+{
+	uint32_t hash = jhash(key, sizeof(*key), 0);
+
+	return &cache->entries[(hash + probe) % ELF_CACHE_NR_ENTRIES];
+}
+
+int lttng_ust_elf_cache_lookup(const struct stat *st,
+		struct lttng_ust_elf_cache_info *info)
+{
+	struct elf_cache *cache = elf_cache_get();
+	struct elf_cache_key key;
+	unsigned int i;
+
+	if (!cache)
+		return 0;
+	elf_cache_key_init(&key, st);
+	for (i = 0; i < ELF_CACHE_NR_PROBES; i++) {
+		struct elf_cache_entry *e = elf_cache_probe(cache, &key, i);
+		struct elf_cache_key entry_key;
+		uint32_t seq;
+
+		seq = uatomic_read(&e->seq);
+		if (!seq)
+			return 0;
+		if (seq & 1)
+			continue;
+		cmm_smp_rmb();
+		memcpy(&entry_key, &e->key, sizeof(entry_key));
+		memcpy(info, &e->info, sizeof(*info));
+		cmm_smp_rmb();
+		if (uatomic_read(&e->seq) != seq)
+			continue;
+		if (memcmp(&entry_key, &key, sizeof(key)))
+			continue;
+		if (info->build_id_len > LTTNG_UST_ELF_CACHE_BUILD_ID_MAX
+				|| !memchr(info->dbg_file, '\0', sizeof(info->dbg_file)))
+			return 0;
+		return 1;
+	}
+	return 0;
+}
+
+void lttng_ust_elf_cache_store(const struct stat *st,
+		const struct lttng_ust_elf_cache_info *info)
+{
+	struct elf_cache *cache = elf_cache_get();
+	struct elf_cache_entry *e = NULL;
+	struct elf_cache_key key;
+	unsigned int i;
+	uint32_t seq;
+
+	if (!cache)
+		return;
+	elf_cache_key_init(&key, st);
+	/* Use the first empty entry, else overwrite the first one. */
+	for (i = 0; i < ELF_CACHE_NR_PROBES; i++) {
+		e = elf_cache_probe(cache, &key, i);
+		if (!uatomic_read(&e->seq))
+			break;
+	}
+	if (i == ELF_CACHE_NR_PROBES)
+		e = elf_cache_probe(cache, &key, 0);
+	seq = uatomic_read(&e->seq);
+	if ((seq & 1) || uatomic_cmpxchg(&e->seq, seq, seq + 1) != seq)
+		return;		/* Being written by another process. */
+	cmm_smp_mb();
+	memcpy(&e->key, &key, sizeof(key));
+	memcpy(&e->info, info, sizeof(*info));
+	cmm_smp_wmb();
+	uatomic_set(&e->seq, seq + 2);
+}
+
+void lttng_ust_elf_cache_exit(void)
+{
+	if (elf_cache_state > 0) {
+		if (munmap(elf_cache, sizeof(struct elf_cache)))
+			PERROR("munmap");
+	}
+	elf_cache = NULL;
+	elf_cache_state = 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#ifndef LTTNG_UST_ELF_CACHE_H
+#define LTTNG_UST_ELF_CACHE_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define LTTNG_UST_ELF_CACHE_BUILD_ID_MAX	64
+#define LTTNG_UST_ELF_CACHE_DBG_FILE_MAX	256
+
+/* ELF information of the statedump, as stored in the cache. */
+struct lttng_ust_elf_cache_info {
+	uint64_t memsz;
+	uint32_t build_id_len;
+	uint32_t crc;
+	uint8_t is_pic;
+	uint8_t has_build_id;
+	uint8_t has_debug_link;
+	uint8_t build_id[LTTNG_UST_ELF_CACHE_BUILD_ID_MAX];
+	char dbg_file[LTTNG_UST_ELF_CACHE_DBG_FILE_MAX];
+};
+
+/*
+ * Host-wide cache of the ELF information of binaries, shared by the
+ * processes of a user through a file mapped from $LTTNG_HOME/.lttng,
+ * and keyed by the device, inode, size and modification time of each
+ * binary. Only used when LTTNG_UST_ELF_CACHE is set.
+ *
+ * Lookup returns 1 and fills @info on hit, 0 otherwise.
+ */
+int lttng_ust_elf_cache_lookup(const struct stat *st,
+		struct lttng_ust_elf_cache_info *info)
+	__attribute__((visibility("hidden")));
+
+void lttng_ust_elf_cache_store(const struct stat *st,
+		const struct lttng_ust_elf_cache_info *info)
+	__attribute__((visibility("hidden")));
+
+void lttng_ust_elf_cache_exit(void)
+	__attribute__((visibility("hidden")));
+
+#endif /* LTTNG_UST_ELF_CACHE_H */
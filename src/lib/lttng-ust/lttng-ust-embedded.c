@@ -0,0 +1,1185 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Embedded mode: trace without session daemon. The tracer creates its
+ * own session, with one per-cpu discard channel, and an in-process
+ * consumer thread writes its streams and their CTF metadata in a new
+ * directory under LTTNG_UST_EMBEDDED_OUTPUT, readable as is by a CTF
+ * reader such as babeltrace2.
+ *
+ * The session daemon usually assigns the event ids and generates the
+ * metadata from the registration requests sent on the notify socket.
+ * Here the session objects are registered to this file instead, which
+ * writes the metadata from the event descriptors.
+ */
+
+#define _LGPL_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lttng/ust-abi.h>
+#include <lttng/ust-ctl.h>
+#include <lttng/ust-endian.h>
+#include <lttng/ust-events.h>
+#include <lttng/ust-version.h>
+
+#include "common/align.h"
+#include "common/clock.h"
+#include "common/dynamic-type.h"
+#include "common/events.h"
+#include "common/getenv.h"
+#include "common/logging.h"
+#include "common/macros.h"
+#include "common/patient.h"
+#include "common/procname.h"
+#include "common/ringbuffer/backend.h"
+#include "common/ringbuffer/frontend.h"
+#include "common/smp.h"
+#include "common/strutils.h"
+#include "common/tracer.h"
+#include "common/ust-fd.h"
+#include "common/utils.h"
+
+#include "lib/lttng-ust/events.h"
+#include "lttng-tracer-core.h"
+
+#define EMBEDDED_TRANSPORT_NAME		"relay-discard-mmap"
+#define EMBEDDED_CHANNEL_NAME		"channel0"
+#define EMBEDDED_SUBBUF_SIZE		(256 * 1024)
+#define EMBEDDED_NUM_SUBBUF		4
+#define EMBEDDED_DEFAULT_EVENTS		"*"
+
+struct embedded_stream {
+	struct lttng_ust_ring_buffer *buf;
+	int wait_fd;
+	int out_fd;
+};
+
+static void *embedded_owner;
+static struct lttng_ust_session *embedded_session;
+static struct lttng_ust_channel_buffer *embedded_chan;
+static struct embedded_stream *embedded_streams;
+static unsigned int embedded_nr_streams;
+static int embedded_shm_fd = -1;
+static int embedded_metadata_fd = -1;
+static int embedded_quit_pipe[2] = { -1, -1 };
+static pthread_t embedded_consumer;
+static int embedded_consumer_active;
+static unsigned char embedded_uuid[LTTNG_UST_UUID_LEN];
+static char embedded_path[PATH_MAX];
+
+/* Protected by the UST lock. */
+static uint32_t embedded_next_event_id;
+static uint64_t embedded_next_enum_id;
+
+const char *lttng_ust_embedded_output(void)
+{
+	const char *output = lttng_ust_getenv("LTTNG_UST_EMBEDDED_OUTPUT");
+
+	if (!output || !*output)
+		return NULL;
+	return output;
+}
+
+/*
+ * File descriptors are added to the fd tracker, so the application
+ * closing all its file descriptors does not close them.
+ */
+static
+int embedded_track_fd(int fd)
+{
+	int ret;
+
+	ret = lttng_ust_add_fd_to_tracker(fd);
+	if (ret < 0) {
+		if (close(fd))
+			PERROR("close");
+		return ret;
+	}
+	return ret;
+}
+
+static
+void embedded_close(int *fd)
+{
+	if (*fd < 0)
+		return;
+	lttng_ust_lock_fd_tracker();
+	if (!close(*fd))
+		lttng_ust_delete_fd_from_tracker(*fd);
+	else
+		PERROR("close");
+	lttng_ust_unlock_fd_tracker();
+	*fd = -1;
+}
+
+static
+int embedded_open_file(const char *name)
+{
+	char path[PATH_MAX];
+	int fd, ret;
+
+	ret = snprintf(path, sizeof(path), "%s/%s", embedded_path, name);
+	if (ret < 0 || ret >= sizeof(path))
+		return -ENAMETOOLONG;
+	lttng_ust_lock_fd_tracker();
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+			S_IRUSR | S_IWUSR | S_IRGRP);
+	if (fd < 0) {
+		ret = -errno;
+		PERROR("open %s", path);
+		lttng_ust_unlock_fd_tracker();
+		return ret;
+	}
+	fd = embedded_track_fd(fd);
+	lttng_ust_unlock_fd_tracker();
+	return fd;
+}
+
+static
+int embedded_mkdir_p(const char *path)
+{
+	char tmp[PATH_MAX];
+	size_t len;
+	char *p;
+
+	len = strlen(path);
+	if (len >= sizeof(tmp))
+		return -ENAMETOOLONG;
+	memcpy(tmp, path, len + 1);
+	for (p = tmp + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+		*p = '\0';
+		if (mkdir(tmp, S_IRWXU | S_IRGRP | S_IXGRP) && errno != EEXIST)
+			return -errno;
+		*p = '/';
+	}
+	if (mkdir(tmp, S_IRWXU | S_IRGRP | S_IXGRP) && errno != EEXIST)
+		return -errno;
+	return 0;
+}
+
+/*
+ * Each process traces to its own directory, named after its process
+ * name, id and start time, as the session daemon names per-pid buffers.
+ */
+static
+int embedded_create_directory(const char *output, const char *procname)
+{
+	char datetime[sizeof("YYYYmmdd-HHMMSS")];
+	struct tm tm;
+	time_t now;
+	int ret;
+
+	now = time(NULL);
+	if (!localtime_r(&now, &tm))
+		return -EINVAL;
+	if (!strftime(datetime, sizeof(datetime), "%Y%m%d-%H%M%S", &tm))
+		return -EINVAL;
+	ret = snprintf(embedded_path, sizeof(embedded_path), "%s/%s-%d-%s",
+			output, procname, (int) getpid(), datetime);
+	if (ret < 0 || ret >= sizeof(embedded_path))
+		return -ENAMETOOLONG;
+	return embedded_mkdir_p(embedded_path);
+}
+
+static
+void embedded_generate_uuid(unsigned char *uuid)
+{
+	uint64_t seed;
+	unsigned int i;
+	int fd;
+
+	fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		ssize_t len = lttng_ust_read(fd, uuid, LTTNG_UST_UUID_LEN);
+
+		(void) close(fd);
+		if (len == LTTNG_UST_UUID_LEN)
+			goto version;
+	}
+	/* Fallback: mix the time and the process id. */
+	seed = trace_clock_read64_monotonic() ^ ((uint64_t) getpid() << 32)
+		^ (uint64_t) time(NULL);
+	for (i = 0; i < LTTNG_UST_UUID_LEN; i++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		uuid[i] = seed >> 56;
+	}
+version:
+	/* RFC 4122 version 4 (random) UUID. */
+	uuid[6] = (uuid[6] & 0x0f) | 0x40;
+	uuid[8] = (uuid[8] & 0x3f) | 0x80;
+}
+
+static
+void embedded_print_uuid(FILE *f, const unsigned char *uuid)
+{
+	fprintf(f, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+		uuid[0], uuid[1], uuid[2], uuid[3], uuid[4], uuid[5],
+		uuid[6], uuid[7], uuid[8], uuid[9], uuid[10], uuid[11],
+		uuid[12], uuid[13], uuid[14], uuid[15]);
+}
+
+/* Print @str as a TSDL string literal, without the quotes. */
+static
+void tsdl_print_escaped(FILE *f, const char *str)
+{
+	for (; *str; str++) {
+		switch (*str) {
+		case '\\':
+		case '"':
+			fputc('\\', f);
+			fputc(*str, f);
+			break;
+		case '\n':
+			fputs("\\n", f);
+			break;
+		default:
+			fputc(*str, f);
+		}
+	}
+}
+
+static
+void tsdl_indent(FILE *f, unsigned int nesting)
+{
+	while (nesting--)
+		fputc('\t', f);
+}
+
+static
+const char *tsdl_encoding(enum lttng_ust_string_encoding encoding)
+{
+	switch (encoding) {
+	case lttng_ust_string_encoding_UTF8:
+		return "UTF8";
+	case lttng_ust_string_encoding_ASCII:
+		return "ASCII";
+	case lttng_ust_string_encoding_none:
+	default:
+		return "none";
+	}
+}
+
+static
+const char *tsdl_byte_order(unsigned int reverse_byte_order)
+{
+	if (!reverse_byte_order)
+		return "";
+#if LTTNG_UST_BYTE_ORDER == LTTNG_UST_LITTLE_ENDIAN
+	return " byte_order = be;";
+#else
+	return " byte_order = le;";
+#endif
+}
+
+static
+void tsdl_print_integer(FILE *f, const struct lttng_ust_type_integer *integer,
+		enum lttng_ust_string_encoding encoding)
+{
+	fprintf(f, "integer { size = %u; align = %u; signed = %u; encoding = %s; base = %u;%s }",
+		integer->size, integer->alignment, integer->signedness,
+		tsdl_encoding(encoding), integer->base,
+		tsdl_byte_order(integer->reverse_byte_order));
+}
+
+static
+void tsdl_print_enum_value(FILE *f, const struct lttng_ust_enum_value *value)
+{
+	if (value->signedness)
+		fprintf(f, "%lld", (long long) value->value);
+	else
+		fprintf(f, "%llu", value->value);
+}
+
+static
+int tsdl_print_enum(FILE *f, const struct lttng_ust_type_enum *enum_type,
+		unsigned int nesting)
+{
+	const struct lttng_ust_enum_desc *desc = enum_type->desc;
+	unsigned int i;
+
+	if (enum_type->container_type->type != lttng_ust_type_integer)
+		return -EINVAL;
+	fputs("enum : ", f);
+	tsdl_print_integer(f, lttng_ust_get_type_integer(enum_type->container_type),
+		lttng_ust_string_encoding_none);
+	fputs(" {\n", f);
+	for (i = 0; i < desc->nr_entries; i++) {
+		const struct lttng_ust_enum_entry *entry = desc->entries[i];
+
+		tsdl_indent(f, nesting + 1);
+		fputc('"', f);
+		tsdl_print_escaped(f, entry->string);
+		fputc('"', f);
+		if (!(entry->options & LTTNG_UST_ENUM_ENTRY_OPTION_IS_AUTO)) {
+			fputs(" = ", f);
+			tsdl_print_enum_value(f, &entry->start);
+			if (entry->start.value != entry->end.value
+					|| entry->start.signedness != entry->end.signedness) {
+				fputs(" ... ", f);
+				tsdl_print_enum_value(f, &entry->end);
+			}
+		}
+		fputs(",\n", f);
+	}
+	tsdl_indent(f, nesting);
+	fputc('}', f);
+	return 0;
+}
+
+static
+int tsdl_print_fields(FILE *f, size_t nr_fields,
+		const struct lttng_ust_event_field * const *fields,
+		unsigned int nesting);
+
+/*
+ * Print the declaration of a type, before the field name. Arrays and
+ * sequences print their element type: the length follows the name.
+ */
+static
+int tsdl_print_type(FILE *f, const struct lttng_ust_type_common *type,
+		enum lttng_ust_string_encoding encoding, unsigned int nesting)
+{
+	switch (type->type) {
+	case lttng_ust_type_integer:
+		tsdl_print_integer(f, lttng_ust_get_type_integer(type), encoding);
+		return 0;
+	case lttng_ust_type_float:
+	{
+		const struct lttng_ust_type_float *float_type = lttng_ust_get_type_float(type);
+
+		fprintf(f, "floating_point { exp_dig = %u; mant_dig = %u; align = %u;%s }",
+			float_type->exp_dig, float_type->mant_dig,
+			float_type->alignment,
+			tsdl_byte_order(float_type->reverse_byte_order));
+		return 0;
+	}
+	case lttng_ust_type_string:
+		fprintf(f, "string { encoding = %s; }",
+			lttng_ust_get_type_string(type)->encoding == lttng_ust_string_encoding_ASCII ?
+				"ASCII" : "UTF8");
+		return 0;
+	case lttng_ust_type_enum:
+		return tsdl_print_enum(f, lttng_ust_get_type_enum(type), nesting);
+	case lttng_ust_type_struct:
+	{
+		const struct lttng_ust_type_struct *struct_type = lttng_ust_get_type_struct(type);
+		int ret;
+
+		fputs("struct {\n", f);
+		ret = tsdl_print_fields(f, struct_type->nr_fields,
+				struct_type->fields, nesting + 1);
+		if (ret)
+			return ret;
+		tsdl_indent(f, nesting);
+		fputc('}', f);
+		if (struct_type->alignment)
+			fprintf(f, " align(%u)", struct_type->alignment * CHAR_BIT);
+		return 0;
+	}
+	default:
+		/* Nested arrays, sequences and variants are not described. */
+		return -EINVAL;
+	}
+}
+
+static
+int tsdl_print_field(FILE *f, const struct lttng_ust_event_field *field,
+		const char *prev_field_name, unsigned int nesting)
+{
+	const struct lttng_ust_type_common *type = field->type;
+	int ret;
+
+	switch (type->type) {
+	case lttng_ust_type_array:
+	{
+		const struct lttng_ust_type_array *array = lttng_ust_get_type_array(type);
+
+		if (array->alignment) {
+			tsdl_indent(f, nesting);
+			fprintf(f, "struct { } align(%u) _%s_padding;\n",
+				array->alignment * CHAR_BIT, field->name);
+		}
+		tsdl_indent(f, nesting);
+		ret = tsdl_print_type(f, array->elem_type, array->encoding, nesting);
+		if (ret)
+			return ret;
+		fprintf(f, " _%s[%u];\n", field->name, array->length);
+		return 0;
+	}
+	case lttng_ust_type_sequence:
+	{
+		const struct lttng_ust_type_sequence *sequence = lttng_ust_get_type_sequence(type);
+		const char *length_name = sequence->length_name;
+
+		if (!length_name)
+			length_name = prev_field_name;
+		if (!length_name)
+			return -EINVAL;
+		if (sequence->alignment) {
+			tsdl_indent(f, nesting);
+			fprintf(f, "struct { } align(%u) _%s_padding;\n",
+				sequence->alignment * CHAR_BIT, field->name);
+		}
+		tsdl_indent(f, nesting);
+		ret = tsdl_print_type(f, sequence->elem_type, sequence->encoding, nesting);
+		if (ret)
+			return ret;
+		fprintf(f, " _%s[ _%s ];\n", field->name, length_name);
+		return 0;
+	}
+	case lttng_ust_type_dynamic:
+	{
+		const struct lttng_ust_event_field * const *choices;
+		const struct lttng_ust_event_field *tag_field;
+		size_t nr_choices;
+
+		/* Tag enumeration followed by the variant of its choices. */
+		tag_field = lttng_ust_dynamic_type_tag_field();
+		tsdl_indent(f, nesting);
+		ret = tsdl_print_type(f, tag_field->type,
+				lttng_ust_string_encoding_none, nesting);
+		if (ret)
+			return ret;
+		fprintf(f, " _%s_tag;\n", field->name);
+		ret = lttng_ust_dynamic_type_choices(&nr_choices, &choices);
+		if (ret)
+			return ret;
+		tsdl_indent(f, nesting);
+		fprintf(f, "variant <_%s_tag> {\n", field->name);
+		ret = tsdl_print_fields(f, nr_choices, choices, nesting + 1);
+		if (ret)
+			return ret;
+		tsdl_indent(f, nesting);
+		fprintf(f, "} _%s;\n", field->name);
+		return 0;
+	}
+	default:
+		tsdl_indent(f, nesting);
+		ret = tsdl_print_type(f, type, lttng_ust_string_encoding_none, nesting);
+		if (ret)
+			return ret;
+		fprintf(f, " _%s;\n", field->name);
+		return 0;
+	}
+}
+
+/* Field names are prefixed with an underscore, as by the session daemon. */
+static
+int tsdl_print_fields(FILE *f, size_t nr_fields,
+		const struct lttng_ust_event_field * const *fields,
+		unsigned int nesting)
+{
+	const char *prev_field_name = NULL;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < nr_fields; i++) {
+		const struct lttng_ust_event_field *field = fields[i];
+
+		if (field->nowrite)
+			continue;
+		ret = tsdl_print_field(f, field, prev_field_name, nesting);
+		if (ret)
+			return ret;
+		prev_field_name = field->name;
+	}
+	return 0;
+}
+
+/*
+ * Offset of the trace clock from the Epoch, measured as the session
+ * daemon does, in clock cycles.
+ */
+static
+void embedded_clock_offset(uint64_t freq, int64_t *offset_s, int64_t *offset)
+{
+	struct timespec ts;
+	uint64_t before, after;
+	int64_t cycles;
+
+	before = trace_clock_read64();
+	if (clock_gettime(CLOCK_REALTIME, &ts)) {
+		*offset_s = 0;
+		*offset = 0;
+		return;
+	}
+	after = trace_clock_read64();
+	cycles = (int64_t) ts.tv_sec * freq
+		+ (int64_t) ((uint64_t) ts.tv_nsec * freq / 1000000000ULL)
+		- (int64_t) (before + ((after - before) >> 1));
+	*offset_s = cycles / (int64_t) freq;
+	*offset = cycles % (int64_t) freq;
+}
+
+static
+void embedded_print_clock(FILE *f)
+{
+	struct lttng_ust_trace_clock *ltc = CMM_LOAD_SHARED(lttng_ust_trace_clock);
+	const char *name = "monotonic", *description = "Monotonic Clock";
+	char clock_uuid[LTTNG_UST_UUID_STR_LEN];
+	uint64_t freq = 1000000000ULL;
+	int64_t offset_s, offset;
+	bool has_uuid = false;
+
+	if (ltc) {
+		cmm_read_barrier_depends();	/* load ltc before content */
+		name = ltc->name();
+		description = ltc->description();
+		freq = ltc->freq();
+		if (ltc->uuid && !ltc->uuid(clock_uuid))
+			has_uuid = true;
+	}
+	embedded_clock_offset(freq, &offset_s, &offset);
+	fprintf(f, "clock {\n"
+		"\tname = \"%s\";\n", name);
+	if (has_uuid)
+		fprintf(f, "\tuuid = \"%s\";\n", clock_uuid);
+	fputs("\tdescription = \"", f);
+	tsdl_print_escaped(f, description);
+	fprintf(f, "\";\n"
+		"\tfreq = %" PRIu64 ";\n"
+		"\tprecision = 1;\n"
+		"\toffset_s = %" PRId64 ";\n"
+		"\toffset = %" PRId64 ";\n"
+		"\tabsolute = FALSE;\n"
+		"};\n\n", freq, offset_s, offset);
+	fprintf(f, "typealias integer {\n"
+		"\tsize = 27; align = 1; signed = false;\n"
+		"\tmap = clock.%s.value;\n"
+		"} := uint27_clock_t;\n\n"
+		"typealias integer {\n"
+		"\tsize = 32; align = %u; signed = false;\n"
+		"\tmap = clock.%s.value;\n"
+		"} := uint32_clock_t;\n\n"
+		"typealias integer {\n"
+		"\tsize = 64; align = %u; signed = false;\n"
+		"\tmap = clock.%s.value;\n"
+		"} := uint64_clock_t;\n\n",
+		name, lttng_ust_rb_alignof(uint32_t) * CHAR_BIT,
+		name, lttng_ust_rb_alignof(uint64_t) * CHAR_BIT, name);
+}
+
+static
+int embedded_metadata_write(char *buf, size_t len)
+{
+	ssize_t ret;
+
+	ret = ust_patient_write(embedded_metadata_fd, buf, len);
+	if (ret < 0 || (size_t) ret != len) {
+		PERROR("Error writing embedded metadata");
+		return -EIO;
+	}
+	return 0;
+}
+
+/*
+ * The trace, clock and stream descriptions, matching the packet and
+ * event headers written by the ring buffer clients with the large event
+ * header, which is used for every channel.
+ */
+static
+int embedded_metadata_preamble(const char *procname)
+{
+	char hostname[HOST_NAME_MAX + 1];
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *f;
+	int ret;
+
+	f = open_memstream(&buf, &len);
+	if (!f)
+		return -ENOMEM;
+	if (gethostname(hostname, sizeof(hostname)))
+		strcpy(hostname, "unknown");
+	hostname[sizeof(hostname) - 1] = '\0';
+
+	fprintf(f, "/* CTF %u.%u */\n\n", CTF_SPEC_MAJOR, CTF_SPEC_MINOR);
+	fprintf(f, "typealias integer { size = 8; align = %u; signed = false; } := uint8_t;\n"
+		"typealias integer { size = 16; align = %u; signed = false; } := uint16_t;\n"
+		"typealias integer { size = 32; align = %u; signed = false; } := uint32_t;\n"
+		"typealias integer { size = 64; align = %u; signed = false; } := uint64_t;\n"
+		"typealias integer { size = %u; align = %u; signed = false; } := unsigned long;\n"
+		"typealias integer { size = 5; align = 1; signed = false; } := uint5_t;\n"
+		"typealias integer { size = 27; align = 1; signed = false; } := uint27_t;\n\n",
+		lttng_ust_rb_alignof(uint8_t) * CHAR_BIT,
+		lttng_ust_rb_alignof(uint16_t) * CHAR_BIT,
+		lttng_ust_rb_alignof(uint32_t) * CHAR_BIT,
+		lttng_ust_rb_alignof(uint64_t) * CHAR_BIT,
+		(unsigned int) (sizeof(unsigned long) * CHAR_BIT),
+		lttng_ust_rb_alignof(unsigned long) * CHAR_BIT);
+	fprintf(f, "trace {\n"
+		"\tmajor = %u;\n"
+		"\tminor = %u;\n"
+		"\tuuid = \"", CTF_SPEC_MAJOR, CTF_SPEC_MINOR);
+	embedded_print_uuid(f, embedded_uuid);
+	fprintf(f, "\";\n"
+		"\tbyte_order = %s;\n"
+		"\tpacket.header := struct {\n"
+		"\t\tuint32_t magic;\n"
+		"\t\tuint8_t  uuid[16];\n"
+		"\t\tuint32_t stream_id;\n"
+		"\t\tuint64_t stream_instance_id;\n"
+		"\t};\n"
+		"};\n\n",
+#if LTTNG_UST_BYTE_ORDER == LTTNG_UST_LITTLE_ENDIAN
+		"le"
+#else
+		"be"
+#endif
+		);
+	fputs("env {\n\thostname = \"", f);
+	tsdl_print_escaped(f, hostname);
+	fprintf(f, "\";\n"
+		"\tdomain = \"ust\";\n"
+		"\ttracer_name = \"lttng-ust\";\n"
+		"\ttracer_major = %u;\n"
+		"\ttracer_minor = %u;\n"
+		"\ttracer_patchlevel = %u;\n"
+		"\tvpid = %d;\n"
+		"\tprocname = \"",
+		LTTNG_UST_MAJOR_VERSION, LTTNG_UST_MINOR_VERSION,
+		LTTNG_UST_PATCHLEVEL_VERSION, (int) getpid());
+	tsdl_print_escaped(f, procname);
+	fputs("\";\n};\n\n", f);
+	embedded_print_clock(f);
+	fputs("struct packet_context {\n"
+		"\tuint64_clock_t timestamp_begin;\n"
+		"\tuint64_clock_t timestamp_end;\n"
+		"\tuint64_t content_size;\n"
+		"\tuint64_t packet_size;\n"
+		"\tuint64_t packet_seq_num;\n"
+		"\tunsigned long events_discarded;\n"
+		"\tuint32_t cpu_id;\n"
+		"};\n\n"
+		"struct event_header_large {\n"
+		"\tenum : uint16_t { compact = 0 ... 65534, extended = 65535 } id;\n"
+		"\tvariant <id> {\n"
+		"\t\tstruct {\n"
+		"\t\t\tuint32_clock_t timestamp;\n"
+		"\t\t} compact;\n"
+		"\t\tstruct {\n"
+		"\t\t\tuint32_t id;\n"
+		"\t\t\tuint64_clock_t timestamp;\n"
+		"\t\t} extended;\n"
+		"\t} v;\n"
+		"} align(8);\n\n", f);
+	fprintf(f, "stream {\n"
+		"\tid = %u;\n"
+		"\tevent.header := struct event_header_large;\n"
+		"\tpacket.context := struct packet_context;\n"
+		"};\n\n", embedded_chan->priv->id);
+	if (fclose(f)) {
+		free(buf);
+		return -ENOMEM;
+	}
+	ret = embedded_metadata_write(buf, len);
+	free(buf);
+	return ret;
+}
+
+int lttng_ust_embedded_register_enum(
+		const struct lttng_ust_enum_desc *desc __attribute__((unused)),
+		uint64_t *id)
+{
+	/* Enumerations are described in the fields using them. */
+	*id = embedded_next_enum_id++;
+	return 0;
+}
+
+int lttng_ust_embedded_register_channel(struct lttng_ust_channel_buffer *chan,
+		uint32_t *chan_id, int *header_type)
+{
+	/* The stream is described by the metadata preamble. */
+	*chan_id = chan->priv->id;
+	*header_type = LTTNG_UST_CTL_CHANNEL_HEADER_LARGE;
+	return 0;
+}
+
+int lttng_ust_embedded_register_event(struct lttng_ust_channel_buffer *chan,
+		const struct lttng_ust_event_desc *desc, const char *name,
+		int loglevel, const char *model_emf_uri, uint32_t *id)
+{
+	char *buf = NULL;
+	size_t len = 0;
+	FILE *f;
+	int ret;
+
+	if (embedded_next_event_id == UINT32_MAX)
+		return -ENOSPC;
+	f = open_memstream(&buf, &len);
+	if (!f)
+		return -ENOMEM;
+	fputs("event {\n\tname = \"", f);
+	tsdl_print_escaped(f, name);
+	fprintf(f, "\";\n"
+		"\tid = %" PRIu32 ";\n"
+		"\tstream_id = %" PRIu32 ";\n"
+		"\tloglevel = %d;\n",
+		embedded_next_event_id, chan->priv->id, loglevel);
+	if (model_emf_uri) {
+		fputs("\tmodel.emf.uri = \"", f);
+		tsdl_print_escaped(f, model_emf_uri);
+		fputs("\";\n", f);
+	}
+	fputs("\tfields := struct {\n", f);
+	ret = tsdl_print_fields(f, desc->tp_class->nr_fields,
+			desc->tp_class->fields, 2);
+	fputs("\t};\n};\n\n", f);
+	if (fclose(f)) {
+		free(buf);
+		return -ENOMEM;
+	}
+	if (ret) {
+		DBG("Unable to describe the fields of event \"%s\" (%d)", name, ret);
+		free(buf);
+		return ret;
+	}
+	ret = embedded_metadata_write(buf, len);
+	free(buf);
+	if (ret)
+		return ret;
+	*id = embedded_next_event_id++;
+	return 0;
+}
+
+/* Write the sub-buffers ready for reading to the stream file. */
+static
+void embedded_stream_consume(struct embedded_stream *stream)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = embedded_chan->priv->rb_chan;
+	const struct lttng_ust_ring_buffer_config *config = &rb_chan->backend.config;
+	struct lttng_ust_shm_handle *handle = rb_chan->handle;
+	struct lttng_ust_ring_buffer *buf = stream->buf;
+
+	while (!lib_ring_buffer_get_next_subbuf(buf, handle)) {
+		struct lttng_ust_ring_buffer_backend_pages_shmp *barray_idx;
+		struct lttng_ust_ring_buffer_backend_pages *pages;
+		unsigned long sb_bindex, len;
+		char *base;
+		ssize_t ret;
+
+		sb_bindex = subbuffer_id_get_index(config, buf->backend.buf_rsb.id);
+		barray_idx = shmp_index(handle, buf->backend.array, sb_bindex);
+		pages = barray_idx ? shmp(handle, barray_idx->shmp) : NULL;
+		base = shmp(handle, buf->backend.memory_map);
+		len = LTTNG_UST_PAGE_ALIGN(lib_ring_buffer_get_read_data_size(config,
+				buf, handle));
+		if (pages && base && stream->out_fd >= 0) {
+			ret = ust_patient_write(stream->out_fd,
+					base + pages->mmap_offset, len);
+			if (ret < 0 || (size_t) ret != len) {
+				PERROR("Error writing embedded stream");
+				embedded_close(&stream->out_fd);
+			}
+		}
+		lib_ring_buffer_put_next_subbuf(buf, handle);
+	}
+}
+
+/* Clear the wakeups of the writers, a pipe or an eventfd. */
+static
+void embedded_stream_clear_wakeup(struct embedded_stream *stream)
+{
+	char discard[64];
+
+	while (read(stream->wait_fd, discard, sizeof(discard)) > 0)
+		;
+}
+
+static
+void *embedded_consumer_thread(void *arg __attribute__((unused)))
+{
+	struct pollfd *pollfds;
+	unsigned int i;
+	bool quit = false;
+	int ret;
+
+	lttng_ust_alloc_tls();
+	ret = lttng_ust_setustprocname();
+	if (ret) {
+		ERR("Unable to set UST process name");
+	}
+	/* State dump of the session, as done for a session daemon. */
+	lttng_handle_pending_statedump(embedded_owner);
+
+	pollfds = zmalloc((embedded_nr_streams + 1) * sizeof(*pollfds));
+	if (!pollfds) {
+		ERR("Unable to allocate the embedded consumer poll set");
+		goto drain;
+	}
+	for (i = 0; i < embedded_nr_streams; i++) {
+		pollfds[i].fd = embedded_streams[i].wait_fd;
+		pollfds[i].events = POLLIN;
+	}
+	pollfds[embedded_nr_streams].fd = embedded_quit_pipe[0];
+	pollfds[embedded_nr_streams].events = POLLIN;
+
+	while (!quit) {
+		ret = poll(pollfds, embedded_nr_streams + 1, -1);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			PERROR("poll");
+			break;
+		}
+		if (pollfds[embedded_nr_streams].revents)
+			quit = true;
+		for (i = 0; i < embedded_nr_streams; i++) {
+			if (!pollfds[i].revents)
+				continue;
+			embedded_stream_clear_wakeup(&embedded_streams[i]);
+			embedded_stream_consume(&embedded_streams[i]);
+		}
+	}
+	free(pollfds);
+
+drain:
+	/* Close the current sub-buffers and write the remaining data. */
+	for (i = 0; i < embedded_nr_streams; i++) {
+		struct lttng_ust_ring_buffer_channel *rb_chan = embedded_chan->priv->rb_chan;
+
+		lib_ring_buffer_switch_slow(embedded_streams[i].buf, SWITCH_ACTIVE,
+			rb_chan->handle);
+		embedded_stream_consume(&embedded_streams[i]);
+	}
+	return NULL;
+}
+
+/*
+ * Stream buffers are allocated in a single POSIX shared memory object,
+ * unlinked right away: no other process maps them.
+ */
+static
+int embedded_create_shm(void)
+{
+	char name[NAME_MAX];
+	int fd, ret;
+
+	ret = snprintf(name, sizeof(name), "/lttng-ust-embedded-%d", (int) getpid());
+	if (ret < 0 || ret >= sizeof(name))
+		return -ENAMETOOLONG;
+	lttng_ust_lock_fd_tracker();
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+	if (fd < 0 && errno == EEXIST) {
+		/* Left over by a process which had the same pid. */
+		(void) shm_unlink(name);
+		fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+	}
+	if (fd < 0) {
+		ret = -errno;
+		PERROR("shm_open %s", name);
+		lttng_ust_unlock_fd_tracker();
+		return ret;
+	}
+	(void) shm_unlink(name);
+	fd = embedded_track_fd(fd);
+	lttng_ust_unlock_fd_tracker();
+	return fd;
+}
+
+/* Called with the UST lock held. */
+static
+int embedded_create_channel(void)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan;
+	struct lttng_transport *transport;
+	struct lttng_ust_channel_buffer *chan;
+
+	transport = lttng_ust_transport_find(EMBEDDED_TRANSPORT_NAME);
+	if (!transport)
+		return -EINVAL;
+	embedded_shm_fd = embedded_create_shm();
+	if (embedded_shm_fd < 0)
+		return embedded_shm_fd;
+	chan = transport->ops.priv->channel_create(EMBEDDED_TRANSPORT_NAME, NULL,
+			EMBEDDED_SUBBUF_SIZE, EMBEDDED_NUM_SUBBUF, 0, 0,
+			embedded_uuid, 0, &embedded_shm_fd, 1, 0, 0);
+	if (!chan)
+		return -ENOMEM;
+	rb_chan = chan->priv->rb_chan;
+	chan->priv->intern_caches = zmalloc(rb_chan->nr_streams *
+			sizeof(*chan->priv->intern_caches));
+	if (!chan->priv->intern_caches) {
+		transport->ops.priv->channel_destroy(chan);
+		return -ENOMEM;
+	}
+	chan->priv->nr_intern_caches = rb_chan->nr_streams;
+
+	chan->ops = &transport->ops;
+	chan->parent->enabled = 1;
+	chan->parent->session = embedded_session;
+	chan->priv->parent.tstate = 1;
+	chan->priv->parent.objd = -1;
+	chan->priv->ctx = NULL;
+	chan->priv->header_type = 0;
+	chan->priv->type = LTTNG_UST_ABI_CHAN_PER_CPU;
+	cds_list_add(&chan->priv->node, &embedded_session->priv->chan_head);
+	embedded_chan = chan;
+	return 0;
+}
+
+static
+int embedded_open_streams(void)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = embedded_chan->priv->rb_chan;
+	const struct lttng_ust_ring_buffer_config *config = &rb_chan->backend.config;
+	unsigned int i;
+
+	embedded_nr_streams = rb_chan->nr_streams;
+	embedded_streams = zmalloc(embedded_nr_streams * sizeof(*embedded_streams));
+	if (!embedded_streams)
+		return -ENOMEM;
+	for (i = 0; i < embedded_nr_streams; i++)
+		embedded_streams[i].out_fd = -1;
+	for (i = 0; i < embedded_nr_streams; i++) {
+		struct embedded_stream *stream = &embedded_streams[i];
+		char name[sizeof(EMBEDDED_CHANNEL_NAME) + 16];
+		int shm_fd, wakeup_fd, flags;
+		uint64_t memory_map_size;
+		void *memory_map_addr;
+
+		stream->buf = channel_get_ring_buffer(config, rb_chan, i,
+				rb_chan->handle, &shm_fd, &stream->wait_fd,
+				&wakeup_fd, &memory_map_size, &memory_map_addr);
+		if (!stream->buf)
+			return -EINVAL;
+		if (lib_ring_buffer_open_read(stream->buf, rb_chan->handle))
+			return -EBUSY;
+		flags = fcntl(stream->wait_fd, F_GETFL);
+		if (flags < 0 || fcntl(stream->wait_fd, F_SETFL, flags | O_NONBLOCK) < 0)
+			return -errno;
+		snprintf(name, sizeof(name), EMBEDDED_CHANNEL_NAME "_%u", i);
+		stream->out_fd = embedded_open_file(name);
+		if (stream->out_fd < 0)
+			return stream->out_fd;
+	}
+	return 0;
+}
+
+/*
+ * One enabler per comma-separated pattern of LTTNG_UST_EMBEDDED_EVENTS,
+ * all the events by default. Called with the UST lock held.
+ */
+static
+int embedded_create_enablers(void)
+{
+	const char *events = lttng_ust_getenv("LTTNG_UST_EMBEDDED_EVENTS");
+	const char *p, *end;
+
+	if (!events || !*events)
+		events = EMBEDDED_DEFAULT_EVENTS;
+	for (p = events; *p; p = *end ? end + 1 : end) {
+		struct lttng_ust_abi_event event_param;
+		enum lttng_enabler_format_type format_type;
+		struct lttng_event_enabler *enabler;
+		size_t len;
+		int ret;
+
+		end = strchrnul(p, ',');
+		len = end - p;
+		if (!len)
+			continue;
+		if (len >= LTTNG_UST_ABI_SYM_NAME_LEN)
+			return -EINVAL;
+		memset(&event_param, 0, sizeof(event_param));
+		event_param.instrumentation = LTTNG_UST_ABI_TRACEPOINT;
+		memcpy(event_param.name, p, len);
+		event_param.loglevel_type = LTTNG_UST_ABI_LOGLEVEL_ALL;
+		event_param.loglevel = -1;
+		if (strutils_is_star_glob_pattern(event_param.name))
+			format_type = LTTNG_ENABLER_FORMAT_STAR_GLOB;
+		else
+			format_type = LTTNG_ENABLER_FORMAT_EVENT;
+		enabler = lttng_event_enabler_create(format_type, &event_param,
+				embedded_chan);
+		if (!enabler)
+			return -ENOMEM;
+		ret = lttng_event_enabler_enable(enabler);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static
+int embedded_start_consumer(void)
+{
+	sigset_t sig_all_blocked, orig_mask;
+	int ret, fds[2];
+
+	lttng_ust_lock_fd_tracker();
+	ret = pipe2(fds, O_CLOEXEC);
+	if (ret) {
+		ret = -errno;
+		lttng_ust_unlock_fd_tracker();
+		return ret;
+	}
+	embedded_quit_pipe[0] = embedded_track_fd(fds[0]);
+	embedded_quit_pipe[1] = embedded_track_fd(fds[1]);
+	lttng_ust_unlock_fd_tracker();
+	if (embedded_quit_pipe[0] < 0 || embedded_quit_pipe[1] < 0)
+		return -EMFILE;
+
+	/* As the listener thread, the consumer thread receives no signal. */
+	sigfillset(&sig_all_blocked);
+	ret = pthread_sigmask(SIG_SETMASK, &sig_all_blocked, &orig_mask);
+	if (ret) {
+		ERR("pthread_sigmask: %s", strerror(ret));
+	}
+	ret = pthread_create(&embedded_consumer, NULL,
+			embedded_consumer_thread, NULL);
+	if (ret) {
+		ERR("pthread_create: %s", strerror(ret));
+		ret = -ret;
+	} else {
+		embedded_consumer_active = 1;
+	}
+	if (pthread_sigmask(SIG_SETMASK, &orig_mask, NULL)) {
+		ERR("pthread_sigmask failed");
+	}
+	return ret;
+}
+
+static
+void embedded_close_files(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < embedded_nr_streams; i++)
+		embedded_close(&embedded_streams[i].out_fd);
+	free(embedded_streams);
+	embedded_streams = NULL;
+	embedded_nr_streams = 0;
+	embedded_close(&embedded_metadata_fd);
+	embedded_close(&embedded_quit_pipe[0]);
+	embedded_close(&embedded_quit_pipe[1]);
+}
+
+int lttng_ust_embedded_init(void *owner)
+{
+	const char *output = lttng_ust_embedded_output();
+	const char *procname = lttng_ust_sockinfo_get_procname(owner);
+	int ret;
+
+	if (!output)
+		return -EINVAL;
+	if (!*procname)
+		procname = "unknown";
+	embedded_owner = owner;
+	ret = embedded_create_directory(output, procname);
+	if (ret) {
+		ERR("Unable to create the embedded trace directory \"%s\": %s",
+			embedded_path, strerror(-ret));
+		return ret;
+	}
+	embedded_generate_uuid(embedded_uuid);
+	embedded_metadata_fd = embedded_open_file("metadata");
+	if (embedded_metadata_fd < 0)
+		return embedded_metadata_fd;
+
+	if (ust_lock()) {
+		ret = -EBUSY;
+		goto error_unlock;
+	}
+	embedded_session = lttng_session_create();
+	if (!embedded_session) {
+		ret = -ENOMEM;
+		goto error_unlock;
+	}
+	embedded_session->priv->owner = owner;
+	embedded_session->priv->objd = -1;
+	(void) lttng_ust_session_uuid_validate(embedded_session, embedded_uuid);
+	ret = embedded_create_channel();
+	if (ret)
+		goto error_session;
+	ret = embedded_metadata_preamble(procname);
+	if (ret)
+		goto error_session;
+	ret = embedded_open_streams();
+	if (ret)
+		goto error_session;
+	ret = embedded_create_enablers();
+	if (ret)
+		goto error_session;
+	ret = lttng_session_enable(embedded_session);
+	if (ret)
+		goto error_session;
+	ust_unlock();
+
+	ret = embedded_start_consumer();
+	if (ret)
+		goto error_stop;
+	DBG("Tracing to \"%s\" without session daemon", embedded_path);
+	return 0;
+
+error_stop:
+	if (ust_lock())
+		goto error_unlock;
+error_session:
+	lttng_session_destroy(embedded_session);
+	embedded_session = NULL;
+	embedded_chan = NULL;
+error_unlock:
+	ust_unlock();
+	embedded_close_files();
+	embedded_close(&embedded_shm_fd);
+	return ret;
+}
+
+void lttng_ust_embedded_exit(void)
+{
+	const char quit = 1;
+	int ret;
+
+	if (!embedded_consumer_active)
+		return;
+	/* Stop recording, then let the consumer write the last data. */
+	if (!ust_lock())
+		(void) lttng_session_disable(embedded_session);
+	ust_unlock();
+	if (ust_patient_write(embedded_quit_pipe[1], &quit, sizeof(quit)) < 0)
+		PERROR("write");
+	ret = pthread_join(embedded_consumer, NULL);
+	if (ret)
+		ERR("Error joining the embedded consumer thread: %s", strerror(ret));
+	embedded_consumer_active = 0;
+	embedded_close_files();
+	embedded_close(&embedded_shm_fd);
+	/* The session and its buffers are destroyed with the other sessions. */
+	embedded_session = NULL;
+	embedded_chan = NULL;
+}
+
+void lttng_ust_embedded_after_fork_child(void)
+{
+	/*
+	 * The consumer thread is not running in the child: the session
+	 * inherited from the parent is destroyed with the other sessions,
+	 * and the child traces to its own directory once reinitialized.
+	 */
+	embedded_consumer_active = 0;
+	embedded_close_files();
+	embedded_close(&embedded_shm_fd);
+	embedded_session = NULL;
+	embedded_chan = NULL;
+	embedded_next_event_id = 0;
+	embedded_next_enum_id = 0;
+}
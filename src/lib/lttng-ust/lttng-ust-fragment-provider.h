@@ -0,0 +1,63 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#undef LTTNG_UST_TRACEPOINT_PROVIDER
+#define LTTNG_UST_TRACEPOINT_PROVIDER lttng_ust_fragment
+
+#if !defined(_TRACEPOINT_LTTNG_UST_FRAGMENT_H) || defined(LTTNG_UST_TRACEPOINT_HEADER_MULTI_READ)
+#define _TRACEPOINT_LTTNG_UST_FRAGMENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include <lttng/tracepoint.h>
+
+/*
+ * Fragment of the payload of a record larger than a sub-buffer. The
+ * ring buffer client writes these events itself, in the channel of the
+ * fragmented record, when this event is enabled in that channel: the
+ * field layout must match lttng_event_write_fragments().
+ *
+ * @id identifies the fragmented record within its channel, @event_id
+ * is the ID of its event, @total_len the length of its payload and
+ * @offset the position of @data within that payload. @flags holds
+ * LTTNG_UST_FRAGMENT_FLAG_CONTINUED for every fragment but the first,
+ * and LTTNG_UST_FRAGMENT_FLAG_MORE for every fragment but the last.
+ */
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_fragment, record,
+	LTTNG_UST_TP_ARGS(
+		uint64_t, id,
+		uint32_t, event_id,
+		uint32_t, total_len,
+		uint32_t, offset,
+		uint8_t, flags,
+		const uint8_t *, data,
+		uint32_t, len
+	),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer(uint64_t, id, id)
+		lttng_ust_field_integer(uint32_t, event_id, event_id)
+		lttng_ust_field_integer(uint32_t, total_len, total_len)
+		lttng_ust_field_integer(uint32_t, offset, offset)
+		lttng_ust_field_integer_hex(uint8_t, flags, flags)
+		lttng_ust_field_sequence_hex(uint8_t, data, data, uint32_t, len)
+	)
+)
+
+#endif /* _TRACEPOINT_LTTNG_UST_FRAGMENT_H */
+
+#undef LTTNG_UST_TRACEPOINT_INCLUDE
+#define LTTNG_UST_TRACEPOINT_INCLUDE "./lttng-ust-fragment-provider.h"
+
+/* This part must be outside ifdef protection */
+#include <lttng/tracepoint-event.h>
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,407 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Tracer self-metrics: a per-cpu counter of one element per metric,
+ * placed in a POSIX shared memory object named after the process id
+ * so that lttng-ust-ctl can read it without any tracing session.
+ *
+ * Per-event counters, each a per-cpu counter of one row per event
+ * description, whose names are kept in a second shared memory object:
+ *
+ * - Event discards: the records of each event which could not be
+ *   reserved, kept along the tracer self-metrics.
+ * - Probe overhead: the cycles spent in the probes of the providers
+ *   built with LTTNG_UST_TRACEPOINT_PROBE_OVERHEAD.
+ */
+
+#define _LGPL_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lttng/ust-arch.h>
+#include <lttng/ust-events.h>
+
+#include "common/counter/counter.h"
+#include "common/events.h"
+#include "common/getenv.h"
+#include "common/logging.h"
+#include "common/metrics.h"
+#include "common/ust-fd.h"
+
+#include "lib/lttng-ust/events.h"
+#include "lttng-tracer-core.h"
+
+#define EVENT_COUNTER_DEFAULT_NR_SLOTS	1024
+
+/*
+ * Per-cpu counter of one row per event description and nr_values
+ * columns, in the shm object named after kind, with the event names of
+ * its rows in the shm object named after kind-names.
+ */
+struct event_counter {
+	const char *kind;
+	size_t nr_values;
+	struct lib_counter **counter;
+	struct lttng_ust_metrics_event_names *names;
+	size_t names_len;
+	const struct lttng_ust_event_desc **descs;
+	uint32_t nr_slots;
+	char shm_name[LTTNG_UST_METRICS_SHM_NAME_LEN];
+	char names_shm_name[LTTNG_UST_METRICS_SHM_NAME_LEN];
+};
+
+static char metrics_shm_name[LTTNG_UST_METRICS_SHM_NAME_LEN];
+
+static struct lib_counter *overhead_counter;
+
+static struct event_counter probe_overhead = {
+	.kind = "probe-overhead",
+	.nr_values = NR_LTTNG_UST_PROBE_OVERHEAD_VALUES,
+	.counter = &overhead_counter,
+};
+
+static struct event_counter event_discards = {
+	.kind = "event-discards",
+	.nr_values = 1,
+	.counter = &lttng_ust_event_discards_counter,
+};
+
+/* Create a new shm object, returning its fd, added to the fd tracker. */
+static
+int metrics_shm_create(const char *name)
+{
+	int fd, ret;
+
+	lttng_ust_lock_fd_tracker();
+	fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+	if (fd < 0 && errno == EEXIST) {
+		/* Left over by a process which had the same pid. */
+		(void) shm_unlink(name);
+		fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+	}
+	if (fd < 0) {
+		PERROR("shm_open %s", name);
+		lttng_ust_unlock_fd_tracker();
+		return -1;
+	}
+	ret = lttng_ust_add_fd_to_tracker(fd);
+	if (ret < 0) {
+		if (close(fd))
+			PERROR("close");
+		lttng_ust_unlock_fd_tracker();
+		(void) shm_unlink(name);
+		return -1;
+	}
+	lttng_ust_unlock_fd_tracker();
+	return ret;
+}
+
+static
+void metrics_shm_close(int fd)
+{
+	lttng_ust_lock_fd_tracker();
+	if (!close(fd))
+		lttng_ust_delete_fd_from_tracker(fd);
+	else
+		PERROR("close");
+	lttng_ust_unlock_fd_tracker();
+}
+
+/*
+ * Create a counter allocated in a new shm object. The counter keeps
+ * its mapping of the shm object, whose fd is closed.
+ */
+static
+struct lib_counter *metrics_counter_create(const char *name,
+		size_t nr_dimensions, const size_t *max_nr_elem)
+{
+	struct lib_counter *counter;
+	int fd;
+
+	fd = metrics_shm_create(name);
+	if (fd < 0)
+		return NULL;
+	/* Allocates and clears the counters within the shm object. */
+	counter = lttng_counter_create(&lttng_ust_metrics_config, nr_dimensions,
+		max_nr_elem, 0, -1, -1, NULL, true);
+	if (!counter)
+		goto error;
+	if (lttng_counter_set_cpu_all_shm(counter, fd)) {
+		lttng_counter_destroy(counter);
+		goto error;
+	}
+	metrics_shm_close(fd);
+	return counter;
+
+error:
+	metrics_shm_close(fd);
+	(void) shm_unlink(name);
+	return NULL;
+}
+
+static
+int metrics_create(void)
+{
+	size_t max_nr_elem = NR_LTTNG_UST_METRICS;
+	struct lib_counter *counter;
+
+	lttng_ust_metrics_shm_name(getpid(), "metrics", metrics_shm_name);
+	counter = metrics_counter_create(metrics_shm_name, 1, &max_nr_elem);
+	if (!counter)
+		return -1;
+	CMM_STORE_SHARED(lttng_ust_metrics_counter, counter);
+	DBG("Tracer metrics available in shm object %s", metrics_shm_name);
+	return 0;
+}
+
+static
+uint64_t read_cycles(void)
+{
+#ifdef LTTNG_UST_ARCH_X86
+	uint32_t low, high;
+
+	asm volatile ("rdtsc" : "=a" (low), "=d" (high));
+	return ((uint64_t) high << 32) | low;
+#elif defined(LTTNG_UST_ARCH_AARCH64)
+	uint64_t cnt;
+
+	asm volatile ("isb; mrs %0, cntvct_el0" : "=r" (cnt) : : "memory");
+	return cnt;
+#else
+	struct timespec ts;
+
+	/* No cycle counter: nanoseconds. */
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static
+void event_counter_set_name(struct event_counter *ec, uint32_t slot)
+{
+	lttng_ust_format_event_name(ec->descs[slot], ec->names->name[slot]);
+	/* Publish the name before the slot. */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(ec->names->nr_used, slot + 1);
+}
+
+/*
+ * Create the shm objects of the counter and of the event names of @ec,
+ * filling the names of the slots already assigned.
+ */
+static
+int event_counter_create(struct event_counter *ec, uint32_t nr_used)
+{
+	size_t max_nr_elem[2] = { ec->nr_slots, ec->nr_values };
+	struct lttng_ust_metrics_event_names *names;
+	struct lib_counter *counter;
+	char kind[LTTNG_UST_METRICS_SHM_NAME_LEN];
+	size_t names_len;
+	uint32_t slot;
+	int fd;
+
+	names_len = sizeof(*names) + (size_t) ec->nr_slots * LTTNG_UST_ABI_SYM_NAME_LEN;
+	snprintf(kind, sizeof(kind), "%s-names", ec->kind);
+	lttng_ust_metrics_shm_name(getpid(), kind, ec->names_shm_name);
+	fd = metrics_shm_create(ec->names_shm_name);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, names_len)) {
+		PERROR("ftruncate");
+		goto error_names;
+	}
+	names = mmap(NULL, names_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (names == MAP_FAILED) {
+		PERROR("mmap");
+		goto error_names;
+	}
+	metrics_shm_close(fd);
+	names->nr_slots = ec->nr_slots;
+
+	lttng_ust_metrics_shm_name(getpid(), ec->kind, ec->shm_name);
+	counter = metrics_counter_create(ec->shm_name, 2, max_nr_elem);
+	if (!counter) {
+		(void) munmap(names, names_len);
+		(void) shm_unlink(ec->names_shm_name);
+		return -1;
+	}
+	ec->names = names;
+	ec->names_len = names_len;
+	for (slot = 0; slot < nr_used; slot++)
+		event_counter_set_name(ec, slot);
+	CMM_STORE_SHARED(*ec->counter, counter);
+	DBG("Counters of kind %s available in shm object %s", ec->kind,
+		ec->shm_name);
+	return 0;
+
+error_names:
+	metrics_shm_close(fd);
+	(void) shm_unlink(ec->names_shm_name);
+	return -1;
+}
+
+static
+void event_counter_init(struct event_counter *ec, long nr_slots)
+{
+	if (nr_slots <= 0 || nr_slots > UINT16_MAX)
+		nr_slots = EVENT_COUNTER_DEFAULT_NR_SLOTS;
+	ec->descs = calloc(nr_slots, sizeof(*ec->descs));
+	if (!ec->descs)
+		return;
+	ec->nr_slots = nr_slots;
+	if (event_counter_create(ec, 0)) {
+		free(ec->descs);
+		ec->descs = NULL;
+	}
+}
+
+/*
+ * Called with the UST lock held when an event is created. Events of
+ * the same description share their slot. Returns -1 when the counter is
+ * disabled or when all slots are used.
+ */
+static
+int event_counter_slot(struct event_counter *ec,
+		const struct lttng_ust_event_desc *desc)
+{
+	uint32_t slot, nr_used;
+
+	if (!*ec->counter)
+		return -1;
+	nr_used = ec->names->nr_used;
+	for (slot = 0; slot < nr_used; slot++) {
+		if (ec->descs[slot] == desc)
+			return slot;
+	}
+	if (nr_used == ec->nr_slots)
+		return -1;
+	ec->descs[nr_used] = desc;
+	event_counter_set_name(ec, nr_used);
+	return nr_used;
+}
+
+/*
+ * Application threads may still be counting: the counter mapping is
+ * left to the process teardown, only its names are removed.
+ */
+static
+void event_counter_exit(struct event_counter *ec)
+{
+	if (!*ec->counter)
+		return;
+	CMM_STORE_SHARED(*ec->counter, NULL);
+	(void) shm_unlink(ec->shm_name);
+	(void) shm_unlink(ec->names_shm_name);
+}
+
+static
+void event_counter_after_fork_child(struct event_counter *ec)
+{
+	struct lib_counter *counter = *ec->counter;
+	uint32_t nr_used;
+
+	if (!counter)
+		return;
+	nr_used = ec->names->nr_used;
+	*ec->counter = NULL;
+	lttng_counter_destroy(counter);
+	(void) munmap(ec->names, ec->names_len);
+	ec->names = NULL;
+	(void) event_counter_create(ec, nr_used);
+}
+
+int lttng_ust_probe_overhead_slot(const struct lttng_ust_event_desc *desc)
+{
+	return event_counter_slot(&probe_overhead, desc);
+}
+
+int lttng_ust_event_discards_slot(const struct lttng_ust_event_desc *desc)
+{
+	return event_counter_slot(&event_discards, desc);
+}
+
+uint64_t lttng_ust_probe_overhead_begin(void)
+{
+	uint64_t cycles;
+
+	if (caa_likely(!CMM_LOAD_SHARED(overhead_counter)))
+		return 0;
+	cycles = read_cycles();
+	return cycles ? cycles : 1;
+}
+
+void lttng_ust_probe_overhead_end(const struct lttng_ust_event_common *event,
+		uint64_t begin)
+{
+	struct lib_counter *counter = CMM_LOAD_SHARED(overhead_counter);
+	uint64_t cycles = read_cycles();
+	size_t index[2];
+	int slot;
+
+	if (!counter)
+		return;
+	slot = CMM_LOAD_SHARED(event->priv->overhead_slot);
+	if (slot < 0)
+		return;
+	index[0] = slot;
+	index[1] = LTTNG_UST_PROBE_OVERHEAD_HITS;
+	(void) lttng_counter_add(&lttng_ust_metrics_config, counter, index, 1);
+	index[1] = LTTNG_UST_PROBE_OVERHEAD_CYCLES;
+	(void) lttng_counter_add(&lttng_ust_metrics_config, counter, index,
+		cycles - begin);
+}
+
+void lttng_ust_metrics_init(void)
+{
+	const char *str;
+
+	str = lttng_ust_getenv("LTTNG_UST_METRICS");
+	if (str) {
+		if (!lttng_ust_metrics_counter)
+			(void) metrics_create();
+		if (!event_discards.descs)
+			event_counter_init(&event_discards,
+				EVENT_COUNTER_DEFAULT_NR_SLOTS);
+	}
+	str = lttng_ust_getenv("LTTNG_UST_PROBE_OVERHEAD");
+	if (str && !probe_overhead.descs)
+		event_counter_init(&probe_overhead, strtol(str, NULL, 10));
+}
+
+void lttng_ust_metrics_exit(void)
+{
+	if (lttng_ust_metrics_counter) {
+		CMM_STORE_SHARED(lttng_ust_metrics_counter, NULL);
+		(void) shm_unlink(metrics_shm_name);
+	}
+	event_counter_exit(&event_discards);
+	event_counter_exit(&probe_overhead);
+}
+
+/*
+ * The child would otherwise count into the metrics of its parent: the
+ * only thread of the child drops the inherited mappings and creates the
+ * metrics of its own pid. Its events keep their counter slots.
+ */
+void lttng_ust_metrics_after_fork_child(void)
+{
+	struct lib_counter *counter = lttng_ust_metrics_counter;
+
+	if (counter) {
+		lttng_ust_metrics_counter = NULL;
+		lttng_counter_destroy(counter);
+		(void) metrics_create();
+	}
+	event_counter_after_fork_child(&event_discards);
+	event_counter_after_fork_child(&probe_overhead);
+}
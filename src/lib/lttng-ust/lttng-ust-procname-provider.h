@@ -0,0 +1,49 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#undef LTTNG_UST_TRACEPOINT_PROVIDER
+#define LTTNG_UST_TRACEPOINT_PROVIDER lttng_ust_procname
+
+#if !defined(_TRACEPOINT_LTTNG_UST_PROCNAME_H) || defined(LTTNG_UST_TRACEPOINT_HEADER_MULTI_READ)
+#define _TRACEPOINT_LTTNG_UST_PROCNAME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <lttng/ust-events.h>
+
+#include <lttng/tracepoint.h>
+
+/*
+ * Emitted the first time a thread name is interned, so sessions which
+ * are active at that point can map procname_id context values back to
+ * names. Sessions created later get the mapping from the
+ * lttng_ust_statedump:procname_id events.
+ */
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_procname, intern,
+	LTTNG_UST_TP_ARGS(
+		uint16_t, id,
+		const char *, name
+	),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer(uint16_t, id, id)
+		lttng_ust_field_array_text(char, procname, name, LTTNG_UST_CONTEXT_PROCNAME_LEN)
+	)
+)
+
+#endif /* _TRACEPOINT_LTTNG_UST_PROCNAME_H */
+
+#undef LTTNG_UST_TRACEPOINT_INCLUDE
+#define LTTNG_UST_TRACEPOINT_INCLUDE "./lttng-ust-procname-provider.h"
+
+/* This part must be outside ifdef protection */
+#include <lttng/tracepoint-event.h>
+
+#ifdef __cplusplus
+}
+#endif
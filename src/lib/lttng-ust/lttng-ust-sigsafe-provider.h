@@ -0,0 +1,51 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#undef LTTNG_UST_TRACEPOINT_PROVIDER
+#define LTTNG_UST_TRACEPOINT_PROVIDER lttng_ust_sigsafe
+
+#if !defined(_TRACEPOINT_LTTNG_UST_SIGSAFE_H) || defined(LTTNG_UST_TRACEPOINT_HEADER_MULTI_READ)
+#define _TRACEPOINT_LTTNG_UST_SIGSAFE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include <lttng/tracepoint.h>
+
+/*
+ * Recorded by lttng_ust_sigsafe_record(), typically from a crash
+ * handler.
+ */
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_sigsafe, record,
+	LTTNG_UST_TP_ARGS(
+		int, signo,
+		const char *, msg,
+		size_t, len,
+		void *, ip
+	),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer(int, signo, signo)
+		lttng_ust_field_sequence_text(char, msg, msg, size_t, len)
+		lttng_ust_field_unused(ip)
+	)
+)
+LTTNG_UST_TRACEPOINT_LOGLEVEL(lttng_ust_sigsafe, record, LTTNG_UST_TRACEPOINT_LOGLEVEL_CRIT)
+
+#endif /* _TRACEPOINT_LTTNG_UST_SIGSAFE_H */
+
+#define LTTNG_UST_TP_IP_PARAM ip	/* IP context received as parameter */
+#undef LTTNG_UST_TRACEPOINT_INCLUDE
+#define LTTNG_UST_TRACEPOINT_INCLUDE "./lttng-ust-sigsafe-provider.h"
+
+/* This part must be outside ifdef protection */
+#include <lttng/tracepoint-event.h>
+
+#ifdef __cplusplus
+}
+#endif
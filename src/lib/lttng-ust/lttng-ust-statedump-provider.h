@@ -92,6 +92,55 @@ LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_statedump, procname,
 	)
 )
 
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_statedump, procname_id,
+	LTTNG_UST_TP_ARGS(
+		struct lttng_ust_session *, session,
+		uint16_t, id,
+		const char *, name
+	),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_unused(session)
+		lttng_ust_field_integer(uint16_t, id, id)
+		lttng_ust_field_array_text(char, procname, name, LTTNG_UST_CONTEXT_PROCNAME_LEN)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_statedump, time_ns,
+	LTTNG_UST_TP_ARGS(
+		struct lttng_ust_session *, session,
+		uint64_t, time_ns,
+		int64_t, monotonic_offset,
+		int64_t, boottime_offset
+	),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_unused(session)
+		lttng_ust_field_integer(uint64_t, time_ns, time_ns)
+		lttng_ust_field_integer(int64_t, monotonic_offset, monotonic_offset)
+		lttng_ust_field_integer(int64_t, boottime_offset, boottime_offset)
+	)
+)
+
+LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_statedump, tracef_format,
+	LTTNG_UST_TP_ARGS(
+		struct lttng_ust_session *, session,
+		const void *, site,
+		int, loglevel,
+		const char *, file,
+		int, line,
+		const char *, func,
+		const char *, fmt
+	),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_unused(session)
+		lttng_ust_field_integer_hex(unsigned long, site, (unsigned long) site)
+		lttng_ust_field_integer(int, loglevel, loglevel)
+		lttng_ust_field_integer(int, line, line)
+		lttng_ust_field_string(file, file)
+		lttng_ust_field_string(func, func)
+		lttng_ust_field_string(fmt, fmt)
+	)
+)
+
 LTTNG_UST_TRACEPOINT_EVENT(lttng_ust_statedump, end,
 	LTTNG_UST_TP_ARGS(struct lttng_ust_session *, session),
 	LTTNG_UST_TP_FIELDS(
@@ -7,22 +7,30 @@
  */
 
 #define _LGPL_SOURCE
+#include <errno.h>
 #include <link.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "common/elf.h"
 #include "common/macros.h"
 #include "lttng-tracer-core.h"
 #include "lttng-ust-statedump.h"
+#include "lttng-ust-elf-cache.h"
 #include "common/jhash.h"
 #include "common/getenv.h"
+#include "common/metrics.h"
+#include "common/ringbuffer/frontend.h"
 #include "lib/lttng-ust/events.h"
+#include "context-internal.h"
 
 #define LTTNG_UST_TRACEPOINT_HIDDEN_DEFINITION
 #define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
@@ -59,12 +67,16 @@ struct lttng_ust_dl_node {
 	struct cds_hlist_node node;
 	bool traced;
 	bool marked;
+	uint64_t generation;	/* Table update which added the node. */
 };
 
 #define UST_DL_STATE_HASH_BITS	8
 #define UST_DL_STATE_TABLE_SIZE	(1 << UST_DL_STATE_HASH_BITS)
 static struct cds_hlist_head dl_state_table[UST_DL_STATE_TABLE_SIZE];
 
+/* Count of table updates, protected by the UST lock. */
+static uint64_t dl_generation;
+
 typedef void (*tracepoint_cb)(struct lttng_ust_session *session, void *priv);
 
 static
@@ -174,6 +186,7 @@ struct lttng_ust_dl_node *find_or_create_dl_node(struct bin_info_data *bin_data)
 		e = alloc_dl_node(bin_data);
 		if (!e)
 			return NULL;
+		e->generation = dl_generation;
 		cds_hlist_add_head(&e->node, head);
 	}
 	return e;
@@ -187,7 +200,7 @@ void remove_dl_node(struct lttng_ust_dl_node *e)
 
 /*
  * Trace statedump event into all sessions owned by the caller thread
- * for which statedump is pending.
+ * for which statedump is in progress.
  */
 static
 void trace_statedump_event(tracepoint_cb tp_cb, void *owner, void *priv)
@@ -199,7 +212,7 @@ void trace_statedump_event(tracepoint_cb tp_cb, void *owner, void *priv)
 	cds_list_for_each_entry(session_priv, sessionsp, node) {
 		if (session_priv->owner != owner)
 			continue;
-		if (!session_priv->statedump_pending)
+		if (!session_priv->statedump_active)
 			continue;
 		tp_cb(session_priv->pub, priv);
 	}
@@ -244,6 +257,55 @@ void procname_cb(struct lttng_ust_session *session, void *priv)
 	lttng_ust_tracepoint(lttng_ust_statedump, procname, session, procname);
 }
 
+static
+void procname_id_cb(struct lttng_ust_session *session,
+		void *priv __attribute__((unused)))
+{
+	unsigned int id, nr = lttng_ust_procname_id_count();
+
+	for (id = 0; id < nr; id++) {
+		const char *name = lttng_ust_procname_id_name(id);
+
+		if (!name)
+			continue;
+		lttng_ust_tracepoint(lttng_ust_statedump, procname_id,
+			session, id, name);
+	}
+}
+
+struct time_ns_offsets {
+	ino_t time_ns;
+	int64_t monotonic;
+	int64_t boottime;
+};
+
+static
+void time_ns_cb(struct lttng_ust_session *session, void *priv)
+{
+	struct time_ns_offsets *offsets = (struct time_ns_offsets *) priv;
+
+	lttng_ust_tracepoint(lttng_ust_statedump, time_ns, session,
+		offsets->time_ns, offsets->monotonic, offsets->boottime);
+}
+
+static
+void tracef_format_cb(const void *site,
+		const struct lttng_ust_tracef_site *desc, void *priv)
+{
+	struct lttng_ust_session *session = (struct lttng_ust_session *) priv;
+
+	lttng_ust_tracepoint(lttng_ust_statedump, tracef_format, session,
+		site, desc->loglevel, desc->file, desc->line, desc->func,
+		desc->fmt);
+}
+
+static
+void tracef_formats_cb(struct lttng_ust_session *session,
+		void *priv __attribute__((unused)))
+{
+	lttng_ust_tracef_site_for_each(tracef_format_cb, session);
+}
+
 static
 void trace_start_cb(struct lttng_ust_session *session, void *priv __attribute__((unused)))
 {
@@ -256,11 +318,163 @@ void trace_end_cb(struct lttng_ust_session *session, void *priv __attribute__((u
 	lttng_ust_tracepoint(lttng_ust_statedump, end, session);
 }
 
+#ifndef NT_GNU_BUILD_ID
+# define NT_GNU_BUILD_ID	3
+#endif
+
+/*
+ * Look for the build id note in a PT_NOTE segment mapped by the dynamic
+ * loader. Returns 0 on success, -1 on allocation failure.
+ */
+static
+int get_mapped_build_id(const char *notes, size_t len,
+		struct bin_info_data *bin_data)
+{
+	size_t offset = 0;
+
+	while (offset + sizeof(ElfW(Nhdr)) <= len) {
+		const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *) (notes + offset);
+		size_t desc;
+
+		desc = offset + sizeof(*nhdr) + nhdr->n_namesz;
+		desc += lttng_ust_offset_align(desc, ELF_NOTE_DESC_ALIGN);
+		if (desc + nhdr->n_descsz > len)
+			break;
+		if (nhdr->n_type == NT_GNU_BUILD_ID) {
+			bin_data->build_id = zmalloc(nhdr->n_descsz);
+			if (!bin_data->build_id)
+				return -1;
+			memcpy(bin_data->build_id, notes + desc, nhdr->n_descsz);
+			bin_data->build_id_len = nhdr->n_descsz;
+			bin_data->has_build_id = 1;
+			break;
+		}
+		offset = desc + nhdr->n_descsz;
+		offset += lttng_ust_offset_align(offset, ELF_NOTE_ENTRY_ALIGN);
+	}
+	return 0;
+}
+
+/*
+ * Get the memory size, build id and PIC flag of a loaded object from its
+ * program headers and ELF header, which are mapped in memory, without
+ * reading its file. Returns 1 if the ELF header is not mapped, 0 on
+ * success, -1 on error.
+ */
+static
+int get_mapped_elf_info(struct dl_phdr_info *info,
+		struct bin_info_data *bin_data)
+{
+	uint64_t low_addr = UINT64_MAX, high_addr = 0;
+	const ElfW(Ehdr) *ehdr = NULL;
+	int j;
+
+	for (j = 0; j < info->dlpi_phnum; j++) {
+		const ElfW(Phdr) *phdr = &info->dlpi_phdr[j];
+
+		if (phdr->p_type != PT_LOAD)
+			continue;
+		if (!phdr->p_offset)
+			ehdr = (const ElfW(Ehdr) *) (info->dlpi_addr + phdr->p_vaddr);
+		low_addr = min_t(uint64_t, low_addr, phdr->p_vaddr);
+		high_addr = max_t(uint64_t, high_addr,
+				phdr->p_vaddr + phdr->p_memsz);
+	}
+	if (!ehdr || high_addr < low_addr
+			|| memcmp(ehdr->e_ident, ELFMAG, SELFMAG))
+		return 1;
+	bin_data->memsz = high_addr - low_addr;
+	bin_data->is_pic = ehdr->e_type == ET_DYN;
+
+	for (j = 0; j < info->dlpi_phnum && !bin_data->has_build_id; j++) {
+		const ElfW(Phdr) *phdr = &info->dlpi_phdr[j];
+
+		if (phdr->p_type != PT_NOTE)
+			continue;
+		if (get_mapped_build_id((const char *) (info->dlpi_addr + phdr->p_vaddr),
+				phdr->p_memsz, bin_data))
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * The file is only read for the debug link, which is in a section not
+ * mapped by the dynamic loader, and for objects whose ELF header is not
+ * mapped.
+ */
+static
+int get_cached_elf_info(const struct stat *st, struct bin_info_data *bin_data)
+{
+	struct lttng_ust_elf_cache_info info;
+
+	if (!lttng_ust_elf_cache_lookup(st, &info))
+		return 0;
+	if (info.has_build_id) {
+		bin_data->build_id = zmalloc(info.build_id_len);
+		if (!bin_data->build_id)
+			return 0;
+		memcpy(bin_data->build_id, info.build_id, info.build_id_len);
+		bin_data->build_id_len = info.build_id_len;
+	}
+	if (info.has_debug_link) {
+		bin_data->dbg_file = strdup(info.dbg_file);
+		if (!bin_data->dbg_file) {
+			free(bin_data->build_id);
+			bin_data->build_id = NULL;
+			return 0;
+		}
+		bin_data->crc = info.crc;
+	}
+	bin_data->memsz = info.memsz;
+	bin_data->is_pic = info.is_pic;
+	bin_data->has_build_id = info.has_build_id;
+	bin_data->has_debug_link = info.has_debug_link;
+	return 1;
+}
+
+static
+void cache_elf_info(const struct stat *st, const struct bin_info_data *bin_data)
+{
+	struct lttng_ust_elf_cache_info info;
+
+	if (bin_data->has_build_id
+			&& bin_data->build_id_len > LTTNG_UST_ELF_CACHE_BUILD_ID_MAX)
+		return;
+	if (bin_data->has_debug_link
+			&& strlen(bin_data->dbg_file) >= LTTNG_UST_ELF_CACHE_DBG_FILE_MAX)
+		return;
+	memset(&info, 0, sizeof(info));
+	info.memsz = bin_data->memsz;
+	info.is_pic = bin_data->is_pic;
+	info.has_build_id = bin_data->has_build_id;
+	info.has_debug_link = bin_data->has_debug_link;
+	if (bin_data->has_build_id) {
+		memcpy(info.build_id, bin_data->build_id, bin_data->build_id_len);
+		info.build_id_len = bin_data->build_id_len;
+	}
+	if (bin_data->has_debug_link) {
+		strcpy(info.dbg_file, bin_data->dbg_file);
+		info.crc = bin_data->crc;
+	}
+	lttng_ust_elf_cache_store(st, &info);
+}
+
 static
-int get_elf_info(struct bin_info_data *bin_data)
+int get_elf_info(struct dl_phdr_info *info, struct bin_info_data *bin_data)
 {
 	struct lttng_ust_elf *elf;
-	int ret = 0, found;
+	int ret = 0, found, mapped;
+	struct stat st;
+	bool cached;
+
+	cached = !stat(bin_data->resolved_path, &st);
+	if (cached && get_cached_elf_info(&st, bin_data))
+		return 0;
+
+	mapped = get_mapped_elf_info(info, bin_data);
+	if (mapped < 0)
+		return -1;
 
 	elf = lttng_ust_elf_create(bin_data->resolved_path);
 	if (!elf) {
@@ -268,19 +482,22 @@ int get_elf_info(struct bin_info_data *bin_data)
 		goto end;
 	}
 
-	ret = lttng_ust_elf_get_memsz(elf, &bin_data->memsz);
-	if (ret) {
-		goto end;
-	}
+	if (mapped) {
+		ret = lttng_ust_elf_get_memsz(elf, &bin_data->memsz);
+		if (ret) {
+			goto end;
+		}
 
-	found = 0;
-	ret = lttng_ust_elf_get_build_id(elf, &bin_data->build_id,
-					&bin_data->build_id_len,
-					&found);
-	if (ret) {
-		goto end;
+		found = 0;
+		ret = lttng_ust_elf_get_build_id(elf, &bin_data->build_id,
+						&bin_data->build_id_len,
+						&found);
+		if (ret) {
+			goto end;
+		}
+		bin_data->has_build_id = !!found;
+		bin_data->is_pic = lttng_ust_elf_is_pic(elf);
 	}
-	bin_data->has_build_id = !!found;
 	found = 0;
 	ret = lttng_ust_elf_get_debug_link(elf, &bin_data->dbg_file,
 					&bin_data->crc,
@@ -289,34 +506,60 @@ int get_elf_info(struct bin_info_data *bin_data)
 		goto end;
 	}
 	bin_data->has_debug_link = !!found;
-
-	bin_data->is_pic = lttng_ust_elf_is_pic(elf);
+	if (cached)
+		cache_elf_info(&st, bin_data);
 
 end:
 	lttng_ust_elf_destroy(elf);
 	return ret;
 }
 
+/*
+ * In incremental mode, only sessions which did not dump the node's
+ * table update yet get its events.
+ */
+static
+void trace_baddr_event(tracepoint_cb tp_cb, void *owner,
+		struct lttng_ust_dl_node *e, bool incremental)
+{
+	struct cds_list_head *sessionsp;
+	struct lttng_ust_session_private *session_priv;
+
+	sessionsp = lttng_get_sessions();
+	cds_list_for_each_entry(session_priv, sessionsp, node) {
+		if (session_priv->owner != owner)
+			continue;
+		if (!session_priv->statedump_active)
+			continue;
+		if (incremental && e->generation <= session_priv->statedump_dl_generation)
+			continue;
+		tp_cb(session_priv->pub, &e->bin_data);
+	}
+}
+
+/* The events describing an object share a single time-stamp. */
 static
-void trace_baddr(struct bin_info_data *bin_data, void *owner)
+void trace_baddr(struct lttng_ust_dl_node *e, void *owner, bool incremental)
 {
-	trace_statedump_event(trace_bin_info_cb, owner, bin_data);
+	lib_ring_buffer_tsc_share_begin();
+	trace_baddr_event(trace_bin_info_cb, owner, e, incremental);
 
-	if (bin_data->has_build_id)
-		trace_statedump_event(trace_build_id_cb, owner, bin_data);
+	if (e->bin_data.has_build_id)
+		trace_baddr_event(trace_build_id_cb, owner, e, incremental);
 
-	if (bin_data->has_debug_link)
-		trace_statedump_event(trace_debug_link_cb, owner, bin_data);
+	if (e->bin_data.has_debug_link)
+		trace_baddr_event(trace_debug_link_cb, owner, e, incremental);
+	lib_ring_buffer_tsc_share_end();
 }
 
 static
-int extract_baddr(struct bin_info_data *bin_data)
+int extract_baddr(struct dl_phdr_info *info, struct bin_info_data *bin_data)
 {
 	int ret = 0;
 	struct lttng_ust_dl_node *e;
 
 	if (!bin_data->vdso) {
-		ret = get_elf_info(bin_data);
+		ret = get_elf_info(info, bin_data);
 		if (ret) {
 			goto end;
 		}
@@ -368,6 +611,7 @@ void iter_begin(struct dl_iterate_data *data)
 		data->cancel = true;
 		return;
 	}
+	dl_generation++;
 
 	/* Ensure all entries are unmarked. */
 	for (i = 0; i < UST_DL_STATE_TABLE_SIZE; i++) {
@@ -383,6 +627,7 @@ void iter_begin(struct dl_iterate_data *data)
 static
 void trace_lib_load(const struct bin_info_data *bin_data, void *ip)
 {
+	lib_ring_buffer_tsc_share_begin();
 	lttng_ust_tracepoint(lttng_ust_lib, load,
 		ip, bin_data->base_addr_ptr, bin_data->resolved_path,
 		bin_data->memsz, bin_data->has_build_id,
@@ -399,6 +644,7 @@ void trace_lib_load(const struct bin_info_data *bin_data, void *ip)
 			ip, bin_data->base_addr_ptr, bin_data->dbg_file,
 			bin_data->crc);
 	}
+	lib_ring_buffer_tsc_share_end();
 }
 
 static
@@ -515,7 +761,7 @@ int extract_bin_info_events(struct dl_phdr_info *info, size_t size __attribute__
 			}
 		}
 
-		ret = extract_baddr(&bin_data);
+		ret = extract_baddr(info, &bin_data);
 		break;
 	}
 end:
@@ -525,8 +771,11 @@ end:
 static
 void ust_dl_table_statedump(void *owner)
 {
+	struct lttng_ust_session_private *session_priv;
+	bool incremental;
 	unsigned int i;
 
+	incremental = lttng_ust_getenv("LTTNG_UST_STATEDUMP_INCREMENTAL");
 	if (ust_lock())
 		goto end;
 
@@ -538,10 +787,15 @@ void ust_dl_table_statedump(void *owner)
 		head = &dl_state_table[i];
 		cds_hlist_for_each_entry_2(e, head, node) {
 			if (e->traced)
-				trace_baddr(&e->bin_data, owner);
+				trace_baddr(e, owner, incremental);
 		}
 	}
 
+	cds_list_for_each_entry(session_priv, lttng_get_sessions(), node) {
+		if (session_priv->owner == owner && session_priv->statedump_active)
+			session_priv->statedump_dl_generation = dl_generation;
+	}
+
 end:
 	ust_unlock();
 }
@@ -576,6 +830,63 @@ void lttng_ust_dl_update(void *ip)
 	iter_end(&data, ip);
 }
 
+/*
+ * Look up the ELF information of the object loaded at @base_addr in the
+ * table of loaded objects, sparing the dynamic linker helper from
+ * reading it from the file again.
+ */
+int lttng_ust_dl_get_bin_info(void *base_addr, struct lttng_ust_dl_bin_info *info)
+{
+	struct lttng_ust_dl_node *found = NULL;
+	unsigned int i;
+	int ret = -ENOENT;
+
+	memset(info, 0, sizeof(*info));
+	if (ust_lock())
+		goto end;
+	for (i = 0; i < UST_DL_STATE_TABLE_SIZE && !found; i++) {
+		struct lttng_ust_dl_node *e;
+
+		cds_hlist_for_each_entry_2(e, &dl_state_table[i], node) {
+			if (e->bin_data.base_addr_ptr == base_addr
+					&& !e->bin_data.vdso) {
+				found = e;
+				break;
+			}
+		}
+	}
+	if (!found)
+		goto end;
+	if (found->bin_data.build_id) {
+		info->build_id = zmalloc(found->bin_data.build_id_len);
+		if (!info->build_id) {
+			ret = -ENOMEM;
+			goto end;
+		}
+		memcpy(info->build_id, found->bin_data.build_id,
+				found->bin_data.build_id_len);
+	}
+	if (found->bin_data.dbg_file) {
+		info->dbg_file = strdup(found->bin_data.dbg_file);
+		if (!info->dbg_file) {
+			free(info->build_id);
+			info->build_id = NULL;
+			ret = -ENOMEM;
+			goto end;
+		}
+	}
+	memcpy(info->resolved_path, found->bin_data.resolved_path, PATH_MAX);
+	info->memsz = found->bin_data.memsz;
+	info->build_id_len = found->bin_data.build_id_len;
+	info->crc = found->bin_data.crc;
+	info->has_build_id = found->bin_data.has_build_id;
+	info->has_debug_link = found->bin_data.has_debug_link;
+	ret = 0;
+end:
+	ust_unlock();
+	return ret;
+}
+
 /*
  * Generate a statedump of base addresses of all shared objects loaded
  * by the traced application, as well as for the application's
@@ -598,6 +909,35 @@ int do_procname_statedump(void *owner)
 		return 0;
 
 	trace_statedump_event(procname_cb, owner, lttng_ust_sockinfo_get_procname(owner));
+	trace_statedump_event(procname_id_cb, owner, NULL);
+	return 0;
+}
+
+/*
+ * Record the clock offsets of the time namespace once per statedump,
+ * so that timestamps of processes in a time namespace can be related to
+ * the ones of other processes without a per-event context field.
+ */
+static
+int do_time_ns_statedump(void *owner)
+{
+	struct time_ns_offsets offsets;
+
+	if (lttng_context_time_ns_get_offsets(&offsets.time_ns,
+			&offsets.monotonic, &offsets.boottime))
+		return 0;
+	trace_statedump_event(time_ns_cb, owner, &offsets);
+	return 0;
+}
+
+/*
+ * Record the formats of the deferred-format tracef call sites which
+ * were called before the session started.
+ */
+static
+int do_tracef_statedump(void *owner)
+{
+	trace_statedump_event(tracef_formats_cb, owner, NULL);
 	return 0;
 }
 
@@ -613,19 +953,40 @@ int do_procname_statedump(void *owner)
  * perform synchronize_rcu with the ust_lock held, which can trigger
  * deadlocks otherwise.
  */
+static
+uint64_t statedump_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 int do_lttng_ust_statedump(void *owner)
 {
+	uint64_t start = 0;
+
+	if (lttng_ust_metrics_enabled())
+		start = statedump_now();
 	ust_lock_nocheck();
 	trace_statedump_start(owner);
+	do_procname_statedump(owner);
+	do_time_ns_statedump(owner);
+	do_tracef_statedump(owner);
 	ust_unlock();
 
-	do_procname_statedump(owner);
 	do_baddr_statedump(owner);
 
 	ust_lock_nocheck();
 	trace_statedump_end(owner);
 	ust_unlock();
 
+	if (lttng_ust_metrics_enabled()) {
+		lttng_ust_metrics_inc(LTTNG_UST_METRIC_STATEDUMP);
+		lttng_ust_metrics_add(LTTNG_UST_METRIC_STATEDUMP_NS,
+			statedump_now() - start);
+	}
 	return 0;
 }
 
@@ -659,4 +1020,5 @@ void lttng_ust_statedump_destroy(void)
 	lttng_ust__tracepoints__ptrs_destroy();
 	lttng_ust__tracepoints__destroy();
 	ust_dl_state_destroy();
+	lttng_ust_elf_cache_exit();
 }
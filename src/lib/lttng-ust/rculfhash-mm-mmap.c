@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include "rculfhash-internal.h"
 
@@ -35,21 +36,37 @@
  * macOS.
  *
  * For this reason, we keep to original scheme on all platforms except Cygwin.
+ *
+ * Large bucket tables are aligned on, and populated by, huge pages when
+ * transparent huge pages are available, so that their lookups do not
+ * miss the TLB. As the table only grows within its reservation, it is
+ * never copied on resize. The memory is allocated when populated, on
+ * the node of the resizing thread.
  */
-
+#define HUGEPAGE_SIZE		(2UL * 1024 * 1024)
 
 /* Reserve inaccessible memory space without allocating it */
 static
 void *memory_map(size_t length)
 {
-	void *ret;
+	size_t head, map_length = length;
+	char *ret;
 
-	ret = mmap(NULL, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (length >= HUGEPAGE_SIZE)
+		map_length += HUGEPAGE_SIZE;
+	ret = mmap(NULL, map_length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 	if (ret == MAP_FAILED) {
 		perror("mmap");
 		abort();
 	}
-	return ret;
+	if (map_length == length)
+		return ret;
+	/* Trim the reservation to a huge page aligned one. */
+	head = -(uintptr_t) ret & (HUGEPAGE_SIZE - 1);
+	if (head)
+		(void) munmap(ret, head);
+	(void) munmap(ret + head + length, HUGEPAGE_SIZE - head);
+	return ret + head;
 }
 
 static
@@ -93,6 +110,11 @@ void memory_populate(void *ptr, size_t length)
 		perror("mmap");
 		abort();
 	}
+#ifdef MADV_HUGEPAGE
+	/* Best effort, the new mapping does not inherit the advice. */
+	if (length >= HUGEPAGE_SIZE)
+		(void) madvise(ptr, length, MADV_HUGEPAGE);
+#endif
 }
 
 /*
@@ -0,0 +1,49 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Async-signal-safe record API, for crash handlers to record their last
+ * words in flight recorder sessions.
+ */
+
+#define _LGPL_SOURCE
+#include <stddef.h>
+#include <urcu/compiler.h>
+#include <urcu/tls-compat.h>
+#include <lttng/ust-thread.h>
+#include <lttng/urcu/urcu-ust.h>
+
+#include "common/macros.h"
+#include "common/ringbuffer/frontend.h"
+#include "lib/lttng-ust/lttng-tracer-core.h"
+
+#define LTTNG_UST_TRACEPOINT_HIDDEN_DEFINITION
+#define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
+
+#define LTTNG_UST_TRACEPOINT_CREATE_PROBES
+#define LTTNG_UST_TRACEPOINT_DEFINE
+#include "lttng-ust-sigsafe-provider.h"
+
+/*
+ * Set once lttng_ust_init_thread() has prepared the current thread: its
+ * TLS is allocated and it is registered as URCU reader, so the
+ * tracepoint path neither allocates memory nor takes locks.
+ */
+static DEFINE_URCU_TLS(int, sigsafe_ready);
+
+void lttng_ust_sigsafe_init_thread(void)
+{
+	lttng_ust_urcu_register_thread();
+	URCU_TLS(sigsafe_ready) = 1;
+}
+
+void lttng_ust_sigsafe_record(int signo, const char *msg, size_t len)
+{
+	if (caa_unlikely(!URCU_TLS(sigsafe_ready)))
+		return;
+	lib_ring_buffer_nesting_reserve_begin();
+	lttng_ust_tracepoint(lttng_ust_sigsafe, record, signo, msg, len,
+		LTTNG_UST_CALLER_IP());
+	lib_ring_buffer_nesting_reserve_end();
+}
@@ -5,8 +5,17 @@
  */
 
 #define _LGPL_SOURCE
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu/compiler.h>
+#include <urcu/uatomic.h>
+#include <urcu/tls-compat.h>
 #include "common/macros.h"
+#include "lib/lttng-ust/lttng-tracer-core.h"
 
 /* The tracepoint definition is public, but the provider definition is hidden. */
 #define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
@@ -15,6 +24,64 @@
 #define LTTNG_UST_TRACEPOINT_DEFINE
 #include "lttng-ust-tracef-provider.h"
 
+/*
+ * Per-thread scratch buffer for the formatted messages, which spares a
+ * heap allocation for each message fitting in it. It is only used by
+ * the outermost tracef/tracelog call of a thread: calls nested from a
+ * signal handler, and longer messages, fall back on vasprintf().
+ */
+#define TRACEF_SCRATCH_LEN	512
+
+struct tracef_scratch {
+	int nest;
+	char buf[TRACEF_SCRATCH_LEN];
+};
+
+static DEFINE_URCU_TLS(struct tracef_scratch, tracef_scratch);
+
+int lttng_ust_tracef_msg_get(char **msg, const char *fmt, va_list ap)
+{
+	struct tracef_scratch *scratch = &URCU_TLS(tracef_scratch);
+	int len;
+
+	if (!scratch->nest++) {
+		va_list ap_copy;
+
+		cmm_barrier();
+		va_copy(ap_copy, ap);
+		len = vsnprintf(scratch->buf, sizeof(scratch->buf), fmt, ap_copy);
+		va_end(ap_copy);
+		if (len >= 0 && len < (int) sizeof(scratch->buf)) {
+			*msg = scratch->buf;
+			return len;
+		}
+	}
+	len = vasprintf(msg, fmt, ap);
+	if (len < 0) {
+		cmm_barrier();
+		scratch->nest--;
+	}
+	return len;
+}
+
+void lttng_ust_tracef_msg_put(char *msg)
+{
+	struct tracef_scratch *scratch = &URCU_TLS(tracef_scratch);
+
+	if (msg != scratch->buf)
+		free(msg);
+	cmm_barrier();
+	scratch->nest--;
+}
+
+/*
+ * Force a read (imply TLS allocation for dlopen) of TLS variables.
+ */
+void lttng_tracef_alloc_tls(void)
+{
+	asm volatile ("" : : "m" (URCU_TLS(tracef_scratch)));
+}
+
 static inline
 void lttng_ust___vtracef(const char *fmt, va_list ap)
 	__attribute__((always_inline, format(printf, 1, 0)));
@@ -22,14 +89,14 @@ static inline
 void lttng_ust___vtracef(const char *fmt, va_list ap)
 {
 	char *msg;
-	const int len = vasprintf(&msg, fmt, ap);
+	const int len = lttng_ust_tracef_msg_get(&msg, fmt, ap);
 
 	/* len does not include the final \0 */
 	if (len < 0)
 		goto end;
 	lttng_ust_tracepoint_cb_lttng_ust_tracef___event(msg, len,
 		LTTNG_UST_CALLER_IP());
-	free(msg);
+	lttng_ust_tracef_msg_put(msg);
 end:
 	return;
 }
@@ -51,3 +118,360 @@ void lttng_ust__tracef(const char *fmt, ...)
 	lttng_ust___vtracef(fmt, ap);
 	va_end(ap);
 }
+
+/*
+ * Deferred-format tracef.
+ *
+ * The format string of each call site is parsed on its first call to
+ * find the class of each argument, and recorded by the
+ * lttng_ust_tracef:format event. The following calls only record the
+ * call site id and the argument values, packed in native byte order
+ * without padding:
+ *
+ * - integer and pointer arguments as 64-bit integers,
+ * - floating point arguments as doubles,
+ * - string arguments as null-terminated strings, truncated to fit.
+ *
+ * Formats which cannot be decoded from such a record (positional
+ * arguments, wide strings, %n, or too many arguments) are formatted at
+ * trace time and recorded by the lttng_ust_tracef:event event instead.
+ *
+ * Call sites are kept in a lock-free list, which is never freed, so the
+ * statedump can record the formats of all the call sites already seen.
+ * They hold a copy of the call site descriptor strings, as the call
+ * site may belong to an object which is unloaded since then.
+ */
+#define TRACEF_DEFERRED_MAX_ARGS	16
+#define TRACEF_DEFERRED_ARGS_LEN	LTTNG_UST_TRACEF_DEFERRED_ARGS_LEN
+
+lttng_ust_static_assert(TRACEF_DEFERRED_MAX_ARGS * sizeof(uint64_t) < TRACEF_DEFERRED_ARGS_LEN,
+		"Deferred tracef arguments do not fit in their buffer",
+		Deferred_tracef_arguments_do_not_fit_in_their_buffer);
+
+enum tracef_arg_class {
+	TRACEF_ARG_INT		= 'i',
+	TRACEF_ARG_LONG		= 'l',
+	TRACEF_ARG_LONG_LONG	= 'q',
+	TRACEF_ARG_INTMAX	= 'j',
+	TRACEF_ARG_SIZE		= 'z',
+	TRACEF_ARG_PTRDIFF	= 't',
+	TRACEF_ARG_POINTER	= 'p',
+	TRACEF_ARG_DOUBLE	= 'd',
+	TRACEF_ARG_LONG_DOUBLE	= 'D',
+	TRACEF_ARG_STRING	= 's',
+};
+
+struct tracef_site_node {
+	struct tracef_site_node *next;
+	const void *site;		/* NULL once superseded. */
+	struct lttng_ust_tracef_site desc;
+	int nr_args;			/* -1 if not deferrable. */
+	char args[TRACEF_DEFERRED_MAX_ARGS];
+	/* Space needed by the arguments following each argument. */
+	uint16_t reserve[TRACEF_DEFERRED_MAX_ARGS];
+};
+
+static struct tracef_site_node *tracef_sites;
+
+/*
+ * Parse the conversion specifications of a printf format. Returns the
+ * number of arguments, or -1 if the format cannot be deferred.
+ */
+static
+int tracef_parse_format(const char *fmt, char *args)
+{
+	int nr_args = 0;
+
+	for (; *fmt; fmt++) {
+		char arg;
+		int len = 0;
+
+		if (*fmt != '%')
+			continue;
+		fmt++;
+		if (*fmt == '%')
+			continue;
+		/* Flags. */
+		while (*fmt && strchr("-+ #0'I", *fmt))
+			fmt++;
+		/* Width and precision. */
+		while ((*fmt >= '0' && *fmt <= '9') || *fmt == '.' || *fmt == '*') {
+			if (*fmt == '*') {
+				if (nr_args == TRACEF_DEFERRED_MAX_ARGS)
+					return -1;
+				args[nr_args++] = TRACEF_ARG_INT;
+			}
+			fmt++;
+		}
+		if (*fmt == '$')
+			return -1;
+		/* Length modifier. */
+		for (;; fmt++) {
+			if (*fmt == 'h') {
+				continue;
+			} else if (*fmt == 'l') {
+				len = len == 'l' ? 'q' : 'l';
+			} else if (*fmt == 'q' || *fmt == 'L') {
+				len = 'q';
+			} else if (*fmt == 'j' || *fmt == 'z' || *fmt == 'Z' || *fmt == 't') {
+				len = *fmt == 'Z' ? 'z' : *fmt;
+			} else {
+				break;
+			}
+		}
+		switch (*fmt) {
+		case 'd':
+		case 'i':
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			switch (len) {
+			case 'l':
+				arg = TRACEF_ARG_LONG;
+				break;
+			case 'q':
+				arg = TRACEF_ARG_LONG_LONG;
+				break;
+			case 'j':
+				arg = TRACEF_ARG_INTMAX;
+				break;
+			case 'z':
+				arg = TRACEF_ARG_SIZE;
+				break;
+			case 't':
+				arg = TRACEF_ARG_PTRDIFF;
+				break;
+			default:
+				arg = TRACEF_ARG_INT;
+				break;
+			}
+			break;
+		case 'c':
+			/* wint_t is promoted like int. */
+			arg = TRACEF_ARG_INT;
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			arg = len == 'q' ? TRACEF_ARG_LONG_DOUBLE : TRACEF_ARG_DOUBLE;
+			break;
+		case 's':
+			if (len)
+				return -1;
+			arg = TRACEF_ARG_STRING;
+			break;
+		case 'p':
+			arg = TRACEF_ARG_POINTER;
+			break;
+		case 'm':
+			/* glibc extension, consumes no argument. */
+			continue;
+		default:
+			return -1;
+		}
+		if (nr_args == TRACEF_DEFERRED_MAX_ARGS)
+			return -1;
+		args[nr_args++] = arg;
+	}
+	return nr_args;
+}
+
+static
+void tracef_site_free(struct tracef_site_node *node)
+{
+	free((char *) node->desc.fmt);
+	free((char *) node->desc.file);
+	free((char *) node->desc.func);
+	free(node);
+}
+
+static
+struct tracef_site_node *tracef_site_register(struct lttng_ust_tracef_site *site,
+		void (*format_cb)(const void *site,
+			const struct lttng_ust_tracef_site *desc, void *ip),
+		void *ip)
+{
+	struct tracef_site_node *node, *iter, *old;
+	size_t reserve = 0;
+	int i;
+
+	node = zmalloc(sizeof(*node));
+	if (!node)
+		return NULL;
+	node->site = site;
+	node->desc = *site;
+	node->desc.priv = NULL;
+	node->desc.fmt = strdup(site->fmt);
+	node->desc.file = site->file ? strdup(site->file) : NULL;
+	node->desc.func = site->func ? strdup(site->func) : NULL;
+	if (!node->desc.fmt || (site->file && !node->desc.file)
+			|| (site->func && !node->desc.func)) {
+		tracef_site_free(node);
+		return NULL;
+	}
+	node->nr_args = tracef_parse_format(site->fmt, node->args);
+	for (i = node->nr_args - 1; i >= 0; i--) {
+		node->reserve[i] = reserve;
+		reserve += node->args[i] == TRACEF_ARG_STRING ? 1 : sizeof(uint64_t);
+	}
+
+	/* Supersede the node of an unloaded call site at the same address. */
+	for (iter = CMM_LOAD_SHARED(tracef_sites); iter; iter = iter->next) {
+		if (CMM_LOAD_SHARED(iter->site) == site)
+			CMM_STORE_SHARED(iter->site, NULL);
+	}
+	old = CMM_LOAD_SHARED(tracef_sites);
+	do {
+		node->next = old;
+		iter = old;
+	} while ((old = uatomic_cmpxchg(&tracef_sites, iter, node)) != iter);
+	CMM_STORE_SHARED(site->priv, node);
+
+	if (node->nr_args >= 0)
+		format_cb(site, &node->desc, ip);
+	return node;
+}
+
+void lttng_ust_tracef_site_for_each(
+		void (*cb)(const void *site,
+			const struct lttng_ust_tracef_site *desc, void *priv),
+		void *priv)
+{
+	struct tracef_site_node *iter;
+
+	for (iter = CMM_LOAD_SHARED(tracef_sites); iter; iter = iter->next) {
+		const void *site = CMM_LOAD_SHARED(iter->site);
+
+		if (site && iter->nr_args >= 0)
+			cb(site, &iter->desc, priv);
+	}
+}
+
+static
+size_t tracef_pack_string(uint8_t *buf, size_t offset, const char *str,
+		size_t reserve)
+{
+	size_t len;
+
+	if (!str)
+		str = "(null)";
+	len = strnlen(str, TRACEF_DEFERRED_ARGS_LEN - offset - reserve - 1);
+	memcpy(&buf[offset], str, len);
+	buf[offset + len] = '\0';
+	return offset + len + 1;
+}
+
+static
+size_t tracef_pack_u64(uint8_t *buf, size_t offset, uint64_t v)
+{
+	memcpy(&buf[offset], &v, sizeof(v));
+	return offset + sizeof(v);
+}
+
+static
+size_t tracef_pack_double(uint8_t *buf, size_t offset, double v)
+{
+	memcpy(&buf[offset], &v, sizeof(v));
+	return offset + sizeof(v);
+}
+
+int lttng_ust_tracef_site_pack(struct lttng_ust_tracef_site *site,
+		uint8_t *buf, va_list ap,
+		void (*format_cb)(const void *site,
+			const struct lttng_ust_tracef_site *desc, void *ip),
+		void *ip)
+{
+	struct tracef_site_node *node;
+	size_t offset = 0;
+	int i;
+
+	node = CMM_LOAD_SHARED(site->priv);
+	if (caa_unlikely(!node)) {
+		node = tracef_site_register(site, format_cb, ip);
+		if (!node)
+			return -ENOMEM;
+	}
+	if (caa_unlikely(node->nr_args < 0))
+		return -1;
+	for (i = 0; i < node->nr_args; i++) {
+		switch (node->args[i]) {
+		case TRACEF_ARG_INT:
+			offset = tracef_pack_u64(buf, offset, va_arg(ap, int));
+			break;
+		case TRACEF_ARG_LONG:
+			offset = tracef_pack_u64(buf, offset, va_arg(ap, long));
+			break;
+		case TRACEF_ARG_LONG_LONG:
+			offset = tracef_pack_u64(buf, offset, va_arg(ap, long long));
+			break;
+		case TRACEF_ARG_INTMAX:
+			offset = tracef_pack_u64(buf, offset, va_arg(ap, intmax_t));
+			break;
+		case TRACEF_ARG_SIZE:
+			offset = tracef_pack_u64(buf, offset, va_arg(ap, size_t));
+			break;
+		case TRACEF_ARG_PTRDIFF:
+			offset = tracef_pack_u64(buf, offset, va_arg(ap, ptrdiff_t));
+			break;
+		case TRACEF_ARG_POINTER:
+			offset = tracef_pack_u64(buf, offset,
+				(uintptr_t) va_arg(ap, void *));
+			break;
+		case TRACEF_ARG_DOUBLE:
+			offset = tracef_pack_double(buf, offset, va_arg(ap, double));
+			break;
+		case TRACEF_ARG_LONG_DOUBLE:
+			offset = tracef_pack_double(buf, offset,
+				(double) va_arg(ap, long double));
+			break;
+		case TRACEF_ARG_STRING:
+			offset = tracef_pack_string(buf, offset,
+				va_arg(ap, const char *), node->reserve[i]);
+			break;
+		}
+	}
+	return offset;
+}
+
+static
+void tracef_format_cb(const void *site,
+		const struct lttng_ust_tracef_site *desc, void *ip)
+{
+	lttng_ust_tracepoint(lttng_ust_tracef, format, site, desc->fmt, ip);
+}
+
+void lttng_ust__tracef_deferred(struct lttng_ust_tracef_site *site,
+		const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void lttng_ust__tracef_deferred(struct lttng_ust_tracef_site *site,
+		const char *fmt, ...)
+{
+	uint8_t buf[TRACEF_DEFERRED_ARGS_LEN];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = lttng_ust_tracef_site_pack(site, buf, ap, tracef_format_cb,
+		LTTNG_UST_CALLER_IP());
+	if (len >= 0) {
+		lttng_ust_tracepoint_cb_lttng_ust_tracef___deferred(site, buf,
+			len, LTTNG_UST_CALLER_IP());
+	} else if (len == -1) {
+		char *msg;
+
+		/* The arguments were not consumed. */
+		len = lttng_ust_tracef_msg_get(&msg, fmt, ap);
+		if (len >= 0) {
+			lttng_ust_tracepoint_cb_lttng_ust_tracef___event(msg,
+				len, LTTNG_UST_CALLER_IP());
+			lttng_ust_tracef_msg_put(msg);
+		}
+	}
+	va_end(ap);
+}
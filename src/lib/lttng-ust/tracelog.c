@@ -5,8 +5,10 @@
  */
 
 #define _LGPL_SOURCE
+#include <stdint.h>
 #include <stdio.h>
 #include "common/macros.h"
+#include "lib/lttng-ust/lttng-tracer-core.h"
 
 /* The tracepoint definition is public, but the provider definition is hidden. */
 #define LTTNG_UST_TRACEPOINT_PROVIDER_HIDDEN_DEFINITION
@@ -15,6 +17,13 @@
 #define LTTNG_UST_TRACEPOINT_DEFINE
 #include "lttng-ust-tracelog-provider.h"
 
+static
+void tracelog_format_cb(const void *site,
+		const struct lttng_ust_tracef_site *desc, void *ip)
+{
+	lttng_ust_tracepoint(lttng_ust_tracelog, format, site, desc, ip);
+}
+
 #define LTTNG_UST_TRACELOG_CB(level) \
 	static inline \
 	void lttng_ust___vtracelog_##level(const char *file, \
@@ -28,7 +37,7 @@
 			const char *fmt, va_list ap) \
 	{ \
 		char *msg; \
-		const int len = vasprintf(&msg, fmt, ap); \
+		const int len = lttng_ust_tracef_msg_get(&msg, fmt, ap); \
 		\
 		/* len does not include the final \0 */ \
 		if (len < 0) \
@@ -36,7 +45,7 @@
 		lttng_ust_tracepoint_cb_lttng_ust_tracelog___##level(file, \
 			line, func, msg, len, \
 			LTTNG_UST_CALLER_IP()); \
-		free(msg); \
+		lttng_ust_tracef_msg_put(msg); \
 	end: \
 		return; \
 	} \
@@ -73,6 +82,35 @@
 		va_start(ap, fmt); \
 		lttng_ust___vtracelog_##level(file, line, func, fmt, ap); \
 		va_end(ap); \
+	} \
+	\
+	void lttng_ust__tracelog_deferred_##level( \
+			struct lttng_ust_tracef_site *site, \
+			const char *fmt, ...) \
+		__attribute__ ((format(printf, 2, 3))); \
+	\
+	void lttng_ust__tracelog_deferred_##level( \
+			struct lttng_ust_tracef_site *site, \
+			const char *fmt, ...); \
+	void lttng_ust__tracelog_deferred_##level( \
+			struct lttng_ust_tracef_site *site, \
+			const char *fmt, ...) \
+	{ \
+		uint8_t buf[LTTNG_UST_TRACEF_DEFERRED_ARGS_LEN]; \
+		va_list ap; \
+		int len; \
+		\
+		va_start(ap, fmt); \
+		len = lttng_ust_tracef_site_pack(site, buf, ap, \
+			tracelog_format_cb, LTTNG_UST_CALLER_IP()); \
+		if (len >= 0) \
+			lttng_ust_tracepoint_cb_lttng_ust_tracelog___deferred_##level( \
+				site, buf, len, LTTNG_UST_CALLER_IP()); \
+		else if (len == -1) \
+			/* The arguments were not consumed. */ \
+			lttng_ust___vtracelog_##level(site->file, site->line, \
+				site->func, fmt, ap); \
+		va_end(ap); \
 	}
 
 LTTNG_UST_TRACELOG_CB(LTTNG_UST_TRACEPOINT_LOGLEVEL_EMERG)
@@ -51,6 +51,10 @@ def _get_env_value_ms(key, default_s):
 _REG_TIMEOUT = _get_env_value_ms('LTTNG_UST_PYTHON_REGISTER_TIMEOUT', 5)
 _RETRY_REG_DELAY = _get_env_value_ms('LTTNG_UST_PYTHON_REGISTER_RETRY_DELAY', 3)
 
+# when set, the agent registers to the session daemons when the first
+# record is logged instead of at import time
+_LAZY = os.getenv('LTTNG_UST_PYTHON_LAZY') is not None
+
 
 class _TcpClient(object):
     def __init__(self, name, host, port, reg_queue):
@@ -254,6 +258,11 @@ def _get_port_from_file(path):
     port = None
     dbg._pdebug('reading port from file "{}"'.format(path))
 
+    if not os.path.exists(path):
+        # no session daemon: skip registration to it
+        dbg._pdebug('port file "{}" does not exist'.format(path))
+        return None
+
     try:
         f = open(path)
         r_port = int(f.readline())
@@ -273,6 +282,7 @@ def _get_user_home_path():
 
 
 _initialized = False
+_init_lock = threading.Lock()
 _SESSIOND_HOST = '127.0.0.1'
 
 
@@ -382,4 +392,53 @@ def _init_threads():
     dbg._pdebug('leaving')
 
 
-_init_threads()
+class _LazyInitHandler(logging.Handler):
+    # Added to the root logger in lazy mode: initializes the agent when it
+    # sees the first record, then removes itself.
+    def __init__(self):
+        super(self.__class__, self).__init__(level=logging.NOTSET)
+
+    def handle(self, record):
+        root_logger = logging.getLogger()
+        root_logger.removeHandler(self)
+
+        with _init_lock:
+            _init_threads()
+
+        self._last_resort(record)
+        return True
+
+    def emit(self, record):
+        pass
+
+    def _last_resort(self, record):
+        # Without this handler, Logger.callHandlers() would have used the
+        # last resort handler if there were no other handlers for this
+        # record: do the same.
+        last_resort = getattr(logging, 'lastResort', None)
+
+        if last_resort is None or record.levelno < last_resort.level:
+            return
+
+        if record.name == 'root':
+            logger = logging.getLogger()
+        else:
+            logger = logging.getLogger(record.name)
+
+        while logger is not None:
+            if logger.handlers:
+                return
+
+            if not logger.propagate:
+                break
+
+            logger = logger.parent
+
+        last_resort.handle(record)
+
+
+if _LAZY:
+    dbg._pdebug('deferring initialization until the first record is logged')
+    logging.getLogger().addHandler(_LazyInitHandler())
+else:
+    _init_threads()
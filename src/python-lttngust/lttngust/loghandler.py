@@ -6,11 +6,30 @@
 # Copyright (C) 2014 David Goulet <dgoulet@efficios.com>
 
 from __future__ import unicode_literals
+import collections
+import threading
 import logging
 import ctypes
+import os
 
 from .version import __soname_major__
 
+try:
+    # native fast path, built along with the agent library
+    from . import _native
+except (ImportError, OSError):
+    _native = None
+
+
+# when set, records are traced by a dedicated thread instead of the
+# logging thread
+_ASYNC = os.getenv('LTTNG_UST_PYTHON_ASYNC') is not None
+
+# maximum number of records waiting to be traced in asynchronous mode;
+# records logged while the queue is full are dropped
+_ASYNC_QUEUE_SIZE = 65536
+
+
 class _Handler(logging.Handler):
     _LIB_NAME = 'liblttng-ust-python-agent.so.' + __soname_major__
 
@@ -20,12 +39,70 @@ class _Handler(logging.Handler):
 
         # will raise if library is not found: caller should catch
         self.agent_lib = ctypes.cdll.LoadLibrary(_Handler._LIB_NAME)
+        self._queue = None
+        self.dropped_count = 0
+
+        if _ASYNC:
+            # appending to and popping from a deque are atomic, so the
+            # logging threads only take a lock to wake up an idle worker
+            self._queue = collections.deque()
+            self._wakeup = threading.Event()
+            self._idle = False
+            thread = threading.Thread(target=self._async_run,
+                                      name='lttngust async handler')
+            thread.daemon = True
+            thread.start()
+
+    def _trace(self, record, msg=None):
+        if _native is not None:
+            # fields extracted natively, tracepoint fired without the GIL
+            _native.emit(record, msg)
+            return
+
+        if msg is None:
+            msg = record.getMessage()
 
-    def emit(self, record):
         self.agent_lib.py_tracepoint(self.format(record).encode(),
-                                     record.getMessage().encode(),
+                                     msg.encode(),
                                      record.name.encode(),
                                      record.funcName.encode(),
                                      record.lineno, record.levelno,
                                      record.thread,
                                      record.threadName.encode())
+
+    def _async_run(self):
+        while True:
+            try:
+                record, msg = self._queue.popleft()
+            except IndexError:
+                self._idle = True
+                self._wakeup.clear()
+
+                # recheck: a record may have been appended before the
+                # flag was set
+                if not self._queue:
+                    self._wakeup.wait(0.1)
+
+                self._idle = False
+                continue
+
+            try:
+                self._trace(record, msg)
+            except Exception:
+                self.handleError(record)
+
+    def emit(self, record):
+        if self._queue is None:
+            self._trace(record)
+            return
+
+        if len(self._queue) >= _ASYNC_QUEUE_SIZE:
+            self.dropped_count += 1
+            return
+
+        # format the message now: its arguments may change once this
+        # returns
+        self._queue.append((record, record.getMessage()))
+
+        if self._idle:
+            self._wakeup.set()
@@ -0,0 +1,234 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Native log handler fast path of the Python agent: extracts the fields
+ * of a logging.LogRecord with the C API, without creating intermediate
+ * bytes objects, and fires the tracepoint of the agent library
+ * (liblttng-ust-python-agent) with the GIL released.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <time.h>
+
+/* From liblttng-ust-python-agent. */
+void py_tracepoint(const char *asctime, const char *msg,
+		const char *logger_name, const char *funcName, unsigned int lineno,
+		unsigned int int_loglevel, unsigned int thread, const char *threadName);
+
+#if PY_MAJOR_VERSION >= 3
+#define NATIVE_INTERN(s)	PyUnicode_InternFromString(s)
+#else
+#define NATIVE_INTERN(s)	PyString_InternFromString(s)
+#endif
+
+static PyObject *str_getMessage, *str_name, *str_funcName, *str_lineno,
+	*str_levelno, *str_thread, *str_threadName, *str_created, *str_msecs;
+
+/*
+ * Returns the UTF-8 representation of a string attribute value, which
+ * remains valid as long as the value and *tmp are referenced. None
+ * yields an empty string, other objects their str().
+ */
+static
+const char *native_str(PyObject *obj, PyObject **tmp)
+{
+	*tmp = NULL;
+	if (!obj || obj == Py_None)
+		return "";
+#if PY_MAJOR_VERSION >= 3
+	if (PyUnicode_Check(obj))
+		return PyUnicode_AsUTF8(obj);
+	*tmp = PyObject_Str(obj);
+	return *tmp ? PyUnicode_AsUTF8(*tmp) : NULL;
+#else
+	if (PyString_Check(obj))
+		return PyString_AS_STRING(obj);
+	if (PyUnicode_Check(obj))
+		*tmp = PyUnicode_AsUTF8String(obj);
+	else
+		*tmp = PyObject_Str(obj);
+	return *tmp ? PyString_AsString(*tmp) : NULL;
+#endif
+}
+
+/* Reads an integer attribute, None yielding 0. */
+static
+int native_uint_attr(PyObject *record, PyObject *name, unsigned int *val)
+{
+	PyObject *obj;
+	unsigned long v = 0;
+
+	obj = PyObject_GetAttr(record, name);
+	if (!obj)
+		return -1;
+#if PY_MAJOR_VERSION < 3
+	if (PyInt_Check(obj))
+		v = PyInt_AsUnsignedLongMask(obj);
+	else
+#endif
+	if (obj != Py_None)
+		v = PyLong_AsUnsignedLongMask(obj);
+	Py_DECREF(obj);
+	if (v == (unsigned long) -1 && PyErr_Occurred())
+		return -1;
+	*val = (unsigned int) v;
+	return 0;
+}
+
+/*
+ * Formats the creation time of the record like logging.Formatter does
+ * with its default time format, "%Y-%m-%d %H:%M:%S,<msecs>".
+ */
+static
+int native_asctime(PyObject *record, char *buf, size_t len)
+{
+	PyObject *created, *msecs;
+	double created_val, msecs_val;
+	struct tm tm;
+	time_t t;
+	size_t ret;
+
+	created = PyObject_GetAttr(record, str_created);
+	if (!created)
+		return -1;
+	created_val = PyFloat_AsDouble(created);
+	Py_DECREF(created);
+	msecs = PyObject_GetAttr(record, str_msecs);
+	if (!msecs)
+		return -1;
+	msecs_val = PyFloat_AsDouble(msecs);
+	Py_DECREF(msecs);
+	if (PyErr_Occurred())
+		return -1;
+
+	t = (time_t) created_val;
+	if (!localtime_r(&t, &tm))
+		goto error;
+	ret = strftime(buf, len, "%Y-%m-%d %H:%M:%S", &tm);
+	if (!ret || snprintf(buf + ret, len - ret, ",%03d", (int) msecs_val) >= (int) (len - ret))
+		goto error;
+	return 0;
+
+error:
+	PyErr_SetString(PyExc_ValueError, "cannot format the record time");
+	return -1;
+}
+
+/*
+ * emit(record, msg=None): fire the tracepoint for a logging.LogRecord.
+ * The message is record.getMessage() unless given, as when the record
+ * was emitted asynchronously and its message already formatted.
+ */
+static
+PyObject *native_emit(PyObject *self, PyObject *args)
+{
+	PyObject *record, *msg = Py_None, *ret = NULL;
+	PyObject *vals[4] = { NULL }, *tmps[4] = { NULL };
+	const char *msg_str, *name_str, *func_str, *thread_name_str;
+	unsigned int lineno, levelno, thread;
+	char asctime[64];
+	int i;
+
+	(void) self;
+	if (!PyArg_ParseTuple(args, "O|O:emit", &record, &msg))
+		return NULL;
+	if (msg == Py_None) {
+		vals[0] = PyObject_CallMethodObjArgs(record, str_getMessage, NULL);
+	} else {
+		Py_INCREF(msg);
+		vals[0] = msg;
+	}
+	if (!vals[0])
+		goto end;
+	vals[1] = PyObject_GetAttr(record, str_name);
+	vals[2] = PyObject_GetAttr(record, str_funcName);
+	vals[3] = PyObject_GetAttr(record, str_threadName);
+	if (!vals[1] || !vals[2] || !vals[3])
+		goto end;
+	msg_str = native_str(vals[0], &tmps[0]);
+	name_str = native_str(vals[1], &tmps[1]);
+	func_str = native_str(vals[2], &tmps[2]);
+	thread_name_str = native_str(vals[3], &tmps[3]);
+	if (!msg_str || !name_str || !func_str || !thread_name_str)
+		goto end;
+
+	if (native_uint_attr(record, str_lineno, &lineno)
+			|| native_uint_attr(record, str_levelno, &levelno)
+			|| native_uint_attr(record, str_thread, &thread)
+			|| native_asctime(record, asctime, sizeof(asctime)))
+		goto end;
+
+	/* The strings are kept alive by vals and tmps. */
+	Py_BEGIN_ALLOW_THREADS
+	py_tracepoint(asctime, msg_str, name_str, func_str, lineno, levelno,
+		thread, thread_name_str);
+	Py_END_ALLOW_THREADS
+
+	Py_INCREF(Py_None);
+	ret = Py_None;
+end:
+	for (i = 0; i < 4; i++)
+		Py_XDECREF(vals[i]);
+	for (i = 0; i < 4; i++)
+		Py_XDECREF(tmps[i]);
+	return ret;
+}
+
+static PyMethodDef native_methods[] = {
+	{ "emit", native_emit, METH_VARARGS,
+		"emit(record, msg=None): trace a logging.LogRecord" },
+	{ NULL, NULL, 0, NULL },
+};
+
+static
+int native_init_strings(void)
+{
+	str_getMessage = NATIVE_INTERN("getMessage");
+	str_name = NATIVE_INTERN("name");
+	str_funcName = NATIVE_INTERN("funcName");
+	str_lineno = NATIVE_INTERN("lineno");
+	str_levelno = NATIVE_INTERN("levelno");
+	str_thread = NATIVE_INTERN("thread");
+	str_threadName = NATIVE_INTERN("threadName");
+	str_created = NATIVE_INTERN("created");
+	str_msecs = NATIVE_INTERN("msecs");
+	if (!str_getMessage || !str_name || !str_funcName || !str_lineno
+			|| !str_levelno || !str_thread || !str_threadName
+			|| !str_created || !str_msecs)
+		return -1;
+	return 0;
+}
+
+#if PY_MAJOR_VERSION >= 3
+
+static struct PyModuleDef native_module = {
+	PyModuleDef_HEAD_INIT,
+	"lttngust._native",
+	"LTTng-UST Python agent native log handler",
+	-1,
+	native_methods,
+	NULL, NULL, NULL, NULL,
+};
+
+PyMODINIT_FUNC PyInit__native(void)
+{
+	if (native_init_strings())
+		return NULL;
+	return PyModule_Create(&native_module);
+}
+
+#else
+
+PyMODINIT_FUNC init_native(void)
+{
+	if (native_init_strings())
+		return;
+	Py_InitModule3("lttngust._native", native_methods,
+		"LTTng-UST Python agent native log handler");
+}
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * LTTng Userspace Tracer (UST) - stream cacheline sharing benchmark
+ *
+ * Writer threads loop on the accesses the reserve fast path makes to a
+ * stream (read the extended writer state, then compare-and-swap the write
+ * offset), while a reader thread keeps writing either nothing, the
+ * consumed position, which shares the cacheline of the write offset in
+ * the stream layout kept for compatibility, or the checkpoint of the
+ * extended stream state, which is on a reader cacheline of its own. The
+ * writer throughput of each case shows the cost of false sharing between
+ * writers and the consumer.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <urcu/compiler.h>
+#include <urcu/uatomic.h>
+
+#include "common/ringbuffer/frontend_types.h"
+
+enum reader_target {
+	READER_NONE,
+	READER_CONSUMED,
+	READER_EXT,
+};
+
+struct writer {
+	pthread_t thread;
+	unsigned long long ops;
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+static struct lttng_ust_ring_buffer buf;
+static struct lttng_ust_ring_buffer_ext ext;
+
+static volatile int test_go, test_stop;
+
+static
+void *writer_thread(void *arg)
+{
+	struct writer *writer = arg;
+	unsigned long long ops = 0;
+
+	while (!test_go)
+		cmm_barrier();
+
+	while (!test_stop) {
+		long old;
+
+		if (caa_unlikely(CMM_LOAD_SHARED(ext.sample_shift)))
+			continue;
+		old = uatomic_read(&buf.offset.a);
+		if (uatomic_cmpxchg(&buf.offset.a, old, old + 1) == old)
+			ops++;
+	}
+	writer->ops = ops;
+	return NULL;
+}
+
+static
+void *reader_thread(void *arg)
+{
+	enum reader_target target = (enum reader_target) (long) arg;
+	unsigned long pos = 0;
+
+	while (!test_go)
+		cmm_barrier();
+
+	while (!test_stop) {
+		pos++;
+		if (target == READER_CONSUMED)
+			uatomic_set(&buf.consumed, (long) pos);
+		else
+			CMM_STORE_SHARED(ext.checkpoint, pos);
+		caa_cpu_relax();
+	}
+	return NULL;
+}
+
+static
+double run(int nr_writers, unsigned long duration, enum reader_target target)
+{
+	unsigned long long ops = 0;
+	struct timespec start, end;
+	struct writer *writers;
+	pthread_t reader;
+	double elapsed;
+	int i;
+
+	memset(&buf, 0, sizeof(buf));
+	memset(&ext, 0, sizeof(ext));
+	test_go = 0;
+	test_stop = 0;
+
+	writers = calloc(nr_writers, sizeof(*writers));
+	if (!writers) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		if (pthread_create(&writers[i].thread, NULL, writer_thread,
+				&writers[i])) {
+			fprintf(stderr, "thread create %d failed\n", i);
+			exit(1);
+		}
+	}
+	if (target != READER_NONE && pthread_create(&reader, NULL,
+			reader_thread, (void *) (long) target)) {
+		fprintf(stderr, "reader thread create failed\n");
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	test_go = 1;
+	sleep(duration);
+	test_stop = 1;
+
+	for (i = 0; i < nr_writers; i++) {
+		if (pthread_join(writers[i].thread, NULL)) {
+			fprintf(stderr, "thread join %d failed\n", i);
+			exit(1);
+		}
+		ops += writers[i].ops;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (target != READER_NONE && pthread_join(reader, NULL)) {
+		fprintf(stderr, "reader thread join failed\n");
+		exit(1);
+	}
+	free(writers);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	return ops / elapsed;
+}
+
+static
+void usage(char **argv)
+{
+	printf("Usage: %s nr_writers duration(s) <OPTIONS>\n", argv[0]);
+	printf("OPTIONS:\n");
+	printf("        [-j] (JSON output)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	double none, consumed, checkpoint;
+	unsigned long duration;
+	int nr_writers, json_mode = 0;
+
+	if (argc < 3) {
+		usage(argv);
+		exit(1);
+	}
+	nr_writers = atoi(argv[1]);
+	duration = atol(argv[2]);
+	if (argc > 3 && !strcmp(argv[3], "-j"))
+		json_mode = 1;
+
+	none = run(nr_writers, duration, READER_NONE);
+	consumed = run(nr_writers, duration, READER_CONSUMED);
+	checkpoint = run(nr_writers, duration, READER_EXT);
+
+	if (json_mode) {
+		printf("{ \"nr_writers\": %d, \"duration_s\": %lu, "
+			"\"ops_per_s_no_reader\": %.0f, "
+			"\"ops_per_s_reader_same_line\": %.0f, "
+			"\"ops_per_s_reader_own_line\": %.0f }\n",
+			nr_writers, duration, none, consumed, checkpoint);
+	} else {
+		printf("Writer operations/s, %d writer(s):\n", nr_writers);
+		printf("  no reader:                           %.0f\n", none);
+		printf("  reader writing consumed (same line): %.0f\n", consumed);
+		printf("  reader writing checkpoint (own line): %.0f\n", checkpoint);
+	}
+	return 0;
+}
@@ -0,0 +1,501 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * LTTng Userspace Tracer (UST) - filter bytecode benchmark
+ *
+ * Links hand-assembled filter bytecodes, as generated by lttng-tools
+ * for usual filter expressions, against a synthetic event and context,
+ * and measures the time taken by each evaluation: with the interpreter
+ * function selected when the filter is enabled, which may be the
+ * natively compiled one, and with the generic interpreter.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <lttng/ust-events.h>
+
+#include "common/events.h"
+#include "common/dynamic-type.h"
+#include "lib/lttng-ust/lttng-bytecode.h"
+#include "lib/lttng-ust/context-internal.h"
+
+#define BC_MAX_LEN	256
+
+struct bc_builder {
+	char code[BC_MAX_LEN];
+	uint32_t len;
+	char relocs[BC_MAX_LEN];
+	uint32_t reloc_len;
+};
+
+struct program {
+	const char *name;
+	const char *expr;
+	void (*build)(struct bc_builder *b);
+};
+
+/* Interpreter stack data of the event, following its field order. */
+struct payload {
+	int64_t intfield;
+	const char *strfield;
+	unsigned long arr_len;
+	const int *arr;
+};
+
+static
+const struct lttng_ust_type_array arr_type = {
+	.parent = {
+		.type = lttng_ust_type_array,
+	},
+	.struct_size = sizeof(struct lttng_ust_type_array),
+	.elem_type = lttng_ust_type_integer_define(int, LTTNG_UST_BYTE_ORDER, 10),
+	.length = 4,
+	.alignment = 0,
+	.encoding = lttng_ust_string_encoding_none,
+};
+
+static
+const struct lttng_ust_type_string str_type = {
+	.parent = {
+		.type = lttng_ust_type_string,
+	},
+	.struct_size = sizeof(struct lttng_ust_type_string),
+	.encoding = lttng_ust_string_encoding_UTF8,
+};
+
+static
+const struct lttng_ust_type_common dynamic_type = {
+	.type = lttng_ust_type_dynamic,
+};
+
+static struct lttng_ust_event_field intfield = {
+	.struct_size = sizeof(struct lttng_ust_event_field),
+	.name = "intfield",
+	.type = lttng_ust_type_integer_define(int64_t, LTTNG_UST_BYTE_ORDER, 10),
+}, strfield = {
+	.struct_size = sizeof(struct lttng_ust_event_field),
+	.name = "strfield",
+	.type = &str_type.parent,
+}, arrfield = {
+	.struct_size = sizeof(struct lttng_ust_event_field),
+	.name = "arr",
+	.type = &arr_type.parent,
+}, vtid_field = {
+	.struct_size = sizeof(struct lttng_ust_event_field),
+	.name = "vtid",
+	.type = lttng_ust_type_integer_define(int32_t, LTTNG_UST_BYTE_ORDER, 10),
+}, app_field = {
+	.struct_size = sizeof(struct lttng_ust_event_field),
+	.name = "$app.bench:value",
+	.type = &dynamic_type,
+};
+
+static const struct lttng_ust_event_field *event_fields[] = {
+	&intfield, &strfield, &arrfield,
+};
+
+static const struct lttng_ust_probe_desc probe_desc = {
+	.struct_size = sizeof(struct lttng_ust_probe_desc),
+	.provider_name = "bench",
+};
+
+static const struct lttng_ust_tracepoint_class tp_class = {
+	.struct_size = sizeof(struct lttng_ust_tracepoint_class),
+	.fields = event_fields,
+	.nr_fields = 3,
+	.probe_desc = &probe_desc,
+};
+
+static const struct lttng_ust_event_desc event_desc = {
+	.struct_size = sizeof(struct lttng_ust_event_desc),
+	.event_name = "filter",
+	.probe_desc = &probe_desc,
+	.tp_class = &tp_class,
+};
+
+static
+void get_vtid_value(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ctx_value *value)
+{
+	value->sel = LTTNG_UST_DYNAMIC_TYPE_S64;
+	value->u.s64 = 1234;
+}
+
+static
+void get_app_value(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ctx_value *value)
+{
+	value->sel = LTTNG_UST_DYNAMIC_TYPE_S64;
+	value->u.s64 = 7;
+}
+
+static struct lttng_ust_ctx_field ctx_fields[] = {
+	{ .event_field = &vtid_field, .get_value = get_vtid_value },
+	{ .event_field = &app_field, .get_value = get_app_value },
+};
+
+static struct lttng_ust_ctx bench_ctx = {
+	.fields = ctx_fields,
+	.nr_fields = 2,
+	.allocated_fields = 2,
+};
+static struct lttng_ust_ctx *bench_ctx_ptr = &bench_ctx;
+
+static struct lttng_enabler enabler = {
+	.enabled = 1,
+};
+
+/*
+ * The context lookups of the tracer, kept out of the bytecode runtime
+ * library: the benchmark context holds all the fields its bytecodes
+ * refer to.
+ */
+int lttng_get_context_index(struct lttng_ust_ctx *ctx, const char *name)
+{
+	unsigned int i;
+
+	if (!strncmp(name, "$ctx.", strlen("$ctx.")))
+		name += strlen("$ctx.");
+	for (i = 0; i < ctx->nr_fields; i++) {
+		if (!strcmp(ctx->fields[i].event_field->name, name))
+			return i;
+	}
+	return -1;
+}
+
+int lttng_ust_add_app_context_to_ctx_rcu(const char *name __attribute__((unused)),
+		struct lttng_ust_ctx **ctx __attribute__((unused)))
+{
+	return -ENOENT;
+}
+
+void lttng_ust_format_event_name(const struct lttng_ust_event_desc *desc,
+		char *name)
+{
+	strcpy(name, desc->probe_desc->provider_name);
+	strcat(name, ":");
+	strcat(name, desc->event_name);
+}
+
+static
+void emit(struct bc_builder *b, const void *data, size_t len)
+{
+	if (b->len + len > BC_MAX_LEN)
+		abort();
+	memcpy(&b->code[b->len], data, len);
+	b->len += len;
+}
+
+static
+void emit_op(struct bc_builder *b, bytecode_opcode_t op)
+{
+	emit(b, &op, sizeof(op));
+}
+
+static
+void emit_u16(struct bc_builder *b, uint16_t v)
+{
+	emit(b, &v, sizeof(v));
+}
+
+/*
+ * Add a relocation of the instruction about to be emitted, returning
+ * the offset of its name from the start of the relocation table.
+ */
+static
+uint16_t add_reloc(struct bc_builder *b, const char *name)
+{
+	uint16_t insn_offset = b->len;
+	size_t len = strlen(name) + 1;
+
+	if (b->reloc_len + sizeof(insn_offset) + len > BC_MAX_LEN)
+		abort();
+	memcpy(&b->relocs[b->reloc_len], &insn_offset, sizeof(insn_offset));
+	b->reloc_len += sizeof(insn_offset);
+	memcpy(&b->relocs[b->reloc_len], name, len);
+	b->reloc_len += len;
+	return b->reloc_len - len;
+}
+
+static
+void emit_ref(struct bc_builder *b, bytecode_opcode_t op, const char *name)
+{
+	add_reloc(b, name);
+	emit_op(b, op);
+	emit_u16(b, 0);
+}
+
+static
+void emit_symbol(struct bc_builder *b, const char *name)
+{
+	uint16_t offset = add_reloc(b, name);
+
+	emit_op(b, BYTECODE_OP_GET_SYMBOL);
+	emit_u16(b, offset);
+}
+
+static
+void emit_s64(struct bc_builder *b, int64_t v)
+{
+	emit_op(b, BYTECODE_OP_LOAD_S64);
+	emit(b, &v, sizeof(v));
+}
+
+static
+void emit_string(struct bc_builder *b, bytecode_opcode_t op, const char *str)
+{
+	emit_op(b, op);
+	emit(b, str, strlen(str) + 1);
+}
+
+/* intfield == 42 */
+static
+void build_int(struct bc_builder *b)
+{
+	emit_ref(b, BYTECODE_OP_LOAD_FIELD_REF, "intfield");
+	emit_s64(b, 42);
+	emit_op(b, BYTECODE_OP_EQ);
+	emit_op(b, BYTECODE_OP_RETURN);
+}
+
+/* strfield == "hello*" */
+static
+void build_glob(struct bc_builder *b)
+{
+	emit_ref(b, BYTECODE_OP_LOAD_FIELD_REF, "strfield");
+	emit_string(b, BYTECODE_OP_LOAD_STAR_GLOB_STRING, "hello*");
+	emit_op(b, BYTECODE_OP_EQ);
+	emit_op(b, BYTECODE_OP_RETURN);
+}
+
+/* $ctx.vtid == 1234 */
+static
+void build_context(struct bc_builder *b)
+{
+	emit_ref(b, BYTECODE_OP_GET_CONTEXT_REF, "vtid");
+	emit_s64(b, 1234);
+	emit_op(b, BYTECODE_OP_EQ);
+	emit_op(b, BYTECODE_OP_RETURN);
+}
+
+/* $app.bench:value == 7 */
+static
+void build_app_context(struct bc_builder *b)
+{
+	emit_ref(b, BYTECODE_OP_GET_CONTEXT_REF, "$app.bench:value");
+	emit_s64(b, 7);
+	emit_op(b, BYTECODE_OP_EQ);
+	emit_op(b, BYTECODE_OP_RETURN);
+}
+
+/* arr[2] == 3 */
+static
+void build_nested(struct bc_builder *b)
+{
+	emit_op(b, BYTECODE_OP_GET_PAYLOAD_ROOT);
+	emit_symbol(b, "arr");
+	emit_op(b, BYTECODE_OP_GET_INDEX_U16);
+	emit_u16(b, 2);
+	emit_op(b, BYTECODE_OP_LOAD_FIELD);
+	emit_s64(b, 3);
+	emit_op(b, BYTECODE_OP_EQ);
+	emit_op(b, BYTECODE_OP_RETURN);
+}
+
+/* intfield > 10 && strfield == "hello*" */
+static
+void build_and(struct bc_builder *b)
+{
+	uint16_t skip_offset_pos;
+
+	emit_ref(b, BYTECODE_OP_LOAD_FIELD_REF, "intfield");
+	emit_s64(b, 10);
+	emit_op(b, BYTECODE_OP_GT);
+	emit_op(b, BYTECODE_OP_AND);
+	skip_offset_pos = b->len;
+	emit_u16(b, 0);
+	emit_ref(b, BYTECODE_OP_LOAD_FIELD_REF, "strfield");
+	emit_string(b, BYTECODE_OP_LOAD_STAR_GLOB_STRING, "hello*");
+	emit_op(b, BYTECODE_OP_EQ);
+	/* Skip to the return when the first test is false. */
+	memcpy(&b->code[skip_offset_pos], &b->len, sizeof(uint16_t));
+	emit_op(b, BYTECODE_OP_RETURN);
+}
+
+static const struct program programs[] = {
+	{ "int", "intfield == 42", build_int },
+	{ "glob", "strfield == \"hello*\"", build_glob },
+	{ "context", "$ctx.vtid == 1234", build_context },
+	{ "app_context", "$app.bench:value == 7", build_app_context },
+	{ "nested", "arr[2] == 3", build_nested },
+	{ "and", "intfield > 10 && strfield == \"hello*\"", build_and },
+};
+
+static const int arr[4] = { 0, 1, 3, 4 };
+
+static const struct payload payload = {
+	.intfield = 42,
+	.strfield = "hello world",
+	.arr_len = 4,
+	.arr = arr,
+};
+
+static
+struct lttng_ust_bytecode_node *assemble(const struct program *program)
+{
+	struct lttng_ust_bytecode_node *node;
+	struct bc_builder b;
+
+	memset(&b, 0, sizeof(b));
+	program->build(&b);
+	node = calloc(1, sizeof(*node) + b.len + b.reloc_len);
+	if (!node)
+		return NULL;
+	node->type = LTTNG_UST_BYTECODE_TYPE_FILTER;
+	node->enabler = &enabler;
+	node->bc.len = b.len + b.reloc_len;
+	node->bc.reloc_offset = b.len;
+	memcpy(node->bc.data, b.code, b.len);
+	memcpy(node->bc.data + b.len, b.relocs, b.reloc_len);
+	return node;
+}
+
+/* Returns the number of accepted evaluations. */
+static
+unsigned long run(struct lttng_ust_bytecode_runtime *runtime,
+		int (*func)(struct lttng_ust_bytecode_runtime *bytecode_runtime,
+			const char *interpreter_stack_data,
+			struct lttng_ust_probe_ctx *probe_ctx,
+			void *ctx),
+		unsigned long iters, double *ns_per_eval)
+{
+	struct lttng_ust_probe_ctx probe_ctx = {
+		.struct_size = sizeof(struct lttng_ust_probe_ctx),
+	};
+	struct lttng_ust_bytecode_filter_ctx filter_ctx;
+	struct timespec start, end;
+	unsigned long i, accepted = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iters; i++) {
+		filter_ctx.result = LTTNG_UST_BYTECODE_FILTER_REJECT;
+		if (func(runtime, (const char *) &payload, &probe_ctx,
+				&filter_ctx) != LTTNG_UST_BYTECODE_INTERPRETER_OK)
+			continue;
+		if (filter_ctx.result == LTTNG_UST_BYTECODE_FILTER_ACCEPT)
+			accepted++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	*ns_per_eval = ((end.tv_sec - start.tv_sec) * 1e9
+		+ (end.tv_nsec - start.tv_nsec)) / iters;
+	return accepted;
+}
+
+static
+void usage(char **argv)
+{
+	printf("Usage: %s <OPTIONS>\n", argv[0]);
+	printf("OPTIONS:\n");
+	printf("        [-n iterations] (evaluations per filter, default 10000000)\n");
+	printf("        [-j] (JSON output)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long iters = 10000000;
+	int json_mode = 0, failed = 0;
+	unsigned int i;
+
+	for (i = 1; i < (unsigned int) argc; i++) {
+		if (!strcmp(argv[i], "-j")) {
+			json_mode = 1;
+		} else if (!strcmp(argv[i], "-n") && i + 1 < (unsigned int) argc) {
+			iters = strtoul(argv[++i], NULL, 0);
+		} else {
+			usage(argv);
+			exit(1);
+		}
+	}
+	if (!iters) {
+		usage(argv);
+		exit(1);
+	}
+
+	if (json_mode)
+		printf("[\n");
+	for (i = 0; i < LTTNG_ARRAY_SIZE(programs); i++) {
+		const struct program *program = &programs[i];
+		struct cds_list_head runtime_head, bytecode_head;
+		struct lttng_ust_bytecode_runtime *runtime;
+		struct lttng_ust_bytecode_node *node;
+		unsigned long accepted, accepted_interp;
+		double selected_ns, interp_ns;
+		const char *path;
+
+		node = assemble(program);
+		if (!node) {
+			perror("calloc");
+			exit(1);
+		}
+		CDS_INIT_LIST_HEAD(&runtime_head);
+		CDS_INIT_LIST_HEAD(&bytecode_head);
+		cds_list_add(&node->node, &bytecode_head);
+		lttng_enabler_link_bytecode(&event_desc, &bench_ctx_ptr,
+			&runtime_head, &bytecode_head);
+		runtime = cds_list_first_entry(&runtime_head,
+			struct lttng_ust_bytecode_runtime, node);
+		if (cds_list_empty(&runtime_head) || runtime->link_failed) {
+			fprintf(stderr, "Filter \"%s\": link failed\n", program->expr);
+			failed = 1;
+			goto next;
+		}
+		lttng_bytecode_sync_state(runtime);
+		if (runtime->interpreter_func == lttng_bytecode_interpret_compiled)
+			path = "compiled";
+		else
+			path = "interpreter";
+
+		accepted = run(runtime, runtime->interpreter_func, iters,
+			&selected_ns);
+		accepted_interp = run(runtime, lttng_bytecode_interpret, iters,
+			&interp_ns);
+		if (accepted != iters || accepted_interp != iters) {
+			fprintf(stderr, "Filter \"%s\": %lu/%lu evaluations accepted\n",
+				program->expr, accepted, accepted_interp);
+			failed = 1;
+		}
+
+		if (json_mode) {
+			printf("  { \"name\": \"%s\", \"path\": \"%s\", "
+				"\"ns_per_eval\": %.2f, "
+				"\"interpreter_ns_per_eval\": %.2f }%s\n",
+				program->name, path, selected_ns, interp_ns,
+				i + 1 < LTTNG_ARRAY_SIZE(programs) ? "," : "");
+		} else {
+			printf("%-44s %-11s %8.2f ns/eval (interpreter: %.2f ns/eval)\n",
+				program->expr, path, selected_ns, interp_ns);
+		}
+	next:
+		if (!cds_list_empty(&runtime_head)) {
+			struct bytecode_runtime *bc_runtime =
+				caa_container_of(runtime, struct bytecode_runtime, p);
+
+			free(bc_runtime->data);
+			free(bc_runtime);
+		}
+		free(node);
+	}
+	if (json_mode)
+		printf("]\n");
+	return failed;
+}
@@ -0,0 +1,395 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * LTTng Userspace Tracer (UST) - ring buffer benchmark
+ *
+ * Writers record fixed-size events directly into a channel created
+ * through the ring buffer client of the configured mode, while a
+ * consumer thread of the same process reads its sub-buffers, so that
+ * full buffers, sub-buffer switches and blocking writers are exercised
+ * without a session daemon.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <urcu/compiler.h>
+#include <urcu/uatomic.h>
+
+#include "common/events.h"
+#include "common/smp.h"
+#include "common/tracer.h"
+#include "common/ringbuffer/frontend.h"
+#include "common/ringbuffer/frontend_internal.h"
+#include "common/ringbuffer/rb-init.h"
+#include "common/ringbuffer-clients/clients.h"
+
+struct writer {
+	pthread_t thread;
+	unsigned long long written, lost;
+};
+
+static const char *mode = "discard";
+static size_t subbuf_size = 16384, num_subbuf = 4, event_size = 32;
+static int nr_writers, json_mode, no_consumer, consumer_delay_us;
+static unsigned long duration;
+
+static struct lttng_ust_channel_buffer *lttng_chan;
+static struct lttng_ust_event_recorder event_recorder;
+static struct lttng_ust_event_recorder_private event_recorder_priv;
+static unsigned long long consumed_bytes, consumed_subbufs;
+
+static volatile int test_go, test_stop, consumer_stop;
+
+static
+void *writer_thread(void *arg)
+{
+	struct writer *writer = arg;
+	char payload[event_size];
+
+	memset(payload, 'x', event_size);
+	while (!test_go)
+		cmm_barrier();
+
+	while (!test_stop) {
+		struct lttng_ust_ring_buffer_ctx ctx;
+
+		lttng_ust_ring_buffer_ctx_init(&ctx, &event_recorder,
+			event_size, 1, NULL);
+		if (lttng_chan->ops->event_reserve(&ctx) < 0) {
+			writer->lost++;
+			continue;
+		}
+		lttng_chan->ops->event_write(&ctx, payload, event_size, 1);
+		lttng_chan->ops->event_commit(&ctx);
+		writer->written++;
+	}
+	return NULL;
+}
+
+static
+struct lttng_ust_ring_buffer *get_buffer(int cpu)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	int shm_fd, wait_fd, wakeup_fd;
+	uint64_t memory_map_size;
+	void *memory_map_addr;
+
+	return channel_get_ring_buffer(&rb_chan->backend.config, rb_chan,
+		cpu, rb_chan->handle, &shm_fd, &wait_fd, &wakeup_fd,
+		&memory_map_size, &memory_map_addr);
+}
+
+/* Returns the number of sub-buffers consumed. */
+static
+unsigned int consume_buffer(struct lttng_ust_ring_buffer *buf)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	unsigned int nr = 0;
+
+	while (!lib_ring_buffer_get_next_subbuf(buf, rb_chan->handle)) {
+		consumed_bytes += lib_ring_buffer_get_read_data_size(
+			&rb_chan->backend.config, buf, rb_chan->handle);
+		if (consumer_delay_us)
+			usleep(consumer_delay_us);
+		lib_ring_buffer_put_next_subbuf(buf, rb_chan->handle);
+		nr++;
+	}
+	return nr;
+}
+
+static
+void *consumer_thread(void *arg __attribute__((unused)))
+{
+	int cpu;
+
+	while (!consumer_stop) {
+		unsigned int nr = 0;
+
+		for (cpu = 0; cpu < num_possible_cpus(); cpu++) {
+			struct lttng_ust_ring_buffer *buf = get_buffer(cpu);
+
+			if (buf)
+				nr += consume_buffer(buf);
+		}
+		consumed_subbufs += nr;
+		if (!nr)
+			sched_yield();
+	}
+	return NULL;
+}
+
+static
+int create_channel(void)
+{
+	const char *transport_name;
+	struct lttng_transport *transport;
+	int64_t blocking_timeout = 0;
+	unsigned char uuid[LTTNG_UST_UUID_LEN] = { 0 };
+	char shm_path[64];
+	int nr_streams = num_possible_cpus(), i, ret = -1;
+	int stream_fds[nr_streams];
+
+	if (!strcmp(mode, "discard")) {
+		transport_name = "relay-discard-mmap";
+	} else if (!strcmp(mode, "blocking")) {
+		transport_name = "relay-discard-mmap";
+		blocking_timeout = -1;
+	} else if (!strcmp(mode, "overwrite")) {
+		transport_name = "relay-overwrite-mmap";
+	} else {
+		fprintf(stderr, "Unknown mode %s\n", mode);
+		return -1;
+	}
+	transport = lttng_ust_transport_find(transport_name);
+	if (!transport) {
+		fprintf(stderr, "Transport %s not found\n", transport_name);
+		return -1;
+	}
+
+	for (i = 0; i < nr_streams; i++)
+		stream_fds[i] = -1;
+	for (i = 0; i < nr_streams; i++) {
+		snprintf(shm_path, sizeof(shm_path), "/ust-bench-rb-%d-%d",
+			(int) getpid(), i);
+		stream_fds[i] = shm_open(shm_path, O_RDWR | O_CREAT | O_EXCL,
+			S_IRUSR | S_IWUSR);
+		if (stream_fds[i] < 0) {
+			perror("shm_open");
+			goto end;
+		}
+		(void) shm_unlink(shm_path);
+	}
+
+	lttng_chan = transport->ops.priv->channel_create(transport_name, NULL,
+		subbuf_size, num_subbuf, 0, 0, uuid, 0, stream_fds, nr_streams,
+		0, blocking_timeout);
+	if (!lttng_chan) {
+		fprintf(stderr, "Channel creation failed\n");
+		goto end;
+	}
+	lttng_chan->ops = &transport->ops;
+	/* Compact event headers, as for a channel with few events. */
+	lttng_chan->priv->header_type = 1;
+
+	event_recorder.struct_size = sizeof(event_recorder);
+	event_recorder.priv = &event_recorder_priv;
+	event_recorder.chan = lttng_chan;
+	event_recorder_priv.pub = &event_recorder;
+
+	for (i = 0; i < nr_streams; i++) {
+		struct lttng_ust_ring_buffer *buf = get_buffer(i);
+
+		if (!buf || lib_ring_buffer_open_read(buf,
+				lttng_chan->priv->rb_chan->handle)) {
+			fprintf(stderr, "Cannot open stream %d for reading\n", i);
+			goto end;
+		}
+	}
+	ret = 0;
+end:
+	/* The channel keeps its own references on the stream fds. */
+	for (i = 0; i < nr_streams; i++) {
+		if (stream_fds[i] >= 0 && ret)
+			(void) close(stream_fds[i]);
+	}
+	return ret;
+}
+
+/*
+ * Flush the current sub-buffer of each stream and read it, so that the
+ * consumed byte count accounts for everything written.
+ */
+static
+void drain_channel(void)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	int cpu;
+
+	for (cpu = 0; cpu < num_possible_cpus(); cpu++) {
+		struct lttng_ust_ring_buffer *buf = get_buffer(cpu);
+
+		if (!buf)
+			continue;
+		lib_ring_buffer_switch_slow(buf, SWITCH_ACTIVE, rb_chan->handle);
+		if (!no_consumer)
+			consumed_subbufs += consume_buffer(buf);
+	}
+}
+
+static
+unsigned long long sum_counters(size_t offset)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	unsigned long long sum = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < num_possible_cpus(); cpu++) {
+		struct lttng_ust_ring_buffer *buf = get_buffer(cpu);
+
+		if (buf)
+			sum += v_read(&rb_chan->backend.config,
+				(union v_atomic *) ((char *) buf + offset));
+	}
+	return sum;
+}
+
+static
+void usage(char **argv)
+{
+	printf("Usage: %s nr_writers duration(s) <OPTIONS>\n", argv[0]);
+	printf("OPTIONS:\n");
+	printf("        [-m discard|overwrite|blocking] (channel mode, default discard)\n");
+	printf("        [-s bytes] (sub-buffer size, default 16384)\n");
+	printf("        [-n count] (number of sub-buffers, default 4)\n");
+	printf("        [-e bytes] (event payload size, default 32)\n");
+	printf("        [-d us] (consumer delay per sub-buffer)\n");
+	printf("        [-c] (no consumer, buffers fill up)\n");
+	printf("        [-j] (JSON output)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long written = 0, lost = 0, lost_full, lost_wrap;
+	struct timespec start, end;
+	pthread_t consumer;
+	struct writer *writers;
+	double elapsed;
+	int i;
+
+	if (argc < 3) {
+		usage(argv);
+		exit(1);
+	}
+	nr_writers = atoi(argv[1]);
+	duration = atol(argv[2]);
+
+	for (i = 3; i < argc; i++) {
+		if (argv[i][0] != '-')
+			continue;
+		switch (argv[i][1]) {
+		case 'c':
+			no_consumer = 1;
+			continue;
+		case 'j':
+			json_mode = 1;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			usage(argv);
+			exit(1);
+		}
+		switch (argv[i][1]) {
+		case 'm':
+			mode = argv[++i];
+			break;
+		case 's':
+			subbuf_size = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'n':
+			num_subbuf = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'e':
+			event_size = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'd':
+			consumer_delay_us = atoi(argv[++i]);
+			break;
+		default:
+			usage(argv);
+			exit(1);
+		}
+	}
+	if (!strcmp(mode, "blocking") && no_consumer) {
+		fprintf(stderr, "Blocking writers need a consumer\n");
+		exit(1);
+	}
+
+	lttng_ust_ring_buffer_clients_init();
+	if (!strcmp(mode, "blocking"))
+		lttng_ust_ringbuffer_set_allow_blocking();
+	if (create_channel())
+		exit(1);
+
+	writers = calloc(nr_writers, sizeof(*writers));
+	if (!writers) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		if (pthread_create(&writers[i].thread, NULL, writer_thread,
+				&writers[i])) {
+			fprintf(stderr, "thread create %d failed\n", i);
+			exit(1);
+		}
+	}
+	if (!no_consumer && pthread_create(&consumer, NULL, consumer_thread, NULL)) {
+		fprintf(stderr, "consumer thread create failed\n");
+		exit(1);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	test_go = 1;
+	sleep(duration);
+	test_stop = 1;
+
+	for (i = 0; i < nr_writers; i++) {
+		if (pthread_join(writers[i].thread, NULL)) {
+			fprintf(stderr, "thread join %d failed\n", i);
+			exit(1);
+		}
+		written += writers[i].written;
+		lost += writers[i].lost;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	if (!no_consumer) {
+		consumer_stop = 1;
+		if (pthread_join(consumer, NULL)) {
+			fprintf(stderr, "consumer thread join failed\n");
+			exit(1);
+		}
+	}
+	drain_channel();
+	lost_full = sum_counters(offsetof(struct lttng_ust_ring_buffer, records_lost_full));
+	lost_wrap = sum_counters(offsetof(struct lttng_ust_ring_buffer, records_lost_wrap));
+
+	if (json_mode) {
+		printf("{ \"mode\": \"%s\", \"nr_writers\": %d, \"consumer\": %s, "
+			"\"subbuf_size\": %zu, \"num_subbuf\": %zu, "
+			"\"event_size\": %zu, \"duration_s\": %.3f, "
+			"\"events_written\": %llu, \"events_lost\": %llu, "
+			"\"events_lost_full\": %llu, \"events_lost_wrap\": %llu, "
+			"\"events_per_s\": %.0f, \"consumed_bytes\": %llu, "
+			"\"consumed_subbufs\": %llu }\n",
+			mode, nr_writers, no_consumer ? "false" : "true",
+			subbuf_size, num_subbuf, event_size, elapsed,
+			written, lost, lost_full, lost_wrap, written / elapsed,
+			consumed_bytes, consumed_subbufs);
+	} else {
+		printf("Mode: %s, %d writer(s), %s consumer\n", mode, nr_writers,
+			no_consumer ? "no" : "with");
+		printf("Events written: %llu (%.0f/s)\n", written, written / elapsed);
+		printf("Events lost: %llu (buffer full: %llu, nested wrap-around: %llu)\n",
+			lost, lost_full, lost_wrap);
+		printf("Sub-buffers consumed: %llu (%llu bytes)\n",
+			consumed_subbufs, consumed_bytes);
+	}
+
+	lttng_chan->ops->priv->channel_destroy(lttng_chan);
+	free(writers);
+	return 0;
+}
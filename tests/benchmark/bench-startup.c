@@ -0,0 +1,150 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * LTTng Userspace Tracer (UST) - startup and teardown benchmark
+ *
+ * Spawns short-lived processes one after the other and measures the
+ * time from their spawn to their exit, which includes the liblttng-ust
+ * constructor, the listener threads, the registration of the probe
+ * providers and the teardown. The baseline program, not linked with
+ * liblttng-ust, gives the cost of the process itself, so that the
+ * latency added by the tracer can be reported.
+ */
+
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+
+extern char **environ;
+
+struct result {
+	double mean_us, min_us, max_us;
+};
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Returns 0 when every process ran and exited successfully. */
+static
+int spawn_loop(const char *prog, unsigned long count, struct result *result)
+{
+	char *child_argv[] = { (char *) prog, NULL };
+	uint64_t total = 0, min = UINT64_MAX, max = 0;
+	unsigned long i;
+
+	for (i = 0; i < count; i++) {
+		uint64_t start, delta;
+		int ret, status;
+		pid_t pid;
+
+		start = now_ns();
+		ret = posix_spawn(&pid, prog, NULL, NULL, child_argv, environ);
+		if (ret) {
+			fprintf(stderr, "posix_spawn %s: %s\n", prog, strerror(ret));
+			return -1;
+		}
+		if (waitpid(pid, &status, 0) != pid) {
+			perror("waitpid");
+			return -1;
+		}
+		delta = now_ns() - start;
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "%s did not exit successfully\n", prog);
+			return -1;
+		}
+		total += delta;
+		if (delta < min)
+			min = delta;
+		if (delta > max)
+			max = delta;
+	}
+	result->mean_us = total / 1000.0 / count;
+	result->min_us = min / 1000.0;
+	result->max_us = max / 1000.0;
+	return 0;
+}
+
+static
+void usage(char **argv)
+{
+	printf("Usage: %s <OPTIONS> program\n", argv[0]);
+	printf("OPTIONS:\n");
+	printf("        [-n count] (processes spawned, default 1000)\n");
+	printf("        [-b program] (baseline program, not linked with lttng-ust)\n");
+	printf("        [-j] (JSON output)\n");
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *prog = NULL, *baseline = NULL;
+	struct result res, base_res;
+	unsigned long count = 1000;
+	int json_mode = 0, i;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] != '-') {
+			prog = argv[i];
+			continue;
+		}
+		if (argv[i][1] == 'j') {
+			json_mode = 1;
+			continue;
+		}
+		if (i + 1 >= argc) {
+			usage(argv);
+			exit(1);
+		}
+		switch (argv[i][1]) {
+		case 'n':
+			count = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'b':
+			baseline = argv[++i];
+			break;
+		default:
+			usage(argv);
+			exit(1);
+		}
+	}
+	if (!prog || !count) {
+		usage(argv);
+		exit(1);
+	}
+
+	/* Run the baseline first, warming up the page cache for both. */
+	if (baseline && spawn_loop(baseline, count, &base_res))
+		exit(1);
+	if (spawn_loop(prog, count, &res))
+		exit(1);
+
+	if (json_mode) {
+		printf("{ \"program\": \"%s\", \"processes\": %lu, "
+			"\"mean_us\": %.1f, \"min_us\": %.1f, \"max_us\": %.1f",
+			prog, count, res.mean_us, res.min_us, res.max_us);
+		if (baseline)
+			printf(", \"baseline_mean_us\": %.1f, \"added_us\": %.1f",
+				base_res.mean_us, res.mean_us - base_res.mean_us);
+		printf(" }\n");
+	} else {
+		printf("%s: %lu processes, %.1f us/process (min %.1f, max %.1f)\n",
+			prog, count, res.mean_us, res.min_us, res.max_us);
+		if (baseline)
+			printf("Added latency per process: %.1f us (baseline %.1f us)\n",
+				res.mean_us - base_res.mean_us, base_res.mean_us);
+	}
+	return 0;
+}
@@ -8,8 +8,10 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sched.h>
 #include <time.h>
@@ -26,32 +28,186 @@
 			printf(fmt, ## args);	\
 	} while (0)
 
-static int verbose_mode;
+/*
+ * Log-linear latency histogram, in the spirit of HdrHistogram: each
+ * power of two range of values is split in HIST_SUB_BUCKETS linear
+ * buckets, for a relative precision of 1/HIST_SUB_BUCKETS.
+ */
+#define HIST_SUB_BITS		5
+#define HIST_SUB_BUCKETS	(1U << HIST_SUB_BITS)
+#define HIST_NR_BUCKETS		((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct histogram {
+	unsigned long long count;
+	uint64_t min, max;
+	unsigned long long buckets[HIST_NR_BUCKETS];
+};
+
+static int verbose_mode, latency_mode, json_mode;
 
 struct thread_counter {
 	unsigned long long nr_loops;
+	struct histogram *hist;
 };
 
 static int nr_threads;
 static unsigned long duration;
+static size_t payload_len;
+static char *payload;
 
 static volatile int test_go, test_stop;
 
+/*
+ * Timestamps of the latency measurements, in TSC cycles on x86-64,
+ * which are converted to nanoseconds once the run is over.
+ */
+static inline
+uint64_t bench_clock(void)
+{
+#ifdef __x86_64__
+	__builtin_ia32_lfence();
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
 static
-void do_stuff(void)
+uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static
+unsigned int hist_index(uint64_t v)
+{
+	unsigned int shift;
+
+	if (v < 2 * HIST_SUB_BUCKETS)
+		return v;
+	shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+	return shift * HIST_SUB_BUCKETS + (v >> shift);
+}
+
+/* Highest value of a bucket. */
+static
+uint64_t hist_value(unsigned int index)
+{
+	unsigned int shift;
+	uint64_t sub;
+
+	if (index < 2 * HIST_SUB_BUCKETS)
+		return index;
+	shift = index / HIST_SUB_BUCKETS - 1;
+	sub = index % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS;
+	return ((sub + 1) << shift) - 1;
+}
+
+static inline
+void hist_record(struct histogram *hist, uint64_t v)
+{
+	hist->buckets[hist_index(v)]++;
+	hist->count++;
+	if (v < hist->min)
+		hist->min = v;
+	if (v > hist->max)
+		hist->max = v;
+}
+
+static
+void hist_merge(struct histogram *dst, const struct histogram *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < HIST_NR_BUCKETS; i++)
+		dst->buckets[i] += src->buckets[i];
+	dst->count += src->count;
+	if (src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+}
+
+static
+uint64_t hist_percentile(const struct histogram *hist, double percentile)
+{
+	unsigned long long rank, seen = 0;
+	unsigned int i;
+
+	if (!hist->count)
+		return 0;
+	rank = (unsigned long long) (percentile / 100.0 * hist->count);
+	if (rank >= hist->count)
+		rank = hist->count - 1;
+	for (i = 0; i < HIST_NR_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if (seen > rank)
+			break;
+	}
+	/* Clamp the bucket bounds to the observed values. */
+	if (hist_value(i) > hist->max)
+		return hist->max;
+	if (hist_value(i) < hist->min)
+		return hist->min;
+	return hist_value(i);
+}
+
+static
+struct histogram *hist_create(void)
+{
+	struct histogram *hist;
+
+	hist = calloc(1, sizeof(*hist));
+	if (!hist) {
+		perror("calloc");
+		exit(1);
+	}
+	hist->min = UINT64_MAX;
+	return hist;
+}
+
+static inline
+void bench_tracepoint(void)
 {
-	int i;
 #ifdef TRACING
 	int v = 50;
+
+	if (payload_len)
+		lttng_ust_tracepoint(ust_tests_benchmark, tpbench_payload, v,
+			payload, payload_len);
+	else
+		lttng_ust_tracepoint(ust_tests_benchmark, tpbench, v);
 #endif
+}
+
+static
+void do_stuff(void)
+{
+	int i;
 
 	for (i = 0; i < 100; i++)
 		cmm_barrier();
-#ifdef TRACING
-	lttng_ust_tracepoint(ust_tests_benchmark, tpbench, v);
-#endif
+	bench_tracepoint();
 }
 
+static
+void do_stuff_latency(struct histogram *hist)
+{
+	uint64_t start;
+	int i;
+
+	for (i = 0; i < 100; i++)
+		cmm_barrier();
+	start = bench_clock();
+	bench_tracepoint();
+	hist_record(hist, bench_clock() - start);
+}
 
 static
 void *function(void *arg __attribute__((unused)))
@@ -63,7 +219,10 @@ void *function(void *arg __attribute__((unused)))
 		cmm_barrier();
 
 	for (;;) {
-		do_stuff();
+		if (latency_mode)
+			do_stuff_latency(thread_counter->hist);
+		else
+			do_stuff();
 		nr_loops++;
 		if (test_stop)
 			break;
@@ -72,17 +231,47 @@ void *function(void *arg __attribute__((unused)))
 	return NULL;
 }
 
+static
+void print_latency(const struct histogram *hist, double ns_per_tick)
+{
+	const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+	const char *names[] = { "p50", "p90", "p99", "p99.9", "p99.99" };
+	unsigned int i;
+
+	if (json_mode) {
+		printf("{ \"count\": %llu, \"min_ns\": %.0f", hist->count,
+			hist->count ? hist->min * ns_per_tick : 0.0);
+		for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+			printf(", \"%s_ns\": %.0f", names[i],
+				hist_percentile(hist, percentiles[i]) * ns_per_tick);
+		printf(", \"max_ns\": %.0f }", hist->max * ns_per_tick);
+		return;
+	}
+	printf("Latency (ns): min %.0f",
+		hist->count ? hist->min * ns_per_tick : 0.0);
+	for (i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++)
+		printf(", %s %.0f", names[i],
+			hist_percentile(hist, percentiles[i]) * ns_per_tick);
+	printf(", max %.0f\n", hist->max * ns_per_tick);
+}
+
 static
 void usage(char **argv) {
 	printf("Usage: %s nr_threads duration(s) <OPTIONS>\n", argv[0]);
 	printf("OPTIONS:\n");
 	printf("        [-v] (verbose output)\n");
+	printf("        [-l] (measure the latency of each tracepoint)\n");
+	printf("        [-p bytes] (size of the event payload)\n");
+	printf("        [-j] (JSON output)\n");
 	printf("\n");
 }
 
 int main(int argc, char **argv)
 {
 	unsigned long long total_loops = 0;
+	uint64_t start_ns, start_tick, end_ns, end_tick;
+	double ns_per_tick = 1.0;
+	struct histogram *total_hist = NULL;
 	unsigned long i_thr;
 	void *retval;
 	int i;
@@ -102,23 +291,51 @@ int main(int argc, char **argv)
 		case 'v':
 			verbose_mode = 1;
 			break;
+		case 'l':
+			latency_mode = 1;
+			break;
+		case 'j':
+			json_mode = 1;
+			break;
+		case 'p':
+			if (++i >= argc) {
+				usage(argv);
+				exit(1);
+			}
+			payload_len = strtoul(argv[i], NULL, 0);
+			break;
 		}
 	}
+	if (json_mode)
+		verbose_mode = 0;
 
 	printf_verbose("using %d thread(s)\n", nr_threads);
 	printf_verbose("for a duration of %lds\n", duration);
+	printf_verbose("with a payload of %zu bytes\n", payload_len);
+
+	if (payload_len) {
+		payload = malloc(payload_len);
+		if (!payload) {
+			perror("malloc");
+			exit(1);
+		}
+		memset(payload, 'x', payload_len);
+	}
 
 	pthread_t thread[nr_threads];
 	struct thread_counter thread_counter[nr_threads];
 
 	for (i = 0; i < nr_threads; i++) {
 		thread_counter[i].nr_loops = 0;
+		thread_counter[i].hist = latency_mode ? hist_create() : NULL;
 		if (pthread_create(&thread[i], NULL, function, &thread_counter[i])) {
 			fprintf(stderr, "thread create %d failed\n", i);
 			exit(1);
 		}
 	}
 
+	start_ns = monotonic_ns();
+	start_tick = bench_clock();
 	test_go = 1;
 
 	for (i_thr = 0; i_thr < duration; i_thr++) {
@@ -131,14 +348,61 @@ int main(int argc, char **argv)
 	printf_verbose("\n");
 
 	test_stop = 1;
+	end_ns = monotonic_ns();
+	end_tick = bench_clock();
+	if (end_tick > start_tick)
+		ns_per_tick = (double) (end_ns - start_ns) / (end_tick - start_tick);
 
+	if (latency_mode)
+		total_hist = hist_create();
 	for (i = 0; i < nr_threads; i++) {
 		if (pthread_join(thread[i], &retval)) {
 			fprintf(stderr, "thread join %d failed\n", i);
 			exit(1);
 		}
 		total_loops += thread_counter[i].nr_loops;
+		if (latency_mode)
+			hist_merge(total_hist, thread_counter[i].hist);
+	}
+
+	if (json_mode) {
+		printf("{ \"tracing\": %s, \"nr_threads\": %d, \"duration_s\": %lu, "
+			"\"payload_bytes\": %zu, \"nr_loops\": %llu",
+#ifdef TRACING
+			"true",
+#else
+			"false",
+#endif
+			nr_threads, duration, payload_len, total_loops);
+		if (latency_mode) {
+			printf(", \"latency\": ");
+			print_latency(total_hist, ns_per_tick);
+			printf(", \"threads\": [");
+			for (i = 0; i < nr_threads; i++) {
+				printf("%s", i ? ", " : " ");
+				print_latency(thread_counter[i].hist, ns_per_tick);
+			}
+			printf(" ]");
+		}
+		printf(" }\n");
+	} else {
+		printf("Number of loops: %llu\n", total_loops);
+		if (latency_mode) {
+			print_latency(total_hist, ns_per_tick);
+			if (verbose_mode) {
+				for (i = 0; i < nr_threads; i++) {
+					printf("Thread %d: ", i);
+					print_latency(thread_counter[i].hist, ns_per_tick);
+				}
+			}
+		}
+	}
+
+	if (latency_mode) {
+		for (i = 0; i < nr_threads; i++)
+			free(thread_counter[i].hist);
+		free(total_hist);
 	}
-	printf("Number of loops: %llu\n", total_loops);
+	free(payload);
 	return 0;
 }
@@ -0,0 +1,35 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * LTTng Userspace Tracer (UST) - startup benchmark process
+ *
+ * Exits right away: spawned repeatedly by bench_startup, it only pays
+ * for the loading, constructors and destructors of what it is linked
+ * with. Built without any provider as the baseline, and with the small
+ * or the large provider linked against liblttng-ust.
+ */
+
+#if defined(STARTUP_SMALL)
+#define LTTNG_UST_TRACEPOINT_DEFINE
+#include "ust_tests_benchmark.h"
+#elif defined(STARTUP_LARGE)
+#define LTTNG_UST_TRACEPOINT_DEFINE
+#include "ust_tests_startup.h"
+#endif
+
+int main(int argc, char **argv __attribute__((unused)))
+{
+	/* Never true, keeps the tracepoint call sites. */
+#if defined(STARTUP_SMALL)
+	if (argc < 0)
+		lttng_ust_tracepoint(ust_tests_benchmark, tpbench, argc);
+#elif defined(STARTUP_LARGE)
+	if (argc < 0)
+		lttng_ust_tracepoint(ust_tests_startup, event0, argc);
+#else
+	(void) argc;
+#endif
+	return 0;
+}
@@ -19,6 +19,14 @@ LTTNG_UST_TRACEPOINT_EVENT(ust_tests_benchmark, tpbench,
 	)
 )
 
+LTTNG_UST_TRACEPOINT_EVENT(ust_tests_benchmark, tpbench_payload,
+	LTTNG_UST_TP_ARGS(int, value, const char *, payload, size_t, len),
+	LTTNG_UST_TP_FIELDS(
+		lttng_ust_field_integer(int, event, value)
+		lttng_ust_field_sequence(char, payload, payload, size_t, len)
+	)
+)
+
 #endif /* _TRACEPOINT_UST_TESTS_BENCHMARK_H */
 
 #undef LTTNG_UST_TRACEPOINT_INCLUDE
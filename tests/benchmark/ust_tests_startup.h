@@ -0,0 +1,163 @@
+/*
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ */
+
+#undef LTTNG_UST_TRACEPOINT_PROVIDER
+#define LTTNG_UST_TRACEPOINT_PROVIDER ust_tests_startup
+
+#if !defined(_TRACEPOINT_UST_TESTS_STARTUP_H) || defined(LTTNG_UST_TRACEPOINT_HEADER_MULTI_READ)
+#define _TRACEPOINT_UST_TESTS_STARTUP_H
+
+#include <lttng/tracepoint.h>
+
+/*
+ * Large provider of the startup benchmark: its probe registration
+ * handles 128 event descriptions.
+ */
+#undef STARTUP_EVENT
+#define STARTUP_EVENT(name)						\
+	LTTNG_UST_TRACEPOINT_EVENT(ust_tests_startup, name,		\
+		LTTNG_UST_TP_ARGS(int, value),				\
+		LTTNG_UST_TP_FIELDS(					\
+			lttng_ust_field_integer(int, event, value)	\
+		)							\
+	)
+
+STARTUP_EVENT(event0)
+STARTUP_EVENT(event1)
+STARTUP_EVENT(event2)
+STARTUP_EVENT(event3)
+STARTUP_EVENT(event4)
+STARTUP_EVENT(event5)
+STARTUP_EVENT(event6)
+STARTUP_EVENT(event7)
+STARTUP_EVENT(event8)
+STARTUP_EVENT(event9)
+STARTUP_EVENT(event10)
+STARTUP_EVENT(event11)
+STARTUP_EVENT(event12)
+STARTUP_EVENT(event13)
+STARTUP_EVENT(event14)
+STARTUP_EVENT(event15)
+STARTUP_EVENT(event16)
+STARTUP_EVENT(event17)
+STARTUP_EVENT(event18)
+STARTUP_EVENT(event19)
+STARTUP_EVENT(event20)
+STARTUP_EVENT(event21)
+STARTUP_EVENT(event22)
+STARTUP_EVENT(event23)
+STARTUP_EVENT(event24)
+STARTUP_EVENT(event25)
+STARTUP_EVENT(event26)
+STARTUP_EVENT(event27)
+STARTUP_EVENT(event28)
+STARTUP_EVENT(event29)
+STARTUP_EVENT(event30)
+STARTUP_EVENT(event31)
+STARTUP_EVENT(event32)
+STARTUP_EVENT(event33)
+STARTUP_EVENT(event34)
+STARTUP_EVENT(event35)
+STARTUP_EVENT(event36)
+STARTUP_EVENT(event37)
+STARTUP_EVENT(event38)
+STARTUP_EVENT(event39)
+STARTUP_EVENT(event40)
+STARTUP_EVENT(event41)
+STARTUP_EVENT(event42)
+STARTUP_EVENT(event43)
+STARTUP_EVENT(event44)
+STARTUP_EVENT(event45)
+STARTUP_EVENT(event46)
+STARTUP_EVENT(event47)
+STARTUP_EVENT(event48)
+STARTUP_EVENT(event49)
+STARTUP_EVENT(event50)
+STARTUP_EVENT(event51)
+STARTUP_EVENT(event52)
+STARTUP_EVENT(event53)
+STARTUP_EVENT(event54)
+STARTUP_EVENT(event55)
+STARTUP_EVENT(event56)
+STARTUP_EVENT(event57)
+STARTUP_EVENT(event58)
+STARTUP_EVENT(event59)
+STARTUP_EVENT(event60)
+STARTUP_EVENT(event61)
+STARTUP_EVENT(event62)
+STARTUP_EVENT(event63)
+STARTUP_EVENT(event64)
+STARTUP_EVENT(event65)
+STARTUP_EVENT(event66)
+STARTUP_EVENT(event67)
+STARTUP_EVENT(event68)
+STARTUP_EVENT(event69)
+STARTUP_EVENT(event70)
+STARTUP_EVENT(event71)
+STARTUP_EVENT(event72)
+STARTUP_EVENT(event73)
+STARTUP_EVENT(event74)
+STARTUP_EVENT(event75)
+STARTUP_EVENT(event76)
+STARTUP_EVENT(event77)
+STARTUP_EVENT(event78)
+STARTUP_EVENT(event79)
+STARTUP_EVENT(event80)
+STARTUP_EVENT(event81)
+STARTUP_EVENT(event82)
+STARTUP_EVENT(event83)
+STARTUP_EVENT(event84)
+STARTUP_EVENT(event85)
+STARTUP_EVENT(event86)
+STARTUP_EVENT(event87)
+STARTUP_EVENT(event88)
+STARTUP_EVENT(event89)
+STARTUP_EVENT(event90)
+STARTUP_EVENT(event91)
+STARTUP_EVENT(event92)
+STARTUP_EVENT(event93)
+STARTUP_EVENT(event94)
+STARTUP_EVENT(event95)
+STARTUP_EVENT(event96)
+STARTUP_EVENT(event97)
+STARTUP_EVENT(event98)
+STARTUP_EVENT(event99)
+STARTUP_EVENT(event100)
+STARTUP_EVENT(event101)
+STARTUP_EVENT(event102)
+STARTUP_EVENT(event103)
+STARTUP_EVENT(event104)
+STARTUP_EVENT(event105)
+STARTUP_EVENT(event106)
+STARTUP_EVENT(event107)
+STARTUP_EVENT(event108)
+STARTUP_EVENT(event109)
+STARTUP_EVENT(event110)
+STARTUP_EVENT(event111)
+STARTUP_EVENT(event112)
+STARTUP_EVENT(event113)
+STARTUP_EVENT(event114)
+STARTUP_EVENT(event115)
+STARTUP_EVENT(event116)
+STARTUP_EVENT(event117)
+STARTUP_EVENT(event118)
+STARTUP_EVENT(event119)
+STARTUP_EVENT(event120)
+STARTUP_EVENT(event121)
+STARTUP_EVENT(event122)
+STARTUP_EVENT(event123)
+STARTUP_EVENT(event124)
+STARTUP_EVENT(event125)
+STARTUP_EVENT(event126)
+STARTUP_EVENT(event127)
+
+#endif /* _TRACEPOINT_UST_TESTS_STARTUP_H */
+
+#undef LTTNG_UST_TRACEPOINT_INCLUDE
+#define LTTNG_UST_TRACEPOINT_INCLUDE "./ust_tests_startup.h"
+
+/* This part must be outside ifdef protection */
+#include <lttng/tracepoint-event.h>
@@ -0,0 +1,425 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Filter bytecode runtime test.
+ *
+ * Links hand-assembled filter bytecodes against a synthetic event and
+ * context, and checks the per-thread cache of the results of
+ * context-only filters follows the changes of state of the filters,
+ * including while a probe evaluates the filter concurrently. Also checks
+ * the validator rejects malformed bytecode, and payload comparisons are
+ * compiled to a native evaluation agreeing with the interpreter.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lttng/ust-events.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+
+#include "common/events.h"
+#include "lib/lttng-ust/lttng-bytecode.h"
+#include "lib/lttng-ust/context-internal.h"
+
+#include "tap.h"
+
+#define NUM_TESTS	9
+
+#define BC_MAX_LEN	128
+#define NR_TOGGLES	20000
+
+struct bc_builder {
+	char code[BC_MAX_LEN];
+	uint32_t len;
+	char relocs[BC_MAX_LEN];
+	uint32_t reloc_len;
+};
+
+static const struct lttng_ust_event_field intfield_field = {
+	.struct_size = sizeof(struct lttng_ust_event_field),
+	.name = "intfield",
+	.type = lttng_ust_static_type_integer(64, 64, 1, LTTNG_UST_BYTE_ORDER, 10),
+};
+
+static const struct lttng_ust_event_field *event_fields[] = {
+	&intfield_field,
+};
+
+static struct lttng_ust_event_field vtid_field = {
+	.struct_size = sizeof(struct lttng_ust_event_field),
+	.name = "vtid",
+	.type = lttng_ust_static_type_integer(32, 32, 1, LTTNG_UST_BYTE_ORDER, 10),
+};
+
+static const struct lttng_ust_probe_desc probe_desc = {
+	.struct_size = sizeof(struct lttng_ust_probe_desc),
+	.provider_name = "test",
+};
+
+static const struct lttng_ust_tracepoint_class tp_class = {
+	.struct_size = sizeof(struct lttng_ust_tracepoint_class),
+	.fields = event_fields,
+	.nr_fields = 1,
+	.probe_desc = &probe_desc,
+};
+
+static const struct lttng_ust_event_desc event_desc = {
+	.struct_size = sizeof(struct lttng_ust_event_desc),
+	.event_name = "filter",
+	.probe_desc = &probe_desc,
+	.tp_class = &tp_class,
+};
+
+static
+void get_vtid_value(void *priv __attribute__((unused)),
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ctx_value *value)
+{
+	value->sel = LTTNG_UST_DYNAMIC_TYPE_S64;
+	value->u.s64 = 1234;
+}
+
+static struct lttng_ust_ctx_field ctx_fields[] = {
+	{ .event_field = &vtid_field, .get_value = get_vtid_value },
+};
+
+static struct lttng_ust_ctx test_ctx = {
+	.fields = ctx_fields,
+	.nr_fields = 1,
+	.allocated_fields = 1,
+};
+static struct lttng_ust_ctx *test_ctx_ptr = &test_ctx;
+
+static struct lttng_enabler enabler = {
+	.enabled = 1,
+};
+
+static struct lttng_ust_event_common_private event_priv;
+static struct lttng_ust_event_common event = {
+	.struct_size = sizeof(struct lttng_ust_event_common),
+	.priv = &event_priv,
+};
+
+/*
+ * Odd while the state of the filter changes, even once
+ * lttng_bytecode_sync_state() returned. The filter accepts events when
+ * the number of state changes is even.
+ */
+static unsigned long toggle_seq;
+static int test_stop;
+
+/* The context lookups of the tracer, not in the bytecode runtime library. */
+int lttng_get_context_index(struct lttng_ust_ctx *ctx, const char *name)
+{
+	unsigned int i;
+
+	if (!strncmp(name, "$ctx.", strlen("$ctx.")))
+		name += strlen("$ctx.");
+	for (i = 0; i < ctx->nr_fields; i++) {
+		if (!strcmp(ctx->fields[i].event_field->name, name))
+			return i;
+	}
+	return -1;
+}
+
+int lttng_ust_add_app_context_to_ctx_rcu(const char *name __attribute__((unused)),
+		struct lttng_ust_ctx **ctx __attribute__((unused)))
+{
+	return -ENOENT;
+}
+
+void lttng_ust_format_event_name(const struct lttng_ust_event_desc *desc,
+		char *name)
+{
+	strcpy(name, desc->probe_desc->provider_name);
+	strcat(name, ":");
+	strcat(name, desc->event_name);
+}
+
+static
+void emit(struct bc_builder *b, const void *data, size_t len)
+{
+	if (b->len + len > BC_MAX_LEN)
+		abort();
+	memcpy(&b->code[b->len], data, len);
+	b->len += len;
+}
+
+static
+void emit_op(struct bc_builder *b, bytecode_opcode_t op)
+{
+	emit(b, &op, sizeof(op));
+}
+
+/* Relocation of the next instruction to the field or context @name. */
+static
+void emit_reloc(struct bc_builder *b, const char *name)
+{
+	uint16_t insn_offset = b->len;
+
+	if (b->reloc_len + sizeof(insn_offset) + strlen(name) + 1 > BC_MAX_LEN)
+		abort();
+	memcpy(&b->relocs[b->reloc_len], &insn_offset, sizeof(insn_offset));
+	b->reloc_len += sizeof(insn_offset);
+	memcpy(&b->relocs[b->reloc_len], name, strlen(name) + 1);
+	b->reloc_len += strlen(name) + 1;
+}
+
+static
+struct lttng_ust_bytecode_node *assemble(struct bc_builder *b)
+{
+	struct lttng_ust_bytecode_node *node;
+
+	node = calloc(1, sizeof(*node) + b->len + b->reloc_len);
+	if (!node)
+		return NULL;
+	node->type = LTTNG_UST_BYTECODE_TYPE_FILTER;
+	node->enabler = &enabler;
+	node->bc.len = b->len + b->reloc_len;
+	node->bc.reloc_offset = b->len;
+	memcpy(node->bc.data, b->code, b->len);
+	memcpy(node->bc.data + b->len, b->relocs, b->reloc_len);
+	return node;
+}
+
+/* $ctx.vtid == 1234 */
+static
+struct lttng_ust_bytecode_node *assemble_vtid_filter(void)
+{
+	uint16_t ref = 0;
+	int64_t value = 1234;
+	struct bc_builder b;
+
+	memset(&b, 0, sizeof(b));
+	emit_reloc(&b, "vtid");
+	emit_op(&b, BYTECODE_OP_GET_CONTEXT_REF);
+	emit(&b, &ref, sizeof(ref));
+	emit_op(&b, BYTECODE_OP_LOAD_S64);
+	emit(&b, &value, sizeof(value));
+	emit_op(&b, BYTECODE_OP_EQ);
+	emit_op(&b, BYTECODE_OP_RETURN);
+	return assemble(&b);
+}
+
+/* intfield > 42, or "> 42" without its first operand if @malformed. */
+static
+struct lttng_ust_bytecode_node *assemble_payload_filter(bool malformed)
+{
+	uint16_t ref = 0;
+	int64_t value = 42;
+	struct bc_builder b;
+
+	memset(&b, 0, sizeof(b));
+	if (!malformed) {
+		emit_reloc(&b, "intfield");
+		emit_op(&b, BYTECODE_OP_LOAD_FIELD_REF);
+		emit(&b, &ref, sizeof(ref));
+	}
+	emit_op(&b, BYTECODE_OP_LOAD_S64);
+	emit(&b, &value, sizeof(value));
+	emit_op(&b, BYTECODE_OP_GT);
+	emit_op(&b, BYTECODE_OP_RETURN);
+	return assemble(&b);
+}
+
+/* Link @node alone to the event, and return its runtime. */
+static
+struct lttng_ust_bytecode_runtime *link_filter(struct lttng_ust_bytecode_node *node,
+		struct cds_list_head *runtime_head)
+{
+	struct cds_list_head bytecode_head;
+
+	CDS_INIT_LIST_HEAD(runtime_head);
+	CDS_INIT_LIST_HEAD(&bytecode_head);
+	cds_list_add(&node->node, &bytecode_head);
+	lttng_enabler_link_bytecode(&event_desc, &test_ctx_ptr, runtime_head,
+		&bytecode_head);
+	if (cds_list_empty(runtime_head))
+		return NULL;
+	return cds_list_first_entry(runtime_head,
+		struct lttng_ust_bytecode_runtime, node);
+}
+
+static
+void free_filter(struct lttng_ust_bytecode_runtime *runtime,
+		struct lttng_ust_bytecode_node *node)
+{
+	if (runtime) {
+		free(caa_container_of(runtime, struct bytecode_runtime, p)->data);
+		free(caa_container_of(runtime, struct bytecode_runtime, p));
+	}
+	free(node);
+}
+
+/*
+ * Evaluate @runtime on payloads around its literal, both natively and
+ * with the interpreter, and return the number of wrong results.
+ */
+static
+unsigned int check_payload_filter(struct lttng_ust_bytecode_runtime *runtime)
+{
+	static const int64_t payloads[] = {
+		INT64_MIN, -43, -1, 0, 41, 42, 43, INT64_MAX,
+	};
+	struct lttng_ust_probe_ctx probe_ctx = {
+		.struct_size = sizeof(struct lttng_ust_probe_ctx),
+	};
+	unsigned int nr_wrong = 0, i;
+
+	for (i = 0; i < sizeof(payloads) / sizeof(payloads[0]); i++) {
+		struct lttng_ust_bytecode_filter_ctx compiled, interpreted;
+		const char *stack_data = (const char *) &payloads[i];
+		enum lttng_ust_bytecode_filter_result expected;
+
+		expected = payloads[i] > 42 ? LTTNG_UST_BYTECODE_FILTER_ACCEPT
+			: LTTNG_UST_BYTECODE_FILTER_REJECT;
+		if (runtime->interpreter_func(runtime, stack_data, &probe_ctx,
+					&compiled) != LTTNG_UST_BYTECODE_INTERPRETER_OK
+				|| lttng_bytecode_interpret(runtime, stack_data,
+					&probe_ctx, &interpreted)
+					!= LTTNG_UST_BYTECODE_INTERPRETER_OK
+				|| compiled.result != expected
+				|| interpreted.result != expected)
+			nr_wrong++;
+	}
+	return nr_wrong;
+}
+
+static
+int evaluate(void)
+{
+	struct lttng_ust_probe_ctx probe_ctx = {
+		.struct_size = sizeof(struct lttng_ust_probe_ctx),
+	};
+
+	return lttng_ust_interpret_event_filter(&event, NULL, &probe_ctx, NULL);
+}
+
+static
+void set_state(struct lttng_ust_bytecode_runtime *runtime, int enabled)
+{
+	enabler.enabled = enabled;
+	lttng_bytecode_sync_state(runtime);
+}
+
+/*
+ * Evaluate the filter in a loop, and check each evaluation which did
+ * not overlap a change of state returns the result of the current state.
+ */
+static
+void *probe_thread(void *arg)
+{
+	unsigned long *nr_stale = arg;
+
+	while (!CMM_LOAD_SHARED(test_stop)) {
+		unsigned long seq;
+		int result;
+
+		seq = CMM_LOAD_SHARED(toggle_seq);
+		cmm_smp_rmb();
+		result = evaluate();
+		cmm_smp_rmb();
+		if (seq & 1 || seq != CMM_LOAD_SHARED(toggle_seq))
+			continue;
+		if ((result == LTTNG_UST_EVENT_FILTER_ACCEPT) != !((seq / 2) & 1))
+			(*nr_stale)++;
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	struct cds_list_head payload_runtime_head;
+	struct lttng_ust_bytecode_runtime *runtime, *payload_runtime;
+	struct lttng_ust_bytecode_node *node, *payload_node;
+	unsigned long nr_stale = 0, i;
+	pthread_t thread;
+
+	plan_tests(NUM_TESTS);
+
+	payload_node = assemble_payload_filter(true);
+	if (!payload_node) {
+		diag("calloc failed");
+		exit(1);
+	}
+	payload_runtime = link_filter(payload_node, &payload_runtime_head);
+	ok(payload_runtime && payload_runtime->link_failed,
+		"Validator rejects a comparison missing an operand");
+	free_filter(payload_runtime, payload_node);
+
+	payload_node = assemble_payload_filter(false);
+	if (!payload_node) {
+		diag("calloc failed");
+		exit(1);
+	}
+	payload_runtime = link_filter(payload_node, &payload_runtime_head);
+	if (payload_runtime)
+		lttng_bytecode_sync_state(payload_runtime);
+	if (!ok(payload_runtime && !payload_runtime->link_failed
+			&& payload_runtime->interpreter_func == lttng_bytecode_interpret_compiled,
+			"Payload comparison is compiled")) {
+		skip(1, "Payload filter not compiled");
+	} else {
+		unsigned int nr_wrong = check_payload_filter(payload_runtime);
+
+		ok(nr_wrong == 0, "Compiled and interpreted payload comparisons "
+			"agree (%u wrong results)", nr_wrong);
+	}
+	free_filter(payload_runtime, payload_node);
+
+	node = assemble_vtid_filter();
+	if (!node) {
+		diag("calloc failed");
+		exit(1);
+	}
+	CDS_INIT_LIST_HEAD(&event_priv.filter_bytecode_runtime_head);
+	runtime = link_filter(node, &event_priv.filter_bytecode_runtime_head);
+	if (!ok(runtime, "Link the filter")) {
+		skip(NUM_TESTS - 4, "No filter");
+		return exit_status();
+	}
+	ok(!runtime->link_failed && !runtime->reads_payload
+		&& !runtime->reads_volatile_context,
+		"Filter on a thread-stable context is cached");
+
+	set_state(runtime, 1);
+	ok(evaluate() == LTTNG_UST_EVENT_FILTER_ACCEPT
+		&& evaluate() == LTTNG_UST_EVENT_FILTER_ACCEPT,
+		"Enabled filter accepts the event, cached or not");
+	set_state(runtime, 0);
+	ok(evaluate() == LTTNG_UST_EVENT_FILTER_REJECT,
+		"Cached result invalidated when the filter is disabled");
+	set_state(runtime, 1);
+	ok(evaluate() == LTTNG_UST_EVENT_FILTER_ACCEPT,
+		"Cached result invalidated when the filter is enabled again");
+
+	if (pthread_create(&thread, NULL, probe_thread, &nr_stale)) {
+		diag("probe thread create failed");
+		exit(1);
+	}
+	for (i = 0; i < NR_TOGGLES; i++) {
+		CMM_STORE_SHARED(toggle_seq, toggle_seq + 1);
+		cmm_smp_wmb();
+		set_state(runtime, !enabler.enabled);
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(toggle_seq, toggle_seq + 1);
+	}
+	CMM_STORE_SHARED(test_stop, 1);
+	if (pthread_join(thread, NULL)) {
+		diag("probe thread join failed");
+		exit(1);
+	}
+	ok(nr_stale == 0, "No stale result cached by a concurrent probe "
+		"(%lu state changes, %lu stale)", (unsigned long) NR_TOGGLES,
+		nr_stale);
+
+	free_filter(runtime, node);
+	return exit_status();
+}
@@ -15,7 +15,7 @@
 #include "common/msgpack/msgpack.h"
 
 #define BUFFER_SIZE 4096
-#define NUM_TESTS 23
+#define NUM_TESTS 33
 
 
 /*
@@ -246,6 +246,56 @@ static void complete_capture_test(uint8_t *buf)
 	lttng_msgpack_writer_fini(&writer);
 }
 
+/*
+ * Encode an array of integers with lttng_msgpack_write_integer_array()
+ * in @bulk, and element by element in @ref, both of @size bytes. Returns
+ * whether both encodings match.
+ */
+static int integer_array_test(uint8_t *bulk, uint8_t *ref, size_t size,
+		const void *elems, size_t count, unsigned int elem_size,
+		bool is_signed)
+{
+	struct lttng_msgpack_writer writer;
+	size_t i, bulk_len, ref_len;
+
+	memset(bulk, 0, size);
+	memset(ref, 0, size);
+	lttng_msgpack_writer_init(&writer, bulk, size);
+	lttng_msgpack_write_integer_array(&writer, elems, count, elem_size,
+		is_signed, false);
+	bulk_len = writer.write_pos - writer.buffer;
+	lttng_msgpack_writer_fini(&writer);
+
+	lttng_msgpack_writer_init(&writer, ref, size);
+	lttng_msgpack_begin_array(&writer, count);
+	for (i = 0; i < count; i++) {
+		int64_t value;
+
+		switch (elem_size) {
+		case 16:
+			value = is_signed ? ((const int16_t *) elems)[i]
+				: ((const uint16_t *) elems)[i];
+			break;
+		case 32:
+			value = is_signed ? ((const int32_t *) elems)[i]
+				: ((const uint32_t *) elems)[i];
+			break;
+		default:
+			value = ((const int64_t *) elems)[i];
+			break;
+		}
+		if (is_signed)
+			lttng_msgpack_write_signed_integer(&writer, value);
+		else
+			lttng_msgpack_write_unsigned_integer(&writer, value);
+	}
+	lttng_msgpack_end_array(&writer);
+	ref_len = writer.write_pos - writer.buffer;
+	lttng_msgpack_writer_fini(&writer);
+
+	return bulk_len == ref_len && !memcmp(bulk, ref, size);
+}
+
 static void nil_test(uint8_t *buf)
 {
 	struct lttng_msgpack_writer writer;
@@ -255,6 +305,79 @@ static void nil_test(uint8_t *buf)
 	lttng_msgpack_writer_fini(&writer);
 }
 
+static int read_object(const uint8_t *buf, size_t len,
+		struct lttng_msgpack_object *object)
+{
+	struct lttng_msgpack_reader reader;
+	int ret;
+
+	lttng_msgpack_reader_init(&reader, buf, len);
+	ret = lttng_msgpack_read_object(&reader, object);
+	if (ret)
+		return ret;
+	/* The whole object must have been consumed. */
+	return reader.read_pos == reader.end_read_pos ? 0 : -1;
+}
+
+static int read_uint_test(const uint8_t *buf, size_t len, uint64_t expected)
+{
+	struct lttng_msgpack_object object;
+
+	return !read_object(buf, len, &object)
+		&& object.type == LTTNG_MSGPACK_OBJECT_UNSIGNED_INTEGER
+		&& object.u.u == expected;
+}
+
+static int read_int_test(const uint8_t *buf, size_t len, int64_t expected)
+{
+	struct lttng_msgpack_object object;
+
+	return !read_object(buf, len, &object)
+		&& object.type == LTTNG_MSGPACK_OBJECT_SIGNED_INTEGER
+		&& object.u.s == expected;
+}
+
+static int read_complete_capture_test(void)
+{
+	struct lttng_msgpack_reader reader;
+	struct lttng_msgpack_object object;
+
+	lttng_msgpack_reader_init(&reader, COMPLETE_CAPTURE_EXPECTED,
+		sizeof(COMPLETE_CAPTURE_EXPECTED));
+	if (lttng_msgpack_read_object(&reader, &object)
+			|| object.type != LTTNG_MSGPACK_OBJECT_ARRAY
+			|| object.u.count != 5)
+		return 0;
+	if (lttng_msgpack_read_object(&reader, &object)
+			|| object.type != LTTNG_MSGPACK_OBJECT_STR
+			|| object.u.str.len != strlen("meow mix")
+			|| memcmp(object.u.str.str, "meow mix", object.u.str.len))
+		return 0;
+	if (lttng_msgpack_read_object(&reader, &object)
+			|| object.type != LTTNG_MSGPACK_OBJECT_UNSIGNED_INTEGER
+			|| object.u.u != 18)
+		return 0;
+	if (lttng_msgpack_read_object(&reader, &object)
+			|| object.type != LTTNG_MSGPACK_OBJECT_NIL)
+		return 0;
+	if (lttng_msgpack_read_object(&reader, &object)
+			|| object.type != LTTNG_MSGPACK_OBJECT_DOUBLE
+			|| object.u.d != 14.197)
+		return 0;
+	if (lttng_msgpack_read_object(&reader, &object)
+			|| object.type != LTTNG_MSGPACK_OBJECT_ARRAY
+			|| object.u.count != 2)
+		return 0;
+	if (lttng_msgpack_read_object(&reader, &object)
+			|| object.u.u != 1980)
+		return 0;
+	if (lttng_msgpack_read_object(&reader, &object)
+			|| object.u.u != 1995)
+		return 0;
+	/* End of buffer. */
+	return lttng_msgpack_read_object(&reader, &object) != 0;
+}
+
 int main(void)
 {
 	uint8_t buf[BUFFER_SIZE] = {0};
@@ -368,5 +491,61 @@ int main(void)
 	ok(memcmp(buf, COMPLETE_CAPTURE_EXPECTED, sizeof(COMPLETE_CAPTURE_EXPECTED)) == 0,
 		"Complete capture object");
 
+	{
+		const int16_t s16[] = { 0, -1, -32, -33, 127, 128, -129, 32767, -32768 };
+		const uint32_t u32[] = { 0, 127, 128, 255, 256, 65535, 65536,
+			4294967295U };
+		uint64_t u64[40];
+		uint8_t bulk[BUFFER_SIZE], ref[BUFFER_SIZE];
+		size_t i;
+
+		for (i = 0; i < 40; i++)
+			u64[i] = (uint64_t) 1 << (i + 24);
+
+		ok(integer_array_test(bulk, ref, BUFFER_SIZE, s16, 9, 16, true),
+			"Array of signed 16-bit integers encoded at once");
+		ok(integer_array_test(bulk, ref, BUFFER_SIZE, u32, 8, 32, false),
+			"Array of unsigned 32-bit integers encoded at once");
+		ok(integer_array_test(bulk, ref, 100, u64, 40, 64, false),
+			"Array of integers larger than the buffer truncated as element by element");
+	}
+
+	diag("Testing msgpack decoding");
+
+	ok(read_uint_test(UINT_127_EXPECTED, sizeof(UINT_127_EXPECTED), 127)
+		&& read_uint_test(UINT_1337_EXPECTED, sizeof(UINT_1337_EXPECTED), 1337)
+		&& read_uint_test(UINT_4294967296_EXPECTED, sizeof(UINT_4294967296_EXPECTED), 4294967296),
+		"Decode unsigned integer objects");
+
+	ok(read_int_test(INT_NEG_32_EXPECTED, sizeof(INT_NEG_32_EXPECTED), -32)
+		&& read_int_test(INT_NEG_129_EXPECTED, sizeof(INT_NEG_129_EXPECTED), -129)
+		&& read_int_test(INT_NEG_32769_EXPECTED, sizeof(INT_NEG_32769_EXPECTED), -32769)
+		&& read_int_test(INT_NEG_2147483649_EXPECTED, sizeof(INT_NEG_2147483649_EXPECTED), -2147483649),
+		"Decode signed integer objects");
+
+	{
+		struct lttng_msgpack_object object;
+
+		ok(!read_object(DOUBLE_NEG_PI_EXPECTED, sizeof(DOUBLE_NEG_PI_EXPECTED), &object)
+			&& object.type == LTTNG_MSGPACK_OBJECT_DOUBLE
+			&& object.u.d == -3.14159265,
+			"Decode double object");
+
+		ok(!read_object(STRING_BYE_EXPECTED, sizeof(STRING_BYE_EXPECTED), &object)
+			&& object.type == LTTNG_MSGPACK_OBJECT_STR
+			&& object.u.str.len == 3
+			&& !memcmp(object.u.str.str, "bye", 3),
+			"Decode string object");
+
+		ok(!read_object(NIL_EXPECTED, sizeof(NIL_EXPECTED), &object)
+			&& object.type == LTTNG_MSGPACK_OBJECT_NIL,
+			"Decode NIL object");
+
+		ok(read_object(UINT_65536_EXPECTED, sizeof(UINT_65536_EXPECTED) - 1, &object) != 0,
+			"Reject truncated object");
+	}
+
+	ok(read_complete_capture_test(), "Decode complete capture object");
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,193 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Ring buffer batched reservation test.
+ *
+ * Reserve batches of records of a single event in a per-thread stream,
+ * so that the stream written to does not depend on the cpu, and check
+ * the space reserved by a single write offset update matches the space
+ * the records of the batch fill, that a batch never spans more than
+ * the current sub-buffer, and that a batch of which no record fits in
+ * the current sub-buffer reserves a single record in the next one.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/events.h"
+#include "common/smp.h"
+#include "common/tracer.h"
+#include "common/ringbuffer/frontend.h"
+#include "common/ringbuffer/frontend_internal.h"
+#include "common/ringbuffer-clients/clients.h"
+
+#include "tap.h"
+
+#define NUM_TESTS	6
+
+#define SUBBUF_SIZE	4096
+#define NR_BATCH	8
+#define NR_OVERSIZED	1000
+
+static struct lttng_ust_channel_buffer *lttng_chan;
+static struct lttng_ust_event_common event_common;
+static struct lttng_ust_event_recorder event_recorder;
+static struct lttng_ust_event_recorder_private event_recorder_priv;
+
+struct batch_result {
+	int nr;			/* Records reserved, or error. */
+	unsigned long begin;	/* Write offset before the reservation. */
+	unsigned long end;	/* Write offset after the reservation. */
+	size_t filled;		/* Space filled by the records. */
+	size_t slot_size;	/* Space reserved for the records. */
+};
+
+static
+int create_channel(void)
+{
+	const char *transport_name = "relay-discard-per-thread-mmap";
+	struct lttng_transport *transport;
+	unsigned char uuid[LTTNG_UST_UUID_LEN] = { 0 };
+	char shm_path[64];
+	int nr_streams = num_possible_cpus(), i, ret = -1;
+	int stream_fds[nr_streams];
+
+	transport = lttng_ust_transport_find(transport_name);
+	if (!transport) {
+		diag("Transport %s not found", transport_name);
+		return -1;
+	}
+	for (i = 0; i < nr_streams; i++)
+		stream_fds[i] = -1;
+	for (i = 0; i < nr_streams; i++) {
+		snprintf(shm_path, sizeof(shm_path), "/ust-rb-batch-%d-%d",
+			(int) getpid(), i);
+		stream_fds[i] = shm_open(shm_path, O_RDWR | O_CREAT | O_EXCL,
+			S_IRUSR | S_IWUSR);
+		if (stream_fds[i] < 0) {
+			diag("shm_open: %s", strerror(errno));
+			goto end;
+		}
+		(void) shm_unlink(shm_path);
+	}
+	lttng_chan = transport->ops.priv->channel_create(transport_name, NULL,
+		SUBBUF_SIZE, 4, 0, 0, uuid, 0, stream_fds, nr_streams, 0, 0);
+	if (!lttng_chan) {
+		diag("Channel creation failed");
+		goto end;
+	}
+	lttng_chan->ops = &transport->ops;
+
+	event_common.struct_size = sizeof(event_common);
+	event_common.type = LTTNG_UST_EVENT_TYPE_RECORDER;
+	event_common.child = &event_recorder;
+	event_common.priv = &event_recorder_priv.parent;
+	event_recorder_priv.parent.pub = &event_common;
+	/* The event has no rows in the metrics counters. */
+	event_recorder_priv.parent.overhead_slot = -1;
+	event_recorder_priv.parent.discard_slot = -1;
+
+	event_recorder.struct_size = sizeof(event_recorder);
+	event_recorder.parent = &event_common;
+	event_recorder.priv = &event_recorder_priv;
+	event_recorder.chan = lttng_chan;
+	event_recorder_priv.pub = &event_recorder;
+	ret = 0;
+end:
+	/* The channel keeps its own references on the stream fds. */
+	for (i = 0; i < nr_streams; i++) {
+		if (stream_fds[i] >= 0 && ret)
+			(void) close(stream_fds[i]);
+	}
+	return ret;
+}
+
+/*
+ * Reserve, write and commit a batch of up to @nr_records records, and
+ * account the space reserved and filled in @result.
+ */
+static
+void write_batch(unsigned int nr_records, struct batch_result *result)
+{
+	const struct lttng_ust_ring_buffer_config *config =
+		&lttng_chan->priv->rb_chan->backend.config;
+	struct lttng_ust_ring_buffer_ctx ctx;
+	uint64_t payload[4];
+	int i;
+
+	memset(result, 0, sizeof(*result));
+	memset(payload, 0, sizeof(payload));
+	lttng_ust_ring_buffer_ctx_init(&ctx, &event_recorder, sizeof(payload),
+		lttng_ust_rb_alignof(uint64_t), NULL);
+	result->nr = lttng_chan->ops->event_reserve_batch(&ctx, nr_records);
+	if (result->nr <= 0)
+		return;
+	result->begin = ctx.priv->pre_offset;
+	result->end = v_read(config, &ctx.priv->buf->offset);
+	result->slot_size = ctx.priv->slot_size;
+	for (i = 0; i < result->nr; i++) {
+		if (i)
+			lttng_chan->ops->event_reserve_batch_next(&ctx);
+		payload[0] = i;
+		lttng_chan->ops->event_write(&ctx, payload, sizeof(payload),
+			lttng_ust_rb_alignof(uint64_t));
+	}
+	result->filled = ctx.priv->buf_offset - ctx.priv->pre_offset;
+	lttng_chan->ops->event_commit(&ctx);
+}
+
+int main(void)
+{
+	struct lttng_ust_ring_buffer_ctx ctx;
+	struct batch_result result;
+	unsigned long prev_end;
+	size_t subbuf_size;
+
+	plan_tests(NUM_TESTS);
+
+	lttng_ust_ring_buffer_clients_init();
+	if (!ok(!create_channel() && lttng_chan->ops->event_reserve_batch,
+			"Create a discard per-thread channel with batched reservations")) {
+		skip(NUM_TESTS - 1, "No channel");
+		return exit_status();
+	}
+	subbuf_size = lttng_chan->priv->rb_chan->backend.subbuf_size;
+
+	lttng_ust_ring_buffer_ctx_init(&ctx, &event_recorder, sizeof(uint64_t),
+		lttng_ust_rb_alignof(uint64_t), NULL);
+	ok(lttng_chan->ops->event_reserve_batch(&ctx, 0) == -EINVAL,
+		"Empty batch is rejected");
+
+	/* The first sub-buffer is started when the stream is created. */
+	write_batch(NR_BATCH, &result);
+	ok(result.nr == NR_BATCH && result.end - result.begin == result.slot_size,
+		"Batch of %d records reserved by a single write offset update "
+		"(%d records, %zu bytes)", NR_BATCH, result.nr, result.slot_size);
+	ok(result.filled == result.slot_size,
+		"Records of the batch fill the reserved space (%zu/%zu bytes)",
+		result.filled, result.slot_size);
+
+	write_batch(NR_OVERSIZED, &result);
+	ok(result.nr > 0 && result.nr < NR_OVERSIZED
+		&& result.begin / subbuf_size == (result.end - 1) / subbuf_size,
+		"Batch limited to the current sub-buffer (%d/%d records)",
+		result.nr, NR_OVERSIZED);
+
+	/* No record fits in the rest of the sub-buffer: slow path. */
+	prev_end = result.end;
+	write_batch(NR_BATCH, &result);
+	ok(result.nr == 1 && result.begin / subbuf_size > (prev_end - 1) / subbuf_size,
+		"Batch starting a sub-buffer reserves a single record (%d)",
+		result.nr);
+
+	lttng_chan->ops->priv->channel_destroy(lttng_chan);
+	return exit_status();
+}
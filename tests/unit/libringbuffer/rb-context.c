@@ -0,0 +1,303 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Frozen context recording test.
+ *
+ * A channel context made of freezable fields of various sizes and
+ * alignments is recorded once frozen, stored at the offsets laid out by
+ * lttng_context_update(), and once through the record callback of each
+ * field. Check both produce the same bytes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/events.h"
+#include "common/smp.h"
+#include "common/tracer.h"
+#include "common/ringbuffer/backend.h"
+#include "common/ringbuffer/frontend.h"
+#include "common/ringbuffer-clients/clients.h"
+
+#include "tap.h"
+
+#define NUM_TESTS	3
+
+#define TEXT_LEN	6
+
+struct test_field {
+	size_t size;		/* In bytes. */
+	size_t align;		/* In bytes. */
+	uint64_t value;		/* Integer fields. */
+	const char *text;	/* Text array fields, TEXT_LEN bytes. */
+};
+
+/* Trailing bytes after the terminator are recorded as they are. */
+static const char text_value[TEXT_LEN] = { 'c', 't', 'x', '\0', 'z', 'z' };
+
+static struct test_field test_fields[] = {
+	{ .size = 1, .align = 1, .value = 0x5a },
+	{ .size = 8, .align = 8, .value = 0x0123456789abcdefULL },
+	{ .size = 2, .align = 2, .value = 0xbeef },
+	{ .size = TEXT_LEN, .align = 1, .text = text_value },
+	{ .size = 4, .align = 4, .value = 0xdeadbeef },
+};
+
+#define NR_FIELDS	(sizeof(test_fields) / sizeof(test_fields[0]))
+
+static const struct lttng_ust_event_field *event_fields[] = {
+	lttng_ust_static_event_field("u8",
+		lttng_ust_static_type_integer(8, 8, 0, LTTNG_UST_BYTE_ORDER, 10),
+		false, false),
+	lttng_ust_static_event_field("u64",
+		lttng_ust_static_type_integer(64, 64, 0, LTTNG_UST_BYTE_ORDER, 10),
+		false, false),
+	lttng_ust_static_event_field("u16",
+		lttng_ust_static_type_integer(16, 16, 0, LTTNG_UST_BYTE_ORDER, 10),
+		false, false),
+	lttng_ust_static_event_field("text",
+		lttng_ust_static_type_array_text(TEXT_LEN),
+		false, false),
+	lttng_ust_static_event_field("u32",
+		lttng_ust_static_type_integer(32, 32, 0, LTTNG_UST_BYTE_ORDER, 10),
+		false, false),
+};
+
+static struct lttng_ust_channel_buffer *lttng_chan;
+static struct lttng_ust_event_common event_common;
+static struct lttng_ust_event_recorder event_recorder;
+static struct lttng_ust_event_recorder_private event_recorder_priv;
+
+static struct lttng_ust_ctx_field ctx_fields[NR_FIELDS];
+static struct lttng_ust_ctx chan_ctx;
+
+static
+size_t test_get_size(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		size_t offset)
+{
+	struct test_field *field = priv;
+
+	return lttng_ust_ring_buffer_align(offset, field->align) + field->size;
+}
+
+static
+void test_record(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ring_buffer_ctx *ctx,
+		struct lttng_ust_channel_buffer *chan)
+{
+	struct test_field *field = priv;
+	uint8_t u8 = field->value;
+	uint16_t u16 = field->value;
+	uint32_t u32 = field->value;
+
+	if (field->text) {
+		chan->ops->event_write(ctx, field->text, field->size, 1);
+		return;
+	}
+	switch (field->size) {
+	case 1:
+		chan->ops->event_write(ctx, &u8, sizeof(u8), field->align);
+		break;
+	case 2:
+		chan->ops->event_write(ctx, &u16, sizeof(u16), field->align);
+		break;
+	case 4:
+		chan->ops->event_write(ctx, &u32, sizeof(u32), field->align);
+		break;
+	case 8:
+		chan->ops->event_write(ctx, &field->value, sizeof(field->value),
+			field->align);
+		break;
+	}
+}
+
+static
+void test_get_value(void *priv,
+		struct lttng_ust_probe_ctx *probe_ctx __attribute__((unused)),
+		struct lttng_ust_ctx_value *value)
+{
+	struct test_field *field = priv;
+
+	if (field->text)
+		value->u.str = field->text;
+	else
+		value->u.u64 = field->value;
+}
+
+/* Lay the context out as lttng_context_update() does. */
+static
+void init_context(void)
+{
+	size_t offset = 0;
+	unsigned int i;
+
+	for (i = 0; i < NR_FIELDS; i++) {
+		struct lttng_ust_ctx_field *field = &ctx_fields[i];
+
+		field->event_field = event_fields[i];
+		field->get_size = test_get_size;
+		field->record = test_record;
+		field->get_value = test_get_value;
+		field->priv = &test_fields[i];
+		field->freezable = 1;
+		offset += field->get_size(field->priv, NULL, offset);
+		field->frozen_size = test_fields[i].size;
+		field->frozen_offset = offset - field->frozen_size;
+	}
+	chan_ctx.fields = ctx_fields;
+	chan_ctx.nr_fields = NR_FIELDS;
+	chan_ctx.allocated_fields = NR_FIELDS;
+	chan_ctx.largest_align = sizeof(uint64_t);
+	chan_ctx.fixed_size_valid = 1;
+	chan_ctx.fixed_size = offset;
+}
+
+static
+int create_channel(void)
+{
+	const char *transport_name = "relay-discard-per-thread-mmap";
+	struct lttng_transport *transport;
+	unsigned char uuid[LTTNG_UST_UUID_LEN] = { 0 };
+	char shm_path[64];
+	int nr_streams = num_possible_cpus(), i, ret = -1;
+	int stream_fds[nr_streams];
+
+	transport = lttng_ust_transport_find(transport_name);
+	if (!transport) {
+		diag("Transport %s not found", transport_name);
+		return -1;
+	}
+	for (i = 0; i < nr_streams; i++)
+		stream_fds[i] = -1;
+	for (i = 0; i < nr_streams; i++) {
+		snprintf(shm_path, sizeof(shm_path), "/ust-rb-context-%d-%d",
+			(int) getpid(), i);
+		stream_fds[i] = shm_open(shm_path, O_RDWR | O_CREAT | O_EXCL,
+			S_IRUSR | S_IWUSR);
+		if (stream_fds[i] < 0) {
+			diag("shm_open: %s", strerror(errno));
+			goto end;
+		}
+		(void) shm_unlink(shm_path);
+	}
+	lttng_chan = transport->ops.priv->channel_create(transport_name, NULL,
+		4096, 4, 0, 0, uuid, 0, stream_fds, nr_streams, 0, 0);
+	if (!lttng_chan) {
+		diag("Channel creation failed");
+		goto end;
+	}
+	lttng_chan->ops = &transport->ops;
+	lttng_chan->priv->ctx = &chan_ctx;
+
+	event_common.struct_size = sizeof(event_common);
+	event_common.type = LTTNG_UST_EVENT_TYPE_RECORDER;
+	event_common.child = &event_recorder;
+	event_common.priv = &event_recorder_priv.parent;
+	event_recorder_priv.parent.pub = &event_common;
+	/* The event has no rows in the metrics counters. */
+	event_recorder_priv.parent.overhead_slot = -1;
+	event_recorder_priv.parent.discard_slot = -1;
+
+	event_recorder.struct_size = sizeof(event_recorder);
+	event_recorder.parent = &event_common;
+	event_recorder.priv = &event_recorder_priv;
+	event_recorder.chan = lttng_chan;
+	event_recorder_priv.pub = &event_recorder;
+	ret = 0;
+end:
+	/* The channel keeps its own references on the stream fds. */
+	for (i = 0; i < nr_streams; i++) {
+		if (stream_fds[i] >= 0 && ret)
+			(void) close(stream_fds[i]);
+	}
+	return ret;
+}
+
+/*
+ * Record an event without payload, and copy the channel context it
+ * holds to @data, chan_ctx.fixed_size bytes.
+ */
+static
+int record_context(char *data)
+{
+	const struct lttng_ust_ring_buffer_config *config =
+		&lttng_chan->priv->rb_chan->backend.config;
+	struct lttng_ust_ring_buffer_ctx ctx;
+	void *addr;
+	int ret;
+
+	/* The payload is not aligned: the reservation ends with the context. */
+	lttng_ust_ring_buffer_ctx_init(&ctx, &event_recorder, 0, 1, NULL);
+	ret = lttng_chan->ops->event_reserve(&ctx);
+	if (ret)
+		return ret;
+	addr = lib_ring_buffer_write_address(config, &ctx,
+		ctx.priv->buf_offset - chan_ctx.fixed_size);
+	if (addr)
+		memcpy(data, addr, chan_ctx.fixed_size);
+	lttng_chan->ops->event_commit(&ctx);
+	return addr ? 0 : -EIO;
+}
+
+int main(void)
+{
+	char frozen[LTTNG_UST_CTX_FROZEN_MAX_SIZE], plain[LTTNG_UST_CTX_FROZEN_MAX_SIZE];
+	bool values_ok = true;
+	unsigned int i;
+	int ret;
+
+	plan_tests(NUM_TESTS);
+
+	init_context();
+	lttng_ust_ring_buffer_clients_init();
+	if (!ok(!create_channel(), "Create a discard per-thread channel "
+			"with a %zu bytes context", chan_ctx.fixed_size)) {
+		skip(NUM_TESTS - 1, "No channel");
+		return exit_status();
+	}
+
+	memset(frozen, 0, sizeof(frozen));
+	memset(plain, 0xff, sizeof(plain));
+	chan_ctx.frozen = 1;
+	ret = record_context(frozen);
+	chan_ctx.frozen = 0;
+	ret |= record_context(plain);
+	ok(!ret && !memcmp(frozen, plain, chan_ctx.fixed_size),
+		"Frozen and non-frozen contexts record the same bytes");
+
+	for (i = 0; i < NR_FIELDS; i++) {
+		const struct test_field *field = &test_fields[i];
+		const char *slot = frozen + ctx_fields[i].frozen_offset;
+
+		if (field->text) {
+			values_ok &= !memcmp(slot, field->text, field->size);
+		} else {
+			uint64_t value = 0;
+
+			/* Integers are recorded in native byte order. */
+#if (LTTNG_UST_BYTE_ORDER == LTTNG_UST_LITTLE_ENDIAN)
+			memcpy(&value, slot, field->size);
+#else
+			memcpy((char *) &value + sizeof(value) - field->size,
+				slot, field->size);
+#endif
+			values_ok &= value == field->value;
+		}
+	}
+	ok(!ret && values_ok, "Frozen context holds each value at its offset");
+
+	lttng_chan->priv->ctx = NULL;
+	lttng_chan->ops->priv->channel_destroy(lttng_chan);
+	return exit_status();
+}
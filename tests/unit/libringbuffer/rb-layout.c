@@ -0,0 +1,270 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Ring buffer shared memory layout test.
+ *
+ * struct lttng_ust_ring_buffer is mapped by lttng-ust-ctl and by the
+ * applications, which may run different versions. Check its fields stay
+ * where the previous layout put them, that its extended state keeps the
+ * writer, statistics and reader fields on separate cachelines, that its
+ * statistics account the reservations, and that streams without extended
+ * state, as created by older versions, can still be written to.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/events.h"
+#include "common/smp.h"
+#include "common/tracer.h"
+#include "common/ringbuffer/frontend.h"
+#include "common/ringbuffer/frontend_internal.h"
+#include "common/ringbuffer/rb-init.h"
+#include "common/ringbuffer-clients/clients.h"
+
+#include "tap.h"
+
+#define NUM_TESTS	9
+
+#define NR_RECORDS	1000
+
+/* Layout of struct lttng_ust_ring_buffer before the extended state. */
+struct rb_layout_v0 {
+	struct lttng_crash_abi crash_abi;
+	union v_atomic __attribute__((aligned(32))) offset;
+	DECLARE_SHMP(struct commit_counters_hot, commit_hot);
+	long consumed;
+	int record_disabled;
+	union v_atomic last_tsc;
+	struct lttng_ust_ring_buffer_backend backend;
+	DECLARE_SHMP(struct commit_counters_cold, commit_cold);
+	DECLARE_SHMP(uint64_t, ts_end);
+	long active_readers;
+	union v_atomic records_lost_full;
+	union v_atomic records_lost_wrap;
+	union v_atomic records_lost_big;
+	union v_atomic records_count;
+	union v_atomic records_overrun;
+	int finalized;
+	unsigned long get_subbuf_consumed;
+	unsigned long prod_snapshot;
+	unsigned long cons_snapshot;
+	unsigned int get_subbuf:1;
+	DECLARE_SHMP(struct lttng_ust_ring_buffer, self);
+	char padding[60];
+} __attribute__((aligned(CAA_CACHE_LINE_SIZE)));
+
+#define SAME_OFFSET(field)	\
+	(offsetof(struct lttng_ust_ring_buffer, field)	\
+		== offsetof(struct rb_layout_v0, field))
+
+#define CACHELINE(field)	\
+	(offsetof(struct lttng_ust_ring_buffer_ext, field) / CAA_CACHE_LINE_SIZE)
+
+static struct lttng_ust_channel_buffer *lttng_chan;
+static struct lttng_ust_event_common event_common;
+static struct lttng_ust_event_recorder event_recorder;
+static struct lttng_ust_event_recorder_private event_recorder_priv;
+
+static
+struct lttng_ust_ring_buffer *get_buffer(int cpu)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	int shm_fd, wait_fd, wakeup_fd;
+	uint64_t memory_map_size;
+	void *memory_map_addr;
+
+	return channel_get_ring_buffer(&rb_chan->backend.config, rb_chan,
+		cpu, rb_chan->handle, &shm_fd, &wait_fd, &wakeup_fd,
+		&memory_map_size, &memory_map_addr);
+}
+
+static
+int create_channel(void)
+{
+	const char *transport_name = "relay-discard-mmap";
+	struct lttng_transport *transport;
+	unsigned char uuid[LTTNG_UST_UUID_LEN] = { 0 };
+	char shm_path[64];
+	int nr_streams = num_possible_cpus(), i, ret = -1;
+	int stream_fds[nr_streams];
+
+	transport = lttng_ust_transport_find(transport_name);
+	if (!transport) {
+		diag("Transport %s not found", transport_name);
+		return -1;
+	}
+	for (i = 0; i < nr_streams; i++)
+		stream_fds[i] = -1;
+	for (i = 0; i < nr_streams; i++) {
+		snprintf(shm_path, sizeof(shm_path), "/ust-rb-layout-%d-%d",
+			(int) getpid(), i);
+		stream_fds[i] = shm_open(shm_path, O_RDWR | O_CREAT | O_EXCL,
+			S_IRUSR | S_IWUSR);
+		if (stream_fds[i] < 0) {
+			diag("shm_open: %s", strerror(errno));
+			goto end;
+		}
+		(void) shm_unlink(shm_path);
+	}
+	lttng_chan = transport->ops.priv->channel_create(transport_name, NULL,
+		4096, 4, 0, 0, uuid, 0, stream_fds, nr_streams, 0, 0);
+	if (!lttng_chan) {
+		diag("Channel creation failed");
+		goto end;
+	}
+	lttng_chan->ops = &transport->ops;
+
+	event_common.struct_size = sizeof(event_common);
+	event_common.type = LTTNG_UST_EVENT_TYPE_RECORDER;
+	event_common.child = &event_recorder;
+	event_common.priv = &event_recorder_priv.parent;
+	event_recorder_priv.parent.pub = &event_common;
+	/* The event has no rows in the metrics counters. */
+	event_recorder_priv.parent.overhead_slot = -1;
+	event_recorder_priv.parent.discard_slot = -1;
+
+	event_recorder.struct_size = sizeof(event_recorder);
+	event_recorder.parent = &event_common;
+	event_recorder.priv = &event_recorder_priv;
+	event_recorder.chan = lttng_chan;
+	event_recorder_priv.pub = &event_recorder;
+	ret = 0;
+end:
+	/* The channel keeps its own references on the stream fds. */
+	for (i = 0; i < nr_streams; i++) {
+		if (stream_fds[i] >= 0 && ret)
+			(void) close(stream_fds[i]);
+	}
+	return ret;
+}
+
+static
+unsigned int write_records(void)
+{
+	unsigned int nr_written = 0, i;
+	char payload[32];
+
+	memset(payload, 'x', sizeof(payload));
+	for (i = 0; i < NR_RECORDS; i++) {
+		struct lttng_ust_ring_buffer_ctx ctx;
+
+		lttng_ust_ring_buffer_ctx_init(&ctx, &event_recorder,
+			sizeof(payload), 1, NULL);
+		if (lttng_chan->ops->event_reserve(&ctx) < 0)
+			continue;
+		lttng_chan->ops->event_write(&ctx, payload, sizeof(payload), 1);
+		lttng_chan->ops->event_commit(&ctx);
+		nr_written++;
+	}
+	return nr_written;
+}
+
+static
+void sum_stats(unsigned long long *slow_path, unsigned long long *switches,
+		unsigned long long *full, unsigned int *nr_ext)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	const struct lttng_ust_ring_buffer_config *config = &rb_chan->backend.config;
+	int cpu;
+
+	*slow_path = *switches = *full = 0;
+	*nr_ext = 0;
+	for (cpu = 0; cpu < num_possible_cpus(); cpu++) {
+		struct lttng_ust_ring_buffer *buf = get_buffer(cpu);
+
+		if (!buf)
+			continue;
+		if (lib_ring_buffer_get_ext(buf, rb_chan->handle))
+			(*nr_ext)++;
+		*slow_path += lib_ring_buffer_get_slow_path_count(config, buf,
+			rb_chan->handle);
+		*switches += lib_ring_buffer_get_switch_count(config, buf,
+			rb_chan->handle);
+		*full += lib_ring_buffer_get_full_count(config, buf,
+			rb_chan->handle);
+	}
+}
+
+int main(void)
+{
+	unsigned long long slow_path, switches, full;
+	unsigned int nr_ext, nr_written;
+	int cpu, nr_streams = num_possible_cpus();
+
+	plan_tests(NUM_TESTS);
+
+	ok(sizeof(struct lttng_ust_ring_buffer) == sizeof(struct rb_layout_v0),
+		"Stream structure size unchanged (%zu bytes)",
+		sizeof(struct lttng_ust_ring_buffer));
+	ok(SAME_OFFSET(offset) && SAME_OFFSET(commit_hot)
+		&& SAME_OFFSET(consumed) && SAME_OFFSET(record_disabled)
+		&& SAME_OFFSET(last_tsc) && SAME_OFFSET(backend)
+		&& SAME_OFFSET(commit_cold) && SAME_OFFSET(ts_end)
+		&& SAME_OFFSET(active_readers)
+		&& SAME_OFFSET(records_lost_full)
+		&& SAME_OFFSET(records_lost_wrap)
+		&& SAME_OFFSET(records_lost_big)
+		&& SAME_OFFSET(records_count)
+		&& SAME_OFFSET(records_overrun) && SAME_OFFSET(finalized)
+		&& SAME_OFFSET(get_subbuf_consumed)
+		&& SAME_OFFSET(prod_snapshot) && SAME_OFFSET(cons_snapshot)
+		&& SAME_OFFSET(self)
+		&& offsetof(struct lttng_ust_ring_buffer, ext)
+			== offsetof(struct rb_layout_v0, padding),
+		"Stream structure fields keep their offsets");
+	ok(CACHELINE(sample_shift) != CACHELINE(records_sampled)
+		&& CACHELINE(records_sampled) != CACHELINE(consumer_futex)
+		&& CACHELINE(sample_shift) != CACHELINE(consumer_futex)
+		&& CACHELINE(max_fill) == CACHELINE(records_sampled)
+		&& CACHELINE(reclaim_pos) == CACHELINE(consumer_futex),
+		"Extended state writer, statistics and reader fields on separate cachelines");
+
+	lttng_ust_ring_buffer_clients_init();
+	if (!ok(!create_channel(), "Create a discard channel")) {
+		skip(NUM_TESTS - 4, "No channel");
+		return exit_status();
+	}
+	/* Without consumer: the streams fill up after a few switches. */
+	nr_written = write_records();
+	sum_stats(&slow_path, &switches, &full, &nr_ext);
+	ok(nr_ext == (unsigned int) nr_streams,
+		"Streams are created with their extended state (%u/%d)",
+		nr_ext, nr_streams);
+	ok(nr_written > 0 && slow_path > 0 && switches > 0 && full > 0,
+		"Statistics account the slow path (%llu), switches (%llu) "
+		"and full buffers (%llu)", slow_path, switches, full);
+
+	lttng_chan->ops->priv->channel_destroy(lttng_chan);
+
+	/* Streams created by an older version have no extended state. */
+	if (create_channel()) {
+		skip(3, "No channel");
+		return exit_status();
+	}
+	for (cpu = 0; cpu < nr_streams; cpu++) {
+		struct lttng_ust_ring_buffer *buf = get_buffer(cpu);
+
+		if (buf)
+			buf->ext_size = 0;
+	}
+	nr_written = write_records();
+	ok(nr_written > 0, "Streams without extended state are written to "
+		"(%u records)", nr_written);
+	sum_stats(&slow_path, &switches, &full, &nr_ext);
+	ok(nr_ext == 0, "Extended state ignored once its size is cleared");
+	ok(slow_path == 0 && switches == 0 && full == 0,
+		"Statistics of streams without extended state read 0");
+
+	lttng_chan->ops->priv->channel_destroy(lttng_chan);
+	return exit_status();
+}
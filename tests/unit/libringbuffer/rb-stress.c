@@ -0,0 +1,651 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Ring buffer concurrency stress test.
+ *
+ * Writer threads record sequence-numbered records into a channel created
+ * through a ring buffer client, while a signaller thread interrupts them
+ * with a signal whose handler records nested records. A consumer thread
+ * of the same process parses every sub-buffer and checks each record
+ * against the writers' accounting: no corrupt, reordered, duplicated or
+ * missing record, and each failed reservation accounted by the buffer
+ * lost record counters.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <urcu/compiler.h>
+#include <urcu/uatomic.h>
+
+#include "common/bitfield.h"
+#include "common/events.h"
+#include "common/smp.h"
+#include "common/tracer.h"
+#include "common/ringbuffer/frontend.h"
+#include "common/ringbuffer/frontend_internal.h"
+#include "common/ringbuffer/rb-init.h"
+#include "common/ringbuffer-clients/clients.h"
+
+#include "tap.h"
+
+#define NUM_TESTS		8
+
+#define STRESS_MAGIC		0x57e55edU
+#define COMPACT_EVENT_BITS	5	/* Compact event header id bits. */
+#define COMPACT_EXTENDED_ID	31
+
+/* Nesting levels of the records of a writer. */
+enum stress_level {
+	LEVEL_THREAD = 0,
+	LEVEL_SIGNAL = 1,
+	NR_LEVELS,
+};
+
+struct stress_record {
+	uint32_t magic;
+	uint16_t writer;
+	uint16_t level;
+	uint64_t seq;
+	uint64_t check;
+};
+
+/* Accounting of the records of a writer at one nesting level. */
+struct stress_stream {
+	uint64_t next_seq;
+	unsigned long long committed, seq_sum;
+	unsigned long long failed_reserve, lost;
+};
+
+struct writer {
+	pthread_t thread;
+	unsigned int id;
+	struct stress_stream stream[NR_LEVELS];
+};
+
+/* What the consumer received of the records of a writer at one level. */
+struct received_stream {
+	unsigned long long count, seq_sum;
+};
+
+static const char *mode = "discard";
+static size_t subbuf_size = 4096, num_subbuf = 4;
+static unsigned int nr_writers = 4, batch = 1, signal_period_us = 50;
+static unsigned long duration = 1;
+
+static struct lttng_ust_channel_buffer *lttng_chan;
+static struct lttng_ust_event_common event_common;
+static struct lttng_ust_event_recorder event_recorder;
+static struct lttng_ust_event_recorder_private event_recorder_priv;
+static struct writer *writers;
+
+static struct lttng_ust_ring_buffer_iter *iters;
+static struct received_stream *received;
+/* Next expected minimum sequence number, per cpu, writer and level. */
+static uint64_t *next_seq_seen;
+static unsigned long long nr_records, nr_corrupt, nr_reordered, nr_subbufs;
+
+static volatile int test_go, test_stop, consumer_stop;
+static unsigned long long nr_signals;
+
+static __thread struct writer *current_writer;
+
+static
+uint64_t record_check(unsigned int writer, unsigned int level, uint64_t seq)
+{
+	uint64_t v = seq ^ ((uint64_t) writer << 48) ^ ((uint64_t) level << 40);
+
+	/* Mix all the bits, so that any torn write changes the check. */
+	v ^= v >> 33;
+	v *= 0xff51afd7ed558ccdULL;
+	v ^= v >> 33;
+	return v;
+}
+
+static
+void record_init(struct stress_record *record, struct writer *writer,
+		unsigned int level, uint64_t seq)
+{
+	record->magic = STRESS_MAGIC;
+	record->writer = writer->id;
+	record->level = level;
+	record->seq = seq;
+	record->check = record_check(writer->id, level, seq);
+}
+
+/*
+ * Record a batch of records of a writer at one nesting level, as a
+ * probe would. The sequence number is consumed even when the
+ * reservation fails: the gap is the record lost.
+ */
+static
+void write_records(struct writer *writer, unsigned int level)
+{
+	struct stress_stream *stream = &writer->stream[level];
+	struct lttng_ust_ring_buffer_ctx ctx;
+	struct stress_record record;
+	int i, nr;
+
+	lttng_ust_ring_buffer_ctx_init(&ctx, &event_recorder, sizeof(record),
+		lttng_ust_rb_alignof(uint64_t), NULL);
+	if (batch > 1) {
+		nr = lttng_chan->ops->event_reserve_batch(&ctx, batch);
+	} else {
+		nr = lttng_chan->ops->event_reserve(&ctx);
+		if (!nr)
+			nr = 1;
+	}
+	if (nr < 0) {
+		stream->failed_reserve++;
+		stream->lost += batch;
+		stream->next_seq += batch;
+		return;
+	}
+	for (i = 0; i < nr; i++) {
+		if (i)
+			lttng_chan->ops->event_reserve_batch_next(&ctx);
+		record_init(&record, writer, level, stream->next_seq);
+		lttng_chan->ops->event_write(&ctx, &record, sizeof(record),
+			lttng_ust_rb_alignof(uint64_t));
+		stream->committed++;
+		stream->seq_sum += stream->next_seq++;
+	}
+	lttng_chan->ops->event_commit(&ctx);
+	/* Records of the batch which could not be reserved. */
+	stream->lost += batch - nr;
+	stream->next_seq += batch - nr;
+}
+
+static
+void nested_handler(int signo __attribute__((unused)))
+{
+	struct writer *writer = current_writer;
+
+	/* SIGUSR1 is blocked while it runs: a single nesting level. */
+	if (writer)
+		write_records(writer, LEVEL_SIGNAL);
+}
+
+static
+void *writer_thread(void *arg)
+{
+	struct writer *writer = arg;
+
+	current_writer = writer;
+	while (!test_go)
+		cmm_barrier();
+
+	while (!test_stop)
+		write_records(writer, LEVEL_THREAD);
+	return NULL;
+}
+
+static
+void *signaller_thread(void *arg __attribute__((unused)))
+{
+	struct timespec period = {
+		.tv_sec = signal_period_us / 1000000,
+		.tv_nsec = (signal_period_us % 1000000) * 1000,
+	};
+	unsigned int i = 0;
+
+	while (!test_go)
+		cmm_barrier();
+
+	while (!test_stop) {
+		if (!pthread_kill(writers[i].thread, SIGUSR1))
+			nr_signals++;
+		i = (i + 1) % nr_writers;
+		(void) nanosleep(&period, NULL);
+	}
+	return NULL;
+}
+
+static
+struct lttng_ust_ring_buffer *get_buffer(int cpu)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	int shm_fd, wait_fd, wakeup_fd;
+	uint64_t memory_map_size;
+	void *memory_map_addr;
+
+	return channel_get_ring_buffer(&rb_chan->backend.config, rb_chan,
+		cpu, rb_chan->handle, &shm_fd, &wait_fd, &wakeup_fd,
+		&memory_map_size, &memory_map_addr);
+}
+
+static
+size_t align_offset(size_t offset, size_t align)
+{
+	return offset + lttng_ust_ring_buffer_align(offset, align);
+}
+
+static
+void check_record(int cpu, const struct stress_record *record)
+{
+	uint64_t *next;
+	size_t index;
+
+	if (record->magic != STRESS_MAGIC || record->writer >= nr_writers
+			|| record->level >= NR_LEVELS
+			|| record->check != record_check(record->writer,
+				record->level, record->seq)) {
+		nr_corrupt++;
+		return;
+	}
+	index = record->writer * NR_LEVELS + record->level;
+	next = &next_seq_seen[cpu * nr_writers * NR_LEVELS + index];
+	/*
+	 * The records of a writer are reserved in program order: within a
+	 * buffer, their sequence numbers increase.
+	 */
+	if (record->seq < *next)
+		nr_reordered++;
+	*next = record->seq + 1;
+	received[index].count++;
+	received[index].seq_sum += record->seq;
+}
+
+/*
+ * Parse the records of a sub-buffer written by the client with compact
+ * event headers and no context.
+ */
+static
+void parse_subbuf(int cpu, const char *data, size_t data_size)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	size_t offset = rb_chan->backend.config.cb.subbuffer_header_size();
+	struct stress_record record;
+
+	while (offset < data_size) {
+		uint8_t id_byte, id;
+
+		offset = align_offset(offset, lttng_ust_rb_alignof(uint32_t));
+		memcpy(&id_byte, data + offset, sizeof(id_byte));
+		bt_bitfield_read(&id_byte, uint8_t, 0, COMPACT_EVENT_BITS, &id);
+		if (id == COMPACT_EXTENDED_ID) {
+			uint32_t event_id;
+
+			offset++;
+			offset = align_offset(offset, lttng_ust_rb_alignof(uint64_t));
+			memcpy(&event_id, data + offset, sizeof(event_id));
+			offset += sizeof(event_id);
+			offset = align_offset(offset, lttng_ust_rb_alignof(uint64_t));
+			offset += sizeof(uint64_t);	/* timestamp */
+			id = event_id;
+		} else {
+			offset += sizeof(uint32_t);	/* id and timestamp */
+		}
+		offset = align_offset(offset, lttng_ust_rb_alignof(uint64_t));
+		if (id != event_recorder_priv.id
+				|| offset + sizeof(record) > data_size) {
+			/* The rest of the sub-buffer cannot be parsed. */
+			nr_corrupt++;
+			return;
+		}
+		memcpy(&record, data + offset, sizeof(record));
+		offset += sizeof(record);
+		check_record(cpu, &record);
+		nr_records++;
+	}
+}
+
+/* Returns the number of sub-buffers consumed. */
+static
+unsigned int consume_buffer(int cpu)
+{
+	struct lttng_ust_ring_buffer_iter *iter = &iters[cpu];
+	unsigned int nr = 0;
+
+	if (!iter->buf)
+		return 0;
+	while (!lib_ring_buffer_iter_next(iter)) {
+		parse_subbuf(cpu, iter->data, iter->data_size);
+		nr++;
+	}
+	lib_ring_buffer_iter_fini(iter);
+	nr_subbufs += nr;
+	return nr;
+}
+
+static
+void *consumer_thread(void *arg __attribute__((unused)))
+{
+	int cpu;
+
+	while (!consumer_stop) {
+		unsigned int nr = 0;
+
+		for (cpu = 0; cpu < num_possible_cpus(); cpu++)
+			nr += consume_buffer(cpu);
+		if (!nr)
+			sched_yield();
+	}
+	return NULL;
+}
+
+static
+int create_channel(void)
+{
+	const char *transport_name = "relay-discard-mmap";
+	struct lttng_transport *transport;
+	int64_t blocking_timeout = 0;
+	unsigned char uuid[LTTNG_UST_UUID_LEN] = { 0 };
+	char shm_path[64];
+	int nr_streams = num_possible_cpus(), i, ret = -1;
+	int stream_fds[nr_streams];
+
+	if (!strcmp(mode, "blocking")) {
+		/*
+		 * Bounded: a nested writer waiting for space may hold back
+		 * the sub-buffer of the record it interrupted.
+		 */
+		blocking_timeout = 100;
+	} else if (strcmp(mode, "discard")) {
+		diag("Unknown mode %s", mode);
+		return -1;
+	}
+	transport = lttng_ust_transport_find(transport_name);
+	if (!transport) {
+		diag("Transport %s not found", transport_name);
+		return -1;
+	}
+
+	for (i = 0; i < nr_streams; i++)
+		stream_fds[i] = -1;
+	for (i = 0; i < nr_streams; i++) {
+		snprintf(shm_path, sizeof(shm_path), "/ust-rb-stress-%d-%d",
+			(int) getpid(), i);
+		stream_fds[i] = shm_open(shm_path, O_RDWR | O_CREAT | O_EXCL,
+			S_IRUSR | S_IWUSR);
+		if (stream_fds[i] < 0) {
+			diag("shm_open: %s", strerror(errno));
+			goto end;
+		}
+		(void) shm_unlink(shm_path);
+	}
+
+	lttng_chan = transport->ops.priv->channel_create(transport_name, NULL,
+		subbuf_size, num_subbuf, 0, 0, uuid, 0, stream_fds, nr_streams,
+		0, blocking_timeout);
+	if (!lttng_chan) {
+		diag("Channel creation failed");
+		goto end;
+	}
+	lttng_chan->ops = &transport->ops;
+	/* The consumer parses compact event headers. */
+	lttng_chan->priv->header_type = 1;
+
+	event_common.struct_size = sizeof(event_common);
+	event_common.type = LTTNG_UST_EVENT_TYPE_RECORDER;
+	event_common.child = &event_recorder;
+	event_common.priv = &event_recorder_priv.parent;
+	event_recorder_priv.parent.pub = &event_common;
+	/* The event has no rows in the metrics counters. */
+	event_recorder_priv.parent.overhead_slot = -1;
+	event_recorder_priv.parent.discard_slot = -1;
+
+	event_recorder.struct_size = sizeof(event_recorder);
+	event_recorder.parent = &event_common;
+	event_recorder.priv = &event_recorder_priv;
+	event_recorder.chan = lttng_chan;
+	event_recorder_priv.pub = &event_recorder;
+
+	for (i = 0; i < nr_streams; i++) {
+		struct lttng_ust_ring_buffer *buf = get_buffer(i);
+
+		if (!buf)
+			continue;
+		if (lib_ring_buffer_open_read(buf,
+				lttng_chan->priv->rb_chan->handle)) {
+			diag("Cannot open stream %d for reading", i);
+			goto end;
+		}
+		lib_ring_buffer_iter_init(&iters[i], buf,
+			lttng_chan->priv->rb_chan->handle);
+	}
+	ret = 0;
+end:
+	/* The channel keeps its own references on the stream fds. */
+	for (i = 0; i < nr_streams; i++) {
+		if (stream_fds[i] >= 0 && ret)
+			(void) close(stream_fds[i]);
+	}
+	return ret;
+}
+
+/*
+ * Consume what is readable, then flush the current sub-buffer of each
+ * stream and consume it, so that every committed record is parsed.
+ */
+static
+void drain_channel(void)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	int cpu;
+
+	for (cpu = 0; cpu < num_possible_cpus(); cpu++) {
+		if (!iters[cpu].buf)
+			continue;
+		(void) consume_buffer(cpu);
+		lib_ring_buffer_switch_slow(iters[cpu].buf, SWITCH_ACTIVE,
+			rb_chan->handle);
+		(void) consume_buffer(cpu);
+	}
+}
+
+static
+unsigned long long sum_counters(size_t offset)
+{
+	struct lttng_ust_ring_buffer_channel *rb_chan = lttng_chan->priv->rb_chan;
+	unsigned long long sum = 0;
+	int cpu;
+
+	for (cpu = 0; cpu < num_possible_cpus(); cpu++) {
+		struct lttng_ust_ring_buffer *buf = iters[cpu].buf;
+
+		if (buf)
+			sum += v_read(&rb_chan->backend.config,
+				(union v_atomic *) ((char *) buf + offset));
+	}
+	return sum;
+}
+
+static
+void usage(char **argv)
+{
+	printf("Usage: %s <OPTIONS>\n", argv[0]);
+	printf("OPTIONS:\n");
+	printf("        [-w count] (writer threads, default 4)\n");
+	printf("        [-d s] (duration, default 1)\n");
+	printf("        [-m discard|blocking] (channel mode, default discard)\n");
+	printf("        [-b count] (records per batched reservation, default 1)\n");
+	printf("        [-s bytes] (sub-buffer size, default 4096)\n");
+	printf("        [-n count] (number of sub-buffers, default 4)\n");
+	printf("        [-p us] (period of the nesting signals, default 50)\n");
+	printf("\n");
+}
+
+static
+int parse_args(int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] != '-' || i + 1 >= argc)
+			return -1;
+		switch (argv[i][1]) {
+		case 'w':
+			nr_writers = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'm':
+			mode = argv[++i];
+			break;
+		case 'b':
+			batch = strtoul(argv[++i], NULL, 0);
+			break;
+		case 's':
+			subbuf_size = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'n':
+			num_subbuf = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'p':
+			signal_period_us = strtoul(argv[++i], NULL, 0);
+			break;
+		default:
+			return -1;
+		}
+	}
+	if (!nr_writers || nr_writers > UINT16_MAX || !batch)
+		return -1;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long committed = 0, seq_sum = 0, failed_reserve = 0,
+		lost = 0, nested = 0, lost_counters;
+	unsigned int missing = 0, i, level;
+	struct sigaction sa;
+	pthread_t consumer, signaller;
+	int nr_cpus;
+
+	if (parse_args(argc, argv)) {
+		usage(argv);
+		exit(1);
+	}
+
+	plan_tests(NUM_TESTS);
+
+	nr_cpus = num_possible_cpus();
+	writers = calloc(nr_writers, sizeof(*writers));
+	received = calloc(nr_writers * NR_LEVELS, sizeof(*received));
+	next_seq_seen = calloc((size_t) nr_cpus * nr_writers * NR_LEVELS,
+		sizeof(*next_seq_seen));
+	iters = calloc(nr_cpus, sizeof(*iters));
+	if (!writers || !received || !next_seq_seen || !iters) {
+		diag("calloc: %s", strerror(errno));
+		exit(1);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = nested_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(SIGUSR1, &sa, NULL)) {
+		diag("sigaction: %s", strerror(errno));
+		exit(1);
+	}
+
+	lttng_ust_ring_buffer_clients_init();
+	if (!strcmp(mode, "blocking"))
+		lttng_ust_ringbuffer_set_allow_blocking();
+	if (!ok(!create_channel(), "Create a %s channel of %zu sub-buffers of %zu bytes",
+			mode, num_subbuf, subbuf_size))
+		return exit_status();
+	if (batch > 1 && !lttng_chan->ops->event_reserve_batch) {
+		diag("Batched reservations unsupported by the channel");
+		exit(1);
+	}
+
+	for (i = 0; i < nr_writers; i++) {
+		writers[i].id = i;
+		if (pthread_create(&writers[i].thread, NULL, writer_thread,
+				&writers[i])) {
+			diag("thread create %u failed", i);
+			exit(1);
+		}
+	}
+	if (pthread_create(&signaller, NULL, signaller_thread, NULL)) {
+		diag("signaller thread create failed");
+		exit(1);
+	}
+	if (pthread_create(&consumer, NULL, consumer_thread, NULL)) {
+		diag("consumer thread create failed");
+		exit(1);
+	}
+
+	test_go = 1;
+	sleep(duration);
+	test_stop = 1;
+
+	/* No signal may target a writer once joined. */
+	if (pthread_join(signaller, NULL)) {
+		diag("signaller thread join failed");
+		exit(1);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		if (pthread_join(writers[i].thread, NULL)) {
+			diag("thread join %u failed", i);
+			exit(1);
+		}
+	}
+	consumer_stop = 1;
+	if (pthread_join(consumer, NULL)) {
+		diag("consumer thread join failed");
+		exit(1);
+	}
+	drain_channel();
+
+	for (i = 0; i < nr_writers; i++) {
+		for (level = 0; level < NR_LEVELS; level++) {
+			struct stress_stream *stream = &writers[i].stream[level];
+			struct received_stream *recv = &received[i * NR_LEVELS + level];
+
+			committed += stream->committed;
+			seq_sum += stream->seq_sum;
+			failed_reserve += stream->failed_reserve;
+			lost += stream->lost;
+			if (level == LEVEL_SIGNAL)
+				nested += stream->committed;
+			if (recv->count != stream->committed
+					|| recv->seq_sum != stream->seq_sum) {
+				diag("Writer %u level %u: %llu records committed, %llu received",
+					i, level, stream->committed, recv->count);
+				missing++;
+			}
+		}
+	}
+	lost_counters = sum_counters(offsetof(struct lttng_ust_ring_buffer, records_lost_full))
+		+ sum_counters(offsetof(struct lttng_ust_ring_buffer, records_lost_wrap))
+		+ sum_counters(offsetof(struct lttng_ust_ring_buffer, records_lost_big));
+	diag("%llu records committed, %llu lost, %llu nested in %llu signals, %llu sub-buffers",
+		committed, lost, nested, nr_signals, nr_subbufs);
+
+	ok(committed > 0, "Writers commit records");
+	ok(nested > 0, "Signal handlers commit nested records");
+	ok(nr_corrupt == 0, "No corrupt record (%llu)", nr_corrupt);
+	ok(nr_reordered == 0, "No reordered record within a buffer (%llu)",
+		nr_reordered);
+	ok(nr_records == committed, "Every committed record is consumed once "
+		"(%llu committed, %llu consumed)", committed, nr_records);
+	ok(missing == 0, "Records received match each writer's sequence (%u mismatch)",
+		missing);
+	ok(lost_counters == failed_reserve, "Failed reservations match the lost "
+		"record counters (%llu failed, %llu counted)",
+		failed_reserve, lost_counters);
+
+	lttng_chan->ops->priv->channel_destroy(lttng_chan);
+	free(iters);
+	free(next_seq_seen);
+	free(received);
+	free(writers);
+	return exit_status();
+}
@@ -0,0 +1,385 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Lock-free URCU reader registry stress test.
+ *
+ * Reader threads keep dereferencing a shared object which an updater
+ * thread keeps replacing, poisoning each replaced object once a grace
+ * period elapsed. Meanwhile, short-lived threads register and exit in a
+ * loop, each interrupted early by a signal whose handler also reads the
+ * object, which may register the thread concurrently with the thread
+ * itself. Idle threads stay registered outside of any critical section.
+ * Checks no reader ever sees a poisoned object, and that a grace period,
+ * which only waits for the readers it finds within critical sections,
+ * still waits for all of them.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <urcu/compiler.h>
+#include <urcu/uatomic.h>
+
+#include <lttng/urcu/urcu-ust.h>
+#include <lttng/urcu/pointer.h>
+
+#include "tap.h"
+
+#define NUM_TESTS		5
+
+#define OBJ_ALIVE		0xa11feUL
+#define OBJ_RECLAIMED		0xdeadUL
+#define NR_HOLDERS		4
+#define HOLDER_DELAY_MS		25
+
+struct stress_obj {
+	unsigned long magic;
+	struct stress_obj *next;
+};
+
+struct reader {
+	pthread_t thread;
+	unsigned long long nr_reads, nr_stale;
+};
+
+struct holder {
+	pthread_t thread;
+	unsigned int delay_ms;
+	volatile int in, out;
+};
+
+static unsigned int nr_readers = 4, nr_idle = 64;
+static unsigned long duration = 1;
+
+static struct stress_obj *shared;
+/* Replaced objects, only freed once all readers are joined. */
+static struct stress_obj *reclaimed;
+
+static unsigned long nr_signal_reads, nr_signal_stale;
+static unsigned long long nr_grace_periods, nr_churned;
+
+static volatile int test_go, test_stop, idle_stop;
+
+static
+bool read_shared(void)
+{
+	struct stress_obj *obj;
+	bool alive;
+
+	lttng_ust_urcu_read_lock();
+	obj = lttng_ust_rcu_dereference(shared);
+	alive = CMM_LOAD_SHARED(obj->magic) == OBJ_ALIVE;
+	caa_cpu_relax();
+	alive &= CMM_LOAD_SHARED(obj->magic) == OBJ_ALIVE;
+	lttng_ust_urcu_read_unlock();
+	return alive;
+}
+
+static
+void read_handler(int sig __attribute__((unused)))
+{
+	if (read_shared())
+		uatomic_inc(&nr_signal_reads);
+	else
+		uatomic_inc(&nr_signal_stale);
+}
+
+static
+struct stress_obj *alloc_obj(void)
+{
+	struct stress_obj *obj;
+
+	obj = calloc(1, sizeof(*obj));
+	if (!obj) {
+		diag("calloc: %s", strerror(errno));
+		exit(1);
+	}
+	obj->magic = OBJ_ALIVE;
+	return obj;
+}
+
+static
+void *reader_thread(void *arg)
+{
+	struct reader *reader = arg;
+
+	while (!test_go)
+		cmm_barrier();
+	while (!test_stop) {
+		if (read_shared())
+			reader->nr_reads++;
+		else
+			reader->nr_stale++;
+	}
+	return NULL;
+}
+
+static
+void *updater_thread(void *arg __attribute__((unused)))
+{
+	while (!test_go)
+		cmm_barrier();
+	while (!test_stop) {
+		struct stress_obj *old;
+
+		old = lttng_ust_rcu_xchg_pointer(&shared, alloc_obj());
+		lttng_ust_urcu_synchronize_rcu();
+		CMM_STORE_SHARED(old->magic, OBJ_RECLAIMED);
+		old->next = reclaimed;
+		reclaimed = old;
+		nr_grace_periods++;
+	}
+	return NULL;
+}
+
+static
+void *churn_thread(void *arg __attribute__((unused)))
+{
+	unsigned int i;
+
+	for (i = 0; i < 16; i++) {
+		if (!read_shared())
+			uatomic_inc(&nr_signal_stale);
+	}
+	return NULL;
+}
+
+/*
+ * Create short-lived threads, signalled right away so that the handler
+ * often runs while the thread registers.
+ */
+static
+void *spawner_thread(void *arg __attribute__((unused)))
+{
+	while (!test_go)
+		cmm_barrier();
+	while (!test_stop) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, churn_thread, NULL)) {
+			diag("churn thread create failed");
+			exit(1);
+		}
+		(void) pthread_kill(thread, SIGUSR1);
+		if (pthread_join(thread, NULL)) {
+			diag("churn thread join failed");
+			exit(1);
+		}
+		nr_churned++;
+	}
+	return NULL;
+}
+
+static
+void *idle_thread(void *arg __attribute__((unused)))
+{
+	lttng_ust_urcu_register_thread();
+	while (!idle_stop)
+		(void) poll(NULL, 0, 10);
+	return NULL;
+}
+
+static
+void *holder_thread(void *arg)
+{
+	struct holder *holder = arg;
+
+	lttng_ust_urcu_read_lock();
+	CMM_STORE_SHARED(holder->in, 1);
+	(void) poll(NULL, 0, holder->delay_ms);
+	CMM_STORE_SHARED(holder->out, 1);
+	lttng_ust_urcu_read_unlock();
+	return NULL;
+}
+
+/*
+ * Start readers holding critical sections of increasing lengths, some
+ * entered before the grace period begins, others while it waits for the
+ * first ones. Return whether the grace period waited for all the
+ * readers which entered before it began.
+ */
+static
+bool hold_readers(void)
+{
+	struct holder holders[NR_HOLDERS];
+	bool waited = true;
+	unsigned int i;
+
+	memset(holders, 0, sizeof(holders));
+	for (i = 0; i < NR_HOLDERS; i++) {
+		holders[i].delay_ms = (i + 1) * HOLDER_DELAY_MS;
+		if (pthread_create(&holders[i].thread, NULL, holder_thread,
+				&holders[i])) {
+			diag("holder thread create %u failed", i);
+			exit(1);
+		}
+		/* Only the first half is waited for before the grace period. */
+		if (i >= NR_HOLDERS / 2)
+			continue;
+		while (!CMM_LOAD_SHARED(holders[i].in))
+			(void) poll(NULL, 0, 1);
+	}
+	lttng_ust_urcu_synchronize_rcu();
+	for (i = 0; i < NR_HOLDERS / 2; i++)
+		waited &= CMM_LOAD_SHARED(holders[i].out);
+	for (i = 0; i < NR_HOLDERS; i++) {
+		if (pthread_join(holders[i].thread, NULL)) {
+			diag("holder thread join %u failed", i);
+			exit(1);
+		}
+	}
+	return waited;
+}
+
+static
+void usage(char **argv)
+{
+	printf("Usage: %s <OPTIONS>\n", argv[0]);
+	printf("OPTIONS:\n");
+	printf("        [-r count] (reader threads, default 4)\n");
+	printf("        [-i count] (idle registered threads, default 64)\n");
+	printf("        [-d s] (duration, default 1)\n");
+	printf("\n");
+}
+
+static
+int parse_args(int argc, char **argv)
+{
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (argv[i][0] != '-' || i + 1 >= argc)
+			return -1;
+		switch (argv[i][1]) {
+		case 'r':
+			nr_readers = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'i':
+			nr_idle = strtoul(argv[++i], NULL, 0);
+			break;
+		case 'd':
+			duration = strtoul(argv[++i], NULL, 0);
+			break;
+		default:
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long nr_reads = 0, nr_stale = 0;
+	pthread_t updater, spawner, *idlers;
+	struct reader *readers;
+	struct sigaction sa;
+	unsigned int i;
+
+	if (parse_args(argc, argv)) {
+		usage(argv);
+		exit(1);
+	}
+
+	plan_tests(NUM_TESTS);
+
+	readers = calloc(nr_readers, sizeof(*readers));
+	idlers = calloc(nr_idle, sizeof(*idlers));
+	if (!readers || !idlers) {
+		diag("calloc: %s", strerror(errno));
+		exit(1);
+	}
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = read_handler;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(SIGUSR1, &sa, NULL)) {
+		diag("sigaction: %s", strerror(errno));
+		exit(1);
+	}
+	shared = alloc_obj();
+
+	for (i = 0; i < nr_idle; i++) {
+		if (pthread_create(&idlers[i], NULL, idle_thread, NULL)) {
+			diag("idle thread create %u failed", i);
+			exit(1);
+		}
+	}
+	for (i = 0; i < nr_readers; i++) {
+		if (pthread_create(&readers[i].thread, NULL, reader_thread,
+				&readers[i])) {
+			diag("reader thread create %u failed", i);
+			exit(1);
+		}
+	}
+	if (pthread_create(&updater, NULL, updater_thread, NULL)) {
+		diag("updater thread create failed");
+		exit(1);
+	}
+	if (pthread_create(&spawner, NULL, spawner_thread, NULL)) {
+		diag("spawner thread create failed");
+		exit(1);
+	}
+
+	test_go = 1;
+	sleep(duration);
+	test_stop = 1;
+
+	if (pthread_join(spawner, NULL) || pthread_join(updater, NULL)) {
+		diag("thread join failed");
+		exit(1);
+	}
+	for (i = 0; i < nr_readers; i++) {
+		if (pthread_join(readers[i].thread, NULL)) {
+			diag("reader thread join %u failed", i);
+			exit(1);
+		}
+		nr_reads += readers[i].nr_reads;
+		nr_stale += readers[i].nr_stale;
+	}
+	diag("%llu reads, %lu nested in signals, %llu grace periods, "
+		"%llu threads registered and exited",
+		nr_reads, nr_signal_reads, nr_grace_periods, nr_churned);
+
+	ok(nr_grace_periods > 0 && nr_churned > 0,
+		"Grace periods complete while threads register and exit");
+	ok(nr_reads > 0 && nr_stale == 0,
+		"No reader sees an object reclaimed after a grace period "
+		"(%llu stale)", nr_stale);
+	ok(nr_signal_reads > 0 && nr_signal_stale == 0,
+		"Readers registering from signal handlers see no reclaimed "
+		"object (%lu stale)", nr_signal_stale);
+
+	ok(hold_readers(),
+		"Grace period waits for the readers within critical sections, "
+		"among %u idle registered threads", nr_idle);
+
+	idle_stop = 1;
+	for (i = 0; i < nr_idle; i++) {
+		if (pthread_join(idlers[i], NULL)) {
+			diag("idle thread join %u failed", i);
+			exit(1);
+		}
+	}
+	/* Most registry slots are released by now. */
+	ok(hold_readers(),
+		"Grace period waits for the readers within critical sections, "
+		"once the registered threads exited");
+	while (reclaimed) {
+		struct stress_obj *next = reclaimed->next;
+
+		free(reclaimed);
+		reclaimed = next;
+	}
+	free(shared);
+	free(idlers);
+	free(readers);
+	return exit_status();
+}
@@ -0,0 +1,53 @@
+/*
+ * SPDX-License-Identifier: LGPL-2.1-or-later
+ *
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * Compare the speed of ust_safe_snprintf() with the libc snprintf().
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "common/safe-snprintf.h"
+
+#define DEFAULT_LOOPS	1000000
+
+static
+uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	const char fmt[] = "pid %d, addr %p, count %llu, name %s, value %lu";
+	unsigned long loops = DEFAULT_LOOPS, i;
+	uint64_t start, ust_ns, libc_ns;
+	char buf[128];
+
+	if (argc > 1)
+		loops = strtoul(argv[1], NULL, 10);
+	if (!loops)
+		loops = DEFAULT_LOOPS;
+
+	start = now_ns();
+	for (i = 0; i < loops; i++)
+		ust_safe_snprintf(buf, sizeof(buf), fmt, (int) i, (void *) buf,
+			(unsigned long long) i * 1000003ULL, "bench", i * 37);
+	ust_ns = now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < loops; i++)
+		snprintf(buf, sizeof(buf), fmt, (int) i, (void *) buf,
+			(unsigned long long) i * 1000003ULL, "bench", i * 37);
+	libc_ns = now_ns() - start;
+
+	printf("ust_safe_snprintf: %.1f ns/call\n", (double) ust_ns / loops);
+	printf("libc snprintf:     %.1f ns/call\n", (double) libc_ns / loops);
+	return 0;
+}
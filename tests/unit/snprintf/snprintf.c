@@ -4,23 +4,56 @@
  * Copyright (C) 2009 Pierre-Marc Fournier
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "common/safe-snprintf.h"
 
 #include "tap.h"
 
+/* Compare the integer conversions with the libc ones. */
+static
+int check_integers(void)
+{
+	const int64_t values[] = {
+		0, 1, 9, 10, 99, 100, 101, 999, 1000, 65535, 99999999,
+		100000000, 2147483647, 4294967295LL, 4294967296LL,
+		999999999999999999LL, INT64_MAX, INT64_MIN, -1, -10,
+		-2147483648LL,
+	};
+	char buf[100], expected[100];
+	unsigned int i;
+
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		long long v = values[i];
+
+		ust_safe_snprintf(buf, sizeof(buf), "%lld %llu %d %u %08lld %-12u| %+d",
+			v, (unsigned long long) v, (int) v, (unsigned int) v,
+			v, (unsigned int) v, (int) v);
+		snprintf(expected, sizeof(expected), "%lld %llu %d %u %08lld %-12u| %+d",
+			v, (unsigned long long) v, (int) v, (unsigned int) v,
+			v, (unsigned int) v, (int) v);
+		if (strcmp(buf, expected)) {
+			diag("Got \"%s\", expected \"%s\"", buf, expected);
+			return 0;
+		}
+	}
+	return 1;
+}
+
 int main(void)
 {
 	char buf[100];
 	const char expected_str[] = "header 9999, hello, 005, '    9'";
 	const char test_fmt_str[] = "header %d, %s, %03d, '%*d'";
 
-	plan_tests(1);
+	plan_tests(2);
 
 	ust_safe_snprintf(buf, 99, test_fmt_str, 9999, "hello", 5, 5, 9);
 
 	ok(strcmp(buf, expected_str) == 0, "Got expected output string with format string \"%s\"", test_fmt_str);
 
+	ok(check_integers(), "Decimal integer conversions match the libc ones");
+
 	return exit_status();
 }